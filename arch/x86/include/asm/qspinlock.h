@@ -0,0 +1,33 @@
+#ifndef _ASM_X86_QSPINLOCK_H
+#define _ASM_X86_QSPINLOCK_H
+
+#include <asm-generic/qspinlock_types.h>
+
+#if !defined(CONFIG_X86_32) || \
+	!(defined(CONFIG_X86_OOSTORE) || defined(CONFIG_X86_PPRO_FENCE))
+/*
+ * x86 is TSO: loads aren't reordered with older loads nor stores with
+ * older stores, so the lock hand-overs of the slowpath only need to keep
+ * the compiler in check.
+ */
+#define queued_spin_acquire_barrier()	barrier()
+#define queued_spin_release_barrier()	barrier()
+
+#define	queued_spin_unlock queued_spin_unlock
+/**
+ * queued_spin_unlock - release a queued spinlock
+ * @lock : Pointer to queued spinlock structure
+ *
+ * A plain byte store of the locked byte is enough to release the lock,
+ * the waiters may concurrently be changing the rest of the lock word.
+ */
+static inline void queued_spin_unlock(struct qspinlock *lock)
+{
+	barrier();
+	ACCESS_ONCE(*(u8 *)lock) = 0;
+}
+#endif
+
+#include <asm-generic/qspinlock.h>
+
+#endif /* _ASM_X86_QSPINLOCK_H */
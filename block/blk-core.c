@@ -572,9 +572,11 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 	q->backing_dev_info.ra_pages =
 			(VM_MAX_READAHEAD * 1024) / PAGE_CACHE_SIZE;
 	q->backing_dev_info.state = 0;
-	q->backing_dev_info.capabilities = BDI_CAP_MAP_COPY;
+	q->backing_dev_info.capabilities = BDI_CAP_MAP_COPY |
+					   BDI_CAP_CGROUP_WRITEBACK;
 	q->backing_dev_info.name = "block";
 	q->node = node_id;
+	q->poll_nsec = -1;
 
 	err = bdi_init(&q->backing_dev_info);
 	if (err)
@@ -884,6 +886,10 @@ static struct request *__get_request(struct request_list *rl, int rw_flags,
 	if (may_queue == ELV_MQUEUE_NO)
 		goto rq_starved;
 
+	/* held back to protect the latency of other groups */
+	if (blk_rl_over_depth(rl))
+		goto rq_starved;
+
 	if (rl->count[is_sync]+1 >= queue_congestion_on_threshold(q)) {
 		if (rl->count[is_sync]+1 >= q->nr_requests) {
 			/*
@@ -1843,6 +1849,94 @@ void submit_bio(int rw, struct bio *bio)
 }
 EXPORT_SYMBOL(submit_bio);
 
+/*
+ * Hybrid polling: spinning for the whole completion time of an I/O burns a
+ * CPU for nothing most of that time, so sleep through a part of it first.
+ */
+static bool blk_poll_sleep(struct request_queue *q, ktime_t submitted)
+{
+	struct hrtimer_sleeper hs;
+	unsigned long nsec;
+	ktime_t expires;
+
+	if (q->poll_nsec < 0)
+		return false;
+	nsec = q->poll_nsec ? q->poll_nsec : ACCESS_ONCE(q->poll_mean_nsec) / 2;
+	if (!nsec)
+		return false;
+
+	expires = ktime_add_ns(submitted, nsec);
+	if (ktime_to_ns(ktime_sub(expires, ktime_get())) <= 0)
+		return false;
+
+	hrtimer_init_on_stack(&hs.timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	hrtimer_init_sleeper(&hs, current);
+	hrtimer_start(&hs.timer, expires, HRTIMER_MODE_ABS);
+	if (hs.task)
+		io_schedule();
+	hrtimer_cancel(&hs.timer);
+	destroy_hrtimer_on_stack(&hs.timer);
+	__set_current_state(TASK_RUNNING);
+	return true;
+}
+
+static void blk_poll_account(struct request_queue *q, ktime_t submitted)
+{
+	unsigned long nsec = ktime_to_ns(ktime_sub(ktime_get(), submitted));
+	unsigned long mean = ACCESS_ONCE(q->poll_mean_nsec);
+
+	/* pollers race on this, losing a sample now and then is fine */
+	if (mean)
+		nsec = mean - mean / 8 + nsec / 8;
+	q->poll_mean_nsec = nsec;
+}
+
+/**
+ * blk_poll - poll for an I/O completion instead of sleeping
+ * @q:		the queue the I/O was submitted to
+ * @submitted:	when it was submitted
+ *
+ * Description:
+ *    For synchronous submitters waiting for their I/O: the caller sets its
+ *    task state as for going to sleep and calls in instead, blk_poll()
+ *    then spins on the driver's ->poll_fn until the completion wakes the
+ *    task up.  It gives up when it should reschedule or a signal comes in.
+ *
+ *    Returns true if the task is running again and should check for its
+ *    I/O having completed, false if it should go to sleep after all.
+ */
+bool blk_poll(struct request_queue *q, ktime_t submitted)
+{
+	long state = current->state;
+
+	if (!q->poll_fn || !blk_queue_poll(q))
+		return false;
+
+	if (blk_poll_sleep(q, submitted))
+		return true;
+
+	atomic_long_inc(&q->poll_invoked);
+	while (!need_resched()) {
+		int ret = q->poll_fn(q);
+
+		if (current->state == TASK_RUNNING) {
+			atomic_long_inc(&q->poll_hit);
+			blk_poll_account(q, submitted);
+			return true;
+		}
+		if (signal_pending_state(state, current)) {
+			__set_current_state(TASK_RUNNING);
+			return true;
+		}
+		if (ret < 0)
+			break;
+		cpu_relax();
+	}
+	atomic_long_inc(&q->poll_miss);
+	return false;
+}
+EXPORT_SYMBOL_GPL(blk_poll);
+
 /**
  * blk_rq_check_limits - Helper function to check a request for the queue limit
  * @q:  the queue
@@ -2425,6 +2519,7 @@ static void blk_finish_request(struct request *req, int error)
 
 
 	blk_account_io_done(req);
+	blk_iolatency_done(req);
 
 	if (req->end_io)
 		req->end_io(req, error);
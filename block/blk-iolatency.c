@@ -0,0 +1,393 @@
+/*
+ * Block IO latency targets for cgroups
+ *
+ * A group given a latency target on a device is protected: when the mean
+ * completion latency of its requests over the last window exceeds the
+ * target, every group on the device with a looser target or none at all
+ * gets the number of requests it may have allocated at once halved.  Once
+ * a window goes by without any target missed, the limits grow back a
+ * quarter at a time until they reach nr_requests and are dropped.
+ *
+ * The limits act on the request_list of each group, the same way a full
+ * queue does: allocation fails in __get_request() and the submitter waits
+ * in get_request() for one of the group's requests to be freed.  So this
+ * works below any IO scheduler, but only for request based queues.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/math64.h>
+#include "blk-cgroup.h"
+#include "blk.h"
+
+/*
+ * Latencies are averaged over a window of two halves; every half window
+ * the averages are checked and the older half is dropped.
+ */
+#define IOLAT_HALF_WINDOW	(50 * NSEC_PER_MSEC)
+
+static struct blkcg_policy blkcg_policy_iolat;
+
+struct iolat_window {
+	u64			lat_sum;
+	unsigned int		nr_ios;
+};
+
+struct iolat_grp {
+	/* must be the first member */
+	struct blkg_policy_data pd;
+
+	/* target mean latency in usecs, 0 if the group has none */
+	u64			target;
+
+	struct iolat_window	win[2];
+
+	/* mean latency over the last full window, in nsecs */
+	u64			avg_ns;
+
+	/* times the group's depth was cut for others */
+	struct blkg_stat	throttled;
+};
+
+struct iolat_data {
+	struct request_queue	*queue;
+
+	/* groups with a target, nothing is tracked without any */
+	unsigned int		nr_targets;
+
+	/* index of the half window being filled and when it started */
+	int			cur;
+	u64			win_start;
+};
+
+static inline struct iolat_grp *pd_to_ig(struct blkg_policy_data *pd)
+{
+	return pd ? container_of(pd, struct iolat_grp, pd) : NULL;
+}
+
+static inline struct iolat_grp *blkg_to_ig(struct blkcg_gq *blkg)
+{
+	return pd_to_ig(blkg_to_pd(blkg, &blkcg_policy_iolat));
+}
+
+/* requests of the root group come from the queue's own request_list */
+static inline struct request_list *blkg_to_rl(struct blkcg_gq *blkg)
+{
+	if (blkg->blkcg == &blkcg_root)
+		return &blkg->q->root_rl;
+	return &blkg->rl;
+}
+
+static void iolat_set_depth(struct request_list *rl, unsigned int depth)
+{
+	bool grown = !depth || (rl->max_depth && depth > rl->max_depth);
+
+	rl->max_depth = depth;
+	if (!grown)
+		return;
+
+	if (waitqueue_active(&rl->wait[BLK_RW_SYNC]))
+		wake_up(&rl->wait[BLK_RW_SYNC]);
+	if (waitqueue_active(&rl->wait[BLK_RW_ASYNC]))
+		wake_up(&rl->wait[BLK_RW_ASYNC]);
+}
+
+static void iolat_scale_down(struct iolat_grp *ig, struct request_list *rl)
+{
+	unsigned int depth = rl->max_depth;
+
+	/* start from what the group has out now */
+	if (!depth)
+		depth = max(rl->count[BLK_RW_SYNC] + rl->count[BLK_RW_ASYNC], 1);
+
+	iolat_set_depth(rl, max(depth / 2, 1U));
+	blkg_stat_add(&ig->throttled, 1);
+}
+
+static void iolat_scale_up(struct request_list *rl)
+{
+	unsigned int depth = rl->max_depth;
+
+	depth += max(depth / 4, 1U);
+	if (depth >= rl->q->nr_requests)
+		depth = 0;
+	iolat_set_depth(rl, depth);
+}
+
+/*
+ * A half window is over: work out the means over the whole window, adjust
+ * the depths and drop the older half.  Called under queue_lock.
+ */
+static void iolat_roll_window(struct iolat_data *id, u64 now)
+{
+	struct request_queue *q = id->queue;
+	struct blkcg_gq *blkg;
+	int old = id->cur ^ 1;
+	u64 missed = 0;
+
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		struct iolat_grp *ig = blkg_to_ig(blkg);
+		unsigned int nr = ig->win[0].nr_ios + ig->win[1].nr_ios;
+
+		if (nr) {
+			ig->avg_ns = div_u64(ig->win[0].lat_sum +
+					     ig->win[1].lat_sum, nr);
+			if (ig->target &&
+			    ig->avg_ns > ig->target * NSEC_PER_USEC &&
+			    (!missed || ig->target < missed))
+				missed = ig->target;
+		}
+		ig->win[old].lat_sum = 0;
+		ig->win[old].nr_ios = 0;
+	}
+
+	list_for_each_entry(blkg, &q->blkg_list, q_node) {
+		struct iolat_grp *ig = blkg_to_ig(blkg);
+		struct request_list *rl = blkg_to_rl(blkg);
+
+		if (missed && (!ig->target || ig->target > missed))
+			iolat_scale_down(ig, rl);
+		else if (rl->max_depth)
+			iolat_scale_up(rl);
+	}
+
+	id->cur = old;
+	id->win_start = now;
+}
+
+/**
+ * blk_iolatency_done - account a completed request
+ * @rq: the request
+ *
+ * Called from blk_finish_request() with queue_lock held.
+ */
+void blk_iolatency_done(struct request *rq)
+{
+	struct iolat_data *id = rq->q->iolat;
+	struct iolat_window *win;
+	struct iolat_grp *ig;
+	u64 now, start;
+
+	if (likely(!id->nr_targets))
+		return;
+	if (!(rq->cmd_flags & REQ_ALLOCED) || rq->cmd_type != REQ_TYPE_FS)
+		return;
+
+	ig = blkg_to_ig(blk_rq_rl(rq)->blkg);
+	if (!ig)
+		return;
+
+	now = sched_clock();
+	start = rq_start_time_ns(rq);
+
+	win = &ig->win[id->cur];
+	win->lat_sum += now > start ? now - start : 0;
+	win->nr_ios++;
+
+	if (now - id->win_start >= IOLAT_HALF_WINDOW)
+		iolat_roll_window(id, now);
+}
+
+/* forget all limits, called under queue_lock when the last target goes */
+static void iolat_reset_depths(struct request_queue *q)
+{
+	struct blkcg_gq *blkg;
+
+	list_for_each_entry(blkg, &q->blkg_list, q_node)
+		iolat_set_depth(blkg_to_rl(blkg), 0);
+}
+
+static void iolat_pd_init(struct blkcg_gq *blkg)
+{
+	struct iolat_grp *ig = blkg_to_ig(blkg);
+
+	ig->target = 0;
+	ig->avg_ns = 0;
+	memset(ig->win, 0, sizeof(ig->win));
+	blkg_stat_reset(&ig->throttled);
+}
+
+static void iolat_pd_offline(struct blkcg_gq *blkg)
+{
+	struct iolat_grp *ig = blkg_to_ig(blkg);
+	struct iolat_data *id = blkg->q->iolat;
+
+	if (ig->target && !--id->nr_targets)
+		iolat_reset_depths(blkg->q);
+	ig->target = 0;
+}
+
+static void iolat_pd_reset_stats(struct blkcg_gq *blkg)
+{
+	struct iolat_grp *ig = blkg_to_ig(blkg);
+
+	blkg_stat_reset(&ig->throttled);
+}
+
+static u64 ig_prfill_target(struct seq_file *sf, struct blkg_policy_data *pd,
+			    int off)
+{
+	struct iolat_grp *ig = pd_to_ig(pd);
+
+	if (!ig->target)
+		return 0;
+	return __blkg_prfill_u64(sf, pd, ig->target);
+}
+
+static u64 ig_prfill_avg(struct seq_file *sf, struct blkg_policy_data *pd,
+			 int off)
+{
+	struct iolat_grp *ig = pd_to_ig(pd);
+
+	if (!ig->avg_ns)
+		return 0;
+	return __blkg_prfill_u64(sf, pd, div_u64(ig->avg_ns, NSEC_PER_USEC));
+}
+
+static u64 ig_prfill_depth(struct seq_file *sf, struct blkg_policy_data *pd,
+			   int off)
+{
+	struct request_list *rl = blkg_to_rl(pd_to_blkg(pd));
+
+	if (!rl->max_depth)
+		return 0;
+	return __blkg_prfill_u64(sf, pd, rl->max_depth);
+}
+
+static int ig_print(struct cgroup *cgrp, struct cftype *cft,
+		    struct seq_file *sf)
+{
+	u64 (*prfill)(struct seq_file *, struct blkg_policy_data *, int);
+
+	switch (cft->private) {
+	case 0:
+		prfill = ig_prfill_target;
+		break;
+	case 1:
+		prfill = ig_prfill_avg;
+		break;
+	default:
+		prfill = ig_prfill_depth;
+		break;
+	}
+	blkcg_print_blkgs(sf, cgroup_to_blkcg(cgrp), prfill,
+			  &blkcg_policy_iolat, 0, false);
+	return 0;
+}
+
+static int ig_print_stat(struct cgroup *cgrp, struct cftype *cft,
+			 struct seq_file *sf)
+{
+	blkcg_print_blkgs(sf, cgroup_to_blkcg(cgrp), blkg_prfill_stat,
+			  &blkcg_policy_iolat, cft->private, true);
+	return 0;
+}
+
+static int ig_set_target(struct cgroup *cgrp, struct cftype *cft,
+			 const char *buf)
+{
+	struct blkcg *blkcg = cgroup_to_blkcg(cgrp);
+	struct blkg_conf_ctx ctx;
+	struct request_queue *q;
+	struct iolat_data *id;
+	struct iolat_grp *ig;
+	int ret;
+
+	ret = blkg_conf_prep(blkcg, &blkcg_policy_iolat, buf, &ctx);
+	if (ret)
+		return ret;
+
+	q = ctx.blkg->q;
+	id = q->iolat;
+	ig = blkg_to_ig(ctx.blkg);
+
+	/* depths are enforced on request allocation */
+	ret = -EINVAL;
+	if (!q->request_fn)
+		goto out;
+
+	if (ctx.v && !ig->target) {
+		if (!id->nr_targets++) {
+			id->cur = 0;
+			id->win_start = sched_clock();
+		}
+	} else if (!ctx.v && ig->target) {
+		if (!--id->nr_targets)
+			iolat_reset_depths(q);
+	}
+	ig->target = ctx.v;
+	ret = 0;
+out:
+	blkg_conf_finish(&ctx);
+	return ret;
+}
+
+static struct cftype iolat_files[] = {
+	{
+		.name = "latency.target_device",
+		.private = 0,
+		.read_seq_string = ig_print,
+		.write_string = ig_set_target,
+		.max_write_len = 256,
+	},
+	{
+		.name = "latency.avg",
+		.private = 1,
+		.read_seq_string = ig_print,
+	},
+	{
+		.name = "latency.depth",
+		.private = 2,
+		.read_seq_string = ig_print,
+	},
+	{
+		.name = "latency.throttled",
+		.private = offsetof(struct iolat_grp, throttled),
+		.read_seq_string = ig_print_stat,
+	},
+	{ }	/* terminate */
+};
+
+static struct blkcg_policy blkcg_policy_iolat = {
+	.pd_size		= sizeof(struct iolat_grp),
+	.cftypes		= iolat_files,
+
+	.pd_init_fn		= iolat_pd_init,
+	.pd_offline_fn		= iolat_pd_offline,
+	.pd_reset_stats_fn	= iolat_pd_reset_stats,
+};
+
+int blk_iolatency_init(struct request_queue *q)
+{
+	struct iolat_data *id;
+	int ret;
+
+	id = kzalloc_node(sizeof(*id), GFP_KERNEL, q->node);
+	if (!id)
+		return -ENOMEM;
+
+	id->queue = q;
+	q->iolat = id;
+
+	ret = blkcg_activate_policy(q, &blkcg_policy_iolat);
+	if (ret) {
+		q->iolat = NULL;
+		kfree(id);
+	}
+	return ret;
+}
+
+void blk_iolatency_exit(struct request_queue *q)
+{
+	BUG_ON(!q->iolat);
+	blkcg_deactivate_policy(q, &blkcg_policy_iolat);
+	kfree(q->iolat);
+}
+
+static int __init iolat_init(void)
+{
+	return blkcg_policy_register(&blkcg_policy_iolat);
+}
+
+module_init(iolat_init);
@@ -99,6 +99,21 @@ void blk_queue_lld_busy(struct request_queue *q, lld_busy_fn *fn)
 }
 EXPORT_SYMBOL_GPL(blk_queue_lld_busy);
 
+/**
+ * blk_queue_poll_fn - set driver's completion polling function
+ * @q:  queue
+ * @fn: function that reaps completions without waiting for an interrupt
+ *
+ * @fn returns a positive value if it completed anything, 0 if not and a
+ * negative one if polling is pointless for now.  It is called from process
+ * context by blk_poll(), which has to be switched on in sysfs.
+ */
+void blk_queue_poll_fn(struct request_queue *q, poll_fn *fn)
+{
+	q->poll_fn = fn;
+}
+EXPORT_SYMBOL_GPL(blk_queue_poll_fn);
+
 /**
  * blk_set_default_limits - reset limits to default values
  * @lim:  the queue_limits structure to reset
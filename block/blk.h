@@ -230,4 +230,28 @@ static inline int blk_throtl_init(struct request_queue *q) { return 0; }
 static inline void blk_throtl_exit(struct request_queue *q) { }
 #endif /* CONFIG_BLK_DEV_THROTTLING */
 
+/*
+ * Internal latency controller interface
+ */
+#ifdef CONFIG_BLK_CGROUP_IOLATENCY
+extern void blk_iolatency_done(struct request *rq);
+extern int blk_iolatency_init(struct request_queue *q);
+extern void blk_iolatency_exit(struct request_queue *q);
+
+static inline bool blk_rl_over_depth(struct request_list *rl)
+{
+	return rl->max_depth &&
+		rl->count[BLK_RW_SYNC] + rl->count[BLK_RW_ASYNC] >=
+		rl->max_depth;
+}
+#else /* CONFIG_BLK_CGROUP_IOLATENCY */
+static inline void blk_iolatency_done(struct request *rq) { }
+static inline int blk_iolatency_init(struct request_queue *q) { return 0; }
+static inline void blk_iolatency_exit(struct request_queue *q) { }
+static inline bool blk_rl_over_depth(struct request_list *rl)
+{
+	return false;
+}
+#endif /* CONFIG_BLK_CGROUP_IOLATENCY */
+
 #endif /* BLK_INTERNAL_H */
@@ -256,6 +256,10 @@ struct cfq_group {
 	int dispatched;
 	struct cfq_ttime ttime;
 	struct cfqg_stats stats;
+
+	/* async queue for each priority case */
+	struct cfq_queue *async_cfqq[2][IOPRIO_BE_NR];
+	struct cfq_queue *async_idle_cfqq;
 };
 
 struct cfq_io_cq {
@@ -321,12 +325,6 @@ struct cfq_data {
 	struct cfq_queue *active_queue;
 	struct cfq_io_cq *active_cic;
 
-	/*
-	 * async queue for each priority case
-	 */
-	struct cfq_queue *async_cfqq[2][IOPRIO_BE_NR];
-	struct cfq_queue *async_idle_cfqq;
-
 	sector_t last_position;
 
 	/*
@@ -1372,10 +1370,6 @@ static struct cfq_group *cfq_lookup_create_cfqg(struct cfq_data *cfqd,
 
 static void cfq_link_cfqq_cfqg(struct cfq_queue *cfqq, struct cfq_group *cfqg)
 {
-	/* Currently, all async queues are mapped to root group */
-	if (!cfq_cfqq_sync(cfqq))
-		cfqg = cfqq->cfqd->root_group;
-
 	cfqq->cfqg = cfqg;
 	/* cfqq reference on cfqg */
 	cfqg_get(cfqg);
@@ -3141,7 +3135,7 @@ static void cfq_init_cfqq(struct cfq_data *cfqd, struct cfq_queue *cfqq,
 static void check_blkcg_changed(struct cfq_io_cq *cic, struct bio *bio)
 {
 	struct cfq_data *cfqd = cic_to_cfqd(cic);
-	struct cfq_queue *sync_cfqq;
+	struct cfq_queue *cfqq;
 	uint64_t id;
 
 	rcu_read_lock();
@@ -3155,15 +3149,23 @@ static void check_blkcg_changed(struct cfq_io_cq *cic, struct bio *bio)
 	if (unlikely(!cfqd) || likely(cic->blkcg_id == id))
 		return;
 
-	sync_cfqq = cic_to_cfqq(cic, 1);
-	if (sync_cfqq) {
-		/*
-		 * Drop reference to sync queue. A new sync queue will be
-		 * assigned in new group upon arrival of a fresh request.
-		 */
-		cfq_log_cfqq(cfqd, sync_cfqq, "changed cgroup");
+	/*
+	 * Drop references to the queues.  New ones will be assigned in the
+	 * new group upon arrival of a fresh request.  Async queues are per
+	 * group too, and a flusher writing back for several cgroups ends up
+	 * here whenever the blkcg of its bios changes.
+	 */
+	cfqq = cic_to_cfqq(cic, 1);
+	if (cfqq) {
+		cfq_log_cfqq(cfqd, cfqq, "changed cgroup");
 		cic_set_cfqq(cic, NULL, 1);
-		cfq_put_queue(sync_cfqq);
+		cfq_put_queue(cfqq);
+	}
+
+	cfqq = cic_to_cfqq(cic, 0);
+	if (cfqq) {
+		cic_set_cfqq(cic, NULL, 0);
+		cfq_put_queue(cfqq);
 	}
 
 	cic->blkcg_id = id;
@@ -3228,18 +3230,18 @@ retry:
 }
 
 static struct cfq_queue **
-cfq_async_queue_prio(struct cfq_data *cfqd, int ioprio_class, int ioprio)
+cfq_async_queue_prio(struct cfq_group *cfqg, int ioprio_class, int ioprio)
 {
 	switch (ioprio_class) {
 	case IOPRIO_CLASS_RT:
-		return &cfqd->async_cfqq[0][ioprio];
+		return &cfqg->async_cfqq[0][ioprio];
 	case IOPRIO_CLASS_NONE:
 		ioprio = IOPRIO_NORM;
 		/* fall through */
 	case IOPRIO_CLASS_BE:
-		return &cfqd->async_cfqq[1][ioprio];
+		return &cfqg->async_cfqq[1][ioprio];
 	case IOPRIO_CLASS_IDLE:
-		return &cfqd->async_idle_cfqq;
+		return &cfqg->async_idle_cfqq;
 	default:
 		BUG();
 	}
@@ -3255,17 +3257,38 @@ cfq_get_queue(struct cfq_data *cfqd, bool is_sync, struct cfq_io_cq *cic,
 	struct cfq_queue *cfqq = NULL;
 
 	if (!is_sync) {
-		async_cfqq = cfq_async_queue_prio(cfqd, ioprio_class, ioprio);
-		cfqq = *async_cfqq;
+		struct cfq_group *cfqg;
+
+		rcu_read_lock();
+		cfqg = cfq_lookup_create_cfqg(cfqd, bio_blkcg(bio));
+		if (cfqg) {
+			async_cfqq = cfq_async_queue_prio(cfqg, ioprio_class,
+							  ioprio);
+			cfqq = *async_cfqq;
+		}
+		rcu_read_unlock();
 	}
 
-	if (!cfqq)
+	if (!cfqq) {
 		cfqq = cfq_find_alloc_queue(cfqd, is_sync, cic, bio, gfp_mask);
 
+		/*
+		 * cfq_find_alloc_queue() may have dropped the queue_lock,
+		 * find the slot again through the group the queue is
+		 * linked to, which is alive as the lock is held since.
+		 */
+		if (!is_sync && cfqq != &cfqd->oom_cfqq)
+			async_cfqq = cfq_async_queue_prio(cfqq->cfqg,
+							  ioprio_class, ioprio);
+		else
+			async_cfqq = NULL;
+	}
+
 	/*
-	 * pin the queue now that it's allocated, scheduler exit will prune it
+	 * pin the queue now that it's allocated, group offline or
+	 * scheduler exit will prune it
 	 */
-	if (!is_sync && !(*async_cfqq)) {
+	if (async_cfqq && !(*async_cfqq)) {
 		cfqq->ref++;
 		*async_cfqq = cfqq;
 	}
@@ -3918,19 +3941,45 @@ static void cfq_shutdown_timer_wq(struct cfq_data *cfqd)
 	cancel_work_sync(&cfqd->unplug_work);
 }
 
-static void cfq_put_async_queues(struct cfq_data *cfqd)
+static void cfqg_put_async_queues(struct cfq_group *cfqg)
 {
 	int i;
 
 	for (i = 0; i < IOPRIO_BE_NR; i++) {
-		if (cfqd->async_cfqq[0][i])
-			cfq_put_queue(cfqd->async_cfqq[0][i]);
-		if (cfqd->async_cfqq[1][i])
-			cfq_put_queue(cfqd->async_cfqq[1][i]);
+		if (cfqg->async_cfqq[0][i]) {
+			cfq_put_queue(cfqg->async_cfqq[0][i]);
+			cfqg->async_cfqq[0][i] = NULL;
+		}
+		if (cfqg->async_cfqq[1][i]) {
+			cfq_put_queue(cfqg->async_cfqq[1][i]);
+			cfqg->async_cfqq[1][i] = NULL;
+		}
+	}
+
+	if (cfqg->async_idle_cfqq) {
+		cfq_put_queue(cfqg->async_idle_cfqq);
+		cfqg->async_idle_cfqq = NULL;
 	}
+}
 
-	if (cfqd->async_idle_cfqq)
-		cfq_put_queue(cfqd->async_idle_cfqq);
+#ifdef CONFIG_CFQ_GROUP_IOSCHED
+/* the group is going away, its async queues hold references on it */
+static void cfq_pd_offline(struct blkcg_gq *blkg)
+{
+	cfqg_put_async_queues(blkg_to_cfqg(blkg));
+}
+#endif
+
+static void cfq_put_async_queues(struct cfq_data *cfqd)
+{
+#ifdef CONFIG_CFQ_GROUP_IOSCHED
+	struct blkcg_gq *blkg;
+
+	list_for_each_entry(blkg, &cfqd->queue->blkg_list, q_node)
+		cfqg_put_async_queues(blkg_to_cfqg(blkg));
+#else
+	cfqg_put_async_queues(cfqd->root_group);
+#endif
 }
 
 static void cfq_exit_queue(struct elevator_queue *e)
@@ -4176,6 +4225,7 @@ static struct blkcg_policy blkcg_policy_cfq = {
 	.cftypes		= cfq_blkcg_files,
 
 	.pd_init_fn		= cfq_pd_init,
+	.pd_offline_fn		= cfq_pd_offline,
 	.pd_reset_stats_fn	= cfq_pd_reset_stats,
 };
 #endif
@@ -790,6 +790,8 @@ int elv_register_queue(struct request_queue *q)
 		}
 		kobject_uevent(&e->kobj, KOBJ_ADD);
 		e->registered = 1;
+		if (e->type->ops.elevator_registered_fn)
+			e->type->ops.elevator_registered_fn(q);
 	}
 	return error;
 }
@@ -800,6 +802,8 @@ void elv_unregister_queue(struct request_queue *q)
 	if (q) {
 		struct elevator_queue *e = q->elevator;
 
+		if (e->registered && e->type->ops.elevator_unregistered_fn)
+			e->type->ops.elevator_unregistered_fn(q);
 		kobject_uevent(&e->kobj, KOBJ_REMOVE);
 		kobject_del(&e->kobj);
 		e->registered = 0;
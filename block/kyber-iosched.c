@@ -0,0 +1,633 @@
+/*
+ *  Kyber, a token based IO scheduler for fast devices
+ *
+ *  Requests are sorted into four domains: reads, synchronous writes, other
+ *  writes and discards.  Each domain has a pool of tokens limiting how many
+ *  of its requests can be out at the device: a request takes one when it is
+ *  dispatched and gives it back when it completes.  Within a domain requests
+ *  are served in FIFO order and the domains take turns dispatching a batch
+ *  each, so scheduling is O(1) per request.
+ *
+ *  The latency of reads and synchronous writes from issue to completion is
+ *  collected in per-cpu histograms.  Every 100ms the 99th percentile of each
+ *  is checked against its target and the token pools are resized: a domain
+ *  meeting its target gives up depth while the other misses its own, and
+ *  other writes and discards are cut back whenever either target is missed.
+ */
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/bio.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/timer.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+enum {
+	KYBER_READ,
+	KYBER_SYNC_WRITE,
+	KYBER_ASYNC_WRITE,
+	KYBER_DISCARD,
+	KYBER_NUM_DOMAINS,
+};
+
+static const char *kyber_domain_names[KYBER_NUM_DOMAINS] = {
+	[KYBER_READ]		= "read",
+	[KYBER_SYNC_WRITE]	= "sync_write",
+	[KYBER_ASYNC_WRITE]	= "async_write",
+	[KYBER_DISCARD]		= "discard",
+};
+
+/* most tokens each domain can get */
+static const unsigned int kyber_depth[KYBER_NUM_DOMAINS] = {
+	[KYBER_READ]		= 256,
+	[KYBER_SYNC_WRITE]	= 128,
+	[KYBER_ASYNC_WRITE]	= 64,
+	[KYBER_DISCARD]		= 16,
+};
+
+/* requests dispatched from a domain before moving on to the next */
+static const unsigned int kyber_batch_size[KYBER_NUM_DOMAINS] = {
+	[KYBER_READ]		= 16,
+	[KYBER_SYNC_WRITE]	= 8,
+	[KYBER_ASYNC_WRITE]	= 8,
+	[KYBER_DISCARD]		= 1,
+};
+
+/*
+ * tunables
+ */
+static const int read_lat_usec = 2000;		/* p99 target for reads */
+static const int write_lat_usec = 10000;	/* p99 target for sync writes */
+
+/* latencies are kept for the read and sync write domains only */
+#define KYBER_NUM_LAT		2
+
+/*
+ * Histogram buckets are a quarter of the target wide: the first four are
+ * within the target, the last one takes everything from 1.75 times it.
+ */
+#define KYBER_LATENCY_SHIFT	2
+#define KYBER_GOOD_BUCKETS	(1 << KYBER_LATENCY_SHIFT)
+#define KYBER_LATENCY_BUCKETS	(2 << KYBER_LATENCY_SHIFT)
+
+/* good looking histograms with fewer samples are left to fill up */
+#define KYBER_MIN_SAMPLES	100
+
+#define KYBER_TIMER_PERIOD	(HZ / 10)
+
+enum {
+	KYBER_LAT_NONE,
+	KYBER_LAT_GREAT,	/* p99 within half the target */
+	KYBER_LAT_GOOD,		/* within the target */
+	KYBER_LAT_BAD,		/* within 1.5 times the target */
+	KYBER_LAT_AWFUL,
+};
+
+struct kyber_cpu_latency {
+	atomic_t buckets[KYBER_NUM_LAT][KYBER_LATENCY_BUCKETS];
+};
+
+struct kyber_data {
+	struct request_queue *queue;
+
+	/* requests waiting in each domain, in FIFO order */
+	struct list_head rqs[KYBER_NUM_DOMAINS];
+
+	/* token pools */
+	unsigned int depth[KYBER_NUM_DOMAINS];
+	unsigned int in_flight[KYBER_NUM_DOMAINS];
+
+	/* domain being served and requests dispatched from it so far */
+	unsigned int cur_domain;
+	unsigned int batching;
+
+	/* a request was held back for want of a token */
+	bool starved;
+
+	int lat_usec[KYBER_NUM_LAT];
+
+	struct kyber_cpu_latency __percpu *cpu_latency;
+	struct timer_list timer;
+
+	/* samples not acted on yet, and all samples since init */
+	unsigned int lat_pending[KYBER_NUM_LAT][KYBER_LATENCY_BUCKETS];
+	u64 lat_total[KYBER_NUM_LAT][KYBER_LATENCY_BUCKETS];
+
+	struct dentry *debugfs_dir;
+};
+
+static struct dentry *kyber_debugfs_root;
+
+/*
+ * The domain of a request and the time it was issued to the driver are
+ * kept in its elevator private fields; the issue time is truncated to an
+ * unsigned long, which still measures up to four seconds on 32 bit.
+ */
+static inline unsigned int kyber_rq_domain(struct request *rq)
+{
+	return (unsigned long)rq->elv.priv[0];
+}
+
+static unsigned int kyber_sched_domain(struct request *rq)
+{
+	if (rq->cmd_flags & REQ_DISCARD)
+		return KYBER_DISCARD;
+	if (rq_data_dir(rq) == READ)
+		return KYBER_READ;
+	if (rq_is_sync(rq))
+		return KYBER_SYNC_WRITE;
+	return KYBER_ASYNC_WRITE;
+}
+
+static void kyber_add_request(struct request_queue *q, struct request *rq)
+{
+	struct kyber_data *kqd = q->elevator->elevator_data;
+	unsigned int domain = kyber_sched_domain(rq);
+
+	rq->elv.priv[0] = (void *)(unsigned long)domain;
+	list_add_tail(&rq->queuelist, &kqd->rqs[domain]);
+}
+
+static void kyber_merged_requests(struct request_queue *q, struct request *rq,
+				  struct request *next)
+{
+	list_del_init(&next->queuelist);
+}
+
+static int kyber_dispatch(struct request_queue *q, int force)
+{
+	struct kyber_data *kqd = q->elevator->elevator_data;
+	unsigned int i, domain;
+	struct request *rq;
+
+	for (i = 0; i < KYBER_NUM_DOMAINS; i++) {
+		domain = (kqd->cur_domain + i) % KYBER_NUM_DOMAINS;
+
+		if (list_empty(&kqd->rqs[domain]))
+			continue;
+		if (kqd->in_flight[domain] >= kqd->depth[domain] && !force) {
+			kqd->starved = true;
+			continue;
+		}
+
+		if (domain != kqd->cur_domain) {
+			kqd->cur_domain = domain;
+			kqd->batching = 0;
+		}
+
+		rq = list_first_entry(&kqd->rqs[domain], struct request,
+				      queuelist);
+		list_del_init(&rq->queuelist);
+		kqd->in_flight[domain]++;
+		elv_dispatch_add_tail(q, rq);
+
+		if (++kqd->batching >= kyber_batch_size[domain]) {
+			kqd->cur_domain = (domain + 1) % KYBER_NUM_DOMAINS;
+			kqd->batching = 0;
+		}
+		return 1;
+	}
+
+	return 0;
+}
+
+static void kyber_activate_request(struct request_queue *q,
+				   struct request *rq)
+{
+	rq->elv.priv[1] = (void *)(unsigned long)ktime_to_ns(ktime_get());
+}
+
+static void kyber_completed_request(struct request_queue *q,
+				    struct request *rq)
+{
+	struct kyber_data *kqd = q->elevator->elevator_data;
+	unsigned int domain = kyber_rq_domain(rq);
+
+	kqd->in_flight[domain]--;
+
+	if (domain < KYBER_NUM_LAT) {
+		unsigned long now = ktime_to_ns(ktime_get());
+		unsigned long lat = now - (unsigned long)rq->elv.priv[1];
+		struct kyber_cpu_latency *cl = this_cpu_ptr(kqd->cpu_latency);
+		unsigned long width;
+		unsigned int bucket;
+
+		width = max_t(unsigned long, kqd->lat_usec[domain] *
+			      NSEC_PER_USEC >> KYBER_LATENCY_SHIFT, 1);
+		bucket = min(lat / width, KYBER_LATENCY_BUCKETS - 1UL);
+		atomic_inc(&cl->buckets[domain][bucket]);
+	}
+
+	if (!timer_pending(&kqd->timer))
+		mod_timer(&kqd->timer, jiffies + KYBER_TIMER_PERIOD);
+
+	if (kqd->starved) {
+		kqd->starved = false;
+		blk_run_queue_async(q);
+	}
+}
+
+static struct request *
+kyber_former_request(struct request_queue *q, struct request *rq)
+{
+	struct kyber_data *kqd = q->elevator->elevator_data;
+
+	if (rq->queuelist.prev == &kqd->rqs[kyber_rq_domain(rq)])
+		return NULL;
+	return list_entry(rq->queuelist.prev, struct request, queuelist);
+}
+
+static struct request *
+kyber_latter_request(struct request_queue *q, struct request *rq)
+{
+	struct kyber_data *kqd = q->elevator->elevator_data;
+
+	if (rq->queuelist.next == &kqd->rqs[kyber_rq_domain(rq)])
+		return NULL;
+	return list_entry(rq->queuelist.next, struct request, queuelist);
+}
+
+/*
+ * Rate the p99 latency seen in the samples pending for @lat and consume
+ * them, unless there are too few to tell.
+ */
+static int kyber_lat_status(struct kyber_data *kqd, int lat)
+{
+	unsigned int *buckets = kqd->lat_pending[lat];
+	unsigned int samples = 0, sum = 0, p99;
+	int bucket;
+
+	for (bucket = 0; bucket < KYBER_LATENCY_BUCKETS; bucket++)
+		samples += buckets[bucket];
+	if (!samples)
+		return KYBER_LAT_NONE;
+
+	p99 = DIV_ROUND_UP(samples * 99, 100);
+	for (bucket = 0; bucket < KYBER_LATENCY_BUCKETS - 1; bucket++) {
+		sum += buckets[bucket];
+		if (sum >= p99)
+			break;
+	}
+
+	if (bucket < KYBER_GOOD_BUCKETS && samples < KYBER_MIN_SAMPLES)
+		return KYBER_LAT_NONE;
+	memset(buckets, 0, sizeof(kqd->lat_pending[lat]));
+
+	if (bucket < KYBER_GOOD_BUCKETS / 2)
+		return KYBER_LAT_GREAT;
+	if (bucket < KYBER_GOOD_BUCKETS)
+		return KYBER_LAT_GOOD;
+	if (bucket < KYBER_GOOD_BUCKETS + KYBER_GOOD_BUCKETS / 2)
+		return KYBER_LAT_BAD;
+	return KYBER_LAT_AWFUL;
+}
+
+static void kyber_set_depth(struct kyber_data *kqd, unsigned int domain,
+			    unsigned int depth)
+{
+	kqd->depth[domain] = clamp(depth, 1U, kyber_depth[domain]);
+}
+
+/*
+ * Reads and sync writes trade depth: only when one meets its target and
+ * the other does not is anything changed.
+ */
+static void kyber_adjust_rw_depth(struct kyber_data *kqd, unsigned int domain,
+				  int this_status, int other_status)
+{
+	unsigned int depth = kqd->depth[domain];
+	bool this_good = this_status <= KYBER_LAT_GOOD;
+	bool other_good = other_status <= KYBER_LAT_GOOD;
+
+	if (this_status == KYBER_LAT_NONE || this_good == other_good)
+		return;
+
+	switch (this_status) {
+	case KYBER_LAT_GREAT:
+		if (other_status == KYBER_LAT_AWFUL)
+			depth /= 2;
+		else
+			depth -= max(depth / 4, 1U);
+		break;
+	case KYBER_LAT_GOOD:
+		if (other_status == KYBER_LAT_AWFUL)
+			depth -= max(depth / 4, 1U);
+		else
+			depth -= max(depth / 8, 1U);
+		break;
+	case KYBER_LAT_BAD:
+		depth++;
+		break;
+	case KYBER_LAT_AWFUL:
+		depth += other_status == KYBER_LAT_GREAT ? 2 : 1;
+		break;
+	}
+	kyber_set_depth(kqd, domain, depth);
+}
+
+/* other writes and discards follow the worse of the two */
+static void kyber_adjust_other_depth(struct kyber_data *kqd,
+				     unsigned int domain, int status)
+{
+	unsigned int depth = kqd->depth[domain];
+
+	switch (status) {
+	case KYBER_LAT_NONE:
+	case KYBER_LAT_GREAT:
+		depth += 2;
+		break;
+	case KYBER_LAT_GOOD:
+		depth++;
+		break;
+	case KYBER_LAT_BAD:
+		depth -= max(depth / 4, 1U);
+		break;
+	case KYBER_LAT_AWFUL:
+		depth /= 2;
+		break;
+	}
+	kyber_set_depth(kqd, domain, depth);
+}
+
+static void kyber_timer_fn(unsigned long data)
+{
+	struct kyber_data *kqd = (struct kyber_data *)data;
+	struct request_queue *q = kqd->queue;
+	int status[KYBER_NUM_LAT], worst;
+	unsigned long flags;
+	int cpu, lat, bucket;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	for_each_possible_cpu(cpu) {
+		struct kyber_cpu_latency *cl;
+
+		cl = per_cpu_ptr(kqd->cpu_latency, cpu);
+		for (lat = 0; lat < KYBER_NUM_LAT; lat++) {
+			for (bucket = 0; bucket < KYBER_LATENCY_BUCKETS;
+			     bucket++) {
+				unsigned int n;
+
+				n = atomic_xchg(&cl->buckets[lat][bucket], 0);
+				kqd->lat_pending[lat][bucket] += n;
+				kqd->lat_total[lat][bucket] += n;
+			}
+		}
+	}
+
+	for (lat = 0; lat < KYBER_NUM_LAT; lat++)
+		status[lat] = kyber_lat_status(kqd, lat);
+	worst = max(status[KYBER_READ], status[KYBER_SYNC_WRITE]);
+
+	kyber_adjust_rw_depth(kqd, KYBER_READ, status[KYBER_READ],
+			      status[KYBER_SYNC_WRITE]);
+	kyber_adjust_rw_depth(kqd, KYBER_SYNC_WRITE, status[KYBER_SYNC_WRITE],
+			      status[KYBER_READ]);
+	kyber_adjust_other_depth(kqd, KYBER_ASYNC_WRITE, worst);
+	kyber_adjust_other_depth(kqd, KYBER_DISCARD, worst);
+
+	if (kqd->starved && !blk_queue_dead(q)) {
+		kqd->starved = false;
+		blk_run_queue_async(q);
+	}
+
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+static int kyber_init_queue(struct request_queue *q)
+{
+	struct kyber_data *kqd;
+	unsigned int i;
+
+	kqd = kmalloc_node(sizeof(*kqd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!kqd)
+		return -ENOMEM;
+
+	kqd->cpu_latency = alloc_percpu(struct kyber_cpu_latency);
+	if (!kqd->cpu_latency) {
+		kfree(kqd);
+		return -ENOMEM;
+	}
+
+	kqd->queue = q;
+	for (i = 0; i < KYBER_NUM_DOMAINS; i++) {
+		INIT_LIST_HEAD(&kqd->rqs[i]);
+		kqd->depth[i] = kyber_depth[i];
+	}
+	kqd->lat_usec[KYBER_READ] = read_lat_usec;
+	kqd->lat_usec[KYBER_SYNC_WRITE] = write_lat_usec;
+	setup_timer(&kqd->timer, kyber_timer_fn, (unsigned long)kqd);
+
+	q->elevator->elevator_data = kqd;
+	return 0;
+}
+
+static void kyber_exit_queue(struct elevator_queue *e)
+{
+	struct kyber_data *kqd = e->elevator_data;
+	unsigned int i;
+
+	del_timer_sync(&kqd->timer);
+	for (i = 0; i < KYBER_NUM_DOMAINS; i++)
+		BUG_ON(!list_empty(&kqd->rqs[i]));
+
+	debugfs_remove_recursive(kqd->debugfs_dir);
+	free_percpu(kqd->cpu_latency);
+	kfree(kqd);
+}
+
+/*
+ * debugfs parts below, one directory per disk under kyber/
+ */
+
+static int kyber_domains_show(struct seq_file *m, void *v)
+{
+	struct kyber_data *kqd = m->private;
+	unsigned int i;
+
+	spin_lock_irq(kqd->queue->queue_lock);
+	for (i = 0; i < KYBER_NUM_DOMAINS; i++)
+		seq_printf(m, "%-12s depth %u/%u in_flight %u\n",
+			   kyber_domain_names[i], kqd->depth[i],
+			   kyber_depth[i], kqd->in_flight[i]);
+	spin_unlock_irq(kqd->queue->queue_lock);
+	return 0;
+}
+
+static int kyber_latency_show(struct seq_file *m, void *v)
+{
+	struct kyber_data *kqd = m->private;
+	int lat, bucket;
+
+	spin_lock_irq(kqd->queue->queue_lock);
+	for (lat = 0; lat < KYBER_NUM_LAT; lat++) {
+		seq_printf(m, "%-12s target %d usec:", kyber_domain_names[lat],
+			   kqd->lat_usec[lat]);
+		for (bucket = 0; bucket < KYBER_LATENCY_BUCKETS; bucket++)
+			seq_printf(m, " %llu", (unsigned long long)
+				   kqd->lat_total[lat][bucket]);
+		seq_putc(m, '\n');
+	}
+	spin_unlock_irq(kqd->queue->queue_lock);
+	return 0;
+}
+
+static int kyber_domains_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, kyber_domains_show, inode->i_private);
+}
+
+static int kyber_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, kyber_latency_show, inode->i_private);
+}
+
+static const struct file_operations kyber_domains_fops = {
+	.owner		= THIS_MODULE,
+	.open		= kyber_domains_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static const struct file_operations kyber_latency_fops = {
+	.owner		= THIS_MODULE,
+	.open		= kyber_latency_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void kyber_registered_queue(struct request_queue *q)
+{
+	struct kyber_data *kqd = q->elevator->elevator_data;
+	struct dentry *dir;
+
+	if (IS_ERR_OR_NULL(kyber_debugfs_root))
+		return;
+
+	/* the queue's kobject sits in the disk's directory */
+	dir = debugfs_create_dir(kobject_name(q->kobj.parent),
+				 kyber_debugfs_root);
+	if (IS_ERR_OR_NULL(dir))
+		return;
+
+	debugfs_create_file("domains", S_IRUSR, dir, kqd, &kyber_domains_fops);
+	debugfs_create_file("latency", S_IRUSR, dir, kqd, &kyber_latency_fops);
+	kqd->debugfs_dir = dir;
+}
+
+static void kyber_unregistered_queue(struct request_queue *q)
+{
+	struct kyber_data *kqd = q->elevator->elevator_data;
+
+	debugfs_remove_recursive(kqd->debugfs_dir);
+	kqd->debugfs_dir = NULL;
+}
+
+/*
+ * sysfs parts below
+ */
+
+static ssize_t
+kyber_var_show(int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+kyber_var_store(int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtol(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR)					\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct kyber_data *kqd = e->elevator_data;			\
+	return kyber_var_show(__VAR, (page));				\
+}
+SHOW_FUNCTION(kyber_read_lat_usec_show, kqd->lat_usec[KYBER_READ]);
+SHOW_FUNCTION(kyber_write_lat_usec_show, kqd->lat_usec[KYBER_SYNC_WRITE]);
+#undef SHOW_FUNCTION
+
+/* targets are capped at a second so latencies fit an unsigned long */
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX)				\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct kyber_data *kqd = e->elevator_data;			\
+	int __data;							\
+	int ret = kyber_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	*(__PTR) = __data;						\
+	return ret;							\
+}
+STORE_FUNCTION(kyber_read_lat_usec_store, &kqd->lat_usec[KYBER_READ], 1, USEC_PER_SEC);
+STORE_FUNCTION(kyber_write_lat_usec_store, &kqd->lat_usec[KYBER_SYNC_WRITE], 1, USEC_PER_SEC);
+#undef STORE_FUNCTION
+
+#define KYBER_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, kyber_##name##_show, \
+				      kyber_##name##_store)
+
+static struct elv_fs_entry kyber_attrs[] = {
+	KYBER_ATTR(read_lat_usec),
+	KYBER_ATTR(write_lat_usec),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_kyber = {
+	.ops = {
+		.elevator_merge_req_fn =	kyber_merged_requests,
+		.elevator_dispatch_fn =		kyber_dispatch,
+		.elevator_add_req_fn =		kyber_add_request,
+		.elevator_activate_req_fn =	kyber_activate_request,
+		.elevator_completed_req_fn =	kyber_completed_request,
+		.elevator_former_req_fn =	kyber_former_request,
+		.elevator_latter_req_fn =	kyber_latter_request,
+		.elevator_init_fn =		kyber_init_queue,
+		.elevator_exit_fn =		kyber_exit_queue,
+		.elevator_registered_fn =	kyber_registered_queue,
+		.elevator_unregistered_fn =	kyber_unregistered_queue,
+	},
+
+	.elevator_attrs = kyber_attrs,
+	.elevator_name = "kyber",
+	.elevator_owner = THIS_MODULE,
+};
+
+static int __init kyber_init(void)
+{
+	int ret;
+
+	kyber_debugfs_root = debugfs_create_dir("kyber", NULL);
+
+	ret = elv_register(&iosched_kyber);
+	if (ret)
+		debugfs_remove(kyber_debugfs_root);
+	return ret;
+}
+
+static void __exit kyber_exit(void)
+{
+	elv_unregister(&iosched_kyber);
+	debugfs_remove(kyber_debugfs_root);
+}
+
+module_init(kyber_init);
+module_exit(kyber_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Kyber IO scheduler");
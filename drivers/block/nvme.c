@@ -673,6 +673,12 @@ static irqreturn_t nvme_process_cq(struct nvme_queue *nvmeq)
 	return IRQ_HANDLED;
 }
 
+static bool nvme_cqe_pending(struct nvme_queue *nvmeq)
+{
+	struct nvme_completion cqe = nvmeq->cqes[nvmeq->cq_head];
+	return (le16_to_cpu(cqe.status) & 1) == nvmeq->cq_phase;
+}
+
 static irqreturn_t nvme_irq(int irq, void *data)
 {
 	irqreturn_t result;
@@ -686,12 +692,30 @@ static irqreturn_t nvme_irq(int irq, void *data)
 static irqreturn_t nvme_irq_check(int irq, void *data)
 {
 	struct nvme_queue *nvmeq = data;
-	struct nvme_completion cqe = nvmeq->cqes[nvmeq->cq_head];
-	if ((le16_to_cpu(cqe.status) & 1) != nvmeq->cq_phase)
+	if (!nvme_cqe_pending(nvmeq))
 		return IRQ_NONE;
 	return IRQ_WAKE_THREAD;
 }
 
+/*
+ * Reap completions on this CPU's queue, which is where nvme_make_request()
+ * put the I/O of a submitter still running here.
+ */
+static int nvme_poll(struct request_queue *q)
+{
+	struct nvme_ns *ns = q->queuedata;
+	struct nvme_queue *nvmeq = get_nvmeq(ns->dev);
+	int found = 0;
+
+	if (nvme_cqe_pending(nvmeq)) {
+		spin_lock_irq(&nvmeq->q_lock);
+		found = nvme_process_cq(nvmeq) == IRQ_HANDLED;
+		spin_unlock_irq(&nvmeq->q_lock);
+	}
+	put_nvmeq(nvmeq);
+	return found;
+}
+
 static void nvme_abort_command(struct nvme_queue *nvmeq, int cmdid)
 {
 	spin_lock_irq(&nvmeq->q_lock);
@@ -1353,6 +1377,7 @@ static struct nvme_ns *nvme_alloc_ns(struct nvme_dev *dev, int nsid,
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, ns->queue);
 /*	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, ns->queue); */
 	blk_queue_make_request(ns->queue, nvme_make_request);
+	blk_queue_poll_fn(ns->queue, nvme_poll);
 	ns->dev = dev;
 	ns->queue->queuedata = ns;
 
@@ -1651,6 +1651,28 @@ bad:
 EXPORT_SYMBOL(bioset_create);
 
 #ifdef CONFIG_BLK_CGROUP
+/**
+ * bio_associate_blkcg - associate a bio with the specified blkcg
+ * @bio: target bio
+ * @blkcg_css: css of the blkcg to associate
+ *
+ * Associate @bio with the blkcg specified by @blkcg_css.  Block layer will
+ * treat @bio as if it were issued by a task which belongs to the blkcg.
+ *
+ * This function takes an extra reference of @blkcg_css which will be put
+ * when @bio is released.  The caller must own @bio and is responsible for
+ * synchronizing calls to this function.
+ */
+int bio_associate_blkcg(struct bio *bio, struct cgroup_subsys_state *blkcg_css)
+{
+	if (unlikely(bio->bi_css))
+		return -EBUSY;
+	css_get(blkcg_css);
+	bio->bi_css = blkcg_css;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(bio_associate_blkcg);
+
 /**
  * bio_associate_current - associate a bio with %current
  * @bio: target bio
@@ -1680,7 +1702,10 @@ int bio_associate_current(struct bio *bio)
 	get_io_context_active(ioc);
 	bio->bi_ioc = ioc;
 
-	/* associate blkcg if exists */
+	/* associate blkcg if exists and not already set, e.g. by writeback */
+	if (bio->bi_css)
+		return 0;
+
 	rcu_read_lock();
 	css = task_subsys_state(current, blkio_subsys_id);
 	if (css && css_tryget(css))
@@ -2336,13 +2336,13 @@ out:
 	return ret;
 }
 
-static noinline long btrfs_ioctl_clone(struct file *file, unsigned long srcfd,
-				       u64 off, u64 olen, u64 destoff)
+static noinline int btrfs_clone_files(struct file *file, struct file *src_file,
+				     u64 off, u64 olen, u64 destoff,
+				     bool is_dedupe)
 {
 	struct inode *inode = fdentry(file)->d_inode;
 	struct btrfs_root *root = BTRFS_I(inode)->root;
-	struct file *src_file;
-	struct inode *src;
+	struct inode *src = src_file->f_dentry->d_inode;
 	struct btrfs_trans_handle *trans;
 	struct btrfs_path *path;
 	struct extent_buffer *leaf;
@@ -2363,61 +2363,29 @@ static noinline long btrfs_ioctl_clone(struct file *file, unsigned long srcfd,
 	 *   otherwise reinsert) a subrange.
 	 * - allow ranges within the same file to be cloned (provided
 	 *   they don't overlap)?
+	 *
+	 * The open modes, the mount and the file types have been checked
+	 * by the VFS already.
 	 */
-
-	/* the destination must be opened for writing */
-	if (!(file->f_mode & FMODE_WRITE) || (file->f_flags & O_APPEND))
-		return -EINVAL;
-
 	if (btrfs_root_readonly(root))
 		return -EROFS;
 
-	ret = mnt_want_write_file(file);
-	if (ret)
-		return ret;
-
-	src_file = fget(srcfd);
-	if (!src_file) {
-		ret = -EBADF;
-		goto out_drop_write;
-	}
-
-	ret = -EXDEV;
-	if (src_file->f_path.mnt != file->f_path.mnt)
-		goto out_fput;
-
-	src = src_file->f_dentry->d_inode;
-
-	ret = -EINVAL;
 	if (src == inode)
-		goto out_fput;
-
-	/* the src must be open for reading */
-	if (!(src_file->f_mode & FMODE_READ))
-		goto out_fput;
+		return -EINVAL;
 
 	/* don't make the dst file partly checksummed */
 	if ((BTRFS_I(src)->flags & BTRFS_INODE_NODATASUM) !=
 	    (BTRFS_I(inode)->flags & BTRFS_INODE_NODATASUM))
-		goto out_fput;
-
-	ret = -EISDIR;
-	if (S_ISDIR(src->i_mode) || S_ISDIR(inode->i_mode))
-		goto out_fput;
-
-	ret = -EXDEV;
-	if (src->i_sb != inode->i_sb)
-		goto out_fput;
+		return -EINVAL;
 
-	ret = -ENOMEM;
 	buf = vmalloc(btrfs_level_size(root, 0));
 	if (!buf)
-		goto out_fput;
+		return -ENOMEM;
 
 	path = btrfs_alloc_path();
 	if (!path) {
 		vfree(buf);
-		goto out_fput;
+		return -ENOMEM;
 	}
 	path->reada = 2;
 
@@ -2444,6 +2412,32 @@ static noinline long btrfs_ioctl_clone(struct file *file, unsigned long srcfd,
 	    !IS_ALIGNED(destoff, bs))
 		goto out_unlock;
 
+	if (is_dedupe) {
+		bool is_same;
+
+		/*
+		 * Only whole blocks can be shared: a range ending in the
+		 * source's eof block has to end at the destination's eof
+		 * as well, and nothing past it is touched.
+		 */
+		if (olen == 0) {
+			ret = 0;
+			goto out_unlock;
+		}
+		if (destoff + olen > inode->i_size ||
+		    (len != olen && destoff + olen != inode->i_size))
+			goto out_unlock;
+
+		ret = vfs_dedupe_file_range_compare(src, off, inode, destoff,
+						    olen, &is_same);
+		if (ret)
+			goto out_unlock;
+		if (!is_same) {
+			ret = -EBADE;
+			goto out_unlock;
+		}
+	}
+
 	if (destoff > inode->i_size) {
 		ret = btrfs_cont_expand(inode, inode->i_size, destoff);
 		if (ret)
@@ -2723,21 +2717,30 @@ out_unlock:
 	mutex_unlock(&inode->i_mutex);
 	vfree(buf);
 	btrfs_free_path(path);
-out_fput:
-	fput(src_file);
-out_drop_write:
-	mnt_drop_write_file(file);
 	return ret;
 }
 
-static long btrfs_ioctl_clone_range(struct file *file, void __user *argp)
+int btrfs_clone_file_range(struct file *src_file, loff_t off,
+			   struct file *dst_file, loff_t destoff, u64 len)
 {
-	struct btrfs_ioctl_clone_range_args args;
+	return btrfs_clone_files(dst_file, src_file, off, len, destoff, false);
+}
 
-	if (copy_from_user(&args, argp, sizeof(args)))
-		return -EFAULT;
-	return btrfs_ioctl_clone(file, args.src_fd, args.src_offset,
-				 args.src_length, args.dest_offset);
+/* the extent data items are only ever compared up to this many bytes */
+#define BTRFS_MAX_DEDUPE_LEN	(16 * 1024 * 1024)
+
+ssize_t btrfs_dedupe_file_range(struct file *src_file, u64 off, u64 olen,
+				struct file *dst_file, u64 destoff)
+{
+	int ret;
+
+	if (olen > BTRFS_MAX_DEDUPE_LEN)
+		olen = BTRFS_MAX_DEDUPE_LEN;
+
+	ret = btrfs_clone_files(dst_file, src_file, off, olen, destoff, true);
+	if (ret)
+		return ret;
+	return olen;
 }
 
 /*
@@ -3734,10 +3737,6 @@ long btrfs_ioctl(struct file *file, unsigned int
 		return btrfs_ioctl_dev_info(root, argp);
 	case BTRFS_IOC_BALANCE:
 		return btrfs_ioctl_balance(file, NULL);
-	case BTRFS_IOC_CLONE:
-		return btrfs_ioctl_clone(file, arg, 0, 0, 0);
-	case BTRFS_IOC_CLONE_RANGE:
-		return btrfs_ioctl_clone_range(file, argp);
 	case BTRFS_IOC_TRANS_START:
 		return btrfs_ioctl_trans_start(file);
 	case BTRFS_IOC_TRANS_END:
@@ -43,6 +43,8 @@
 #include <linux/bit_spinlock.h>
 
 static int fsync_buffers_list(spinlock_t *lock, struct list_head *list);
+static int submit_bh_wbc(int rw, struct buffer_head *bh,
+			 struct writeback_control *wbc);
 
 #define BH_ENTRY(list) list_entry((list), struct buffer_head, b_assoc_buffers)
 
@@ -1684,7 +1686,7 @@ static int __block_write_full_page(struct inode *inode, struct page *page,
 	do {
 		struct buffer_head *next = bh->b_this_page;
 		if (buffer_async_write(bh)) {
-			submit_bh(write_op, bh);
+			submit_bh_wbc(write_op, bh, wbc);
 			nr_underway++;
 		}
 		bh = next;
@@ -1738,7 +1740,7 @@ recover:
 		struct buffer_head *next = bh->b_this_page;
 		if (buffer_async_write(bh)) {
 			clear_buffer_dirty(bh);
-			submit_bh(write_op, bh);
+			submit_bh_wbc(write_op, bh, wbc);
 			nr_underway++;
 		}
 		bh = next;
@@ -2864,7 +2866,8 @@ static void end_bio_bh_io_sync(struct bio *bio, int err)
 	bio_put(bio);
 }
 
-int submit_bh(int rw, struct buffer_head * bh)
+static int submit_bh_wbc(int rw, struct buffer_head *bh,
+			 struct writeback_control *wbc)
 {
 	struct bio *bio;
 	int ret = 0;
@@ -2900,6 +2903,9 @@ int submit_bh(int rw, struct buffer_head * bh)
 	bio->bi_end_io = end_bio_bh_io_sync;
 	bio->bi_private = bh;
 
+	if (wbc)
+		wbc_init_bio(wbc, bio);
+
 	bio_get(bio);
 	submit_bio(rw, bio);
 
@@ -2909,6 +2915,11 @@ int submit_bh(int rw, struct buffer_head * bh)
 	bio_put(bio);
 	return ret;
 }
+
+int submit_bh(int rw, struct buffer_head *bh)
+{
+	return submit_bh_wbc(rw, bh, NULL);
+}
 EXPORT_SYMBOL(submit_bh);
 
 /**
@@ -1559,6 +1559,12 @@ asmlinkage long compat_sys_ioctl(unsigned int fd, unsigned int cmd,
 	case FIOQSIZE:
 		break;
 
+	case FICLONE:
+		goto do_ioctl;
+	case FICLONERANGE:
+	case FIDEDUPERANGE:
+		goto found_handler;
+
 #if defined(CONFIG_IA64) || defined(CONFIG_X86_64)
 	case FS_IOC_RESVSP_32:
 	case FS_IOC_RESVSP64_32:
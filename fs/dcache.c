@@ -37,6 +37,7 @@
 #include <linux/rculist_bl.h>
 #include <linux/prefetch.h>
 #include <linux/ratelimit.h>
+#include <linux/memcontrol.h>
 #include "internal.h"
 #include "mount.h"
 
@@ -853,6 +854,7 @@ static void shrink_dentry_list(struct list_head *list)
  * prune_dcache_sb - shrink the dcache
  * @sb: superblock
  * @count: number of entries to try to free
+ * @memcg: only free dentries charged to this memcg, NULL for all
  *
  * Attempt to shrink the superblock dcache LRU by @count entries. This is
  * done when we need more memory an called from the superblock shrinker
@@ -861,10 +863,12 @@ static void shrink_dentry_list(struct list_head *list)
  * This function may fail to free any resources if all the dentries are in
  * use.
  */
-void prune_dcache_sb(struct super_block *sb, int count)
+void prune_dcache_sb(struct super_block *sb, int count,
+		     struct mem_cgroup *memcg)
 {
 	struct dentry *dentry;
 	LIST_HEAD(referenced);
+	LIST_HEAD(skipped);
 	LIST_HEAD(tmp);
 
 relock:
@@ -880,7 +884,11 @@ relock:
 			goto relock;
 		}
 
-		if (dentry->d_flags & DCACHE_REFERENCED) {
+		/* charged to another memcg, keep its place on the LRU */
+		if (!memcg_kmem_owns(memcg, dentry)) {
+			list_move(&dentry->d_lru, &skipped);
+			spin_unlock(&dentry->d_lock);
+		} else if (dentry->d_flags & DCACHE_REFERENCED) {
 			dentry->d_flags &= ~DCACHE_REFERENCED;
 			list_move(&dentry->d_lru, &referenced);
 			spin_unlock(&dentry->d_lock);
@@ -895,6 +903,8 @@ relock:
 	}
 	if (!list_empty(&referenced))
 		list_splice(&referenced, &sb->s_dentry_lru);
+	if (!list_empty(&skipped))
+		list_splice_tail(&skipped, &sb->s_dentry_lru);
 	spin_unlock(&dcache_lru_lock);
 
 	shrink_dentry_list(&tmp);
@@ -2049,6 +2059,183 @@ out:
 	return dentry;
 }
 
+/*
+ * Lookups in progress without the parent's i_mutex, hashed by parent and
+ * name.  Only the miss path of d_alloc_parallel() and d_lookup_done() ever
+ * touch this, so a small table does.
+ */
+#define IN_LOOKUP_SHIFT 10
+static struct hlist_bl_head in_lookup_hashtable[1 << IN_LOOKUP_SHIFT];
+
+static inline struct hlist_bl_head *in_lookup_hash(const struct dentry *parent,
+						   unsigned int hash)
+{
+	hash += (unsigned long) parent / L1_CACHE_BYTES;
+	return in_lookup_hashtable + hash_32(hash, IN_LOOKUP_SHIFT);
+}
+
+/* Called with the in-lookup hash chain locked */
+static struct d_in_lookup *d_find_in_lookup(struct hlist_bl_head *b,
+					    struct dentry *parent,
+					    struct qstr *name)
+{
+	struct d_in_lookup *dil;
+	struct hlist_bl_node *node;
+
+	hlist_bl_for_each_entry(dil, node, b, hash) {
+		if (dil->parent != parent)
+			continue;
+		if (dil->name->hash != name->hash)
+			continue;
+		if (parent->d_flags & DCACHE_OP_COMPARE) {
+			if (parent->d_op->d_compare(parent, parent->d_inode,
+					dil->dentry, NULL, dil->name->len,
+					(const char *)dil->name->name, name))
+				continue;
+		} else {
+			if (dil->name->len != name->len)
+				continue;
+			if (memcmp(dil->name->name, name->name, name->len))
+				continue;
+		}
+		return dil;
+	}
+	return NULL;
+}
+
+/*
+ * Wait for the lookup of @dentry to finish if there is one.  Called with the
+ * in-lookup hash chain @b locked and a reference to @dentry held; returns
+ * with @b unlocked and @dentry->d_lock held.
+ */
+static void d_wait_lookup(struct dentry *dentry, struct hlist_bl_head *b)
+{
+	struct d_in_lookup *dil, *found = NULL;
+	struct hlist_bl_node *node;
+	DECLARE_WAITQUEUE(wait, current);
+
+	spin_lock(&dentry->d_lock);
+	if (d_in_lookup(dentry)) {
+		hlist_bl_for_each_entry(dil, node, b, hash) {
+			if (dil->dentry == dentry) {
+				found = dil;
+				break;
+			}
+		}
+	}
+	if (!found) {
+		hlist_bl_unlock(b);
+		return;
+	}
+	/*
+	 * d_lookup_done() wakes us with both locks held and the flag
+	 * cleared, and @dil is gone once it drops them: we must not touch
+	 * the wait queue again after seeing the flag clear.
+	 */
+	add_wait_queue(&found->wq, &wait);
+	hlist_bl_unlock(b);
+	do {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		spin_unlock(&dentry->d_lock);
+		schedule();
+		spin_lock(&dentry->d_lock);
+	} while (d_in_lookup(dentry));
+}
+
+/**
+ * d_alloc_parallel - find or allocate a dentry for a lookup
+ * @parent: parent dentry
+ * @name: qstr of the name, hashed
+ * @dil: in-lookup state, set up here if a new dentry is returned
+ *
+ * For filesystems that look up names under the parent's i_dir_sem held
+ * shared.  Returns the dentry from the dcache if there is one, waiting for
+ * a lookup of the name that is in progress elsewhere to finish first.
+ * Otherwise a new dentry is returned with d_in_lookup() true, the caller
+ * has to call ->lookup() on it and then d_lookup_done().  Returns
+ * ERR_PTR(-ENOMEM) if a dentry can't be allocated.
+ */
+struct dentry *d_alloc_parallel(struct dentry *parent, struct qstr *name,
+				struct d_in_lookup *dil)
+{
+	struct hlist_bl_head *b = in_lookup_hash(parent, name->hash);
+	struct dentry *new = d_alloc(parent, name);
+	struct d_in_lookup *other;
+	struct dentry *dentry;
+
+	if (unlikely(!new))
+		return ERR_PTR(-ENOMEM);
+retry:
+	dentry = d_lookup(parent, name);
+	hlist_bl_lock(b);
+	if (!dentry) {
+		other = d_find_in_lookup(b, parent, name);
+		if (other) {
+			dentry = dget(other->dentry);
+		} else {
+			/*
+			 * d_lookup_done() unhashes under this lock, so a
+			 * lookup that finished since our d_lookup() is in
+			 * the dcache by now.
+			 */
+			dentry = d_lookup(parent, name);
+		}
+	}
+	if (!dentry) {
+		spin_lock(&new->d_lock);
+		new->d_flags |= DCACHE_PAR_LOOKUP;
+		spin_unlock(&new->d_lock);
+		dil->dentry = new;
+		dil->parent = parent;
+		dil->name = name;
+		init_waitqueue_head(&dil->wq);
+		hlist_bl_add_head(&dil->hash, b);
+		hlist_bl_unlock(b);
+		return new;
+	}
+
+	d_wait_lookup(dentry, b);
+	/*
+	 * The lookup we waited for may have failed or handed back another
+	 * dentry, and this one may have been renamed since; start over then.
+	 * Still being in lookup here means ->lookup() moved the dentry away
+	 * from the name we could find its state under.
+	 */
+	if (unlikely(d_unhashed(dentry) || d_in_lookup(dentry) ||
+		     dentry->d_parent != parent ||
+		     dentry->d_name.hash != name->hash)) {
+		spin_unlock(&dentry->d_lock);
+		dput(dentry);
+		goto retry;
+	}
+	spin_unlock(&dentry->d_lock);
+	dput(new);
+	return dentry;
+}
+EXPORT_SYMBOL(d_alloc_parallel);
+
+/**
+ * d_lookup_done - end a lookup started by d_alloc_parallel()
+ * @dil: the in-lookup state d_alloc_parallel() set up
+ *
+ * Called after ->lookup() returned, whatever it returned.  Wakes up
+ * everybody waiting for the name; they find the result in the dcache.
+ */
+void d_lookup_done(struct d_in_lookup *dil)
+{
+	struct dentry *dentry = dil->dentry;
+	struct hlist_bl_head *b = in_lookup_hash(dil->parent, dil->name->hash);
+
+	hlist_bl_lock(b);
+	spin_lock(&dentry->d_lock);
+	dentry->d_flags &= ~DCACHE_PAR_LOOKUP;
+	__hlist_bl_del(&dil->hash);
+	wake_up_all(&dil->wq);
+	spin_unlock(&dentry->d_lock);
+	hlist_bl_unlock(b);
+}
+EXPORT_SYMBOL(d_lookup_done);
+
 /**
  * d_validate - verify dentry provided from insecure source (deprecated)
  * @dentry: The dentry alleged to be valid child of @dparent
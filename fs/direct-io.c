@@ -130,6 +130,8 @@ struct dio {
 	unsigned long refcount;		/* direct_io_worker() and bios */
 	struct bio *bio_list;		/* singly linked via bi_private */
 	struct task_struct *waiter;	/* waiting task (NULL if none) */
+	struct request_queue *poll_queue; /* sync I/O polls this queue */
+	ktime_t poll_start;		/* when the last BIO was submitted */
 
 	/* AIO related stuff */
 	struct kiocb *iocb;		/* kiocb */
@@ -379,6 +381,15 @@ static inline void dio_bio_submit(struct dio *dio, struct dio_submit *sdio)
 	if (dio->is_async && dio->rw == READ)
 		bio_set_pages_dirty(bio);
 
+	if (!dio->is_async) {
+		struct request_queue *q = bdev_get_queue(bio->bi_bdev);
+
+		if (blk_queue_poll(q)) {
+			dio->poll_queue = q;
+			dio->poll_start = ktime_get();
+		}
+	}
+
 	if (sdio->submit_io)
 		sdio->submit_io(dio->rw, bio, dio->inode,
 			       sdio->logical_offset_in_bio);
@@ -422,7 +433,9 @@ static struct bio *dio_await_one(struct dio *dio)
 		__set_current_state(TASK_UNINTERRUPTIBLE);
 		dio->waiter = current;
 		spin_unlock_irqrestore(&dio->bio_lock, flags);
-		io_schedule();
+		if (!dio->poll_queue ||
+		    !blk_poll(dio->poll_queue, dio->poll_start))
+			io_schedule();
 		/* wake up sets us TASK_RUNNING */
 		spin_lock_irqsave(&dio->bio_lock, flags);
 		dio->waiter = NULL;
@@ -925,6 +925,14 @@ struct ext4_inode_info {
 	tid_t i_sync_tid;
 	tid_t i_datasync_tid;
 
+	/*
+	 * Logical blocks changed in transaction i_fc_tid, for fast commits.
+	 * Protected by i_data_sem.
+	 */
+	tid_t i_fc_tid;
+	ext4_lblk_t i_fc_lblk_start;
+	ext4_lblk_t i_fc_lblk_len;
+
 	/* Precomputed uuid+inum+igen checksum for seeding inode checksums */
 	__u32 i_csum_seed;
 };
@@ -935,6 +943,7 @@ struct ext4_inode_info {
 #define	EXT4_VALID_FS			0x0001	/* Unmounted cleanly */
 #define	EXT4_ERROR_FS			0x0002	/* Errors detected */
 #define	EXT4_ORPHAN_FS			0x0004	/* Orphans being recovered */
+#define	EXT4_FC_REPLAY			0x0020	/* Fast commit replay ongoing */
 
 /*
  * Misc. filesystem flags
@@ -1295,6 +1304,20 @@ struct ext4_sb_info {
 
 	/* Precomputed FS UUID checksum for seeding other checksums */
 	__u32 s_csum_seed;
+
+	/* Fast commits, see fast_commit.c */
+	int s_fc_enabled;
+	spinlock_t s_fc_lock;
+	struct list_head s_fc_dentry_q;		/* namespace ops to log */
+	int s_fc_ineligible;			/* s_fc_ineligible_tid can't */
+	tid_t s_fc_ineligible_tid;		/* be fast committed */
+	unsigned int s_fc_nr_freed;		/* inodes freed, in the queue */
+	unsigned long s_fc_num_commits;
+	unsigned long s_fc_num_full_commits;
+	unsigned long s_fc_num_fallbacks;
+	u64 s_fc_bytes;
+	unsigned long s_fc_num_fsyncs;
+	u64 s_fc_fsync_time;			/* total, in ns */
 };
 
 static inline struct ext4_sb_info *EXT4_SB(struct super_block *sb)
@@ -1435,6 +1458,7 @@ static inline void ext4_clear_state_flags(struct ext4_inode_info *ei)
 #define EXT4_FEATURE_COMPAT_EXT_ATTR		0x0008
 #define EXT4_FEATURE_COMPAT_RESIZE_INODE	0x0010
 #define EXT4_FEATURE_COMPAT_DIR_INDEX		0x0020
+#define EXT4_FEATURE_COMPAT_FAST_COMMIT		0x0400
 
 #define EXT4_FEATURE_RO_COMPAT_SPARSE_SUPER	0x0001
 #define EXT4_FEATURE_RO_COMPAT_LARGE_FILE	0x0002
@@ -1930,6 +1954,23 @@ extern int ext4_htree_store_dirent(struct file *dir_file, __u32 hash,
 				    struct ext4_dir_entry_2 *dirent);
 extern void ext4_htree_free_dir_info(struct dir_private_info *p);
 
+/* fast_commit.c */
+extern void ext4_fc_init(struct super_block *sb);
+extern void ext4_fc_destroy(struct super_block *sb);
+extern void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+				ext4_lblk_t lblk, ext4_lblk_t len);
+extern void ext4_fc_track_create(handle_t *handle, struct dentry *dentry);
+extern void ext4_fc_track_link(handle_t *handle, struct dentry *dentry);
+extern void ext4_fc_track_unlink(handle_t *handle, struct dentry *dentry);
+extern void ext4_fc_track_free_inode(handle_t *handle, struct inode *inode);
+extern void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle);
+extern void ext4_fc_cleanup(struct super_block *sb, tid_t tid);
+extern int ext4_fc_commit(struct inode *inode, int datasync);
+extern void ext4_fc_account_fsync(struct super_block *sb, ktime_t start,
+				  int full_commit);
+extern int ext4_fc_replay(struct super_block *sb);
+extern const struct file_operations ext4_fc_info_fops;
+
 /* fsync.c */
 extern int ext4_sync_file(struct file *, loff_t, loff_t, int);
 extern int ext4_flush_completed_IO(struct inode *);
@@ -1951,6 +1992,8 @@ extern void ext4_mark_bitmap_end(int start_bit, int end_bit, char *bitmap);
 extern int ext4_init_inode_table(struct super_block *sb,
 				 ext4_group_t group, int barrier);
 extern void ext4_end_bitmap_read(struct buffer_head *bh, int uptodate);
+extern int ext4_mark_inode_used(handle_t *handle, struct super_block *sb,
+				unsigned long ino, umode_t mode);
 
 /* mballoc.c */
 extern long ext4_mb_stats;
@@ -1971,6 +2014,8 @@ extern int ext4_mb_add_groupinfo(struct super_block *sb,
 extern int ext4_group_add_blocks(handle_t *handle, struct super_block *sb,
 				ext4_fsblk_t block, unsigned long count);
 extern int ext4_trim_fs(struct super_block *, struct fstrim_range *);
+extern int ext4_mb_mark_bb_used(handle_t *handle, struct super_block *sb,
+				ext4_fsblk_t block, unsigned long count);
 
 /* inode.c */
 struct buffer_head *ext4_getblk(handle_t *, struct inode *,
@@ -2033,6 +2078,12 @@ extern int ext4_orphan_add(handle_t *, struct inode *);
 extern int ext4_orphan_del(handle_t *, struct inode *);
 extern int ext4_htree_fill_tree(struct file *dir_file, __u32 start_hash,
 				__u32 start_minor_hash, __u32 *next_hash);
+extern int ext4_fc_replay_add_entry(handle_t *handle, struct inode *dir,
+				    struct inode *inode,
+				    const struct qstr *name);
+extern int ext4_fc_replay_del_entry(handle_t *handle, struct inode *dir,
+				    struct inode *inode,
+				    const struct qstr *name);
 
 /* resize.c */
 extern int ext4_group_add(struct super_block *sb,
@@ -2043,6 +2094,7 @@ extern int ext4_group_extend(struct super_block *sb,
 extern int ext4_resize_fs(struct super_block *sb, ext4_fsblk_t n_blocks_count);
 
 /* super.c */
+extern int ext4_commit_super(struct super_block *sb, int sync);
 extern int ext4_calculate_overhead(struct super_block *sb);
 extern int ext4_superblock_csum_verify(struct super_block *sb,
 				       struct ext4_super_block *es);
@@ -2392,6 +2444,17 @@ extern int ext4_map_blocks(handle_t *handle, struct inode *inode,
 			   struct ext4_map_blocks *map, int flags);
 extern int ext4_fiemap(struct inode *inode, struct fiemap_extent_info *fieinfo,
 			__u64 start, __u64 len);
+typedef int (*ext4_fc_range_fn)(struct inode *inode, ext4_lblk_t lblk,
+				ext4_fsblk_t pblk, ext4_lblk_t len,
+				int unwritten, void *data);
+extern int ext4_ext_fc_walk_range(struct inode *inode, ext4_lblk_t start,
+				  ext4_lblk_t len, ext4_fc_range_fn fn,
+				  void *data);
+extern int ext4_ext_replay_set_range(struct inode *inode, ext4_lblk_t lblk,
+				     ext4_fsblk_t pblk, unsigned int len,
+				     int unwritten);
+extern int ext4_ext_replay_del_range(struct inode *inode, ext4_lblk_t lblk,
+				     ext4_lblk_t len);
 /* move_extent.c */
 extern int ext4_move_extents(struct file *o_filp, struct file *d_filp,
 			     __u64 start_orig, __u64 start_donor,
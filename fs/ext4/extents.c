@@ -2583,6 +2583,7 @@ static int ext4_ext_remove_space(struct inode *inode, ext4_lblk_t start,
 	handle = ext4_journal_start(inode, depth + 1);
 	if (IS_ERR(handle))
 		return PTR_ERR(handle);
+	ext4_fc_track_range(handle, inode, start, end - start + 1);
 
 again:
 	ext4_ext_invalidate_cache(inode);
@@ -4373,6 +4374,515 @@ static void ext4_falloc_update_inode(struct inode *inode,
 
 }
 
+/*
+ * Shift the extents of the leaf @path points to which start at or after
+ * @start by @shift blocks, to the left if @left is set or else to the
+ * right, and merge them with their neighbours in the leaf where possible.
+ */
+static int ext4_ext_shift_leaf(handle_t *handle, struct inode *inode,
+			       struct ext4_ext_path *path, ext4_lblk_t start,
+			       ext4_lblk_t shift, int left)
+{
+	int depth = ext_depth(inode);
+	struct ext4_extent_header *eh = path[depth].p_hdr;
+	struct ext4_extent *ex, *ex_start, *ex_last;
+	int err;
+
+	ex_start = EXT_FIRST_EXTENT(eh);
+	ex_last = EXT_LAST_EXTENT(eh);
+	while (ex_start <= ex_last && le32_to_cpu(ex_start->ee_block) < start)
+		ex_start++;
+	if (ex_start > ex_last)
+		return 0;
+
+	err = ext4_ext_get_access(handle, inode, path + depth);
+	if (err)
+		return err;
+
+	if (left) {
+		ex = ex_start;
+		while (ex <= ex_last) {
+			le32_add_cpu(&ex->ee_block, -shift);
+			if (ex > EXT_FIRST_EXTENT(eh) &&
+			    ext4_ext_try_to_merge_right(inode, path, ex - 1))
+				ex_last--;
+			else
+				ex++;
+		}
+	} else {
+		for (ex = ex_last; ex >= ex_start; ex--) {
+			le32_add_cpu(&ex->ee_block, shift);
+			ext4_ext_try_to_merge_right(inode, path, ex);
+		}
+	}
+
+	err = ext4_ext_dirty(handle, inode, path + depth);
+	if (err)
+		return err;
+
+	/* the first extent of the leaf moved, so does the leaf */
+	if (ex_start == EXT_FIRST_EXTENT(eh)) {
+		path[depth].p_ext = ex_start;
+		err = ext4_ext_correct_indexes(handle, inode, path);
+	}
+	return err;
+}
+
+/*
+ * ext4_ext_shift_extents:
+ * Shift all extents starting at or after @start by @shift blocks, to the
+ * left for collapse range or to the right for insert range.  For a left
+ * shift the @shift blocks in front of @start have to be a hole, for a
+ * right shift no extent may straddle @start.
+ *
+ * The extents are shifted one leaf at a time, @handle is extended or
+ * restarted in between as needed.  Called with i_data_sem held for
+ * writing.
+ */
+static int ext4_ext_shift_extents(handle_t *handle, struct inode *inode,
+				  ext4_lblk_t start, ext4_lblk_t shift,
+				  int left)
+{
+	struct ext4_ext_path *path, *tmp;
+	struct ext4_extent_header *eh;
+	struct ext4_extent *ex;
+	ext4_lblk_t iter, next, ee_block;
+	u64 ee_end;
+	int err = 0;
+
+	if (left && start < shift)
+		return -EINVAL;
+
+	/* check that the extents fit before touching any of them */
+	path = ext4_ext_find_extent(inode,
+				    left ? start - 1 : EXT_MAX_BLOCKS - 1, NULL);
+	if (IS_ERR(path))
+		return PTR_ERR(path);
+	ex = path[path->p_depth].p_ext;
+	if (ex) {
+		ee_block = le32_to_cpu(ex->ee_block);
+		ee_end = (u64)ee_block + ext4_ext_get_actual_len(ex);
+		if (left && ee_block < start && ee_end > start - shift)
+			err = -EINVAL;
+		if (!left && ee_end + shift > EXT_MAX_BLOCKS)
+			err = -EFBIG;
+	}
+	if (err || !ex)
+		goto out;
+
+	iter = left ? start : EXT_MAX_BLOCKS - 1;
+	for (;;) {
+		ext4_ext_drop_refs(path);
+		err = ext4_ext_truncate_extend_restart(handle, inode,
+						       ext_depth(inode) + 3);
+		if (err && err != -EAGAIN)
+			break;
+		err = 0;
+		ext4_fc_mark_ineligible(inode->i_sb, handle);
+		ext4_ext_invalidate_cache(inode);
+
+		tmp = ext4_ext_find_extent(inode, iter, path);
+		if (IS_ERR(tmp)) {
+			err = PTR_ERR(tmp);
+			break;
+		}
+		eh = path[path->p_depth].p_hdr;
+		if (!path[path->p_depth].p_ext)
+			break;
+
+		if (left) {
+			/*
+			 * The index entries of the leaves still to go are not
+			 * shifted yet, so the next one is found by its index.
+			 */
+			ex = EXT_LAST_EXTENT(eh);
+			path[path->p_depth].p_ext = ex;
+			next = ext4_ext_next_allocated_block(path);
+			if (le32_to_cpu(ex->ee_block) >= iter) {
+				err = ext4_ext_shift_leaf(handle, inode, path,
+							  iter, shift, 1);
+				if (err)
+					break;
+			}
+			if (next == EXT_MAX_BLOCKS)
+				break;
+			iter = next;
+		} else {
+			/* go on with the leaf in front of this one */
+			ee_block = le32_to_cpu(EXT_FIRST_EXTENT(eh)->ee_block);
+			err = ext4_ext_shift_leaf(handle, inode, path,
+						  start, shift, 0);
+			if (err || ee_block <= start)
+				break;
+			iter = ee_block - 1;
+		}
+	}
+out:
+	ext4_ext_drop_refs(path);
+	kfree(path);
+	return err;
+}
+
+/*
+ * Write back and drop the page cache from the page containing @offset on,
+ * waiting for direct I/O and pending unwritten extent conversions, before
+ * the blocks behind @offset are moved.  Called with i_mutex held.
+ */
+static int ext4_prepare_shift(struct inode *inode, loff_t offset)
+{
+	loff_t ioffset = round_down(offset, PAGE_CACHE_SIZE);
+	int ret;
+
+	/* journalled data has to be checkpointed before its blocks move */
+	if (ext4_should_journal_data(inode)) {
+		ret = ext4_force_commit(inode->i_sb);
+		if (ret)
+			return ret;
+	}
+
+	ret = filemap_write_and_wait_range(inode->i_mapping, ioffset,
+					   LLONG_MAX);
+	if (ret)
+		return ret;
+	inode_dio_wait(inode);
+	ext4_flush_completed_IO(inode);
+	truncate_pagecache_range(inode, ioffset, -1);
+	return 0;
+}
+
+static int ext4_shift_range_ok(struct inode *inode, loff_t offset,
+			       loff_t len)
+{
+	if (!S_ISREG(inode->i_mode))
+		return -EINVAL;
+
+	/* only whole blocks can be shifted */
+	if ((offset | len) & (inode->i_sb->s_blocksize - 1))
+		return -EINVAL;
+
+	if (EXT4_SB(inode->i_sb)->s_cluster_ratio > 1) {
+		/* TODO: Add support for bigalloc file systems */
+		return -EOPNOTSUPP;
+	}
+	return 0;
+}
+
+/*
+ * ext4_collapse_range
+ *
+ * Removes the block aligned range [@offset, @offset + @len) from a file
+ * and shifts the extents behind it down, the file shrinks by @len bytes.
+ *
+ * Returns 0 on success or negative on err
+ */
+static int ext4_collapse_range(struct inode *inode, loff_t offset,
+			       loff_t len)
+{
+	struct super_block *sb = inode->i_sb;
+	ext4_lblk_t punch_start, punch_stop;
+	handle_t *handle;
+	loff_t new_size;
+	int ret;
+
+	ret = ext4_shift_range_ok(inode, offset, len);
+	if (ret)
+		return ret;
+
+	punch_start = offset >> EXT4_BLOCK_SIZE_BITS(sb);
+	punch_stop = (offset + len) >> EXT4_BLOCK_SIZE_BITS(sb);
+
+	mutex_lock(&inode->i_mutex);
+
+	/* collapsing a range up to or beyond EOF is a truncate */
+	if (offset + len >= i_size_read(inode)) {
+		ret = -EINVAL;
+		goto out_mutex;
+	}
+
+	ret = ext4_prepare_shift(inode, offset);
+	if (ret)
+		goto out_mutex;
+
+	handle = ext4_journal_start(inode, ext4_writepage_trans_blocks(inode));
+	if (IS_ERR(handle)) {
+		ret = PTR_ERR(handle);
+		goto out_mutex;
+	}
+	ext4_fc_mark_ineligible(sb, handle);
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	ext4_ext_invalidate_cache(inode);
+	ext4_discard_preallocations(inode);
+
+	ret = ext4_ext_remove_space(inode, punch_start, punch_stop - 1);
+	if (ret)
+		goto out_sem;
+	ext4_discard_preallocations(inode);
+
+	ret = ext4_ext_shift_extents(handle, inode, punch_stop,
+				     punch_stop - punch_start, 1);
+	if (ret)
+		goto out_sem;
+
+	new_size = i_size_read(inode) - len;
+	i_size_write(inode, new_size);
+	EXT4_I(inode)->i_disksize = new_size;
+
+out_sem:
+	ext4_ext_invalidate_cache(inode);
+	up_write(&EXT4_I(inode)->i_data_sem);
+	if (IS_SYNC(inode))
+		ext4_handle_sync(handle);
+	inode->i_mtime = inode->i_ctime = ext4_current_time(inode);
+	ext4_mark_inode_dirty(handle, inode);
+	ext4_journal_stop(handle);
+out_mutex:
+	mutex_unlock(&inode->i_mutex);
+	return ret;
+}
+
+/*
+ * ext4_insert_range
+ *
+ * Opens up a hole of @len bytes at the block aligned @offset by shifting
+ * the extents from there on up, the file grows by @len bytes.
+ *
+ * Returns 0 on success or negative on err
+ */
+static int ext4_insert_range(struct inode *inode, loff_t offset, loff_t len)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_ext_path *path;
+	struct ext4_extent *ex;
+	ext4_lblk_t offset_lblk, len_lblk, ee_block;
+	unsigned int ee_len;
+	handle_t *handle;
+	loff_t new_size;
+	int ret, split_flag;
+
+	ret = ext4_shift_range_ok(inode, offset, len);
+	if (ret)
+		return ret;
+
+	offset_lblk = offset >> EXT4_BLOCK_SIZE_BITS(sb);
+	len_lblk = len >> EXT4_BLOCK_SIZE_BITS(sb);
+
+	mutex_lock(&inode->i_mutex);
+
+	/* inserting at or beyond EOF would just extend the file */
+	if (offset >= i_size_read(inode)) {
+		ret = -EINVAL;
+		goto out_mutex;
+	}
+	new_size = i_size_read(inode) + len;
+	ret = inode_newsize_ok(inode, new_size);
+	if (ret)
+		goto out_mutex;
+
+	ret = ext4_prepare_shift(inode, offset);
+	if (ret)
+		goto out_mutex;
+
+	handle = ext4_journal_start(inode, ext4_writepage_trans_blocks(inode));
+	if (IS_ERR(handle)) {
+		ret = PTR_ERR(handle);
+		goto out_mutex;
+	}
+	ext4_fc_mark_ineligible(sb, handle);
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	ext4_ext_invalidate_cache(inode);
+	ext4_discard_preallocations(inode);
+
+	/* split the extent spanning @offset, only its tail is shifted */
+	path = ext4_ext_find_extent(inode, offset_lblk, NULL);
+	if (IS_ERR(path)) {
+		ret = PTR_ERR(path);
+		goto out_sem;
+	}
+	ex = path[path->p_depth].p_ext;
+	if (ex) {
+		ee_block = le32_to_cpu(ex->ee_block);
+		ee_len = ext4_ext_get_actual_len(ex);
+		if (ee_block < offset_lblk && offset_lblk < ee_block + ee_len) {
+			split_flag = 0;
+			if (ext4_ext_is_uninitialized(ex))
+				split_flag = EXT4_EXT_MARK_UNINIT1 |
+					     EXT4_EXT_MARK_UNINIT2;
+			ret = ext4_split_extent_at(handle, inode, path,
+					offset_lblk, split_flag,
+					EXT4_GET_BLOCKS_PRE_IO);
+		}
+	}
+	ext4_ext_drop_refs(path);
+	kfree(path);
+	if (ret)
+		goto out_sem;
+
+	i_size_write(inode, new_size);
+	EXT4_I(inode)->i_disksize += len;
+
+	ret = ext4_ext_shift_extents(handle, inode, offset_lblk, len_lblk, 0);
+
+out_sem:
+	ext4_ext_invalidate_cache(inode);
+	up_write(&EXT4_I(inode)->i_data_sem);
+	if (IS_SYNC(inode))
+		ext4_handle_sync(handle);
+	inode->i_mtime = inode->i_ctime = ext4_current_time(inode);
+	ext4_mark_inode_dirty(handle, inode);
+	ext4_journal_stop(handle);
+out_mutex:
+	mutex_unlock(&inode->i_mutex);
+	return ret;
+}
+
+/*
+ * Convert the initialized extents in [@lblk, @lblk + @len) to
+ * uninitialized ones, one extent per transaction.  Holes and extents which
+ * are uninitialized already are left alone.
+ */
+static int ext4_ext_convert_to_uninit(struct inode *inode, ext4_lblk_t lblk,
+				      ext4_lblk_t len)
+{
+	struct ext4_ext_path *path;
+	struct ext4_extent *ex;
+	struct ext4_map_blocks map;
+	ext4_lblk_t end = lblk + len, next, ee_block;
+	unsigned int ee_len;
+	handle_t *handle;
+	int err = 0, err2;
+
+	while (!err && lblk < end) {
+		handle = ext4_journal_start(inode,
+					    ext4_writepage_trans_blocks(inode));
+		if (IS_ERR(handle))
+			return PTR_ERR(handle);
+
+		down_write(&EXT4_I(inode)->i_data_sem);
+		ext4_ext_invalidate_cache(inode);
+		path = ext4_ext_find_extent(inode, lblk, NULL);
+		if (IS_ERR(path)) {
+			err = PTR_ERR(path);
+			up_write(&EXT4_I(inode)->i_data_sem);
+			ext4_journal_stop(handle);
+			break;
+		}
+
+		next = end;
+		ex = path[path->p_depth].p_ext;
+		if (ex) {
+			ee_block = le32_to_cpu(ex->ee_block);
+			ee_len = ext4_ext_get_actual_len(ex);
+			if (lblk < ee_block) {
+				next = min(ee_block, end);
+			} else if (lblk >= ee_block + ee_len) {
+				next = min(ext4_ext_next_allocated_block(path),
+					   end);
+			} else {
+				next = min(ee_block + ee_len, end);
+				if (!ext4_ext_is_uninitialized(ex)) {
+					map.m_lblk = lblk;
+					map.m_len = next - lblk;
+					err = ext4_split_extent(handle, inode,
+							path, &map,
+							EXT4_EXT_MARK_UNINIT2,
+							0);
+					if (err > 0)
+						err = 0;
+					ext4_fc_track_range(handle, inode,
+							    lblk, next - lblk);
+				}
+			}
+		}
+		ext4_ext_drop_refs(path);
+		kfree(path);
+		ext4_ext_invalidate_cache(inode);
+		up_write(&EXT4_I(inode)->i_data_sem);
+
+		err2 = ext4_journal_stop(handle);
+		if (!err)
+			err = err2;
+		lblk = next;
+	}
+	return err;
+}
+
+/*
+ * ext4_zero_range
+ *
+ * Zeroes [@offset, @offset + @len) for FALLOC_FL_ZERO_RANGE: the partial
+ * blocks at either end are zeroed in the page cache and the whole blocks
+ * in between are converted to uninitialized extents.  ext4_fallocate()
+ * then allocates uninitialized extents for the holes in the range.
+ * Called with i_mutex held.
+ */
+static int ext4_zero_range(struct inode *inode, loff_t offset, loff_t len)
+{
+	struct super_block *sb = inode->i_sb;
+	struct address_space *mapping = inode->i_mapping;
+	loff_t first_page_offset, last_page_offset;
+	ext4_lblk_t start, stop;
+	handle_t *handle;
+	int ret;
+
+	if (!S_ISREG(inode->i_mode))
+		return -EOPNOTSUPP;
+
+	if (EXT4_SB(sb)->s_cluster_ratio > 1) {
+		/* TODO: Add support for bigalloc file systems */
+		return -EOPNOTSUPP;
+	}
+
+	/* write out dirty data so that it doesn't land on the zeroes */
+	ret = filemap_write_and_wait_range(mapping, offset, offset + len - 1);
+	if (ret)
+		return ret;
+	inode_dio_wait(inode);
+	ext4_flush_completed_IO(inode);
+
+	first_page_offset = round_up(offset, PAGE_CACHE_SIZE);
+	last_page_offset = round_down(offset + len, PAGE_CACHE_SIZE);
+	if (last_page_offset > first_page_offset)
+		truncate_pagecache_range(inode, first_page_offset,
+					 last_page_offset - 1);
+
+	handle = ext4_journal_start(inode, ext4_writepage_trans_blocks(inode));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	/*
+	 * Zero out the non-page-aligned data at the start and the end of
+	 * the range and unmap the buffer heads of the whole blocks in there,
+	 * their extents are converted below.
+	 */
+	if (first_page_offset > last_page_offset) {
+		ret = ext4_discard_partial_page_buffers(handle, mapping,
+							offset, len, 0);
+	} else {
+		if (first_page_offset > offset)
+			ret = ext4_discard_partial_page_buffers(handle,
+					mapping, offset,
+					first_page_offset - offset, 0);
+		if (!ret && offset + len > last_page_offset)
+			ret = ext4_discard_partial_page_buffers(handle,
+					mapping, last_page_offset,
+					offset + len - last_page_offset, 0);
+	}
+
+	inode->i_mtime = inode->i_ctime = ext4_current_time(inode);
+	ext4_mark_inode_dirty(handle, inode);
+	ext4_journal_stop(handle);
+	if (ret)
+		return ret;
+
+	start = (offset + sb->s_blocksize - 1) >> EXT4_BLOCK_SIZE_BITS(sb);
+	stop = (offset + len) >> EXT4_BLOCK_SIZE_BITS(sb);
+	if (start < stop)
+		ret = ext4_ext_convert_to_uninit(inode, start, stop - start);
+	return ret;
+}
+
 /*
  * preallocate space for a file. This implements ext4's fallocate file
  * operation, which gets called from sys_fallocate system call.
@@ -4401,12 +4911,20 @@ long ext4_fallocate(struct file *file, int mode, loff_t offset, loff_t len)
 		return -EOPNOTSUPP;
 
 	/* Return error if mode is not supported */
-	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE))
+	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE |
+		     FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_ZERO_RANGE |
+		     FALLOC_FL_INSERT_RANGE))
 		return -EOPNOTSUPP;
 
 	if (mode & FALLOC_FL_PUNCH_HOLE)
 		return ext4_punch_hole(file, offset, len);
 
+	if (mode & FALLOC_FL_COLLAPSE_RANGE)
+		return ext4_collapse_range(inode, offset, len);
+
+	if (mode & FALLOC_FL_INSERT_RANGE)
+		return ext4_insert_range(inode, offset, len);
+
 	trace_ext4_fallocate_enter(inode, offset, len, mode);
 	map.m_lblk = offset >> blkbits;
 	/*
@@ -4421,6 +4939,8 @@ long ext4_fallocate(struct file *file, int mode, loff_t offset, loff_t len)
 	credits = ext4_chunk_trans_blocks(inode, max_blocks);
 	mutex_lock(&inode->i_mutex);
 	ret = inode_newsize_ok(inode, (len + offset));
+	if (!ret && (mode & FALLOC_FL_ZERO_RANGE))
+		ret = ext4_zero_range(inode, offset, len);
 	if (ret) {
 		mutex_unlock(&inode->i_mutex);
 		trace_ext4_fallocate_exit(inode, offset, max_blocks, ret);
@@ -4944,6 +5464,7 @@ out:
 	ext4_journal_stop(handle);
 	return err;
 }
+
 int ext4_fiemap(struct inode *inode, struct fiemap_extent_info *fieinfo,
 		__u64 start, __u64 len)
 {
@@ -4980,3 +5501,169 @@ int ext4_fiemap(struct inode *inode, struct fiemap_extent_info *fieinfo,
 
 	return error;
 }
+
+/*
+ * Fast commit support
+ */
+
+struct ext4_fc_walk {
+	ext4_lblk_t		start;
+	ext4_lblk_t		end;
+	ext4_fc_range_fn	fn;
+	void			*data;
+};
+
+static int ext4_ext_fc_walk_cb(struct inode *inode, ext4_lblk_t next,
+			       struct ext4_ext_cache *newex,
+			       struct ext4_extent *ex, void *data)
+{
+	struct ext4_fc_walk *walk = data;
+	ext4_lblk_t lblk = max(newex->ec_block, walk->start);
+	ext4_lblk_t end = min(newex->ec_block + newex->ec_len, walk->end);
+	ext4_fsblk_t pblk = 0;
+	int unwritten = 0, err;
+
+	if (newex->ec_start) {
+		pblk = newex->ec_start + lblk - newex->ec_block;
+		unwritten = ext4_ext_is_uninitialized(ex);
+	}
+	err = walk->fn(inode, lblk, pblk, end - lblk, unwritten, walk->data);
+	return err < 0 ? err : EXT_CONTINUE;
+}
+
+/*
+ * Report the extents and holes in [start, start + len) to @fn, which gets
+ * called with a physical block of 0 for holes.
+ */
+int ext4_ext_fc_walk_range(struct inode *inode, ext4_lblk_t start,
+			   ext4_lblk_t len, ext4_fc_range_fn fn, void *data)
+{
+	struct ext4_fc_walk walk = {
+		.start	= start,
+		.end	= start + len,
+		.fn	= fn,
+		.data	= data,
+	};
+
+	return ext4_ext_walk_space(inode, start, len, ext4_ext_fc_walk_cb,
+				   &walk);
+}
+
+/*
+ * Fast commit replay: map [lblk, lblk + len) to [pblk, pblk + len).  The
+ * blocks have been marked in use already, blocks mapped there by now
+ * get freed.
+ */
+int ext4_ext_replay_set_range(struct inode *inode, ext4_lblk_t lblk,
+			      ext4_fsblk_t pblk, unsigned int len,
+			      int unwritten)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+	struct ext4_map_blocks map;
+	struct ext4_ext_path *path;
+	struct ext4_extent newex;
+	handle_t *handle;
+	unsigned int max_len;
+	int ret;
+
+	max_len = unwritten ? EXT_UNINIT_MAX_LEN : EXT_INIT_MAX_LEN;
+	while (len) {
+		map.m_lblk = lblk;
+		map.m_len = min(len, max_len);
+		ret = ext4_map_blocks(NULL, inode, &map, 0);
+		if (ret < 0)
+			return ret;
+
+		if (ret > 0 && map.m_pblk != pblk) {
+			ret = ext4_ext_replay_del_range(inode, lblk, ret);
+			if (ret)
+				return ret;
+			continue;
+		}
+
+		if (ret > 0) {
+			/* Already there, it may have been written since */
+			if ((map.m_flags & EXT4_MAP_UNWRITTEN) && !unwritten) {
+				ret = ext4_convert_unwritten_extents(inode,
+					(loff_t)lblk << inode->i_blkbits,
+					(ssize_t)ret << inode->i_blkbits);
+				if (ret)
+					return ret;
+			}
+			lblk += map.m_len;
+			pblk += map.m_len;
+			len -= map.m_len;
+			continue;
+		}
+
+		/* A hole, fill as much of it as we can */
+		handle = ext4_journal_start(inode,
+					    ext4_chunk_trans_blocks(inode, 1));
+		if (IS_ERR(handle))
+			return PTR_ERR(handle);
+
+		down_write(&EXT4_I(inode)->i_data_sem);
+		ext4_ext_invalidate_cache(inode);
+		path = ext4_ext_find_extent(inode, lblk, NULL);
+		if (IS_ERR(path)) {
+			ret = PTR_ERR(path);
+			up_write(&EXT4_I(inode)->i_data_sem);
+			ext4_journal_stop(handle);
+			return ret;
+		}
+
+		newex.ee_block = cpu_to_le32(lblk);
+		newex.ee_len = cpu_to_le16(map.m_len);
+		ext4_ext_store_pblock(&newex, pblk);
+		ext4_ext_check_overlap(sbi, inode, &newex, path);
+		map.m_len = ext4_ext_get_actual_len(&newex);
+		if (unwritten)
+			ext4_ext_mark_uninitialized(&newex);
+		ret = ext4_ext_insert_extent(handle, inode, path, &newex, 0);
+		ext4_ext_drop_refs(path);
+		kfree(path);
+		up_write(&EXT4_I(inode)->i_data_sem);
+
+		if (!ret) {
+			dquot_alloc_block_nofail(inode, map.m_len);
+			ret = ext4_mark_inode_dirty(handle, inode);
+		}
+		ext4_journal_stop(handle);
+		if (ret)
+			return ret;
+
+		lblk += map.m_len;
+		pblk += map.m_len;
+		len -= map.m_len;
+	}
+	return 0;
+}
+
+/*
+ * Fast commit replay: unmap and free [lblk, lblk + len).
+ */
+int ext4_ext_replay_del_range(struct inode *inode, ext4_lblk_t lblk,
+			      ext4_lblk_t len)
+{
+	handle_t *handle;
+	int err, err2;
+
+	if (!len)
+		return 0;
+
+	handle = ext4_journal_start(inode, ext4_writepage_trans_blocks(inode));
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+
+	down_write(&EXT4_I(inode)->i_data_sem);
+	ext4_ext_invalidate_cache(inode);
+	err = ext4_ext_remove_space(inode, lblk, lblk + len - 1);
+	ext4_ext_invalidate_cache(inode);
+	up_write(&EXT4_I(inode)->i_data_sem);
+
+	err2 = ext4_mark_inode_dirty(handle, inode);
+	if (!err)
+		err = err2;
+	err2 = ext4_journal_stop(handle);
+	return err ? err : err2;
+}
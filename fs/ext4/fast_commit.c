@@ -0,0 +1,1294 @@
+/*
+ * linux/fs/ext4/fast_commit.c
+ *
+ * Fast commits
+ *
+ * fsync() normally commits the running transaction, which writes every
+ * metadata block anybody modified since the last commit to the journal,
+ * and waits for it.  A fast commit instead logs what fsync() needs to
+ * make the inode durable, as a few compact records in the fast commit
+ * area at the end of the journal:
+ *
+ *  - the logical block ranges of the inode which got mapped or unmapped,
+ *  - the on-disk inode itself, which takes care of size, timestamps and
+ *    the like,
+ *  - the directory entries added and removed by creat(), link() and
+ *    unlink() in the running transaction, along with the new inodes.
+ *
+ * The records of a fast commit are closed by a tail record carrying the
+ * transaction ID and a checksum.  jbd2 recovery leaves the fast commits
+ * of the first transaction missing from the log alone, ext4_fc_replay()
+ * applies them on top at mount time.
+ *
+ * Operations which these records can't describe (directories, renames,
+ * special files, xattrs, resizing, ...) mark the running transaction
+ * ineligible, fsync() falls back to a full commit until that transaction
+ * is committed.  Fast commits are only done in data=ordered mode and not
+ * with quotas, metadata_csum or bigalloc.
+ */
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/jbd2.h>
+#include <linux/crc32.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/quotaops.h>
+#include "ext4.h"
+#include "ext4_jbd2.h"
+#include "ext4_extents.h"
+#include "xattr.h"
+
+/*
+ * On-disk format: a sequence of tag-length-value records, all little
+ * endian.  A record never crosses a block boundary, the end of a block
+ * that can't take the next record is covered by a pad record.  Every
+ * fast commit starts in a new block.
+ */
+#define EXT4_FC_TAG_ADD_RANGE	1	/* ext4_fc_add_range */
+#define EXT4_FC_TAG_DEL_RANGE	2	/* ext4_fc_del_range */
+#define EXT4_FC_TAG_CREAT	3	/* ext4_fc_dentry_info */
+#define EXT4_FC_TAG_LINK	4	/* ext4_fc_dentry_info */
+#define EXT4_FC_TAG_UNLINK	5	/* ext4_fc_dentry_info */
+#define EXT4_FC_TAG_INODE	6	/* ext4_fc_inode */
+#define EXT4_FC_TAG_PAD		7	/* nothing */
+#define EXT4_FC_TAG_TAIL	8	/* ext4_fc_tail */
+
+struct ext4_fc_tl {
+	__le16 fc_tag;
+	__le16 fc_len;		/* of the value following */
+};
+
+/* @fc_ex maps the logical range to the blocks it got allocated */
+struct ext4_fc_add_range {
+	__le32 fc_ino;
+	struct ext4_extent fc_ex;
+};
+
+struct ext4_fc_del_range {
+	__le32 fc_ino;
+	__le32 fc_lblk;
+	__le32 fc_len;
+};
+
+struct ext4_fc_dentry_info {
+	__le32 fc_parent_ino;
+	__le32 fc_ino;
+	__u8 fc_dname[0];
+};
+
+/* the first EXT4_GOOD_OLD_INODE_SIZE + i_extra_isize bytes of the inode */
+struct ext4_fc_inode {
+	__le32 fc_ino;
+	__u8 fc_raw_inode[0];
+};
+
+/*
+ * @fc_crc is the crc32 of the fast commit, from the start of its first
+ * block up to @fc_crc.
+ */
+struct ext4_fc_tail {
+	__le32 fc_tid;
+	__le32 fc_crc;
+};
+
+/* Inode freed, only kept in memory to catch its number getting reused */
+#define EXT4_FC_FREE_INODE	0
+
+/* A namespace operation waiting to be logged */
+struct ext4_fc_dentry_update {
+	struct list_head fcd_list;
+	tid_t fcd_tid;
+	int fcd_op;			/* EXT4_FC_TAG_*, EXT4_FC_FREE_INODE */
+	unsigned long fcd_parent;
+	unsigned long fcd_ino;
+	unsigned int fcd_name_len;
+	unsigned char fcd_name[0];
+};
+
+void ext4_fc_init(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	spin_lock_init(&sbi->s_fc_lock);
+	INIT_LIST_HEAD(&sbi->s_fc_dentry_q);
+}
+
+static void ext4_fc_free_dentries(struct list_head *head)
+{
+	struct ext4_fc_dentry_update *fcd, *tmp;
+
+	list_for_each_entry_safe(fcd, tmp, head, fcd_list) {
+		list_del(&fcd->fcd_list);
+		kfree(fcd);
+	}
+}
+
+void ext4_fc_destroy(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	ext4_fc_free_dentries(&sbi->s_fc_dentry_q);
+	sbi->s_fc_nr_freed = 0;
+}
+
+static void ext4_fc_set_ineligible(struct super_block *sb, tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+
+	spin_lock(&sbi->s_fc_lock);
+	if (!sbi->s_fc_ineligible || tid_gt(tid, sbi->s_fc_ineligible_tid)) {
+		sbi->s_fc_ineligible = 1;
+		sbi->s_fc_ineligible_tid = tid;
+	}
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * The transaction of @handle can't be fast committed: fsync() has to
+ * commit it in full.
+ */
+void ext4_fc_mark_ineligible(struct super_block *sb, handle_t *handle)
+{
+	if (!ext4_handle_valid(handle) || !EXT4_SB(sb)->s_fc_enabled)
+		return;
+	ext4_fc_set_ineligible(sb, handle->h_transaction->t_tid);
+}
+
+static int ext4_fc_is_ineligible(struct super_block *sb, tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int ret;
+
+	spin_lock(&sbi->s_fc_lock);
+	ret = sbi->s_fc_ineligible && sbi->s_fc_ineligible_tid == tid;
+	spin_unlock(&sbi->s_fc_lock);
+	return ret;
+}
+
+/*
+ * Remember that [@lblk, @lblk + @len) of @inode changed in the
+ * transaction of @handle.  Called with i_data_sem held for writing.
+ */
+void ext4_fc_track_range(handle_t *handle, struct inode *inode,
+			 ext4_lblk_t lblk, ext4_lblk_t len)
+{
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	tid_t tid;
+	u64 end;
+
+	if (!ext4_handle_valid(handle) || !len ||
+	    !EXT4_SB(inode->i_sb)->s_fc_enabled)
+		return;
+
+	tid = handle->h_transaction->t_tid;
+	if (ei->i_fc_tid != tid || !ei->i_fc_lblk_len) {
+		ei->i_fc_tid = tid;
+		ei->i_fc_lblk_start = lblk;
+		ei->i_fc_lblk_len = len;
+		return;
+	}
+
+	end = max((u64)ei->i_fc_lblk_start + ei->i_fc_lblk_len,
+		  (u64)lblk + len);
+	ei->i_fc_lblk_start = min(ei->i_fc_lblk_start, lblk);
+	ei->i_fc_lblk_len = end - ei->i_fc_lblk_start;
+}
+
+static void ext4_fc_queue(handle_t *handle, struct super_block *sb,
+			  int op, unsigned long parent, unsigned long ino,
+			  const struct qstr *name)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_dentry_update *fcd;
+	unsigned int name_len = name ? name->len : 0;
+	tid_t tid;
+
+	if (!ext4_handle_valid(handle) || !sbi->s_fc_enabled)
+		return;
+
+	tid = handle->h_transaction->t_tid;
+	if (ext4_fc_is_ineligible(sb, tid))
+		return;
+
+	fcd = kmalloc(sizeof(*fcd) + name_len, GFP_NOFS);
+	if (!fcd) {
+		ext4_fc_set_ineligible(sb, tid);
+		return;
+	}
+	fcd->fcd_tid = tid;
+	fcd->fcd_op = op;
+	fcd->fcd_parent = parent;
+	fcd->fcd_ino = ino;
+	fcd->fcd_name_len = name_len;
+	if (name_len)
+		memcpy(fcd->fcd_name, name->name, name_len);
+
+	spin_lock(&sbi->s_fc_lock);
+	list_add_tail(&fcd->fcd_list, &sbi->s_fc_dentry_q);
+	if (op == EXT4_FC_FREE_INODE)
+		sbi->s_fc_nr_freed++;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+static void ext4_fc_track_dentry(handle_t *handle, struct dentry *dentry,
+				 int op)
+{
+	ext4_fc_queue(handle, dentry->d_sb, op,
+		      dentry->d_parent->d_inode->i_ino,
+		      dentry->d_inode->i_ino, &dentry->d_name);
+}
+
+void ext4_fc_track_create(handle_t *handle, struct dentry *dentry)
+{
+	struct super_block *sb = dentry->d_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_dentry_update *fcd;
+	unsigned long ino = dentry->d_inode->i_ino;
+	int reused = 0;
+
+	if (!ext4_handle_valid(handle) || !sbi->s_fc_enabled)
+		return;
+
+	/*
+	 * Replay can't tell a new inode from an old one with the same
+	 * number that got freed in the same transaction.
+	 */
+	spin_lock(&sbi->s_fc_lock);
+	if (sbi->s_fc_nr_freed) {
+		list_for_each_entry(fcd, &sbi->s_fc_dentry_q, fcd_list) {
+			if (fcd->fcd_op == EXT4_FC_FREE_INODE &&
+			    fcd->fcd_ino == ino) {
+				reused = 1;
+				break;
+			}
+		}
+	}
+	spin_unlock(&sbi->s_fc_lock);
+	if (reused) {
+		ext4_fc_mark_ineligible(sb, handle);
+		return;
+	}
+
+	ext4_fc_track_dentry(handle, dentry, EXT4_FC_TAG_CREAT);
+}
+
+void ext4_fc_track_link(handle_t *handle, struct dentry *dentry)
+{
+	ext4_fc_track_dentry(handle, dentry, EXT4_FC_TAG_LINK);
+}
+
+void ext4_fc_track_unlink(handle_t *handle, struct dentry *dentry)
+{
+	ext4_fc_track_dentry(handle, dentry, EXT4_FC_TAG_UNLINK);
+}
+
+void ext4_fc_track_free_inode(handle_t *handle, struct inode *inode)
+{
+	ext4_fc_queue(handle, inode->i_sb, EXT4_FC_FREE_INODE, 0,
+		      inode->i_ino, NULL);
+}
+
+/*
+ * Called once transaction @tid is committed: the operations logged for it
+ * and before are on disk now.
+ */
+void ext4_fc_cleanup(struct super_block *sb, tid_t tid)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_dentry_update *fcd, *tmp;
+
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry_safe(fcd, tmp, &sbi->s_fc_dentry_q, fcd_list) {
+		if (tid_gt(fcd->fcd_tid, tid))
+			continue;
+		if (fcd->fcd_op == EXT4_FC_FREE_INODE)
+			sbi->s_fc_nr_freed--;
+		list_del(&fcd->fcd_list);
+		kfree(fcd);
+	}
+	if (sbi->s_fc_ineligible && !tid_gt(sbi->s_fc_ineligible_tid, tid))
+		sbi->s_fc_ineligible = 0;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * Writing fast commits
+ */
+
+struct ext4_fc_writer {
+	journal_t *journal;
+	struct buffer_head *bh;		/* block being filled */
+	unsigned int off;		/* in @bh */
+	u32 crc;			/* of the blocks before @bh */
+	unsigned int blocks;
+};
+
+#define EXT4_FC_MAX_INODES	16
+
+/*
+ * Inodes the namespace operations of a fast commit log, looked up before
+ * it starts.  @inode[i] is NULL if @ino[i] was deleted already.
+ */
+struct ext4_fc_inodes {
+	unsigned int nr;
+	unsigned long ino[EXT4_FC_MAX_INODES];
+	struct inode *inode[EXT4_FC_MAX_INODES];
+};
+
+static int ext4_fc_add_ino(struct ext4_fc_inodes *refs, unsigned long ino)
+{
+	unsigned int i;
+
+	for (i = 0; i < refs->nr; i++) {
+		if (refs->ino[i] == ino)
+			return 0;
+	}
+	if (refs->nr == EXT4_FC_MAX_INODES)
+		return -EAGAIN;
+	refs->ino[refs->nr] = ino;
+	refs->inode[refs->nr++] = NULL;
+	return 0;
+}
+
+static void ext4_fc_put_inodes(struct ext4_fc_inodes *refs)
+{
+	unsigned int i;
+
+	for (i = 0; i < refs->nr; i++)
+		iput(refs->inode[i]);
+	refs->nr = 0;
+}
+
+/*
+ * Take references to the inodes created by the queued operations and to
+ * the directories they changed, except for @inode.  ext4_iget() sleeps
+ * on an inode being evicted, and eviction starts a handle, so this can't
+ * be done once the fast commit has begun and updates are locked.
+ */
+static int ext4_fc_get_inodes(struct inode *inode,
+			      struct ext4_fc_inodes *refs)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_fc_dentry_update *fcd;
+	struct inode *ref;
+	unsigned int i;
+	int err = 0;
+
+	refs->nr = 0;
+	spin_lock(&sbi->s_fc_lock);
+	list_for_each_entry(fcd, &sbi->s_fc_dentry_q, fcd_list) {
+		if (fcd->fcd_op == EXT4_FC_FREE_INODE)
+			continue;
+		if (fcd->fcd_op == EXT4_FC_TAG_CREAT)
+			err = ext4_fc_add_ino(refs, fcd->fcd_ino);
+		if (!err && fcd->fcd_parent != inode->i_ino)
+			err = ext4_fc_add_ino(refs, fcd->fcd_parent);
+		if (err)
+			break;
+	}
+	spin_unlock(&sbi->s_fc_lock);
+	if (err)
+		return err;
+
+	for (i = 0; i < refs->nr; i++) {
+		ref = ext4_iget(sb, refs->ino[i]);
+		if (IS_ERR(ref)) {
+			if (PTR_ERR(ref) != -ESTALE) {
+				ext4_fc_put_inodes(refs);
+				return PTR_ERR(ref);
+			}
+			ref = NULL;
+		}
+		refs->inode[i] = ref;
+	}
+	return 0;
+}
+
+/*
+ * Returns the inode looked up for @ino, NULL if it was deleted, or
+ * -EAGAIN if the operation needing it was queued after the lookup.
+ */
+static struct inode *ext4_fc_find_inode(struct ext4_fc_inodes *refs,
+					unsigned long ino)
+{
+	unsigned int i;
+
+	for (i = 0; i < refs->nr; i++) {
+		if (refs->ino[i] == ino)
+			return refs->inode[i];
+	}
+	return ERR_PTR(-EAGAIN);
+}
+
+static int ext4_fc_next_block(struct ext4_fc_writer *w)
+{
+	unsigned int blocksize = w->journal->j_blocksize;
+	struct ext4_fc_tl *tl;
+	int err;
+
+	if (w->bh) {
+		if (w->off + sizeof(*tl) <= blocksize) {
+			tl = (struct ext4_fc_tl *)(w->bh->b_data + w->off);
+			tl->fc_tag = cpu_to_le16(EXT4_FC_TAG_PAD);
+			tl->fc_len = cpu_to_le16(blocksize - w->off -
+						 sizeof(*tl));
+		}
+		w->crc = crc32_le(w->crc, w->bh->b_data, blocksize);
+	}
+
+	err = jbd2_fc_get_buf(w->journal, &w->bh);
+	if (err)
+		return err;
+	w->off = 0;
+	w->blocks++;
+	return 0;
+}
+
+/* Start a record with a value of @len bytes, returns the value */
+static void *ext4_fc_reserve(struct ext4_fc_writer *w, int tag,
+			     unsigned int len)
+{
+	struct ext4_fc_tl *tl;
+	int err;
+
+	if (sizeof(*tl) + len > w->journal->j_blocksize)
+		return ERR_PTR(-EAGAIN);
+	if (!w->bh || w->off + sizeof(*tl) + len > w->journal->j_blocksize) {
+		err = ext4_fc_next_block(w);
+		if (err)
+			return ERR_PTR(err);
+	}
+
+	tl = (struct ext4_fc_tl *)(w->bh->b_data + w->off);
+	tl->fc_tag = cpu_to_le16(tag);
+	tl->fc_len = cpu_to_le16(len);
+	w->off += sizeof(*tl) + len;
+	return tl + 1;
+}
+
+static int ext4_fc_write_tail(struct ext4_fc_writer *w, tid_t tid)
+{
+	struct ext4_fc_tail *tail;
+	u32 crc;
+
+	tail = ext4_fc_reserve(w, EXT4_FC_TAG_TAIL, sizeof(*tail));
+	if (IS_ERR(tail))
+		return PTR_ERR(tail);
+
+	tail->fc_tid = cpu_to_le32(tid);
+	crc = crc32_le(w->crc, w->bh->b_data,
+		       (char *)&tail->fc_crc - w->bh->b_data);
+	tail->fc_crc = cpu_to_le32(crc);
+	return 0;
+}
+
+static int ext4_fc_write_inode(struct ext4_fc_writer *w, struct inode *inode,
+			       int created)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_fc_inode *rec;
+	struct ext4_iloc iloc;
+	unsigned int len = EXT4_GOOD_OLD_INODE_SIZE;
+	int err;
+
+	if (EXT4_INODE_SIZE(sb) > EXT4_GOOD_OLD_INODE_SIZE)
+		len += EXT4_I(inode)->i_extra_isize;
+
+	err = ext4_get_inode_loc(inode, &iloc);
+	if (err)
+		return err;
+
+	rec = ext4_fc_reserve(w, EXT4_FC_TAG_INODE, sizeof(*rec) + len);
+	if (IS_ERR(rec)) {
+		brelse(iloc.bh);
+		return PTR_ERR(rec);
+	}
+	rec->fc_ino = cpu_to_le32(inode->i_ino);
+	memcpy(rec->fc_raw_inode, ext4_raw_inode(&iloc), len);
+	/* further links are logged on their own */
+	if (created)
+		((struct ext4_inode *)rec->fc_raw_inode)->i_links_count =
+			cpu_to_le16(1);
+	brelse(iloc.bh);
+	return 0;
+}
+
+static int ext4_fc_write_range(struct inode *inode, ext4_lblk_t lblk,
+			       ext4_fsblk_t pblk, ext4_lblk_t len,
+			       int unwritten, void *data)
+{
+	struct ext4_fc_writer *w = data;
+	struct ext4_fc_add_range *add;
+	struct ext4_fc_del_range *del;
+	unsigned int max_len, n;
+
+	if (!pblk) {
+		del = ext4_fc_reserve(w, EXT4_FC_TAG_DEL_RANGE, sizeof(*del));
+		if (IS_ERR(del))
+			return PTR_ERR(del);
+		del->fc_ino = cpu_to_le32(inode->i_ino);
+		del->fc_lblk = cpu_to_le32(lblk);
+		del->fc_len = cpu_to_le32(len);
+		return 0;
+	}
+
+	max_len = unwritten ? EXT_UNINIT_MAX_LEN : EXT_INIT_MAX_LEN;
+	while (len) {
+		n = min_t(unsigned int, len, max_len);
+		add = ext4_fc_reserve(w, EXT4_FC_TAG_ADD_RANGE, sizeof(*add));
+		if (IS_ERR(add))
+			return PTR_ERR(add);
+		add->fc_ino = cpu_to_le32(inode->i_ino);
+		add->fc_ex.ee_block = cpu_to_le32(lblk);
+		add->fc_ex.ee_len = cpu_to_le16(n);
+		ext4_ext_store_pblock(&add->fc_ex, pblk);
+		if (unwritten)
+			ext4_ext_mark_uninitialized(&add->fc_ex);
+		lblk += n;
+		pblk += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int ext4_fc_write_dentry(struct ext4_fc_writer *w,
+				struct ext4_fc_dentry_update *fcd)
+{
+	struct ext4_fc_dentry_info *rec;
+
+	rec = ext4_fc_reserve(w, fcd->fcd_op,
+			      sizeof(*rec) + fcd->fcd_name_len);
+	if (IS_ERR(rec))
+		return PTR_ERR(rec);
+	rec->fc_parent_ino = cpu_to_le32(fcd->fcd_parent);
+	rec->fc_ino = cpu_to_le32(fcd->fcd_ino);
+	memcpy(rec->fc_dname, fcd->fcd_name, fcd->fcd_name_len);
+	return 0;
+}
+
+/*
+ * Log the namespace operations of @ops and the inodes they created, then
+ * the directories they changed, except for @inode.  The inodes come from
+ * @refs.
+ */
+static int ext4_fc_write_dentries(struct ext4_fc_writer *w,
+				  struct inode *inode, struct list_head *ops,
+				  struct ext4_fc_inodes *refs)
+{
+	struct ext4_fc_dentry_update *fcd, *prev;
+	struct inode *child, *dir;
+	int err;
+
+	list_for_each_entry(fcd, ops, fcd_list) {
+		if (fcd->fcd_op == EXT4_FC_FREE_INODE)
+			continue;
+		if (fcd->fcd_op == EXT4_FC_TAG_CREAT) {
+			child = ext4_fc_find_inode(refs, fcd->fcd_ino);
+			if (IS_ERR(child))
+				return PTR_ERR(child);
+			if (!child) {
+				/*
+				 * Created and deleted again in this
+				 * transaction, leave it out altogether.
+				 */
+				prev = fcd;
+				list_for_each_entry_continue(prev, ops,
+							     fcd_list) {
+					if (prev->fcd_ino == fcd->fcd_ino)
+						prev->fcd_op =
+							EXT4_FC_FREE_INODE;
+				}
+				continue;
+			}
+			err = ext4_fc_write_inode(w, child, 1);
+			if (err)
+				return err;
+		}
+		err = ext4_fc_write_dentry(w, fcd);
+		if (err)
+			return err;
+	}
+
+	list_for_each_entry(fcd, ops, fcd_list) {
+		if (fcd->fcd_op == EXT4_FC_FREE_INODE ||
+		    fcd->fcd_parent == inode->i_ino)
+			continue;
+		/* once per directory */
+		list_for_each_entry(prev, ops, fcd_list) {
+			if (prev == fcd ||
+			    (prev->fcd_op != EXT4_FC_FREE_INODE &&
+			     prev->fcd_parent == fcd->fcd_parent))
+				break;
+		}
+		if (prev != fcd)
+			continue;
+
+		dir = ext4_fc_find_inode(refs, fcd->fcd_parent);
+		if (IS_ERR(dir))
+			return PTR_ERR(dir);
+		if (!dir)
+			return -EAGAIN;
+		err = ext4_fc_write_inode(w, dir, 0);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
+static int ext4_fc_inode_eligible(struct inode *inode)
+{
+	if (sb_any_quota_loaded(inode->i_sb))
+		return 0;
+	if (S_ISREG(inode->i_mode)) {
+		if (!ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS) ||
+		    ext4_should_journal_data(inode))
+			return 0;
+	} else if (!S_ISDIR(inode->i_mode)) {
+		return 0;
+	}
+	return list_empty(&EXT4_I(inode)->i_orphan);
+}
+
+/**
+ * ext4_fc_commit() - make an inode durable with a fast commit
+ * @inode: inode to sync, its i_mutex is held
+ * @datasync: only sync what fdatasync() needs
+ *
+ * Returns -EAGAIN if the caller has to commit the transaction in full.
+ */
+int ext4_fc_commit(struct inode *inode, int datasync)
+{
+	struct super_block *sb = inode->i_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_inode_info *ei = EXT4_I(inode);
+	journal_t *journal = sbi->s_journal;
+	struct ext4_fc_writer w = {
+		.journal	= journal,
+		.crc		= ~0,
+	};
+	struct ext4_fc_inodes refs;
+	LIST_HEAD(ops);
+	tid_t tid;
+	int ret;
+
+	if (!sbi->s_fc_enabled)
+		return -EAGAIN;
+	if (!ext4_fc_inode_eligible(inode))
+		goto fallback;
+
+	/*
+	 * As in data=ordered commits, all of the data has to be on disk
+	 * before the metadata pointing to it.
+	 */
+	ret = filemap_write_and_wait(inode->i_mapping);
+	if (ret)
+		return ret;
+	ret = ext4_flush_completed_IO(inode);
+	if (ret < 0)
+		return ret;
+
+	if (ext4_fc_get_inodes(inode, &refs))
+		goto fallback;
+
+	tid = datasync ? ei->i_datasync_tid : ei->i_sync_tid;
+	ret = jbd2_fc_begin_commit(journal, tid);
+	if (ret == -EALREADY) {
+		ext4_fc_put_inodes(&refs);
+		return -EAGAIN;
+	}
+	if (ret)
+		goto fallback_put;
+
+	jbd2_journal_lock_updates(journal);
+	if (ext4_fc_is_ineligible(sb, tid)) {
+		jbd2_journal_unlock_updates(journal);
+		jbd2_fc_abort_commit(journal);
+		goto fallback_put;
+	}
+
+	spin_lock(&sbi->s_fc_lock);
+	list_splice_init(&sbi->s_fc_dentry_q, &ops);
+	sbi->s_fc_nr_freed = 0;
+	spin_unlock(&sbi->s_fc_lock);
+
+	ret = ext4_fc_write_dentries(&w, inode, &ops, &refs);
+	if (!ret && S_ISREG(inode->i_mode) && ei->i_fc_tid == tid &&
+	    ei->i_fc_lblk_len)
+		ret = ext4_ext_fc_walk_range(inode, ei->i_fc_lblk_start,
+					     ei->i_fc_lblk_len,
+					     ext4_fc_write_range, &w);
+	if (!ret)
+		ret = ext4_fc_write_inode(&w, inode, 0);
+	if (!ret)
+		ret = ext4_fc_write_tail(&w, tid);
+	if (!ret) {
+		down_write(&ei->i_data_sem);
+		ei->i_fc_lblk_len = 0;
+		up_write(&ei->i_data_sem);
+	}
+	jbd2_journal_unlock_updates(journal);
+
+	if (ret) {
+		jbd2_fc_abort_commit(journal);
+	} else {
+		/* the data may be on another device than the journal */
+		if (journal->j_fs_dev != journal->j_dev &&
+		    (journal->j_flags & JBD2_BARRIER))
+			blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
+		ret = jbd2_fc_end_commit(journal);
+	}
+	ext4_fc_free_dentries(&ops);
+	ext4_fc_put_inodes(&refs);
+	if (ret) {
+		/* the queued operations are gone */
+		ext4_fc_set_ineligible(sb, tid);
+		goto fallback;
+	}
+
+	spin_lock(&sbi->s_fc_lock);
+	sbi->s_fc_num_commits++;
+	sbi->s_fc_bytes += (u64)w.blocks * journal->j_blocksize;
+	spin_unlock(&sbi->s_fc_lock);
+	return 0;
+
+fallback_put:
+	ext4_fc_put_inodes(&refs);
+fallback:
+	spin_lock(&sbi->s_fc_lock);
+	sbi->s_fc_num_fallbacks++;
+	spin_unlock(&sbi->s_fc_lock);
+	return -EAGAIN;
+}
+
+void ext4_fc_account_fsync(struct super_block *sb, ktime_t start,
+			   int full_commit)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	s64 delta = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	spin_lock(&sbi->s_fc_lock);
+	sbi->s_fc_num_fsyncs++;
+	sbi->s_fc_fsync_time += delta;
+	if (full_commit)
+		sbi->s_fc_num_full_commits++;
+	spin_unlock(&sbi->s_fc_lock);
+}
+
+/*
+ * Replay
+ */
+
+typedef int (*ext4_fc_replay_fn)(struct super_block *sb, int tag,
+				 void *val, unsigned int len);
+
+/*
+ * Call @fn for the records of the first @nr_blocks blocks of the fast
+ * commit area, skipping pad and tail records.
+ */
+static int ext4_fc_for_each_record(struct super_block *sb,
+				   unsigned long nr_blocks,
+				   ext4_fc_replay_fn fn)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	struct buffer_head *bh;
+	struct ext4_fc_tl *tl;
+	unsigned long blk;
+	unsigned int off, tag, len;
+	int err = 0;
+
+	for (blk = 0; blk < nr_blocks && !err; blk++) {
+		err = jbd2_fc_read_block(journal, blk, &bh);
+		if (err)
+			break;
+		for (off = 0; off + sizeof(*tl) <= journal->j_blocksize;
+		     off += sizeof(*tl) + len) {
+			tl = (struct ext4_fc_tl *)(bh->b_data + off);
+			tag = le16_to_cpu(tl->fc_tag);
+			len = le16_to_cpu(tl->fc_len);
+			if (tag == EXT4_FC_TAG_TAIL)
+				break;
+			if (tag == EXT4_FC_TAG_PAD)
+				continue;
+			err = fn(sb, tag, tl + 1, len);
+			if (err)
+				break;
+		}
+		brelse(bh);
+	}
+	return err;
+}
+
+static unsigned int ext4_fc_min_len(int tag)
+{
+	switch (tag) {
+	case EXT4_FC_TAG_ADD_RANGE:
+		return sizeof(struct ext4_fc_add_range);
+	case EXT4_FC_TAG_DEL_RANGE:
+		return sizeof(struct ext4_fc_del_range);
+	case EXT4_FC_TAG_CREAT:
+	case EXT4_FC_TAG_LINK:
+	case EXT4_FC_TAG_UNLINK:
+		return sizeof(struct ext4_fc_dentry_info) + 1;
+	case EXT4_FC_TAG_INODE:
+		return sizeof(struct ext4_fc_inode) + EXT4_GOOD_OLD_INODE_SIZE;
+	case EXT4_FC_TAG_PAD:
+		return 0;
+	case EXT4_FC_TAG_TAIL:
+		return sizeof(struct ext4_fc_tail);
+	}
+	return UINT_MAX;
+}
+
+/*
+ * Find the end of the valid fast commits: those with a matching checksum
+ * that belong to @tid, or to the first transaction found if @tid is NULL.
+ * Returns the number of blocks they take.
+ */
+static unsigned long ext4_fc_scan(struct super_block *sb, tid_t *tid)
+{
+	journal_t *journal = EXT4_SB(sb)->s_journal;
+	unsigned int blocksize = journal->j_blocksize;
+	struct ext4_fc_tail *tail;
+	struct buffer_head *bh;
+	struct ext4_fc_tl *tl;
+	unsigned long blk, end = 0;
+	unsigned int off, tag, len;
+	tid_t want = tid ? *tid : 0;
+	int have_tid = tid != NULL;
+	int closed;
+	u32 crc = ~0;
+
+	for (blk = 0; !jbd2_fc_read_block(journal, blk, &bh); blk++) {
+		closed = 0;
+		for (off = 0; off + sizeof(*tl) <= blocksize;
+		     off += sizeof(*tl) + len) {
+			tl = (struct ext4_fc_tl *)(bh->b_data + off);
+			tag = le16_to_cpu(tl->fc_tag);
+			len = le16_to_cpu(tl->fc_len);
+			if (off + sizeof(*tl) + len > blocksize ||
+			    len < ext4_fc_min_len(tag))
+				goto out;
+			if (tag != EXT4_FC_TAG_TAIL)
+				continue;
+
+			tail = (struct ext4_fc_tail *)(tl + 1);
+			if (!have_tid) {
+				want = le32_to_cpu(tail->fc_tid);
+				have_tid = 1;
+			}
+			crc = crc32_le(crc, bh->b_data,
+				       (char *)&tail->fc_crc - bh->b_data);
+			if (le32_to_cpu(tail->fc_tid) != want ||
+			    le32_to_cpu(tail->fc_crc) != crc)
+				goto out;
+			/* the next fast commit starts in a new block */
+			end = blk + 1;
+			crc = ~0;
+			closed = 1;
+			break;
+		}
+		if (!closed)
+			crc = crc32_le(crc, bh->b_data, blocksize);
+		brelse(bh);
+	}
+	return end;
+out:
+	brelse(bh);
+	return end;
+}
+
+static int ext4_fc_replay_scan_range(struct super_block *sb, int tag,
+				     void *val, unsigned int len)
+{
+	struct ext4_fc_add_range *add = val;
+	unsigned int nr;
+	handle_t *handle;
+	int err, err2;
+
+	if (tag != EXT4_FC_TAG_ADD_RANGE)
+		return 0;
+
+	nr = ext4_ext_get_actual_len(&add->fc_ex);
+	handle = ext4_journal_start_sb(sb,
+			2 * (nr / EXT4_BLOCKS_PER_GROUP(sb) + 2) + 1);
+	if (IS_ERR(handle))
+		return PTR_ERR(handle);
+	err = ext4_mb_mark_bb_used(handle, sb, ext4_ext_pblock(&add->fc_ex),
+				   nr);
+	err2 = ext4_journal_stop(handle);
+	return err ? err : err2;
+}
+
+/* Write @raw to the inode table slot of @ino */
+static int ext4_fc_write_raw_inode(handle_t *handle, struct super_block *sb,
+				   unsigned long ino, struct ext4_inode *raw)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	ext4_group_t group = (ino - 1) / EXT4_INODES_PER_GROUP(sb);
+	unsigned long offset = (ino - 1) % EXT4_INODES_PER_GROUP(sb);
+	struct ext4_group_desc *gdp;
+	struct buffer_head *bh;
+	int err;
+
+	gdp = ext4_get_group_desc(sb, group, NULL);
+	if (!gdp)
+		return -EIO;
+	bh = sb_bread(sb, ext4_inode_table(sb, gdp) +
+		      offset / sbi->s_inodes_per_block);
+	if (!bh)
+		return -EIO;
+
+	BUFFER_TRACE(bh, "get_write_access");
+	err = ext4_journal_get_write_access(handle, bh);
+	if (!err) {
+		memcpy(bh->b_data + (offset % sbi->s_inodes_per_block) *
+		       EXT4_INODE_SIZE(sb), raw, EXT4_INODE_SIZE(sb));
+		err = ext4_handle_dirty_metadata(handle, NULL, bh);
+	}
+	brelse(bh);
+	return err;
+}
+
+static struct inode *ext4_fc_iget(struct super_block *sb, unsigned long ino)
+{
+	struct inode *inode = ext4_iget(sb, ino);
+
+	if (IS_ERR(inode))
+		ext4_msg(sb, KERN_WARNING, "fast commit replay: can't read "
+			 "inode %lu: %ld", ino, PTR_ERR(inode));
+	return inode;
+}
+
+/*
+ * Replay an inode record: allocate the inode if it is new, then bring the
+ * attributes of the in-core inode up to date.  The blocks are taken care
+ * of by the range records.
+ */
+static int ext4_fc_replay_inode(struct super_block *sb,
+				struct ext4_fc_inode *rec, unsigned int len)
+{
+	unsigned long ino = le32_to_cpu(rec->fc_ino);
+	struct ext4_inode_info *ei;
+	struct ext4_inode *raw;
+	struct inode *inode;
+	handle_t *handle;
+	unsigned int old_nlink;
+	uid_t i_uid;
+	gid_t i_gid;
+	u32 flags;
+	int err;
+
+	raw = kzalloc(EXT4_INODE_SIZE(sb), GFP_NOFS);
+	if (!raw)
+		return -ENOMEM;
+	memcpy(raw, rec->fc_raw_inode,
+	       min_t(unsigned int, len, EXT4_INODE_SIZE(sb)));
+
+	handle = ext4_journal_start_sb(sb, EXT4_DATA_TRANS_BLOCKS(sb));
+	if (IS_ERR(handle)) {
+		err = PTR_ERR(handle);
+		goto out;
+	}
+	err = ext4_mark_inode_used(handle, sb, ino,
+				   le16_to_cpu(raw->i_mode));
+	if (!err) {
+		struct ext4_inode *new = kmemdup(raw, EXT4_INODE_SIZE(sb),
+						 GFP_NOFS);
+
+		/* a new inode, without any blocks yet */
+		if (!new) {
+			err = -ENOMEM;
+			goto out_stop;
+		}
+		new->i_size_lo = 0;
+		new->i_size_high = 0;
+		new->i_blocks_lo = 0;
+		new->osd2.linux2.l_i_blocks_high = 0;
+		new->i_file_acl_lo = 0;
+		new->osd2.linux2.l_i_file_acl_high = 0;
+		new->i_dtime = 0;
+		new->i_flags &= ~cpu_to_le32(EXT4_HUGE_FILE_FL);
+		memset(new->i_block, 0, sizeof(new->i_block));
+		if (new->i_flags & cpu_to_le32(EXT4_EXTENTS_FL)) {
+			struct ext4_extent_header *eh = (void *)new->i_block;
+
+			eh->eh_magic = EXT4_EXT_MAGIC;
+			eh->eh_max = cpu_to_le16((sizeof(new->i_block) -
+						  sizeof(*eh)) /
+						 sizeof(struct ext4_extent));
+		}
+		err = ext4_fc_write_raw_inode(handle, sb, ino, new);
+		kfree(new);
+	} else if (err > 0) {
+		err = 0;
+	}
+out_stop:
+	ext4_journal_stop(handle);
+	if (err)
+		goto out;
+
+	inode = ext4_fc_iget(sb, ino);
+	if (IS_ERR(inode))
+		goto out;
+	ei = EXT4_I(inode);
+	if (inode->i_generation != le32_to_cpu(raw->i_generation)) {
+		ext4_msg(sb, KERN_WARNING, "fast commit replay: generation "
+			 "of inode %lu changed, skipping", ino);
+		goto out_iput;
+	}
+
+	handle = ext4_journal_start(inode, EXT4_DATA_TRANS_BLOCKS(sb));
+	if (IS_ERR(handle)) {
+		err = PTR_ERR(handle);
+		goto out_iput;
+	}
+
+	inode->i_mode = le16_to_cpu(raw->i_mode);
+	i_uid = (uid_t)le16_to_cpu(raw->i_uid_low);
+	i_gid = (gid_t)le16_to_cpu(raw->i_gid_low);
+	if (!(test_opt(sb, NO_UID32))) {
+		i_uid |= le16_to_cpu(raw->i_uid_high) << 16;
+		i_gid |= le16_to_cpu(raw->i_gid_high) << 16;
+	}
+	i_uid_write(inode, i_uid);
+	i_gid_write(inode, i_gid);
+	if (S_ISREG(inode->i_mode)) {
+		i_size_write(inode, ext4_isize(raw));
+		ei->i_disksize = inode->i_size;
+	}
+	old_nlink = inode->i_nlink;
+	set_nlink(inode, le16_to_cpu(raw->i_links_count));
+	EXT4_INODE_GET_XTIME(i_ctime, inode, raw);
+	EXT4_INODE_GET_XTIME(i_mtime, inode, raw);
+	EXT4_INODE_GET_XTIME(i_atime, inode, raw);
+
+	/* the mapping and directory layout flags are left alone */
+	flags = EXT4_FL_USER_MODIFIABLE & ~(EXT4_EXTENTS_FL | EXT4_EOFBLOCKS_FL);
+	ei->i_flags = (ei->i_flags & ~flags) |
+		      (le32_to_cpu(raw->i_flags) & flags);
+	ext4_set_inode_flags(inode);
+
+	err = ext4_mark_inode_dirty(handle, inode);
+	if (!err && old_nlink && !inode->i_nlink)
+		err = ext4_orphan_add(handle, inode);
+	ext4_journal_stop(handle);
+out_iput:
+	iput(inode);
+out:
+	kfree(raw);
+	return err;
+}
+
+static int ext4_fc_replay_dentry(struct super_block *sb, int tag,
+				 struct ext4_fc_dentry_info *rec,
+				 unsigned int len)
+{
+	struct qstr name = QSTR_INIT(rec->fc_dname, len - sizeof(*rec));
+	struct inode *dir, *inode;
+	handle_t *handle;
+	int err = 0;
+
+	dir = ext4_fc_iget(sb, le32_to_cpu(rec->fc_parent_ino));
+	if (IS_ERR(dir))
+		return 0;
+	inode = ext4_fc_iget(sb, le32_to_cpu(rec->fc_ino));
+	if (IS_ERR(inode))
+		goto out_dir;
+	if (!S_ISDIR(dir->i_mode) || S_ISDIR(inode->i_mode))
+		goto out;
+
+	handle = ext4_journal_start(dir, EXT4_DATA_TRANS_BLOCKS(sb) +
+				    EXT4_INDEX_EXTRA_TRANS_BLOCKS + 2);
+	if (IS_ERR(handle)) {
+		err = PTR_ERR(handle);
+		goto out;
+	}
+
+	if (tag == EXT4_FC_TAG_UNLINK) {
+		err = ext4_fc_replay_del_entry(handle, dir, inode, &name);
+		if (err > 0 && inode->i_nlink) {
+			drop_nlink(inode);
+			err = ext4_mark_inode_dirty(handle, inode);
+			if (!err && !inode->i_nlink)
+				err = ext4_orphan_add(handle, inode);
+		}
+	} else {
+		err = ext4_fc_replay_add_entry(handle, dir, inode, &name);
+		if (err > 0 && tag == EXT4_FC_TAG_LINK) {
+			inc_nlink(inode);
+			err = ext4_mark_inode_dirty(handle, inode);
+		}
+	}
+	ext4_journal_stop(handle);
+	if (err > 0)
+		err = 0;
+out:
+	iput(inode);
+out_dir:
+	iput(dir);
+	return err;
+}
+
+static int ext4_fc_replay_record(struct super_block *sb, int tag,
+				 void *val, unsigned int len)
+{
+	struct ext4_fc_add_range *add = val;
+	struct ext4_fc_del_range *del = val;
+	struct inode *inode;
+	int err = 0;
+
+	switch (tag) {
+	case EXT4_FC_TAG_INODE:
+		return ext4_fc_replay_inode(sb, val,
+					    len - sizeof(struct ext4_fc_inode));
+	case EXT4_FC_TAG_CREAT:
+	case EXT4_FC_TAG_LINK:
+	case EXT4_FC_TAG_UNLINK:
+		return ext4_fc_replay_dentry(sb, tag, val, len);
+	case EXT4_FC_TAG_ADD_RANGE:
+		inode = ext4_fc_iget(sb, le32_to_cpu(add->fc_ino));
+		if (IS_ERR(inode))
+			return 0;
+		if (S_ISREG(inode->i_mode) &&
+		    ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS))
+			err = ext4_ext_replay_set_range(inode,
+				le32_to_cpu(add->fc_ex.ee_block),
+				ext4_ext_pblock(&add->fc_ex),
+				ext4_ext_get_actual_len(&add->fc_ex),
+				ext4_ext_is_uninitialized(&add->fc_ex));
+		iput(inode);
+		return err;
+	case EXT4_FC_TAG_DEL_RANGE:
+		inode = ext4_fc_iget(sb, le32_to_cpu(del->fc_ino));
+		if (IS_ERR(inode))
+			return 0;
+		if (S_ISREG(inode->i_mode) &&
+		    ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS))
+			err = ext4_ext_replay_del_range(inode,
+				le32_to_cpu(del->fc_lblk),
+				le32_to_cpu(del->fc_len));
+		iput(inode);
+		return err;
+	}
+	return 0;
+}
+
+/**
+ * ext4_fc_replay() - replay the fast commits after journal recovery
+ * @sb: super block being mounted
+ *
+ * The blocks logged by the fast commits are marked in use first, so that
+ * nothing allocated while replaying the records can take them.
+ * EXT4_FC_REPLAY is kept in the superblock until the replay is complete,
+ * a replay interrupted by a crash is done again on the next mount.
+ */
+int ext4_fc_replay(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_super_block *es = sbi->s_es;
+	journal_t *journal = sbi->s_journal;
+	unsigned int s_flags = sb->s_flags;
+	unsigned long nr_blocks;
+	int restart, err;
+
+	if (!journal)
+		return 0;
+	restart = le16_to_cpu(es->s_state) & EXT4_FC_REPLAY;
+	if (!restart && !(journal->j_flags & JBD2_FC_REPLAY))
+		return 0;
+
+	if (EXT4_HAS_RO_COMPAT_FEATURE(sb,
+				       EXT4_FEATURE_RO_COMPAT_METADATA_CSUM) ||
+	    EXT4_HAS_RO_COMPAT_FEATURE(sb, EXT4_FEATURE_RO_COMPAT_BIGALLOC)) {
+		ext4_msg(sb, KERN_WARNING, "fast commits not supported with "
+			 "this feature set, not replaying them");
+		err = 0;
+		goto done;
+	}
+
+	nr_blocks = ext4_fc_scan(sb, restart ? NULL :
+				 &journal->j_fc_replay_tid);
+	if (!nr_blocks) {
+		err = 0;
+		goto done;
+	}
+
+	if (bdev_read_only(sb->s_bdev)) {
+		ext4_msg(sb, KERN_ERR, "write access unavailable, "
+			 "can't replay fast commits");
+		return -EROFS;
+	}
+	if (s_flags & MS_RDONLY) {
+		ext4_msg(sb, KERN_INFO, "fast commit replay on readonly fs");
+		sb->s_flags &= ~MS_RDONLY;
+	}
+
+	es->s_state |= cpu_to_le16(EXT4_FC_REPLAY);
+	ext4_commit_super(sb, 1);
+
+	err = ext4_fc_for_each_record(sb, nr_blocks,
+				      ext4_fc_replay_scan_range);
+	if (!err)
+		err = ext4_fc_for_each_record(sb, nr_blocks,
+					      ext4_fc_replay_record);
+	if (!err)
+		err = jbd2_journal_flush(journal);
+	if (!err) {
+		ext4_msg(sb, KERN_INFO, "fast commit replay complete, "
+			 "%lu blocks", nr_blocks);
+		es->s_state &= ~cpu_to_le16(EXT4_FC_REPLAY);
+		ext4_commit_super(sb, 1);
+	}
+	sb->s_flags = s_flags;	/* Restore MS_RDONLY status */
+done:
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FC_REPLAY;
+	write_unlock(&journal->j_state_lock);
+	return err;
+}
+
+static int ext4_fc_info_show(struct seq_file *seq, void *v)
+{
+	struct super_block *sb = seq->private;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	unsigned long commits, full, fallbacks, fsyncs;
+	u64 bytes, fsync_time;
+
+	spin_lock(&sbi->s_fc_lock);
+	commits = sbi->s_fc_num_commits;
+	full = sbi->s_fc_num_full_commits;
+	fallbacks = sbi->s_fc_num_fallbacks;
+	bytes = sbi->s_fc_bytes;
+	fsyncs = sbi->s_fc_num_fsyncs;
+	fsync_time = sbi->s_fc_fsync_time;
+	spin_unlock(&sbi->s_fc_lock);
+
+	seq_printf(seq, "enabled: %d\n", sbi->s_fc_enabled);
+	seq_printf(seq, "fsyncs: %lu\n", fsyncs);
+	seq_printf(seq, "avg_fsync_us: %llu\n", fsyncs ?
+		   div64_u64(fsync_time, (u64)fsyncs * NSEC_PER_USEC) : 0);
+	seq_printf(seq, "fast_commits: %lu\n", commits);
+	seq_printf(seq, "full_commits: %lu\n", full);
+	seq_printf(seq, "fallbacks: %lu\n", fallbacks);
+	seq_printf(seq, "fast_commit_bytes: %llu\n", bytes);
+	seq_printf(seq, "avg_fast_commit_bytes: %llu\n",
+		   commits ? div64_u64(bytes, commits) : 0);
+	return 0;
+}
+
+static int ext4_fc_info_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, ext4_fc_info_show, PDE(inode)->data);
+}
+
+const struct file_operations ext4_fc_info_fops = {
+	.owner = THIS_MODULE,
+	.open = ext4_fc_info_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
@@ -206,6 +206,7 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	int ret;
 	tid_t commit_tid;
 	bool needs_barrier = false;
+	ktime_t fsync_start = ktime_get();
 
 	J_ASSERT(ext4_journal_current_handle() == NULL);
 
@@ -249,6 +250,16 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 		goto out;
 	}
 
+	/*
+	 * Try to log just what this inode needs first, the running
+	 * transaction is committed in full if that isn't possible.
+	 */
+	ret = ext4_fc_commit(inode, datasync);
+	if (ret != -EAGAIN) {
+		ext4_fc_account_fsync(inode->i_sb, fsync_start, 0);
+		goto out;
+	}
+
 	commit_tid = datasync ? ei->i_datasync_tid : ei->i_sync_tid;
 	if (journal->j_flags & JBD2_BARRIER &&
 	    !jbd2_trans_will_send_data_barrier(journal, commit_tid))
@@ -257,6 +268,7 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	ret = jbd2_log_wait_commit(journal, commit_tid);
 	if (needs_barrier)
 		blkdev_issue_flush(inode->i_sb->s_bdev, GFP_KERNEL, NULL);
+	ext4_fc_account_fsync(inode->i_sb, fsync_start, 1);
  out:
 	mutex_unlock(&inode->i_mutex);
 	trace_ext4_sync_file_exit(inode, ret);
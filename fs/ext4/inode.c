@@ -659,6 +659,8 @@ int ext4_map_blocks(handle_t *handle, struct inode *inode,
 		if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED)
 			set_buffers_da_mapped(inode, map);
 	}
+	if (retval > 0)
+		ext4_fc_track_range(handle, inode, map->m_lblk, map->m_len);
 
 	up_write((&EXT4_I(inode)->i_data_sem));
 	if (retval > 0 && map->m_flags & EXT4_MAP_MAPPED) {
@@ -2175,6 +2177,7 @@ static int write_cache_pages_da(struct address_space *mapping,
 
 			wait_on_page_writeback(page);
 			BUG_ON(PageWriteback(page));
+			wbc_account_io(wbc, page, PAGE_CACHE_SIZE);
 
 			if (mpd->next_page != page->index)
 				mpd->first_page = page->index;
@@ -4760,6 +4763,7 @@ int ext4_change_inode_journal_flag(struct inode *inode, int val)
 	if (IS_ERR(handle))
 		return PTR_ERR(handle);
 
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 	err = ext4_mark_inode_dirty(handle, inode);
 	ext4_handle_sync(handle);
 	ext4_journal_stop(handle);
@@ -4837,6 +4837,123 @@ error_return:
 	return err;
 }
 
+/**
+ * ext4_mb_mark_bb_used() -- mark blocks in use for fast commit replay
+ * @handle:		handle to this transaction
+ * @sb:			super block
+ * @block:		start physical block to mark
+ * @count:		number of blocks to mark
+ *
+ * Marks the blocks of an extent logged by a fast commit as allocated,
+ * blocks which are in use already are left alone.  Bigalloc file systems
+ * don't do fast commits, so blocks and clusters are the same here.
+ */
+int ext4_mb_mark_bb_used(handle_t *handle, struct super_block *sb,
+			 ext4_fsblk_t block, unsigned long count)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct buffer_head *bitmap_bh = NULL;
+	struct buffer_head *gd_bh;
+	struct ext4_group_desc *desc;
+	struct ext4_free_extent ex;
+	struct ext4_buddy e4b;
+	ext4_group_t group;
+	ext4_grpblk_t bit, i, end;
+	unsigned long len, used;
+	int err = 0, ret;
+
+	if (!ext4_data_block_valid(sbi, block, count)) {
+		ext4_error(sb, "Marking blocks %llu-%llu which overlap "
+			   "fs metadata", block, block + count - 1);
+		return -EIO;
+	}
+
+	while (count) {
+		ext4_get_group_no_and_offset(sb, block, &group, &bit);
+		len = min_t(unsigned long, count,
+			    EXT4_BLOCKS_PER_GROUP(sb) - bit);
+
+		bitmap_bh = ext4_read_block_bitmap(sb, group);
+		if (!bitmap_bh) {
+			err = -EIO;
+			break;
+		}
+		desc = ext4_get_group_desc(sb, group, &gd_bh);
+		if (!desc) {
+			err = -EIO;
+			break;
+		}
+
+		BUFFER_TRACE(bitmap_bh, "getting write access");
+		err = ext4_journal_get_write_access(handle, bitmap_bh);
+		if (err)
+			break;
+		BUFFER_TRACE(gd_bh, "get_write_access");
+		err = ext4_journal_get_write_access(handle, gd_bh);
+		if (err)
+			break;
+
+		err = ext4_mb_load_buddy(sb, group, &e4b);
+		if (err)
+			break;
+
+		used = 0;
+		ext4_lock_group(sb, group);
+		for (i = bit; i < bit + len; i = end) {
+			if (mb_test_bit(i, bitmap_bh->b_data)) {
+				end = i + 1;
+				continue;
+			}
+			for (end = i + 1; end < bit + len; end++)
+				if (mb_test_bit(end, bitmap_bh->b_data))
+					break;
+			ex.fe_logical = 0;
+			ex.fe_group = group;
+			ex.fe_start = i;
+			ex.fe_len = end - i;
+			mb_mark_used(&e4b, &ex);
+			ext4_set_bits(bitmap_bh->b_data, i, end - i);
+			used += end - i;
+		}
+		if (desc->bg_flags & cpu_to_le16(EXT4_BG_BLOCK_UNINIT)) {
+			desc->bg_flags &= cpu_to_le16(~EXT4_BG_BLOCK_UNINIT);
+			ext4_free_group_clusters_set(sb, desc,
+				ext4_free_clusters_after_init(sb, group, desc));
+		}
+		ext4_free_group_clusters_set(sb, desc,
+				ext4_free_group_clusters(sb, desc) - used);
+		ext4_block_bitmap_csum_set(sb, group, desc, bitmap_bh);
+		ext4_group_desc_csum_set(sb, group, desc);
+		ext4_unlock_group(sb, group);
+		ext4_mb_unload_buddy(&e4b);
+
+		percpu_counter_sub(&sbi->s_freeclusters_counter, used);
+		if (sbi->s_log_groups_per_flex) {
+			ext4_group_t flex_group = ext4_flex_group(sbi, group);
+			atomic_sub(used,
+				   &sbi->s_flex_groups[flex_group].free_clusters);
+		}
+
+		BUFFER_TRACE(bitmap_bh, "dirtied bitmap block");
+		err = ext4_handle_dirty_metadata(handle, NULL, bitmap_bh);
+		BUFFER_TRACE(gd_bh, "dirtied group descriptor block");
+		ret = ext4_handle_dirty_metadata(handle, NULL, gd_bh);
+		if (!err)
+			err = ret;
+		if (err)
+			break;
+
+		brelse(bitmap_bh);
+		bitmap_bh = NULL;
+		block += len;
+		count -= len;
+	}
+
+	brelse(bitmap_bh);
+	ext4_std_error(sb, err);
+	return err;
+}
+
 /**
  * ext4_trim_extent -- function to TRIM one single free extent in the group
  * @sb:		super block for the file system
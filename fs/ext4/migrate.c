@@ -326,6 +326,7 @@ static int ext4_ext_swap_inode_data(handle_t *handle, struct inode *inode,
 		if (retval)
 			goto err_out;
 	}
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 
 	i_data[0] = ei->i_data[EXT4_IND_BLOCK];
 	i_data[1] = ei->i_data[EXT4_DIND_BLOCK];
@@ -464,6 +465,7 @@ int ext4_ext_migrate(struct inode *inode)
 		retval = PTR_ERR(handle);
 		return retval;
 	}
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 	goal = (((inode->i_ino - 1) / EXT4_INODES_PER_GROUP(inode->i_sb)) *
 		EXT4_INODES_PER_GROUP(inode->i_sb)) + 1;
 	owner[0] = i_uid_read(inode);
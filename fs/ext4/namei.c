@@ -2116,6 +2116,8 @@ retry:
 		inode->i_fop = &ext4_file_operations;
 		ext4_set_aops(inode);
 		err = ext4_add_nondir(handle, dentry, inode);
+		if (!err)
+			ext4_fc_track_create(handle, dentry);
 	}
 	ext4_journal_stop(handle);
 	if (err == -ENOSPC && ext4_should_retry_alloc(dir->i_sb, &retries))
@@ -2144,6 +2146,7 @@ retry:
 
 	if (IS_DIRSYNC(dir))
 		ext4_handle_sync(handle);
+	ext4_fc_mark_ineligible(dir->i_sb, handle);
 
 	inode = ext4_new_inode(handle, dir, mode, &dentry->d_name, 0, NULL);
 	err = PTR_ERR(inode);
@@ -2187,6 +2190,7 @@ retry:
 
 	if (IS_DIRSYNC(dir))
 		ext4_handle_sync(handle);
+	ext4_fc_mark_ineligible(dir->i_sb, handle);
 
 	inode = ext4_new_inode(handle, dir, S_IFDIR | mode,
 			       &dentry->d_name, 0, NULL);
@@ -2514,6 +2518,7 @@ static int ext4_rmdir(struct inode *dir, struct dentry *dentry)
 	handle = ext4_journal_start(dir, EXT4_DELETE_TRANS_BLOCKS(dir->i_sb));
 	if (IS_ERR(handle))
 		return PTR_ERR(handle);
+	ext4_fc_mark_ineligible(dir->i_sb, handle);
 
 	retval = -ENOENT;
 	bh = ext4_find_entry(dir, &dentry->d_name, &de);
@@ -2559,6 +2564,78 @@ end_rmdir:
 	return retval;
 }
 
+/*
+ * Fast commit replay: link @inode into @dir as @name, unless the entry is
+ * there already.  Returns 1 if the entry got added.
+ */
+int ext4_fc_replay_add_entry(handle_t *handle, struct inode *dir,
+			     struct inode *inode, const struct qstr *name)
+{
+	struct dentry *parent, *dentry;
+	struct ext4_dir_entry_2 *de;
+	struct buffer_head *bh;
+	int err;
+
+	bh = ext4_find_entry(dir, name, &de);
+	if (bh) {
+		if (le32_to_cpu(de->inode) != inode->i_ino)
+			ext4_warning(dir->i_sb, "%.*s in dir %lu exists, "
+				     "not linking inode %lu", name->len,
+				     name->name, dir->i_ino, inode->i_ino);
+		brelse(bh);
+		return 0;
+	}
+
+	parent = d_obtain_alias(igrab(dir));
+	if (IS_ERR(parent))
+		return PTR_ERR(parent);
+	dentry = d_alloc(parent, name);
+	if (!dentry) {
+		dput(parent);
+		return -ENOMEM;
+	}
+	err = ext4_add_entry(handle, dentry, inode);
+	dput(dentry);
+	dput(parent);
+	if (err)
+		return err;
+
+	dir->i_ctime = dir->i_mtime = ext4_current_time(dir);
+	ext4_update_dx_flag(dir);
+	err = ext4_mark_inode_dirty(handle, dir);
+	return err ? err : 1;
+}
+
+/*
+ * Fast commit replay: remove the entry @name for @inode from @dir, if it
+ * is still there.  Returns 1 if the entry got removed.
+ */
+int ext4_fc_replay_del_entry(handle_t *handle, struct inode *dir,
+			     struct inode *inode, const struct qstr *name)
+{
+	struct ext4_dir_entry_2 *de;
+	struct buffer_head *bh;
+	int err;
+
+	bh = ext4_find_entry(dir, name, &de);
+	if (!bh)
+		return 0;
+	if (le32_to_cpu(de->inode) != inode->i_ino) {
+		brelse(bh);
+		return 0;
+	}
+
+	err = ext4_delete_entry(handle, dir, de, bh);
+	brelse(bh);
+	if (err)
+		return err;
+
+	dir->i_ctime = dir->i_mtime = ext4_current_time(dir);
+	ext4_update_dx_flag(dir);
+	err = ext4_mark_inode_dirty(handle, dir);
+	return err ? err : 1;
+}
+
 static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 {
 	int retval;
@@ -2608,6 +2685,7 @@ static int ext4_unlink(struct inode *dir, struct dentry *dentry)
 		ext4_orphan_add(handle, inode);
 	inode->i_ctime = ext4_current_time(inode);
 	ext4_mark_inode_dirty(handle, inode);
+	ext4_fc_track_unlink(handle, dentry);
 	retval = 0;
 
 end_unlink:
@@ -2712,6 +2790,7 @@ retry:
 		inode->i_size = l-1;
 	}
 	EXT4_I(inode)->i_disksize = inode->i_size;
+	ext4_fc_mark_ineligible(dir->i_sb, handle);
 	err = ext4_add_nondir(handle, dentry, inode);
 out_stop:
 	ext4_journal_stop(handle);
@@ -2753,6 +2832,7 @@ retry:
 	if (!err) {
 		ext4_mark_inode_dirty(handle, inode);
 		d_instantiate(dentry, inode);
+		ext4_fc_track_link(handle, dentry);
 	} else {
 		drop_nlink(inode);
 		iput(inode);
@@ -2796,6 +2876,7 @@ static int ext4_rename(struct inode *old_dir, struct dentry *old_dentry,
 
 	if (IS_DIRSYNC(old_dir) || IS_DIRSYNC(new_dir))
 		ext4_handle_sync(handle);
+	ext4_fc_mark_ineligible(old_dir->i_sb, handle);
 
 	old_bh = ext4_find_entry(old_dir, &old_dentry->d_name, &old_de);
 	/*
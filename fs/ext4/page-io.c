@@ -298,6 +298,7 @@ static int io_submit_init(struct ext4_io_submit *io,
 	bio->bi_bdev = bh->b_bdev;
 	bio->bi_private = io->io_end = io_end;
 	bio->bi_end_io = ext4_end_bio;
+	wbc_init_bio(wbc, bio);
 
 	io_end->offset = (page->index << PAGE_CACHE_SHIFT) + bh_offset(bh);
 
@@ -343,9 +343,14 @@ static int extend_or_restart_transaction(handle_t *handle, int thresh)
 	if (err < 0)
 		return err;
 	if (err) {
+		struct super_block *sb;
+
+		/* the rest goes into a new transaction */
+		sb = handle->h_transaction->t_journal->j_private;
 		err = ext4_journal_restart(handle, EXT4_MAX_TRANS_DATA);
 		if (err)
 			return err;
+		ext4_fc_mark_ineligible(sb, handle);
 	}
 
 	return 0;
@@ -448,6 +453,7 @@ static int setup_new_flex_group_blocks(struct super_block *sb,
 	handle = ext4_journal_start_sb(sb, EXT4_MAX_TRANS_DATA);
 	if (IS_ERR(handle))
 		return PTR_ERR(handle);
+	ext4_fc_mark_ineligible(sb, handle);
 
 	group = group_data[0].group;
 	for (i = 0; i < flex_gd->count; i++, group++) {
@@ -1329,6 +1335,7 @@ static int ext4_flex_group_add(struct super_block *sb,
 		err = PTR_ERR(handle);
 		goto exit;
 	}
+	ext4_fc_mark_ineligible(sb, handle);
 
 	err = ext4_journal_get_write_access(handle, sbi->s_sbh);
 	if (err)
@@ -1528,6 +1535,7 @@ static int ext4_group_extend_no_check(struct super_block *sb,
 		ext4_warning(sb, "error %d on journal start", err);
 		return err;
 	}
+	ext4_fc_mark_ineligible(sb, handle);
 
 	err = ext4_journal_get_write_access(handle, EXT4_SB(sb)->s_sbh);
 	if (err) {
@@ -63,7 +63,6 @@ static struct ext4_features *ext4_feat;
 static int ext4_load_journal(struct super_block *, struct ext4_super_block *,
 			     unsigned long journal_devnum);
 static int ext4_show_options(struct seq_file *seq, struct dentry *root);
-static int ext4_commit_super(struct super_block *sb, int sync);
 static void ext4_mark_recovery_complete(struct super_block *sb,
 					struct ext4_super_block *es);
 static void ext4_clear_journal_err(struct super_block *sb,
@@ -90,7 +89,7 @@ static struct file_system_type ext2_fs_type = {
 	.name		= "ext2",
 	.mount		= ext4_mount,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_CGROUP_WRITEBACK | FS_PARALLEL_DIROPS,
 };
 #define IS_EXT2_SB(sb) ((sb)->s_bdev->bd_holder == &ext2_fs_type)
 #else
@@ -104,7 +103,7 @@ static struct file_system_type ext3_fs_type = {
 	.name		= "ext3",
 	.mount		= ext4_mount,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_CGROUP_WRITEBACK | FS_PARALLEL_DIROPS,
 };
 #define IS_EXT3_SB(sb) ((sb)->s_bdev->bd_holder == &ext3_fs_type)
 #else
@@ -462,6 +461,8 @@ static void ext4_journal_commit_callback(journal_t *journal, transaction_t *txn)
 		spin_lock(&sbi->s_md_lock);
 	}
 	spin_unlock(&sbi->s_md_lock);
+
+	ext4_fc_cleanup(sb, txn->t_tid);
 }
 
 /* Deal with the reporting of failure conditions on a filesystem such as
@@ -873,10 +874,12 @@ static void ext4_put_super(struct super_block *sb)
 		ext4_commit_super(sb, 1);
 
 	if (sbi->s_proc) {
+		remove_proc_entry("fc_info", sbi->s_proc);
 		remove_proc_entry("options", sbi->s_proc);
 		remove_proc_entry(sb->s_id, ext4_proc_root);
 	}
 	kobject_del(&sbi->s_kobj);
+	ext4_fc_destroy(sb);
 
 	for (i = 0; i < sbi->s_gdb_count; i++)
 		brelse(sbi->s_group_desc[i]);
@@ -960,6 +963,9 @@ static struct inode *ext4_alloc_inode(struct super_block *sb)
 	ei->cur_aio_dio = NULL;
 	ei->i_sync_tid = 0;
 	ei->i_datasync_tid = 0;
+	ei->i_fc_tid = 0;
+	ei->i_fc_lblk_start = 0;
+	ei->i_fc_lblk_len = 0;
 	atomic_set(&ei->i_ioend_count, 0);
 	atomic_set(&ei->i_aiodio_unwritten, 0);
 
@@ -3682,9 +3688,13 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	if (ext4_proc_root)
 		sbi->s_proc = proc_mkdir(sb->s_id, ext4_proc_root);
 
-	if (sbi->s_proc)
+	if (sbi->s_proc) {
 		proc_create_data("options", S_IRUGO, sbi->s_proc,
 				 &ext4_seq_options_fops, sb);
+		proc_create_data("fc_info", S_IRUGO, sbi->s_proc,
+				 &ext4_fc_info_fops, sb);
+	}
+	ext4_fc_init(sb);
 
 	bgl_lock_init(sbi->s_blockgroup_lock);
 
@@ -3835,6 +3845,12 @@ static int ext4_fill_super(struct super_block *sb, void *data, int silent)
 	default:
 		break;
 	}
+	if (EXT4_HAS_COMPAT_FEATURE(sb, EXT4_FEATURE_COMPAT_FAST_COMMIT) &&
+	    !jbd2_journal_set_features(sbi->s_journal, 0, 0,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		ext4_msg(sb, KERN_WARNING, "Failed to set fast commit journal "
+			 "feature, fast commits disabled");
+
 	set_task_ioprio(sbi->s_journal->j_task, journal_ioprio);
 
 	sbi->s_journal->j_commit_callback = ext4_journal_commit_callback;
@@ -3942,6 +3958,22 @@ no_journal:
 		goto failed_mount5;
 	}
 
+	err = ext4_fc_replay(sb);
+	if (err) {
+		ext4_msg(sb, KERN_ERR, "failed to replay fast commits (%d)",
+			 err);
+		goto failed_mount6;
+	}
+	sbi->s_fc_enabled = sbi->s_journal &&
+		EXT4_HAS_COMPAT_FEATURE(sb, EXT4_FEATURE_COMPAT_FAST_COMMIT) &&
+		JBD2_HAS_INCOMPAT_FEATURE(sbi->s_journal,
+					  JBD2_FEATURE_INCOMPAT_FAST_COMMIT) &&
+		test_opt(sb, DATA_FLAGS) == EXT4_MOUNT_ORDERED_DATA &&
+		!EXT4_HAS_RO_COMPAT_FEATURE(sb,
+				EXT4_FEATURE_RO_COMPAT_METADATA_CSUM) &&
+		!EXT4_HAS_RO_COMPAT_FEATURE(sb,
+				EXT4_FEATURE_RO_COMPAT_BIGALLOC);
+
 	err = ext4_register_li_request(sb, first_not_zeroed);
 	if (err)
 		goto failed_mount6;
@@ -4031,6 +4063,7 @@ failed_mount:
 	if (sbi->s_chksum_driver)
 		crypto_free_shash(sbi->s_chksum_driver);
 	if (sbi->s_proc) {
+		remove_proc_entry("fc_info", sbi->s_proc);
 		remove_proc_entry("options", sbi->s_proc);
 		remove_proc_entry(sb->s_id, ext4_proc_root);
 	}
@@ -4295,7 +4328,7 @@ static int ext4_load_journal(struct super_block *sb,
 	return 0;
 }
 
-static int ext4_commit_super(struct super_block *sb, int sync)
+int ext4_commit_super(struct super_block *sb, int sync)
 {
 	struct ext4_super_block *es = EXT4_SB(sb)->s_es;
 	struct buffer_head *sbh = EXT4_SB(sb)->s_sbh;
@@ -5206,7 +5239,7 @@ static struct file_system_type ext4_fs_type = {
 	.name		= "ext4",
 	.mount		= ext4_mount,
 	.kill_sb	= kill_block_super,
-	.fs_flags	= FS_REQUIRES_DEV,
+	.fs_flags	= FS_REQUIRES_DEV | FS_CGROUP_WRITEBACK | FS_PARALLEL_DIROPS,
 };
 
 static int __init ext4_init_feat_adverts(void)
@@ -1054,6 +1054,7 @@ ext4_xattr_set_handle(handle_t *handle, struct inode *inode, int name_index,
 	error = ext4_reserve_inode_write(handle, inode, &is.iloc);
 	if (error)
 		goto cleanup;
+	ext4_fc_mark_ineligible(inode->i_sb, handle);
 
 	if (ext4_test_inode_state(inode, EXT4_STATE_NEW)) {
 		struct ext4_inode *raw_inode = ext4_raw_inode(&is.iloc);
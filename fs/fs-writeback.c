@@ -27,6 +27,8 @@
 #include <linux/blkdev.h>
 #include <linux/backing-dev.h>
 #include <linux/tracepoint.h>
+#include <linux/memcontrol.h>
+#include <linux/bio.h>
 #include "internal.h"
 
 /*
@@ -80,6 +82,21 @@ static inline struct inode *wb_inode(struct list_head *head)
 	return list_entry(head, struct inode, i_wb_list);
 }
 
+/*
+ * The wb an inode is associated with.  Stable while either inode->i_lock or
+ * the list_lock of the returned wb is held.
+ */
+static inline struct bdi_writeback *inode_to_wb(struct inode *inode)
+{
+#ifdef CONFIG_CGROUP_WRITEBACK
+	struct bdi_writeback *wb = ACCESS_ONCE(inode->i_wb);
+
+	if (wb)
+		return wb;
+#endif
+	return &inode_to_bdi(inode)->wb;
+}
+
 /*
  * Include the creation of the trace points after defining the
  * wb_writeback_work structure and inline functions so that the definition
@@ -182,18 +199,449 @@ void bdi_start_background_writeback(struct backing_dev_info *bdi)
 	spin_unlock_bh(&bdi->wb_lock);
 }
 
+/**
+ * locked_inode_to_wb_and_lock_list - determine an inode's wb and lock it
+ * @inode: inode of interest with i_lock held
+ *
+ * Returns @inode's wb with its list_lock held.  @inode->i_lock is dropped,
+ * the association can't change until the list_lock is released.
+ */
+static struct bdi_writeback *
+locked_inode_to_wb_and_lock_list(struct inode *inode)
+	__releases(&inode->i_lock)
+{
+	while (true) {
+		struct bdi_writeback *wb = inode_to_wb(inode);
+
+		/*
+		 * The association is protected by both i_lock and the
+		 * list_lock, which nests outside i_lock.  Pin the wb, drop
+		 * i_lock and check that the association didn't change
+		 * after taking the list_lock.
+		 */
+		wb_get(wb);
+		spin_unlock(&inode->i_lock);
+		spin_lock(&wb->list_lock);
+		if (likely(wb == inode_to_wb(inode))) {
+			/* the inode's own reference keeps it alive */
+			wb_put(wb);
+			return wb;
+		}
+
+		spin_unlock(&wb->list_lock);
+		wb_put(wb);
+		cpu_relax();
+		spin_lock(&inode->i_lock);
+	}
+}
+
+static struct bdi_writeback *inode_to_wb_and_lock_list(struct inode *inode)
+{
+	spin_lock(&inode->i_lock);
+	return locked_inode_to_wb_and_lock_list(inode);
+}
+
 /*
  * Remove the inode from the writeback list it is on.
  */
 void inode_wb_list_del(struct inode *inode)
 {
-	struct backing_dev_info *bdi = inode_to_bdi(inode);
+	struct bdi_writeback *wb;
 
-	spin_lock(&bdi->wb.list_lock);
+	wb = inode_to_wb_and_lock_list(inode);
 	list_del_init(&inode->i_wb_list);
-	spin_unlock(&bdi->wb.list_lock);
+	spin_unlock(&wb->list_lock);
 }
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+
+/*
+ * Parameters of the foreign inode detection, see wbc_detach_inode().  Each
+ * writeback round shifts up to WB_FRN_HIST_MAX_SLOTS slots, one per
+ * WB_FRN_HIST_UNIT bytes written, into the 16 bit history of the inode.
+ * The inode is switched once more than WB_FRN_HIST_THR_SLOTS of them were
+ * written mostly by a foreign memcg, so a single large round can't do it.
+ */
+#define WB_FRN_HIST_SLOTS	16
+#define WB_FRN_HIST_UNIT	(256 * 1024)
+#define WB_FRN_HIST_THR_SLOTS	(WB_FRN_HIST_SLOTS / 2)
+#define WB_FRN_HIST_MAX_SLOTS	(WB_FRN_HIST_THR_SLOTS / 2 + 1)
+
+struct inode_switch_wbs_context {
+	struct inode		*inode;
+	struct bdi_writeback	*new_wb;
+
+	struct rcu_head		rcu_head;
+	struct work_struct	work;
+};
+
+static atomic_t isw_nr_in_flight = ATOMIC_INIT(0);
+static struct workqueue_struct *isw_wq;
+
+static void inode_switch_wbs_work_fn(struct work_struct *work)
+{
+	struct inode_switch_wbs_context *isw =
+		container_of(work, struct inode_switch_wbs_context, work);
+	struct inode *inode = isw->inode;
+	struct address_space *mapping = inode->i_mapping;
+	struct bdi_writeback *old_wb = inode_to_wb(inode);
+	struct bdi_writeback *new_wb = isw->new_wb;
+	struct radix_tree_iter iter;
+	bool switched = false;
+	void **slot;
+
+	/*
+	 * I_WB_SWITCH keeps others from changing the association.  The
+	 * list_locks and i_lock synchronize against the writeback list
+	 * users, tree_lock against the page stat updates.
+	 */
+	bdi_lock_two(old_wb, new_wb);
+	spin_lock(&inode->i_lock);
+	spin_lock_irq(&mapping->tree_lock);
+
+	/* once I_FREEING is set, the inode is on its way out, leave it */
+	if (unlikely(inode->i_state & I_FREEING))
+		goto skip_switch;
+
+	radix_tree_for_each_tagged(slot, &mapping->page_tree, &iter, 0,
+				   PAGECACHE_TAG_DIRTY) {
+		struct page *page = radix_tree_deref_slot_protected(slot,
+							&mapping->tree_lock);
+		if (likely(page) && PageDirty(page)) {
+			__dec_wb_stat(old_wb, WB_RECLAIMABLE);
+			__inc_wb_stat(new_wb, WB_RECLAIMABLE);
+		}
+	}
+
+	radix_tree_for_each_tagged(slot, &mapping->page_tree, &iter, 0,
+				   PAGECACHE_TAG_WRITEBACK) {
+		struct page *page = radix_tree_deref_slot_protected(slot,
+							&mapping->tree_lock);
+		if (likely(page) && PageWriteback(page)) {
+			__dec_wb_stat(old_wb, WB_WRITEBACK);
+			__inc_wb_stat(new_wb, WB_WRITEBACK);
+		}
+	}
+
+	/*
+	 * Transfer the inode to new_wb's b_dirty, keeping it sorted by
+	 * dirtied_when, newest first.  Inodes on b_io and b_more_io are
+	 * just queued again by new_wb's next round.
+	 */
+	if (!list_empty(&inode->i_wb_list)) {
+		struct inode *pos;
+
+		list_del_init(&inode->i_wb_list);
+		list_for_each_entry(pos, &new_wb->b_dirty, i_wb_list)
+			if (time_after_eq(inode->dirtied_when,
+					  pos->dirtied_when))
+				break;
+		list_add_tail(&inode->i_wb_list, &pos->i_wb_list);
+	}
+
+	/* the reference on new_wb is transferred to the inode */
+	inode->i_wb = new_wb;
+	inode->i_wb_frn_winner = 0;
+	inode->i_wb_frn_history = 0;
+	switched = true;
+skip_switch:
+	/*
+	 * Paired with the smp_rmb() in unlocked_mapping_to_wb_begin(), the
+	 * new association must be visible before I_WB_SWITCH is cleared.
+	 */
+	smp_wmb();
+	inode->i_state &= ~I_WB_SWITCH;
+
+	spin_unlock_irq(&mapping->tree_lock);
+	spin_unlock(&inode->i_lock);
+	spin_unlock(&new_wb->list_lock);
+	spin_unlock(&old_wb->list_lock);
+
+	if (switched)
+		wb_put(old_wb);
+	else
+		wb_put(new_wb);
+
+	iput(inode);
+	kfree(isw);
+
+	atomic_dec(&isw_nr_in_flight);
+}
+
+static void inode_switch_wbs_rcu_fn(struct rcu_head *rcu_head)
+{
+	struct inode_switch_wbs_context *isw = container_of(rcu_head,
+				struct inode_switch_wbs_context, rcu_head);
+
+	/* needs to grab bh-unsafe locks, bounce to work item */
+	INIT_WORK(&isw->work, inode_switch_wbs_work_fn);
+	queue_work(isw_wq, &isw->work);
+}
+
+/**
+ * inode_switch_wbs - change the wb association of an inode
+ * @inode: target inode
+ * @new_memcg_id: css_id of the memcg to switch to, 0 for the root memcg
+ *
+ * Switch @inode's wb association to the wb of @new_memcg_id, or to the
+ * root wb if that doesn't exist.  The switching is performed
+ * asynchronously and may fail silently.  Doesn't sleep.
+ */
+void inode_switch_wbs(struct inode *inode, unsigned short new_memcg_id)
+{
+	struct backing_dev_info *bdi = inode_to_bdi(inode);
+	struct inode_switch_wbs_context *isw;
+
+	/* noop if seems to be already in progress */
+	if (inode->i_state & I_WB_SWITCH)
+		return;
+
+	isw = kzalloc(sizeof(*isw), GFP_ATOMIC);
+	if (!isw)
+		return;
+
+	/* paired with the smp_mb() in cgroup_writeback_umount() */
+	atomic_inc(&isw_nr_in_flight);
+	smp_mb__after_atomic_inc();
+
+	isw->new_wb = wb_get_lookup(bdi, new_memcg_id);
+	if (!isw->new_wb)
+		isw->new_wb = &bdi->wb;
+
+	/* while holding I_WB_SWITCH, no one else can update the association */
+	spin_lock(&inode->i_lock);
+	if (!(inode->i_sb->s_flags & MS_ACTIVE) ||
+	    inode->i_state & (I_WB_SWITCH | I_FREEING | I_WILL_FREE) ||
+	    inode_to_wb(inode) == isw->new_wb) {
+		spin_unlock(&inode->i_lock);
+		goto out_free;
+	}
+	inode->i_state |= I_WB_SWITCH;
+	__iget(inode);
+	spin_unlock(&inode->i_lock);
+
+	isw->inode = inode;
+
+	/*
+	 * I_WB_SWITCH makes the RCU protected page stat updaters take
+	 * tree_lock, continue once that is visible to all of them.
+	 */
+	call_rcu(&isw->rcu_head, inode_switch_wbs_rcu_fn);
+	return;
+
+out_free:
+	wb_put(isw->new_wb);
+	kfree(isw);
+	atomic_dec(&isw_nr_in_flight);
+}
+
+/**
+ * wbc_attach_and_unlock_inode - associate wbc with target inode and unlock it
+ * @wbc: writeback_control of interest
+ * @inode: target inode
+ *
+ * @inode is locked and about to be written back under the control of @wbc.
+ * Record @inode's writeback context into @wbc and unlock the i_lock.  On
+ * writeback completion, wbc_detach_inode() should be called.
+ */
+void wbc_attach_and_unlock_inode(struct writeback_control *wbc,
+				 struct inode *inode)
+	__releases(&inode->i_lock)
+{
+	struct bdi_writeback *wb;
+
+	wbc->wb = NULL;
+	wbc->inode = inode;
+	wbc->blkcg_css = NULL;
+
+	if (!inode_cgwb_enabled(inode)) {
+		spin_unlock(&inode->i_lock);
+		return;
+	}
+
+	wb = inode_to_wb(inode);
+	wb_get(wb);
+	wbc->wb = wb;
+	wbc->wb_id = wb->memcg_id;
+	wbc->wb_lcand_id = inode->i_wb_frn_winner;
+	wbc->wb_tcand_id = 0;
+	wbc->wb_bytes = 0;
+	wbc->wb_lcand_bytes = 0;
+	wbc->wb_tcand_bytes = 0;
+	spin_unlock(&inode->i_lock);
+
+	if (wbc->wb_id)
+		wbc->blkcg_css = mem_cgroup_wb_blkcg_css(wbc->wb_id);
+}
+
+/**
+ * wbc_detach_inode - disassociate wbc from inode and perform foreign detection
+ * @wbc: writeback_control of the just finished writeback
+ *
+ * An inode is associated with the wb of the memcg which first dirtied it,
+ * but its pages may later be dirtied and owned by another one, which then
+ * isn't throttled and charged for the writeback properly.
+ *
+ * While writing out, wbc_account_io() keeps track of the bytes written
+ * for the current wb, for the winner of the last round and for a foreign
+ * candidate elected with the Boyer-Moore majority vote.  Here the winner
+ * of this round is determined and the result is shifted into the inode's
+ * history, weighted by the amount written.  If most of the history is
+ * foreign, the inode is switched to the winner.  Inodes of a wb whose
+ * memcg is gone are always switched.
+ */
+void wbc_detach_inode(struct writeback_control *wbc)
+{
+	struct bdi_writeback *wb = wbc->wb;
+	struct inode *inode = wbc->inode;
+	unsigned short max_id;
+	size_t max_bytes;
+	u16 history;
+	int slots;
+
+	if (!wb)
+		return;
+
+	/* pick the winner of this round */
+	if (wbc->wb_bytes >= wbc->wb_lcand_bytes &&
+	    wbc->wb_bytes >= wbc->wb_tcand_bytes) {
+		max_id = wbc->wb_id;
+		max_bytes = wbc->wb_bytes;
+	} else if (wbc->wb_lcand_bytes >= wbc->wb_tcand_bytes) {
+		max_id = wbc->wb_lcand_id;
+		max_bytes = wbc->wb_lcand_bytes;
+	} else {
+		max_id = wbc->wb_tcand_id;
+		max_bytes = wbc->wb_tcand_bytes;
+	}
+
+	if (unlikely(wb->offline)) {
+		inode_switch_wbs(inode, max_id != wbc->wb_id ? max_id : 0);
+		goto out;
+	}
+
+	history = inode->i_wb_frn_history;
+	if (max_bytes) {
+		slots = min_t(int, DIV_ROUND_UP(max_bytes, WB_FRN_HIST_UNIT),
+			      WB_FRN_HIST_MAX_SLOTS);
+		history <<= slots;
+		if (max_id != wbc->wb_id)
+			history |= (1U << slots) - 1;
+
+		if (hweight16(history) > WB_FRN_HIST_THR_SLOTS)
+			inode_switch_wbs(inode, max_id);
+	}
+
+	/* racing updates from concurrent writeback don't matter much */
+	inode->i_wb_frn_winner = max_id;
+	inode->i_wb_frn_history = history;
+out:
+	wb_put(wb);
+	wbc->wb = NULL;
+	if (wbc->blkcg_css) {
+		css_put(wbc->blkcg_css);
+		wbc->blkcg_css = NULL;
+	}
+}
+
+/**
+ * wbc_account_io - account IO issued during writeback
+ * @wbc: writeback_control of the writeback in progress
+ * @page: page being written out
+ * @bytes: number of bytes being written out
+ *
+ * @bytes from @page are about to be written out during the writeback
+ * controlled by @wbc.  Keep the book for foreign inode detection.  See
+ * wbc_detach_inode().
+ */
+void wbc_account_io(struct writeback_control *wbc, struct page *page,
+		    size_t bytes)
+{
+	unsigned short id;
+
+	/* writeback outside of the flusher isn't attached, e.g. pageout() */
+	if (!wbc->wb)
+		return;
+
+	id = mem_cgroup_wb_page_id(page);
+	if (id == wbc->wb_id) {
+		wbc->wb_bytes += bytes;
+		return;
+	}
+
+	if (id == wbc->wb_lcand_id)
+		wbc->wb_lcand_bytes += bytes;
+
+	/* Boyer-Moore majority vote algorithm */
+	if (!wbc->wb_tcand_bytes)
+		wbc->wb_tcand_id = id;
+	if (id == wbc->wb_tcand_id)
+		wbc->wb_tcand_bytes += bytes;
+	else
+		wbc->wb_tcand_bytes -= min(bytes, wbc->wb_tcand_bytes);
+}
+EXPORT_SYMBOL_GPL(wbc_account_io);
+
+/**
+ * wbc_init_bio - writeback specific initializtion of bio
+ * @wbc: writeback_control for the writeback in progress
+ * @bio: bio to be initialized
+ *
+ * @bio is a part of the writeback in progress controlled by @wbc.  Tag it
+ * with the blkcg of the memcg owning the inode, so that the IO is issued
+ * and accounted on behalf of the cgroup which dirtied the pages rather
+ * than the flusher thread.
+ */
+void wbc_init_bio(struct writeback_control *wbc, struct bio *bio)
+{
+	if (wbc->blkcg_css)
+		bio_associate_blkcg(bio, wbc->blkcg_css);
+}
+EXPORT_SYMBOL_GPL(wbc_init_bio);
+
+/*
+ * Drop the wb reference of an inode which is being destroyed.
+ */
+void inode_detach_wb(struct inode *inode)
+{
+	if (inode->i_wb) {
+		wb_put(inode->i_wb);
+		inode->i_wb = NULL;
+	}
+}
+
+/**
+ * cgroup_writeback_umount - flush inode wb switches for umount
+ *
+ * This function is called when a super_block is about to be destroyed and
+ * flushes in-flight inode wb switches.  An inode wb switch goes through
+ * RCU and then workqueue, so the two need to be flushed in order to ensure
+ * that all previously scheduled switches are finished.  As wb switches are
+ * rare occurrences and synchronize_rcu() can take a while, perform
+ * flushing iff wb switches are in flight.
+ */
+void cgroup_writeback_umount(void)
+{
+	/* MS_ACTIVE is cleared, paired with inode_switch_wbs() */
+	smp_mb();
+
+	if (atomic_read(&isw_nr_in_flight)) {
+		rcu_barrier();
+		flush_workqueue(isw_wq);
+	}
+}
+
+static int __init cgroup_writeback_init(void)
+{
+	isw_wq = alloc_workqueue("inode_switch_wbs", 0, 0);
+	if (!isw_wq)
+		return -ENOMEM;
+	return 0;
+}
+fs_initcall(cgroup_writeback_init);
+
+#endif	/* CONFIG_CGROUP_WRITEBACK */
+
 /*
  * Redirty an inode: set its when-it-was dirtied timestamp and move it to the
  * furthest end of its superblock's dirty-inode list.
@@ -441,8 +889,7 @@ static void requeue_inode(struct inode *inode, struct bdi_writeback *wb,
  * setting I_SYNC flag and calling inode_sync_complete() to clear it.
  */
 static int
-__writeback_single_inode(struct inode *inode, struct bdi_writeback *wb,
-			 struct writeback_control *wbc)
+__writeback_single_inode(struct inode *inode, struct writeback_control *wbc)
 {
 	struct address_space *mapping = inode->i_mapping;
 	long nr_to_write = wbc->nr_to_write;
@@ -494,10 +941,10 @@ __writeback_single_inode(struct inode *inode, struct bdi_writeback *wb,
  * we go e.g. from filesystem. Flusher thread uses __writeback_single_inode()
  * and does more profound writeback list handling in writeback_sb_inodes().
  */
-static int
-writeback_single_inode(struct inode *inode, struct bdi_writeback *wb,
-		       struct writeback_control *wbc)
+static int writeback_single_inode(struct inode *inode,
+				  struct writeback_control *wbc)
 {
+	struct bdi_writeback *wb;
 	int ret = 0;
 
 	spin_lock(&inode->i_lock);
@@ -527,11 +974,13 @@ writeback_single_inode(struct inode *inode, struct bdi_writeback *wb,
 	if (!(inode->i_state & I_DIRTY))
 		goto out;
 	inode->i_state |= I_SYNC;
-	spin_unlock(&inode->i_lock);
+	wbc_attach_and_unlock_inode(wbc, inode);
 
-	ret = __writeback_single_inode(inode, wb, wbc);
+	ret = __writeback_single_inode(inode, wbc);
 
-	spin_lock(&wb->list_lock);
+	wbc_detach_inode(wbc);
+
+	wb = inode_to_wb_and_lock_list(inode);
 	spin_lock(&inode->i_lock);
 	/*
 	 * If inode is clean, remove it from writeback lists. Otherwise don't
@@ -546,7 +995,7 @@ out:
 	return ret;
 }
 
-static long writeback_chunk_size(struct backing_dev_info *bdi,
+static long writeback_chunk_size(struct bdi_writeback *wb,
 				 struct wb_writeback_work *work)
 {
 	long pages;
@@ -567,7 +1016,7 @@ static long writeback_chunk_size(struct backing_dev_info *bdi,
 	if (work->sync_mode == WB_SYNC_ALL || work->tagged_writepages)
 		pages = LONG_MAX;
 	else {
-		pages = min(bdi->avg_write_bandwidth / 2,
+		pages = min(wb->avg_write_bandwidth / 2,
 			    global_dirty_limit / DIRTY_SCOPE);
 		pages = min(pages, work->nr_pages);
 		pages = round_down(pages + MIN_WRITEBACK_PAGES,
@@ -605,6 +1054,7 @@ static long writeback_sb_inodes(struct super_block *sb,
 
 	while (!list_empty(&wb->b_io)) {
 		struct inode *inode = wb_inode(wb->b_io.prev);
+		struct bdi_writeback *tmp_wb;
 
 		if (inode->i_sb != sb) {
 			if (work->sb) {
@@ -666,9 +1116,9 @@ static long writeback_sb_inodes(struct super_block *sb,
 			continue;
 		}
 		inode->i_state |= I_SYNC;
-		spin_unlock(&inode->i_lock);
+		wbc_attach_and_unlock_inode(&wbc, inode);
 
-		write_chunk = writeback_chunk_size(wb->bdi, work);
+		write_chunk = writeback_chunk_size(wb, work);
 		wbc.nr_to_write = write_chunk;
 		wbc.pages_skipped = 0;
 
@@ -676,17 +1126,29 @@ static long writeback_sb_inodes(struct super_block *sb,
 		 * We use I_SYNC to pin the inode in memory. While it is set
 		 * evict_inode() will wait so the inode cannot be freed.
 		 */
-		__writeback_single_inode(inode, wb, &wbc);
+		__writeback_single_inode(inode, &wbc);
 
+		wbc_detach_inode(&wbc);
 		work->nr_pages -= write_chunk - wbc.nr_to_write;
 		wrote += write_chunk - wbc.nr_to_write;
-		spin_lock(&wb->list_lock);
+
+		/*
+		 * The inode may have been switched to another wb in the
+		 * meantime, requeue it on the one it belongs to now.
+		 */
+		tmp_wb = inode_to_wb_and_lock_list(inode);
 		spin_lock(&inode->i_lock);
 		if (!(inode->i_state & I_DIRTY))
 			wrote++;
-		requeue_inode(inode, wb, &wbc);
+		requeue_inode(inode, tmp_wb, &wbc);
 		inode_sync_complete(inode);
 		spin_unlock(&inode->i_lock);
+
+		if (unlikely(tmp_wb != wb)) {
+			spin_unlock(&tmp_wb->list_lock);
+			spin_lock(&wb->list_lock);
+		}
+
 		cond_resched_lock(&wb->list_lock);
 		/*
 		 * bail out to wb_writeback() often enough to check
@@ -755,31 +1217,13 @@ long writeback_inodes_wb(struct bdi_writeback *wb, long nr_pages,
 	return nr_pages - work.nr_pages;
 }
 
-static bool over_bground_thresh(struct backing_dev_info *bdi)
-{
-	unsigned long background_thresh, dirty_thresh;
-
-	global_dirty_limits(&background_thresh, &dirty_thresh);
-
-	if (global_page_state(NR_FILE_DIRTY) +
-	    global_page_state(NR_UNSTABLE_NFS) > background_thresh)
-		return true;
-
-	if (bdi_stat(bdi, BDI_RECLAIMABLE) >
-				bdi_dirty_limit(bdi, background_thresh))
-		return true;
-
-	return false;
-}
-
 /*
- * Called under wb->list_lock. If there are multiple wb per bdi,
- * only the flusher working on the first wb should do it.
+ * Called under wb->list_lock.
  */
 static void wb_update_bandwidth(struct bdi_writeback *wb,
 				unsigned long start_time)
 {
-	__bdi_update_bandwidth(wb->bdi, 0, 0, 0, 0, 0, start_time);
+	__wb_update_bandwidth(wb, 0, 0, 0, 0, 0, start_time);
 }
 
 /*
@@ -831,7 +1275,7 @@ static long wb_writeback(struct bdi_writeback *wb,
 		 * For background writeout, stop when we are below the
 		 * background dirty threshold
 		 */
-		if (work->for_background && !over_bground_thresh(wb->bdi))
+		if (work->for_background && !wb_over_bg_thresh(wb))
 			break;
 
 		/*
@@ -923,7 +1367,7 @@ static unsigned long get_nr_dirty_pages(void)
 
 static long wb_check_background_flush(struct bdi_writeback *wb)
 {
-	if (over_bground_thresh(wb->bdi)) {
+	if (wb_over_bg_thresh(wb)) {
 
 		struct wb_writeback_work work = {
 			.nr_pages	= LONG_MAX,
@@ -973,6 +1417,39 @@ static long wb_check_old_data_flush(struct bdi_writeback *wb)
 	return 0;
 }
 
+/*
+ * Execute @base_work on all wbs of @bdi which have dirty inodes.  A limited
+ * number of pages is split between them in proportion to their write
+ * bandwidth.
+ */
+static long bdi_split_work_exec(struct backing_dev_info *bdi,
+				struct wb_writeback_work *base_work)
+{
+	unsigned long tot_bw = 0;
+	struct bdi_writeback *wb;
+	long wrote = 0;
+
+	bdi_for_each_wb(wb, bdi)
+		if (wb_has_dirty_io(wb))
+			tot_bw += wb->avg_write_bandwidth;
+
+	bdi_for_each_wb(wb, bdi) {
+		struct wb_writeback_work work = *base_work;
+
+		if (!wb_has_dirty_io(wb))
+			continue;
+
+		if (base_work->nr_pages != LONG_MAX && tot_bw)
+			work.nr_pages = DIV_ROUND_UP_ULL(
+				(u64)base_work->nr_pages *
+				wb->avg_write_bandwidth, tot_bw);
+
+		wrote += wb_writeback(wb, &work);
+	}
+
+	return wrote;
+}
+
 /*
  * Retrieve work items and do the writeback they describe
  */
@@ -980,6 +1457,7 @@ long wb_do_writeback(struct bdi_writeback *wb, int force_wait)
 {
 	struct backing_dev_info *bdi = wb->bdi;
 	struct wb_writeback_work *work;
+	struct bdi_writeback *iter;
 	long wrote = 0;
 
 	set_bit(BDI_writeback_running, &wb->bdi->state);
@@ -993,7 +1471,7 @@ long wb_do_writeback(struct bdi_writeback *wb, int force_wait)
 
 		trace_writeback_exec(bdi, work);
 
-		wrote += wb_writeback(wb, work);
+		wrote += bdi_split_work_exec(bdi, work);
 
 		/*
 		 * Notify the caller of completion if this is a synchronous
@@ -1008,8 +1486,10 @@ long wb_do_writeback(struct bdi_writeback *wb, int force_wait)
 	/*
 	 * Check for periodic writeback, kupdated() style
 	 */
-	wrote += wb_check_old_data_flush(wb);
-	wrote += wb_check_background_flush(wb);
+	bdi_for_each_wb(iter, bdi) {
+		wrote += wb_check_old_data_flush(iter);
+		wrote += wb_check_background_flush(iter);
+	}
 	clear_bit(BDI_writeback_running, &wb->bdi->state);
 
 	return wrote;
@@ -1056,7 +1536,7 @@ int bdi_writeback_thread(void *data)
 			continue;
 		}
 
-		if (wb_has_dirty_io(wb) && dirty_writeback_interval)
+		if (bdi_has_dirty_io(bdi) && dirty_writeback_interval)
 			schedule_timeout(msecs_to_jiffies(dirty_writeback_interval * 10));
 		else {
 			/*
@@ -1202,6 +1682,7 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 		 * reposition it (that would break b_dirty time-ordering).
 		 */
 		if (!was_dirty) {
+			struct bdi_writeback *wb;
 			bool wakeup_bdi = false;
 			bdi = inode_to_bdi(inode);
 
@@ -1215,15 +1696,14 @@ void __mark_inode_dirty(struct inode *inode, int flags)
 				 * bdi thread to make sure background
 				 * write-back happens later.
 				 */
-				if (!wb_has_dirty_io(&bdi->wb))
+				if (!wb_has_dirty_io(inode_to_wb(inode)))
 					wakeup_bdi = true;
 			}
 
-			spin_unlock(&inode->i_lock);
-			spin_lock(&bdi->wb.list_lock);
+			wb = locked_inode_to_wb_and_lock_list(inode);
 			inode->dirtied_when = jiffies;
-			list_move(&inode->i_wb_list, &bdi->wb.b_dirty);
-			spin_unlock(&bdi->wb.list_lock);
+			list_move(&inode->i_wb_list, &wb->b_dirty);
+			spin_unlock(&wb->list_lock);
 
 			if (wakeup_bdi)
 				bdi_wakeup_thread_delayed(bdi);
@@ -1422,7 +1902,6 @@ EXPORT_SYMBOL(sync_inodes_sb);
  */
 int write_inode_now(struct inode *inode, int sync)
 {
-	struct bdi_writeback *wb = &inode_to_bdi(inode)->wb;
 	struct writeback_control wbc = {
 		.nr_to_write = LONG_MAX,
 		.sync_mode = sync ? WB_SYNC_ALL : WB_SYNC_NONE,
@@ -1434,7 +1913,7 @@ int write_inode_now(struct inode *inode, int sync)
 		wbc.nr_to_write = 0;
 
 	might_sleep();
-	return writeback_single_inode(inode, wb, &wbc);
+	return writeback_single_inode(inode, &wbc);
 }
 EXPORT_SYMBOL(write_inode_now);
 
@@ -1451,7 +1930,7 @@ EXPORT_SYMBOL(write_inode_now);
  */
 int sync_inode(struct inode *inode, struct writeback_control *wbc)
 {
-	return writeback_single_inode(inode, &inode_to_bdi(inode)->wb, wbc);
+	return writeback_single_inode(inode, wbc);
 }
 EXPORT_SYMBOL(sync_inode);
 
@@ -25,13 +25,35 @@ MODULE_ALIAS("devname:fuse");
 
 static struct kmem_cache *fuse_req_cachep;
 
-static struct fuse_conn *fuse_get_conn(struct file *file)
+static struct fuse_dev *fuse_get_dev(struct file *file)
 {
 	/*
 	 * Lockless access is OK, because file->private data is set
-	 * once during mount and is valid until the file is released.
+	 * once during mount or clone and is valid until the file is
+	 * released.
 	 */
-	return file->private_data;
+	return ACCESS_ONCE(file->private_data);
+}
+
+static struct fuse_conn *fuse_get_conn(struct file *file)
+{
+	struct fuse_dev *fud = fuse_get_dev(file);
+
+	return fud ? fud->fc : NULL;
+}
+
+static struct fuse_iqueue *fuse_iq(struct fuse_conn *fc, unsigned int cpu)
+{
+	return per_cpu_ptr(fc->iq, cpu);
+}
+
+/*
+ * Input queue of the sending CPU.  Being migrated away afterwards
+ * doesn't matter, the queue is only picked for locality.
+ */
+static struct fuse_iqueue *fuse_iq_current(struct fuse_conn *fc)
+{
+	return __this_cpu_ptr(fc->iq);
 }
 
 static void fuse_request_init(struct fuse_req *req)
@@ -227,59 +249,123 @@ static unsigned len_args(unsigned numargs, struct fuse_arg *args)
 	return nbytes;
 }
 
-static u64 fuse_get_unique(struct fuse_conn *fc)
+/*
+ * The CPU of the input queue is kept in the low bits of the unique ID,
+ * so that replies can be matched without searching all queues.  The
+ * counter starts at one, zero is special.
+ */
+static u64 fuse_get_unique(struct fuse_iqueue *iq)
+{
+	iq->reqctr++;
+
+	return (iq->reqctr << FUSE_UNIQUE_CPU_BITS) | iq->cpu;
+}
+
+/* Input queue a unique ID was handed out by, NULL if it's bogus */
+static struct fuse_iqueue *fuse_unique_iq(struct fuse_conn *fc, u64 unique)
 {
-	fc->reqctr++;
-	/* zero is special */
-	if (fc->reqctr == 0)
-		fc->reqctr = 1;
+	unsigned int cpu = unique & ((1 << FUSE_UNIQUE_CPU_BITS) - 1);
+
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu))
+		return NULL;
 
-	return fc->reqctr;
+	return fuse_iq(fc, cpu);
 }
 
+static int forget_pending(struct fuse_iqueue *iq)
+{
+	return iq->forget_list_head.next != NULL;
+}
+
+static int request_pending(struct fuse_iqueue *iq)
+{
+	return !list_empty(&iq->pending) || !list_empty(&iq->interrupts) ||
+		forget_pending(iq);
+}
+
+/*
+ * Let a reader know that there is something on the input queue: the
+ * channel bound to it, or else one of the unbound channels.
+ *
+ * Called with iq->lock
+ */
+static void fuse_iq_wake(struct fuse_conn *fc, struct fuse_iqueue *iq)
+{
+	if (iq->bound) {
+		wake_up(&iq->waitq);
+	} else {
+		if (!cpumask_test_cpu(iq->cpu, fc->iq_pending))
+			cpumask_set_cpu(iq->cpu, fc->iq_pending);
+		/* pairs with prepare_to_wait() in fuse_dev_wait() */
+		smp_mb();
+		if (waitqueue_active(&fc->waitq))
+			wake_up(&fc->waitq);
+	}
+	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+}
+
+void fuse_wake_up_readers(struct fuse_conn *fc)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		wake_up_all(&fuse_iq(fc, cpu)->waitq);
+	wake_up_all(&fc->waitq);
+	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+}
+EXPORT_SYMBOL_GPL(fuse_wake_up_readers);
+
+/* Called with req->iq->lock */
 static void queue_request(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_iqueue *iq = req->iq;
+
 	req->in.h.len = sizeof(struct fuse_in_header) +
 		len_args(req->in.numargs, (struct fuse_arg *) req->in.args);
-	list_add_tail(&req->list, &fc->pending);
+	list_add_tail(&req->list, &iq->pending);
 	req->state = FUSE_REQ_PENDING;
 	if (!req->waiting) {
 		req->waiting = 1;
 		atomic_inc(&fc->num_waiting);
 	}
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	fuse_iq_wake(fc, iq);
 }
 
 void fuse_queue_forget(struct fuse_conn *fc, struct fuse_forget_link *forget,
 		       u64 nodeid, u64 nlookup)
 {
+	struct fuse_iqueue *iq = fuse_iq_current(fc);
+
 	forget->forget_one.nodeid = nodeid;
 	forget->forget_one.nlookup = nlookup;
 
-	spin_lock(&fc->lock);
+	spin_lock(&iq->lock);
 	if (fc->connected) {
-		fc->forget_list_tail->next = forget;
-		fc->forget_list_tail = forget;
-		wake_up(&fc->waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+		iq->forget_list_tail->next = forget;
+		iq->forget_list_tail = forget;
+		fuse_iq_wake(fc, iq);
 	} else {
 		kfree(forget);
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 }
 
+/* Called with fc->lock */
 static void flush_bg_queue(struct fuse_conn *fc)
 {
 	while (fc->active_background < fc->max_background &&
 	       !list_empty(&fc->bg_queue)) {
 		struct fuse_req *req;
+		struct fuse_iqueue *iq;
 
 		req = list_entry(fc->bg_queue.next, struct fuse_req, list);
 		list_del(&req->list);
 		fc->active_background++;
-		req->in.h.unique = fuse_get_unique(fc);
+		iq = req->iq;
+		spin_lock(&iq->lock);
+		req->in.h.unique = fuse_get_unique(iq);
 		queue_request(fc, req);
+		spin_unlock(&iq->lock);
 	}
 }
 
@@ -291,17 +377,19 @@ static void flush_bg_queue(struct fuse_conn *fc)
  * the 'end' callback is called if given, else the reference to the
  * request is released
  *
- * Called with fc->lock, unlocks it
+ * Called with req->iq->lock, unlocks it
  */
 static void request_end(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
+__releases(req->iq->lock)
 {
 	void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 	req->end = NULL;
 	list_del(&req->list);
 	list_del(&req->intr_entry);
 	req->state = FUSE_REQ_FINISHED;
+	spin_unlock(&req->iq->lock);
 	if (req->background) {
+		spin_lock(&fc->lock);
 		if (fc->num_background == fc->max_background) {
 			fc->blocked = 0;
 			wake_up_all(&fc->blocked_waitq);
@@ -314,8 +402,8 @@ __releases(fc->lock)
 		fc->num_background--;
 		fc->active_background--;
 		flush_bg_queue(fc);
+		spin_unlock(&fc->lock);
 	}
-	spin_unlock(&fc->lock);
 	wake_up(&req->waitq);
 	if (end)
 		end(fc, req);
@@ -324,27 +412,27 @@ __releases(fc->lock)
 
 static void wait_answer_interruptible(struct fuse_conn *fc,
 				      struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->iq->lock)
+__acquires(req->iq->lock)
 {
 	if (signal_pending(current))
 		return;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->iq->lock);
 	wait_event_interruptible(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	spin_lock(&req->iq->lock);
 }
 
+/* Called with req->iq->lock */
 static void queue_interrupt(struct fuse_conn *fc, struct fuse_req *req)
 {
-	list_add_tail(&req->intr_entry, &fc->interrupts);
-	wake_up(&fc->waitq);
-	kill_fasync(&fc->fasync, SIGIO, POLL_IN);
+	list_add_tail(&req->intr_entry, &req->iq->interrupts);
+	fuse_iq_wake(fc, req->iq);
 }
 
 static void request_wait_answer(struct fuse_conn *fc, struct fuse_req *req)
-__releases(fc->lock)
-__acquires(fc->lock)
+__releases(req->iq->lock)
+__acquires(req->iq->lock)
 {
 	if (!fc->no_interrupt) {
 		/* Any signal may interrupt this */
@@ -386,9 +474,9 @@ __acquires(fc->lock)
 	 * Either request is already in userspace, or it was forced.
 	 * Wait it out.
 	 */
-	spin_unlock(&fc->lock);
+	spin_unlock(&req->iq->lock);
 	wait_event(req->waitq, req->state == FUSE_REQ_FINISHED);
-	spin_lock(&fc->lock);
+	spin_lock(&req->iq->lock);
 
 	if (!req->aborted)
 		return;
@@ -401,22 +489,25 @@ __acquires(fc->lock)
 		   locked state, there mustn't be any filesystem
 		   operation (e.g. page fault), since that could lead
 		   to deadlock */
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->iq->lock);
 		wait_event(req->waitq, !req->locked);
-		spin_lock(&fc->lock);
+		spin_lock(&req->iq->lock);
 	}
 }
 
 void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 {
+	struct fuse_iqueue *iq = fuse_iq_current(fc);
+
 	req->isreply = 1;
-	spin_lock(&fc->lock);
+	req->iq = iq;
+	spin_lock(&iq->lock);
 	if (!fc->connected)
 		req->out.h.error = -ENOTCONN;
 	else if (fc->conn_error)
 		req->out.h.error = -ECONNREFUSED;
 	else {
-		req->in.h.unique = fuse_get_unique(fc);
+		req->in.h.unique = fuse_get_unique(iq);
 		queue_request(fc, req);
 		/* acquire extra reference, since request is still needed
 		   after request_end() */
@@ -424,13 +515,14 @@ void fuse_request_send(struct fuse_conn *fc, struct fuse_req *req)
 
 		request_wait_answer(fc, req);
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 }
 EXPORT_SYMBOL_GPL(fuse_request_send);
 
 static void fuse_request_send_nowait_locked(struct fuse_conn *fc,
 					    struct fuse_req *req)
 {
+	req->iq = fuse_iq_current(fc);
 	req->background = 1;
 	fc->num_background++;
 	if (fc->num_background == fc->max_background)
@@ -451,7 +543,10 @@ static void fuse_request_send_nowait(struct fuse_conn *fc, struct fuse_req *req)
 		fuse_request_send_nowait_locked(fc, req);
 		spin_unlock(&fc->lock);
 	} else {
+		spin_unlock(&fc->lock);
 		req->out.h.error = -ENOTCONN;
+		req->iq = fuse_iq_current(fc);
+		spin_lock(&req->iq->lock);
 		request_end(fc, req);
 	}
 }
@@ -466,16 +561,18 @@ EXPORT_SYMBOL_GPL(fuse_request_send_background);
 static int fuse_request_send_notify_reply(struct fuse_conn *fc,
 					  struct fuse_req *req, u64 unique)
 {
+	struct fuse_iqueue *iq = fuse_iq_current(fc);
 	int err = -ENODEV;
 
 	req->isreply = 0;
 	req->in.h.unique = unique;
-	spin_lock(&fc->lock);
+	req->iq = iq;
+	spin_lock(&iq->lock);
 	if (fc->connected) {
 		queue_request(fc, req);
 		err = 0;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 
 	return err;
 }
@@ -501,12 +598,12 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	int err = 0;
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->iq->lock);
 		if (req->aborted)
 			err = -ENOENT;
 		else
 			req->locked = 1;
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->iq->lock);
 	}
 	return err;
 }
@@ -519,11 +616,11 @@ static int lock_request(struct fuse_conn *fc, struct fuse_req *req)
 static void unlock_request(struct fuse_conn *fc, struct fuse_req *req)
 {
 	if (req) {
-		spin_lock(&fc->lock);
+		spin_lock(&req->iq->lock);
 		req->locked = 0;
 		if (req->aborted)
 			wake_up(&req->waitq);
-		spin_unlock(&fc->lock);
+		spin_unlock(&req->iq->lock);
 	}
 }
 
@@ -753,12 +850,12 @@ static int fuse_try_move_page(struct fuse_copy_state *cs, struct page **pagep)
 		lru_cache_add_file(newpage);
 
 	err = 0;
-	spin_lock(&cs->fc->lock);
+	spin_lock(&cs->req->iq->lock);
 	if (cs->req->aborted)
 		err = -ENOENT;
 	else
 		*pagep = newpage;
-	spin_unlock(&cs->fc->lock);
+	spin_unlock(&cs->req->iq->lock);
 
 	if (err) {
 		unlock_page(newpage);
@@ -906,36 +1003,99 @@ static int fuse_copy_args(struct fuse_copy_state *cs, unsigned numargs,
 	return err;
 }
 
-static int forget_pending(struct fuse_conn *fc)
-{
-	return fc->forget_list_head.next != NULL;
+/*
+ * Find an input queue with something to read for an unbound channel
+ * and return it locked.  The scan starts after the queue read last, so
+ * that a busy CPU can't starve the others.
+ */
+static struct fuse_iqueue *fuse_next_iq(struct fuse_conn *fc)
+__acquires(iq->lock)
+{
+	int last = ACCESS_ONCE(fc->iq_next);
+	int cpu = last;
+	bool wrapped = false;
+
+	for (;;) {
+		struct fuse_iqueue *iq;
+
+		cpu = cpumask_next(cpu, fc->iq_pending);
+		if (cpu >= nr_cpu_ids) {
+			if (wrapped)
+				return NULL;
+			wrapped = true;
+			cpu = -1;
+			continue;
+		}
+		if (wrapped && cpu > last)
+			return NULL;
+
+		iq = fuse_iq(fc, cpu);
+		spin_lock(&iq->lock);
+		if (!iq->bound && request_pending(iq)) {
+			fc->iq_next = cpu;
+			return iq;
+		}
+		/* bits are set under iq->lock, so this can't lose a wakeup */
+		cpumask_clear_cpu(cpu, fc->iq_pending);
+		spin_unlock(&iq->lock);
+	}
 }
 
-static int request_pending(struct fuse_conn *fc)
-{
-	return !list_empty(&fc->pending) || !list_empty(&fc->interrupts) ||
-		forget_pending(fc);
-}
+/*
+ * Wait until a request is available for the channel and return the
+ * input queue holding it, locked.  A bound channel only reads the queue
+ * of its CPU, unbound ones read any queue without a bound channel.
+ */
+static struct fuse_iqueue *fuse_dev_wait(struct fuse_dev *fud, bool nonblock,
+					 int *errp)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *iq;
+	wait_queue_head_t *wq;
+	DEFINE_WAIT(wait);
+	int cpu;
+
+ again:
+	cpu = ACCESS_ONCE(fud->cpu);
+	wq = cpu >= 0 ? &fuse_iq(fc, cpu)->waitq : &fc->waitq;
+	for (;;) {
+		prepare_to_wait_exclusive(wq, &wait, TASK_INTERRUPTIBLE);
+		if (ACCESS_ONCE(fud->cpu) != cpu) {
+			finish_wait(wq, &wait);
+			goto again;
+		}
+		*errp = -ENODEV;
+		if (!fc->connected)
+			break;
 
-/* Wait until a request is available on the pending list */
-static void request_wait(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
-{
-	DECLARE_WAITQUEUE(wait, current);
+		if (cpu >= 0) {
+			iq = fuse_iq(fc, cpu);
+			spin_lock(&iq->lock);
+			if (request_pending(iq)) {
+				finish_wait(wq, &wait);
+				return iq;
+			}
+			spin_unlock(&iq->lock);
+		} else {
+			iq = fuse_next_iq(fc);
+			if (iq) {
+				finish_wait(wq, &wait);
+				return iq;
+			}
+		}
 
-	add_wait_queue_exclusive(&fc->waitq, &wait);
-	while (fc->connected && !request_pending(fc)) {
-		set_current_state(TASK_INTERRUPTIBLE);
+		*errp = -EAGAIN;
+		if (nonblock)
+			break;
+		*errp = -ERESTARTSYS;
 		if (signal_pending(current))
 			break;
 
-		spin_unlock(&fc->lock);
 		schedule();
-		spin_lock(&fc->lock);
 	}
-	set_current_state(TASK_RUNNING);
-	remove_wait_queue(&fc->waitq, &wait);
+	finish_wait(wq, &wait);
+
+	return NULL;
 }
 
 /*
@@ -944,11 +1104,12 @@ __acquires(fc->lock)
  * Unlike other requests this is assembled on demand, without a need
  * to allocate a separate fuse_req structure.
  *
- * Called with fc->lock held, releases it
+ * Called with iq->lock held, releases it
  */
-static int fuse_read_interrupt(struct fuse_conn *fc, struct fuse_copy_state *cs,
+static int fuse_read_interrupt(struct fuse_iqueue *iq,
+			       struct fuse_copy_state *cs,
 			       size_t nbytes, struct fuse_req *req)
-__releases(fc->lock)
+__releases(iq->lock)
 {
 	struct fuse_in_header ih;
 	struct fuse_interrupt_in arg;
@@ -956,7 +1117,7 @@ __releases(fc->lock)
 	int err;
 
 	list_del_init(&req->intr_entry);
-	req->intr_unique = fuse_get_unique(fc);
+	req->intr_unique = fuse_get_unique(iq);
 	memset(&ih, 0, sizeof(ih));
 	memset(&arg, 0, sizeof(arg));
 	ih.len = reqsize;
@@ -964,7 +1125,7 @@ __releases(fc->lock)
 	ih.unique = req->intr_unique;
 	arg.unique = req->in.h.unique;
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 	if (nbytes < reqsize)
 		return -EINVAL;
 
@@ -976,21 +1137,21 @@ __releases(fc->lock)
 	return err ? err : reqsize;
 }
 
-static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
+static struct fuse_forget_link *dequeue_forget(struct fuse_iqueue *iq,
 					       unsigned max,
 					       unsigned *countp)
 {
-	struct fuse_forget_link *head = fc->forget_list_head.next;
+	struct fuse_forget_link *head = iq->forget_list_head.next;
 	struct fuse_forget_link **newhead = &head;
 	unsigned count;
 
 	for (count = 0; *newhead != NULL && count < max; count++)
 		newhead = &(*newhead)->next;
 
-	fc->forget_list_head.next = *newhead;
+	iq->forget_list_head.next = *newhead;
 	*newhead = NULL;
-	if (fc->forget_list_head.next == NULL)
-		fc->forget_list_tail = &fc->forget_list_head;
+	if (iq->forget_list_head.next == NULL)
+		iq->forget_list_tail = &iq->forget_list_head;
 
 	if (countp != NULL)
 		*countp = count;
@@ -998,24 +1159,24 @@ static struct fuse_forget_link *dequeue_forget(struct fuse_conn *fc,
 	return head;
 }
 
-static int fuse_read_single_forget(struct fuse_conn *fc,
+static int fuse_read_single_forget(struct fuse_iqueue *iq,
 				   struct fuse_copy_state *cs,
 				   size_t nbytes)
-__releases(fc->lock)
+__releases(iq->lock)
 {
 	int err;
-	struct fuse_forget_link *forget = dequeue_forget(fc, 1, NULL);
+	struct fuse_forget_link *forget = dequeue_forget(iq, 1, NULL);
 	struct fuse_forget_in arg = {
 		.nlookup = forget->forget_one.nlookup,
 	};
 	struct fuse_in_header ih = {
 		.opcode = FUSE_FORGET,
 		.nodeid = forget->forget_one.nodeid,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(iq),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 	kfree(forget);
 	if (nbytes < ih.len)
 		return -EINVAL;
@@ -1031,9 +1192,9 @@ __releases(fc->lock)
 	return ih.len;
 }
 
-static int fuse_read_batch_forget(struct fuse_conn *fc,
+static int fuse_read_batch_forget(struct fuse_iqueue *iq,
 				   struct fuse_copy_state *cs, size_t nbytes)
-__releases(fc->lock)
+__releases(iq->lock)
 {
 	int err;
 	unsigned max_forgets;
@@ -1042,18 +1203,18 @@ __releases(fc->lock)
 	struct fuse_batch_forget_in arg = { .count = 0 };
 	struct fuse_in_header ih = {
 		.opcode = FUSE_BATCH_FORGET,
-		.unique = fuse_get_unique(fc),
+		.unique = fuse_get_unique(iq),
 		.len = sizeof(ih) + sizeof(arg),
 	};
 
 	if (nbytes < ih.len) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&iq->lock);
 		return -EINVAL;
 	}
 
 	max_forgets = (nbytes - ih.len) / sizeof(struct fuse_forget_one);
-	head = dequeue_forget(fc, max_forgets, &count);
-	spin_unlock(&fc->lock);
+	head = dequeue_forget(iq, max_forgets, &count);
+	spin_unlock(&iq->lock);
 
 	arg.count = count;
 	ih.len += count * sizeof(struct fuse_forget_one);
@@ -1080,14 +1241,14 @@ __releases(fc->lock)
 	return ih.len;
 }
 
-static int fuse_read_forget(struct fuse_conn *fc, struct fuse_copy_state *cs,
-			    size_t nbytes)
-__releases(fc->lock)
+static int fuse_read_forget(struct fuse_conn *fc, struct fuse_iqueue *iq,
+			    struct fuse_copy_state *cs, size_t nbytes)
+__releases(iq->lock)
 {
-	if (fc->minor < 16 || fc->forget_list_head.next->next == NULL)
-		return fuse_read_single_forget(fc, cs, nbytes);
+	if (fc->minor < 16 || iq->forget_list_head.next->next == NULL)
+		return fuse_read_single_forget(iq, cs, nbytes);
 	else
-		return fuse_read_batch_forget(fc, cs, nbytes);
+		return fuse_read_batch_forget(iq, cs, nbytes);
 }
 
 /*
@@ -1099,46 +1260,42 @@ __releases(fc->lock)
  * request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *iq;
 	struct fuse_req *req;
 	struct fuse_in *in;
 	unsigned reqsize;
 
  restart:
-	spin_lock(&fc->lock);
-	err = -EAGAIN;
-	if ((file->f_flags & O_NONBLOCK) && fc->connected &&
-	    !request_pending(fc))
-		goto err_unlock;
+	iq = fuse_dev_wait(fud, file->f_flags & O_NONBLOCK, &err);
+	if (!iq)
+		return err;
 
-	request_wait(fc);
 	err = -ENODEV;
 	if (!fc->connected)
 		goto err_unlock;
-	err = -ERESTARTSYS;
-	if (!request_pending(fc))
-		goto err_unlock;
 
-	if (!list_empty(&fc->interrupts)) {
-		req = list_entry(fc->interrupts.next, struct fuse_req,
+	if (!list_empty(&iq->interrupts)) {
+		req = list_entry(iq->interrupts.next, struct fuse_req,
 				 intr_entry);
-		return fuse_read_interrupt(fc, cs, nbytes, req);
+		return fuse_read_interrupt(iq, cs, nbytes, req);
 	}
 
-	if (forget_pending(fc)) {
-		if (list_empty(&fc->pending) || fc->forget_batch-- > 0)
-			return fuse_read_forget(fc, cs, nbytes);
+	if (forget_pending(iq)) {
+		if (list_empty(&iq->pending) || iq->forget_batch-- > 0)
+			return fuse_read_forget(fc, iq, cs, nbytes);
 
-		if (fc->forget_batch <= -8)
-			fc->forget_batch = 16;
+		if (iq->forget_batch <= -8)
+			iq->forget_batch = 16;
 	}
 
-	req = list_entry(fc->pending.next, struct fuse_req, list);
+	req = list_entry(iq->pending.next, struct fuse_req, list);
 	req->state = FUSE_REQ_READING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &iq->io);
 
 	in = &req->in;
 	reqsize = in->h.len;
@@ -1151,14 +1308,14 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 		goto restart;
 	}
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 	cs->req = req;
 	err = fuse_copy_one(cs, &in->h, sizeof(in->h));
 	if (!err)
 		err = fuse_copy_args(cs, in->numargs, in->argpages,
 				     (struct fuse_arg *) in->args, 0);
 	fuse_copy_finish(cs);
-	spin_lock(&fc->lock);
+	spin_lock(&iq->lock);
 	req->locked = 0;
 	if (req->aborted) {
 		request_end(fc, req);
@@ -1173,15 +1330,16 @@ static ssize_t fuse_dev_do_read(struct fuse_conn *fc, struct file *file,
 		request_end(fc, req);
 	else {
 		req->state = FUSE_REQ_SENT;
-		list_move_tail(&req->list, &fc->processing);
+		req->fud = fud;
+		list_move_tail(&req->list, &iq->processing);
 		if (req->interrupted)
 			queue_interrupt(fc, req);
-		spin_unlock(&fc->lock);
+		spin_unlock(&iq->lock);
 	}
 	return reqsize;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 	return err;
 }
 
@@ -1190,13 +1348,13 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, const struct iovec *iov,
 {
 	struct fuse_copy_state cs;
 	struct file *file = iocb->ki_filp;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (!fud)
 		return -EPERM;
 
-	fuse_copy_init(&cs, fc, 1, iov, nr_segs);
+	fuse_copy_init(&cs, fud->fc, 1, iov, nr_segs);
 
-	return fuse_dev_do_read(fc, file, &cs, iov_length(iov, nr_segs));
+	return fuse_dev_do_read(fud, file, &cs, iov_length(iov, nr_segs));
 }
 
 static int fuse_dev_pipe_buf_steal(struct pipe_inode_info *pipe,
@@ -1224,18 +1382,18 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	int do_wakeup = 0;
 	struct pipe_buffer *bufs;
 	struct fuse_copy_state cs;
-	struct fuse_conn *fc = fuse_get_conn(in);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(in);
+	if (!fud)
 		return -EPERM;
 
 	bufs = kmalloc(pipe->buffers * sizeof(struct pipe_buffer), GFP_KERNEL);
 	if (!bufs)
 		return -ENOMEM;
 
-	fuse_copy_init(&cs, fc, 1, NULL, 0);
+	fuse_copy_init(&cs, fud->fc, 1, NULL, 0);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fc, in, &cs, len);
+	ret = fuse_dev_do_read(fud, in, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -1660,11 +1818,11 @@ static int fuse_notify(struct fuse_conn *fc, enum fuse_notify_code code,
 }
 
 /* Look up request on processing list by unique ID */
-static struct fuse_req *request_find(struct fuse_conn *fc, u64 unique)
+static struct fuse_req *request_find(struct fuse_iqueue *iq, u64 unique)
 {
 	struct list_head *entry;
 
-	list_for_each(entry, &fc->processing) {
+	list_for_each(entry, &iq->processing) {
 		struct fuse_req *req;
 		req = list_entry(entry, struct fuse_req, list);
 		if (req->in.h.unique == unique || req->intr_unique == unique)
@@ -1699,14 +1857,16 @@ static int copy_out_args(struct fuse_copy_state *cs, struct fuse_out *out,
 /*
  * Write a single reply to a request.  First the header is copied from
  * the write buffer.  The request is then searched on the processing
- * list by the unique ID found in the header.  If found, then remove
- * it from the list and copy the rest of the buffer to the request.
- * The request is finished by calling request_end()
+ * list of the input queue encoded in the unique ID found in the header,
+ * so the reply may be written to any channel of the connection.  If
+ * found, then remove it from the list and copy the rest of the buffer
+ * to the request.  The request is finished by calling request_end()
  */
 static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 				 struct fuse_copy_state *cs, size_t nbytes)
 {
 	int err;
+	struct fuse_iqueue *iq;
 	struct fuse_req *req;
 	struct fuse_out_header oh;
 
@@ -1734,19 +1894,23 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	if (oh.error <= -1000 || oh.error > 0)
 		goto err_finish;
 
-	spin_lock(&fc->lock);
 	err = -ENOENT;
+	iq = fuse_unique_iq(fc, oh.unique);
+	if (!iq)
+		goto err_finish;
+
+	spin_lock(&iq->lock);
 	if (!fc->connected)
 		goto err_unlock;
 
-	req = request_find(fc, oh.unique);
+	req = request_find(iq, oh.unique);
 	if (!req)
 		goto err_unlock;
 
 	if (req->aborted) {
-		spin_unlock(&fc->lock);
+		spin_unlock(&iq->lock);
 		fuse_copy_finish(cs);
-		spin_lock(&fc->lock);
+		spin_lock(&iq->lock);
 		request_end(fc, req);
 		return -ENOENT;
 	}
@@ -1761,24 +1925,24 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 		else if (oh.error == -EAGAIN)
 			queue_interrupt(fc, req);
 
-		spin_unlock(&fc->lock);
+		spin_unlock(&iq->lock);
 		fuse_copy_finish(cs);
 		return nbytes;
 	}
 
 	req->state = FUSE_REQ_WRITING;
-	list_move(&req->list, &fc->io);
+	list_move(&req->list, &iq->io);
 	req->out.h = oh;
 	req->locked = 1;
 	cs->req = req;
 	if (!req->out.page_replace)
 		cs->move_pages = 0;
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
 
 	err = copy_out_args(cs, &req->out, nbytes);
 	fuse_copy_finish(cs);
 
-	spin_lock(&fc->lock);
+	spin_lock(&iq->lock);
 	req->locked = 0;
 	if (!err) {
 		if (req->aborted)
@@ -1790,7 +1954,7 @@ static ssize_t fuse_dev_do_write(struct fuse_conn *fc,
 	return err ? err : nbytes;
 
  err_unlock:
-	spin_unlock(&fc->lock);
+	spin_unlock(&iq->lock);
  err_finish:
 	fuse_copy_finish(cs);
 	return err;
@@ -1890,18 +2054,35 @@ out:
 static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 {
 	unsigned mask = POLLOUT | POLLWRNORM;
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (!fc)
+	struct fuse_dev *fud = fuse_get_dev(file);
+	struct fuse_conn *fc;
+	struct fuse_iqueue *iq;
+	bool pending;
+	int cpu;
+
+	if (!fud)
 		return POLLERR;
 
-	poll_wait(file, &fc->waitq, wait);
+	fc = fud->fc;
+	cpu = ACCESS_ONCE(fud->cpu);
+	if (cpu >= 0) {
+		iq = fuse_iq(fc, cpu);
+		poll_wait(file, &iq->waitq, wait);
+		spin_lock(&iq->lock);
+		pending = request_pending(iq);
+		spin_unlock(&iq->lock);
+	} else {
+		poll_wait(file, &fc->waitq, wait);
+		iq = fuse_next_iq(fc);
+		pending = iq != NULL;
+		if (iq)
+			spin_unlock(&iq->lock);
+	}
 
-	spin_lock(&fc->lock);
 	if (!fc->connected)
 		mask = POLLERR;
-	else if (request_pending(fc))
+	else if (pending)
 		mask |= POLLIN | POLLRDNORM;
-	spin_unlock(&fc->lock);
 
 	return mask;
 }
@@ -1909,18 +2090,19 @@ static unsigned fuse_dev_poll(struct file *file, poll_table *wait)
 /*
  * Abort all requests on the given list (pending or processing)
  *
- * This function releases and reacquires fc->lock
+ * This function releases and reacquires iq->lock
  */
-static void end_requests(struct fuse_conn *fc, struct list_head *head)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_requests(struct fuse_conn *fc, struct fuse_iqueue *iq,
+			 struct list_head *head)
+__releases(iq->lock)
+__acquires(iq->lock)
 {
 	while (!list_empty(head)) {
 		struct fuse_req *req;
 		req = list_entry(head->next, struct fuse_req, list);
 		req->out.h.error = -ECONNABORTED;
 		request_end(fc, req);
-		spin_lock(&fc->lock);
+		spin_lock(&iq->lock);
 	}
 }
 
@@ -1935,13 +2117,13 @@ __acquires(fc->lock)
  * called after waiting for the request to be unlocked (if it was
  * locked).
  */
-static void end_io_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_io_requests(struct fuse_conn *fc, struct fuse_iqueue *iq)
+__releases(iq->lock)
+__acquires(iq->lock)
 {
-	while (!list_empty(&fc->io)) {
+	while (!list_empty(&iq->io)) {
 		struct fuse_req *req =
-			list_entry(fc->io.next, struct fuse_req, list);
+			list_entry(iq->io.next, struct fuse_req, list);
 		void (*end) (struct fuse_conn *, struct fuse_req *) = req->end;
 
 		req->aborted = 1;
@@ -1952,25 +2134,23 @@ __acquires(fc->lock)
 		if (end) {
 			req->end = NULL;
 			__fuse_get_request(req);
-			spin_unlock(&fc->lock);
+			spin_unlock(&iq->lock);
 			wait_event(req->waitq, !req->locked);
 			end(fc, req);
 			fuse_put_request(fc, req);
-			spin_lock(&fc->lock);
+			spin_lock(&iq->lock);
 		}
 	}
 }
 
-static void end_queued_requests(struct fuse_conn *fc)
-__releases(fc->lock)
-__acquires(fc->lock)
+static void end_queued_requests(struct fuse_conn *fc, struct fuse_iqueue *iq)
+__releases(iq->lock)
+__acquires(iq->lock)
 {
-	fc->max_background = UINT_MAX;
-	flush_bg_queue(fc);
-	end_requests(fc, &fc->pending);
-	end_requests(fc, &fc->processing);
-	while (forget_pending(fc))
-		kfree(dequeue_forget(fc, 1, NULL));
+	end_requests(fc, iq, &iq->pending);
+	end_requests(fc, iq, &iq->processing);
+	while (forget_pending(iq))
+		kfree(dequeue_forget(iq, 1, NULL));
 }
 
 static void end_polls(struct fuse_conn *fc)
@@ -1988,6 +2168,38 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/*
+ * Disconnect: fail the background requests not yet queued, then the
+ * requests on every input queue, with those under I/O first when
+ * aborting.
+ *
+ * Called with fc->lock, unlocks it
+ */
+static void fuse_disconnect(struct fuse_conn *fc, bool abort)
+__releases(fc->lock)
+{
+	int cpu;
+
+	fc->connected = 0;
+	fc->blocked = 0;
+	fc->max_background = UINT_MAX;
+	flush_bg_queue(fc);
+	end_polls(fc);
+	spin_unlock(&fc->lock);
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_iqueue *iq = fuse_iq(fc, cpu);
+
+		spin_lock(&iq->lock);
+		if (abort)
+			end_io_requests(fc, iq);
+		end_queued_requests(fc, iq);
+		spin_unlock(&iq->lock);
+	}
+	wake_up_all(&fc->blocked_waitq);
+	fuse_wake_up_readers(fc);
+}
+
 /*
  * Abort all requests.
  *
@@ -2002,6 +2214,8 @@ static void end_polls(struct fuse_conn *fc)
  * During the aborting, progression of requests from the pending and
  * processing lists onto the io list, and progression of new requests
  * onto the pending list is prevented by req->connected being false.
+ * fc->connected is cleared before any input queue is locked, so every
+ * queue sees it by the time it is emptied.
  *
  * Progression of requests under I/O to the processing list is
  * prevented by the req->aborted flag being true for these requests.
@@ -2010,31 +2224,133 @@ static void end_polls(struct fuse_conn *fc)
 void fuse_abort_conn(struct fuse_conn *fc)
 {
 	spin_lock(&fc->lock);
-	if (fc->connected) {
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_io_requests(fc);
-		end_queued_requests(fc);
-		end_polls(fc);
+	if (fc->connected)
+		fuse_disconnect(fc, true);
+	else
+		spin_unlock(&fc->lock);
+}
+EXPORT_SYMBOL_GPL(fuse_abort_conn);
+
+/*
+ * Bind the channel to the input queue of @cpu, or unbind it if @cpu is
+ * -1.  A queue can only have one channel bound to it.
+ */
+static int fuse_dev_bind(struct fuse_dev *fud, int cpu)
+{
+	struct fuse_conn *fc = fud->fc;
+	struct fuse_iqueue *iq;
+	int old, err = 0;
+
+	if (cpu != -1 && (cpu < 0 || cpu >= nr_cpu_ids || !cpu_possible(cpu)))
+		return -EINVAL;
+
+	spin_lock(&fc->lock);
+	old = fud->cpu;
+	if (cpu == old)
+		goto out;
+
+	if (cpu >= 0) {
+		iq = fuse_iq(fc, cpu);
+		spin_lock(&iq->lock);
+		if (iq->bound)
+			err = -EBUSY;
+		else
+			iq->bound = 1;
+		spin_unlock(&iq->lock);
+		if (err)
+			goto out;
+	}
+
+	/* readers of the channel waiting elsewhere notice this when woken */
+	ACCESS_ONCE(fud->cpu) = cpu;
+	if (old >= 0) {
+		iq = fuse_iq(fc, old);
+		spin_lock(&iq->lock);
+		iq->bound = 0;
+		if (request_pending(iq))
+			fuse_iq_wake(fc, iq);
+		spin_unlock(&iq->lock);
+		wake_up_all(&iq->waitq);
+	} else {
 		wake_up_all(&fc->waitq);
-		wake_up_all(&fc->blocked_waitq);
-		kill_fasync(&fc->fasync, SIGIO, POLL_IN);
 	}
+ out:
+	spin_unlock(&fc->lock);
+
+	return err;
+}
+
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc)
+{
+	struct fuse_dev *fud;
+
+	fud = kzalloc(sizeof(struct fuse_dev), GFP_KERNEL);
+	if (fud) {
+		fud->fc = fuse_conn_get(fc);
+		fud->cpu = -1;
+		spin_lock(&fc->lock);
+		fc->dev_count++;
+		spin_unlock(&fc->lock);
+	}
+
+	return fud;
+}
+EXPORT_SYMBOL_GPL(fuse_dev_alloc);
+
+void fuse_dev_free(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+
+	spin_lock(&fc->lock);
+	fc->dev_count--;
 	spin_unlock(&fc->lock);
+	kfree(fud);
+	fuse_conn_put(fc);
 }
-EXPORT_SYMBOL_GPL(fuse_abort_conn);
+EXPORT_SYMBOL_GPL(fuse_dev_free);
 
+/*
+ * Abort the requests read through the channel that are still waiting
+ * for a reply, nobody is going to answer them.
+ */
+static void end_dev_requests(struct fuse_dev *fud)
+{
+	struct fuse_conn *fc = fud->fc;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct fuse_iqueue *iq = fuse_iq(fc, cpu);
+		struct fuse_req *req, *next;
+		LIST_HEAD(head);
+
+		spin_lock(&iq->lock);
+		list_for_each_entry_safe(req, next, &iq->processing, list) {
+			if (req->fud == fud)
+				list_move_tail(&req->list, &head);
+		}
+		end_requests(fc, iq, &head);
+		spin_unlock(&iq->lock);
+	}
+}
+
+/*
+ * Closing a channel unbinds it and aborts the requests read through it.
+ * Closing the last one disconnects.
+ */
 int fuse_dev_release(struct inode *inode, struct file *file)
 {
-	struct fuse_conn *fc = fuse_get_conn(file);
-	if (fc) {
+	struct fuse_dev *fud = fuse_get_dev(file);
+	if (fud) {
+		struct fuse_conn *fc = fud->fc;
+
+		fuse_dev_bind(fud, -1);
+		end_dev_requests(fud);
 		spin_lock(&fc->lock);
-		fc->connected = 0;
-		fc->blocked = 0;
-		end_queued_requests(fc);
-		end_polls(fc);
-		wake_up_all(&fc->blocked_waitq);
-		spin_unlock(&fc->lock);
+		if (--fc->dev_count == 0)
+			fuse_disconnect(fc, false);
+		else
+			spin_unlock(&fc->lock);
+		kfree(fud);
 		fuse_conn_put(fc);
 	}
 
@@ -2042,6 +2358,69 @@ int fuse_dev_release(struct inode *inode, struct file *file)
 }
 EXPORT_SYMBOL_GPL(fuse_dev_release);
 
+static int fuse_dev_clone(struct file *file, unsigned int oldfd)
+{
+	struct file *old;
+	struct fuse_dev *fud;
+	int err = -EINVAL;
+
+	old = fget(oldfd);
+	if (!old)
+		return -EBADF;
+
+	/*
+	 * Check against file->private_data and install the channel under
+	 * fuse_mutex, like mounting does.
+	 */
+	mutex_lock(&fuse_mutex);
+	if (old->f_op != &fuse_dev_operations ||
+	    file->f_op != &fuse_dev_operations ||
+	    !fuse_get_dev(old) || fuse_get_dev(file))
+		goto out_unlock;
+
+	err = -ENOMEM;
+	fud = fuse_dev_alloc(fuse_get_dev(old)->fc);
+	if (!fud)
+		goto out_unlock;
+
+	/* make the channel visible to lockless readers fully set up */
+	smp_wmb();
+	file->private_data = fud;
+	err = 0;
+ out_unlock:
+	mutex_unlock(&fuse_mutex);
+	fput(old);
+
+	return err;
+}
+
+static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct fuse_dev *fud;
+	__u32 val;
+
+	switch (cmd) {
+	case FUSE_DEV_IOC_CLONE:
+		if (get_user(val, (__u32 __user *) arg))
+			return -EFAULT;
+
+		return fuse_dev_clone(file, val);
+
+	case FUSE_DEV_IOC_BIND_CPU:
+		fud = fuse_get_dev(file);
+		if (!fud)
+			return -EPERM;
+		if (get_user(val, (__u32 __user *) arg))
+			return -EFAULT;
+
+		return fuse_dev_bind(fud, (int) val);
+
+	default:
+		return -ENOTTY;
+	}
+}
+
 static int fuse_dev_fasync(int fd, struct file *file, int on)
 {
 	struct fuse_conn *fc = fuse_get_conn(file);
@@ -2064,6 +2443,8 @@ const struct file_operations fuse_dev_operations = {
 	.poll		= fuse_dev_poll,
 	.release	= fuse_dev_release,
 	.fasync		= fuse_dev_fasync,
+	.unlocked_ioctl	= fuse_dev_ioctl,
+	.compat_ioctl	= fuse_dev_ioctl,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
@@ -2076,6 +2457,8 @@ static struct miscdevice fuse_miscdevice = {
 int __init fuse_dev_init(void)
 {
 	int err = -ENOMEM;
+
+	BUILD_BUG_ON(NR_CPUS > (1 << FUSE_UNIQUE_CPU_BITS));
 	fuse_req_cachep = kmem_cache_create("fuse_request",
 					    sizeof(struct fuse_req),
 					    0, 0, NULL);
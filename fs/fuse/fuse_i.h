@@ -22,6 +22,8 @@
 #include <linux/rbtree.h>
 #include <linux/poll.h>
 #include <linux/workqueue.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
 
 /** Max number of pages that can be used in a single read request */
 #define FUSE_MAX_PAGES_PER_REQ 32
@@ -32,6 +34,9 @@
 /** It could be as large as PATH_MAX, but would that have any uses? */
 #define FUSE_NAME_MAX 1024
 
+/** Low bits of a request's unique ID holding the CPU of its input queue */
+#define FUSE_UNIQUE_CPU_BITS 16
+
 /** Number of dentries for each connection in the control filesystem */
 #define FUSE_CTL_NUM_DENTRIES 5
 
@@ -215,7 +220,7 @@ enum fuse_req_state {
  */
 struct fuse_req {
 	/** This can be on either pending processing or io lists in
-	    fuse_conn */
+	    fuse_iqueue */
 	struct list_head list;
 
 	/** Entry on the interrupts list  */
@@ -230,7 +235,7 @@ struct fuse_req {
 	/*
 	 * The following bitfields are either set once before the
 	 * request is queued or setting/clearing them is protected by
-	 * fuse_conn->lock
+	 * iq->lock
 	 */
 
 	/** True if the request has reply */
@@ -313,6 +318,71 @@ struct fuse_req {
 
 	/** Request is stolen from fuse_file->reserved_req */
 	struct file *stolen_file;
+
+	/** Input queue the request is sent on */
+	struct fuse_iqueue *iq;
+
+	/** Channel the request was read through, while it is processing */
+	struct fuse_dev *fud;
+};
+
+/**
+ * Input queue of a fuse connection
+ *
+ * There is one for every CPU.  A request is queued on the queue of the
+ * CPU sending it and stays with that queue until it is finished, its
+ * state being protected by the queue's lock.  The queue is read by the
+ * device channel bound to its CPU if there is one, otherwise by any of
+ * the unbound channels of the connection.
+ */
+struct fuse_iqueue {
+	/** Lock protecting the lists and the requests on them */
+	spinlock_t lock;
+
+	/** Readers of the bound channel are waiting on this */
+	wait_queue_head_t waitq;
+
+	/** CPU of this queue, kept in the low bits of unique IDs */
+	unsigned int cpu;
+
+	/** Is a channel bound to this queue? */
+	unsigned bound:1;
+
+	/** The next unique request id */
+	u64 reqctr;
+
+	/** The list of pending requests */
+	struct list_head pending;
+
+	/** The list of requests being processed */
+	struct list_head processing;
+
+	/** The list of requests under I/O */
+	struct list_head io;
+
+	/** Pending interrupts */
+	struct list_head interrupts;
+
+	/** Queue of pending forgets */
+	struct fuse_forget_link forget_list_head;
+	struct fuse_forget_link *forget_list_tail;
+
+	/** Batching of FORGET requests (positive indicates FORGET batch) */
+	int forget_batch;
+} ____cacheline_aligned_in_smp;
+
+/**
+ * A device channel
+ *
+ * Every /dev/fuse file attached to a connection has one: the file
+ * passed to mount and those cloned from it with FUSE_DEV_IOC_CLONE.
+ */
+struct fuse_dev {
+	/** The connection, the channel holds a reference to it */
+	struct fuse_conn *fc;
+
+	/** CPU whose input queue the channel is bound to, or -1 */
+	int cpu;
 };
 
 /**
@@ -347,17 +417,20 @@ struct fuse_conn {
 	/** Maximum write size */
 	unsigned max_write;
 
-	/** Readers of the connection are waiting on this */
+	/** Readers of the unbound channels are waiting on this */
 	wait_queue_head_t waitq;
 
-	/** The list of pending requests */
-	struct list_head pending;
+	/** Per-CPU input queues */
+	struct fuse_iqueue __percpu *iq;
 
-	/** The list of requests being processed */
-	struct list_head processing;
+	/** Unbound input queues which may have requests pending */
+	cpumask_var_t iq_pending;
 
-	/** The list of requests under I/O */
-	struct list_head io;
+	/** Input queue last read by an unbound channel */
+	unsigned int iq_next;
+
+	/** Number of device channels */
+	unsigned dev_count;
 
 	/** The next unique kernel file handle */
 	u64 khctr;
@@ -380,16 +453,6 @@ struct fuse_conn {
 	/** The list of background requests set aside for later queuing */
 	struct list_head bg_queue;
 
-	/** Pending interrupts */
-	struct list_head interrupts;
-
-	/** Queue of pending forgets */
-	struct fuse_forget_link forget_list_head;
-	struct fuse_forget_link *forget_list_tail;
-
-	/** Batching of FORGET requests (positive indicates FORGET batch) */
-	int forget_batch;
-
 	/** Flag indicating if connection is blocked.  This will be
 	    the case before the INIT reply is received, and if there
 	    are too many outstading backgrounds requests */
@@ -401,9 +464,6 @@ struct fuse_conn {
 	/** waitq for reserved requests */
 	wait_queue_head_t reserved_req_waitq;
 
-	/** The next unique request id */
-	u64 reqctr;
-
 	/** Connection established, cleared on umount, connection
 	    abort and device release */
 	unsigned connected;
@@ -487,6 +547,9 @@ struct fuse_conn {
 	/** Use enhanced/automatic page cache invalidation. */
 	unsigned auto_inval_data:1;
 
+	/** Buffer writes in the page cache.  Only set in INIT */
+	unsigned writeback_cache:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -716,7 +779,7 @@ void fuse_conn_kill(struct fuse_conn *fc);
 /**
  * Initialize fuse_conn
  */
-void fuse_conn_init(struct fuse_conn *fc);
+int fuse_conn_init(struct fuse_conn *fc);
 
 /**
  * Release reference to fuse_conn
@@ -785,6 +848,21 @@ long fuse_ioctl_common(struct file *file, unsigned int cmd,
 unsigned fuse_file_poll(struct file *file, poll_table *wait);
 int fuse_dev_release(struct inode *inode, struct file *file);
 
+/**
+ * Allocate a device channel for the connection
+ */
+struct fuse_dev *fuse_dev_alloc(struct fuse_conn *fc);
+
+/**
+ * Free a device channel which hasn't been installed in a file
+ */
+void fuse_dev_free(struct fuse_dev *fud);
+
+/**
+ * Wake up all readers of the connection
+ */
+void fuse_wake_up_readers(struct fuse_conn *fc);
+
 void fuse_write_update_size(struct inode *inode, loff_t pos);
 
 #endif /* _FS_FUSE_I_H */
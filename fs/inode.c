@@ -17,6 +17,7 @@
 #include <linux/prefetch.h>
 #include <linux/buffer_head.h> /* for inode_has_buffers */
 #include <linux/ratelimit.h>
+#include <linux/memcontrol.h>
 #include "internal.h"
 
 /*
@@ -150,6 +151,11 @@ int inode_init_always(struct super_block *sb, struct inode *inode)
 	inode->i_cdev = NULL;
 	inode->i_rdev = 0;
 	inode->dirtied_when = 0;
+#ifdef CONFIG_CGROUP_WRITEBACK
+	inode->i_wb = NULL;
+	inode->i_wb_frn_winner = 0;
+	inode->i_wb_frn_history = 0;
+#endif
 
 	if (security_inode_alloc(inode))
 		goto out;
@@ -158,6 +164,7 @@ int inode_init_always(struct super_block *sb, struct inode *inode)
 
 	mutex_init(&inode->i_mutex);
 	lockdep_set_class(&inode->i_mutex, &sb->s_type->i_mutex_key);
+	init_rwsem(&inode->i_dir_sem);
 
 	atomic_set(&inode->i_dio_count, 0);
 
@@ -231,6 +238,7 @@ EXPORT_SYMBOL(free_inode_nonrcu);
 void __destroy_inode(struct inode *inode)
 {
 	BUG_ON(inode_has_buffers(inode));
+	inode_detach_wb(inode);
 	security_inode_free(inode);
 	fsnotify_inode_delete(inode);
 	if (!inode->i_nlink) {
@@ -690,7 +698,8 @@ static int can_unuse(struct inode *inode)
  * Walk the superblock inode LRU for freeable inodes and attempt to free them.
  * This is called from the superblock shrinker function with a number of inodes
  * to trim from the LRU. Inodes to be freed are moved to a temporary list and
- * then are freed outside inode_lock by dispose_list().
+ * then are freed outside inode_lock by dispose_list(). When @memcg is set,
+ * only inodes charged to it are considered.
  *
  * Any inodes which are pinned purely because of attached pagecache have their
  * pagecache removed.  If the inode has metadata buffers attached to
@@ -704,9 +713,11 @@ static int can_unuse(struct inode *inode)
  * LRU does not have strict ordering. Hence we don't want to reclaim inodes
  * with this flag set because they are the inodes that are out of order.
  */
-void prune_icache_sb(struct super_block *sb, int nr_to_scan)
+void prune_icache_sb(struct super_block *sb, int nr_to_scan,
+		     struct mem_cgroup *memcg)
 {
 	LIST_HEAD(freeable);
+	LIST_HEAD(skipped);
 	int nr_scanned;
 	unsigned long reap = 0;
 
@@ -719,6 +730,12 @@ void prune_icache_sb(struct super_block *sb, int nr_to_scan)
 
 		inode = list_entry(sb->s_inode_lru.prev, struct inode, i_lru);
 
+		/* charged to another memcg, keep its place on the LRU */
+		if (!memcg_kmem_owns(memcg, inode)) {
+			list_move(&inode->i_lru, &skipped);
+			continue;
+		}
+
 		/*
 		 * we are inverting the sb->s_inode_lru_lock/inode->i_lock here,
 		 * so use a trylock. If we fail to get the lock, just move the
@@ -782,6 +799,8 @@ void prune_icache_sb(struct super_block *sb, int nr_to_scan)
 		__count_vm_events(KSWAPD_INODESTEAL, reap);
 	else
 		__count_vm_events(PGINODESTEAL, reap);
+	if (!list_empty(&skipped))
+		list_splice_tail(&skipped, &sb->s_inode_lru);
 	spin_unlock(&sb->s_inode_lru_lock);
 	if (current->reclaim_state)
 		current->reclaim_state->reclaimed_slab += reap;
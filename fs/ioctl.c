@@ -15,6 +15,7 @@
 #include <linux/writeback.h>
 #include <linux/buffer_head.h>
 #include <linux/falloc.h>
+#include <linux/slab.h>
 
 #include <asm/ioctls.h>
 
@@ -536,6 +537,59 @@ static int ioctl_fsthaw(struct file *filp)
 	return thaw_super(sb);
 }
 
+static long ioctl_file_clone(struct file *dst_file, unsigned long srcfd,
+			     u64 off, u64 olen, u64 destoff)
+{
+	struct file *src_file;
+	int ret;
+
+	src_file = fget(srcfd);
+	if (!src_file)
+		return -EBADF;
+	ret = vfs_clone_file_range(src_file, off, dst_file, destoff, olen);
+	fput(src_file);
+	return ret;
+}
+
+static long ioctl_file_clone_range(struct file *file, void __user *argp)
+{
+	struct file_clone_range args;
+
+	if (copy_from_user(&args, argp, sizeof(args)))
+		return -EFAULT;
+	return ioctl_file_clone(file, args.src_fd, args.src_offset,
+				args.src_length, args.dest_offset);
+}
+
+static long ioctl_file_dedupe_range(struct file *file, void __user *arg)
+{
+	struct file_dedupe_range __user *argp = arg;
+	struct file_dedupe_range *same = NULL;
+	int ret;
+	unsigned long size;
+	u16 count;
+
+	if (get_user(count, &argp->dest_count))
+		return -EFAULT;
+
+	size = offsetof(struct file_dedupe_range, info[count]);
+	if (size > PAGE_SIZE)
+		return -ENOMEM;
+
+	same = memdup_user(argp, size);
+	if (IS_ERR(same))
+		return PTR_ERR(same);
+
+	/* don't trust a dest_count that changed since we sized the copy */
+	same->dest_count = count;
+	ret = vfs_dedupe_file_range(file, same);
+	if (!ret && copy_to_user(argp, same, size))
+		ret = -EFAULT;
+
+	kfree(same);
+	return ret;
+}
+
 /*
  * When you add any new common ioctls to the switches above and below
  * please update compat_sys_ioctl() too.
@@ -588,6 +642,15 @@ int do_vfs_ioctl(struct file *filp, unsigned int fd, unsigned int cmd,
 	case FS_IOC_FIEMAP:
 		return ioctl_fiemap(filp, arg);
 
+	case FICLONE:
+		return ioctl_file_clone(filp, arg, 0, 0, 0);
+
+	case FICLONERANGE:
+		return ioctl_file_clone_range(filp, argp);
+
+	case FIDEDUPERANGE:
+		return ioctl_file_dedupe_range(filp, argp);
+
 	case FIGETBSZ:
 		return put_user(inode->i_sb->s_blocksize, argp);
 
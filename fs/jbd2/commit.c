@@ -358,6 +358,14 @@ static void jbd2_block_tag_csum_set(journal_t *j, journal_block_tag_t *tag,
 
 	tag->t_checksum = cpu_to_be32(csum);
 }
+
+/* Account @msecs in one of the journal latency histograms [j_history_lock] */
+static void jbd2_hist_account(journal_t *journal, int hist,
+			      unsigned int msecs)
+{
+	journal->j_stats.ts_hist[hist][jbd2_hist_bucket(msecs)]++;
+}
+
 /*
  * jbd2_journal_commit_transaction
  *
@@ -430,7 +438,24 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	jbd_debug(1, "JBD2: starting commit of transaction %d\n",
 			commit_transaction->t_tid);
 
+	/*
+	 * Let a running fast commit finish.  Once this transaction is
+	 * committed its fast commits are obsolete, so the fast commit area
+	 * starts over, and no new fast commits are started until we are done.
+	 */
 	write_lock(&journal->j_state_lock);
+	while (journal->j_flags & JBD2_FAST_COMMIT_ONGOING) {
+		DEFINE_WAIT(wait);
+
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		write_lock(&journal->j_state_lock);
+	}
+	journal->j_flags |= JBD2_FULL_COMMIT_ONGOING;
+	journal->j_fc_off = 0;
 	commit_transaction->t_state = T_LOCKED;
 
 	trace_jbd2_commit_locking(journal, commit_transaction);
@@ -439,22 +464,18 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	stats.run.rs_running = jbd2_time_diff(commit_transaction->t_start,
 					      stats.run.rs_locked);
 
-	spin_lock(&commit_transaction->t_handle_lock);
 	while (atomic_read(&commit_transaction->t_updates)) {
 		DEFINE_WAIT(wait);
 
 		prepare_to_wait(&journal->j_wait_updates, &wait,
 					TASK_UNINTERRUPTIBLE);
 		if (atomic_read(&commit_transaction->t_updates)) {
-			spin_unlock(&commit_transaction->t_handle_lock);
 			write_unlock(&journal->j_state_lock);
 			schedule();
 			write_lock(&journal->j_state_lock);
-			spin_lock(&commit_transaction->t_handle_lock);
 		}
 		finish_wait(&journal->j_wait_updates, &wait);
 	}
-	spin_unlock(&commit_transaction->t_handle_lock);
 
 	J_ASSERT (atomic_read(&commit_transaction->t_outstanding_credits) <=
 			journal->j_max_transaction_buffers);
@@ -493,15 +514,6 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 		jbd2_journal_refile_buffer(journal, jh);
 	}
 
-	/*
-	 * Now try to drop any written-back buffers from the journal's
-	 * checkpoint lists.  We do this *before* commit because it potentially
-	 * frees some memory
-	 */
-	spin_lock(&journal->j_list_lock);
-	__jbd2_journal_clean_checkpoint_list(journal);
-	spin_unlock(&journal->j_list_lock);
-
 	jbd_debug(3, "JBD2: commit phase 1\n");
 
 	/*
@@ -528,6 +540,17 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	wake_up(&journal->j_wait_transaction_locked);
 	write_unlock(&journal->j_state_lock);
 
+	/*
+	 * Now try to drop any written-back buffers from the journal's
+	 * checkpoint lists.  We do this *before* commit because it potentially
+	 * frees some memory, but only once the transaction has been switched
+	 * out: the next transaction is already running and new handles need
+	 * not wait for this.
+	 */
+	spin_lock(&journal->j_list_lock);
+	__jbd2_journal_clean_checkpoint_list(journal);
+	spin_unlock(&journal->j_list_lock);
+
 	jbd_debug(3, "JBD2: commit phase 2\n");
 
 	/*
@@ -1106,6 +1129,12 @@ restart_loop:
 	journal->j_stats.run.rs_handle_count += stats.run.rs_handle_count;
 	journal->j_stats.run.rs_blocks += stats.run.rs_blocks;
 	journal->j_stats.run.rs_blocks_logged += stats.run.rs_blocks_logged;
+	jbd2_hist_account(journal, JBD2_HIST_LOCKED,
+			  jiffies_to_msecs(stats.run.rs_locked));
+	jbd2_hist_account(journal, JBD2_HIST_FLUSHING,
+			  jiffies_to_msecs(stats.run.rs_flushing));
+	jbd2_hist_account(journal, JBD2_HIST_LOGGING,
+			  jiffies_to_msecs(stats.run.rs_logging));
 	spin_unlock(&journal->j_history_lock);
 
 	commit_transaction->t_state = T_FINISHED;
@@ -1125,6 +1154,11 @@ restart_loop:
 		journal->j_average_commit_time = commit_time;
 	write_unlock(&journal->j_state_lock);
 
+	spin_lock(&journal->j_history_lock);
+	jbd2_hist_account(journal, JBD2_HIST_COMMIT,
+			  div_u64(commit_time, NSEC_PER_MSEC));
+	spin_unlock(&journal->j_history_lock);
+
 	if (commit_transaction->t_checkpoint_list == NULL &&
 	    commit_transaction->t_checkpoint_io_list == NULL) {
 		__jbd2_journal_drop_transaction(journal, commit_transaction);
@@ -1156,5 +1190,9 @@ restart_loop:
 	if (to_free)
 		jbd2_journal_free_transaction(commit_transaction);
 
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FULL_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
 	wake_up(&journal->j_wait_done_commit);
 }
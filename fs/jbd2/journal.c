@@ -780,6 +780,233 @@ struct journal_head *jbd2_journal_get_descriptor_buffer(journal_t *journal)
 	return jbd2_journal_add_journal_head(bh);
 }
 
+/*
+ * Fast commits
+ *
+ * A fast commit writes a compact description of the changes made to an
+ * inode by the running transaction into the fast commit area at the end
+ * of the journal, instead of committing the whole transaction.  The
+ * format of the records is up to the filesystem, which also replays them
+ * after recovery; jbd2 only hands out the blocks of the area, writes them
+ * and keeps fast commits and full commits from running at the same time.
+ * Every full commit starts the area over, since it makes the fast commits
+ * of the transaction it commits obsolete.
+ */
+
+/**
+ * int jbd2_fc_begin_commit() - start a fast commit
+ * @journal: Journal to act on.
+ * @tid: Transaction the fast commit belongs to.
+ *
+ * Waits for a running fast or full commit to finish.  Returns -EALREADY
+ * if @tid got committed in the meantime, in which case there is nothing
+ * left to do, and -EINVAL if @tid is not the running transaction or the
+ * fast commit area can't be used right now; the caller has to fall back
+ * to a full commit then.
+ */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid)
+{
+	DEFINE_WAIT(wait);
+	transaction_t *transaction;
+
+	if (!JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_FAST_COMMIT))
+		return -EINVAL;
+
+	write_lock(&journal->j_state_lock);
+	while (!tid_geq(journal->j_commit_sequence, tid) &&
+	       (journal->j_flags & (JBD2_FAST_COMMIT_ONGOING |
+				    JBD2_FULL_COMMIT_ONGOING))) {
+		prepare_to_wait(&journal->j_fc_wait, &wait,
+				TASK_UNINTERRUPTIBLE);
+		write_unlock(&journal->j_state_lock);
+		schedule();
+		finish_wait(&journal->j_fc_wait, &wait);
+		write_lock(&journal->j_state_lock);
+	}
+	if (tid_geq(journal->j_commit_sequence, tid)) {
+		write_unlock(&journal->j_state_lock);
+		return -EALREADY;
+	}
+
+	/*
+	 * Until the first commit after an empty log rewrites the superblock
+	 * recovery wouldn't look at the fast commit area.
+	 */
+	transaction = journal->j_running_transaction;
+	if (is_journal_aborted(journal) ||
+	    (journal->j_flags & JBD2_FLUSHED) ||
+	    !transaction || transaction->t_tid != tid ||
+	    transaction->t_state != T_RUNNING) {
+		write_unlock(&journal->j_state_lock);
+		return -EINVAL;
+	}
+	journal->j_flags |= JBD2_FAST_COMMIT_ONGOING;
+	journal->j_fc_start = journal->j_fc_off;
+	write_unlock(&journal->j_state_lock);
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_begin_commit);
+
+/**
+ * int jbd2_fc_get_buf() - get the next block of the fast commit area
+ * @journal: Journal to act on.
+ * @bh_out: Returns the zeroed buffer.
+ *
+ * Must be called between jbd2_fc_begin_commit() and jbd2_fc_end_commit().
+ * The buffer is written and released by jbd2_fc_end_commit().  Returns
+ * -ENOSPC once the area is full.
+ */
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out)
+{
+	unsigned long long pblock;
+	struct buffer_head *bh;
+	int err;
+
+	if (journal->j_fc_first + journal->j_fc_off >= journal->j_fc_last)
+		return -ENOSPC;
+
+	err = jbd2_journal_bmap(journal, journal->j_fc_first + journal->j_fc_off,
+				&pblock);
+	if (err)
+		return err;
+
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+	lock_buffer(bh);
+	memset(bh->b_data, 0, journal->j_blocksize);
+	set_buffer_uptodate(bh);
+	unlock_buffer(bh);
+
+	journal->j_fc_wbuf[journal->j_fc_off++] = bh;
+	*bh_out = bh;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_get_buf);
+
+static void jbd2_fc_submit_buffer(struct buffer_head *bh, int write_op)
+{
+	lock_buffer(bh);
+	clear_buffer_dirty(bh);
+	set_buffer_uptodate(bh);
+	get_bh(bh);
+	bh->b_end_io = end_buffer_write_sync;
+	submit_bh(write_op, bh);
+}
+
+static void jbd2_fc_release(journal_t *journal)
+{
+	unsigned long i;
+
+	for (i = journal->j_fc_start; i < journal->j_fc_off; i++) {
+		brelse(journal->j_fc_wbuf[i]);
+		journal->j_fc_wbuf[i] = NULL;
+	}
+
+	write_lock(&journal->j_state_lock);
+	journal->j_flags &= ~JBD2_FAST_COMMIT_ONGOING;
+	write_unlock(&journal->j_state_lock);
+	wake_up(&journal->j_fc_wait);
+}
+
+/**
+ * int jbd2_fc_end_commit() - write out a fast commit
+ * @journal: Journal to act on.
+ *
+ * Writes the blocks handed out by jbd2_fc_get_buf() since
+ * jbd2_fc_begin_commit() and waits for them to reach stable storage.  The
+ * last block is written only once the others are done, with a cache flush
+ * ahead of it, so it also takes care of flushing the data written before
+ * the fast commit started.
+ */
+int jbd2_fc_end_commit(journal_t *journal)
+{
+	unsigned long i, last = journal->j_fc_off - 1;
+	int write_op = WRITE_SYNC;
+	int err = 0;
+
+	if (journal->j_fc_off == journal->j_fc_start) {
+		jbd2_fc_release(journal);
+		return 0;
+	}
+
+	for (i = journal->j_fc_start; i < last; i++)
+		jbd2_fc_submit_buffer(journal->j_fc_wbuf[i], WRITE_SYNC);
+	for (i = journal->j_fc_start; i < last; i++) {
+		wait_on_buffer(journal->j_fc_wbuf[i]);
+		if (unlikely(!buffer_uptodate(journal->j_fc_wbuf[i])))
+			err = -EIO;
+	}
+
+	if (!err) {
+		if (journal->j_flags & JBD2_BARRIER)
+			write_op = WRITE_FLUSH_FUA;
+		jbd2_fc_submit_buffer(journal->j_fc_wbuf[last], write_op);
+		wait_on_buffer(journal->j_fc_wbuf[last]);
+		if (unlikely(!buffer_uptodate(journal->j_fc_wbuf[last])))
+			err = -EIO;
+	}
+
+	jbd2_fc_release(journal);
+	return err;
+}
+EXPORT_SYMBOL(jbd2_fc_end_commit);
+
+/**
+ * void jbd2_fc_abort_commit() - give up on a fast commit
+ * @journal: Journal to act on.
+ *
+ * Releases the blocks handed out since jbd2_fc_begin_commit() without
+ * writing them, the next fast commit will reuse them.
+ */
+void jbd2_fc_abort_commit(journal_t *journal)
+{
+	unsigned long off = journal->j_fc_start;
+
+	jbd2_fc_release(journal);
+	journal->j_fc_off = off;
+}
+EXPORT_SYMBOL(jbd2_fc_abort_commit);
+
+/**
+ * int jbd2_fc_read_block() - read a block of the fast commit area
+ * @journal: Journal to act on.
+ * @off: Block number relative to the start of the area.
+ * @bh_out: Returns the buffer, the caller has to release it.
+ *
+ * Used to replay the fast commits after recovery.  Returns -ENOSPC for
+ * blocks past the end of the area.
+ */
+int jbd2_fc_read_block(journal_t *journal, unsigned long off,
+		       struct buffer_head **bh_out)
+{
+	unsigned long long pblock;
+	struct buffer_head *bh;
+	int err;
+
+	if (journal->j_fc_first + off >= journal->j_fc_last)
+		return -ENOSPC;
+
+	err = jbd2_journal_bmap(journal, journal->j_fc_first + off, &pblock);
+	if (err)
+		return err;
+
+	bh = __getblk(journal->j_dev, pblock, journal->j_blocksize);
+	if (!bh)
+		return -ENOMEM;
+	if (!bh_uptodate_or_lock(bh)) {
+		err = bh_submit_read(bh);
+		if (err) {
+			brelse(bh);
+			return err;
+		}
+	}
+	*bh_out = bh;
+	return 0;
+}
+EXPORT_SYMBOL(jbd2_fc_read_block);
+
 /*
  * Return tid of the oldest transaction in the journal and block in the journal
  * where the transaction starts.
@@ -889,6 +1116,35 @@ static void *jbd2_seq_info_next(struct seq_file *seq, void *v, loff_t *pos)
 	return NULL;
 }
 
+/*
+ * Print the latency histograms, one row per log2 millisecond bucket and
+ * one column per histogram.
+ */
+static void jbd2_seq_hist_show(struct seq_file *seq,
+			       struct jbd2_stats_proc_session *s)
+{
+	unsigned long (*hist)[JBD2_HIST_BUCKETS] = s->stats->ts_hist;
+	int i;
+
+	seq_printf(seq, "latency histogram (ms):\n");
+	seq_printf(seq, "  %10s %12s %10s %10s %10s %10s\n", "",
+		   "handle wait", "locked", "flushing", "logging", "commit");
+	for (i = 0; i < JBD2_HIST_BUCKETS; i++) {
+		if (i == 0)
+			seq_printf(seq, "  %10s", "<1");
+		else if (i == JBD2_HIST_BUCKETS - 1)
+			seq_printf(seq, "  %9u+", 1U << (i - 1));
+		else
+			seq_printf(seq, "  %10u", 1U << (i - 1));
+		seq_printf(seq, " %12u %10lu %10lu %10lu %10lu\n",
+			   atomic_read(&s->journal->j_handle_wait_hist[i]),
+			   hist[JBD2_HIST_LOCKED][i],
+			   hist[JBD2_HIST_FLUSHING][i],
+			   hist[JBD2_HIST_LOGGING][i],
+			   hist[JBD2_HIST_COMMIT][i]);
+	}
+}
+
 static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 {
 	struct jbd2_stats_proc_session *s = seq->private;
@@ -918,6 +1174,7 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	    s->stats->run.rs_blocks / s->stats->ts_tid);
 	seq_printf(seq, "  %lu logged blocks per transaction\n",
 	    s->stats->run.rs_blocks_logged / s->stats->ts_tid);
+	jbd2_seq_hist_show(seq, s);
 	return 0;
 }
 
@@ -1022,6 +1279,7 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_checkpoint);
 	init_waitqueue_head(&journal->j_wait_commit);
 	init_waitqueue_head(&journal->j_wait_updates);
+	init_waitqueue_head(&journal->j_fc_wait);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
 	spin_lock_init(&journal->j_revoke_lock);
@@ -1206,6 +1464,43 @@ static void journal_fail_superblock (journal_t *journal)
 	journal->j_sb_buffer = NULL;
 }
 
+/*
+ * With fast commits the last blocks of the journal are set aside for the
+ * fast commit area and the log proper ends where that area starts.
+ * j_first has to be set up already.
+ */
+static int journal_fc_layout(journal_t *journal)
+{
+	journal_superblock_t *sb = journal->j_superblock;
+	unsigned long num_fc_blks = 0;
+
+	journal->j_last = be32_to_cpu(sb->s_maxlen);
+	if (JBD2_HAS_INCOMPAT_FEATURE(journal,
+				      JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		num_fc_blks = be32_to_cpu(sb->s_num_fc_blks);
+		if (!num_fc_blks)
+			num_fc_blks = JBD2_DEFAULT_FAST_COMMIT_BLOCKS;
+		if (journal->j_first + JBD2_MIN_JOURNAL_BLOCKS + num_fc_blks >
+		    journal->j_last) {
+			printk(KERN_ERR "JBD2: Journal too short for %lu fast "
+			       "commit blocks.\n", num_fc_blks);
+			return -EINVAL;
+		}
+		if (!journal->j_fc_wbuf) {
+			journal->j_fc_wbuf = kcalloc(num_fc_blks,
+						sizeof(struct buffer_head *),
+						GFP_KERNEL);
+			if (!journal->j_fc_wbuf)
+				return -ENOMEM;
+		}
+	}
+	journal->j_fc_last = journal->j_last;
+	journal->j_last -= num_fc_blks;
+	journal->j_fc_first = journal->j_last;
+	journal->j_fc_off = 0;
+	return 0;
+}
+
 /*
  * Given a journal_t structure, initialise the various fields for
  * startup of a new journaling session.  We use this both when creating
@@ -1228,17 +1523,21 @@ static int journal_reset(journal_t *journal)
 	}
 
 	journal->j_first = first;
-	journal->j_last = last;
+	if (journal_fc_layout(journal)) {
+		journal_fail_superblock(journal);
+		return -EINVAL;
+	}
 
 	journal->j_head = first;
 	journal->j_tail = first;
-	journal->j_free = last - first;
+	journal->j_free = journal->j_last - first;
 
 	journal->j_tail_sequence = journal->j_transaction_sequence;
 	journal->j_commit_sequence = journal->j_transaction_sequence - 1;
 	journal->j_commit_request = journal->j_commit_sequence;
 
-	journal->j_max_transaction_buffers = journal->j_maxlen / 4;
+	journal->j_max_transaction_buffers = (journal->j_maxlen -
+			(journal->j_fc_last - journal->j_fc_first)) / 4;
 
 	/*
 	 * As a special case, if the on-disk copy is already marked as needing
@@ -1523,10 +1822,9 @@ static int load_superblock(journal_t *journal)
 	journal->j_tail_sequence = be32_to_cpu(sb->s_sequence);
 	journal->j_tail = be32_to_cpu(sb->s_start);
 	journal->j_first = be32_to_cpu(sb->s_first);
-	journal->j_last = be32_to_cpu(sb->s_maxlen);
 	journal->j_errno = be32_to_cpu(sb->s_errno);
 
-	return 0;
+	return journal_fc_layout(journal);
 }
 
 
@@ -1650,6 +1948,7 @@ int jbd2_journal_destroy(journal_t *journal)
 		jbd2_journal_destroy_revoke(journal);
 	if (journal->j_chksum_driver)
 		crypto_free_shash(journal->j_chksum_driver);
+	kfree(journal->j_fc_wbuf);
 	kfree(journal->j_wbuf);
 	kfree(journal);
 
@@ -1787,6 +2086,41 @@ int jbd2_journal_set_features (journal_t *journal, unsigned long compat,
 							   sizeof(sb->s_uuid));
 	}
 
+	/*
+	 * The fast commit area is carved out of the end of the log, which
+	 * has to be empty for that.  Have the next commit write the new
+	 * layout to disk: recovery has to know about the area before the
+	 * first fast commit can be written to it.
+	 */
+	if (INCOMPAT_FEATURE_ON(JBD2_FEATURE_INCOMPAT_FAST_COMMIT)) {
+		int empty;
+
+		read_lock(&journal->j_state_lock);
+		empty = !journal->j_running_transaction &&
+			!journal->j_committing_transaction &&
+			!journal->j_checkpoint_transactions &&
+			journal->j_head == journal->j_first &&
+			journal->j_tail == journal->j_first;
+		read_unlock(&journal->j_state_lock);
+		if (!empty)
+			return 0;
+
+		sb->s_feature_incompat |=
+			cpu_to_be32(JBD2_FEATURE_INCOMPAT_FAST_COMMIT);
+		if (journal_fc_layout(journal)) {
+			sb->s_feature_incompat &=
+				~cpu_to_be32(JBD2_FEATURE_INCOMPAT_FAST_COMMIT);
+			journal_fc_layout(journal);
+			return 0;
+		}
+		write_lock(&journal->j_state_lock);
+		journal->j_free = journal->j_last - journal->j_first;
+		journal->j_max_transaction_buffers = (journal->j_maxlen -
+			(journal->j_fc_last - journal->j_fc_first)) / 4;
+		journal->j_flags |= JBD2_FLUSHED;
+		write_unlock(&journal->j_state_lock);
+	}
+
 	/* If enabling v1 checksums, downgrade superblock */
 	if (COMPAT_FEATURE_ON(JBD2_FEATURE_COMPAT_CHECKSUM))
 		sb->s_feature_incompat &=
@@ -172,18 +172,26 @@ int dcache_readdir(struct file * filp, void * dirent, filldir_t filldir)
 					continue;
 				}
 
+				/*
+				 * Readers may run in parallel with the final
+				 * dput() of an unlinked entry, hold next on
+				 * the list ourselves.
+				 */
+				dget_dlock(next);
 				spin_unlock(&next->d_lock);
 				spin_unlock(&dentry->d_lock);
 				if (filldir(dirent, next->d_name.name, 
 					    next->d_name.len, filp->f_pos, 
 					    next->d_inode->i_ino, 
-					    dt_type(next->d_inode)) < 0)
+					    dt_type(next->d_inode)) < 0) {
+					dput(next);
 					return 0;
+				}
 				spin_lock(&dentry->d_lock);
-				spin_lock_nested(&next->d_lock, DENTRY_D_LOCK_NESTED);
-				/* next is still alive */
 				list_move(q, p);
-				spin_unlock(&next->d_lock);
+				spin_unlock(&dentry->d_lock);
+				dput(next);
+				spin_lock(&dentry->d_lock);
 				p = q;
 				filp->f_pos++;
 			}
@@ -1204,6 +1204,24 @@ static void follow_dotdot(struct nameidata *nd)
 	nd->inode = nd->path.dentry->d_inode;
 }
 
+/*
+ * Filesystems with FS_PARALLEL_DIROPS look names up and read directories
+ * under ->i_dir_sem held shared, without ->i_mutex.  Everything that
+ * changes a directory or instantiates dentries in it under ->i_mutex takes
+ * ->i_dir_sem exclusive as well, innermost, around the filesystem call.
+ */
+static inline void dir_lock_exclusive(struct inode *dir, int subclass)
+{
+	if (IS_PARALLEL_DIROPS(dir))
+		down_write_nested(&dir->i_dir_sem, subclass);
+}
+
+static inline void dir_unlock_exclusive(struct inode *dir)
+{
+	if (IS_PARALLEL_DIROPS(dir))
+		up_write(&dir->i_dir_sem);
+}
+
 /*
  * This looks up the name in dcache, possibly revalidates the old dentry and
  * allocates a new one if not found or not valid.  In the need_lookup argument
@@ -1274,14 +1292,66 @@ static struct dentry *lookup_real(struct inode *dir, struct dentry *dentry,
 static struct dentry *__lookup_hash(struct qstr *name,
 		struct dentry *base, unsigned int flags)
 {
+	struct inode *dir = base->d_inode;
 	bool need_lookup;
 	struct dentry *dentry;
 
+	dir_lock_exclusive(dir, 0);
 	dentry = lookup_dcache(name, base, flags, &need_lookup);
-	if (!need_lookup)
-		return dentry;
+	if (need_lookup)
+		dentry = lookup_real(dir, dentry, flags);
+	dir_unlock_exclusive(dir);
+	return dentry;
+}
+
+/*
+ * Slow lookup without the parent's i_mutex for FS_PARALLEL_DIROPS.  Other
+ * lookups in the directory go on meanwhile; those of the same name wait in
+ * d_alloc_parallel() for ours instead of calling ->lookup() as well.
+ */
+static struct dentry *lookup_parallel(struct qstr *name, struct dentry *parent,
+				      unsigned int flags)
+{
+	struct inode *dir = parent->d_inode;
+	struct d_in_lookup dil;
+	struct dentry *dentry, *old;
+	int error;
+
+	down_read(&dir->i_dir_sem);
+again:
+	dentry = d_alloc_parallel(parent, name, &dil);
+	if (IS_ERR(dentry))
+		goto out;
+
+	if (!d_in_lookup(dentry)) {
+		if (dentry->d_flags & DCACHE_OP_REVALIDATE) {
+			error = d_revalidate(dentry, flags);
+			if (unlikely(error <= 0)) {
+				if (error < 0) {
+					dput(dentry);
+					dentry = ERR_PTR(error);
+				} else if (!d_invalidate(dentry)) {
+					dput(dentry);
+					goto again;
+				}
+			}
+		}
+		goto out;
+	}
 
-	return lookup_real(base->d_inode, dentry, flags);
+	/* Don't create child dentry for a dead directory. */
+	if (unlikely(IS_DEADDIR(dir)))
+		old = ERR_PTR(-ENOENT);
+	else
+		old = dir->i_op->lookup(dir, dentry, flags);
+	d_lookup_done(&dil);
+	if (unlikely(old)) {
+		dput(dentry);
+		dentry = old;
+	}
+out:
+	up_read(&dir->i_dir_sem);
+	return dentry;
 }
 
 /*
@@ -1399,9 +1469,13 @@ static int lookup_slow(struct nameidata *nd, struct qstr *name,
 	parent = nd->path.dentry;
 	BUG_ON(nd->inode != parent->d_inode);
 
-	mutex_lock(&parent->d_inode->i_mutex);
-	dentry = __lookup_hash(name, parent, nd->flags);
-	mutex_unlock(&parent->d_inode->i_mutex);
+	if (IS_PARALLEL_DIROPS(parent->d_inode)) {
+		dentry = lookup_parallel(name, parent, nd->flags);
+	} else {
+		mutex_lock(&parent->d_inode->i_mutex);
+		dentry = __lookup_hash(name, parent, nd->flags);
+		mutex_unlock(&parent->d_inode->i_mutex);
+	}
 	if (IS_ERR(dentry))
 		return PTR_ERR(dentry);
 	path->mnt = nd->path.mnt;
@@ -2281,7 +2355,9 @@ int vfs_create(struct inode *dir, struct dentry *dentry, umode_t mode,
 	error = security_inode_create(dir, dentry, mode);
 	if (error)
 		return error;
+	dir_lock_exclusive(dir, 0);
 	error = dir->i_op->create(dir, dentry, mode, want_excl);
+	dir_unlock_exclusive(dir);
 	if (!error)
 		fsnotify_create(dir, dentry);
 	return error;
@@ -2568,26 +2644,34 @@ static int lookup_open(struct nameidata *nd, struct path *path,
 	bool need_lookup;
 
 	*opened &= ~FILE_CREATED;
+	dir_lock_exclusive(dir_inode, 0);
 	dentry = lookup_dcache(&nd->last, dir, nd->flags, &need_lookup);
-	if (IS_ERR(dentry))
+	if (IS_ERR(dentry)) {
+		dir_unlock_exclusive(dir_inode);
 		return PTR_ERR(dentry);
+	}
 
 	/* Cached positive dentry: will open in f_op->open */
-	if (!need_lookup && dentry->d_inode)
+	if (!need_lookup && dentry->d_inode) {
+		dir_unlock_exclusive(dir_inode);
 		goto out_no_open;
+	}
 
 	if ((nd->flags & LOOKUP_OPEN) && dir_inode->i_op->atomic_open) {
-		return atomic_open(nd, dentry, path, file, op, got_write,
-				   need_lookup, opened);
+		error = atomic_open(nd, dentry, path, file, op, got_write,
+				    need_lookup, opened);
+		dir_unlock_exclusive(dir_inode);
+		return error;
 	}
 
 	if (need_lookup) {
 		BUG_ON(dentry->d_inode);
 
 		dentry = lookup_real(dir_inode, dentry, nd->flags);
-		if (IS_ERR(dentry))
-			return PTR_ERR(dentry);
 	}
+	dir_unlock_exclusive(dir_inode);
+	if (IS_ERR(dentry))
+		return PTR_ERR(dentry);
 
 	/* Negative dentry, just create the file */
 	if (!dentry->d_inode && (op->open_flag & O_CREAT)) {
@@ -3079,7 +3163,9 @@ int vfs_mknod(struct inode *dir, struct dentry *dentry, umode_t mode, dev_t dev)
 	if (error)
 		return error;
 
+	dir_lock_exclusive(dir, 0);
 	error = dir->i_op->mknod(dir, dentry, mode, dev);
+	dir_unlock_exclusive(dir);
 	if (!error)
 		fsnotify_create(dir, dentry);
 	return error;
@@ -3163,7 +3249,9 @@ int vfs_mkdir(struct inode *dir, struct dentry *dentry, umode_t mode)
 	if (max_links && dir->i_nlink >= max_links)
 		return -EMLINK;
 
+	dir_lock_exclusive(dir, 0);
 	error = dir->i_op->mkdir(dir, dentry, mode);
+	dir_unlock_exclusive(dir);
 	if (!error)
 		fsnotify_mkdir(dir, dentry);
 	return error;
@@ -3239,11 +3327,17 @@ int vfs_rmdir(struct inode *dir, struct dentry *dentry)
 		goto out;
 
 	shrink_dcache_parent(dentry);
+	/* readdir of the victim holds only its i_dir_sem */
+	dir_lock_exclusive(dir, I_MUTEX_PARENT);
+	dir_lock_exclusive(dentry->d_inode, I_MUTEX_CHILD);
 	error = dir->i_op->rmdir(dir, dentry);
+	if (!error)
+		dentry->d_inode->i_flags |= S_DEAD;
+	dir_unlock_exclusive(dentry->d_inode);
+	dir_unlock_exclusive(dir);
 	if (error)
 		goto out;
 
-	dentry->d_inode->i_flags |= S_DEAD;
 	dont_mount(dentry);
 
 out:
@@ -3327,7 +3421,9 @@ int vfs_unlink(struct inode *dir, struct dentry *dentry)
 	else {
 		error = security_inode_unlink(dir, dentry);
 		if (!error) {
+			dir_lock_exclusive(dir, 0);
 			error = dir->i_op->unlink(dir, dentry);
+			dir_unlock_exclusive(dir);
 			if (!error)
 				dont_mount(dentry);
 		}
@@ -3433,7 +3529,9 @@ int vfs_symlink(struct inode *dir, struct dentry *dentry, const char *oldname)
 	if (error)
 		return error;
 
+	dir_lock_exclusive(dir, 0);
 	error = dir->i_op->symlink(dir, dentry, oldname);
+	dir_unlock_exclusive(dir);
 	if (!error)
 		fsnotify_create(dir, dentry);
 	return error;
@@ -3506,8 +3604,11 @@ int vfs_link(struct dentry *old_dentry, struct inode *dir, struct dentry *new_de
 		error =  -ENOENT;
 	else if (max_links && inode->i_nlink >= max_links)
 		error = -EMLINK;
-	else
+	else {
+		dir_lock_exclusive(dir, 0);
 		error = dir->i_op->link(old_dentry, dir, new_dentry);
+		dir_unlock_exclusive(dir);
+	}
 	mutex_unlock(&inode->i_mutex);
 	if (!error)
 		fsnotify_link(dir, inode, new_dentry);
@@ -3579,6 +3680,24 @@ SYSCALL_DEFINE2(link, const char __user *, oldname, const char __user *, newname
 	return sys_linkat(AT_FDCWD, oldname, AT_FDCWD, newname, 0);
 }
 
+/*
+ * Both directories are under ->i_mutex already, via lock_rename(), so the
+ * order we take ->i_dir_sem in doesn't matter.
+ */
+static void dir_lock_rename(struct inode *old_dir, struct inode *new_dir)
+{
+	dir_lock_exclusive(old_dir, I_MUTEX_PARENT);
+	if (new_dir != old_dir)
+		dir_lock_exclusive(new_dir, I_MUTEX_CHILD);
+}
+
+static void dir_unlock_rename(struct inode *old_dir, struct inode *new_dir)
+{
+	if (new_dir != old_dir)
+		dir_unlock_exclusive(new_dir);
+	dir_unlock_exclusive(old_dir);
+}
+
 /*
  * The worst of all namespace operations - renaming directory. "Perverted"
  * doesn't even start to describe it. Somebody in UCB had a heck of a trip...
@@ -3642,21 +3761,27 @@ static int vfs_rename_dir(struct inode *old_dir, struct dentry *old_dentry,
 
 	if (target)
 		shrink_dcache_parent(new_dentry);
+	dir_lock_rename(old_dir, new_dir);
+	if (target)
+		dir_lock_exclusive(target, I_MUTEX_NORMAL);
 	error = old_dir->i_op->rename(old_dir, old_dentry, new_dir, new_dentry);
 	if (error)
-		goto out;
+		goto out_unlock;
 
 	if (target) {
 		target->i_flags |= S_DEAD;
 		dont_mount(new_dentry);
 	}
+	if (!(old_dir->i_sb->s_type->fs_flags & FS_RENAME_DOES_D_MOVE))
+		d_move(old_dentry,new_dentry);
+out_unlock:
+	if (target)
+		dir_unlock_exclusive(target);
+	dir_unlock_rename(old_dir, new_dir);
 out:
 	if (target)
 		mutex_unlock(&target->i_mutex);
 	dput(new_dentry);
-	if (!error)
-		if (!(old_dir->i_sb->s_type->fs_flags & FS_RENAME_DOES_D_MOVE))
-			d_move(old_dentry,new_dentry);
 	return error;
 }
 
@@ -3678,14 +3803,15 @@ static int vfs_rename_other(struct inode *old_dir, struct dentry *old_dentry,
 	if (d_mountpoint(old_dentry)||d_mountpoint(new_dentry))
 		goto out;
 
+	dir_lock_rename(old_dir, new_dir);
 	error = old_dir->i_op->rename(old_dir, old_dentry, new_dir, new_dentry);
-	if (error)
-		goto out;
-
-	if (target)
-		dont_mount(new_dentry);
-	if (!(old_dir->i_sb->s_type->fs_flags & FS_RENAME_DOES_D_MOVE))
-		d_move(old_dentry, new_dentry);
+	if (!error) {
+		if (target)
+			dont_mount(new_dentry);
+		if (!(old_dir->i_sb->s_type->fs_flags & FS_RENAME_DOES_D_MOVE))
+			d_move(old_dentry, new_dentry);
+	}
+	dir_unlock_rename(old_dir, new_dir);
 out:
 	if (target)
 		mutex_unlock(&target->i_mutex);
@@ -15,6 +15,8 @@
 #include <linux/syscalls.h>
 #include <linux/pagemap.h>
 #include <linux/splice.h>
+#include <linux/mount.h>
+#include <linux/highmem.h>
 #include "read_write.h"
 
 #include <asm/uaccess.h>
@@ -218,13 +220,23 @@ EXPORT_SYMBOL(default_llseek);
 
 loff_t vfs_llseek(struct file *file, loff_t offset, int origin)
 {
+	struct inode *inode = file->f_path.dentry->d_inode;
 	loff_t (*fn)(struct file *, loff_t, int);
+	loff_t retval;
 
 	fn = no_llseek;
 	if (file->f_mode & FMODE_LSEEK) {
 		if (file->f_op && file->f_op->llseek)
 			fn = file->f_op->llseek;
 	}
+
+	/* vfs_readdir() doesn't take i_mutex on those */
+	if (S_ISDIR(inode->i_mode) && IS_PARALLEL_DIROPS(inode)) {
+		mutex_lock(&file->f_pos_lock);
+		retval = fn(file, offset, origin);
+		mutex_unlock(&file->f_pos_lock);
+		return retval;
+	}
 	return fn(file, offset, origin);
 }
 EXPORT_SYMBOL(vfs_llseek);
@@ -1007,3 +1019,271 @@ SYSCALL_DEFINE4(sendfile64, int, out_fd, int, in_fd, loff_t __user *, offset, si
 
 	return do_sendfile(out_fd, in_fd, NULL, count, 0);
 }
+
+/*
+ * Like rw_verify_area(), but without the MAX_RW_COUNT limit: clone and
+ * dedupe requests only remap blocks, they don't copy any data.
+ */
+static int clone_verify_area(struct file *file, loff_t pos, u64 len,
+			     bool write)
+{
+	struct inode *inode = file->f_path.dentry->d_inode;
+
+	if (unlikely(pos < 0 || (loff_t) len < 0))
+		return -EINVAL;
+	if (unlikely((loff_t) (pos + len) < 0))
+		return -EINVAL;
+
+	if (unlikely(inode->i_flock && mandatory_lock(inode))) {
+		int retval;
+
+		retval = locks_mandatory_area(
+			write ? FLOCK_VERIFY_WRITE : FLOCK_VERIFY_READ,
+			inode, file, pos, len);
+		if (retval < 0)
+			return retval;
+	}
+
+	return security_file_permission(file, write ? MAY_WRITE : MAY_READ);
+}
+
+/**
+ * vfs_clone_file_range - share blocks between two files
+ * @file_in:	source file
+ * @pos_in:	start of the range in the source file
+ * @file_out:	destination file
+ * @pos_out:	start of the range in the destination file
+ * @len:	length of the range, zero for up to the end of the source file
+ *
+ * Make the destination range refer to the blocks backing the source range
+ * instead of copying the data.  Both files have to be regular files on the
+ * same mount; the filesystem decides about alignment and whether source
+ * and destination may be the same file.
+ */
+int vfs_clone_file_range(struct file *file_in, loff_t pos_in,
+			 struct file *file_out, loff_t pos_out, u64 len)
+{
+	struct inode *inode_in = file_in->f_path.dentry->d_inode;
+	struct inode *inode_out = file_out->f_path.dentry->d_inode;
+	int ret;
+
+	if (inode_in->i_sb != inode_out->i_sb ||
+	    file_in->f_path.mnt != file_out->f_path.mnt)
+		return -EXDEV;
+
+	if (S_ISDIR(inode_in->i_mode) || S_ISDIR(inode_out->i_mode))
+		return -EISDIR;
+	if (!S_ISREG(inode_in->i_mode) || !S_ISREG(inode_out->i_mode))
+		return -EINVAL;
+
+	if (!(file_in->f_mode & FMODE_READ) ||
+	    !(file_out->f_mode & FMODE_WRITE) ||
+	    (file_out->f_flags & O_APPEND))
+		return -EBADF;
+
+	if (IS_IMMUTABLE(inode_out) || IS_APPEND(inode_out))
+		return -EPERM;
+
+	if (!file_in->f_op->clone_file_range)
+		return -EOPNOTSUPP;
+
+	ret = clone_verify_area(file_in, pos_in, len, false);
+	if (ret)
+		return ret;
+
+	ret = clone_verify_area(file_out, pos_out, len, true);
+	if (ret)
+		return ret;
+
+	if (pos_in + len > i_size_read(inode_in))
+		return -EINVAL;
+
+	ret = mnt_want_write_file(file_out);
+	if (ret)
+		return ret;
+
+	ret = file_in->f_op->clone_file_range(file_in, pos_in,
+			file_out, pos_out, len);
+	if (!ret) {
+		fsnotify_access(file_in);
+		fsnotify_modify(file_out);
+	}
+
+	mnt_drop_write_file(file_out);
+	return ret;
+}
+EXPORT_SYMBOL(vfs_clone_file_range);
+
+/**
+ * vfs_dedupe_file_range_compare - compare the contents of two file ranges
+ * @src:	source inode
+ * @srcoff:	start of the range in @src
+ * @dest:	destination inode
+ * @destoff:	start of the range in @dest
+ * @len:	length of the ranges
+ * @is_same:	set if the ranges have the same contents
+ *
+ * The comparison is done through the page cache.  The caller has to keep
+ * both ranges from being written to, and both must be inside i_size.
+ */
+int vfs_dedupe_file_range_compare(struct inode *src, loff_t srcoff,
+				  struct inode *dest, loff_t destoff,
+				  loff_t len, bool *is_same)
+{
+	struct page *src_page, *dest_page;
+	void *src_addr, *dest_addr;
+	bool same = true;
+
+	while (len) {
+		pgoff_t src_index = srcoff >> PAGE_CACHE_SHIFT;
+		pgoff_t dest_index = destoff >> PAGE_CACHE_SHIFT;
+		loff_t src_poff = srcoff & (PAGE_CACHE_SIZE - 1);
+		loff_t dest_poff = destoff & (PAGE_CACHE_SIZE - 1);
+		loff_t cmp_len;
+
+		cmp_len = min(PAGE_CACHE_SIZE - src_poff,
+			      PAGE_CACHE_SIZE - dest_poff);
+		cmp_len = min(cmp_len, len);
+
+		src_page = read_mapping_page(src->i_mapping, src_index, NULL);
+		if (IS_ERR(src_page))
+			return PTR_ERR(src_page);
+		dest_page = read_mapping_page(dest->i_mapping, dest_index,
+					      NULL);
+		if (IS_ERR(dest_page)) {
+			page_cache_release(src_page);
+			return PTR_ERR(dest_page);
+		}
+
+		src_addr = kmap_atomic(src_page);
+		dest_addr = kmap_atomic(dest_page);
+
+		flush_dcache_page(src_page);
+		flush_dcache_page(dest_page);
+
+		if (memcmp(src_addr + src_poff, dest_addr + dest_poff,
+			   cmp_len))
+			same = false;
+
+		kunmap_atomic(dest_addr);
+		kunmap_atomic(src_addr);
+		page_cache_release(dest_page);
+		page_cache_release(src_page);
+
+		if (!same)
+			break;
+
+		srcoff += cmp_len;
+		destoff += cmp_len;
+		len -= cmp_len;
+	}
+
+	*is_same = same;
+	return 0;
+}
+EXPORT_SYMBOL(vfs_dedupe_file_range_compare);
+
+/**
+ * vfs_dedupe_file_range - share identical blocks between files
+ * @file:	source file
+ * @same:	source range and array of destination ranges
+ *
+ * Try to share the source range with each of the destination ranges in
+ * turn.  The outcome for each destination is reported in its status and
+ * bytes_deduped fields; the return value is only an error if the request
+ * itself is invalid.
+ */
+int vfs_dedupe_file_range(struct file *file, struct file_dedupe_range *same)
+{
+	struct file_dedupe_range_info *info;
+	struct inode *src = file->f_path.dentry->d_inode;
+	u64 off = same->src_offset;
+	u64 len = same->src_length;
+	bool is_admin = capable(CAP_SYS_ADMIN);
+	u16 count = same->dest_count;
+	struct file *dst_file;
+	struct inode *dst;
+	ssize_t deduped;
+	int i;
+	int ret;
+
+	if (!(file->f_mode & FMODE_READ))
+		return -EINVAL;
+
+	if (same->reserved1 || same->reserved2)
+		return -EINVAL;
+
+	if (S_ISDIR(src->i_mode))
+		return -EISDIR;
+	if (!S_ISREG(src->i_mode))
+		return -EINVAL;
+
+	ret = clone_verify_area(file, off, len, false);
+	if (ret)
+		return ret;
+
+	if (off + len > i_size_read(src))
+		return -EINVAL;
+
+	/* pre-format output fields to sane values */
+	for (i = 0; i < count; i++) {
+		same->info[i].bytes_deduped = 0ULL;
+		same->info[i].status = FILE_DEDUPE_RANGE_SAME;
+	}
+
+	for (i = 0, info = same->info; i < count; i++, info++) {
+		dst_file = fget(info->dest_fd);
+		if (!dst_file) {
+			info->status = -EBADF;
+			goto next_loop;
+		}
+		dst = dst_file->f_path.dentry->d_inode;
+
+		if (info->reserved) {
+			info->status = -EINVAL;
+			goto next_fput;
+		}
+
+		ret = mnt_want_write_file(dst_file);
+		if (ret) {
+			info->status = ret;
+			goto next_fput;
+		}
+
+		ret = clone_verify_area(dst_file, info->dest_offset, len, true);
+		if (ret) {
+			info->status = ret;
+			goto next_file;
+		}
+
+		if (file->f_path.mnt != dst_file->f_path.mnt ||
+		    src->i_sb != dst->i_sb)
+			info->status = -EXDEV;
+		else if (S_ISDIR(dst->i_mode))
+			info->status = -EISDIR;
+		else if (!is_admin && !(dst_file->f_mode & FMODE_WRITE))
+			info->status = -EINVAL;
+		else if (!file->f_op->dedupe_file_range)
+			info->status = -EINVAL;
+		else {
+			deduped = file->f_op->dedupe_file_range(file, off, len,
+					dst_file, info->dest_offset);
+			if (deduped == -EBADE)
+				info->status = FILE_DEDUPE_RANGE_DIFFERS;
+			else if (deduped < 0)
+				info->status = deduped;
+			else
+				info->bytes_deduped += deduped;
+		}
+
+next_file:
+		mnt_drop_write_file(dst_file);
+next_fput:
+		fput(dst_file);
+next_loop:
+		if (fatal_signal_pending(current))
+			break;
+	}
+	return 0;
+}
+EXPORT_SYMBOL(vfs_dedupe_file_range);
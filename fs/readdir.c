@@ -31,16 +31,34 @@ int vfs_readdir(struct file *file, filldir_t filler, void *buf)
 	if (res)
 		goto out;
 
-	res = mutex_lock_killable(&inode->i_mutex);
-	if (res)
-		goto out;
+	/*
+	 * Filesystems with FS_PARALLEL_DIROPS let readers of a directory in
+	 * at the same time; only f_pos and ->private_data of this file need
+	 * serializing then.
+	 */
+	if (IS_PARALLEL_DIROPS(inode)) {
+		res = mutex_lock_killable(&file->f_pos_lock);
+		if (res)
+			goto out;
+		down_read(&inode->i_dir_sem);
+	} else {
+		res = mutex_lock_killable(&inode->i_mutex);
+		if (res)
+			goto out;
+	}
 
 	res = -ENOENT;
 	if (!IS_DEADDIR(inode)) {
 		res = file->f_op->readdir(file, buf, filler);
 		file_accessed(file);
 	}
-	mutex_unlock(&inode->i_mutex);
+
+	if (IS_PARALLEL_DIROPS(inode)) {
+		up_read(&inode->i_dir_sem);
+		mutex_unlock(&file->f_pos_lock);
+	} else {
+		mutex_unlock(&inode->i_mutex);
+	}
 out:
 	return res;
 }
@@ -93,8 +93,8 @@ static int prune_super(struct shrinker *shrink, struct shrink_control *sc)
 		 * prune the dcache first as the icache is pinned by it, then
 		 * prune the icache, followed by the filesystem specific caches
 		 */
-		prune_dcache_sb(sb, dentries);
-		prune_icache_sb(sb, inodes);
+		prune_dcache_sb(sb, dentries, sc->target_mem_cgroup);
+		prune_icache_sb(sb, inodes, sc->target_mem_cgroup);
 
 		if (fs_objects && sb->s_op->free_cached_objects) {
 			sb->s_op->free_cached_objects(sb, fs_objects);
@@ -225,6 +225,7 @@ static struct super_block *alloc_super(struct file_system_type *type, int flags)
 		s->s_shrink.seeks = DEFAULT_SEEKS;
 		s->s_shrink.shrink = prune_super;
 		s->s_shrink.batch = 1024;
+		s->s_shrink.flags = SHRINKER_MEMCG_AWARE;
 	}
 out:
 	return s;
@@ -439,6 +440,9 @@ void generic_shutdown_super(struct super_block *sb)
 		sync_filesystem(sb);
 		sb->s_flags &= ~MS_ACTIVE;
 
+		/* in-flight wb switches hold inode references */
+		cgroup_writeback_umount();
+
 		fsnotify_unmount_inodes(&sb->s_inodes);
 
 		evict_inodes(sb);
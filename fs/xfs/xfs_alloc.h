@@ -71,9 +71,11 @@ typedef unsigned int xfs_alloctype_t;
  * reserved in delayed allocation. Considering the minimum number of
  * needed freelist blocks is 4 fsbs _per AG_, a potential split of file's bmap
  * btree requires 1 fsb, so we set the number of set-aside blocks
- * to 4 + 4*agcount.
+ * to 4 + 4*agcount.  With reflink the freelist also has to cover a
+ * split of the refcount btree, so that much more is set aside per AG.
  */
-#define XFS_ALLOC_SET_ASIDE(mp)  (4 + ((mp)->m_sb.sb_agcount * 4))
+#define XFS_ALLOC_SET_ASIDE(mp)  \
+	(4 + ((mp)->m_sb.sb_agcount * (4 + (mp)->m_refc_maxlevels)))
 
 /*
  * When deciding how much space to allocate out of an AG, we limit the
@@ -204,6 +206,15 @@ int				/* error */
 xfs_alloc_vextent(
 	xfs_alloc_arg_t	*args);	/* allocation argument structure */
 
+/*
+ * Decide whether to use this allocation group for this allocation.
+ * If so, fix up the btree freelist's size.
+ */
+int				/* error */
+xfs_alloc_fix_freelist(
+	xfs_alloc_arg_t	*args,	/* allocation argument structure */
+	int		flags);	/* XFS_ALLOC_FLAG_... */
+
 /*
  * Free an extent.
  */
@@ -31,6 +31,7 @@
 #include "xfs_vnodeops.h"
 #include "xfs_trace.h"
 #include "xfs_bmap.h"
+#include "xfs_reflink.h"
 #include <linux/gfp.h>
 #include <linux/mpage.h>
 #include <linux/pagevec.h>
@@ -185,7 +186,8 @@ xfs_finish_ioend(
 	if (atomic_dec_and_test(&ioend->io_remaining)) {
 		struct xfs_mount	*mp = XFS_I(ioend->io_inode)->i_mount;
 
-		if (ioend->io_type == XFS_IO_UNWRITTEN)
+		if (ioend->io_type == XFS_IO_UNWRITTEN ||
+		    ioend->io_type == XFS_IO_COW)
 			queue_work(mp->m_unwritten_workqueue, &ioend->io_work);
 		else if (ioend->io_append_trans)
 			queue_work(mp->m_data_workqueue, &ioend->io_work);
@@ -246,6 +248,17 @@ xfs_end_io(
 			ioend->io_error = -error;
 			goto done;
 		}
+	} else if (ioend->io_type == XFS_IO_COW) {
+		/*
+		 * The data went to the staging extent, make it part of the
+		 * file.  This also updates the on-disk inode size.
+		 */
+		error = xfs_reflink_end_cow(ip, ioend->io_offset,
+					    ioend->io_size,
+					    ioend->io_cow_startblock,
+					    ioend->io_cow_blockcount);
+		if (error)
+			ioend->io_error = -error;
 	} else if (ioend->io_append_trans) {
 		error = xfs_setfilesize(ioend);
 		if (error)
@@ -255,6 +268,20 @@ xfs_end_io(
 	}
 
 done:
+	/*
+	 * If the staging extent did not make it into the file, free it and
+	 * make sure the buffers get mapped again on the next write instead
+	 * of pointing at the freed blocks.
+	 */
+	if (ioend->io_error && ioend->io_type == XFS_IO_COW &&
+	    !XFS_FORCED_SHUTDOWN(ip->i_mount)) {
+		struct buffer_head	*bh;
+
+		xfs_reflink_cancel_cow(ip, ioend->io_cow_startblock,
+				       ioend->io_cow_blockcount);
+		for (bh = ioend->io_buffer_head; bh; bh = bh->b_private)
+			clear_buffer_mapped(bh);
+	}
 	xfs_destroy_ioend(ioend);
 }
 
@@ -303,6 +330,8 @@ xfs_alloc_ioend(
 	ioend->io_iocb = NULL;
 	ioend->io_result = 0;
 	ioend->io_append_trans = NULL;
+	ioend->io_cow_startblock = NULLFSBLOCK;
+	ioend->io_cow_blockcount = 0;
 
 	INIT_WORK(&ioend->io_work, xfs_end_io);
 	return ioend;
@@ -543,6 +572,10 @@ xfs_cancel_ioend(
 
 	do {
 		next = ioend->io_list;
+		if (ioend->io_type == XFS_IO_COW)
+			xfs_reflink_cancel_cow(XFS_I(ioend->io_inode),
+					       ioend->io_cow_startblock,
+					       ioend->io_cow_blockcount);
 		bh = ioend->io_buffer_head;
 		do {
 			next_bh = bh->b_private;
@@ -588,6 +621,9 @@ xfs_add_to_ioend(
 
 	bh->b_private = NULL;
 	ioend->io_size += bh->b_size;
+
+	/* the staging extent for the copy has been allocated by now */
+	xfs_reflink_unreserve_cow_buffer(XFS_I(inode), bh);
 }
 
 STATIC void
@@ -649,11 +685,13 @@ xfs_check_page_type(
 		bh = head = page_buffers(page);
 		do {
 			if (buffer_unwritten(bh))
-				acceptable += (type == XFS_IO_UNWRITTEN);
+				acceptable += (type == XFS_IO_UNWRITTEN ||
+					       type == XFS_IO_COW);
 			else if (buffer_delay(bh))
 				acceptable += (type == XFS_IO_DELALLOC);
 			else if (buffer_dirty(bh) && buffer_mapped(bh))
-				acceptable += (type == XFS_IO_OVERWRITE);
+				acceptable += (type == XFS_IO_OVERWRITE ||
+					       type == XFS_IO_COW);
 			else
 				break;
 		} while ((bh = bh->b_this_page) != head);
@@ -726,6 +764,12 @@ xfs_convert_page(
 	do {
 		if (offset >= end_offset)
 			break;
+		/*
+		 * A copy-on-write ioend has to stay contiguous, it is
+		 * written to the start of its staging extent.
+		 */
+		if (done && (*ioendp)->io_type == XFS_IO_COW)
+			break;
 		if (!buffer_uptodate(bh))
 			uptodate = 0;
 		if (!(PageUptodate(page) || buffer_uptodate(bh))) {
@@ -747,6 +791,10 @@ xfs_convert_page(
 				continue;
 			}
 
+			/* imap is the staging extent for these blocks */
+			if ((*ioendp)->io_type == XFS_IO_COW)
+				type = XFS_IO_COW;
+
 			lock_buffer(bh);
 			if (type != XFS_IO_OVERWRITE)
 				xfs_map_at_offset(inode, bh, imap, offset);
@@ -818,6 +866,20 @@ xfs_vm_invalidatepage(
 	unsigned long		offset)
 {
 	trace_xfs_invalidatepage(page->mapping->host, page, offset);
+
+	if (page_has_buffers(page)) {
+		struct buffer_head	*bh, *head;
+		unsigned long		start = 0;
+
+		bh = head = page_buffers(page);
+		do {
+			if (start >= offset)
+				xfs_reflink_unreserve_cow_buffer(
+					XFS_I(page->mapping->host), bh);
+			start += bh->b_size;
+		} while ((bh = bh->b_this_page) != head);
+	}
+
 	block_invalidatepage(page, offset);
 }
 
@@ -911,6 +973,7 @@ xfs_vm_writepage(
 	int			err, imap_valid = 0, uptodate = 1;
 	int			count = 0;
 	int			nonblocking = 0;
+	int			is_cow = 0;
 
 	trace_xfs_writepage(inode, page, 0);
 
@@ -1039,14 +1102,34 @@ xfs_vm_writepage(
 					     nonblocking);
 			if (err)
 				goto error;
+
+			/*
+			 * Shared blocks are written to a new staging extent,
+			 * which then replaces them at I/O completion.
+			 */
+			is_cow = 0;
+			if (type != XFS_IO_DELALLOC &&
+			    XFS_IS_REFLINK_INODE(XFS_I(inode))) {
+				xfs_reflink_unreserve_cow_buffer(XFS_I(inode),
+								 bh);
+				err = -xfs_reflink_map_cow(XFS_I(inode), offset,
+							   &imap, &is_cow);
+				if (err)
+					goto error;
+			}
 			imap_valid = xfs_imap_valid(inode, &imap, offset);
 		}
 		if (imap_valid) {
 			lock_buffer(bh);
-			if (type != XFS_IO_OVERWRITE)
+			if (type != XFS_IO_OVERWRITE || is_cow)
 				xfs_map_at_offset(inode, bh, &imap, offset);
-			xfs_add_to_ioend(inode, bh, offset, type, &ioend,
+			xfs_add_to_ioend(inode, bh, offset,
+					 is_cow ? XFS_IO_COW : type, &ioend,
 					 new_ioend);
+			if (new_ioend && is_cow) {
+				ioend->io_cow_startblock = imap.br_startblock;
+				ioend->io_cow_blockcount = imap.br_blockcount;
+			}
 			count++;
 		}
 
@@ -1085,6 +1168,7 @@ xfs_vm_writepage(
 		 * inode size.
 		 */
 		if (ioend->io_type != XFS_IO_UNWRITTEN &&
+		    ioend->io_type != XFS_IO_COW &&
 		    xfs_ioend_is_append(ioend)) {
 			err = xfs_setfilesize_trans_alloc(ioend);
 			if (err)
@@ -1135,6 +1219,7 @@ xfs_vm_releasepage(
 	struct page		*page,
 	gfp_t			gfp_mask)
 {
+	struct buffer_head	*bh, *head;
 	int			delalloc, unwritten;
 
 	trace_xfs_releasepage(page->mapping->host, page, 0);
@@ -1146,6 +1231,14 @@ xfs_vm_releasepage(
 	if (WARN_ON(unwritten))
 		return 0;
 
+	/* a write that reserved a block for a copy may not have dirtied it */
+	bh = head = page_buffers(page);
+	do {
+		if (!buffer_dirty(bh))
+			xfs_reflink_unreserve_cow_buffer(
+				XFS_I(page->mapping->host), bh);
+	} while ((bh = bh->b_this_page) != head);
+
 	return try_to_free_buffers(page);
 }
 
@@ -1557,6 +1650,12 @@ xfs_vm_write_begin(
 		return -ENOMEM;
 
 	status = __block_write_begin(page, pos, len, xfs_get_blocks);
+	if (!status) {
+		unsigned	from = pos & (PAGE_CACHE_SIZE - 1);
+
+		status = -xfs_reflink_reserve_cow_page(XFS_I(mapping->host),
+						       page, from, from + len);
+	}
 	if (unlikely(status)) {
 		struct inode	*inode = mapping->host;
 
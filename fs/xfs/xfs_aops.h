@@ -28,13 +28,27 @@ enum {
 	XFS_IO_DELALLOC,	/* covers delalloc region */
 	XFS_IO_UNWRITTEN,	/* covers allocated but uninitialized data */
 	XFS_IO_OVERWRITE,	/* covers already allocated extent */
+	XFS_IO_COW,		/* copy-on-write of shared blocks */
 };
 
 #define XFS_IO_TYPES \
 	{ 0,			"" }, \
 	{ XFS_IO_DELALLOC,		"delalloc" }, \
 	{ XFS_IO_UNWRITTEN,		"unwritten" }, \
-	{ XFS_IO_OVERWRITE,		"overwrite" }
+	{ XFS_IO_OVERWRITE,		"overwrite" }, \
+	{ XFS_IO_COW,			"cow" }
+
+/*
+ * A buffer over a shared block that has been dirtied, and for which a
+ * block for the copy-on-write at writeback time has been taken off the
+ * free space counter.  See xfs_reflink_reserve_cow_page().
+ */
+enum {
+	BH_Cow = BH_PrivateStart,
+};
+
+BUFFER_FNS(Cow, cow)
+TAS_BUFFER_FNS(Cow, cow)
 
 /*
  * xfs_ioend struct manages large extent writes for XFS.
@@ -56,6 +70,8 @@ typedef struct xfs_ioend {
 	struct xfs_trans	*io_append_trans;/* xact. for size update */
 	struct kiocb		*io_iocb;
 	int			io_result;
+	xfs_fsblock_t		io_cow_startblock;/* staging extent for cow */
+	xfs_extlen_t		io_cow_blockcount;
 } xfs_ioend_t;
 
 extern const struct address_space_operations xfs_address_space_operations;
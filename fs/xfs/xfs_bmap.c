@@ -29,6 +29,7 @@
 #include "xfs_bmap_btree.h"
 #include "xfs_alloc_btree.h"
 #include "xfs_ialloc_btree.h"
+#include "xfs_refcount_btree.h"
 #include "xfs_dinode.h"
 #include "xfs_inode.h"
 #include "xfs_btree.h"
@@ -37,6 +38,7 @@
 #include "xfs_inode_item.h"
 #include "xfs_extfree_item.h"
 #include "xfs_alloc.h"
+#include "xfs_refcount.h"
 #include "xfs_bmap.h"
 #include "xfs_rtalloc.h"
 #include "xfs_error.h"
@@ -3677,12 +3679,25 @@ xfs_bmap_finish(
 	xfs_mount_t		*mp;		/* filesystem mount structure */
 	xfs_bmap_free_item_t	*next;		/* next item on free list */
 	xfs_trans_t		*ntp;		/* new transaction pointer */
+	xfs_bmap_free_t		rest;		/* extents left for next round */
+	xfs_fsblock_t		firstfsb;	/* unused */
+	xfs_extlen_t		done;		/* blocks dealt with */
 
 	ASSERT((*tp)->t_flags & XFS_TRANS_PERM_LOG_RES);
 	if (flist->xbf_count == 0) {
 		*committed = 0;
 		return 0;
 	}
+	mp = (*tp)->t_mountp;
+
+	/*
+	 * With reflink each extent free only drops a reference to as many
+	 * blocks as one refcount btree record covers, so that it fits the
+	 * reservation.  Whatever is left of an extent is logged in a new
+	 * EFI, in the same transaction as the EFD for the old one, and
+	 * processed in another round.
+	 */
+next_round:
 	ntp = *tp;
 	efi = xfs_trans_get_efi(ntp, flist->xbf_count);
 	for (free = flist->xbf_first; free; free = free->xbfi_next)
@@ -3710,11 +3725,12 @@ xfs_bmap_finish(
 	if ((error = xfs_trans_reserve(ntp, 0, logres, 0, XFS_TRANS_PERM_LOG_RES,
 			logcount)))
 		return error;
+	xfs_bmap_init(&rest, &firstfsb);
 	efd = xfs_trans_get_efd(ntp, efi, flist->xbf_count);
 	for (free = flist->xbf_first; free != NULL; free = next) {
 		next = free->xbfi_next;
-		if ((error = xfs_free_extent(ntp, free->xbfi_startblock,
-				free->xbfi_blockcount))) {
+		if ((error = xfs_refcount_free_extent(ntp, free->xbfi_startblock,
+				free->xbfi_blockcount, &done))) {
 			/*
 			 * The bmap free list will be cleaned up at a
 			 * higher level.  The EFI will be canceled when
@@ -3723,7 +3739,7 @@ xfs_bmap_finish(
 			 * happens, since this transaction may not be
 			 * dirty yet.
 			 */
-			mp = ntp->t_mountp;
+			xfs_bmap_cancel(&rest);
 			if (!XFS_FORCED_SHUTDOWN(mp))
 				xfs_force_shutdown(mp,
 						   (error == EFSCORRUPTED) ?
@@ -3733,8 +3749,19 @@ xfs_bmap_finish(
 		}
 		xfs_trans_log_efd_extent(ntp, efd, free->xbfi_startblock,
 			free->xbfi_blockcount);
+		if (done < free->xbfi_blockcount)
+			xfs_bmap_add_free(free->xbfi_startblock + done,
+					  free->xbfi_blockcount - done,
+					  &rest, mp);
 		xfs_bmap_del_free(flist, NULL, free);
 	}
+
+	if (rest.xbf_count) {
+		ASSERT(flist->xbf_count == 0);
+		flist->xbf_first = rest.xbf_first;
+		flist->xbf_count = rest.xbf_count;
+		goto next_round;
+	}
 	return 0;
 }
 
@@ -5031,6 +5058,83 @@ error0:
 	return error;
 }
 
+/*
+ * Map blocks that are already in use into a hole of the data fork, for
+ * sharing them between files.  The caller has to account for the extra
+ * owner of the blocks in the refcount btree.
+ */
+int						/* error */
+xfs_bmap_remap_extent(
+	struct xfs_trans	*tp,		/* transaction pointer */
+	struct xfs_inode	*ip,		/* incore inode */
+	struct xfs_bmbt_irec	*irec,		/* mapping to add */
+	xfs_fsblock_t		*firstblock,	/* first allocated block
+						   controls a.g. for allocs */
+	struct xfs_bmap_free	*flist)		/* i/o: list extents to free */
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_ifork	*ifp = XFS_IFORK_PTR(ip, XFS_DATA_FORK);
+	struct xfs_bmalloca	bma = { 0 };
+	int			eof;
+	int			error;
+
+	ASSERT(xfs_isilocked(ip, XFS_ILOCK_EXCL));
+	ASSERT(irec->br_blockcount > 0 && irec->br_blockcount <= MAXEXTLEN);
+	ASSERT(!isnullstartblock(irec->br_startblock));
+	ASSERT(!XFS_IS_REALTIME_INODE(ip));
+
+	if (XFS_FORCED_SHUTDOWN(mp))
+		return XFS_ERROR(EIO);
+
+	if (!(ifp->if_flags & XFS_IFEXTENTS)) {
+		error = xfs_iread_extents(tp, ip, XFS_DATA_FORK);
+		if (error)
+			return error;
+	}
+
+	xfs_bmap_search_extents(ip, irec->br_startoff, XFS_DATA_FORK, &eof,
+				&bma.idx, &bma.got, &bma.prev);
+	if (!eof &&
+	    bma.got.br_startoff < irec->br_startoff + irec->br_blockcount)
+		return XFS_ERROR(EINVAL);
+
+	bma.tp = tp;
+	bma.ip = ip;
+	bma.flist = flist;
+	bma.firstblock = firstblock;
+	bma.got = *irec;
+	if (ifp->if_flags & XFS_IFBROOT) {
+		bma.cur = xfs_bmbt_init_cursor(mp, tp, ip, XFS_DATA_FORK);
+		bma.cur->bc_private.b.firstblock = *firstblock;
+		bma.cur->bc_private.b.flist = flist;
+	}
+
+	error = xfs_bmap_add_extent_hole_real(&bma, XFS_DATA_FORK);
+	if (!error) {
+		ip->i_d.di_nblocks += irec->br_blockcount;
+		xfs_trans_mod_dquot_byino(tp, ip, XFS_TRANS_DQ_BCOUNT,
+					  irec->br_blockcount);
+		bma.logflags |= XFS_ILOG_CORE;
+	}
+
+	if ((bma.logflags & XFS_ILOG_DEXT) &&
+	    XFS_IFORK_FORMAT(ip, XFS_DATA_FORK) != XFS_DINODE_FMT_EXTENTS)
+		bma.logflags &= ~XFS_ILOG_DEXT;
+	else if ((bma.logflags & XFS_ILOG_DBROOT) &&
+		 XFS_IFORK_FORMAT(ip, XFS_DATA_FORK) != XFS_DINODE_FMT_BTREE)
+		bma.logflags &= ~XFS_ILOG_DBROOT;
+	if (bma.logflags)
+		xfs_trans_log_inode(tp, ip, bma.logflags);
+
+	if (bma.cur) {
+		if (!error)
+			*firstblock = bma.cur->bc_private.b.firstblock;
+		xfs_btree_del_cursor(bma.cur,
+			error ? XFS_BTREE_ERROR : XFS_BTREE_NOERROR);
+	}
+	return error;
+}
+
 /*
  * Unmap (remove) blocks from a file.
  * If nexts is nonzero then the number of extents to remove is limited to
@@ -6181,3 +6285,333 @@ xfs_fsb_to_db(struct xfs_inode *ip, xfs_fsblock_t fsb)
 		 (xfs_daddr_t)XFS_FSB_TO_BB((ip)->i_mount, (fsb)) : \
 		 XFS_FSB_TO_DADDR((ip)->i_mount, (fsb)));
 }
+
+/*
+ * Shift extent records of the data fork by @offset_shift_fsb blocks, to the
+ * left to close the hole in front of them for collapse range, or to the
+ * right to open up a hole for insert range.
+ *
+ * Extents are shifted starting at *@next_fsb, from there up to the last
+ * extent for a left shift, and from the last extent (*@next_fsb is
+ * NULLFILEOFF on the first call) down to the one at @stop_fsb for a right
+ * shift.  At most @num_exts extents are shifted in one call, *@next_fsb is
+ * updated to where the next call has to continue and *@done is set once
+ * all extents have been shifted.
+ *
+ * A left shifted extent is merged with its left neighbour when they end up
+ * contiguous.  There must not be any delayed allocation extents in the
+ * range being shifted.
+ */
+int
+xfs_bmap_shift_extents(
+	struct xfs_trans	*tp,
+	struct xfs_inode	*ip,
+	xfs_fileoff_t		*next_fsb,
+	xfs_fileoff_t		offset_shift_fsb,
+	int			*done,
+	xfs_fileoff_t		stop_fsb,
+	int			shift_right,
+	xfs_fsblock_t		*firstblock,
+	struct xfs_bmap_free	*flist,
+	int			num_exts)
+{
+	struct xfs_btree_cur		*cur = NULL;
+	struct xfs_bmbt_rec_host	*gotp;
+	struct xfs_bmbt_irec		got;
+	struct xfs_bmbt_irec		left;
+	struct xfs_mount		*mp = ip->i_mount;
+	struct xfs_ifork		*ifp;
+	xfs_extnum_t			current_ext;
+	xfs_extnum_t			total_extents;
+	xfs_fileoff_t			startoff;
+	xfs_filblks_t			blockcount;
+	int				whichfork = XFS_DATA_FORK;
+	int				logflags;
+	int				error = 0;
+	int				i;
+
+	if (unlikely(XFS_TEST_ERROR(
+	    (XFS_IFORK_FORMAT(ip, whichfork) != XFS_DINODE_FMT_EXTENTS &&
+	     XFS_IFORK_FORMAT(ip, whichfork) != XFS_DINODE_FMT_BTREE),
+	     mp, XFS_ERRTAG_BMAPIFORMAT, XFS_RANDOM_BMAPIFORMAT))) {
+		XFS_ERROR_REPORT("xfs_bmap_shift_extents",
+				 XFS_ERRLEVEL_LOW, mp);
+		return XFS_ERROR(EFSCORRUPTED);
+	}
+
+	if (XFS_FORCED_SHUTDOWN(mp))
+		return XFS_ERROR(EIO);
+
+	ASSERT(xfs_isilocked(ip, XFS_IOLOCK_EXCL));
+	ASSERT(xfs_isilocked(ip, XFS_ILOCK_EXCL));
+
+	ifp = XFS_IFORK_PTR(ip, whichfork);
+	if (!(ifp->if_flags & XFS_IFEXTENTS)) {
+		/* Read in all the extents */
+		error = xfs_iread_extents(tp, ip, whichfork);
+		if (error)
+			return error;
+	}
+
+	total_extents = ifp->if_bytes / sizeof(xfs_bmbt_rec_t);
+	if (*next_fsb == NULLFILEOFF) {
+		ASSERT(shift_right);
+		if (!total_extents) {
+			*done = 1;
+			return 0;
+		}
+		current_ext = total_extents - 1;
+		gotp = xfs_iext_get_ext(ifp, current_ext);
+	} else {
+		gotp = xfs_iext_bno_to_ext(ifp, *next_fsb, &current_ext);
+	}
+	/* no extents at or beyond the shift range, we are done */
+	if (!gotp || (shift_right &&
+		      xfs_bmbt_get_startoff(gotp) < stop_fsb)) {
+		*done = 1;
+		return 0;
+	}
+
+	logflags = XFS_ILOG_CORE;
+	if (ifp->if_flags & XFS_IFBROOT) {
+		cur = xfs_bmbt_init_cursor(mp, tp, ip, whichfork);
+		cur->bc_private.b.firstblock = *firstblock;
+		cur->bc_private.b.flist = flist;
+		cur->bc_private.b.flags = 0;
+	} else {
+		logflags |= XFS_ILOG_DEXT;
+	}
+
+	while (num_exts-- > 0) {
+		gotp = xfs_iext_get_ext(ifp, current_ext);
+		xfs_bmbt_get_all(gotp, &got);
+		ASSERT(!isnullstartblock(got.br_startblock));
+
+		if (shift_right) {
+			startoff = got.br_startoff + offset_shift_fsb;
+		} else {
+			/*
+			 * Make sure the hole in front of the extent is large
+			 * enough to take the shift.
+			 */
+			if (current_ext) {
+				xfs_bmbt_get_all(xfs_iext_get_ext(ifp,
+						current_ext - 1), &left);
+				if (got.br_startoff - offset_shift_fsb <
+				    left.br_startoff + left.br_blockcount)
+					error = XFS_ERROR(EINVAL);
+			} else if (offset_shift_fsb > got.br_startoff) {
+				error = XFS_ERROR(EINVAL);
+			}
+			if (error)
+				goto del_cursor;
+			startoff = got.br_startoff - offset_shift_fsb;
+		}
+
+		if (cur) {
+			error = xfs_bmbt_lookup_eq(cur, got.br_startoff,
+						   got.br_startblock,
+						   got.br_blockcount, &i);
+			if (error)
+				goto del_cursor;
+			XFS_WANT_CORRUPTED_GOTO(i == 1, del_cursor);
+		}
+
+		if (!shift_right && current_ext &&
+		    !isnullstartblock(left.br_startblock) &&
+		    left.br_startoff + left.br_blockcount == startoff &&
+		    left.br_startblock + left.br_blockcount ==
+				got.br_startblock &&
+		    left.br_state == got.br_state &&
+		    left.br_blockcount + got.br_blockcount <= MAXEXTLEN) {
+			/* merge into the left neighbour */
+			blockcount = left.br_blockcount + got.br_blockcount;
+			xfs_iext_remove(ip, current_ext, 1, 0);
+			XFS_IFORK_NEXT_SET(ip, whichfork,
+				XFS_IFORK_NEXTENTS(ip, whichfork) - 1);
+			if (cur) {
+				error = xfs_btree_delete(cur, &i);
+				if (error)
+					goto del_cursor;
+				XFS_WANT_CORRUPTED_GOTO(i == 1, del_cursor);
+				error = xfs_bmbt_lookup_eq(cur,
+						left.br_startoff,
+						left.br_startblock,
+						left.br_blockcount, &i);
+				if (error)
+					goto del_cursor;
+				XFS_WANT_CORRUPTED_GOTO(i == 1, del_cursor);
+				error = xfs_bmbt_update(cur, left.br_startoff,
+						left.br_startblock, blockcount,
+						left.br_state);
+				if (error)
+					goto del_cursor;
+			}
+			xfs_bmbt_set_blockcount(xfs_iext_get_ext(ifp,
+						current_ext - 1), blockcount);
+			total_extents--;
+		} else {
+			xfs_bmbt_set_startoff(gotp, startoff);
+			if (cur) {
+				error = xfs_bmbt_update(cur, startoff,
+						got.br_startblock,
+						got.br_blockcount,
+						got.br_state);
+				if (error)
+					goto del_cursor;
+			}
+			if (!shift_right)
+				current_ext++;
+		}
+
+		if (shift_right) {
+			if (!current_ext) {
+				*done = 1;
+				break;
+			}
+			current_ext--;
+			if (xfs_bmbt_get_startoff(xfs_iext_get_ext(ifp,
+						current_ext)) < stop_fsb) {
+				*done = 1;
+				break;
+			}
+		} else if (current_ext >= total_extents) {
+			*done = 1;
+			break;
+		}
+	}
+
+	if (!*done)
+		*next_fsb = xfs_bmbt_get_startoff(xfs_iext_get_ext(ifp,
+							current_ext));
+
+del_cursor:
+	if (cur)
+		xfs_btree_del_cursor(cur,
+			error ? XFS_BTREE_ERROR : XFS_BTREE_NOERROR);
+	xfs_trans_log_inode(tp, ip, logflags);
+	return error;
+}
+
+/*
+ * Split the data fork extent containing @split_fsb in two, so that an
+ * extent starts at @split_fsb.  Nothing is done if @split_fsb is in a hole
+ * or at the start of an extent already.
+ */
+int
+xfs_bmap_split_extent_at(
+	struct xfs_trans	*tp,
+	struct xfs_inode	*ip,
+	xfs_fileoff_t		split_fsb,
+	xfs_fsblock_t		*firstfsb,
+	struct xfs_bmap_free	*flist)
+{
+	struct xfs_btree_cur		*cur = NULL;
+	struct xfs_bmbt_rec_host	*gotp;
+	struct xfs_bmbt_irec		got;
+	struct xfs_bmbt_irec		new;
+	struct xfs_mount		*mp = ip->i_mount;
+	struct xfs_ifork		*ifp;
+	xfs_extnum_t			current_ext;
+	xfs_filblks_t			gotblkcnt;
+	int				whichfork = XFS_DATA_FORK;
+	int				logflags;
+	int				error = 0;
+	int				i;
+
+	if (unlikely(XFS_TEST_ERROR(
+	    (XFS_IFORK_FORMAT(ip, whichfork) != XFS_DINODE_FMT_EXTENTS &&
+	     XFS_IFORK_FORMAT(ip, whichfork) != XFS_DINODE_FMT_BTREE),
+	     mp, XFS_ERRTAG_BMAPIFORMAT, XFS_RANDOM_BMAPIFORMAT))) {
+		XFS_ERROR_REPORT("xfs_bmap_split_extent_at",
+				 XFS_ERRLEVEL_LOW, mp);
+		return XFS_ERROR(EFSCORRUPTED);
+	}
+
+	if (XFS_FORCED_SHUTDOWN(mp))
+		return XFS_ERROR(EIO);
+
+	ifp = XFS_IFORK_PTR(ip, whichfork);
+	if (!(ifp->if_flags & XFS_IFEXTENTS)) {
+		/* Read in all the extents */
+		error = xfs_iread_extents(tp, ip, whichfork);
+		if (error)
+			return error;
+	}
+
+	gotp = xfs_iext_bno_to_ext(ifp, split_fsb, &current_ext);
+	if (!gotp)
+		return 0;
+	xfs_bmbt_get_all(gotp, &got);
+	if (got.br_startoff >= split_fsb)
+		return 0;
+	ASSERT(!isnullstartblock(got.br_startblock));
+
+	gotblkcnt = split_fsb - got.br_startoff;
+	new.br_startoff = split_fsb;
+	new.br_startblock = got.br_startblock + gotblkcnt;
+	new.br_blockcount = got.br_blockcount - gotblkcnt;
+	new.br_state = got.br_state;
+
+	logflags = XFS_ILOG_CORE;
+	if (ifp->if_flags & XFS_IFBROOT) {
+		cur = xfs_bmbt_init_cursor(mp, tp, ip, whichfork);
+		cur->bc_private.b.firstblock = *firstfsb;
+		cur->bc_private.b.flist = flist;
+		cur->bc_private.b.flags = 0;
+		error = xfs_bmbt_lookup_eq(cur, got.br_startoff,
+					   got.br_startblock,
+					   got.br_blockcount, &i);
+		if (error)
+			goto del_cursor;
+		XFS_WANT_CORRUPTED_GOTO(i == 1, del_cursor);
+	} else {
+		logflags |= XFS_ILOG_DEXT;
+	}
+
+	xfs_bmbt_set_blockcount(gotp, gotblkcnt);
+	if (cur) {
+		error = xfs_bmbt_update(cur, got.br_startoff,
+					got.br_startblock, gotblkcnt,
+					got.br_state);
+		if (error)
+			goto del_cursor;
+	}
+
+	xfs_iext_insert(ip, current_ext + 1, 1, &new, 0);
+	XFS_IFORK_NEXT_SET(ip, whichfork,
+			   XFS_IFORK_NEXTENTS(ip, whichfork) + 1);
+
+	if (cur) {
+		error = xfs_bmbt_lookup_eq(cur, new.br_startoff,
+					   new.br_startblock,
+					   new.br_blockcount, &i);
+		if (error)
+			goto del_cursor;
+		XFS_WANT_CORRUPTED_GOTO(i == 0, del_cursor);
+		cur->bc_rec.b.br_state = new.br_state;
+		error = xfs_btree_insert(cur, &i);
+		if (error)
+			goto del_cursor;
+		XFS_WANT_CORRUPTED_GOTO(i == 1, del_cursor);
+	}
+
+	if (xfs_bmap_needs_btree(ip, whichfork)) {
+		int	tmp_logflags;
+
+		ASSERT(cur == NULL);
+		error = xfs_bmap_extents_to_btree(tp, ip, firstfsb, flist,
+						  &cur, 0, &tmp_logflags,
+						  whichfork);
+		logflags |= tmp_logflags;
+	}
+
+del_cursor:
+	if (cur) {
+		cur->bc_private.b.allocated = 0;
+		xfs_btree_del_cursor(cur,
+			error ? XFS_BTREE_ERROR : XFS_BTREE_NOERROR);
+	}
+	xfs_trans_log_inode(tp, ip, logflags);
+	return error;
+}
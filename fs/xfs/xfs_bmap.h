@@ -60,6 +60,7 @@ typedef	struct xfs_bmap_free
 } xfs_bmap_free_t;
 
 #define	XFS_BMAP_MAX_NMAP	4
+#define	XFS_BMAP_MAX_SHIFT_EXTENTS	1
 
 /*
  * Flags for xfs_bmapi_*
@@ -189,6 +190,9 @@ int	xfs_bmapi_write(struct xfs_trans *tp, struct xfs_inode *ip,
 		xfs_fsblock_t *firstblock, xfs_extlen_t total,
 		struct xfs_bmbt_irec *mval, int *nmap,
 		struct xfs_bmap_free *flist);
+int	xfs_bmap_remap_extent(struct xfs_trans *tp, struct xfs_inode *ip,
+		struct xfs_bmbt_irec *irec, xfs_fsblock_t *firstblock,
+		struct xfs_bmap_free *flist);
 int	xfs_bunmapi(struct xfs_trans *tp, struct xfs_inode *ip,
 		xfs_fileoff_t bno, xfs_filblks_t len, int flags,
 		xfs_extnum_t nexts, xfs_fsblock_t *firstblock,
@@ -211,6 +215,14 @@ int	xfs_bmap_count_blocks(struct xfs_trans *tp, struct xfs_inode *ip,
 		int whichfork, int *count);
 int	xfs_bmap_punch_delalloc_range(struct xfs_inode *ip,
 		xfs_fileoff_t start_fsb, xfs_fileoff_t length);
+int	xfs_bmap_shift_extents(struct xfs_trans *tp, struct xfs_inode *ip,
+		xfs_fileoff_t *next_fsb, xfs_fileoff_t offset_shift_fsb,
+		int *done, xfs_fileoff_t stop_fsb, int shift_right,
+		xfs_fsblock_t *firstblock, struct xfs_bmap_free *flist,
+		int num_exts);
+int	xfs_bmap_split_extent_at(struct xfs_trans *tp, struct xfs_inode *ip,
+		xfs_fileoff_t split_fsb, xfs_fsblock_t *firstfsb,
+		struct xfs_bmap_free *flist);
 
 xfs_daddr_t xfs_fsb_to_db(struct xfs_inode *ip, xfs_fsblock_t fsb);
 
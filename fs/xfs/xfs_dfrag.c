@@ -383,6 +383,12 @@ xfs_swap_extents(
 	tip->i_delayed_blks = ip->i_delayed_blks;
 	ip->i_delayed_blks = 0;
 
+	/* shared blocks may have moved either way */
+	if (XFS_IS_REFLINK_INODE(ip) || XFS_IS_REFLINK_INODE(tip)) {
+		ip->i_d.di_flags |= XFS_DIFLAG_REFLINK;
+		tip->i_d.di_flags |= XFS_DIFLAG_REFLINK;
+	}
+
 	src_log_flags = XFS_ILOG_CORE;
 	switch (ip->i_d.di_format) {
 	case XFS_DINODE_FMT_EXTENTS:
@@ -25,6 +25,7 @@
 #include "xfs_alloc_btree.h"
 #include "xfs_bmap_btree.h"
 #include "xfs_ialloc_btree.h"
+#include "xfs_refcount_btree.h"
 #include "xfs_btree.h"
 #include "xfs_inode.h"
 #include "xfs_alloc.h"
@@ -32,6 +32,7 @@
 #include "xfs_vnodeops.h"
 #include "xfs_da_btree.h"
 #include "xfs_ioctl.h"
+#include "xfs_reflink.h"
 #include "xfs_trace.h"
 
 #include <linux/dcache.h>
@@ -83,7 +84,7 @@ xfs_rw_ilock_demote(
  *	valid before the operation, it will be read from disk before
  *	being partially zeroed.
  */
-STATIC int
+int
 xfs_iozero(
 	struct xfs_inode	*ip,	/* inode			*/
 	loff_t			pos,	/* offset in file		*/
@@ -777,11 +778,25 @@ xfs_file_aio_write(
 		goto out;
 	}
 
-	if (unlikely(file->f_flags & O_DIRECT))
+	/*
+	 * Shared blocks must not be overwritten in place, writeback takes
+	 * care of copying them.  So direct I/O to a file that may have them
+	 * goes through the page cache, and is on disk before we return.
+	 */
+	if (unlikely(file->f_flags & O_DIRECT) && !XFS_IS_REFLINK_INODE(ip))
 		ret = xfs_file_dio_aio_write(iocb, iovp, nr_segs, pos, ocount);
-	else
+	else {
 		ret = xfs_file_buffered_aio_write(iocb, iovp, nr_segs, pos,
 						  ocount);
+		if (ret > 0 && unlikely(file->f_flags & O_DIRECT)) {
+			int	err;
+
+			err = filemap_write_and_wait_range(mapping,
+					iocb->ki_pos - ret, iocb->ki_pos - 1);
+			if (err)
+				ret = err;
+		}
+	}
 
 	if (ret > 0) {
 		ssize_t err;
@@ -799,6 +814,64 @@ out:
 	return ret;
 }
 
+/*
+ * Collapse or insert a block aligned range, called with the iolock held
+ * exclusively.  The extents are shifted with the file at its larger size:
+ * it is shrunk after collapsing and grown before inserting.
+ */
+STATIC long
+xfs_file_shift_range(
+	struct file	*file,
+	int		mode,
+	loff_t		offset,
+	loff_t		len)
+{
+	struct inode	*inode = file->f_path.dentry->d_inode;
+	struct xfs_inode *ip = XFS_I(inode);
+	struct xfs_mount *mp = ip->i_mount;
+	unsigned	blksize_mask = (1 << inode->i_blkbits) - 1;
+	loff_t		isize = i_size_read(inode);
+	struct iattr	iattr;
+	long		error;
+
+	if (XFS_IS_REALTIME_INODE(ip))
+		return -EOPNOTSUPP;
+	if ((offset | len) & blksize_mask)
+		return -EINVAL;
+
+	iattr.ia_valid = ATTR_SIZE;
+	if (mode & FALLOC_FL_COLLAPSE_RANGE) {
+		/* collapsing a range up to or beyond EOF is a truncate */
+		if (offset + len >= isize)
+			return -EINVAL;
+
+		error = -xfs_collapse_file_space(ip, offset, len,
+						 XFS_ATTR_NOLOCK);
+		if (error)
+			return error;
+
+		iattr.ia_size = isize - len;
+		error = -xfs_setattr_size(ip, &iattr, XFS_ATTR_NOLOCK);
+	} else {
+		if (offset >= isize)
+			return -EINVAL;
+		error = inode_newsize_ok(inode, isize + len);
+		if (error)
+			return error;
+
+		iattr.ia_size = isize + len;
+		error = -xfs_setattr_size(ip, &iattr, XFS_ATTR_NOLOCK);
+		if (error)
+			return error;
+
+		error = -xfs_insert_file_space(ip, offset, len);
+	}
+
+	if (!error && (file->f_flags & O_DSYNC))
+		xfs_log_force(mp, XFS_LOG_SYNC);
+	return error;
+}
+
 STATIC long
 xfs_file_fallocate(
 	struct file	*file,
@@ -814,7 +887,9 @@ xfs_file_fallocate(
 	int		cmd = XFS_IOC_RESVSP;
 	int		attr_flags = XFS_ATTR_NOLOCK;
 
-	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE))
+	if (mode & ~(FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE |
+		     FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_ZERO_RANGE |
+		     FALLOC_FL_INSERT_RANGE))
 		return -EOPNOTSUPP;
 
 	bf.l_whence = 0;
@@ -823,8 +898,15 @@ xfs_file_fallocate(
 
 	xfs_ilock(ip, XFS_IOLOCK_EXCL);
 
+	if (mode & (FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_INSERT_RANGE)) {
+		error = xfs_file_shift_range(file, mode, offset, len);
+		goto out_unlock;
+	}
+
 	if (mode & FALLOC_FL_PUNCH_HOLE)
 		cmd = XFS_IOC_UNRESVSP;
+	else if (mode & FALLOC_FL_ZERO_RANGE)
+		cmd = XFS_IOC_ZERO_RANGE;
 
 	/* check the new inode size is valid before allocating */
 	if (!(mode & FALLOC_FL_KEEP_SIZE) &&
@@ -945,18 +1027,82 @@ xfs_file_mmap(
 	return 0;
 }
 
+/*
+ * Page faults take the mmap lock shared, so that clone can keep them from
+ * instantiating pages over a range whose blocks it is remapping.
+ */
+STATIC int
+xfs_filemap_fault(
+	struct vm_area_struct	*vma,
+	struct vm_fault		*vmf)
+{
+	struct xfs_inode	*ip = XFS_I(vma->vm_file->f_mapping->host);
+	int			ret;
+
+	xfs_ilock(ip, XFS_MMAPLOCK_SHARED);
+	ret = filemap_fault(vma, vmf);
+	xfs_iunlock(ip, XFS_MMAPLOCK_SHARED);
+
+	return ret;
+}
+
 /*
  * mmap()d file has taken write protection fault and is being made
  * writable. We can set the page state up correctly for a writable
  * page, which means we can do correct delalloc accounting (ENOSPC
  * checking!) and unwritten extent mapping.
+ *
+ * This is __block_page_mkwrite() with the mmap lock held, and with the
+ * blocks for copying shared blocks reserved before the page is dirtied.
  */
 STATIC int
 xfs_vm_page_mkwrite(
 	struct vm_area_struct	*vma,
 	struct vm_fault		*vmf)
 {
-	return block_page_mkwrite(vma, vmf, xfs_get_blocks);
+	struct page		*page = vmf->page;
+	struct inode		*inode = vma->vm_file->f_path.dentry->d_inode;
+	struct xfs_inode	*ip = XFS_I(inode);
+	unsigned long		end;
+	loff_t			size;
+	int			ret;
+
+	sb_start_pagefault(inode->i_sb);
+	file_update_time(vma->vm_file);
+	xfs_ilock(ip, XFS_MMAPLOCK_SHARED);
+
+	lock_page(page);
+	size = i_size_read(inode);
+	if (page->mapping != inode->i_mapping || page_offset(page) > size) {
+		/* We overload EFAULT to mean page got truncated */
+		ret = -EFAULT;
+		goto out_unlock_page;
+	}
+
+	/* page is wholly or partially inside EOF */
+	if (((page->index + 1) << PAGE_CACHE_SHIFT) > size)
+		end = size & ~PAGE_CACHE_MASK;
+	else
+		end = PAGE_CACHE_SIZE;
+
+	ret = __block_write_begin(page, 0, end, xfs_get_blocks);
+	if (!ret)
+		ret = -xfs_reflink_reserve_cow_page(ip, page, 0, end);
+	if (!ret)
+		ret = block_commit_write(page, 0, end);
+	if (ret < 0)
+		goto out_unlock_page;
+
+	set_page_dirty(page);
+	wait_on_page_writeback(page);
+	goto out_unlock;
+
+out_unlock_page:
+	unlock_page(page);
+out_unlock:
+	xfs_iunlock(ip, XFS_MMAPLOCK_SHARED);
+	sb_end_pagefault(inode->i_sb);
+	return block_page_mkwrite_return(ret);
 }
 
 STATIC loff_t
@@ -1100,6 +1246,46 @@ xfs_file_llseek(
 	}
 }
 
+STATIC int
+xfs_file_clone_range(
+	struct file	*file_in,
+	loff_t		pos_in,
+	struct file	*file_out,
+	loff_t		pos_out,
+	u64		len)
+{
+	int		error;
+
+	error = xfs_reflink_remap_range(XFS_I(file_in->f_mapping->host), pos_in,
+					XFS_I(file_out->f_mapping->host),
+					pos_out, len, false);
+	return -error;
+}
+
+STATIC ssize_t
+xfs_file_dedupe_range(
+	struct file	*src_file,
+	u64		loff,
+	u64		len,
+	struct file	*dst_file,
+	u64		dst_loff)
+{
+	int		error;
+
+	if (!len)
+		return 0;
+	/* the caller is told how much was done and can come back */
+	if (len > XFS_MAX_DEDUPE_LEN)
+		len = XFS_MAX_DEDUPE_LEN;
+
+	error = xfs_reflink_remap_range(XFS_I(src_file->f_mapping->host), loff,
+					XFS_I(dst_file->f_mapping->host),
+					dst_loff, len, true);
+	if (error)
+		return -error;
+	return len;
+}
+
 const struct file_operations xfs_file_operations = {
 	.llseek		= xfs_file_llseek,
 	.read		= do_sync_read,
@@ -1117,6 +1303,8 @@ const struct file_operations xfs_file_operations = {
 	.release	= xfs_file_release,
 	.fsync		= xfs_file_fsync,
 	.fallocate	= xfs_file_fallocate,
+	.clone_file_range = xfs_file_clone_range,
+	.dedupe_file_range = xfs_file_dedupe_range,
 };
 
 const struct file_operations xfs_dir_file_operations = {
@@ -1132,6 +1320,6 @@ const struct file_operations xfs_dir_file_operations = {
 };
 
 static const struct vm_operations_struct xfs_file_vm_ops = {
-	.fault		= filemap_fault,
+	.fault		= xfs_filemap_fault,
 	.page_mkwrite	= xfs_vm_page_mkwrite,
 };
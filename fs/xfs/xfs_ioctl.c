@@ -846,8 +846,9 @@ xfs_set_diflags(
 {
 	unsigned int		di_flags;
 
-	/* can't set PREALLOC this way, just preserve it */
-	di_flags = (ip->i_d.di_flags & XFS_DIFLAG_PREALLOC);
+	/* can't set PREALLOC or REFLINK this way, just preserve them */
+	di_flags = (ip->i_d.di_flags &
+		    (XFS_DIFLAG_PREALLOC | XFS_DIFLAG_REFLINK));
 	if (xflags & XFS_XFLAG_IMMUTABLE)
 		di_flags |= XFS_DIFLAG_IMMUTABLE;
 	if (xflags & XFS_XFLAG_APPEND)
@@ -53,6 +53,7 @@
 #include <linux/bitops.h>
 #include <linux/major.h>
 #include <linux/pagemap.h>
+#include <linux/buffer_head.h>
 #include <linux/vfs.h>
 #include <linux/seq_file.h>
 #include <linux/init.h>
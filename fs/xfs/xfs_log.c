@@ -1747,7 +1747,11 @@ xlog_print_tic_res(
 	    "GROWFSRT_ALLOC",
 	    "GROWFSRT_ZERO",
 	    "GROWFSRT_FREE",
-	    "SWAPEXT"
+	    "SWAPEXT",
+	    "SB_COUNT",
+	    "CHECKPOINT",
+	    "REFLINK",
+	    "COW"
 	};
 
 	xfs_warn(mp,
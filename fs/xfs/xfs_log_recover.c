@@ -29,11 +29,14 @@
 #include "xfs_bmap_btree.h"
 #include "xfs_alloc_btree.h"
 #include "xfs_ialloc_btree.h"
+#include "xfs_refcount_btree.h"
 #include "xfs_dinode.h"
 #include "xfs_inode.h"
 #include "xfs_inode_item.h"
 #include "xfs_alloc.h"
 #include "xfs_ialloc.h"
+#include "xfs_bmap.h"
+#include "xfs_refcount.h"
 #include "xfs_log_priv.h"
 #include "xfs_buf_item.h"
 #include "xfs_log_recover.h"
@@ -2925,6 +2928,10 @@ xlog_recover_process_efi(
 	int			error = 0;
 	xfs_extent_t		*extp;
 	xfs_fsblock_t		startblock_fsb;
+	xfs_bmap_free_t		flist;
+	xfs_fsblock_t		firstfsb;
+	xfs_extlen_t		done;
+	int			committed;
 
 	ASSERT(!test_bit(XFS_EFI_RECOVERED, &efip->efi_flags));
 
@@ -2951,26 +2958,42 @@ xlog_recover_process_efi(
 	}
 
 	tp = xfs_trans_alloc(mp, 0);
-	error = xfs_trans_reserve(tp, 0, XFS_ITRUNCATE_LOG_RES(mp), 0, 0, 0);
-	if (error)
-		goto abort_error;
+	error = xfs_trans_reserve(tp, 0, XFS_ITRUNCATE_LOG_RES(mp), 0,
+				  XFS_TRANS_PERM_LOG_RES,
+				  XFS_ITRUNCATE_LOG_COUNT);
+	if (error) {
+		xfs_trans_cancel(tp, 0);
+		return error;
+	}
+	xfs_bmap_init(&flist, &firstfsb);
 	efdp = xfs_trans_get_efd(tp, efip, efip->efi_format.efi_nextents);
 
+	/*
+	 * Shared extents may only be dropped partially, the rest is freed
+	 * through new EFIs by xfs_bmap_finish().
+	 */
 	for (i = 0; i < efip->efi_format.efi_nextents; i++) {
 		extp = &(efip->efi_format.efi_extents[i]);
-		error = xfs_free_extent(tp, extp->ext_start, extp->ext_len);
+		error = xfs_refcount_free_extent(tp, extp->ext_start,
+						 extp->ext_len, &done);
 		if (error)
 			goto abort_error;
 		xfs_trans_log_efd_extent(tp, efdp, extp->ext_start,
 					 extp->ext_len);
+		if (done < extp->ext_len)
+			xfs_bmap_add_free(extp->ext_start + done,
+					  extp->ext_len - done, &flist, mp);
 	}
 
 	set_bit(XFS_EFI_RECOVERED, &efip->efi_flags);
-	error = xfs_trans_commit(tp, 0);
-	return error;
+	error = xfs_bmap_finish(&tp, &flist, &committed);
+	if (error)
+		goto abort_error;
+	return xfs_trans_commit(tp, XFS_TRANS_RELEASE_LOG_RES);
 
 abort_error:
-	xfs_trans_cancel(tp, XFS_TRANS_ABORT);
+	xfs_bmap_cancel(&flist);
+	xfs_trans_cancel(tp, XFS_TRANS_RELEASE_LOG_RES | XFS_TRANS_ABORT);
 	return error;
 }
 
@@ -2990,7 +3013,9 @@ abort_error:
  * the AIL.  As we process them, however, other items are added
  * to the AIL.  Since everything added to the AIL must come after
  * everything already in the AIL, we stop processing as soon as
- * we see something other than an EFI in the AIL.
+ * we see something other than an EFI in the AIL.  Freeing shared
+ * extents logs new EFIs of its own, those come after the log head
+ * we started with and are finished by the time we see them.
  */
 STATIC int
 xlog_recover_process_efis(
@@ -3001,11 +3026,16 @@ xlog_recover_process_efis(
 	int			error = 0;
 	struct xfs_ail_cursor	cur;
 	struct xfs_ail		*ailp;
+	xfs_lsn_t		last_lsn;
 
+	last_lsn = xlog_assign_lsn(log->l_curr_cycle, log->l_curr_block);
 	ailp = log->l_ailp;
 	spin_lock(&ailp->xa_lock);
 	lip = xfs_trans_ail_cursor_first(ailp, &cur, 0);
 	while (lip != NULL) {
+		if (XFS_LSN_CMP(lip->li_lsn, last_lsn) >= 0)
+			break;
+
 		/*
 		 * We're done when we see something other than an EFI.
 		 * There should be no EFIs left in the AIL now.
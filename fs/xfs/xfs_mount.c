@@ -30,11 +30,13 @@
 #include "xfs_bmap_btree.h"
 #include "xfs_alloc_btree.h"
 #include "xfs_ialloc_btree.h"
+#include "xfs_refcount_btree.h"
 #include "xfs_dinode.h"
 #include "xfs_inode.h"
 #include "xfs_btree.h"
 #include "xfs_ialloc.h"
 #include "xfs_alloc.h"
+#include "xfs_refcount.h"
 #include "xfs_rtalloc.h"
 #include "xfs_bmap.h"
 #include "xfs_error.h"
@@ -769,6 +771,11 @@ xfs_mount_common(xfs_mount_t *mp, xfs_sb_t *sbp)
 	mp->m_inobt_mnr[0] = mp->m_inobt_mxr[0] / 2;
 	mp->m_inobt_mnr[1] = mp->m_inobt_mxr[1] / 2;
 
+	mp->m_refc_mxr[0] = xfs_refcountbt_maxrecs(mp, sbp->sb_blocksize, 1);
+	mp->m_refc_mxr[1] = xfs_refcountbt_maxrecs(mp, sbp->sb_blocksize, 0);
+	mp->m_refc_mnr[0] = mp->m_refc_mxr[0] / 2;
+	mp->m_refc_mnr[1] = mp->m_refc_mxr[1] / 2;
+
 	mp->m_bmap_dmxr[0] = xfs_bmbt_maxrecs(mp, sbp->sb_blocksize, 1);
 	mp->m_bmap_dmxr[1] = xfs_bmbt_maxrecs(mp, sbp->sb_blocksize, 0);
 	mp->m_bmap_dmnr[0] = mp->m_bmap_dmxr[0] / 2;
@@ -1183,6 +1190,23 @@ xfs_mountfs(
 			mp->m_update_flags |= XFS_SB_VERSIONNUM;
 	}
 
+	/*
+	 * The reflink mount option turns the feature on for good: from now
+	 * on the AGFs carry refcount btrees which older kernels don't know
+	 * to update, so the superblock gets the incompatible feature bit.
+	 */
+	if (xfs_sb_version_hasreflink(sbp)) {
+		mp->m_flags |= XFS_MOUNT_REFLINK;
+	} else if ((mp->m_flags & XFS_MOUNT_REFLINK) &&
+		   !(mp->m_flags & XFS_MOUNT_RDONLY)) {
+		xfs_sb_version_addreflink(sbp);
+		sbp->sb_bad_features2 = sbp->sb_features2;
+		mp->m_update_flags |= XFS_SB_VERSIONNUM | XFS_SB_FEATURES2 |
+				      XFS_SB_BAD_FEATURES2;
+	} else {
+		mp->m_flags &= ~XFS_MOUNT_REFLINK;
+	}
+
 	/*
 	 * Check if sb_agblocks is aligned at stripe boundary
 	 * If sb_agblocks is NOT aligned turn off m_dalign since
@@ -1197,6 +1221,7 @@ xfs_mountfs(
 	xfs_bmap_compute_maxlevels(mp, XFS_DATA_FORK);
 	xfs_bmap_compute_maxlevels(mp, XFS_ATTR_FORK);
 	xfs_ialloc_compute_maxlevels(mp);
+	xfs_refcountbt_compute_maxlevels(mp);
 
 	xfs_set_maxicount(mp);
 
@@ -1400,6 +1425,16 @@ xfs_mountfs(
 		goto out_rtunmount;
 	}
 
+	/*
+	 * Free the blocks of copy-on-write operations that were still in
+	 * flight when the file system went down.
+	 */
+	error = xfs_refcount_recover_cow_leftovers(mp);
+	if (error) {
+		xfs_warn(mp, "failed to recover copy-on-write extents");
+		goto out_rtunmount;
+	}
+
 	/*
 	 * Complete the quota initialisation, post-log-replay component.
 	 */
@@ -0,0 +1,710 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write the Free Software Foundation,
+ * Inc.,  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "xfs.h"
+#include "xfs_fs.h"
+#include "xfs_types.h"
+#include "xfs_bit.h"
+#include "xfs_log.h"
+#include "xfs_trans.h"
+#include "xfs_sb.h"
+#include "xfs_ag.h"
+#include "xfs_mount.h"
+#include "xfs_bmap_btree.h"
+#include "xfs_alloc_btree.h"
+#include "xfs_ialloc_btree.h"
+#include "xfs_refcount_btree.h"
+#include "xfs_dinode.h"
+#include "xfs_inode.h"
+#include "xfs_btree.h"
+#include "xfs_alloc.h"
+#include "xfs_extent_busy.h"
+#include "xfs_refcount.h"
+#include "xfs_error.h"
+#include "xfs_trace.h"
+
+
+/*
+ * Lookup the record starting at or before bno.
+ */
+STATIC int
+xfs_refcount_lookup_le(
+	struct xfs_btree_cur	*cur,
+	xfs_agblock_t		bno,
+	int			*stat)
+{
+	cur->bc_rec.rc.rc_startblock = bno;
+	cur->bc_rec.rc.rc_blockcount = 0;
+	return xfs_btree_lookup(cur, XFS_LOOKUP_LE, stat);
+}
+
+/*
+ * Lookup the record starting at or after bno.
+ */
+STATIC int
+xfs_refcount_lookup_ge(
+	struct xfs_btree_cur	*cur,
+	xfs_agblock_t		bno,
+	int			*stat)
+{
+	cur->bc_rec.rc.rc_startblock = bno;
+	cur->bc_rec.rc.rc_blockcount = 0;
+	return xfs_btree_lookup(cur, XFS_LOOKUP_GE, stat);
+}
+
+/*
+ * Get the data from the pointed-to record.
+ */
+STATIC int
+xfs_refcount_get_rec(
+	struct xfs_btree_cur	*cur,
+	struct xfs_refcount_irec *irec,
+	int			*stat)
+{
+	union xfs_btree_rec	*rec;
+	int			error;
+
+	error = xfs_btree_get_rec(cur, &rec, stat);
+	if (!error && *stat == 1) {
+		irec->rc_startblock = be32_to_cpu(rec->refc.rc_startblock);
+		irec->rc_blockcount = be32_to_cpu(rec->refc.rc_blockcount);
+		irec->rc_refcount = be32_to_cpu(rec->refc.rc_refcount);
+	}
+	return error;
+}
+
+/*
+ * Update the record starting at irec->rc_startblock.
+ */
+STATIC int
+xfs_refcount_update(
+	struct xfs_btree_cur	*cur,
+	struct xfs_refcount_irec *irec)
+{
+	union xfs_btree_rec	rec;
+	int			i;
+	int			error;
+
+	cur->bc_rec.rc = *irec;
+	error = xfs_btree_lookup(cur, XFS_LOOKUP_EQ, &i);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(i == 1);
+
+	rec.refc.rc_startblock = cpu_to_be32(irec->rc_startblock);
+	rec.refc.rc_blockcount = cpu_to_be32(irec->rc_blockcount);
+	rec.refc.rc_refcount = cpu_to_be32(irec->rc_refcount);
+	return xfs_btree_update(cur, &rec);
+}
+
+/*
+ * Insert irec, there must not be a record at its start block yet.
+ */
+STATIC int
+xfs_refcount_insert(
+	struct xfs_btree_cur	*cur,
+	struct xfs_refcount_irec *irec)
+{
+	int			i;
+	int			error;
+
+	cur->bc_rec.rc = *irec;
+	error = xfs_btree_lookup(cur, XFS_LOOKUP_EQ, &i);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(i == 0);
+
+	cur->bc_rec.rc = *irec;
+	error = xfs_btree_insert(cur, &i);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(i == 1);
+	return 0;
+}
+
+/*
+ * Delete the record starting at bno.
+ */
+STATIC int
+xfs_refcount_delete(
+	struct xfs_btree_cur	*cur,
+	xfs_agblock_t		bno)
+{
+	int			i;
+	int			error;
+
+	cur->bc_rec.rc.rc_startblock = bno;
+	cur->bc_rec.rc.rc_blockcount = 0;
+	error = xfs_btree_lookup(cur, XFS_LOOKUP_EQ, &i);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(i == 1);
+
+	error = xfs_btree_delete(cur, &i);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(i == 1);
+	return 0;
+}
+
+/*
+ * Lock the AGF of agno and top up its freelist, which is where the refcount
+ * btree gets its blocks from.
+ */
+STATIC int
+xfs_refcount_lock_ag(
+	struct xfs_trans	*tp,
+	xfs_agnumber_t		agno,
+	struct xfs_buf		**agbpp)
+{
+	xfs_alloc_arg_t		args;
+	int			error;
+
+	memset(&args, 0, sizeof(xfs_alloc_arg_t));
+	args.tp = tp;
+	args.mp = tp->t_mountp;
+	args.agno = agno;
+	if (args.agno >= args.mp->m_sb.sb_agcount)
+		return EFSCORRUPTED;
+
+	args.pag = xfs_perag_get(args.mp, args.agno);
+	error = xfs_alloc_fix_freelist(&args, XFS_ALLOC_FLAG_FREEING);
+	xfs_perag_put(args.pag);
+	if (error)
+		return error;
+
+	ASSERT(args.agbp != NULL);
+	*agbpp = args.agbp;
+	return 0;
+}
+
+/*
+ * The refcount btree of an AG is only created once the first extent in it
+ * gets shared, so that file systems that never use reflink keep their AGs
+ * exactly as they are.  The root block comes off the freelist.
+ */
+STATIC int
+xfs_refcount_init_root(
+	struct xfs_trans	*tp,
+	struct xfs_buf		*agbp,
+	xfs_agnumber_t		agno)
+{
+	struct xfs_mount	*mp = tp->t_mountp;
+	struct xfs_agf		*agf = XFS_BUF_TO_AGF(agbp);
+	struct xfs_btree_block	*block;
+	struct xfs_perag	*pag;
+	struct xfs_buf		*bp;
+	xfs_agblock_t		bno;
+	int			error;
+
+	if (agf->agf_refcount_root)
+		return 0;
+
+	error = xfs_alloc_get_freelist(tp, agbp, &bno, 1);
+	if (error)
+		return error;
+	if (bno == NULLAGBLOCK)
+		return XFS_ERROR(ENOSPC);
+
+	xfs_extent_busy_reuse(mp, agno, bno, 1, false);
+	xfs_trans_agbtree_delta(tp, 1);
+
+	bp = xfs_trans_get_buf(tp, mp->m_ddev_targp,
+			       XFS_AGB_TO_DADDR(mp, agno, bno), mp->m_bsize, 0);
+	if (!bp)
+		return XFS_ERROR(ENOMEM);
+
+	block = XFS_BUF_TO_BLOCK(bp);
+	memset(block, 0, XFS_REFCOUNT_BLOCK_LEN(mp));
+	block->bb_magic = cpu_to_be32(XFS_REFC_MAGIC);
+	block->bb_level = 0;
+	block->bb_numrecs = 0;
+	block->bb_u.s.bb_leftsib = cpu_to_be32(NULLAGBLOCK);
+	block->bb_u.s.bb_rightsib = cpu_to_be32(NULLAGBLOCK);
+	xfs_trans_log_buf(tp, bp, 0, XFS_REFCOUNT_BLOCK_LEN(mp) - 1);
+
+	agf->agf_refcount_root = cpu_to_be32(bno);
+	agf->agf_refcount_level = cpu_to_be32(1);
+	pag = xfs_perag_get(mp, agno);
+	pag->pagf_refcount_level = 1;
+	xfs_perag_put(pag);
+	xfs_alloc_log_agf(tp, agbp,
+			  XFS_AGF_REFCOUNT_ROOT | XFS_AGF_REFCOUNT_LEVEL);
+	return 0;
+}
+
+/*
+ * Make sure a record starts at bno if one covers it, by splitting the
+ * record that straddles bno in two.
+ */
+STATIC int
+xfs_refcount_split_extent(
+	struct xfs_btree_cur	*cur,
+	xfs_agblock_t		bno)
+{
+	struct xfs_refcount_irec rcext;
+	struct xfs_refcount_irec tmp;
+	int			found;
+	int			error;
+
+	error = xfs_refcount_lookup_le(cur, bno, &found);
+	if (error || !found)
+		return error;
+	error = xfs_refcount_get_rec(cur, &rcext, &found);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(found == 1);
+
+	if (rcext.rc_startblock == bno ||
+	    rcext.rc_startblock + rcext.rc_blockcount <= bno)
+		return 0;
+
+	tmp = rcext;
+	tmp.rc_blockcount = bno - rcext.rc_startblock;
+	error = xfs_refcount_update(cur, &tmp);
+	if (error)
+		return error;
+
+	tmp.rc_startblock = bno;
+	tmp.rc_blockcount = rcext.rc_startblock + rcext.rc_blockcount - bno;
+	return xfs_refcount_insert(cur, &tmp);
+}
+
+/*
+ * Add adj to the reference count of the first record or gap in
+ * [agbno, agbno + aglen), splitting off whatever lies beyond the range.
+ * *adjusted is set to the number of blocks dealt with.  If a decrement
+ * drops the last reference to them *freelen is set to the same number and
+ * the caller has to free the blocks.
+ */
+STATIC int
+xfs_refcount_adjust(
+	struct xfs_btree_cur	*cur,
+	xfs_agblock_t		agbno,
+	xfs_extlen_t		aglen,
+	int			adj,
+	xfs_extlen_t		*adjusted,
+	xfs_extlen_t		*freelen)
+{
+	struct xfs_refcount_irec rcext;
+	struct xfs_refcount_irec tmp;
+	int			found;
+	int			error;
+
+	ASSERT(adj == 1 || adj == -1);
+	ASSERT(agbno + aglen <= XFS_REFC_COW_START);
+
+	*adjusted = 0;
+	*freelen = 0;
+
+	error = xfs_refcount_split_extent(cur, agbno);
+	if (error)
+		return error;
+
+	error = xfs_refcount_lookup_ge(cur, agbno, &found);
+	if (error)
+		return error;
+	if (found) {
+		error = xfs_refcount_get_rec(cur, &rcext, &found);
+		if (error)
+			return error;
+		XFS_WANT_CORRUPTED_RETURN(found == 1);
+	}
+
+	/*
+	 * A gap in front of the next record has an implied count of one,
+	 * which either goes to two or drops to zero.
+	 */
+	if (!found || rcext.rc_startblock > agbno) {
+		tmp.rc_startblock = agbno;
+		tmp.rc_blockcount = aglen;
+		if (found)
+			tmp.rc_blockcount = min(aglen,
+					rcext.rc_startblock - agbno);
+		*adjusted = tmp.rc_blockcount;
+		if (adj < 0) {
+			*freelen = tmp.rc_blockcount;
+			return 0;
+		}
+		tmp.rc_refcount = 2;
+		return xfs_refcount_insert(cur, &tmp);
+	}
+
+	/* only staging extents have a count of one */
+	XFS_WANT_CORRUPTED_RETURN(rcext.rc_refcount > 1);
+
+	if (rcext.rc_blockcount > aglen) {
+		tmp = rcext;
+		tmp.rc_startblock = agbno + aglen;
+		tmp.rc_blockcount = rcext.rc_blockcount - aglen;
+		rcext.rc_blockcount = aglen;
+		error = xfs_refcount_update(cur, &rcext);
+		if (error)
+			return error;
+		error = xfs_refcount_insert(cur, &tmp);
+		if (error)
+			return error;
+	}
+	*adjusted = rcext.rc_blockcount;
+
+	/* a saturated count has lost track, keep the blocks forever */
+	if (rcext.rc_refcount == XFS_REFC_REFCOUNT_MAX)
+		return 0;
+
+	rcext.rc_refcount += adj;
+	if (rcext.rc_refcount == 1)
+		return xfs_refcount_delete(cur, rcext.rc_startblock);
+	return xfs_refcount_update(cur, &rcext);
+}
+
+/*
+ * Take another reference to the first record or gap of [bno, bno + len).
+ */
+int
+xfs_refcount_increase(
+	struct xfs_trans	*tp,
+	xfs_fsblock_t		bno,
+	xfs_extlen_t		len,
+	xfs_extlen_t		*done)
+{
+	struct xfs_mount	*mp = tp->t_mountp;
+	xfs_agnumber_t		agno = XFS_FSB_TO_AGNO(mp, bno);
+	xfs_agblock_t		agbno = XFS_FSB_TO_AGBNO(mp, bno);
+	struct xfs_btree_cur	*cur;
+	struct xfs_buf		*agbp;
+	xfs_extlen_t		freelen;
+	int			error;
+
+	ASSERT(len != 0);
+	ASSERT(xfs_sb_version_hasreflink(&mp->m_sb));
+
+	error = xfs_refcount_lock_ag(tp, agno, &agbp);
+	if (error)
+		return error;
+	error = xfs_refcount_init_root(tp, agbp, agno);
+	if (error)
+		return error;
+
+	cur = xfs_refcountbt_init_cursor(mp, tp, agbp, agno);
+	error = xfs_refcount_adjust(cur, agbno, len, 1, done, &freelen);
+	xfs_btree_del_cursor(cur, error ? XFS_BTREE_ERROR : XFS_BTREE_NOERROR);
+	ASSERT(error || freelen == 0);
+	return error;
+}
+
+/*
+ * Drop a reference to the first record or gap of [bno, bno + len) and free
+ * the blocks if nobody else uses them.
+ */
+int
+xfs_refcount_free_extent(
+	struct xfs_trans	*tp,
+	xfs_fsblock_t		bno,
+	xfs_extlen_t		len,
+	xfs_extlen_t		*done)
+{
+	struct xfs_mount	*mp = tp->t_mountp;
+	xfs_agnumber_t		agno = XFS_FSB_TO_AGNO(mp, bno);
+	xfs_agblock_t		agbno = XFS_FSB_TO_AGBNO(mp, bno);
+	struct xfs_btree_cur	*cur;
+	struct xfs_buf		*agbp;
+	xfs_extlen_t		freelen;
+	int			error;
+
+	ASSERT(len != 0);
+
+	if (!xfs_sb_version_hasreflink(&mp->m_sb))
+		goto free_all;
+
+	error = xfs_refcount_lock_ag(tp, agno, &agbp);
+	if (error)
+		return error;
+	if (!XFS_BUF_TO_AGF(agbp)->agf_refcount_root)
+		goto free_all;
+	if (agbno >= mp->m_sb.sb_agblocks)
+		return EFSCORRUPTED;
+
+	cur = xfs_refcountbt_init_cursor(mp, tp, agbp, agno);
+	error = xfs_refcount_adjust(cur, agbno, len, -1, done, &freelen);
+	xfs_btree_del_cursor(cur, error ? XFS_BTREE_ERROR : XFS_BTREE_NOERROR);
+	if (error || !freelen)
+		return error;
+	return xfs_free_extent(tp, bno, freelen);
+
+free_all:
+	*done = len;
+	return xfs_free_extent(tp, bno, len);
+}
+
+/*
+ * Find the first shared blocks in [bno, bno + len).  Adjacent shared
+ * records are returned as one range.
+ */
+int
+xfs_refcount_find_shared(
+	struct xfs_mount	*mp,
+	struct xfs_trans	*tp,
+	xfs_fsblock_t		bno,
+	xfs_extlen_t		len,
+	xfs_fsblock_t		*fbno,
+	xfs_extlen_t		*flen)
+{
+	xfs_agnumber_t		agno = XFS_FSB_TO_AGNO(mp, bno);
+	xfs_agblock_t		agbno = XFS_FSB_TO_AGBNO(mp, bno);
+	xfs_agblock_t		end = agbno + len;
+	xfs_agblock_t		fagbno = NULLAGBLOCK;
+	struct xfs_refcount_irec rcext;
+	struct xfs_btree_cur	*cur;
+	struct xfs_buf		*agbp;
+	int			found;
+	int			error;
+
+	*fbno = NULLFSBLOCK;
+	*flen = 0;
+
+	if (!xfs_sb_version_hasreflink(&mp->m_sb))
+		return 0;
+
+	error = xfs_alloc_read_agf(mp, tp, agno, 0, &agbp);
+	if (error)
+		return error;
+	if (!agbp)
+		return XFS_ERROR(EAGAIN);
+	if (!XFS_BUF_TO_AGF(agbp)->agf_refcount_root)
+		goto out_relse;
+
+	cur = xfs_refcountbt_init_cursor(mp, tp, agbp, agno);
+
+	/* start with the record covering agbno, if there is one */
+	error = xfs_refcount_lookup_le(cur, agbno, &found);
+	if (error)
+		goto out_cur;
+	if (found) {
+		error = xfs_refcount_get_rec(cur, &rcext, &found);
+		if (error)
+			goto out_cur;
+		XFS_WANT_CORRUPTED_GOTO(found == 1, out_cur);
+		if (rcext.rc_startblock + rcext.rc_blockcount <= agbno) {
+			error = xfs_btree_increment(cur, 0, &found);
+			if (error)
+				goto out_cur;
+		}
+	} else {
+		error = xfs_refcount_lookup_ge(cur, agbno, &found);
+		if (error)
+			goto out_cur;
+	}
+
+	while (found) {
+		error = xfs_refcount_get_rec(cur, &rcext, &found);
+		if (error)
+			goto out_cur;
+		XFS_WANT_CORRUPTED_GOTO(found == 1, out_cur);
+		if (rcext.rc_startblock >= end)
+			break;
+		if (fagbno != NULLAGBLOCK &&
+		    rcext.rc_startblock != fagbno + *flen)
+			break;
+
+		if (rcext.rc_refcount > 1) {
+			xfs_agblock_t	s = max(rcext.rc_startblock, agbno);
+			xfs_agblock_t	e = min(rcext.rc_startblock +
+						rcext.rc_blockcount, end);
+
+			if (fagbno == NULLAGBLOCK)
+				fagbno = s;
+			*flen = e - fagbno;
+		} else if (fagbno != NULLAGBLOCK) {
+			break;
+		}
+
+		error = xfs_btree_increment(cur, 0, &found);
+		if (error)
+			goto out_cur;
+	}
+
+	if (fagbno != NULLAGBLOCK)
+		*fbno = XFS_AGB_TO_FSB(mp, agno, fagbno);
+out_cur:
+	xfs_btree_del_cursor(cur, error ? XFS_BTREE_ERROR : XFS_BTREE_NOERROR);
+out_relse:
+	xfs_trans_brelse(tp, agbp);
+	return error;
+}
+
+/*
+ * Record the freshly allocated blocks [bno, bno + len) as a staging extent.
+ */
+int
+xfs_refcount_alloc_cow_staging(
+	struct xfs_trans	*tp,
+	xfs_fsblock_t		bno,
+	xfs_extlen_t		len)
+{
+	struct xfs_mount	*mp = tp->t_mountp;
+	xfs_agnumber_t		agno = XFS_FSB_TO_AGNO(mp, bno);
+	struct xfs_refcount_irec rcext;
+	struct xfs_btree_cur	*cur;
+	struct xfs_buf		*agbp;
+	int			error;
+
+	error = xfs_refcount_lock_ag(tp, agno, &agbp);
+	if (error)
+		return error;
+	error = xfs_refcount_init_root(tp, agbp, agno);
+	if (error)
+		return error;
+
+	rcext.rc_startblock = XFS_FSB_TO_AGBNO(mp, bno) | XFS_REFC_COW_START;
+	rcext.rc_blockcount = len;
+	rcext.rc_refcount = 1;
+
+	cur = xfs_refcountbt_init_cursor(mp, tp, agbp, agno);
+	error = xfs_refcount_insert(cur, &rcext);
+	xfs_btree_del_cursor(cur, error ? XFS_BTREE_ERROR : XFS_BTREE_NOERROR);
+	return error;
+}
+
+/*
+ * Forget the staging extent [bno, bno + len), the blocks now either belong
+ * to a file or have been freed in the same transaction.
+ */
+int
+xfs_refcount_remove_cow_staging(
+	struct xfs_trans	*tp,
+	xfs_fsblock_t		bno,
+	xfs_extlen_t		len)
+{
+	struct xfs_mount	*mp = tp->t_mountp;
+	xfs_agnumber_t		agno = XFS_FSB_TO_AGNO(mp, bno);
+	xfs_agblock_t		agbno;
+	struct xfs_refcount_irec rcext;
+	struct xfs_btree_cur	*cur;
+	struct xfs_buf		*agbp;
+	int			found;
+	int			error;
+
+	error = xfs_refcount_lock_ag(tp, agno, &agbp);
+	if (error)
+		return error;
+	XFS_WANT_CORRUPTED_RETURN(XFS_BUF_TO_AGF(agbp)->agf_refcount_root != 0);
+
+	agbno = XFS_FSB_TO_AGBNO(mp, bno) | XFS_REFC_COW_START;
+	cur = xfs_refcountbt_init_cursor(mp, tp, agbp, agno);
+	error = xfs_refcount_lookup_le(cur, agbno, &found);
+	if (error)
+		goto out_cur;
+	XFS_WANT_CORRUPTED_GOTO(found == 1, out_cur);
+	error = xfs_refcount_get_rec(cur, &rcext, &found);
+	if (error)
+		goto out_cur;
+	XFS_WANT_CORRUPTED_GOTO(found == 1 &&
+				rcext.rc_startblock == agbno &&
+				rcext.rc_blockcount == len &&
+				rcext.rc_refcount == 1, out_cur);
+
+	error = xfs_btree_delete(cur, &found);
+	if (error)
+		goto out_cur;
+	XFS_WANT_CORRUPTED_GOTO(found == 1, out_cur);
+out_cur:
+	xfs_btree_del_cursor(cur, error ? XFS_BTREE_ERROR : XFS_BTREE_NOERROR);
+	return error;
+}
+
+/*
+ * Free one staging extent left over in agno.  *found is cleared once there
+ * are none left.
+ */
+STATIC int
+xfs_refcount_recover_one(
+	struct xfs_mount	*mp,
+	xfs_agnumber_t		agno,
+	int			*found)
+{
+	struct xfs_refcount_irec rcext;
+	struct xfs_btree_cur	*cur;
+	struct xfs_trans	*tp;
+	struct xfs_buf		*agbp;
+	int			error;
+
+	tp = xfs_trans_alloc(mp, XFS_TRANS_COW);
+	error = xfs_trans_reserve(tp, 0, XFS_ITRUNCATE_LOG_RES(mp), 0, 0, 0);
+	if (error) {
+		xfs_trans_cancel(tp, 0);
+		return error;
+	}
+
+	*found = 0;
+	error = xfs_refcount_lock_ag(tp, agno, &agbp);
+	if (error)
+		goto out_cancel;
+	if (!XFS_BUF_TO_AGF(agbp)->agf_refcount_root)
+		goto out_commit;
+
+	cur = xfs_refcountbt_init_cursor(mp, tp, agbp, agno);
+	error = xfs_refcount_lookup_ge(cur, XFS_REFC_COW_START, found);
+	if (!error && *found) {
+		error = xfs_refcount_get_rec(cur, &rcext, found);
+		if (!error && rcext.rc_refcount != 1)
+			error = XFS_ERROR(EFSCORRUPTED);
+		if (!error)
+			error = xfs_refcount_delete(cur, rcext.rc_startblock);
+	}
+	xfs_btree_del_cursor(cur, error ? XFS_BTREE_ERROR : XFS_BTREE_NOERROR);
+	if (error)
+		goto out_cancel;
+
+	if (*found) {
+		error = xfs_free_extent(tp, XFS_AGB_TO_FSB(mp, agno,
+				rcext.rc_startblock & ~XFS_REFC_COW_START),
+				rcext.rc_blockcount);
+		if (error)
+			goto out_cancel;
+	}
+
+	/* fixing up the freelist may have dirtied the transaction */
+out_commit:
+	return xfs_trans_commit(tp, 0);
+
+out_cancel:
+	xfs_trans_cancel(tp, XFS_TRANS_ABORT);
+	return error;
+}
+
+/*
+ * Free the staging extents of copy-on-write operations that did not make
+ * it to disk before a crash.  Called at mount time after log recovery.
+ */
+int
+xfs_refcount_recover_cow_leftovers(
+	struct xfs_mount	*mp)
+{
+	xfs_agnumber_t		agno;
+	int			found;
+	int			error;
+
+	if (!xfs_sb_version_hasreflink(&mp->m_sb) ||
+	    (mp->m_flags & XFS_MOUNT_RDONLY))
+		return 0;
+
+	for (agno = 0; agno < mp->m_sb.sb_agcount; agno++) {
+		do {
+			error = xfs_refcount_recover_one(mp, agno, &found);
+			if (error)
+				return error;
+		} while (found);
+	}
+	return 0;
+}
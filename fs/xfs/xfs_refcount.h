@@ -0,0 +1,62 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write the Free Software Foundation,
+ * Inc.,  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __XFS_REFCOUNT_H__
+#define	__XFS_REFCOUNT_H__
+
+struct xfs_mount;
+struct xfs_trans;
+
+/*
+ * Reference counting of shared data extents.
+ *
+ * All of these work on a single AG and at most on one refcount record or
+ * one gap between records per call, so that the btree changes fit into
+ * the log reservation of a single extent free.  The number of blocks that
+ * was dealt with is returned in *done and the caller has to come back for
+ * the rest, usually in a new transaction.
+ */
+
+/*
+ * Take another reference to the blocks [bno, bno + len).
+ */
+int	xfs_refcount_increase(struct xfs_trans *tp, xfs_fsblock_t bno,
+			      xfs_extlen_t len, xfs_extlen_t *done);
+
+/*
+ * Drop a reference to the blocks [bno, bno + len) and free them if that
+ * was the last one.  Without reflink this is just xfs_free_extent().
+ */
+int	xfs_refcount_free_extent(struct xfs_trans *tp, xfs_fsblock_t bno,
+				 xfs_extlen_t len, xfs_extlen_t *done);
+
+/*
+ * Find the first shared part of [bno, bno + len).  *fbno and *flen are
+ * set to it, *flen is zero if none of the blocks are shared.
+ */
+int	xfs_refcount_find_shared(struct xfs_mount *mp, struct xfs_trans *tp,
+				 xfs_fsblock_t bno, xfs_extlen_t len,
+				 xfs_fsblock_t *fbno, xfs_extlen_t *flen);
+
+/*
+ * Copy-on-write staging extents: freshly allocated blocks the new data is
+ * written to before they replace the shared blocks in the file.
+ */
+int	xfs_refcount_alloc_cow_staging(struct xfs_trans *tp,
+				       xfs_fsblock_t bno, xfs_extlen_t len);
+int	xfs_refcount_remove_cow_staging(struct xfs_trans *tp,
+					xfs_fsblock_t bno, xfs_extlen_t len);
+int	xfs_refcount_recover_cow_leftovers(struct xfs_mount *mp);
+
+#endif	/* __XFS_REFCOUNT_H__ */
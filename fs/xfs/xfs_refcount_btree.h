@@ -0,0 +1,97 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write the Free Software Foundation,
+ * Inc.,  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __XFS_REFCOUNT_BTREE_H__
+#define	__XFS_REFCOUNT_BTREE_H__
+
+/*
+ * Reference count btree on-disk structures
+ */
+
+struct xfs_buf;
+struct xfs_btree_cur;
+struct xfs_mount;
+
+/*
+ * There is one reference count btree per AG, rooted in the AGF.  It
+ * records how many files share each extent of the AG that is shared at
+ * all; extents without a record are owned by at most one file.
+ *
+ * A record with a count of one is never needed for sharing, so those are
+ * used to mark the staging extents of copy-on-write operations that are
+ * still in flight.  They are keyed with XFS_REFC_COW_START or'ed into the
+ * start block, which sorts them after all the shared extents.  Any such
+ * record found at mount time is a leftover of a crash and its extent is
+ * freed again.
+ */
+#define	XFS_REFC_MAGIC	0x52454643	/* 'REFC' */
+
+/* AG block numbers never reach this */
+#define	XFS_REFC_COW_START	((xfs_agblock_t)(1U << 31))
+
+/* counts saturate here, the extent is then never freed */
+#define	XFS_REFC_REFCOUNT_MAX	((xfs_nlink_t)~0U)
+
+/*
+ * Data record/key structure
+ */
+typedef struct xfs_refcount_rec {
+	__be32		rc_startblock;	/* starting block number */
+	__be32		rc_blockcount;	/* count of blocks */
+	__be32		rc_refcount;	/* number of owners */
+} xfs_refcount_rec_t;
+
+typedef struct xfs_refcount_key {
+	__be32		rc_startblock;	/* starting block number */
+} xfs_refcount_key_t;
+
+typedef struct xfs_refcount_irec {
+	xfs_agblock_t	rc_startblock;	/* starting block number */
+	xfs_extlen_t	rc_blockcount;	/* count of blocks */
+	xfs_nlink_t	rc_refcount;	/* number of owners */
+} xfs_refcount_irec_t;
+
+/* btree pointer type */
+typedef __be32 xfs_refcount_ptr_t;
+
+#define XFS_REFCOUNT_BLOCK_LEN(mp)	XFS_BTREE_SBLOCK_LEN
+
+/*
+ * Record, key, and pointer address macros for btree blocks.
+ */
+#define XFS_REFCOUNT_REC_ADDR(mp, block, index) \
+	((xfs_refcount_rec_t *) \
+		((char *)(block) + \
+		 XFS_REFCOUNT_BLOCK_LEN(mp) + \
+		 (((index) - 1) * sizeof(xfs_refcount_rec_t))))
+
+#define XFS_REFCOUNT_KEY_ADDR(mp, block, index) \
+	((xfs_refcount_key_t *) \
+		((char *)(block) + \
+		 XFS_REFCOUNT_BLOCK_LEN(mp) + \
+		 ((index) - 1) * sizeof(xfs_refcount_key_t)))
+
+#define XFS_REFCOUNT_PTR_ADDR(mp, block, index, maxrecs) \
+	((xfs_refcount_ptr_t *) \
+		((char *)(block) + \
+		 XFS_REFCOUNT_BLOCK_LEN(mp) + \
+		 (maxrecs) * sizeof(xfs_refcount_key_t) + \
+		 ((index) - 1) * sizeof(xfs_refcount_ptr_t)))
+
+extern struct xfs_btree_cur *xfs_refcountbt_init_cursor(struct xfs_mount *,
+		struct xfs_trans *, struct xfs_buf *, xfs_agnumber_t);
+extern int xfs_refcountbt_maxrecs(struct xfs_mount *, int, int);
+extern void xfs_refcountbt_compute_maxlevels(struct xfs_mount *);
+
+#endif	/* __XFS_REFCOUNT_BTREE_H__ */
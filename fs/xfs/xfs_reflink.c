@@ -0,0 +1,640 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write the Free Software Foundation,
+ * Inc.,  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include "xfs.h"
+#include "xfs_fs.h"
+#include "xfs_types.h"
+#include "xfs_bit.h"
+#include "xfs_log.h"
+#include "xfs_trans.h"
+#include "xfs_sb.h"
+#include "xfs_ag.h"
+#include "xfs_alloc.h"
+#include "xfs_quota.h"
+#include "xfs_mount.h"
+#include "xfs_bmap_btree.h"
+#include "xfs_alloc_btree.h"
+#include "xfs_ialloc_btree.h"
+#include "xfs_refcount_btree.h"
+#include "xfs_dinode.h"
+#include "xfs_inode.h"
+#include "xfs_inode_item.h"
+#include "xfs_btree.h"
+#include "xfs_bmap.h"
+#include "xfs_error.h"
+#include "xfs_trans_space.h"
+#include "xfs_refcount.h"
+#include "xfs_reflink.h"
+#include "xfs_vnodeops.h"
+#include "xfs_trace.h"
+
+/*
+ * Sharing data blocks between files.
+ *
+ * xfs_reflink_remap_range() maps the blocks backing a range of one file
+ * into a range of another file (or the same one) and takes a reference on
+ * them in the refcount btree.  The inodes involved are tagged with
+ * XFS_DIFLAG_REFLINK, and only for those inodes the writeback code has to
+ * look out for shared blocks.
+ *
+ * Shared blocks are never overwritten in place.  When writeback finds that
+ * a block it is about to write is shared, xfs_reflink_map_cow() allocates
+ * a staging extent and the data goes there instead.  Once the I/O is done
+ * xfs_reflink_end_cow() unmaps the old blocks, which drops their
+ * reference, and maps the staging extent in their place.  Until then the
+ * staging extent is recorded in the refcount btree, so that it can be
+ * freed again if we crash in between.
+ *
+ * Writeback can't fail a write that has already been acknowledged, so the
+ * block for the copy is taken off the free space counter when a shared
+ * block is dirtied, through write_begin or page_mkwrite, and the write
+ * fails with ENOSPC there if there is none.  The buffer is tagged with
+ * BH_Cow until writeback hands the block back just before the staging
+ * extent is allocated for it.
+ */
+
+/*
+ * Allocate a staging extent of up to len blocks, as close to bno as
+ * possible.  This is done from writeback, so the transaction may dip into
+ * the reserved blocks like any other writeback allocation.
+ */
+STATIC int
+xfs_reflink_alloc_cow(
+	struct xfs_inode	*ip,
+	xfs_fsblock_t		bno,
+	xfs_extlen_t		len,
+	xfs_fsblock_t		*newbno,
+	xfs_extlen_t		*newlen)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_alloc_arg	args;
+	struct xfs_trans	*tp;
+	int			error;
+
+	tp = xfs_trans_alloc(mp, XFS_TRANS_COW);
+	tp->t_flags |= XFS_TRANS_RESERVE;
+	error = xfs_trans_reserve(tp, len, XFS_WRITE_LOG_RES(mp), 0, 0, 0);
+	if (error) {
+		xfs_trans_cancel(tp, 0);
+		return error;
+	}
+
+	memset(&args, 0, sizeof(args));
+	args.tp = tp;
+	args.mp = mp;
+	args.type = XFS_ALLOCTYPE_START_BNO;
+	args.fsbno = bno;
+	args.firstblock = NULLFSBLOCK;
+	args.minlen = 1;
+	args.maxlen = len;
+	args.prod = 1;
+	args.alignment = 1;
+	args.total = len;
+	args.userdata = XFS_ALLOC_USERDATA;
+	error = xfs_alloc_vextent(&args);
+	if (error)
+		goto out_cancel;
+	if (args.fsbno == NULLFSBLOCK) {
+		error = XFS_ERROR(ENOSPC);
+		goto out_cancel;
+	}
+
+	error = xfs_refcount_alloc_cow_staging(tp, args.fsbno, args.len);
+	if (error)
+		goto out_cancel;
+
+	error = xfs_trans_commit(tp, 0);
+	if (error)
+		return error;
+	*newbno = args.fsbno;
+	*newlen = args.len;
+	return 0;
+
+out_cancel:
+	xfs_trans_cancel(tp, XFS_TRANS_ABORT);
+	return error;
+}
+
+/*
+ * Check the mapping writeback has found for the block at offset.  If the
+ * block is shared the mapping is replaced by one of a new staging extent
+ * and *is_cow is set; otherwise the mapping is trimmed so that it does not
+ * run into shared blocks.
+ */
+int
+xfs_reflink_map_cow(
+	struct xfs_inode	*ip,
+	xfs_off_t		offset,
+	struct xfs_bmbt_irec	*imap,
+	int			*is_cow)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	xfs_fileoff_t		offset_fsb = XFS_B_TO_FSBT(mp, offset);
+	xfs_agblock_t		agbno;
+	xfs_extlen_t		len;
+	xfs_fsblock_t		fbno;
+	xfs_extlen_t		flen;
+	int			error;
+
+	*is_cow = 0;
+	if (imap->br_startblock == HOLESTARTBLOCK ||
+	    isnullstartblock(imap->br_startblock))
+		return 0;
+
+	ASSERT(offset_fsb >= imap->br_startoff &&
+	       offset_fsb < imap->br_startoff + imap->br_blockcount);
+	imap->br_startblock += offset_fsb - imap->br_startoff;
+	imap->br_blockcount -= offset_fsb - imap->br_startoff;
+	imap->br_startoff = offset_fsb;
+
+	/* look no further than the end of the AG */
+	agbno = XFS_FSB_TO_AGBNO(mp, imap->br_startblock);
+	len = min_t(xfs_filblks_t, imap->br_blockcount,
+		    mp->m_sb.sb_agblocks - agbno);
+
+	error = xfs_refcount_find_shared(mp, NULL, imap->br_startblock, len,
+					 &fbno, &flen);
+	if (error)
+		return error;
+	if (!flen)
+		return 0;
+	if (fbno != imap->br_startblock) {
+		imap->br_blockcount = fbno - imap->br_startblock;
+		return 0;
+	}
+
+	/*
+	 * Writeback clusters around the page it was asked for, don't copy
+	 * more than a write would allocate in one go.
+	 */
+	flen = min_t(xfs_extlen_t, flen, mp->m_writeio_blocks);
+	error = xfs_reflink_alloc_cow(ip, fbno, flen, &fbno, &flen);
+	if (error)
+		return error;
+
+	imap->br_startblock = fbno;
+	imap->br_blockcount = flen;
+	imap->br_state = XFS_EXT_NORM;
+	*is_cow = 1;
+	return 0;
+}
+
+/*
+ * Reserve a block for the copy-on-write of each buffer in [from, to) of a
+ * locked page that is mapped to a shared block.  Buffers that already hold
+ * a reservation, and delalloc buffers, which can't be shared, are skipped.
+ */
+int
+xfs_reflink_reserve_cow_page(
+	struct xfs_inode	*ip,
+	struct page		*page,
+	unsigned		from,
+	unsigned		to)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct inode		*inode = VFS_I(ip);
+	struct buffer_head	*bh, *head;
+	xfs_fsblock_t		bno;
+	xfs_fsblock_t		fbno;
+	xfs_extlen_t		flen;
+	unsigned		start = 0;
+	int			error;
+
+	if (!XFS_IS_REFLINK_INODE(ip) || !page_has_buffers(page))
+		return 0;
+
+	bh = head = page_buffers(page);
+	do {
+		if (start >= to)
+			break;
+		if (start + bh->b_size <= from || !buffer_mapped(bh) ||
+		    buffer_delay(bh) || buffer_cow(bh))
+			goto next;
+
+		bno = XFS_DADDR_TO_FSB(mp, (xfs_daddr_t)bh->b_blocknr <<
+					   (inode->i_blkbits - BBSHIFT));
+		error = xfs_refcount_find_shared(mp, NULL, bno, 1,
+						 &fbno, &flen);
+		if (error)
+			return error;
+		if (!flen)
+			goto next;
+
+		error = xfs_icsb_modify_counters(mp, XFS_SBS_FDBLOCKS, -1, 0);
+		if (error)
+			return error;
+		set_buffer_cow(bh);
+next:
+		start += bh->b_size;
+	} while ((bh = bh->b_this_page) != head);
+
+	return 0;
+}
+
+/*
+ * Give back the block reserved for the copy-on-write of a buffer, if any.
+ */
+void
+xfs_reflink_unreserve_cow_buffer(
+	struct xfs_inode	*ip,
+	struct buffer_head	*bh)
+{
+	if (test_clear_buffer_cow(bh))
+		xfs_icsb_modify_counters(ip->i_mount, XFS_SBS_FDBLOCKS, 1, 0);
+}
+
+/*
+ * The data for the range [offset, offset + count) has been written to the
+ * start of the staging extent, swap it in for the shared blocks.  The part
+ * of the staging extent that was not written to is freed.
+ *
+ * This runs from I/O completion, so the transaction must not recurse into
+ * the filesystem, see xfs_iomap_write_unwritten().
+ */
+int
+xfs_reflink_end_cow(
+	struct xfs_inode	*ip,
+	xfs_off_t		offset,
+	size_t			count,
+	xfs_fsblock_t		cow_start,
+	xfs_extlen_t		cow_len)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	xfs_fileoff_t		offset_fsb;
+	xfs_filblks_t		count_fsb;
+	struct xfs_bmbt_irec	irec;
+	xfs_bmap_free_t		free_list;
+	xfs_fsblock_t		firstfsb;
+	xfs_fsize_t		isize;
+	struct xfs_trans	*tp;
+	uint			resblks;
+	int			committed;
+	int			done;
+	int			error;
+
+	offset_fsb = XFS_B_TO_FSBT(mp, offset);
+	count_fsb = XFS_B_TO_FSB(mp, (xfs_ufsize_t)offset + count);
+	count_fsb -= offset_fsb;
+	ASSERT(count_fsb > 0 && count_fsb <= cow_len);
+
+	sb_start_intwrite(mp->m_super);
+	tp = _xfs_trans_alloc(mp, XFS_TRANS_COW, KM_NOFS);
+	tp->t_flags |= XFS_TRANS_RESERVE | XFS_TRANS_FREEZE_PROT;
+	resblks = XFS_EXTENTADD_SPACE_RES(mp, XFS_DATA_FORK);
+	error = xfs_trans_reserve(tp, resblks, XFS_ITRUNCATE_LOG_RES(mp), 0,
+				  XFS_TRANS_PERM_LOG_RES,
+				  XFS_ITRUNCATE_LOG_COUNT);
+	if (error) {
+		xfs_trans_cancel(tp, 0);
+		return error;
+	}
+
+	xfs_ilock(ip, XFS_ILOCK_EXCL);
+	xfs_trans_ijoin(tp, ip, 0);
+	xfs_bmap_init(&free_list, &firstfsb);
+
+	/*
+	 * The staging record goes first, that locks the AGF of the staging
+	 * extent and any bmap btree blocks have to come from there or later.
+	 */
+	error = xfs_refcount_remove_cow_staging(tp, cow_start, cow_len);
+	if (error)
+		goto out_cancel;
+	firstfsb = cow_start;
+
+	/* writeback only maps a single extent for copy-on-write */
+	error = xfs_bunmapi(tp, ip, offset_fsb, count_fsb, 0, 2, &firstfsb,
+			    &free_list, &done);
+	if (error)
+		goto out_cancel;
+	XFS_WANT_CORRUPTED_GOTO(done, out_cancel);
+
+	irec.br_startoff = offset_fsb;
+	irec.br_startblock = cow_start;
+	irec.br_blockcount = count_fsb;
+	irec.br_state = XFS_EXT_NORM;
+	error = xfs_bmap_remap_extent(tp, ip, &irec, &firstfsb, &free_list);
+	if (error)
+		goto out_cancel;
+
+	if (count_fsb < cow_len)
+		xfs_bmap_add_free(cow_start + count_fsb, cow_len - count_fsb,
+				  &free_list, mp);
+
+	isize = xfs_new_eof(ip, offset + count);
+	if (isize) {
+		ip->i_d.di_size = isize;
+		xfs_trans_log_inode(tp, ip, XFS_ILOG_CORE);
+	}
+
+	error = xfs_bmap_finish(&tp, &free_list, &committed);
+	if (error)
+		goto out_cancel;
+
+	error = xfs_trans_commit(tp, XFS_TRANS_RELEASE_LOG_RES);
+	xfs_iunlock(ip, XFS_ILOCK_EXCL);
+	return error;
+
+out_cancel:
+	xfs_bmap_cancel(&free_list);
+	xfs_trans_cancel(tp, XFS_TRANS_RELEASE_LOG_RES | XFS_TRANS_ABORT);
+	xfs_iunlock(ip, XFS_ILOCK_EXCL);
+	return error;
+}
+
+/*
+ * The write to a staging extent failed or was never issued, give the
+ * blocks back.  The file still maps the shared blocks.
+ */
+int
+xfs_reflink_cancel_cow(
+	struct xfs_inode	*ip,
+	xfs_fsblock_t		cow_start,
+	xfs_extlen_t		cow_len)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	xfs_bmap_free_t		free_list;
+	xfs_fsblock_t		firstfsb;
+	struct xfs_trans	*tp;
+	int			committed;
+	int			error;
+
+	sb_start_intwrite(mp->m_super);
+	tp = _xfs_trans_alloc(mp, XFS_TRANS_COW, KM_NOFS);
+	tp->t_flags |= XFS_TRANS_RESERVE | XFS_TRANS_FREEZE_PROT;
+	error = xfs_trans_reserve(tp, 0, XFS_ITRUNCATE_LOG_RES(mp), 0,
+				  XFS_TRANS_PERM_LOG_RES,
+				  XFS_ITRUNCATE_LOG_COUNT);
+	if (error) {
+		xfs_trans_cancel(tp, 0);
+		return error;
+	}
+
+	xfs_bmap_init(&free_list, &firstfsb);
+	error = xfs_refcount_remove_cow_staging(tp, cow_start, cow_len);
+	if (error)
+		goto out_cancel;
+	xfs_bmap_add_free(cow_start, cow_len, &free_list, mp);
+
+	error = xfs_bmap_finish(&tp, &free_list, &committed);
+	if (error)
+		goto out_cancel;
+	return xfs_trans_commit(tp, XFS_TRANS_RELEASE_LOG_RES);
+
+out_cancel:
+	xfs_bmap_cancel(&free_list);
+	xfs_trans_cancel(tp, XFS_TRANS_RELEASE_LOG_RES | XFS_TRANS_ABORT);
+	return error;
+}
+
+/*
+ * Map the first extent (or hole) of the source range [sfsbno, sfsbno + len)
+ * into the destination at dfsbno, which must be a hole.  *done is set to
+ * the number of blocks dealt with.
+ */
+STATIC int
+xfs_reflink_remap_one(
+	struct xfs_inode	*src,
+	xfs_fileoff_t		sfsbno,
+	struct xfs_inode	*dest,
+	xfs_fileoff_t		dfsbno,
+	xfs_filblks_t		len,
+	xfs_fsize_t		new_size,
+	xfs_filblks_t		*done)
+{
+	struct xfs_mount	*mp = src->i_mount;
+	struct xfs_bmbt_irec	imap;
+	xfs_bmap_free_t		free_list;
+	xfs_fsblock_t		firstfsb;
+	struct xfs_trans	*tp;
+	xfs_extlen_t		rdone;
+	xfs_fsize_t		isize;
+	uint			resblks;
+	uint			lock_mode = XFS_ILOCK_EXCL;
+	int			committed;
+	int			nimaps;
+	int			error;
+
+	tp = xfs_trans_alloc(mp, XFS_TRANS_REFLINK);
+	resblks = XFS_EXTENTADD_SPACE_RES(mp, XFS_DATA_FORK);
+	error = xfs_trans_reserve(tp, resblks, XFS_WRITE_LOG_RES(mp), 0,
+				  XFS_TRANS_PERM_LOG_RES, XFS_WRITE_LOG_COUNT);
+	if (error) {
+		xfs_trans_cancel(tp, 0);
+		return error;
+	}
+
+	if (src == dest)
+		xfs_ilock(src, lock_mode);
+	else
+		xfs_lock_two_inodes(src, dest, lock_mode);
+
+	nimaps = 1;
+	error = xfs_bmapi_read(src, sfsbno, len, &imap, &nimaps, 0);
+	if (error)
+		goto out_unreserve;
+	ASSERT(nimaps == 1 && imap.br_startoff == sfsbno);
+
+	/*
+	 * The range was flushed and neither write() nor page faults can dirty
+	 * it again while we hold the iolock and the mmap lock, but delalloc
+	 * blocks without pages can be left over from speculative
+	 * preallocation before the file was extended.
+	 */
+	if (imap.br_startblock == DELAYSTARTBLOCK) {
+		error = XFS_ERROR(EAGAIN);
+		goto out_unreserve;
+	}
+
+	/* the shared blocks are charged to the destination as well */
+	error = xfs_trans_reserve_quota_nblks(tp, dest,
+			resblks + (imap.br_startblock == HOLESTARTBLOCK ?
+				   0 : imap.br_blockcount),
+			0, XFS_QMOPT_RES_REGBLKS);
+	if (error)
+		goto out_unreserve;
+
+	xfs_trans_ijoin(tp, src, 0);
+	if (src != dest)
+		xfs_trans_ijoin(tp, dest, 0);
+	xfs_bmap_init(&free_list, &firstfsb);
+
+	*done = imap.br_blockcount;
+	if (imap.br_startblock != HOLESTARTBLOCK) {
+		error = xfs_refcount_increase(tp, imap.br_startblock,
+					      imap.br_blockcount, &rdone);
+		if (error)
+			goto out_cancel;
+		*done = rdone;
+
+		imap.br_startoff = dfsbno;
+		imap.br_blockcount = rdone;
+		firstfsb = imap.br_startblock;
+		error = xfs_bmap_remap_extent(tp, dest, &imap, &firstfsb,
+					      &free_list);
+		if (error)
+			goto out_cancel;
+	}
+
+	isize = min_t(xfs_fsize_t, XFS_FSB_TO_B(mp, dfsbno + *done), new_size);
+	if (isize > dest->i_d.di_size) {
+		dest->i_d.di_size = isize;
+		i_size_write(VFS_I(dest), isize);
+	}
+
+	src->i_d.di_flags |= XFS_DIFLAG_REFLINK;
+	dest->i_d.di_flags |= XFS_DIFLAG_REFLINK;
+	xfs_trans_ichgtime(tp, dest, XFS_ICHGTIME_MOD | XFS_ICHGTIME_CHG);
+	xfs_trans_log_inode(tp, src, XFS_ILOG_CORE);
+	if (src != dest)
+		xfs_trans_log_inode(tp, dest, XFS_ILOG_CORE);
+
+	error = xfs_bmap_finish(&tp, &free_list, &committed);
+	if (error)
+		goto out_cancel;
+
+	error = xfs_trans_commit(tp, XFS_TRANS_RELEASE_LOG_RES);
+	goto out_unlock;
+
+out_cancel:
+	xfs_bmap_cancel(&free_list);
+	xfs_trans_cancel(tp, XFS_TRANS_RELEASE_LOG_RES | XFS_TRANS_ABORT);
+	goto out_unlock;
+out_unreserve:
+	xfs_trans_cancel(tp, XFS_TRANS_RELEASE_LOG_RES);
+out_unlock:
+	xfs_iunlock(src, lock_mode);
+	if (src != dest)
+		xfs_iunlock(dest, lock_mode);
+	return error;
+}
+
+/*
+ * Share the blocks of [srcoff, srcoff + len) of src with dest at destoff.
+ * A length of zero means up to the end of src.
+ *
+ * Both offsets must be block aligned, and so must the length unless the
+ * range ends at the end of src and at or beyond the end of dest.  Whatever
+ * dest had in the range before is freed.  For deduplication the ranges
+ * are compared first and EBADE is returned if they differ.
+ */
+int
+xfs_reflink_remap_range(
+	struct xfs_inode	*src,
+	xfs_off_t		srcoff,
+	struct xfs_inode	*dest,
+	xfs_off_t		destoff,
+	xfs_off_t		len,
+	bool			is_dedupe)
+{
+	struct xfs_mount	*mp = src->i_mount;
+	xfs_off_t		bmask = mp->m_sb.sb_blocksize - 1;
+	xfs_fileoff_t		sfsbno;
+	xfs_fileoff_t		dfsbno;
+	xfs_filblks_t		fsblen;
+	xfs_filblks_t		done;
+	xfs_fsize_t		isize;
+	xfs_off_t		blen;
+	bool			same_inode = (src == dest);
+	int			error;
+
+	if (!xfs_sb_version_hasreflink(&mp->m_sb))
+		return XFS_ERROR(EOPNOTSUPP);
+	if (XFS_FORCED_SHUTDOWN(mp))
+		return XFS_ERROR(EIO);
+	if (XFS_IS_REALTIME_INODE(src) || XFS_IS_REALTIME_INODE(dest))
+		return XFS_ERROR(EINVAL);
+
+	/*
+	 * The mmap lock keeps page faults from dirtying src pages after they
+	 * have been flushed, and from instantiating dest pages over the range
+	 * while its blocks are being replaced.
+	 */
+	if (same_inode) {
+		xfs_ilock(src, XFS_IOLOCK_EXCL | XFS_MMAPLOCK_EXCL);
+	} else {
+		xfs_lock_two_inodes(src, dest, XFS_IOLOCK_EXCL);
+		xfs_lock_two_inodes(src, dest, XFS_MMAPLOCK_EXCL);
+	}
+
+	error = XFS_ERROR(EINVAL);
+	isize = XFS_ISIZE(src);
+	if (len == 0)
+		len = isize - srcoff;
+	if (len <= 0 || srcoff + len > isize)
+		goto out_unlock;
+	if (is_dedupe && destoff + len > XFS_ISIZE(dest))
+		goto out_unlock;
+	if ((srcoff | destoff) & bmask)
+		goto out_unlock;
+	if ((len & bmask) &&
+	    (srcoff + len != isize || destoff + len < XFS_ISIZE(dest)))
+		goto out_unlock;
+
+	blen = (len + bmask) & ~bmask;
+	if (same_inode && srcoff < destoff + blen && destoff < srcoff + blen)
+		goto out_unlock;
+
+	if (is_dedupe) {
+		bool		is_same;
+
+		error = -vfs_dedupe_file_range_compare(VFS_I(src), srcoff,
+				VFS_I(dest), destoff, len, &is_same);
+		if (error)
+			goto out_unlock;
+		if (!is_same) {
+			error = XFS_ERROR(EBADE);
+			goto out_unlock;
+		}
+	}
+
+	/*
+	 * Get the source blocks on disk and the destination range out of the
+	 * way, page cache included.  Anything between the old end of dest and
+	 * the range becomes part of the file and has to read back as zeroes.
+	 */
+	inode_dio_wait(VFS_I(src));
+	if (!same_inode)
+		inode_dio_wait(VFS_I(dest));
+	if (destoff > XFS_ISIZE(dest)) {
+		error = xfs_zero_eof(dest, destoff, XFS_ISIZE(dest));
+		if (error)
+			goto out_unlock;
+	}
+	error = xfs_flush_pages(src, srcoff, srcoff + blen - 1, 0, FI_NONE);
+	if (error)
+		goto out_unlock;
+	error = xfs_free_file_space(dest, destoff, blen, XFS_ATTR_NOLOCK);
+	if (error)
+		goto out_unlock;
+
+	sfsbno = XFS_B_TO_FSBT(mp, srcoff);
+	dfsbno = XFS_B_TO_FSBT(mp, destoff);
+	fsblen = XFS_B_TO_FSB(mp, blen);
+	while (fsblen) {
+		error = xfs_reflink_remap_one(src, sfsbno, dest, dfsbno, fsblen,
+					      destoff + len, &done);
+		if (error)
+			break;
+		sfsbno += done;
+		dfsbno += done;
+		fsblen -= done;
+	}
+
+out_unlock:
+	xfs_iunlock(src, XFS_IOLOCK_EXCL | XFS_MMAPLOCK_EXCL);
+	if (!same_inode)
+		xfs_iunlock(dest, XFS_IOLOCK_EXCL | XFS_MMAPLOCK_EXCL);
+	return error;
+}
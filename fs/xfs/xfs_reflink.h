@@ -0,0 +1,53 @@
+/*
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it would be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write the Free Software Foundation,
+ * Inc.,  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __XFS_REFLINK_H__
+#define	__XFS_REFLINK_H__
+
+struct xfs_bmbt_irec;
+struct xfs_inode;
+struct page;
+struct buffer_head;
+
+/* largest range deduplicated per call, the contents are compared first */
+#define XFS_MAX_DEDUPE_LEN	(16 * 1024 * 1024)
+
+int	xfs_reflink_remap_range(struct xfs_inode *src, xfs_off_t srcoff,
+		struct xfs_inode *dest, xfs_off_t destoff, xfs_off_t len,
+		bool is_dedupe);
+
+/*
+ * Copy-on-write in the writeback path: xfs_reflink_map_cow() turns the
+ * mapping of a block about to be written into one of a new staging extent
+ * if the block is shared, and xfs_reflink_end_cow() moves the staging
+ * blocks into the file once the data is on disk.
+ */
+int	xfs_reflink_map_cow(struct xfs_inode *ip, xfs_off_t offset,
+		struct xfs_bmbt_irec *imap, int *is_cow);
+int	xfs_reflink_end_cow(struct xfs_inode *ip, xfs_off_t offset,
+		size_t count, xfs_fsblock_t cow_start, xfs_extlen_t cow_len);
+int	xfs_reflink_cancel_cow(struct xfs_inode *ip, xfs_fsblock_t cow_start,
+		xfs_extlen_t cow_len);
+
+/*
+ * Blocks for the copy-on-write are reserved when a shared block is
+ * dirtied, so that writeback does not run out of space, and handed back
+ * when the buffer goes to disk or is thrown away.
+ */
+int	xfs_reflink_reserve_cow_page(struct xfs_inode *ip, struct page *page,
+		unsigned from, unsigned to);
+void	xfs_reflink_unreserve_cow_buffer(struct xfs_inode *ip,
+		struct buffer_head *bh);
+
+#endif	/* __XFS_REFLINK_H__ */
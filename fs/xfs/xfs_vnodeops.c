@@ -920,6 +920,9 @@ xfs_lock_inumorder(int lock_mode, int subclass)
 {
 	if (lock_mode & (XFS_IOLOCK_SHARED|XFS_IOLOCK_EXCL))
 		lock_mode |= (subclass + XFS_LOCK_INUMORDER) << XFS_IOLOCK_SHIFT;
+	if (lock_mode & (XFS_MMAPLOCK_SHARED|XFS_MMAPLOCK_EXCL))
+		lock_mode |= (subclass + XFS_LOCK_INUMORDER) <<
+							XFS_MMAPLOCK_SHIFT;
 	if (lock_mode & (XFS_ILOCK_SHARED|XFS_ILOCK_EXCL))
 		lock_mode |= (subclass + XFS_LOCK_INUMORDER) << XFS_ILOCK_SHIFT;
 
@@ -1039,9 +1042,9 @@ again:
 
 /*
  * xfs_lock_two_inodes() can only be used to lock one type of lock
- * at a time - the iolock or the ilock, but not both at once. If
- * we lock both at once, lockdep will report false positives saying
- * we have violated locking orders.
+ * at a time - the iolock, the mmaplock or the ilock, but not more than
+ * one at once. If we lock several at once, lockdep will report false
+ * positives saying we have violated locking orders.
  */
 void
 xfs_lock_two_inodes(
@@ -1054,6 +1057,9 @@ xfs_lock_two_inodes(
 	xfs_log_item_t		*lp;
 
 	if (lock_mode & (XFS_IOLOCK_SHARED|XFS_IOLOCK_EXCL))
+		ASSERT((lock_mode & (XFS_MMAPLOCK_SHARED|XFS_MMAPLOCK_EXCL|
+				     XFS_ILOCK_SHARED|XFS_ILOCK_EXCL)) == 0);
+	if (lock_mode & (XFS_MMAPLOCK_SHARED|XFS_MMAPLOCK_EXCL))
 		ASSERT((lock_mode & (XFS_ILOCK_SHARED|XFS_ILOCK_EXCL)) == 0);
 	ASSERT(ip0->i_ino != ip1->i_ino);
 
@@ -1839,6 +1845,12 @@ xfs_zero_remaining_bytes(
 	if (startoff >= XFS_ISIZE(ip))
 		return 0;
 
+	/* shared blocks must not be written in place */
+	if (XFS_IS_REFLINK_INODE(ip))
+		return xfs_iozero(ip, startoff,
+				min_t(xfs_off_t, endoff + 1, XFS_ISIZE(ip)) -
+				startoff);
+
 	if (endoff > XFS_ISIZE(ip))
 		endoff = XFS_ISIZE(ip);
 
@@ -1899,15 +1911,15 @@ xfs_zero_remaining_bytes(
  * xfs_free_file_space()
  *      This routine frees disk space for the given file.
  *
- *	This routine is only called by xfs_change_file_space
- *	for an UNRESVSP type call.
+ *	This routine is called by xfs_change_file_space for an
+ *	UNRESVSP type call and by reflink to clear the destination.
  *
  * RETURNS:
  *       0 on success
  *      errno on error
  *
  */
-STATIC int
+int
 xfs_free_file_space(
 	xfs_inode_t		*ip,
 	xfs_off_t		offset,
@@ -2095,6 +2107,298 @@ xfs_free_file_space(
 	return error;
 }
 
+/*
+ * Zero the byte range [offset, offset + len) of a file.
+ *
+ * The page cache granularity aligned interior of the range is tossed from
+ * the page cache and converted to unwritten extents, holes in it are
+ * preallocated.  The unaligned edges are zeroed through the page cache,
+ * but only up to EOF as everything beyond is zeroed when the file is
+ * extended.  The caller must hold the iolock exclusively.
+ */
+STATIC int
+xfs_zero_file_space(
+	struct xfs_inode	*ip,
+	xfs_off_t		offset,
+	xfs_off_t		len,
+	int			attr_flags)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	uint			granularity;
+	xfs_off_t		start_boundary;
+	xfs_off_t		end_boundary;
+	xfs_off_t		isize = XFS_ISIZE(ip);
+	int			error;
+
+	ASSERT(xfs_isilocked(ip, XFS_IOLOCK_EXCL));
+
+	granularity = max_t(uint, 1 << mp->m_sb.sb_blocklog, PAGE_CACHE_SIZE);
+	start_boundary = round_up(offset, granularity);
+	end_boundary = round_down(offset + len, granularity);
+
+	if (start_boundary < end_boundary) {
+		error = xfs_flushinval_pages(ip, start_boundary,
+				end_boundary - 1, FI_REMAPF_LOCKED);
+		if (error)
+			return error;
+
+		/*
+		 * Shared blocks can't be converted to unwritten extents in
+		 * just this file, so give them up and preallocate new ones.
+		 */
+		if (XFS_IS_REFLINK_INODE(ip)) {
+			error = xfs_free_file_space(ip, start_boundary,
+					end_boundary - start_boundary,
+					attr_flags | XFS_ATTR_NOLOCK);
+			if (error)
+				return error;
+			error = xfs_alloc_file_space(ip, start_boundary,
+					end_boundary - start_boundary,
+					XFS_BMAPI_PREALLOC, attr_flags);
+		} else {
+			error = xfs_alloc_file_space(ip, start_boundary,
+					end_boundary - start_boundary,
+					XFS_BMAPI_PREALLOC | XFS_BMAPI_CONVERT,
+					attr_flags);
+		}
+		if (error)
+			return error;
+	} else {
+		/* no full granule, zero everything through the page cache */
+		start_boundary = end_boundary = offset + len;
+	}
+
+	if (offset < start_boundary && offset < isize) {
+		error = xfs_iozero(ip, offset,
+				min(start_boundary, isize) - offset);
+		if (error)
+			return error;
+	}
+	if (end_boundary < offset + len && end_boundary < isize)
+		error = xfs_iozero(ip, end_boundary,
+				min(offset + len, isize) - end_boundary);
+	return error;
+}
+
+/*
+ * Get the file ready to have its extents shifted: wait for direct I/O,
+ * write back and toss the page cache from @offset on and get rid of
+ * delayed allocations beyond EOF, which can't be shifted.
+ */
+STATIC int
+xfs_prepare_shift(
+	struct xfs_inode	*ip,
+	xfs_off_t		offset)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	int			error;
+
+	ASSERT(xfs_isilocked(ip, XFS_IOLOCK_EXCL));
+
+	if (XFS_FORCED_SHUTDOWN(mp))
+		return XFS_ERROR(EIO);
+
+	error = xfs_qm_dqattach(ip, 0);
+	if (error)
+		return error;
+
+	inode_dio_wait(VFS_I(ip));
+
+	error = xfs_flushinval_pages(ip, round_down(offset, PAGE_CACHE_SIZE),
+				     -1, FI_REMAPF_LOCKED);
+	if (error)
+		return error;
+
+	/*
+	 * Writeback converted all delayed allocations inside EOF, the ones
+	 * left are speculative preallocation beyond it.
+	 */
+	if (ip->i_delayed_blks) {
+		error = xfs_free_eofblocks(mp, ip, false);
+		if (error)
+			return error;
+	}
+	return 0;
+}
+
+/*
+ * Shift all extents from next_fsb on by shift_fsb blocks, to the left or
+ * down to stop_fsb to the right, XFS_BMAP_MAX_SHIFT_EXTENTS extents per
+ * transaction.
+ */
+STATIC int
+xfs_shift_file_space(
+	struct xfs_inode	*ip,
+	xfs_fileoff_t		next_fsb,
+	xfs_fileoff_t		shift_fsb,
+	xfs_fileoff_t		stop_fsb,
+	int			shift_right)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_trans	*tp;
+	struct xfs_bmap_free	free_list;
+	xfs_fsblock_t		firstfsb;
+	uint			resblks = XFS_DIOSTRAT_SPACE_RES(mp, 0);
+	int			committed;
+	int			done = 0;
+	int			error = 0;
+
+	while (!error && !done) {
+		/*
+		 * Shifting never allocates data blocks, but btree updates
+		 * may need some.  Allow dipping into the reserve blocks so
+		 * that collapsing a range works at ENOSPC.
+		 */
+		tp = xfs_trans_alloc(mp, XFS_TRANS_DIOSTRAT);
+		tp->t_flags |= XFS_TRANS_RESERVE;
+		error = xfs_trans_reserve(tp, resblks, XFS_WRITE_LOG_RES(mp),
+					  0, XFS_TRANS_PERM_LOG_RES,
+					  XFS_WRITE_LOG_COUNT);
+		if (error) {
+			ASSERT(error == ENOSPC || XFS_FORCED_SHUTDOWN(mp));
+			xfs_trans_cancel(tp, 0);
+			break;
+		}
+
+		xfs_ilock(ip, XFS_ILOCK_EXCL);
+		error = xfs_trans_reserve_quota(tp, mp,
+				ip->i_udquot, ip->i_gdquot,
+				resblks, 0, XFS_QMOPT_RES_REGBLKS);
+		if (error)
+			goto out_trans_cancel;
+
+		xfs_trans_ijoin(tp, ip, 0);
+
+		xfs_bmap_init(&free_list, &firstfsb);
+		error = xfs_bmap_shift_extents(tp, ip, &next_fsb, shift_fsb,
+				&done, stop_fsb, shift_right, &firstfsb,
+				&free_list, XFS_BMAP_MAX_SHIFT_EXTENTS);
+		if (error)
+			goto out_bmap_cancel;
+
+		error = xfs_bmap_finish(&tp, &free_list, &committed);
+		if (error)
+			goto out_bmap_cancel;
+
+		error = xfs_trans_commit(tp, XFS_TRANS_RELEASE_LOG_RES);
+		xfs_iunlock(ip, XFS_ILOCK_EXCL);
+	}
+	return error;
+
+ out_bmap_cancel:
+	xfs_bmap_cancel(&free_list);
+ out_trans_cancel:
+	xfs_trans_cancel(tp, XFS_TRANS_RELEASE_LOG_RES | XFS_TRANS_ABORT);
+	xfs_iunlock(ip, XFS_ILOCK_EXCL);
+	return error;
+}
+
+/*
+ * xfs_collapse_file_space()
+ *	Remove the block aligned range [offset, offset + len) from a file
+ *	and shift everything behind it down by len bytes.  The caller holds
+ *	the iolock exclusively and reduces the file size afterwards.
+ */
+int
+xfs_collapse_file_space(
+	struct xfs_inode	*ip,
+	xfs_off_t		offset,
+	xfs_off_t		len,
+	int			attr_flags)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	int			error;
+
+	trace_xfs_collapse_file_space(ip);
+
+	error = xfs_prepare_shift(ip, offset);
+	if (error)
+		return error;
+
+	error = xfs_free_file_space(ip, offset, len,
+				    attr_flags | XFS_ATTR_NOLOCK);
+	if (error)
+		return error;
+
+	return xfs_shift_file_space(ip, XFS_B_TO_FSB(mp, offset + len),
+				    XFS_B_TO_FSB(mp, len), 0, 0);
+}
+
+/*
+ * xfs_insert_file_space()
+ *	Open up a hole of len bytes at the block aligned offset by shifting
+ *	everything from offset on up.  The caller holds the iolock
+ *	exclusively and has already grown the file by len bytes.
+ */
+int
+xfs_insert_file_space(
+	struct xfs_inode	*ip,
+	xfs_off_t		offset,
+	xfs_off_t		len)
+{
+	struct xfs_mount	*mp = ip->i_mount;
+	struct xfs_trans	*tp;
+	struct xfs_bmap_free	free_list;
+	xfs_fsblock_t		firstfsb;
+	xfs_fileoff_t		stop_fsb = XFS_B_TO_FSB(mp, offset);
+	uint			resblks = XFS_DIOSTRAT_SPACE_RES(mp, 0);
+	int			committed;
+	int			error;
+
+	trace_xfs_insert_file_space(ip);
+
+	error = xfs_prepare_shift(ip, offset);
+	if (error)
+		return error;
+
+	/*
+	 * Split the extent spanning offset, if any, so that only the part
+	 * behind offset gets shifted.
+	 */
+	tp = xfs_trans_alloc(mp, XFS_TRANS_DIOSTRAT);
+	tp->t_flags |= XFS_TRANS_RESERVE;
+	error = xfs_trans_reserve(tp, resblks, XFS_WRITE_LOG_RES(mp), 0,
+				  XFS_TRANS_PERM_LOG_RES, XFS_WRITE_LOG_COUNT);
+	if (error) {
+		ASSERT(error == ENOSPC || XFS_FORCED_SHUTDOWN(mp));
+		xfs_trans_cancel(tp, 0);
+		return error;
+	}
+
+	xfs_ilock(ip, XFS_ILOCK_EXCL);
+	error = xfs_trans_reserve_quota(tp, mp, ip->i_udquot, ip->i_gdquot,
+					resblks, 0, XFS_QMOPT_RES_REGBLKS);
+	if (error)
+		goto out_trans_cancel;
+
+	xfs_trans_ijoin(tp, ip, 0);
+
+	xfs_bmap_init(&free_list, &firstfsb);
+	error = xfs_bmap_split_extent_at(tp, ip, stop_fsb, &firstfsb,
+					 &free_list);
+	if (error)
+		goto out_bmap_cancel;
+
+	error = xfs_bmap_finish(&tp, &free_list, &committed);
+	if (error)
+		goto out_bmap_cancel;
+
+	error = xfs_trans_commit(tp, XFS_TRANS_RELEASE_LOG_RES);
+	xfs_iunlock(ip, XFS_ILOCK_EXCL);
+	if (error)
+		return error;
+
+	return xfs_shift_file_space(ip, NULLFILEOFF, XFS_B_TO_FSB(mp, len),
+				    stop_fsb, 1);
+
+ out_bmap_cancel:
+	xfs_bmap_cancel(&free_list);
+ out_trans_cancel:
+	xfs_trans_cancel(tp, XFS_TRANS_RELEASE_LOG_RES | XFS_TRANS_ABORT);
+	xfs_iunlock(ip, XFS_ILOCK_EXCL);
+	return error;
+}
+
 /*
  * xfs_change_file_space()
  *      This routine allocates or frees disk space for the given file.
@@ -2123,7 +2427,6 @@ xfs_change_file_space(
 	xfs_off_t	llen;
 	xfs_trans_t	*tp;
 	struct iattr	iattr;
-	int		prealloc_type;
 
 	if (!S_ISREG(ip->i_d.di_mode))
 		return XFS_ERROR(EINVAL);
@@ -2166,17 +2469,24 @@ xfs_change_file_space(
 	 * size to be changed.
 	 */
 	setprealloc = clrprealloc = 0;
-	prealloc_type = XFS_BMAPI_PREALLOC;
 
 	switch (cmd) {
 	case XFS_IOC_ZERO_RANGE:
-		prealloc_type |= XFS_BMAPI_CONVERT;
-		xfs_tosspages(ip, startoffset, startoffset + bf->l_len, 0);
-		/* FALLTHRU */
+		if (!(attr_flags & XFS_ATTR_NOLOCK))
+			xfs_ilock(ip, XFS_IOLOCK_EXCL);
+		error = xfs_zero_file_space(ip, startoffset, bf->l_len,
+					    attr_flags | XFS_ATTR_NOLOCK);
+		if (!(attr_flags & XFS_ATTR_NOLOCK))
+			xfs_iunlock(ip, XFS_IOLOCK_EXCL);
+		if (error)
+			return error;
+		setprealloc = 1;
+		break;
+
 	case XFS_IOC_RESVSP:
 	case XFS_IOC_RESVSP64:
 		error = xfs_alloc_file_space(ip, startoffset, bf->l_len,
-						prealloc_type, attr_flags);
+						XFS_BMAPI_PREALLOC, attr_flags);
 		if (error)
 			return error;
 		setprealloc = 1;
@@ -38,6 +38,12 @@ int xfs_symlink(struct xfs_inode *dp, struct xfs_name *link_name,
 int xfs_set_dmattrs(struct xfs_inode *ip, u_int evmask, u_int16_t state);
 int xfs_change_file_space(struct xfs_inode *ip, int cmd,
 		xfs_flock64_t *bf, xfs_off_t offset, int attr_flags);
+int xfs_collapse_file_space(struct xfs_inode *ip, xfs_off_t offset,
+		xfs_off_t len, int attr_flags);
+int xfs_insert_file_space(struct xfs_inode *ip, xfs_off_t offset,
+		xfs_off_t len);
+int xfs_free_file_space(struct xfs_inode *ip, xfs_off_t offset,
+		xfs_off_t len, int attr_flags);
 int xfs_rename(struct xfs_inode *src_dp, struct xfs_name *src_name,
 		struct xfs_inode *src_ip, struct xfs_inode *target_dp,
 		struct xfs_name *target_name, struct xfs_inode *target_ip);
@@ -57,5 +63,6 @@ int xfs_flush_pages(struct xfs_inode *ip, xfs_off_t first,
 int xfs_wait_on_pages(struct xfs_inode *ip, xfs_off_t first, xfs_off_t last);
 
 int xfs_zero_eof(struct xfs_inode *, xfs_off_t, xfs_fsize_t);
+int xfs_iozero(struct xfs_inode *, loff_t, size_t);
 
 #endif /* _XFS_VNODEOPS_H */
@@ -18,6 +18,7 @@
 #include <linux/writeback.h>
 #include <linux/atomic.h>
 #include <linux/sysctl.h>
+#include <linux/workqueue.h>
 
 struct page;
 struct device;
@@ -38,15 +39,15 @@ enum bdi_state {
 
 typedef int (congested_fn)(void *, int);
 
-enum bdi_stat_item {
-	BDI_RECLAIMABLE,
-	BDI_WRITEBACK,
-	BDI_DIRTIED,
-	BDI_WRITTEN,
-	NR_BDI_STAT_ITEMS
+enum wb_stat_item {
+	WB_RECLAIMABLE,
+	WB_WRITEBACK,
+	WB_DIRTIED,
+	WB_WRITTEN,
+	NR_WB_STAT_ITEMS
 };
 
-#define BDI_STAT_BATCH (8*(1+ilog2(nr_cpu_ids)))
+#define WB_STAT_BATCH (8*(1+ilog2(nr_cpu_ids)))
 
 struct bdi_writeback {
 	struct backing_dev_info *bdi;	/* our parent bdi */
@@ -61,19 +62,8 @@ struct bdi_writeback {
 	struct list_head b_io;		/* parked for writeback */
 	struct list_head b_more_io;	/* parked for more writeback */
 	spinlock_t list_lock;		/* protects the b_* lists */
-};
-
-struct backing_dev_info {
-	struct list_head bdi_list;
-	unsigned long ra_pages;	/* max readahead in PAGE_CACHE_SIZE units */
-	unsigned long state;	/* Always use atomic bitops on this */
-	unsigned int capabilities; /* Device capabilities */
-	congested_fn *congested_fn; /* Function pointer if device is md/dm */
-	void *congested_data;	/* Pointer to aux data for congested func */
-
-	char *name;
 
-	struct percpu_counter bdi_stat[NR_BDI_STAT_ITEMS];
+	struct percpu_counter stat[NR_WB_STAT_ITEMS];
 
 	unsigned long bw_time_stamp;	/* last time write bw is updated */
 	unsigned long dirtied_stamp;
@@ -93,11 +83,34 @@ struct backing_dev_info {
 	struct fprop_local_percpu completions;
 	int dirty_exceeded;
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+	atomic_t refcnt;		/* only for cgroup wbs, see wb_get() */
+	unsigned short memcg_id;	/* css_id of the memcg, 0 for the root */
+	bool offline;			/* the memcg has been removed */
+	struct list_head bdi_node;	/* anchored at bdi->wb_list, RCU */
+	struct work_struct release_work;
+#endif
+};
+
+struct backing_dev_info {
+	struct list_head bdi_list;
+	unsigned long ra_pages;	/* max readahead in PAGE_CACHE_SIZE units */
+	unsigned long state;	/* Always use atomic bitops on this */
+	unsigned int capabilities; /* Device capabilities */
+	congested_fn *congested_fn; /* Function pointer if device is md/dm */
+	void *congested_data;	/* Pointer to aux data for congested func */
+
+	char *name;
+
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
 
-	struct bdi_writeback wb;  /* default writeback info for this bdi */
+	struct bdi_writeback wb;  /* the root writeback info for this bdi */
 	spinlock_t wb_lock;	  /* protects work_list */
+#ifdef CONFIG_CGROUP_WRITEBACK
+	struct radix_tree_root cgwb_tree; /* memcg_id -> wb, cgwb_lock */
+	struct list_head wb_list; /* all wbs including the root one, RCU */
+#endif
 
 	struct list_head work_list;
 
@@ -138,78 +151,76 @@ static inline int wb_has_dirty_io(struct bdi_writeback *wb)
 	       !list_empty(&wb->b_more_io);
 }
 
-static inline void __add_bdi_stat(struct backing_dev_info *bdi,
-		enum bdi_stat_item item, s64 amount)
+static inline void __add_wb_stat(struct bdi_writeback *wb,
+		enum wb_stat_item item, s64 amount)
 {
-	__percpu_counter_add(&bdi->bdi_stat[item], amount, BDI_STAT_BATCH);
+	__percpu_counter_add(&wb->stat[item], amount, WB_STAT_BATCH);
 }
 
-static inline void __inc_bdi_stat(struct backing_dev_info *bdi,
-		enum bdi_stat_item item)
+static inline void __inc_wb_stat(struct bdi_writeback *wb,
+		enum wb_stat_item item)
 {
-	__add_bdi_stat(bdi, item, 1);
+	__add_wb_stat(wb, item, 1);
 }
 
-static inline void inc_bdi_stat(struct backing_dev_info *bdi,
-		enum bdi_stat_item item)
+static inline void inc_wb_stat(struct bdi_writeback *wb,
+		enum wb_stat_item item)
 {
 	unsigned long flags;
 
 	local_irq_save(flags);
-	__inc_bdi_stat(bdi, item);
+	__inc_wb_stat(wb, item);
 	local_irq_restore(flags);
 }
 
-static inline void __dec_bdi_stat(struct backing_dev_info *bdi,
-		enum bdi_stat_item item)
+static inline void __dec_wb_stat(struct bdi_writeback *wb,
+		enum wb_stat_item item)
 {
-	__add_bdi_stat(bdi, item, -1);
+	__add_wb_stat(wb, item, -1);
 }
 
-static inline void dec_bdi_stat(struct backing_dev_info *bdi,
-		enum bdi_stat_item item)
+static inline void dec_wb_stat(struct bdi_writeback *wb,
+		enum wb_stat_item item)
 {
 	unsigned long flags;
 
 	local_irq_save(flags);
-	__dec_bdi_stat(bdi, item);
+	__dec_wb_stat(wb, item);
 	local_irq_restore(flags);
 }
 
-static inline s64 bdi_stat(struct backing_dev_info *bdi,
-		enum bdi_stat_item item)
+static inline s64 wb_stat(struct bdi_writeback *wb, enum wb_stat_item item)
 {
-	return percpu_counter_read_positive(&bdi->bdi_stat[item]);
+	return percpu_counter_read_positive(&wb->stat[item]);
 }
 
-static inline s64 __bdi_stat_sum(struct backing_dev_info *bdi,
-		enum bdi_stat_item item)
+static inline s64 __wb_stat_sum(struct bdi_writeback *wb,
+		enum wb_stat_item item)
 {
-	return percpu_counter_sum_positive(&bdi->bdi_stat[item]);
+	return percpu_counter_sum_positive(&wb->stat[item]);
 }
 
-static inline s64 bdi_stat_sum(struct backing_dev_info *bdi,
-		enum bdi_stat_item item)
+static inline s64 wb_stat_sum(struct bdi_writeback *wb, enum wb_stat_item item)
 {
 	s64 sum;
 	unsigned long flags;
 
 	local_irq_save(flags);
-	sum = __bdi_stat_sum(bdi, item);
+	sum = __wb_stat_sum(wb, item);
 	local_irq_restore(flags);
 
 	return sum;
 }
 
-extern void bdi_writeout_inc(struct backing_dev_info *bdi);
+extern void wb_writeout_inc(struct bdi_writeback *wb);
 
 /*
  * maximal error of a stat counter.
  */
-static inline unsigned long bdi_stat_error(struct backing_dev_info *bdi)
+static inline unsigned long wb_stat_error(struct bdi_writeback *wb)
 {
 #ifdef CONFIG_SMP
-	return nr_cpu_ids * BDI_STAT_BATCH;
+	return nr_cpu_ids * WB_STAT_BATCH;
 #else
 	return 1;
 #endif
@@ -243,6 +254,10 @@ int bdi_set_max_ratio(struct backing_dev_info *bdi, unsigned int max_ratio);
  * BDI_CAP_EXEC_MAP:       Can be mapped for execution
  *
  * BDI_CAP_SWAP_BACKED:    Count shmem/tmpfs objects as swap-backed.
+ *
+ * BDI_CAP_CGROUP_WRITEBACK: Supports cgroup-aware writeback, i.e. the IO
+ *			   issued for the dirty pages of a memory cgroup is
+ *			   attributed to the matching blkio cgroup.
  */
 #define BDI_CAP_NO_ACCT_DIRTY	0x00000001
 #define BDI_CAP_NO_WRITEBACK	0x00000002
@@ -253,6 +268,7 @@ int bdi_set_max_ratio(struct backing_dev_info *bdi, unsigned int max_ratio);
 #define BDI_CAP_EXEC_MAP	0x00000040
 #define BDI_CAP_NO_ACCT_WB	0x00000080
 #define BDI_CAP_SWAP_BACKED	0x00000100
+#define BDI_CAP_CGROUP_WRITEBACK 0x00000200
 
 #define BDI_CAP_VMFLAGS \
 	(BDI_CAP_READ_MAP | BDI_CAP_WRITE_MAP | BDI_CAP_EXEC_MAP)
@@ -349,6 +365,196 @@ static inline bool mapping_cap_swap_backed(struct address_space *mapping)
 	return bdi_cap_swap_backed(mapping->backing_dev_info);
 }
 
+/*
+ * cgroup writeback
+ *
+ * With CONFIG_CGROUP_WRITEBACK, a bdi has a bdi_writeback per memory
+ * cgroup which dirtied pages on it, in addition to the root one embedded
+ * in the bdi.  Each wb has its own dirty inode lists, stats and bandwidth
+ * estimation, and its IO is issued on behalf of the blkio cgroup of the
+ * memcg.  An inode is attached to the wb of the memcg which owns most of
+ * its dirty pages through inode->i_wb; see fs/fs-writeback.c.
+ *
+ * The root wb is not reference counted, wb_get() and wb_put() on it are
+ * no-ops.
+ */
+struct wb_lock_cookie {
+	bool locked;
+	unsigned long flags;
+};
+
+#ifdef CONFIG_CGROUP_WRITEBACK
+
+void wb_release(struct bdi_writeback *wb);
+struct bdi_writeback *wb_get_lookup(struct backing_dev_info *bdi,
+				    unsigned short memcg_id);
+struct bdi_writeback *wb_get_create(struct backing_dev_info *bdi,
+				    unsigned short memcg_id, gfp_t gfp);
+struct bdi_writeback *bdi_next_wb(struct backing_dev_info *bdi,
+				  struct bdi_writeback *prev);
+void cgwb_memcg_offline(unsigned short memcg_id);
+
+static inline bool wb_is_root(struct bdi_writeback *wb)
+{
+	return wb == &wb->bdi->wb;
+}
+
+static inline void wb_get(struct bdi_writeback *wb)
+{
+	if (!wb_is_root(wb))
+		atomic_inc(&wb->refcnt);
+}
+
+static inline bool wb_tryget(struct bdi_writeback *wb)
+{
+	return wb_is_root(wb) || atomic_inc_not_zero(&wb->refcnt);
+}
+
+static inline void wb_put(struct bdi_writeback *wb)
+{
+	if (!wb_is_root(wb) && atomic_dec_and_test(&wb->refcnt))
+		wb_release(wb);
+}
+
+/*
+ * Can the dirty pages of @inode be attributed to cgroup wbs?  The bdi
+ * must tag the IO with the blkio cgroup and the filesystem must pass
+ * the writeback_control down to the bios it submits, see wbc_init_bio().
+ */
+static inline bool inode_cgwb_enabled(struct inode *inode)
+{
+	struct backing_dev_info *bdi = inode->i_mapping->backing_dev_info;
+
+	return bdi_cap_account_dirty(bdi) &&
+		(bdi->capabilities & BDI_CAP_CGROUP_WRITEBACK) &&
+		(inode->i_sb->s_type->fs_flags & FS_CGROUP_WRITEBACK);
+}
+
+/*
+ * mapping_to_wb - the wb the pages of @mapping are accounted to
+ *
+ * The caller must hold the mapping's tree_lock or the i_lock of its host,
+ * or otherwise keep the inode from switching wbs, see
+ * unlocked_mapping_to_wb_begin().
+ */
+static inline struct bdi_writeback *mapping_to_wb(struct address_space *mapping)
+{
+	struct inode *inode = mapping->host;
+
+	if (inode && inode->i_mapping == mapping && inode->i_wb)
+		return inode->i_wb;
+	return &mapping->backing_dev_info->wb;
+}
+
+/**
+ * unlocked_mapping_to_wb_begin - begin an unlocked page stat transaction
+ * @mapping: mapping of interest
+ * @cookie: output param, to be passed to the end function
+ *
+ * Page stats which are updated outside the tree_lock, like the dirty
+ * count in clear_page_dirty_for_io(), must not race against the inode
+ * switching wbs, or the counts would end up on the wrong wb.  This makes
+ * the wb returned stable until unlocked_mapping_to_wb_end().  Nests
+ * inside the page lock and outside the mapping's tree_lock.
+ */
+static inline struct bdi_writeback *
+unlocked_mapping_to_wb_begin(struct address_space *mapping,
+			     struct wb_lock_cookie *cookie)
+{
+	struct inode *inode = mapping->host;
+
+	rcu_read_lock();
+
+	/*
+	 * inode_switch_wbs() sets I_WB_SWITCH and then waits for an RCU
+	 * grace period before it starts moving stats; switching is done
+	 * under the tree_lock.  The barrier pairs with the one before
+	 * I_WB_SWITCH is cleared, so that we see the new i_wb after it.
+	 */
+	cookie->locked = inode && (ACCESS_ONCE(inode->i_state) & I_WB_SWITCH);
+	smp_rmb();
+
+	if (unlikely(cookie->locked))
+		spin_lock_irqsave(&mapping->tree_lock, cookie->flags);
+
+	return mapping_to_wb(mapping);
+}
+
+static inline void unlocked_mapping_to_wb_end(struct address_space *mapping,
+					      struct wb_lock_cookie *cookie)
+{
+	if (unlikely(cookie->locked))
+		spin_unlock_irqrestore(&mapping->tree_lock, cookie->flags);
+
+	rcu_read_unlock();
+}
+
+#else	/* CONFIG_CGROUP_WRITEBACK */
+
+static inline void wb_get(struct bdi_writeback *wb)
+{
+}
+
+static inline bool wb_tryget(struct bdi_writeback *wb)
+{
+	return true;
+}
+
+static inline void wb_put(struct bdi_writeback *wb)
+{
+}
+
+static inline struct bdi_writeback *
+wb_get_lookup(struct backing_dev_info *bdi, unsigned short memcg_id)
+{
+	return &bdi->wb;
+}
+
+static inline struct bdi_writeback *
+wb_get_create(struct backing_dev_info *bdi, unsigned short memcg_id, gfp_t gfp)
+{
+	return &bdi->wb;
+}
+
+static inline struct bdi_writeback *
+bdi_next_wb(struct backing_dev_info *bdi, struct bdi_writeback *prev)
+{
+	return prev ? NULL : &bdi->wb;
+}
+
+static inline bool inode_cgwb_enabled(struct inode *inode)
+{
+	return false;
+}
+
+static inline struct bdi_writeback *mapping_to_wb(struct address_space *mapping)
+{
+	return &mapping->backing_dev_info->wb;
+}
+
+static inline struct bdi_writeback *
+unlocked_mapping_to_wb_begin(struct address_space *mapping,
+			     struct wb_lock_cookie *cookie)
+{
+	return mapping_to_wb(mapping);
+}
+
+static inline void unlocked_mapping_to_wb_end(struct address_space *mapping,
+					      struct wb_lock_cookie *cookie)
+{
+}
+
+#endif	/* CONFIG_CGROUP_WRITEBACK */
+
+/*
+ * Iterate over all wbs of @bdi, the root one first.  A reference is held
+ * on @wb inside the loop body; breaking out of the loop leaves the caller
+ * with that reference, which must be dropped with wb_put().
+ */
+#define bdi_for_each_wb(wb, bdi)					\
+	for ((wb) = bdi_next_wb((bdi), NULL); (wb);			\
+	     (wb) = bdi_next_wb((bdi), (wb)))
+
 static inline int bdi_sched_wait(void *word)
 {
 	schedule();
@@ -9,9 +9,11 @@
 #include <linux/seqlock.h>
 #include <linux/cache.h>
 #include <linux/rcupdate.h>
+#include <linux/wait.h>
 
 struct nameidata;
 struct path;
+struct d_in_lookup;
 struct vfsmount;
 
 /*
@@ -207,6 +209,7 @@ struct dentry_operations {
 	(DCACHE_MOUNTED|DCACHE_NEED_AUTOMOUNT|DCACHE_MANAGE_TRANSIT)
 
 #define DCACHE_DENTRY_KILLED	0x100000
+#define DCACHE_PAR_LOOKUP	0x200000 /* being looked up, see d_alloc_parallel() */
 
 extern seqlock_t rename_lock;
 
@@ -229,6 +232,9 @@ extern void d_set_d_op(struct dentry *dentry, const struct dentry_operations *op
 /* allocate/de-allocate */
 extern struct dentry * d_alloc(struct dentry *, const struct qstr *);
 extern struct dentry * d_alloc_pseudo(struct super_block *, const struct qstr *);
+extern struct dentry * d_alloc_parallel(struct dentry *, struct qstr *,
+					struct d_in_lookup *);
+extern void d_lookup_done(struct d_in_lookup *);
 extern struct dentry * d_splice_alias(struct inode *, struct dentry *);
 extern struct dentry * d_add_ci(struct dentry *, struct inode *, struct qstr *);
 extern struct dentry *d_find_any_alias(struct inode *inode);
@@ -408,6 +414,26 @@ static inline bool d_mountpoint(struct dentry *dentry)
 	return dentry->d_flags & DCACHE_MOUNTED;
 }
 
+/*
+ * A lookup that runs without the parent's i_mutex.  The caller of
+ * d_alloc_parallel() provides this, usually on its stack, and gets back a
+ * dentry in the DCACHE_PAR_LOOKUP state if nobody else is looking up the
+ * same name.  Others that look up the name until d_lookup_done() is called
+ * sleep on @wq instead of calling ->lookup() again.
+ */
+struct d_in_lookup {
+	struct hlist_bl_node	hash;
+	struct dentry		*dentry;
+	struct dentry		*parent;
+	const struct qstr	*name;
+	wait_queue_head_t	wq;
+};
+
+static inline bool d_in_lookup(struct dentry *dentry)
+{
+	return dentry->d_flags & DCACHE_PAR_LOOKUP;
+}
+
 static inline bool d_need_lookup(struct dentry *dentry)
 {
 	return dentry->d_flags & DCACHE_NEED_LOOKUP;
@@ -36,6 +36,7 @@ typedef void (elevator_deactivate_req_fn) (struct request_queue *, struct reques
 
 typedef int (elevator_init_fn) (struct request_queue *);
 typedef void (elevator_exit_fn) (struct elevator_queue *);
+typedef void (elevator_registered_fn) (struct request_queue *);
 
 struct elevator_ops
 {
@@ -65,6 +66,10 @@ struct elevator_ops
 
 	elevator_init_fn *elevator_init_fn;
 	elevator_exit_fn *elevator_exit_fn;
+
+	/* queue shows up in / goes away from sysfs, see elv_register_queue */
+	elevator_registered_fn *elevator_registered_fn;
+	elevator_registered_fn *elevator_unregistered_fn;
 };
 
 #define ELV_NAME_MAX	(16)
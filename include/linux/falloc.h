@@ -4,8 +4,39 @@
 #define FALLOC_FL_KEEP_SIZE	0x01 /* default is extend size */
 #define FALLOC_FL_PUNCH_HOLE	0x02 /* de-allocates range */
 
+/*
+ * FALLOC_FL_COLLAPSE_RANGE removes the range from the file and shifts the
+ * data behind it down, so that the file shrinks by len bytes without
+ * leaving a hole.  offset and len must be multiples of the file system
+ * block size and the range must end before EOF.  It can't be combined
+ * with any other flag.
+ */
+#define FALLOC_FL_COLLAPSE_RANGE	0x08
+
+/*
+ * FALLOC_FL_ZERO_RANGE zeroes the range: partial blocks at either end are
+ * zeroed, whole blocks are converted to unwritten extents (or allocated as
+ * such) so that later reads return zeroes without the data being written.
+ * The file is extended past its end unless FALLOC_FL_KEEP_SIZE is given.
+ */
+#define FALLOC_FL_ZERO_RANGE		0x10
+
+/*
+ * FALLOC_FL_INSERT_RANGE opens up a hole of len bytes at offset by
+ * shifting the data from there on up, growing the file by len bytes.
+ * offset and len must be multiples of the file system block size and
+ * offset must be before EOF.  It can't be combined with any other flag.
+ */
+#define FALLOC_FL_INSERT_RANGE		0x20
+
 #ifdef __KERNEL__
 
+#define FALLOC_FL_SUPPORTED_MASK	(FALLOC_FL_KEEP_SIZE |		\
+					 FALLOC_FL_PUNCH_HOLE |		\
+					 FALLOC_FL_COLLAPSE_RANGE |	\
+					 FALLOC_FL_ZERO_RANGE |		\
+					 FALLOC_FL_INSERT_RANGE)
+
 /*
  * Space reservation ioctls and argument structure
  * are designed to be compatible with the legacy XFS ioctls.
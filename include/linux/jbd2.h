@@ -266,7 +266,9 @@ typedef struct journal_superblock_s
 /* 0x0050 */
 	__u8	s_checksum_type;	/* checksum type */
 	__u8	s_padding2[3];
-	__u32	s_padding[42];
+/* 0x0054 */
+	__be32	s_num_fc_blks;		/* Number of fast commit blocks */
+	__u32	s_padding[41];
 	__be32	s_checksum;		/* crc32c(superblock) */
 
 /* 0x0100 */
@@ -290,6 +292,7 @@ typedef struct journal_superblock_s
 #define JBD2_FEATURE_INCOMPAT_64BIT		0x00000002
 #define JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT	0x00000004
 #define JBD2_FEATURE_INCOMPAT_CSUM_V2		0x00000008
+#define JBD2_FEATURE_INCOMPAT_FAST_COMMIT	0x00000020
 
 /* Features known to this kernel version: */
 #define JBD2_KNOWN_COMPAT_FEATURES	JBD2_FEATURE_COMPAT_CHECKSUM
@@ -297,7 +300,11 @@ typedef struct journal_superblock_s
 #define JBD2_KNOWN_INCOMPAT_FEATURES	(JBD2_FEATURE_INCOMPAT_REVOKE | \
 					JBD2_FEATURE_INCOMPAT_64BIT | \
 					JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT | \
-					JBD2_FEATURE_INCOMPAT_CSUM_V2)
+					JBD2_FEATURE_INCOMPAT_CSUM_V2 | \
+					JBD2_FEATURE_INCOMPAT_FAST_COMMIT)
+
+/* Size of the fast commit area if the superblock doesn't say otherwise */
+#define JBD2_DEFAULT_FAST_COMMIT_BLOCKS	256
 
 #ifdef __KERNEL__
 
@@ -468,9 +475,6 @@ struct transaction_chp_stats_s {
  *    ->j_list_lock
  *
  *    j_state_lock
- *    ->t_handle_lock
- *
- *    j_state_lock
  *    ->j_list_lock			(journal_unmap_buffer)
  *
  */
@@ -565,13 +569,9 @@ struct transaction_s
 	 */
 	struct list_head	t_inode_list;
 
-	/*
-	 * Protects info related to handles
-	 */
-	spinlock_t		t_handle_lock;
-
 	/*
 	 * Longest time some handle had to wait for running transaction
+	 * [updated locklessly with cmpxchg]
 	 */
 	unsigned long		t_max_wait;
 
@@ -587,13 +587,13 @@ struct transaction_s
 
 	/*
 	 * Number of outstanding updates running on this transaction
-	 * [t_handle_lock]
+	 * [none]
 	 */
 	atomic_t		t_updates;
 
 	/*
 	 * Number of buffers reserved for use by all handles in this transaction
-	 * handle but not yet modified. [t_handle_lock]
+	 * handle but not yet modified. [none]
 	 */
 	atomic_t		t_outstanding_credits;
 
@@ -615,7 +615,7 @@ struct transaction_s
 	ktime_t			t_start_time;
 
 	/*
-	 * How many handles used this transaction? [t_handle_lock]
+	 * How many handles used this transaction? [none]
 	 */
 	atomic_t		t_handle_count;
 
@@ -647,11 +647,32 @@ struct transaction_run_stats_s {
 	__u32			rs_blocks_logged;
 };
 
+/*
+ * Latency histograms kept per journal.  Bucket 0 counts times below one
+ * millisecond, bucket n times in [2^(n-1), 2^n) milliseconds and the last
+ * bucket everything above.
+ */
+#define JBD2_HIST_BUCKETS	16
+
+enum {
+	JBD2_HIST_LOCKED,	/* waiting for updates to finish */
+	JBD2_HIST_FLUSHING,	/* flushing data in ordered mode */
+	JBD2_HIST_LOGGING,	/* writing the transaction to the log */
+	JBD2_HIST_COMMIT,	/* whole commit */
+	JBD2_HIST_NR,
+};
+
 struct transaction_stats_s {
 	unsigned long		ts_tid;
 	struct transaction_run_stats_s run;
+	unsigned long		ts_hist[JBD2_HIST_NR][JBD2_HIST_BUCKETS];
 };
 
+static inline unsigned int jbd2_hist_bucket(unsigned int msecs)
+{
+	return min_t(unsigned int, fls(msecs), JBD2_HIST_BUCKETS - 1);
+}
+
 static inline unsigned long
 jbd2_time_diff(unsigned long start, unsigned long end)
 {
@@ -693,6 +714,13 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_free: Journal free - how many free blocks are there in the journal?
  * @j_first: The block number of the first usable block
  * @j_last: The block number one beyond the last usable block
+ * @j_fc_first: The block number of the first fast commit block
+ * @j_fc_last: The block number one beyond the last fast commit block
+ * @j_fc_off: Number of fast commit blocks used since the last full commit
+ * @j_fc_start: Value of @j_fc_off when the current fast commit started
+ * @j_fc_wbuf: buffer_heads of the fast commit blocks being written
+ * @j_fc_wait: Wait queue for fast and full commits to exclude each other
+ * @j_fc_replay_tid: Transaction the fast commit area has to be replayed for
  * @j_dev: Device where we store the journal
  * @j_blocksize: blocksize for the location where we store the journal.
  * @j_blk_offset: starting block offset for into the device where we store the
@@ -839,6 +867,23 @@ struct journal_s
 	unsigned long		j_first;
 	unsigned long		j_last;
 
+	/*
+	 * Fast commit area: the blocks at the end of the journal set aside
+	 * for fast commits, and how many of them have been used since the
+	 * last full commit.  [j_state_lock] [JBD2_FAST_COMMIT_ONGOING]
+	 */
+	unsigned long		j_fc_first;
+	unsigned long		j_fc_last;
+	unsigned long		j_fc_off;
+	unsigned long		j_fc_start;
+	struct buffer_head	**j_fc_wbuf;
+
+	/* Wait queue for a fast or full commit to finish */
+	wait_queue_head_t	j_fc_wait;
+
+	/* Transaction whose fast commits recovery found in the area */
+	tid_t			j_fc_replay_tid;
+
 	/*
 	 * Device, blocksize and starting block offset for the location where we
 	 * store the journal.
@@ -959,6 +1004,12 @@ struct journal_s
 	struct proc_dir_entry	*j_proc_entry;
 	struct transaction_stats_s j_stats;
 
+	/*
+	 * Histogram of the time handles spent blocked in start_this_handle(),
+	 * updated without j_history_lock so that handle start stays scalable
+	 */
+	atomic_t		j_handle_wait_hist[JBD2_HIST_BUCKETS];
+
 	/* Failed journal commit ID */
 	unsigned int		j_failed_commit;
 
@@ -987,6 +1038,10 @@ struct journal_s
 #define JBD2_ABORT_ON_SYNCDATA_ERR	0x040	/* Abort the journal on file
 						 * data write error in ordered
 						 * mode */
+#define JBD2_FAST_COMMIT_ONGOING	0x080	/* A fast commit is being
+						 * written */
+#define JBD2_FULL_COMMIT_ONGOING	0x100	/* A full commit is running */
+#define JBD2_FC_REPLAY	0x200	/* Recovery left fast commits to replay */
 
 /*
  * Function declarations for the journaling transaction and buffer
@@ -1214,6 +1269,14 @@ int jbd2_log_wait_commit(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
 int jbd2_trans_will_send_data_barrier(journal_t *journal, tid_t tid);
 
+/* Fast commits */
+int jbd2_fc_begin_commit(journal_t *journal, tid_t tid);
+int jbd2_fc_get_buf(journal_t *journal, struct buffer_head **bh_out);
+int jbd2_fc_end_commit(journal_t *journal);
+void jbd2_fc_abort_commit(journal_t *journal);
+int jbd2_fc_read_block(journal_t *journal, unsigned long off,
+		       struct buffer_head **bh_out);
+
 void __jbd2_log_wait_for_space(journal_t *journal);
 extern void __jbd2_journal_drop_transaction(journal_t *, transaction_t *);
 extern int jbd2_cleanup_journal_tail(journal_t *);
@@ -21,6 +21,7 @@
 #define _LINUX_MEMCONTROL_H
 #include <linux/cgroup.h>
 #include <linux/vm_event_item.h>
+#include <linux/jump_label.h>
 
 struct mem_cgroup;
 struct page_cgroup;
@@ -407,5 +408,75 @@ static inline void sock_release_memcg(struct sock *sk)
 {
 }
 #endif /* CONFIG_MEMCG_KMEM */
+
+struct kmem_cache;
+struct shrink_control;
+#ifdef CONFIG_MEMCG_KMEM
+extern struct static_key memcg_kmem_enabled_key;
+
+/*
+ * True once any memcg has ever had a kmem limit set. Until then the slab
+ * allocators do not even look at the memcg of the allocating task.
+ */
+static inline bool memcg_kmem_enabled(void)
+{
+	return static_key_false(&memcg_kmem_enabled_key);
+}
+
+bool memcg_kmem_is_active(struct mem_cgroup *memcg);
+bool __memcg_kmem_owns(struct mem_cgroup *memcg, const void *obj);
+void memcg_shrink_slab(struct mem_cgroup *memcg, struct shrink_control *shrink,
+		       unsigned long nr_scanned);
+
+/*
+ * Shrinkers use this to tell whether the slab object @obj is charged to
+ * @memcg or one of its children. Everything belongs to the NULL memcg of
+ * global reclaim.
+ */
+static inline bool memcg_kmem_owns(struct mem_cgroup *memcg, const void *obj)
+{
+	if (!memcg || !memcg_kmem_enabled())
+		return true;
+	return __memcg_kmem_owns(memcg, obj);
+}
+
+/* Interface to the slab allocators, see mm/slab.h */
+int memcg_register_cache(struct mem_cgroup *memcg, struct kmem_cache *s,
+			 struct kmem_cache *root_cache);
+void memcg_release_cache(struct kmem_cache *s);
+void kmem_cache_destroy_memcg_children(struct kmem_cache *s);
+struct kmem_cache *__memcg_kmem_get_cache(struct kmem_cache *cachep,
+					  gfp_t gfp);
+int __memcg_charge_slab(struct kmem_cache *s, gfp_t gfp, int order);
+void __memcg_uncharge_slab(struct kmem_cache *s, int order);
+#else
+static inline bool memcg_kmem_enabled(void)
+{
+	return false;
+}
+
+static inline bool memcg_kmem_is_active(struct mem_cgroup *memcg)
+{
+	return false;
+}
+
+static inline bool memcg_kmem_owns(struct mem_cgroup *memcg, const void *obj)
+{
+	return true;
+}
+
+static inline void memcg_shrink_slab(struct mem_cgroup *memcg,
+				     struct shrink_control *shrink,
+				     unsigned long nr_scanned)
+{
+}
+#endif /* CONFIG_MEMCG_KMEM */
+
+#ifdef CONFIG_CGROUP_WRITEBACK
+unsigned short mem_cgroup_wb_current_id(void);
+unsigned short mem_cgroup_wb_page_id(struct page *page);
+bool mem_cgroup_wb_domain(unsigned short id, unsigned long *pavail);
+struct cgroup_subsys_state *mem_cgroup_wb_blkcg_css(unsigned short id);
+#endif
 #endif /* _LINUX_MEMCONTROL_H */
 
@@ -191,6 +191,14 @@ extern void rcu_idle_enter(void);
 extern void rcu_idle_exit(void);
 extern void rcu_irq_enter(void);
 extern void rcu_irq_exit(void);
+
+#ifdef CONFIG_CONTEXT_TRACKING
+extern void rcu_user_enter(void);
+extern void rcu_user_exit(void);
+#else
+static inline void rcu_user_enter(void) { }
+static inline void rcu_user_exit(void) { }
+#endif /* CONFIG_CONTEXT_TRACKING */
 extern void exit_rcu(void);
 
 /**
@@ -26,6 +26,15 @@ struct rw_semaphore {
 	long			count;
 	raw_spinlock_t		wait_lock;
 	struct list_head	wait_list;
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	/*
+	 * Write owner, or RWSEM_READER_OWNED.  Used by writers to spin
+	 * while the owner is running instead of going to sleep.
+	 */
+	struct task_struct	*owner;
+	/* set when the first waiter must not be robbed by spinners */
+	int			handoff;
+#endif
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
 	struct lockdep_map	dep_map;
 #endif
@@ -39,6 +48,14 @@ extern struct rw_semaphore *rwsem_downgrade_wake(struct rw_semaphore *sem);
 /* Include the arch specific part */
 #include <asm/rwsem.h>
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Readers aren't tracked individually, sem->owner only records that the
+ * rwsem was last acquired for read.  Spinning on readers is pointless.
+ */
+#define RWSEM_READER_OWNED	((struct task_struct *)1UL)
+#endif
+
 /* In all implementations count != 0 means locked */
 static inline int rwsem_is_locked(struct rw_semaphore *sem)
 {
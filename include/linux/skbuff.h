@@ -567,6 +567,9 @@ static inline struct rtable *skb_rtable(const struct sk_buff *skb)
 
 extern void kfree_skb(struct sk_buff *skb);
 extern void consume_skb(struct sk_buff *skb);
+extern void napi_consume_skb(struct sk_buff *skb, int budget);
+extern void __kfree_skb_defer(struct sk_buff *skb);
+extern void __kfree_skb_flush(void);
 extern void	       __kfree_skb(struct sk_buff *skb);
 extern struct kmem_cache *skbuff_head_cache;
 
@@ -11,6 +11,7 @@
 
 #include <linux/gfp.h>
 #include <linux/types.h>
+#include <linux/workqueue.h>
 
 /*
  * Flags to pass to kmem_cache_create().
@@ -116,6 +117,49 @@ struct kmem_cache {
 };
 #endif
 
+struct mem_cgroup;
+
+#ifdef CONFIG_MEMCG_KMEM
+/*
+ * Per-cache state for kernel memory accounting in memory cgroups.
+ *
+ * A root cache (one created through kmem_cache_create()) gets an array
+ * of per-memcg copies, indexed by the memcg's kmem id and filled in
+ * lazily the first time a task of that memcg allocates from the cache.
+ * Each copy charges its slab pages to its memcg and points back to the
+ * root cache it was made from.
+ *
+ * @is_root_cache: true for a root cache, false for a per-memcg copy
+ * @rcu_head: frees the array of a root cache after it was grown
+ * @nr_caches: number of slots in @memcg_caches
+ * @memcg_caches: per-memcg copies of a root cache
+ * @memcg: the memcg a copy charges its pages to
+ * @list: entry on the memcg's list of copies
+ * @root_cache: the root cache a copy was made from
+ * @cachep: back pointer to the copy itself
+ * @nr_pages: slab pages charged by a copy
+ * @destroy: destroys a copy once its memcg is gone and it is empty
+ */
+struct memcg_cache_params {
+	bool is_root_cache;
+	union {
+		struct {
+			struct rcu_head rcu_head;
+			int nr_caches;
+			struct kmem_cache *memcg_caches[0];
+		};
+		struct {
+			struct mem_cgroup *memcg;
+			struct list_head list;
+			struct kmem_cache *root_cache;
+			struct kmem_cache *cachep;
+			atomic_t nr_pages;
+			struct delayed_work destroy;
+		};
+	};
+};
+#endif
+
 /*
  * struct kmem_cache related prototypes
  */
@@ -125,11 +169,25 @@ int slab_is_available(void);
 struct kmem_cache *kmem_cache_create(const char *, size_t, size_t,
 			unsigned long,
 			void (*)(void *));
+struct kmem_cache *
+kmem_cache_create_memcg(struct mem_cgroup *, const char *, size_t, size_t,
+			unsigned long, void (*)(void *), struct kmem_cache *);
 void kmem_cache_destroy(struct kmem_cache *);
 int kmem_cache_shrink(struct kmem_cache *);
 void kmem_cache_free(struct kmem_cache *, void *);
 unsigned int kmem_cache_size(struct kmem_cache *);
 
+/*
+ * Bulk allocation and freeing operations. These are accelerated in an
+ * allocator specific way to avoid taking locks repeatedly or building
+ * metadata structures unnecessarily.
+ *
+ * kmem_cache_alloc_bulk() returns the number of objects stored in the
+ * array, which is either all of them or zero.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *, gfp_t, size_t, void **);
+void kmem_cache_free_bulk(struct kmem_cache *, size_t, void **);
+
 /*
  * Please use this macro to create slab caches. Simply specify the
  * name of the structure and maybe some flags that are listed above.
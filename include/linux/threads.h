@@ -37,7 +37,10 @@
  * Define a minimum number of pids per cpu.  Heuristically based
  * on original pid max of 32k for 32 cpus.  Also, increase the
  * minimum settable value for pid_max on the running system based
- * on similar defaults.  See kernel/pid.c:pidmap_init() for details.
+ * on similar defaults.  PIDs come from a per-namespace idr, which
+ * only allocates layers for the PIDs in use, so a larger pid_max
+ * costs no memory up front.  See kernel/pid.c:pid_idr_init() for
+ * details.
  */
 #define PIDS_PER_CPU_DEFAULT	1024
 #define PIDS_PER_CPU_MIN	8
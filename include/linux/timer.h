@@ -49,16 +49,22 @@ extern struct tvec_base boot_tvec_bases;
 #endif
 
 /*
- * Note that all tvec_bases are 2 byte aligned and lower bit of
- * base in timer_list is guaranteed to be zero. Use the LSB to
+ * Note that all tvec_bases are 4 byte aligned and the lower two bits of
+ * base in timer_list are guaranteed to be zero. Use the LSB to
  * indicate whether the timer is deferrable.
  *
  * A deferrable timer will work normally when the system is busy, but
  * will not cause a CPU to come out of idle just to service it; instead,
  * the timer will be serviced when the CPU eventually wakes up with a
  * subsequent non-deferrable timer.
+ *
+ * The second bit is set while the timer is armed on a particular CPU by
+ * mod_timer_pinned() or add_timer_on(), such a timer is never pulled to
+ * a busy CPU when its own CPU goes idle.
  */
 #define TBASE_DEFERRABLE_FLAG		(0x1)
+#define TBASE_PINNED_FLAG		(0x2)
+#define TBASE_FLAG_MASK			(TBASE_DEFERRABLE_FLAG | TBASE_PINNED_FLAG)
 
 #define TIMER_INITIALIZER(_function, _expires, _data) {		\
 		.entry = { .prev = TIMER_ENTRY_STATIC },	\
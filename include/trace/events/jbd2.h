@@ -132,6 +132,32 @@ TRACE_EVENT(jbd2_submit_inode_data,
 		  (unsigned long) __entry->ino)
 );
 
+TRACE_EVENT(jbd2_handle_start,
+	TP_PROTO(dev_t dev, unsigned long tid, int requested_blocks,
+		 unsigned long wait),
+
+	TP_ARGS(dev, tid, requested_blocks, wait),
+
+	TP_STRUCT__entry(
+		__field(		dev_t,	dev		)
+		__field(	unsigned long,	tid		)
+		__field(		  int,	requested_blocks)
+		__field(	unsigned long,	wait		)
+	),
+
+	TP_fast_assign(
+		__entry->dev		  = dev;
+		__entry->tid		  = tid;
+		__entry->requested_blocks = requested_blocks;
+		__entry->wait		  = wait;
+	),
+
+	TP_printk("dev %d,%d tid %lu requested_blocks %d wait %u",
+		  MAJOR(__entry->dev), MINOR(__entry->dev), __entry->tid,
+		  __entry->requested_blocks,
+		  jiffies_to_msecs(__entry->wait))
+);
+
 TRACE_EVENT(jbd2_run_stats,
 	TP_PROTO(dev_t dev, unsigned long tid,
 		 struct transaction_run_stats_s *stats),
@@ -2569,6 +2569,15 @@ void perf_event_task_tick(void)
 	}
 }
 
+/*
+ * The tick rotates multiplexed contexts and unthrottles frequency
+ * driven events; it may only be stopped when no context needs that.
+ */
+bool perf_event_can_stop_tick(void)
+{
+	return list_empty(&__get_cpu_var(rotation_list));
+}
+
 static int event_enable_on_exec(struct perf_event *event,
 				struct perf_event_context *ctx)
 {
@@ -8,6 +8,8 @@
 #include <linux/math64.h>
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
+#include <linux/tick.h>
+#include <linux/workqueue.h>
 #include <trace/events/timer.h>
 
 /*
@@ -525,6 +527,28 @@ static inline int expires_gt(cputime_t expires, cputime_t new_exp)
 	return expires == 0 || expires > new_exp;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+static void nohz_kick_work_fn(struct work_struct *work)
+{
+	tick_nohz_full_kick_all();
+}
+
+static DECLARE_WORK(nohz_kick_work, nohz_kick_work_fn);
+
+/*
+ * A full dynticks CPU may be running the task the new timer is queued
+ * on with its tick stopped.  We are called with locks held and irqs
+ * disabled, so leave the IPIs to a workqueue.
+ */
+static void posix_cpu_timer_kick_nohz(void)
+{
+	if (tick_nohz_full_enabled())
+		schedule_work(&nohz_kick_work);
+}
+#else
+static inline void posix_cpu_timer_kick_nohz(void) { }
+#endif
+
 /*
  * Insert the timer on the appropriate list before any timers that
  * expire later.  This must be called with the tasklist_lock held
@@ -581,6 +605,8 @@ static void arm_timer(struct k_itimer *timer)
 			break;
 		}
 	}
+
+	posix_cpu_timer_kick_nohz();
 }
 
 /*
@@ -1274,6 +1300,25 @@ static inline int fastpath_timer_check(struct task_struct *tsk)
 	return 0;
 }
 
+/**
+ * posix_cpu_timers_can_stop_tick - Check whether CPU timers need the tick.
+ *
+ * @tsk:	The task running on the local CPU.
+ *
+ * Expiry of CPU timers is only ever checked from the tick, so it can't
+ * be stopped while @tsk or its thread group has one armed.
+ */
+bool posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return false;
+
+	if (tsk->signal->cputimer.running)
+		return false;
+
+	return true;
+}
+
 /*
  * This is called from the timer interrupt handler.  The irq handler has
  * already updated our counts.  We need to check if any timers fire now.
@@ -1389,6 +1434,8 @@ void set_process_cpu_timer(struct task_struct *tsk, unsigned int clock_idx,
 			tsk->signal->cputime_expires.virt_exp = *newval;
 		break;
 	}
+
+	posix_cpu_timer_kick_nohz();
 }
 
 static int do_cpu_nanosleep(const clockid_t which_clock, int flags,
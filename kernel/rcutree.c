@@ -52,6 +52,8 @@
 #include <linux/prefetch.h>
 #include <linux/delay.h>
 #include <linux/stop_machine.h>
+#include <linux/tick.h>
+#include <linux/context_tracking.h>
 
 #include "rcutree.h"
 #include <trace/events/rcu.h>
@@ -62,7 +64,7 @@
 
 static struct lock_class_key rcu_node_class[RCU_NUM_LVLS];
 
-#define RCU_STATE_INITIALIZER(sname, cr) { \
+#define RCU_STATE_INITIALIZER(sname, sabbr, cr) { \
 	.level = { &sname##_state.node[0] }, \
 	.call = cr, \
 	.fqs_state = RCU_GP_IDLE, \
@@ -74,13 +76,14 @@ static struct lock_class_key rcu_node_class[RCU_NUM_LVLS];
 	.barrier_mutex = __MUTEX_INITIALIZER(sname##_state.barrier_mutex), \
 	.fqslock = __RAW_SPIN_LOCK_UNLOCKED(&sname##_state.fqslock), \
 	.name = #sname, \
+	.abbr = sabbr, \
 }
 
 struct rcu_state rcu_sched_state =
-	RCU_STATE_INITIALIZER(rcu_sched, call_rcu_sched);
+	RCU_STATE_INITIALIZER(rcu_sched, 's', call_rcu_sched);
 DEFINE_PER_CPU(struct rcu_data, rcu_sched_data);
 
-struct rcu_state rcu_bh_state = RCU_STATE_INITIALIZER(rcu_bh, call_rcu_bh);
+struct rcu_state rcu_bh_state = RCU_STATE_INITIALIZER(rcu_bh, 'b', call_rcu_bh);
 DEFINE_PER_CPU(struct rcu_data, rcu_bh_data);
 
 static struct rcu_state *rcu_state;
@@ -305,8 +308,9 @@ cpu_has_callbacks_ready_to_invoke(struct rcu_data *rdp)
 static int
 cpu_needs_another_gp(struct rcu_state *rsp, struct rcu_data *rdp)
 {
-	return *rdp->nxttail[RCU_DONE_TAIL +
-			     ACCESS_ONCE(rsp->completed) != rdp->completed] &&
+	return (*rdp->nxttail[RCU_DONE_TAIL +
+			      ACCESS_ONCE(rsp->completed) != rdp->completed] ||
+		rcu_nocb_needs_gp(rsp)) &&
 	       !rcu_gp_in_progress(rsp);
 }
 
@@ -352,21 +356,27 @@ static int rcu_implicit_offline_qs(struct rcu_data *rdp)
  *
  * If the new value of the ->dynticks_nesting counter now is zero,
  * we really have entered idle, and must do the appropriate accounting.
+ * With @user set the extended quiescent state is userspace rather than
+ * the idle loop, which needs no idle preparation.
  * The caller must have disabled interrupts.
  */
-static void rcu_idle_enter_common(struct rcu_dynticks *rdtp, long long oldval)
+static void rcu_idle_enter_common(struct rcu_dynticks *rdtp, long long oldval,
+				  bool user)
 {
 	trace_rcu_dyntick("Start", oldval, 0);
-	if (!is_idle_task(current)) {
-		struct task_struct *idle = idle_task(smp_processor_id());
-
-		trace_rcu_dyntick("Error on entry: not idle task", oldval, 0);
-		ftrace_dump(DUMP_ORIG);
-		WARN_ONCE(1, "Current pid: %d comm: %s / Idle pid: %d comm: %s",
-			  current->pid, current->comm,
-			  idle->pid, idle->comm); /* must be idle task! */
+	if (!user) {
+		if (!is_idle_task(current)) {
+			struct task_struct *idle = idle_task(smp_processor_id());
+
+			trace_rcu_dyntick("Error on entry: not idle task",
+					  oldval, 0);
+			ftrace_dump(DUMP_ORIG);
+			WARN_ONCE(1, "Current pid: %d comm: %s / Idle pid: %d comm: %s",
+				  current->pid, current->comm,
+				  idle->pid, idle->comm); /* must be idle task! */
+		}
+		rcu_prepare_for_idle(smp_processor_id());
 	}
-	rcu_prepare_for_idle(smp_processor_id());
 	/* CPUs seeing atomic_inc() must see prior RCU read-side crit sects */
 	smp_mb__before_atomic_inc();  /* See above. */
 	atomic_inc(&rdtp->dynticks);
@@ -385,19 +395,15 @@ static void rcu_idle_enter_common(struct rcu_dynticks *rdtp, long long oldval)
 			   "Illegal idle entry in RCU-sched read-side critical section.");
 }
 
-/**
- * rcu_idle_enter - inform RCU that current CPU is entering idle
- *
- * Enter idle mode, in other words, -leave- the mode in which RCU
- * read-side critical sections can occur.  (Though RCU read-side
- * critical sections can occur in irq handlers in idle, a possibility
- * handled by irq_enter() and irq_exit().)
+/*
+ * Enter an RCU extended quiescent state, which can be either the
+ * idle loop or adaptive-tickless usermode execution.
  *
  * We crowbar the ->dynticks_nesting field to zero to allow for
  * the possibility of usermode upcalls having messed up our count
  * of interrupt nesting level during the prior busy period.
  */
-void rcu_idle_enter(void)
+static void rcu_eqs_enter(bool user)
 {
 	unsigned long flags;
 	long long oldval;
@@ -411,11 +417,39 @@ void rcu_idle_enter(void)
 		rdtp->dynticks_nesting = 0;
 	else
 		rdtp->dynticks_nesting -= DYNTICK_TASK_NEST_VALUE;
-	rcu_idle_enter_common(rdtp, oldval);
+	rcu_idle_enter_common(rdtp, oldval, user);
 	local_irq_restore(flags);
 }
+
+/**
+ * rcu_idle_enter - inform RCU that current CPU is entering idle
+ *
+ * Enter idle mode, in other words, -leave- the mode in which RCU
+ * read-side critical sections can occur.  (Though RCU read-side
+ * critical sections can occur in irq handlers in idle, a possibility
+ * handled by irq_enter() and irq_exit().)
+ */
+void rcu_idle_enter(void)
+{
+	rcu_eqs_enter(false);
+}
 EXPORT_SYMBOL_GPL(rcu_idle_enter);
 
+#ifdef CONFIG_CONTEXT_TRACKING
+/**
+ * rcu_user_enter - inform RCU that we are resuming userspace.
+ *
+ * Enter RCU idle mode right before resuming userspace.  No use of RCU
+ * is permitted between this call and rcu_user_exit(). This way the
+ * CPU doesn't need to maintain the tick for RCU maintenance purposes
+ * when the CPU runs in userspace.
+ */
+void rcu_user_enter(void)
+{
+	rcu_eqs_enter(true);
+}
+#endif /* #ifdef CONFIG_CONTEXT_TRACKING */
+
 /**
  * rcu_irq_exit - inform RCU that current CPU is exiting irq towards idle
  *
@@ -446,7 +480,8 @@ void rcu_irq_exit(void)
 	if (rdtp->dynticks_nesting)
 		trace_rcu_dyntick("--=", oldval, rdtp->dynticks_nesting);
 	else
-		rcu_idle_enter_common(rdtp, oldval);
+		rcu_idle_enter_common(rdtp, oldval,
+				      context_tracking_in_user());
 	local_irq_restore(flags);
 }
 
@@ -455,18 +490,21 @@ void rcu_irq_exit(void)
  *
  * If the new value of the ->dynticks_nesting counter was previously zero,
  * we really have exited idle, and must do the appropriate accounting.
+ * With @user set the CPU is leaving userspace rather than the idle loop.
  * The caller must have disabled interrupts.
  */
-static void rcu_idle_exit_common(struct rcu_dynticks *rdtp, long long oldval)
+static void rcu_idle_exit_common(struct rcu_dynticks *rdtp, long long oldval,
+				 bool user)
 {
 	smp_mb__before_atomic_inc();  /* Force ordering w/previous sojourn. */
 	atomic_inc(&rdtp->dynticks);
 	/* CPUs seeing atomic_inc() must see later RCU read-side crit sects */
 	smp_mb__after_atomic_inc();  /* See above. */
 	WARN_ON_ONCE(!(atomic_read(&rdtp->dynticks) & 0x1));
-	rcu_cleanup_after_idle(smp_processor_id());
+	if (!user)
+		rcu_cleanup_after_idle(smp_processor_id());
 	trace_rcu_dyntick("End", oldval, rdtp->dynticks_nesting);
-	if (!is_idle_task(current)) {
+	if (!user && !is_idle_task(current)) {
 		struct task_struct *idle = idle_task(smp_processor_id());
 
 		trace_rcu_dyntick("Error on exit: not idle task",
@@ -478,18 +516,16 @@ static void rcu_idle_exit_common(struct rcu_dynticks *rdtp, long long oldval)
 	}
 }
 
-/**
- * rcu_idle_exit - inform RCU that current CPU is leaving idle
- *
- * Exit idle mode, in other words, -enter- the mode in which RCU
- * read-side critical sections can occur.
+/*
+ * Exit an RCU extended quiescent state, which can be either the
+ * idle loop or adaptive-tickless usermode execution.
  *
  * We crowbar the ->dynticks_nesting field to DYNTICK_TASK_NEST to
  * allow for the possibility of usermode upcalls messing up our count
  * of interrupt nesting level during the busy period that is just
  * now starting.
  */
-void rcu_idle_exit(void)
+static void rcu_eqs_exit(bool user)
 {
 	unsigned long flags;
 	struct rcu_dynticks *rdtp;
@@ -503,11 +539,35 @@ void rcu_idle_exit(void)
 		rdtp->dynticks_nesting += DYNTICK_TASK_NEST_VALUE;
 	else
 		rdtp->dynticks_nesting = DYNTICK_TASK_EXIT_IDLE;
-	rcu_idle_exit_common(rdtp, oldval);
+	rcu_idle_exit_common(rdtp, oldval, user);
 	local_irq_restore(flags);
 }
+
+/**
+ * rcu_idle_exit - inform RCU that current CPU is leaving idle
+ *
+ * Exit idle mode, in other words, -enter- the mode in which RCU
+ * read-side critical sections can occur.
+ */
+void rcu_idle_exit(void)
+{
+	rcu_eqs_exit(false);
+}
 EXPORT_SYMBOL_GPL(rcu_idle_exit);
 
+#ifdef CONFIG_CONTEXT_TRACKING
+/**
+ * rcu_user_exit - inform RCU that we are exiting userspace.
+ *
+ * Exit RCU idle mode while entering the kernel because it can
+ * run a RCU read side critical section anytime.
+ */
+void rcu_user_exit(void)
+{
+	rcu_eqs_exit(true);
+}
+#endif /* #ifdef CONFIG_CONTEXT_TRACKING */
+
 /**
  * rcu_irq_enter - inform RCU that current CPU is entering irq away from idle
  *
@@ -541,7 +601,8 @@ void rcu_irq_enter(void)
 	if (oldval)
 		trace_rcu_dyntick("++=", oldval, rdtp->dynticks_nesting);
 	else
-		rcu_idle_exit_common(rdtp, oldval);
+		rcu_idle_exit_common(rdtp, oldval,
+				     context_tracking_in_user());
 	local_irq_restore(flags);
 }
 
@@ -671,6 +732,34 @@ static int dyntick_save_progress_counter(struct rcu_data *rdp)
 	return (rdp->dynticks_snap & 0x1) == 0;
 }
 
+/*
+ * How long a grace period waits on a full dynticks CPU before kicking
+ * it, and how long between two kicks of the same CPU.
+ */
+#define RCU_NOHZ_FULL_KICK_DELAY	(HZ / 20 ?: 1)
+
+/*
+ * A full dynticks CPU that stays in the kernel is neither idle nor
+ * offline, but it may not see a tick for a long time.  Once it has held
+ * up the grace period for a while, poke it so that it restarts its tick
+ * and reports a quiescent state.  Userspace is an extended quiescent
+ * state, such CPUs never get here.
+ */
+static void rcu_kick_nohz_cpu(struct rcu_data *rdp)
+{
+	if (!tick_nohz_full_cpu(rdp->cpu))
+		return;
+
+	if (ULONG_CMP_LT(jiffies,
+			 rdp->rsp->gp_start + RCU_NOHZ_FULL_KICK_DELAY) ||
+	    ULONG_CMP_LT(jiffies,
+			 rdp->nohz_full_kick + RCU_NOHZ_FULL_KICK_DELAY))
+		return;
+
+	rdp->nohz_full_kick = jiffies;
+	smp_send_reschedule(rdp->cpu);
+}
+
 /*
  * Return true if the specified CPU has passed through a quiescent
  * state by virtue of being in or having passed through an dynticks
@@ -700,7 +789,11 @@ static int rcu_implicit_dynticks_qs(struct rcu_data *rdp)
 	}
 
 	/* Go check for the CPU being offline. */
-	return rcu_implicit_offline_qs(rdp);
+	if (rcu_implicit_offline_qs(rdp))
+		return 1;
+
+	rcu_kick_nohz_cpu(rdp);
+	return 0;
 }
 
 static int jiffies_till_stall_check(void)
@@ -1403,6 +1496,10 @@ static void rcu_adopt_orphan_cbs(struct rcu_state *rsp)
 	    rsp->rcu_barrier_in_progress != current)
 		return;
 
+	/* No-CBs CPUs hand the orphans over to their kthread. */
+	if (rcu_nocb_adopt_orphan_cbs(rsp, rdp))
+		return;
+
 	/* Do the accounting first. */
 	rdp->qlen_lazy += rsp->qlen_lazy;
 	rdp->qlen += rsp->qlen;
@@ -1832,6 +1929,9 @@ __rcu_process_callbacks(struct rcu_state *rsp)
 	/* If there are callbacks ready, invoke them. */
 	if (cpu_has_callbacks_ready_to_invoke(rdp))
 		invoke_rcu_callbacks(rsp, rdp);
+
+	/* Wake up callback-offload kthreads waiting for a grace period. */
+	rcu_nocb_gp_wake(rsp);
 }
 
 /*
@@ -1943,6 +2043,12 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
+	/* No-CBs CPUs hand the callback over to their kthread. */
+	if (__call_rcu_nocb(rdp, head, lazy)) {
+		local_irq_restore(flags);
+		return;
+	}
+
 	/* Add the callback to our list. */
 	ACCESS_ONCE(rdp->qlen)++;
 	if (lazy)
@@ -2281,6 +2387,31 @@ static int rcu_cpu_has_callbacks(int cpu)
 	return 0;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * A full dynticks CPU only needs the tick for RCU while the current
+ * grace period waits on it, or while it has callbacks of its own; grace
+ * periods themselves are driven by the other CPUs.  Interrupts that came
+ * from userspace don't count: that is an extended quiescent state which
+ * force_quiescent_state() reports on this CPU's behalf.
+ */
+int rcu_nohz_full_needs_tick(int cpu)
+{
+	struct rcu_state *rsp;
+
+	if (!context_tracking_in_user()) {
+		for_each_rcu_flavor(rsp) {
+			struct rcu_data *rdp = per_cpu_ptr(rsp->rda, cpu);
+
+			if (ACCESS_ONCE(rdp->mynode->qsmask) & rdp->grpmask)
+				return 1;
+		}
+	}
+
+	return rcu_cpu_has_callbacks(cpu);
+}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+
 /*
  * Helper function for _rcu_barrier() tracing.  If tracing is disabled,
  * the compiler is expected to optimize this away.
@@ -2405,7 +2536,16 @@ static void _rcu_barrier(struct rcu_state *rsp)
 	for_each_possible_cpu(cpu) {
 		preempt_disable();
 		rdp = per_cpu_ptr(rsp->rda, cpu);
-		if (cpu_is_offline(cpu)) {
+		if (is_nocb_cpu(cpu)) {
+			_rcu_barrier_trace(rsp, "OnlineNoCB", cpu,
+					   rsp->n_barrier_done);
+			preempt_enable();
+			atomic_inc(&rsp->barrier_cpu_count);
+			debug_rcu_head_queue(&rdp->barrier_head);
+			rdp->barrier_head.func = rcu_barrier_callback;
+			rdp->barrier_head.next = NULL;
+			__call_rcu_nocb(rdp, &rdp->barrier_head, 0);
+		} else if (cpu_is_offline(cpu)) {
 			_rcu_barrier_trace(rsp, "Offline", cpu,
 					   rsp->n_barrier_done);
 			preempt_enable();
@@ -2502,6 +2642,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
@@ -2526,6 +2667,7 @@ rcu_init_percpu_data(int cpu, struct rcu_state *rsp, int preemptible)
 	rdp->qlen_last_fqs_check = 0;
 	rdp->n_force_qs_snap = rsp->n_force_qs;
 	rdp->blimit = blimit;
+	rdp->nohz_full_kick = jiffies - RCU_NOHZ_FULL_KICK_DELAY;
 	rdp->dynticks->dynticks_nesting = DYNTICK_TASK_EXIT_IDLE;
 	atomic_set(&rdp->dynticks->dynticks,
 		   (atomic_read(&rdp->dynticks->dynticks) & ~0x1) + 1);
@@ -2737,6 +2879,7 @@ static void __init rcu_init_one(struct rcu_state *rsp,
 		per_cpu_ptr(rsp->rda, i)->mynode = rnp;
 		rcu_boot_init_percpu_data(i, rsp);
 	}
+	rcu_init_one_nocb(rsp);
 	list_add(&rsp->flavors, &rcu_struct_flavors);
 }
 
@@ -27,6 +27,7 @@
 #include <linux/threads.h>
 #include <linux/cpumask.h>
 #include <linux/seqlock.h>
+#include <linux/wait.h>
 
 /*
  * Define shape of hierarchy based on NR_CPUS, CONFIG_RCU_FANOUT, and
@@ -303,6 +304,7 @@ struct rcu_data {
 	/* 4) reasons this CPU needed to be kicked by force_quiescent_state */
 	unsigned long dynticks_fqs;	/* Kicked due to dynticks idle. */
 	unsigned long offline_fqs;	/* Kicked due to being offline. */
+	unsigned long nohz_full_kick;	/* jiffies of last tick restart IPI. */
 
 	/* 5) __rcu_pending() statistics. */
 	unsigned long n_rcu_pending;	/* rcu_pending() calls since boot. */
@@ -318,6 +320,22 @@ struct rcu_data {
 	/* 6) _rcu_barrier() callback. */
 	struct rcu_head barrier_head;
 
+#ifdef CONFIG_RCU_NOCB_CPU
+	/* 7) Callback offloading. */
+	struct rcu_head *nocb_head;	/* CBs waiting for kthread. */
+	struct rcu_head **nocb_tail;
+	atomic_long_t nocb_q_count;	/* # CBs waiting for kthread */
+	atomic_long_t nocb_q_count_lazy; /*  (approximate). */
+	int nocb_p_count;		/* # CBs being invoked by kthread */
+	int nocb_p_count_lazy;		/*  (approximate). */
+	unsigned long nocb_batch_start;	/* jiffies at which the batch */
+					/*  being invoked was grabbed, */
+					/*  or zero if none. */
+	unsigned long nocb_gp_waits;	/* # of grace periods waited for. */
+	wait_queue_head_t nocb_wq;	/* For nocb kthreads to sleep on. */
+	struct task_struct *nocb_kthread;
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 	int cpu;
 	struct rcu_state *rsp;
 };
@@ -422,7 +440,17 @@ struct rcu_state {
 						/*  for CPU stalls. */
 	unsigned long gp_max;			/* Maximum GP duration in */
 						/*  jiffies. */
+#ifdef CONFIG_RCU_NOCB_CPU
+	unsigned long nocb_gp_wanted;		/* Grace period needed by */
+						/*  callback-offload kthreads. */
+						/*  Guarded by root node lock. */
+	unsigned long nocb_gp_woken;		/* ->completed at last wakeup */
+						/*  of the waiting kthreads. */
+	wait_queue_head_t nocb_gp_wq;		/* Callback-offload kthreads */
+						/*  wait for GPs here. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 	char *name;				/* Name of structure. */
+	char abbr;				/* Abbreviated name. */
 	struct list_head flavors;		/* List of RCU flavors. */
 };
 
@@ -510,5 +538,14 @@ static void print_cpu_stall_info(struct rcu_state *rsp, int cpu);
 static void print_cpu_stall_info_end(void);
 static void zero_cpu_stall_ticks(struct rcu_data *rdp);
 static void increment_cpu_stall_ticks(void);
+static bool is_nocb_cpu(int cpu);
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy);
+static bool rcu_nocb_needs_gp(struct rcu_state *rsp);
+static bool rcu_nocb_adopt_orphan_cbs(struct rcu_state *rsp,
+				      struct rcu_data *rdp);
+static void rcu_nocb_gp_wake(struct rcu_state *rsp);
+static void __init rcu_init_one_nocb(struct rcu_state *rsp);
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp);
 
 #endif /* #ifndef RCU_TREE_NONCORE */
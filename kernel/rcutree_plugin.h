@@ -25,6 +25,7 @@
  */
 
 #include <linux/delay.h>
+#include <linux/bootmem.h>
 
 #define RCU_KTHREAD_PRIO 1
 
@@ -79,7 +80,7 @@ static void __init rcu_bootup_announce_oddness(void)
 #ifdef CONFIG_TREE_PREEMPT_RCU
 
 struct rcu_state rcu_preempt_state =
-	RCU_STATE_INITIALIZER(rcu_preempt, call_rcu);
+	RCU_STATE_INITIALIZER(rcu_preempt, 'p', call_rcu);
 DEFINE_PER_CPU(struct rcu_data, rcu_preempt_data);
 static struct rcu_state *rcu_state = &rcu_preempt_state;
 
@@ -2227,3 +2228,359 @@ static void increment_cpu_stall_ticks(void)
 }
 
 #endif /* #else #ifdef CONFIG_RCU_CPU_STALL_INFO */
+
+/*
+ * Offload callback processing from the boot-time-specified set of CPUs
+ * specified by rcu_nocb_mask.  For each CPU in the set, there is a
+ * kthread created that pulls the callbacks from the corresponding CPU,
+ * waits for a grace period to elapse, and invokes the callbacks.
+ * The no-CBs CPUs do a wake_up() on their kthread when they insert
+ * a callback into any empty list.
+ *
+ * The kthreads are not bound to any CPU, so that they can be moved to
+ * housekeeping CPUs.  Because the offloaded CPUs may run with their
+ * scheduling-clock interrupt turned off, the kthreads request and drive
+ * the grace periods they need themselves.  Kthreads waiting for the same
+ * grace period share a single wakeup when it ends.
+ */
+#ifdef CONFIG_RCU_NOCB_CPU
+
+static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
+
+/* Parse the boot-time rcu_nocbs CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask)
+		return cpumask_test_cpu(cpu, rcu_nocb_mask);
+	return false;
+}
+
+/*
+ * Does a callback-offload kthread need a grace period that has not yet
+ * been started?  The caller must check for a grace period in progress.
+ */
+static bool rcu_nocb_needs_gp(struct rcu_state *rsp)
+{
+	return ULONG_CMP_LT(ACCESS_ONCE(rsp->completed),
+			    ACCESS_ONCE(rsp->nocb_gp_wanted));
+}
+
+/*
+ * Wake up the callback-offload kthreads once per grace-period end.
+ * Called from RCU core processing, where no RCU locks are held.
+ */
+static void rcu_nocb_gp_wake(struct rcu_state *rsp)
+{
+	unsigned long c = ACCESS_ONCE(rsp->completed);
+
+	if (c == ACCESS_ONCE(rsp->nocb_gp_woken))
+		return;
+	ACCESS_ONCE(rsp->nocb_gp_woken) = c;
+	smp_mb(); /* ->completed update before waitqueue_active() check. */
+	if (waitqueue_active(&rsp->nocb_gp_wq))
+		wake_up_all(&rsp->nocb_gp_wq);
+}
+
+/*
+ * Enqueue the specified string of rcu_head structures onto the specified
+ * CPU's no-CBs lists.  The CPU is specified by rdp, the head of the
+ * string by rhp, and the tail of the string by rhtp.  The non-lazy/lazy
+ * counts are supplied by rhcount and rhcount_lazy.
+ *
+ * If warranted, also wake up the kthread servicing this CPUs queues.
+ */
+static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
+				    struct rcu_head *rhp,
+				    struct rcu_head **rhtp,
+				    int rhcount, int rhcount_lazy)
+{
+	struct rcu_head **old_rhpp;
+	struct task_struct *t;
+
+	/* Enqueue the callback on the nocb list and update counts. */
+	old_rhpp = xchg(&rdp->nocb_tail, rhtp);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	atomic_long_add(rhcount, &rdp->nocb_q_count);
+	atomic_long_add(rhcount_lazy, &rdp->nocb_q_count_lazy);
+
+	/* If there is a kthread and the queue was empty, awaken it. */
+	t = ACCESS_ONCE(rdp->nocb_kthread);
+	if (!t)
+		return;
+	if (old_rhpp == &rdp->nocb_head)
+		wake_up(&rdp->nocb_wq);
+}
+
+/*
+ * This is a helper for __call_rcu(), which invokes this when the normal
+ * callback queue is inoperable.  If this is not a no-CBs CPU, this
+ * function returns failure back to __call_rcu(), which can complain
+ * appropriately.
+ *
+ * Otherwise, this function queues the callback where the corresponding
+ * "rcuo" kthread can find it.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy)
+{
+	if (!is_nocb_cpu(rdp->cpu))
+		return 0;
+	__call_rcu_nocb_enqueue(rdp, rhp, &rhp->next, 1, lazy);
+	if (__is_kfree_rcu_offset((unsigned long)rhp->func))
+		trace_rcu_kfree_callback(rdp->rsp->name, rhp,
+					 (unsigned long)rhp->func,
+					 atomic_long_read(&rdp->nocb_q_count_lazy),
+					 atomic_long_read(&rdp->nocb_q_count));
+	else
+		trace_rcu_callback(rdp->rsp->name, rhp,
+				   atomic_long_read(&rdp->nocb_q_count_lazy),
+				   atomic_long_read(&rdp->nocb_q_count));
+	return 1;
+}
+
+/*
+ * Adopt orphaned callbacks on a no-CBs CPU, or return 0 if this is
+ * not a no-CBs CPU.  The caller must hold the ->onofflock.
+ */
+static bool rcu_nocb_adopt_orphan_cbs(struct rcu_state *rsp,
+				      struct rcu_data *rdp)
+{
+	long ql = rsp->qlen;
+	long qll = rsp->qlen_lazy;
+
+	/* If this is not a no-CBs CPU, tell the caller to do it the old way. */
+	if (!is_nocb_cpu(smp_processor_id()))
+		return 0;
+	rsp->qlen = 0;
+	rsp->qlen_lazy = 0;
+	rdp->n_cbs_adopted += ql;
+
+	/* First, enqueue the donelist, if any.  This preserves CB ordering. */
+	if (rsp->orphan_donelist != NULL) {
+		__call_rcu_nocb_enqueue(rdp, rsp->orphan_donelist,
+					rsp->orphan_donetail, ql, qll);
+		ql = qll = 0;
+		rsp->orphan_donelist = NULL;
+		rsp->orphan_donetail = &rsp->orphan_donelist;
+	}
+	if (rsp->orphan_nxtlist != NULL) {
+		__call_rcu_nocb_enqueue(rdp, rsp->orphan_nxtlist,
+					rsp->orphan_nxttail, ql, qll);
+		ql = qll = 0;
+		rsp->orphan_nxtlist = NULL;
+		rsp->orphan_nxttail = &rsp->orphan_nxtlist;
+	}
+	return 1;
+}
+
+/*
+ * Push the grace period a callback-offload kthread is waiting for:
+ * start it if nobody did, otherwise force quiescent states on behalf
+ * of the CPUs that are in dyntick-idle mode.
+ */
+static void rcu_nocb_kick_gp(struct rcu_state *rsp)
+{
+	unsigned long flags;
+	struct rcu_node *rnp = rcu_get_root(rsp);
+
+	if (!rcu_gp_in_progress(rsp)) {
+		raw_spin_lock_irqsave(&rnp->lock, flags);
+		rcu_start_gp(rsp, flags);  /* releases above lock */
+	} else {
+		force_quiescent_state(rsp, 1);
+	}
+}
+
+/*
+ * Wait for a grace period that starts after the callbacks just grabbed
+ * by the kthread were queued to complete.
+ */
+static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+{
+	unsigned long c;
+	unsigned long flags;
+	struct rcu_state *rsp = rdp->rsp;
+	struct rcu_node *rnp = rcu_get_root(rsp);
+
+	smp_mb(); /* Callback grab before grace-period request. */
+	raw_spin_lock_irqsave(&rnp->lock, flags);
+	c = rsp->gpnum + 1;
+	if (ULONG_CMP_LT(rsp->nocb_gp_wanted, c))
+		rsp->nocb_gp_wanted = c;
+	rcu_start_gp(rsp, flags);  /* releases above lock */
+	rdp->nocb_gp_waits++;
+
+	for (;;) {
+		wait_event_interruptible_timeout(rsp->nocb_gp_wq,
+			ULONG_CMP_GE(ACCESS_ONCE(rsp->completed), c),
+			RCU_JIFFIES_TILL_FORCE_QS);
+		if (ULONG_CMP_GE(ACCESS_ONCE(rsp->completed), c))
+			break;
+		rcu_nocb_kick_gp(rsp);
+	}
+	smp_mb(); /* Ensure that CB invocation happens after GP end. */
+}
+
+/*
+ * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
+ * callbacks queued by the corresponding no-CBs CPU.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	int c, cl;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	struct rcu_data *rdp = arg;
+
+	/* Each pass through this loop invokes one batch of callbacks */
+	for (;;) {
+		/* Wait for callbacks to be queued. */
+		wait_event_interruptible(rdp->nocb_wq,
+					 ACCESS_ONCE(rdp->nocb_head));
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list)
+			continue;
+
+		/*
+		 * Extract queued callbacks, update counts, and wait
+		 * for a grace period to elapse.
+		 */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		c = atomic_long_xchg(&rdp->nocb_q_count, 0);
+		cl = atomic_long_xchg(&rdp->nocb_q_count_lazy, 0);
+		ACCESS_ONCE(rdp->nocb_p_count) += c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) += cl;
+		ACCESS_ONCE(rdp->nocb_batch_start) = jiffies;
+		rcu_nocb_wait_gp(rdp);
+
+		/* Each pass through the following loop invokes a callback. */
+		trace_rcu_batch_start(rdp->rsp->name, cl, c, -1);
+		c = cl = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for enqueuing to complete, if needed. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = list->next;
+			}
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			if (__rcu_reclaim(rdp->rsp->name, list))
+				cl++;
+			c++;
+			local_bh_enable();
+			cond_resched();
+			list = next;
+		}
+		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
+		ACCESS_ONCE(rdp->nocb_p_count) -= c;
+		ACCESS_ONCE(rdp->nocb_p_count_lazy) -= cl;
+		rdp->n_cbs_invoked += c;
+	}
+	return 0;
+}
+
+/* Initialize the rcu_state fields used by callback offloading. */
+static void __init rcu_init_one_nocb(struct rcu_state *rsp)
+{
+	rsp->nocb_gp_wanted = rsp->completed;
+	rsp->nocb_gp_woken = rsp->completed;
+	init_waitqueue_head(&rsp->nocb_gp_wq);
+}
+
+/* Initialize per-rcu_data variables for no-CBs CPUs. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_waitqueue_head(&rdp->nocb_wq);
+}
+
+/* Create a kthread for each RCU flavor for each no-CBs CPU. */
+static void __init rcu_spawn_nocb_kthreads(struct rcu_state *rsp)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct task_struct *t;
+
+	for_each_cpu(cpu, rcu_nocb_mask) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		t = kthread_run(rcu_nocb_kthread, rdp,
+				"rcuo%c/%d", rsp->abbr, cpu);
+		BUG_ON(IS_ERR(t));
+		ACCESS_ONCE(rdp->nocb_kthread) = t;
+	}
+}
+
+/*
+ * Spawn the callback-offload kthreads -- called once the scheduler is
+ * running.  Callbacks queued before then are picked up as soon as the
+ * kthreads start.
+ */
+static int __init rcu_spawn_all_nocb_kthreads(void)
+{
+	struct rcu_state *rsp;
+	char buf[64];
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+	cpumask_and(rcu_nocb_mask, cpu_possible_mask, rcu_nocb_mask);
+	if (cpumask_empty(rcu_nocb_mask))
+		return 0;
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	pr_info("\tOffload RCU callbacks from CPUs: %s.\n", buf);
+	for_each_rcu_flavor(rsp)
+		rcu_spawn_nocb_kthreads(rsp);
+	return 0;
+}
+early_initcall(rcu_spawn_all_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static bool rcu_nocb_needs_gp(struct rcu_state *rsp)
+{
+	return false;
+}
+
+static void rcu_nocb_gp_wake(struct rcu_state *rsp)
+{
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp,
+			    bool lazy)
+{
+	return 0;
+}
+
+static bool rcu_nocb_adopt_orphan_cbs(struct rcu_state *rsp,
+				      struct rcu_data *rdp)
+{
+	return 0;
+}
+
+static void __init rcu_init_one_nocb(struct rcu_state *rsp)
+{
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
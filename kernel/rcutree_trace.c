@@ -115,6 +115,18 @@ static void print_one_rcu_data(struct seq_file *m, struct rcu_data *rdp)
 		   per_cpu(rcu_cpu_kthread_cpu, rdp->cpu),
 		   per_cpu(rcu_cpu_kthread_loops, rdp->cpu) & 0xffff);
 #endif /* #ifdef CONFIG_RCU_BOOST */
+#ifdef CONFIG_RCU_NOCB_CPU
+	if (rdp->nocb_kthread) {
+		unsigned long start = ACCESS_ONCE(rdp->nocb_batch_start);
+		int np = ACCESS_ONCE(rdp->nocb_p_count);
+
+		seq_printf(m, " nq=%ld/%ld np=%d/%d lag=%lu ngw=%lu",
+			   atomic_long_read(&rdp->nocb_q_count_lazy),
+			   atomic_long_read(&rdp->nocb_q_count),
+			   ACCESS_ONCE(rdp->nocb_p_count_lazy), np,
+			   np ? jiffies - start : 0, rdp->nocb_gp_waits);
+	}
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 	seq_printf(m, " b=%ld", rdp->blimit);
 	seq_printf(m, " ci=%lu co=%lu ca=%lu\n",
 		   rdp->n_cbs_invoked, rdp->n_cbs_orphaned, rdp->n_cbs_adopted);
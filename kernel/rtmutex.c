@@ -95,14 +95,24 @@ static inline void mark_rt_mutex_waiters(struct rt_mutex *lock)
  *
  * Return task->normal_prio when the waiter list is empty or when
  * the waiter is not allowed to do priority boosting
+ *
+ * Only SCHED_DEADLINE tasks have the parameters to run as -deadline
+ * tasks: any other task boosted by a -deadline waiter gets the highest
+ * RT priority instead.
  */
 int rt_mutex_getprio(struct task_struct *task)
 {
+	int prio;
+
 	if (likely(!task_has_pi_waiters(task)))
 		return task->normal_prio;
 
-	return min(task_top_pi_waiter(task)->pi_list_entry.prio,
+	prio = min(task_top_pi_waiter(task)->pi_list_entry.prio,
 		   task->normal_prio);
+	if (dl_prio(prio) && !dl_prio(task->normal_prio))
+		prio = 0;
+
+	return prio;
 }
 
 /*
@@ -0,0 +1,234 @@
+/*
+ *  kernel/sched/cpudeadline.c
+ *
+ *  Global CPU deadline management
+ *
+ *  This code tracks the deadline of the -deadline task currently
+ *  running on each CPU of a root domain, so that push and wakeup
+ *  decisions for SCHED_DEADLINE tasks can be taken quickly.  CPUs
+ *  running no -deadline task at all are kept in a mask (free_cpus),
+ *  the others in a max-heap keyed by deadline: the root of the heap
+ *  is the CPU whose current -deadline task has the latest deadline,
+ *  i.e. the best candidate to be preempted.  Finding it costs O(1),
+ *  updating a CPU's deadline O(log(nr_cpus)).
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; version 2
+ *  of the License.
+ */
+
+#include <linux/gfp.h>
+#include <linux/kernel.h>
+#include "cpudeadline.h"
+
+static inline int parent(int i)
+{
+	return (i - 1) >> 1;
+}
+
+static inline int left_child(int i)
+{
+	return (i << 1) + 1;
+}
+
+static inline int right_child(int i)
+{
+	return (i << 1) + 2;
+}
+
+static inline int dl_time_before(u64 a, u64 b)
+{
+	return (s64)(a - b) < 0;
+}
+
+static void cpudl_exchange(struct cpudl *cp, int a, int b)
+{
+	int cpu_a = cp->elements[a].cpu, cpu_b = cp->elements[b].cpu;
+
+	swap(cp->elements[a], cp->elements[b]);
+	swap(cp->cpu_to_idx[cpu_a], cp->cpu_to_idx[cpu_b]);
+}
+
+/* Move the element at @idx down until the heap property holds again */
+static void cpudl_heapify_down(struct cpudl *cp, int idx)
+{
+	int l, r, largest;
+
+	for (;;) {
+		l = left_child(idx);
+		r = right_child(idx);
+		largest = idx;
+
+		if (l < cp->size && dl_time_before(cp->elements[idx].dl,
+						   cp->elements[l].dl))
+			largest = l;
+		if (r < cp->size && dl_time_before(cp->elements[largest].dl,
+						   cp->elements[r].dl))
+			largest = r;
+		if (largest == idx)
+			break;
+
+		cpudl_exchange(cp, largest, idx);
+		idx = largest;
+	}
+}
+
+/* Move the element at @idx up until the heap property holds again */
+static void cpudl_heapify_up(struct cpudl *cp, int idx)
+{
+	while (idx > 0 && dl_time_before(cp->elements[parent(idx)].dl,
+					 cp->elements[idx].dl)) {
+		cpudl_exchange(cp, idx, parent(idx));
+		idx = parent(idx);
+	}
+}
+
+static void cpudl_change_key(struct cpudl *cp, int idx, u64 new_dl)
+{
+	u64 old_dl = cp->elements[idx].dl;
+
+	cp->elements[idx].dl = new_dl;
+	if (dl_time_before(new_dl, old_dl))
+		cpudl_heapify_down(cp, idx);
+	else
+		cpudl_heapify_up(cp, idx);
+}
+
+/**
+ * cpudl_find - find the best (later-dl) CPU in the system
+ * @cp: the cpudl max-heap context
+ * @p: the task
+ * @later_mask: a mask to fill in with the selected CPUs (or NULL)
+ *
+ * Returns: int - best CPU (heap maximum if suitable), or -1
+ */
+int cpudl_find(struct cpudl *cp, struct task_struct *p,
+	       struct cpumask *later_mask)
+{
+	int best_cpu = -1;
+
+	if (later_mask && cpumask_and(later_mask, cp->free_cpus,
+				      tsk_cpus_allowed(p)) &&
+	    cpumask_and(later_mask, later_mask, cpu_active_mask))
+		return cpumask_any(later_mask);
+
+	/* The heap is read locklessly, this is only a hint */
+	if (ACCESS_ONCE(cp->size) > 0) {
+		best_cpu = cp->elements[0].cpu;
+
+		if (!cpumask_test_cpu(best_cpu, tsk_cpus_allowed(p)) ||
+		    !dl_time_before(p->dl.deadline, cp->elements[0].dl))
+			return -1;
+
+		if (later_mask) {
+			cpumask_clear(later_mask);
+			cpumask_set_cpu(best_cpu, later_mask);
+		}
+	}
+
+	return best_cpu;
+}
+
+/**
+ * cpudl_set - update the cpudl max-heap
+ * @cp: the cpudl max-heap context
+ * @cpu: the target cpu
+ * @dl: the new earliest deadline for this cpu
+ * @is_valid: 0 if the cpu no longer runs -deadline tasks
+ *
+ * Notes: assumes cpu_rq(cpu)->lock is locked
+ */
+void cpudl_set(struct cpudl *cp, int cpu, u64 dl, int is_valid)
+{
+	int old_idx, new_cpu;
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&cp->lock, flags);
+	old_idx = cp->cpu_to_idx[cpu];
+
+	if (!is_valid) {
+		if (old_idx == IDX_INVALID)
+			goto out;
+
+		/* Replace the element with the last one and fix the heap */
+		cp->size--;
+		new_cpu = cp->elements[cp->size].cpu;
+		cp->cpu_to_idx[cpu] = IDX_INVALID;
+		if (old_idx != cp->size) {
+			cp->elements[old_idx] = cp->elements[cp->size];
+			cp->cpu_to_idx[new_cpu] = old_idx;
+			cpudl_heapify_up(cp, old_idx);
+			cpudl_heapify_down(cp, cp->cpu_to_idx[new_cpu]);
+		}
+		cpumask_set_cpu(cpu, cp->free_cpus);
+		goto out;
+	}
+
+	if (old_idx == IDX_INVALID) {
+		old_idx = cp->size++;
+		cp->elements[old_idx].dl = dl;
+		cp->elements[old_idx].cpu = cpu;
+		cp->cpu_to_idx[cpu] = old_idx;
+		cpudl_heapify_up(cp, old_idx);
+		cpumask_clear_cpu(cpu, cp->free_cpus);
+	} else {
+		cpudl_change_key(cp, old_idx, dl);
+	}
+
+out:
+	raw_spin_unlock_irqrestore(&cp->lock, flags);
+}
+
+/**
+ * cpudl_set_freecpu - set the cpudl.free_cpus
+ * @cp: the cpudl max-heap context
+ * @cpu: rd attached cpu
+ *
+ * Called when @cpu joins the root domain.
+ */
+void cpudl_set_freecpu(struct cpudl *cp, int cpu)
+{
+	cpumask_set_cpu(cpu, cp->free_cpus);
+}
+
+/**
+ * cpudl_clear_freecpu - clear the cpudl.free_cpus
+ * @cp: the cpudl max-heap context
+ * @cpu: rd attached cpu
+ *
+ * Called when @cpu leaves the root domain.
+ */
+void cpudl_clear_freecpu(struct cpudl *cp, int cpu)
+{
+	cpumask_clear_cpu(cpu, cp->free_cpus);
+}
+
+/**
+ * cpudl_init - initialize the cpudl structure
+ * @cp: the cpudl max-heap context
+ */
+int cpudl_init(struct cpudl *cp)
+{
+	int i;
+
+	memset(cp, 0, sizeof(*cp));
+	raw_spin_lock_init(&cp->lock);
+	cp->size = 0;
+	for (i = 0; i < NR_CPUS; i++)
+		cp->cpu_to_idx[i] = IDX_INVALID;
+
+	if (!zalloc_cpumask_var(&cp->free_cpus, GFP_KERNEL))
+		return -ENOMEM;
+
+	return 0;
+}
+
+/**
+ * cpudl_cleanup - clean up the cpudl structure
+ * @cp: the cpudl max-heap context
+ */
+void cpudl_cleanup(struct cpudl *cp)
+{
+	free_cpumask_var(cp->free_cpus);
+}
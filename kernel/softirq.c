@@ -348,8 +348,13 @@ void irq_exit(void)
 
 #ifdef CONFIG_NO_HZ
 	/* Make sure that timer wheel updates are propagated */
-	if (idle_cpu(smp_processor_id()) && !in_interrupt() && !need_resched())
-		tick_nohz_irq_exit();
+	if (!in_interrupt()) {
+		int cpu = smp_processor_id();
+
+		if ((idle_cpu(cpu) && !need_resched()) ||
+		    tick_nohz_full_cpu(cpu))
+			tick_nohz_irq_exit();
+	}
 #endif
 	rcu_irq_exit();
 	sched_preempt_enable_no_resched();
@@ -20,11 +20,17 @@
 #include <linux/profile.h>
 #include <linux/sched.h>
 #include <linux/module.h>
+#include <linux/bootmem.h>
+#include <linux/perf_event.h>
+#include <linux/posix-timers.h>
+#include <linux/context_tracking.h>
 
 #include <asm/irq_regs.h>
 
 #include "tick-internal.h"
 
+#include <trace/events/timer.h>
+
 /*
  * Per cpu nohz control structure
  */
@@ -40,6 +46,19 @@ struct tick_sched *tick_get_tick_sched(int cpu)
 	return &per_cpu(tick_cpu_sched, cpu);
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+static void tick_nohz_full_update_tick(struct tick_sched *ts, int user);
+static void tick_nohz_full_account_ticks(struct tick_sched *ts,
+					 struct task_struct *p,
+					 unsigned long handled);
+#else
+static inline void tick_nohz_full_update_tick(struct tick_sched *ts,
+					      int user) { }
+static inline void tick_nohz_full_account_ticks(struct tick_sched *ts,
+						struct task_struct *p,
+						unsigned long handled) { }
+#endif
+
 /*
  * Must be called with interrupts disabled !
  */
@@ -123,6 +142,44 @@ static int __init setup_tick_nohz(char *str)
 
 __setup("nohz=", setup_tick_nohz);
 
+#ifdef CONFIG_NO_HZ_FULL
+cpumask_var_t tick_nohz_full_mask;
+bool tick_nohz_full_running;
+
+/*
+ * Parse the boot-time nohz CPU list from the kernel parameters. The boot
+ * CPU keeps the timekeeping duty for the full dynticks CPUs, so it is
+ * never part of the set.
+ */
+static int __init tick_nohz_full_setup(char *str)
+{
+	int cpu;
+
+	alloc_bootmem_cpumask_var(&tick_nohz_full_mask);
+	if (cpulist_parse(str, tick_nohz_full_mask) < 0) {
+		pr_warning("NOHZ: Incorrect nohz_full cpumask\n");
+		return 1;
+	}
+
+	cpu = smp_processor_id();
+	if (cpumask_test_cpu(cpu, tick_nohz_full_mask)) {
+		pr_warning("NOHZ: Clearing %d from nohz_full range for timekeeping\n",
+			   cpu);
+		cpumask_clear_cpu(cpu, tick_nohz_full_mask);
+	}
+
+	if (!cpumask_empty(tick_nohz_full_mask)) {
+		tick_nohz_full_running = true;
+		for_each_cpu(cpu, tick_nohz_full_mask)
+			context_tracking_cpu_set(cpu);
+		pr_info("NOHZ: Full dynticks CPUs: %s.\n", str);
+	}
+
+	return 1;
+}
+__setup("nohz_full=", tick_nohz_full_setup);
+#endif
+
 /**
  * tick_nohz_update_jiffies - update jiffies when idle was interrupted
  *
@@ -372,9 +429,6 @@ static ktime_t tick_nohz_stop_sched_tick(struct tick_sched *ts,
 		 * the scheduler tick in nohz_restart_sched_tick.
 		 */
 		if (!ts->tick_stopped) {
-			select_nohz_load_balancer(1);
-			calc_load_enter_idle();
-
 			ts->last_tick = hrtimer_get_expires(&ts->sched_timer);
 			ts->tick_stopped = 1;
 		}
@@ -433,6 +487,21 @@ static bool can_stop_idle_tick(int cpu, struct tick_sched *ts)
 	if (need_resched())
 		return false;
 
+	if (tick_nohz_full_enabled()) {
+		/*
+		 * Keep the tick alive to guarantee timekeeping progression
+		 * if there are full dynticks CPUs around
+		 */
+		if (tick_do_timer_cpu == cpu)
+			return false;
+		/*
+		 * Boot safety: make sure the timekeeping duty has been
+		 * assigned before entering dyntick-idle mode,
+		 */
+		if (tick_do_timer_cpu == TICK_DO_TIMER_NONE)
+			return false;
+	}
+
 	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
 		static int ratelimit;
 
@@ -465,8 +534,11 @@ static void __tick_nohz_idle_enter(struct tick_sched *ts)
 			ts->idle_expires = expires;
 		}
 
-		if (!was_stopped && ts->tick_stopped)
+		if (!was_stopped && ts->tick_stopped) {
+			select_nohz_load_balancer(1);
+			calc_load_enter_idle();
 			ts->idle_jiffies = ts->last_jiffies;
+		}
 	}
 }
 
@@ -517,15 +589,22 @@ void tick_nohz_idle_enter(void)
  * a reschedule, it may still add, modify or delete a timer, enqueue
  * an RCU callback, etc...
  * So we need to re-calculate and reprogram the next tick event.
+ *
+ * On a full dynticks CPU running a task, this is also where the tick
+ * gets stopped or restarted.
  */
 void tick_nohz_irq_exit(void)
 {
 	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
 
-	if (!ts->inidle)
-		return;
+	if (ts->inidle) {
+		if (!need_resched())
+			__tick_nohz_idle_enter(ts);
+	} else {
+		struct pt_regs *regs = get_irq_regs();
 
-	__tick_nohz_idle_enter(ts);
+		tick_nohz_full_update_tick(ts, regs && user_mode(regs));
+	}
 }
 
 /**
@@ -569,11 +648,7 @@ static void tick_nohz_restart(struct tick_sched *ts, ktime_t now)
 static void tick_nohz_restart_sched_tick(struct tick_sched *ts, ktime_t now)
 {
 	/* Update jiffies first */
-	select_nohz_load_balancer(0);
 	tick_do_update_jiffies64(now);
-	update_cpu_load_nohz();
-
-	calc_load_exit_idle();
 	touch_softlockup_watchdog();
 	/*
 	 * Cancel the scheduled timer and restore the tick
@@ -584,6 +659,173 @@ static void tick_nohz_restart_sched_tick(struct tick_sched *ts, ktime_t now)
 	tick_nohz_restart(ts, now);
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+static bool can_stop_full_tick(int cpu)
+{
+	WARN_ON_ONCE(!irqs_disabled());
+
+	if (!sched_can_stop_tick()) {
+		trace_tick_stop(0, "more than 1 task in runqueue\n");
+		return false;
+	}
+
+	if (!posix_cpu_timers_can_stop_tick(current)) {
+		trace_tick_stop(0, "posix timers running\n");
+		return false;
+	}
+
+	if (!perf_event_can_stop_tick()) {
+		trace_tick_stop(0, "perf events running\n");
+		return false;
+	}
+
+	if (rcu_nohz_full_needs_tick(cpu)) {
+		trace_tick_stop(0, "rcu needs cpu\n");
+		return false;
+	}
+
+	/* sched_clock_tick() needs us? */
+#ifdef CONFIG_HAVE_UNSTABLE_SCHED_CLOCK
+	if (!sched_clock_stable) {
+		trace_tick_stop(0, "unstable sched clock\n");
+		return false;
+	}
+#endif
+
+	return true;
+}
+
+/*
+ * With the tick stopped, the cputime of the task running on a full
+ * dynticks CPU is no longer sampled. Account the jiffies that elapsed
+ * since the tick was stopped, or since the last flush, in one go when
+ * the task is switched out or the tick comes back. @handled ticks are
+ * accounted by the caller itself.
+ */
+static void tick_nohz_full_account_ticks(struct tick_sched *ts,
+					 struct task_struct *p,
+					 unsigned long handled)
+{
+#ifndef CONFIG_VIRT_CPU_ACCOUNTING
+	unsigned long ticks = jiffies - ts->full_jiffies;
+
+	ts->full_jiffies = jiffies;
+	/*
+	 * We might be one off. Do not randomly account a huge number of ticks!
+	 */
+	if (ticks > handled && ticks < LONG_MAX)
+		account_full_ticks(p, ticks - handled, ts->full_user);
+#endif
+}
+
+static void tick_nohz_full_update_tick(struct tick_sched *ts, int user)
+{
+	int cpu = smp_processor_id();
+	int was_stopped = ts->tick_stopped;
+
+	if (!tick_nohz_full_cpu(cpu) || is_idle_task(current))
+		return;
+
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+		return;
+
+	if (can_stop_full_tick(cpu)) {
+		tick_nohz_stop_sched_tick(ts, ktime_get(), cpu);
+		if (!was_stopped && ts->tick_stopped) {
+			ts->full_jiffies = jiffies;
+			ts->full_user = user;
+			trace_tick_stop(1, "");
+		}
+	} else if (was_stopped) {
+		tick_nohz_full_account_ticks(ts, current, 0);
+		tick_nohz_restart_sched_tick(ts, ktime_get());
+	}
+}
+
+/*
+ * Re-evaluate the need for the tick on the current CPU, and restart it
+ * if something needs it. Must be called with interrupts disabled.
+ */
+void tick_nohz_full_check(void)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+
+	if (tick_nohz_full_cpu(smp_processor_id())) {
+		if (ts->tick_stopped && !is_idle_task(current)) {
+			if (!can_stop_full_tick(smp_processor_id())) {
+				tick_nohz_full_account_ticks(ts, current, 0);
+				tick_nohz_restart_sched_tick(ts, ktime_get());
+			}
+		}
+	}
+}
+
+static void nohz_full_kick_ipi(void *info)
+{
+	tick_nohz_full_check();
+}
+
+/*
+ * Kick all full dynticks CPUs in order to force these to re-evaluate
+ * their dependency on the tick and restart it if necessary.
+ */
+void tick_nohz_full_kick_all(void)
+{
+	if (!tick_nohz_full_running)
+		return;
+
+	preempt_disable();
+	smp_call_function_many(tick_nohz_full_mask,
+			       nohz_full_kick_ipi, NULL, false);
+	tick_nohz_full_check();
+	preempt_enable();
+}
+
+/*
+ * Called by context tracking with interrupts disabled when the CPU
+ * crosses the kernel/user boundary: charge the tickless time so far to
+ * the side it is leaving, and what follows to the other one.
+ */
+void tick_nohz_full_user_switch(int user)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+
+	if (ts->tick_stopped && !ts->inidle) {
+		tick_nohz_full_account_ticks(ts, current, 0);
+		ts->full_user = user;
+	}
+}
+
+/*
+ * Called on context switch: charge the outgoing task with the cputime it
+ * consumed tickless, and restart the tick if the incoming task can't run
+ * without it. Idle restarts the tick too, so that it can stop it again on
+ * its own terms.
+ */
+void tick_nohz_task_switch(struct task_struct *prev)
+{
+	struct tick_sched *ts;
+	unsigned long flags;
+
+	if (!tick_nohz_full_cpu(smp_processor_id()))
+		return;
+
+	local_irq_save(flags);
+
+	ts = &__get_cpu_var(tick_cpu_sched);
+	if (ts->tick_stopped && !ts->inidle) {
+		tick_nohz_full_account_ticks(ts, prev, 0);
+		if (is_idle_task(current) ||
+		    !can_stop_full_tick(smp_processor_id()))
+			tick_nohz_restart_sched_tick(ts, ktime_get());
+		else
+			ts->full_user = 0;	/* until user_enter() */
+	}
+
+	local_irq_restore(flags);
+}
+#endif /* CONFIG_NO_HZ_FULL */
+
 static void tick_nohz_account_idle_ticks(struct tick_sched *ts)
 {
 #ifndef CONFIG_VIRT_CPU_ACCOUNTING
@@ -628,7 +870,10 @@ void tick_nohz_idle_exit(void)
 		tick_nohz_stop_idle(cpu, now);
 
 	if (ts->tick_stopped) {
+		select_nohz_load_balancer(0);
 		tick_nohz_restart_sched_tick(ts, now);
+		update_cpu_load_nohz();
+		calc_load_exit_idle();
 		tick_nohz_account_idle_ticks(ts);
 	}
 
@@ -660,7 +905,8 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 
 	/* Check, if the jiffies need an update */
@@ -677,7 +923,10 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	 */
 	if (ts->tick_stopped) {
 		touch_softlockup_watchdog();
-		ts->idle_jiffies++;
+		if (is_idle_task(current))
+			ts->idle_jiffies++;
+		else
+			tick_nohz_full_account_ticks(ts, current, 1);
 	}
 
 	update_process_times(user_mode(regs));
@@ -812,7 +1061,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	 * this duty, then the jiffies update is still serialized by
 	 * xtime_lock.
 	 */
-	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
+	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE) &&
+	    !tick_nohz_full_cpu(cpu))
 		tick_do_timer_cpu = cpu;
 #endif
 
@@ -837,6 +1087,8 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 			touch_softlockup_watchdog();
 			if (is_idle_task(current))
 				ts->idle_jiffies++;
+			else
+				tick_nohz_full_account_ticks(ts, current, 1);
 		}
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
@@ -55,23 +55,86 @@ u64 jiffies_64 __cacheline_aligned_in_smp = INITIAL_JIFFIES;
 EXPORT_SYMBOL(jiffies_64);
 
 /*
- * per-CPU timer vector definitions:
+ * The timer wheel has LVL_DEPTH array levels.  Each level provides an
+ * array of LVL_SIZE buckets.  Each level is driven by its own clock and
+ * therefore each level has a different granularity.
+ *
+ * The level granularity is:		LVL_CLK_DIV ^ lvl
+ * The level clock frequency is:	HZ / (LVL_CLK_DIV ^ level)
+ *
+ * The array level of a newly armed timer depends on the relative expiry
+ * time.  The farther the expiry time is away the higher the array level
+ * and therefore the granularity becomes.
+ *
+ * Contrary to the original timer wheel implementation, which aims for
+ * 'exact' expiry of the timers, this implementation removes the need for
+ * recascading the timers into the lower array levels.  The previous
+ * 'classic' timer wheel implementation of the kernel already violated
+ * the 'exact' expiry by adding slack to the expiry time to provide batched
+ * expiration.  The granularity levels provide implicit batching.
+ *
+ * This is an optimization of the original timer wheel implementation for
+ * the majority of the timer wheel use cases: timeouts.  The vast majority
+ * of timeout timers (networking, disk I/O ...) are canceled before
+ * expiry.  If the timeout expires it indicates that normal operation is
+ * disturbed, so it does not matter much whether the timeout comes with a
+ * slight delay.
+ *
+ * The cascading of all timers of a tv2..tv5 slot on every wrap of the
+ * lower level, which the classic wheel had to do with the base lock held,
+ * is gone.  A timer is placed once and never moved until it expires or
+ * is deleted.  The price is that a timer with a timeout of 63 jiffies
+ * or more may expire up to about 1/8 of its timeout late; timers with a
+ * shorter timeout are expired exactly, as before.
+ *
+ * HZ 1000 steps:
+ * Level Offset  Granularity            Range
+ *  0      0         1 ms                0 ms -         62 ms
+ *  1     64         8 ms               63 ms -        503 ms
+ *  2    128        64 ms              504 ms -       4031 ms (~0.5s - ~4s)
+ *  3    192       512 ms             4032 ms -      32255 ms (~4s - ~32s)
+ *  4    256      4096 ms (~4s)      32256 ms -     258047 ms (~32s - ~4m)
+ *  5    320     32768 ms (~32s)    258048 ms -    2064383 ms (~4m - ~34m)
+ *  6    384    262144 ms (~4m)    2064384 ms -   16515071 ms (~34m - ~4h)
+ *  7    448   2097152 ms (~34m)  16515072 ms -  132120575 ms (~4h - ~1d)
+ *  8    512  16777216 ms (~4h)  132120576 ms - 1056964607 ms (~1d - ~12d)
  */
-#define TVN_BITS (CONFIG_BASE_SMALL ? 4 : 6)
-#define TVR_BITS (CONFIG_BASE_SMALL ? 6 : 8)
-#define TVN_SIZE (1 << TVN_BITS)
-#define TVR_SIZE (1 << TVR_BITS)
-#define TVN_MASK (TVN_SIZE - 1)
-#define TVR_MASK (TVR_SIZE - 1)
-#define MAX_TVAL ((unsigned long)((1ULL << (TVR_BITS + 4*TVN_BITS)) - 1))
-
-struct tvec {
-	struct list_head vec[TVN_SIZE];
-};
 
-struct tvec_root {
-	struct list_head vec[TVR_SIZE];
-};
+/* Clock divisor for the next level */
+#define LVL_CLK_SHIFT	3
+#define LVL_CLK_DIV	(1UL << LVL_CLK_SHIFT)
+#define LVL_CLK_MASK	(LVL_CLK_DIV - 1)
+#define LVL_SHIFT(n)	((n) * LVL_CLK_SHIFT)
+#define LVL_GRAN(n)	(1UL << LVL_SHIFT(n))
+
+/*
+ * The time start value for each level to select the bucket at enqueue
+ * time.
+ */
+#define LVL_START(n)	((LVL_SIZE - 1) << (((n) - 1) * LVL_CLK_SHIFT))
+
+/* Size of each clock level */
+#define LVL_BITS	6
+#define LVL_SIZE	(1UL << LVL_BITS)
+#define LVL_MASK	(LVL_SIZE - 1)
+#define LVL_OFFS(n)	((n) * LVL_SIZE)
+
+/* Level depth */
+#if HZ > 100
+# define LVL_DEPTH	9
+#else
+# define LVL_DEPTH	8
+#endif
+
+/* The cutoff (max. capacity of the wheel) */
+#define WHEEL_TIMEOUT_CUTOFF	(LVL_START(LVL_DEPTH))
+#define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
+
+/*
+ * The resulting wheel size.  With HZ 1000 that is 576 buckets, and the
+ * pending map has one bit per bucket.
+ */
+#define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
 
 struct tvec_base {
 	spinlock_t lock;
@@ -79,26 +142,28 @@ struct tvec_base {
 	unsigned long timer_jiffies;
 	unsigned long next_timer;
 	unsigned long active_timers;
-	struct tvec_root tv1;
-	struct tvec tv2;
-	struct tvec tv3;
-	struct tvec tv4;
-	struct tvec tv5;
+	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
+	struct list_head vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
 
 struct tvec_base boot_tvec_bases;
 EXPORT_SYMBOL(boot_tvec_bases);
 static DEFINE_PER_CPU(struct tvec_base *, tvec_bases) = &boot_tvec_bases;
 
-/* Functions below help us manage 'deferrable' flag */
+/* Functions below help us manage 'deferrable' and 'pinned' flags */
 static inline unsigned int tbase_get_deferrable(struct tvec_base *base)
 {
 	return ((unsigned int)(unsigned long)base & TBASE_DEFERRABLE_FLAG);
 }
 
+static inline unsigned int tbase_get_pinned(struct tvec_base *base)
+{
+	return ((unsigned int)(unsigned long)base & TBASE_PINNED_FLAG);
+}
+
 static inline struct tvec_base *tbase_get_base(struct tvec_base *base)
 {
-	return ((struct tvec_base *)((unsigned long)base & ~TBASE_DEFERRABLE_FLAG));
+	return ((struct tvec_base *)((unsigned long)base & ~TBASE_FLAG_MASK));
 }
 
 static inline void timer_set_deferrable(struct timer_list *timer)
@@ -106,11 +171,20 @@ static inline void timer_set_deferrable(struct timer_list *timer)
 	timer->base = TBASE_MAKE_DEFERRED(timer->base);
 }
 
+static inline void timer_set_pinned(struct timer_list *timer, int pinned)
+{
+	unsigned long base = (unsigned long)timer->base & ~TBASE_PINNED_FLAG;
+
+	if (pinned)
+		base |= TBASE_PINNED_FLAG;
+	timer->base = (struct tvec_base *)base;
+}
+
 static inline void
 timer_set_base(struct timer_list *timer, struct tvec_base *new_base)
 {
 	timer->base = (struct tvec_base *)((unsigned long)(new_base) |
-				      tbase_get_deferrable(timer->base));
+			((unsigned long)timer->base & TBASE_FLAG_MASK));
 }
 
 static unsigned long round_jiffies_common(unsigned long j, int cpu,
@@ -332,59 +406,72 @@ void set_timer_slack(struct timer_list *timer, int slack_hz)
 }
 EXPORT_SYMBOL_GPL(set_timer_slack);
 
-static void
-__internal_add_timer(struct tvec_base *base, struct timer_list *timer)
-{
-	unsigned long expires = timer->expires;
-	unsigned long idx = expires - base->timer_jiffies;
-	struct list_head *vec;
-
-	if (idx < TVR_SIZE) {
-		int i = expires & TVR_MASK;
-		vec = base->tv1.vec + i;
-	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
-		int i = (expires >> TVR_BITS) & TVN_MASK;
-		vec = base->tv2.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 2 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + TVN_BITS)) & TVN_MASK;
-		vec = base->tv3.vec + i;
-	} else if (idx < 1 << (TVR_BITS + 3 * TVN_BITS)) {
-		int i = (expires >> (TVR_BITS + 2 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv4.vec + i;
-	} else if ((signed long) idx < 0) {
+/*
+ * Helper function to calculate the array index for a given expiry
+ * time.  The expiry time is rounded up to the granularity of the level,
+ * so that a timer never expires early.  @bucket_expiry is set to the
+ * jiffy at which the bucket is going to be expired.
+ */
+static inline unsigned int calc_index(unsigned long expires, unsigned int lvl,
+				      unsigned long *bucket_expiry)
+{
+	expires = (expires + LVL_GRAN(lvl) - 1) >> LVL_SHIFT(lvl);
+	*bucket_expiry = expires << LVL_SHIFT(lvl);
+	return LVL_OFFS(lvl) + (expires & LVL_MASK);
+}
+
+static unsigned int calc_wheel_index(unsigned long expires, unsigned long clk,
+				     unsigned long *bucket_expiry)
+{
+	unsigned long delta = expires - clk;
+	unsigned int lvl;
+
+	if ((long) delta < 0) {
 		/*
 		 * Can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
-	} else {
-		int i;
-		/* If the timeout is larger than MAX_TVAL (on 64-bit
-		 * architectures or with CONFIG_BASE_SMALL=1) then we
-		 * use the maximum timeout.
-		 */
-		if (idx > MAX_TVAL) {
-			idx = MAX_TVAL;
-			expires = idx + base->timer_jiffies;
-		}
-		i = (expires >> (TVR_BITS + 3 * TVN_BITS)) & TVN_MASK;
-		vec = base->tv5.vec + i;
+		*bucket_expiry = clk;
+		return clk & LVL_MASK;
 	}
+
 	/*
-	 * Timers are FIFO:
+	 * Force expire obscene large timeouts to expire at the capacity
+	 * limit of the wheel.
 	 */
-	list_add_tail(&timer->entry, vec);
+	if (delta >= WHEEL_TIMEOUT_CUTOFF) {
+		expires = clk + WHEEL_TIMEOUT_MAX;
+		delta = WHEEL_TIMEOUT_MAX;
+	}
+
+	for (lvl = 0; lvl < LVL_DEPTH - 1; lvl++)
+		if (delta < LVL_START(lvl + 1))
+			break;
+
+	return calc_index(expires, lvl, bucket_expiry);
 }
 
 static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 {
-	__internal_add_timer(base, timer);
+	unsigned long bucket_expiry;
+	unsigned int idx;
+
+	idx = calc_wheel_index(timer->expires, base->timer_jiffies,
+			       &bucket_expiry);
+	/*
+	 * Timers are FIFO:
+	 */
+	list_add_tail(&timer->entry, base->vectors + idx);
+	__set_bit(idx, base->pending_map);
+
 	/*
-	 * Update base->active_timers and base->next_timer
+	 * Update base->active_timers and base->next_timer.  The bucket
+	 * expiry is what matters for NO_HZ: all timers of a bucket are
+	 * expired together.
 	 */
 	if (!tbase_get_deferrable(timer->base)) {
-		if (time_before(timer->expires, base->next_timer))
-			base->next_timer = timer->expires;
+		if (time_before(bucket_expiry, base->next_timer))
+			base->next_timer = bucket_expiry;
 		base->active_timers++;
 	}
 }
@@ -671,6 +758,101 @@ void init_timer_deferrable_key(struct timer_list *timer,
 }
 EXPORT_SYMBOL(init_timer_deferrable_key);
 
+/* Does the bucket hold timers which are not deferrable? */
+static bool bucket_is_active(struct tvec_base *base, unsigned int idx)
+{
+	struct timer_list *timer;
+
+	list_for_each_entry(timer, base->vectors + idx, entry)
+		if (!tbase_get_deferrable(timer->base))
+			return true;
+	return false;
+}
+
+/*
+ * Return the distance from @clk to the first bucket holding timers in the
+ * level starting at @offset, or -1 if the level is empty.  Buckets which
+ * only hold deferrable timers are skipped unless @deferrable is set.
+ */
+static int next_pending_bucket(struct tvec_base *base, unsigned int offset,
+			       unsigned int clk, bool deferrable)
+{
+	unsigned int pos, start = offset + clk, end = offset + LVL_SIZE;
+
+	for (pos = find_next_bit(base->pending_map, end, start); pos < end;
+	     pos = find_next_bit(base->pending_map, end, pos + 1))
+		if (deferrable || bucket_is_active(base, pos))
+			return pos - start;
+
+	/* wrap around */
+	for (pos = find_next_bit(base->pending_map, start, offset); pos < start;
+	     pos = find_next_bit(base->pending_map, start, pos + 1))
+		if (deferrable || bucket_is_active(base, pos))
+			return pos + LVL_SIZE - start;
+
+	return -1;
+}
+
+/*
+ * Find out when the next bucket holding timers expires.  Deferrable
+ * timers are only taken into account if @deferrable is set.  This
+ * function needs to be called with the base lock held.
+ */
+static unsigned long __next_timer_interrupt(struct tvec_base *base,
+					    bool deferrable)
+{
+	unsigned long clk, next, adj;
+	unsigned int lvl, offset = 0;
+
+	next = base->timer_jiffies + NEXT_TIMER_MAX_DELTA;
+	clk = base->timer_jiffies;
+	for (lvl = 0; lvl < LVL_DEPTH; lvl++, offset += LVL_SIZE) {
+		int pos = next_pending_bucket(base, offset, clk & LVL_MASK,
+					      deferrable);
+
+		if (pos >= 0) {
+			unsigned long tmp = clk + (unsigned long) pos;
+
+			tmp <<= LVL_SHIFT(lvl);
+			if (time_before(tmp, next))
+				next = tmp;
+		}
+		/*
+		 * Clock for the next level.  If the current level clock lower
+		 * bits are zero, we look at the next level as is.  If not we
+		 * need to advance it by one because that's going to be the
+		 * next expiring bucket in that level.  base->timer_jiffies is
+		 * the next expiring jiffy.
+		 */
+		adj = clk & LVL_CLK_MASK ? 1 : 0;
+		clk >>= LVL_CLK_SHIFT;
+		clk += adj;
+	}
+	return next;
+}
+
+/*
+ * After the tick has been stopped in NO_HZ idle, base->timer_jiffies lags
+ * behind jiffies.  Jump over the jiffies in which no bucket expires
+ * instead of walking the wheel one jiffy at a time.  This is also done
+ * before a timer is enqueued, otherwise its bucket would be computed
+ * from a stale clock and a short timeout would land in a coarse level.
+ * Must be called with the base lock held.
+ */
+static void forward_timer_base(struct tvec_base *base)
+{
+	unsigned long next;
+
+	if ((long)(jiffies - base->timer_jiffies) < 2)
+		return;
+
+	next = __next_timer_interrupt(base, true);
+	if (time_after(next, jiffies))
+		base->timer_jiffies = jiffies;
+	else if (time_after(next, base->timer_jiffies))
+		base->timer_jiffies = next;
+}
+
 static inline void detach_timer(struct timer_list *timer, bool clear_pending)
 {
 	struct list_head *entry = &timer->entry;
@@ -683,12 +865,30 @@ static inline void detach_timer(struct timer_list *timer, bool clear_pending)
 	entry->prev = LIST_POISON2;
 }
 
+/*
+ * Detach a timer which may still be queued in a bucket of the wheel, and
+ * clear the bucket from the pending map if it was the last timer in it.
+ * A pending timer may also sit on the expiry list of __run_timers(), the
+ * list it was left on then isn't part of the wheel.
+ */
+static inline void detach_wheel_timer(struct timer_list *timer,
+				      struct tvec_base *base, bool clear_pending)
+{
+	struct list_head *prev = timer->entry.prev;
+
+	detach_timer(timer, clear_pending);
+
+	if (prev->next == prev && prev >= base->vectors &&
+	    prev < base->vectors + WHEEL_SIZE)
+		__clear_bit(prev - base->vectors, base->pending_map);
+}
+
 static inline void
 detach_expired_timer(struct timer_list *timer, struct tvec_base *base)
 {
 	detach_timer(timer, true);
 	if (!tbase_get_deferrable(timer->base))
-		timer->base->active_timers--;
+		base->active_timers--;
 }
 
 static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
@@ -697,10 +897,14 @@ static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
 	if (!timer_pending(timer))
 		return 0;
 
-	detach_timer(timer, clear_pending);
+	detach_wheel_timer(timer, base, clear_pending);
 	if (!tbase_get_deferrable(timer->base)) {
-		timer->base->active_timers--;
-		if (timer->expires == base->next_timer)
+		base->active_timers--;
+		/*
+		 * base->next_timer is the expiry of a bucket, which is not
+		 * before the expiry of any timer in it.
+		 */
+		if (!time_after(timer->expires, base->next_timer))
 			base->next_timer = base->timer_jiffies;
 	}
 	return 1;
@@ -712,7 +916,7 @@ static int detach_if_pending(struct timer_list *timer, struct tvec_base *base,
  * locked, and the base itself is locked too.
  *
  * So __run_timers/migrate_timers can safely modify all timers which could
- * be found on ->tvX lists.
+ * be found in the wheel.
  *
  * When the timer's base is locked, and the timer removed from list, it is
  * possible to set timer->base = NULL and drop the lock: the timer remains
@@ -784,6 +988,8 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	}
 
 	timer->expires = expires;
+	timer_set_pinned(timer, pinned);
+	forward_timer_base(base);
 	internal_add_timer(base, timer);
 
 out_unlock:
@@ -948,7 +1154,9 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	BUG_ON(timer_pending(timer) || !timer->function);
 	spin_lock_irqsave(&base->lock, flags);
 	timer_set_base(timer, base);
+	timer_set_pinned(timer, TIMER_PINNED);
 	debug_activate(timer, timer->expires);
+	forward_timer_base(base);
 	internal_add_timer(base, timer);
 	/*
 	 * Check whether the other CPU is idle and needs to be
@@ -1086,27 +1294,6 @@ int del_timer_sync(struct timer_list *timer)
 EXPORT_SYMBOL(del_timer_sync);
 #endif
 
-static int cascade(struct tvec_base *base, struct tvec *tv, int index)
-{
-	/* cascade all the timers from tv up one level */
-	struct timer_list *timer, *tmp;
-	struct list_head tv_list;
-
-	list_replace_init(tv->vec + index, &tv_list);
-
-	/*
-	 * We are removing _all_ timers from the list, so we
-	 * don't have to detach them individually.
-	 */
-	list_for_each_entry_safe(timer, tmp, &tv_list, entry) {
-		BUG_ON(tbase_get_base(timer->base) != base);
-		/* No accounting, while moving them */
-		__internal_add_timer(base, timer);
-	}
-
-	return index;
-}
-
 static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 			  unsigned long data)
 {
@@ -1150,14 +1337,37 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 	}
 }
 
-#define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
+/*
+ * Move the timers of all the buckets expiring at base->timer_jiffies to
+ * @head.  A level only has a bucket expiring when the clocks of all the
+ * levels below it wrap.
+ */
+static void collect_expired_timers(struct tvec_base *base,
+				   struct list_head *head)
+{
+	unsigned long clk = base->timer_jiffies;
+	unsigned int i, idx;
+
+	for (i = 0; i < LVL_DEPTH; i++) {
+		idx = (clk & LVL_MASK) + i * LVL_SIZE;
+
+		if (__test_and_clear_bit(idx, base->pending_map))
+			list_splice_tail_init(base->vectors + idx, head);
+
+		/* Is it time to look at the next level? */
+		if (clk & LVL_CLK_MASK)
+			break;
+		/* Shift clock for the next level granularity */
+		clk >>= LVL_CLK_SHIFT;
+	}
+}
 
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
- * This function cascades all vectors and executes all expired timer
- * vectors.
+ * This function collects the expired buckets of all levels and executes
+ * the timers in them.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
@@ -1167,18 +1377,12 @@ static inline void __run_timers(struct tvec_base *base)
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
 		struct list_head work_list;
 		struct list_head *head = &work_list;
-		int index = base->timer_jiffies & TVR_MASK;
 
-		/*
-		 * Cascade timers:
-		 */
-		if (!index &&
-			(!cascade(base, &base->tv2, INDEX(0))) &&
-				(!cascade(base, &base->tv3, INDEX(1))) &&
-					!cascade(base, &base->tv4, INDEX(2)))
-			cascade(base, &base->tv5, INDEX(3));
+		forward_timer_base(base);
+
+		INIT_LIST_HEAD(head);
+		collect_expired_timers(base, head);
 		++base->timer_jiffies;
-		list_replace_init(base->tv1.vec + index, &work_list);
 		while (!list_empty(head)) {
 			void (*fn)(unsigned long);
 			unsigned long data;
@@ -1201,82 +1405,103 @@ static inline void __run_timers(struct tvec_base *base)
 	spin_unlock_irq(&base->lock);
 }
 
-#ifdef CONFIG_NO_HZ
+#if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
 /*
- * Find out when the next timer event is due to happen. This
- * is used on S/390 to stop all activity when a CPU is idle.
- * This function needs to be called with interrupts disabled.
+ * CPUs which stopped the tick in idle with more than one bucket of timers
+ * pending.  A busy CPU pulls their timers, see pull_idle_timers().
  */
-static unsigned long __next_timer_interrupt(struct tvec_base *base)
-{
-	unsigned long timer_jiffies = base->timer_jiffies;
-	unsigned long expires = timer_jiffies + NEXT_TIMER_MAX_DELTA;
-	int index, slot, array, found = 0;
-	struct timer_list *nte;
-	struct tvec *varray[4];
-
-	/* Look for timer events in tv1. */
-	index = slot = timer_jiffies & TVR_MASK;
-	do {
-		list_for_each_entry(nte, base->tv1.vec + slot, entry) {
-			if (tbase_get_deferrable(nte->base))
+static struct cpumask timers_idle_mask;
+
+/* Timers pulled from one idle CPU per tick */
+#define TIMER_PULL_BATCH	32
+
+/* Called by get_next_timer_interrupt() with the base lock held */
+static void timer_base_going_idle(struct tvec_base *base, unsigned long now)
+{
+	int cpu = smp_processor_id();
+
+	if (!get_sysctl_timer_migration() || !idle_cpu(cpu) ||
+	    base->active_timers < 2 || !time_after(base->next_timer, now + 1))
+		return;
+
+	if (!cpumask_test_cpu(cpu, &timers_idle_mask))
+		cpumask_set_cpu(cpu, &timers_idle_mask);
+}
+
+/*
+ * Move the timers of @idle, which are neither pinned nor deferrable and
+ * don't expire when the idle CPU wakes up next anyway, to @base.  When
+ * the idle CPU reevaluates its wheel it can then sleep until the next
+ * pinned timer.  Returns true if timers had to be left for the next tick.
+ */
+static bool pull_timers(struct tvec_base *base, struct tvec_base *idle)
+{
+	struct timer_list *timer, *tmp;
+	unsigned int idx, pulled = 0;
+
+	if (time_before_eq(idle->next_timer, idle->timer_jiffies))
+		idle->next_timer = __next_timer_interrupt(idle, false);
+
+	for_each_set_bit(idx, idle->pending_map, WHEEL_SIZE) {
+		list_for_each_entry_safe(timer, tmp, idle->vectors + idx, entry) {
+			if (tbase_get_pinned(timer->base) ||
+			    tbase_get_deferrable(timer->base) ||
+			    timer == idle->running_timer ||
+			    !time_after(timer->expires, idle->next_timer))
 				continue;
+			if (pulled++ == TIMER_PULL_BATCH)
+				return true;
 
-			found = 1;
-			expires = nte->expires;
-			/* Look at the cascade bucket(s)? */
-			if (!index || slot < index)
-				goto cascade;
-			return expires;
+			detach_if_pending(timer, idle, false);
+			timer_set_base(timer, base);
+			internal_add_timer(base, timer);
 		}
-		slot = (slot + 1) & TVR_MASK;
-	} while (slot != index);
-
-cascade:
-	/* Calculate the next cascade event */
-	if (index)
-		timer_jiffies += TVR_SIZE - index;
-	timer_jiffies >>= TVR_BITS;
-
-	/* Check tv2-tv5. */
-	varray[0] = &base->tv2;
-	varray[1] = &base->tv3;
-	varray[2] = &base->tv4;
-	varray[3] = &base->tv5;
-
-	for (array = 0; array < 4; array++) {
-		struct tvec *varp = varray[array];
-
-		index = slot = timer_jiffies & TVN_MASK;
-		do {
-			list_for_each_entry(nte, varp->vec + slot, entry) {
-				if (tbase_get_deferrable(nte->base))
-					continue;
-
-				found = 1;
-				if (time_before(nte->expires, expires))
-					expires = nte->expires;
-			}
-			/*
-			 * Do we still search for the first timer or are
-			 * we looking up the cascade buckets ?
-			 */
-			if (found) {
-				/* Look at the cascade bucket(s)? */
-				if (!index || slot < index)
-					break;
-				return expires;
-			}
-			slot = (slot + 1) & TVN_MASK;
-		} while (slot != index);
+	}
+	return false;
+}
 
-		if (index)
-			timer_jiffies += TVN_SIZE - index;
-		timer_jiffies >>= TVN_BITS;
+/*
+ * The other half of the hand-off done by __mod_timer(): timers which were
+ * armed on a CPU before it went idle are pulled by a busy CPU, so that the
+ * idle one isn't woken up for them.
+ */
+static void pull_idle_timers(struct tvec_base *base)
+{
+	int this_cpu = smp_processor_id(), cpu;
+
+	if (likely(cpumask_empty(&timers_idle_mask)))
+		return;
+	if (!get_sysctl_timer_migration() || idle_cpu(this_cpu) ||
+	    tick_nohz_full_cpu(this_cpu))
+		return;
+
+	spin_lock_irq(&base->lock);
+	forward_timer_base(base);
+	for_each_cpu(cpu, &timers_idle_mask) {
+		struct tvec_base *idle = per_cpu(tvec_bases, cpu);
+
+		if (!cpumask_test_and_clear_cpu(cpu, &timers_idle_mask) ||
+		    cpu == this_cpu || !idle_cpu(cpu))
+			continue;
+		/*
+		 * That CPU may have woken up meanwhile and be pulling from
+		 * us, only try its lock to avoid an ABBA deadlock.
+		 */
+		if (!spin_trylock(&idle->lock))
+			continue;
+		if (pull_timers(base, idle))
+			cpumask_set_cpu(cpu, &timers_idle_mask);
+		spin_unlock(&idle->lock);
 	}
-	return expires;
+	spin_unlock_irq(&base->lock);
 }
+#else
+static inline void timer_base_going_idle(struct tvec_base *base,
+					 unsigned long now) { }
+static inline void pull_idle_timers(struct tvec_base *base) { }
+#endif
 
+#ifdef CONFIG_NO_HZ
 /*
  * Check, if the next hrtimer event is before the next timer wheel
  * event:
@@ -1340,8 +1565,9 @@ unsigned long get_next_timer_interrupt(unsigned long now)
 	spin_lock(&base->lock);
 	if (base->active_timers) {
 		if (time_before_eq(base->next_timer, base->timer_jiffies))
-			base->next_timer = __next_timer_interrupt(base);
+			base->next_timer = __next_timer_interrupt(base, false);
 		expires = base->next_timer;
+		timer_base_going_idle(base, now);
 	}
 	spin_unlock(&base->lock);
 
@@ -1385,6 +1611,8 @@ static void run_timer_softirq(struct softirq_action *h)
 
 	if (time_after_eq(jiffies, base->timer_jiffies))
 		__run_timers(base);
+
+	pull_idle_timers(base);
 }
 
 /*
@@ -1675,8 +1903,8 @@ static int __cpuinit init_timers_cpu(int cpu)
 			if (!base)
 				return -ENOMEM;
 
-			/* Make sure that tvec_base is 2 byte aligned */
-			if (tbase_get_deferrable(base)) {
+			/* Make sure that tvec_base is 4 byte aligned */
+			if ((unsigned long)base & TBASE_FLAG_MASK) {
 				WARN_ON(1);
 				kfree(base);
 				return -ENOMEM;
@@ -1699,14 +1927,9 @@ static int __cpuinit init_timers_cpu(int cpu)
 
 	spin_lock_init(&base->lock);
 
-	for (j = 0; j < TVN_SIZE; j++) {
-		INIT_LIST_HEAD(base->tv5.vec + j);
-		INIT_LIST_HEAD(base->tv4.vec + j);
-		INIT_LIST_HEAD(base->tv3.vec + j);
-		INIT_LIST_HEAD(base->tv2.vec + j);
-	}
-	for (j = 0; j < TVR_SIZE; j++)
-		INIT_LIST_HEAD(base->tv1.vec + j);
+	for (j = 0; j < WHEEL_SIZE; j++)
+		INIT_LIST_HEAD(base->vectors + j);
+	bitmap_zero(base->pending_map, WHEEL_SIZE);
 
 	base->timer_jiffies = jiffies;
 	base->next_timer = base->timer_jiffies;
@@ -1746,14 +1969,9 @@ static void __cpuinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
-	for (i = 0; i < TVR_SIZE; i++)
-		migrate_timer_list(new_base, old_base->tv1.vec + i);
-	for (i = 0; i < TVN_SIZE; i++) {
-		migrate_timer_list(new_base, old_base->tv2.vec + i);
-		migrate_timer_list(new_base, old_base->tv3.vec + i);
-		migrate_timer_list(new_base, old_base->tv4.vec + i);
-		migrate_timer_list(new_base, old_base->tv5.vec + i);
-	}
+	forward_timer_base(new_base);
+	for (i = 0; i < WHEEL_SIZE; i++)
+		migrate_timer_list(new_base, old_base->vectors + i);
 
 	spin_unlock(&old_base->lock);
 	spin_unlock_irq(&new_base->lock);
@@ -17,8 +17,8 @@
  * This is the generic async execution mechanism.  Work items as are
  * executed in process context.  The worker pool is shared and
  * automatically managed.  There is one worker pool for each CPU and
- * one extra for works which are better served by workers which are
- * not bound to any specific CPU.
+ * dynamically created ones, keyed by their attributes, for works which
+ * are better served by workers which are not bound to any specific CPU.
  *
  * Please read Documentation/workqueue.txt for details.
  */
@@ -41,6 +41,11 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/jhash.h>
+#include <linux/hash.h>
+#include <linux/rcupdate.h>
+#include <linux/moduleparam.h>
+#include <linux/device.h>
 
 #include "workqueue_sched.h"
 
@@ -62,7 +67,6 @@ enum {
 	 * state while create_worker() is in progress.
 	 */
 	GCWQ_DISASSOCIATED	= 1 << 0,	/* cpu can't serve workers */
-	GCWQ_FREEZING		= 1 << 1,	/* freeze in progress */
 
 	/* pool flags */
 	POOL_MANAGE_WORKERS	= 1 << 0,	/* need to manage workers */
@@ -86,6 +90,8 @@ enum {
 	BUSY_WORKER_HASH_SIZE	= 1 << BUSY_WORKER_HASH_ORDER,
 	BUSY_WORKER_HASH_MASK	= BUSY_WORKER_HASH_SIZE - 1,
 
+	UNBOUND_GCWQ_HASH_ORDER	= 6,		/* hashed by gcwq->attrs */
+
 	MAX_IDLE_WORKERS_RATIO	= 4,		/* 1/4 of busy can be idle */
 	IDLE_WORKER_TIMEOUT	= 300 * HZ,	/* keep idle ones for 5 mins */
 
@@ -122,6 +128,13 @@ enum {
  * F: wq->flush_mutex protected.
  *
  * W: workqueue_lock protected.
+ *
+ * FW: Modification requires both wq->flush_mutex and workqueue_lock.
+ *     Either is enough for read access.
+ *
+ * PL: wq_pool_mutex protected.
+ *
+ * MD: wq_mayday_lock protected.
  */
 
 struct global_cwq;
@@ -174,10 +187,16 @@ struct worker_pool {
  * Global per-cpu workqueue.  There's one and only one for each cpu
  * and all works are queued and processed here regardless of their
  * target workqueues.
+ *
+ * Unbound workqueues are served by gcwqs which are created on demand
+ * and shared by all workqueues with the same attributes.  Their cpu is
+ * WORK_CPU_UNBOUND, only the normal pool is used and the nice level of
+ * its workers comes from @attrs.
  */
 struct global_cwq {
 	spinlock_t		lock;		/* the gcwq lock */
 	unsigned int		cpu;		/* I: the associated cpu */
+	int			id;		/* I: cpu or unbound gcwq id */
 	unsigned int		flags;		/* L: GCWQ_* flags */
 
 	/* workers are chained either in busy_hash or pool idle_list */
@@ -187,6 +206,13 @@ struct global_cwq {
 	struct worker_pool	pools[2];	/* normal and highpri pools */
 
 	wait_queue_head_t	rebind_hold;	/* rebind hold wait */
+
+	/* only for unbound gcwqs */
+	struct workqueue_attrs	*attrs;		/* I: worker attributes */
+	int			node;		/* I: node to allocate on */
+	struct hlist_node	hash_node;	/* PL: unbound_gcwq_hash node */
+	int			refcnt;		/* PL: refcnt for unbound gcwqs */
+	struct rcu_head		rcu;		/* freed with sched-RCU */
 } ____cacheline_aligned_in_smp;
 
 /*
@@ -204,8 +230,26 @@ struct cpu_workqueue_struct {
 	int			nr_active;	/* L: nr of active works */
 	int			max_active;	/* L: max active works */
 	struct list_head	delayed_works;	/* L: delayed works */
+	int			refcnt;		/* L: reference count */
+	struct list_head	cwqs_node;	/* FW: node on wq->cwqs */
+	struct list_head	mayday_node;	/* MD: node on wq->maydays */
+
+	/*
+	 * Release of unbound cwq is punted to system_wq.  See cwq_put()
+	 * for details.  The memory is freed with sched-RCU so that
+	 * __queue_work() can look the cwq up locklessly.
+	 */
+	struct work_struct	unbound_release_work;
+	struct rcu_head		rcu;
 };
 
+/*
+ * Alignment of cwqs, both per-cpu and unbound.  Make sure that it isn't
+ * lower than that of unsigned long long either.
+ */
+#define CWQ_ALIGN	max_t(size_t, 1 << WORK_STRUCT_FLAG_BITS,	\
+			      __alignof__(unsigned long long))
+
 /*
  * Structure used to wait for workqueue flush.
  */
@@ -215,38 +259,17 @@ struct wq_flusher {
 	struct completion	done;		/* flush completion */
 };
 
-/*
- * All cpumasks are assumed to be always set on UP and thus can't be
- * used to determine whether there's something to be done.
- */
-#ifdef CONFIG_SMP
-typedef cpumask_var_t mayday_mask_t;
-#define mayday_test_and_set_cpu(cpu, mask)	\
-	cpumask_test_and_set_cpu((cpu), (mask))
-#define mayday_clear_cpu(cpu, mask)		cpumask_clear_cpu((cpu), (mask))
-#define for_each_mayday_cpu(cpu, mask)		for_each_cpu((cpu), (mask))
-#define alloc_mayday_mask(maskp, gfp)		zalloc_cpumask_var((maskp), (gfp))
-#define free_mayday_mask(mask)			free_cpumask_var((mask))
-#else
-typedef unsigned long mayday_mask_t;
-#define mayday_test_and_set_cpu(cpu, mask)	test_and_set_bit(0, &(mask))
-#define mayday_clear_cpu(cpu, mask)		clear_bit(0, &(mask))
-#define for_each_mayday_cpu(cpu, mask)		if ((cpu) = 0, (mask))
-#define alloc_mayday_mask(maskp, gfp)		true
-#define free_mayday_mask(mask)			do { } while (0)
-#endif
+struct wq_device;
 
 /*
  * The externally visible workqueue abstraction is an array of
- * per-CPU workqueues:
+ * per-CPU workqueues for bound workqueues, or of per-node ones for
+ * unbound workqueues:
  */
 struct workqueue_struct {
 	unsigned int		flags;		/* W: WQ_* flags */
-	union {
-		struct cpu_workqueue_struct __percpu	*pcpu;
-		struct cpu_workqueue_struct		*single;
-		unsigned long				v;
-	} cpu_wq;				/* I: cwq's */
+	struct cpu_workqueue_struct __percpu *cpu_cwqs; /* I: bound cwqs */
+	struct list_head	cwqs;		/* FW: all cwqs of this wq */
 	struct list_head	list;		/* W: list of all workqueues */
 
 	struct mutex		flush_mutex;	/* protects wq flushing */
@@ -257,11 +280,22 @@ struct workqueue_struct {
 	struct list_head	flusher_queue;	/* F: flush waiters */
 	struct list_head	flusher_overflow; /* F: flush overflow list */
 
-	mayday_mask_t		mayday_mask;	/* cpus requesting rescue */
+	struct list_head	maydays;	/* MD: cwqs requesting rescue */
 	struct worker		*rescuer;	/* I: rescue worker */
 
 	int			nr_drainers;	/* W: drain in progress */
 	int			saved_max_active; /* W: saved cwq max_active */
+
+	/* only for unbound workqueues */
+	struct workqueue_attrs	*unbound_attrs;	/* PL: current attributes */
+	struct cpu_workqueue_struct *dfl_cwq;	/* PL: default cwq */
+	struct cpu_workqueue_struct __rcu **numa_cwq_tbl;
+						/* FW: cwq of each node */
+
+#ifdef CONFIG_SYSFS
+	struct wq_device	*wq_dev;	/* I: for sysfs interface */
+#endif
+	struct rcu_head		rcu;		/* freed with sched-RCU */
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map	lockdep_map;
 #endif
@@ -292,54 +326,18 @@ EXPORT_SYMBOL_GPL(system_nrt_freezable_wq);
 	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)			\
 		hlist_for_each_entry(worker, pos, &gcwq->busy_hash[i], hentry)
 
-static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
-				  unsigned int sw)
-{
-	if (cpu < nr_cpu_ids) {
-		if (sw & 1) {
-			cpu = cpumask_next(cpu, mask);
-			if (cpu < nr_cpu_ids)
-				return cpu;
-		}
-		if (sw & 2)
-			return WORK_CPU_UNBOUND;
-	}
-	return WORK_CPU_NONE;
-}
-
-static inline int __next_wq_cpu(int cpu, const struct cpumask *mask,
-				struct workqueue_struct *wq)
-{
-	return __next_gcwq_cpu(cpu, mask, !(wq->flags & WQ_UNBOUND) ? 1 : 2);
-}
-
 /*
- * CPU iterators
- *
- * An extra gcwq is defined for an invalid cpu number
- * (WORK_CPU_UNBOUND) to host workqueues which are not bound to any
- * specific CPU.  The following iterators are similar to
- * for_each_*_cpu() iterators but also considers the unbound gcwq.
- *
- * for_each_gcwq_cpu()		: possible CPUs + WORK_CPU_UNBOUND
- * for_each_online_gcwq_cpu()	: online CPUs + WORK_CPU_UNBOUND
- * for_each_cwq_cpu()		: possible CPUs for bound workqueues,
- *				  WORK_CPU_UNBOUND for unbound workqueues
+ * for_each_cwq - iterate through all cwqs of a workqueue
+ * @cwq: iteration cursor
+ * @wq: the target workqueue
+ *
+ * This includes the per-cpu cwqs of a bound workqueue, and the per-node
+ * cwqs of an unbound workqueue along with the ones retired by
+ * apply_workqueue_attrs() which haven't been released yet.  Must be
+ * called with either wq->flush_mutex or workqueue_lock held.
  */
-#define for_each_gcwq_cpu(cpu)						\
-	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 3);		\
-	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_gcwq_cpu((cpu), cpu_possible_mask, 3))
-
-#define for_each_online_gcwq_cpu(cpu)					\
-	for ((cpu) = __next_gcwq_cpu(-1, cpu_online_mask, 3);		\
-	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_gcwq_cpu((cpu), cpu_online_mask, 3))
-
-#define for_each_cwq_cpu(cpu, wq)					\
-	for ((cpu) = __next_wq_cpu(-1, cpu_possible_mask, (wq));	\
-	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_wq_cpu((cpu), cpu_possible_mask, (wq)))
+#define for_each_cwq(cwq, wq)						\
+	list_for_each_entry((cwq), &(wq)->cwqs, cwqs_node)
 
 #ifdef CONFIG_DEBUG_OBJECTS_WORK
 
@@ -462,6 +460,32 @@ static DEFINE_SPINLOCK(workqueue_lock);
 static LIST_HEAD(workqueues);
 static bool workqueue_freezing;		/* W: have wqs started freezing? */
 
+/* protects unbound gcwqs and serializes apply_workqueue_attrs() */
+static DEFINE_MUTEX(wq_pool_mutex);
+
+/* protects wq->maydays, nests inside gcwq->lock */
+static DEFINE_SPINLOCK(wq_mayday_lock);
+
+/* PL: hash of all unbound gcwqs keyed by gcwq->attrs */
+static struct hlist_head unbound_gcwq_hash[1 << UNBOUND_GCWQ_HASH_ORDER];
+
+/*
+ * PL: ids of unbound gcwqs.  These follow the cpu numbers so that the
+ * off-queue work->data can record either kind of gcwq.  Lookups are done
+ * locklessly under sched-RCU, see get_work_gcwq().
+ */
+static DEFINE_IDR(unbound_gcwq_idr);
+
+/* unbound cwqs are allocated from here, aligned as per-cpu ones */
+static struct kmem_cache *cwq_cache;
+
+static bool wq_disable_numa;
+module_param_named(disable_numa, wq_disable_numa, bool, 0444);
+
+/* possible CPUs of each node, used for the per-node cwqs of unbound wqs */
+static cpumask_var_t *wq_numa_possible_cpumask;
+static bool wq_numa_enabled;		/* unbound NUMA affinity enabled */
+
 /*
  * The almighty global cpu workqueues.  nr_running is the only field
  * which is expected to be used frequently by other cpus via
@@ -471,16 +495,16 @@ static DEFINE_PER_CPU(struct global_cwq, global_cwq);
 static DEFINE_PER_CPU_SHARED_ALIGNED(atomic_t, pool_nr_running[NR_WORKER_POOLS]);
 
 /*
- * Global cpu workqueue and nr_running counter for unbound gcwq.  The
- * gcwq is always online, has GCWQ_DISASSOCIATED set, and all its
- * workers have WORKER_UNBOUND set.
+ * nr_running counter shared by all unbound gcwqs.  Unbound gcwqs are
+ * always online, have GCWQ_DISASSOCIATED set, and all their workers have
+ * WORKER_UNBOUND set.
  */
-static struct global_cwq unbound_global_cwq;
 static atomic_t unbound_pool_nr_running[NR_WORKER_POOLS] = {
 	[0 ... NR_WORKER_POOLS - 1]	= ATOMIC_INIT(0),	/* always 0 */
 };
 
 static int worker_thread(void *__worker);
+static void put_unbound_gcwq(struct global_cwq *gcwq);
 
 static int worker_pool_pri(struct worker_pool *pool)
 {
@@ -489,10 +513,7 @@ static int worker_pool_pri(struct worker_pool *pool)
 
 static struct global_cwq *get_gcwq(unsigned int cpu)
 {
-	if (cpu != WORK_CPU_UNBOUND)
-		return &per_cpu(global_cwq, cpu);
-	else
-		return &unbound_global_cwq;
+	return &per_cpu(global_cwq, cpu);
 }
 
 static atomic_t *get_pool_nr_running(struct worker_pool *pool)
@@ -506,14 +527,23 @@ static atomic_t *get_pool_nr_running(struct worker_pool *pool)
 		return &unbound_pool_nr_running[idx];
 }
 
+/*
+ * For an unbound @wq, the cwq of the node of @cpu is returned, or that of
+ * the local node if @cpu is WORK_CPU_UNBOUND.  Unbound cwqs may be
+ * replaced by apply_workqueue_attrs() and the result is only stable under
+ * sched-RCU.
+ */
 static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
 					    struct workqueue_struct *wq)
 {
 	if (!(wq->flags & WQ_UNBOUND)) {
 		if (likely(cpu < nr_cpu_ids))
-			return per_cpu_ptr(wq->cpu_wq.pcpu, cpu);
-	} else if (likely(cpu == WORK_CPU_UNBOUND))
-		return wq->cpu_wq.single;
+			return per_cpu_ptr(wq->cpu_cwqs, cpu);
+	} else if (likely(cpu < nr_cpu_ids || cpu == WORK_CPU_UNBOUND)) {
+		int node = cpu < nr_cpu_ids ? cpu_to_node(cpu) : numa_node_id();
+
+		return rcu_dereference_sched(wq->numa_cwq_tbl[node]);
+	}
 	return NULL;
 }
 
@@ -536,16 +566,19 @@ static int work_next_color(int color)
 /*
  * A work's data points to the cwq with WORK_STRUCT_CWQ set while the
  * work is on queue.  Once execution starts, WORK_STRUCT_CWQ is
- * cleared and the work data contains the cpu number it was last on.
+ * cleared and the work data contains the id of the gcwq it was last
+ * on, which is the cpu number for per-cpu gcwqs.
  *
- * set_work_{cwq|cpu}() and clear_work_data() can be used to set the
- * cwq, cpu or clear work->data.  These functions should only be
+ * set_work_{cwq|gcwq_id}() and clear_work_data() can be used to set the
+ * cwq, gcwq id or clear work->data.  These functions should only be
  * called while the work is owned - ie. while the PENDING bit is set.
  *
  * get_work_[g]cwq() can be used to obtain the gcwq or cwq
  * corresponding to a work.  gcwq is available once the work has been
  * queued anywhere after initialization.  cwq is available only from
- * queueing until execution starts.
+ * queueing until execution starts.  As unbound gcwqs can go away,
+ * get_work_gcwq() must be called under sched-RCU, e.g. with irqs
+ * disabled, and the gcwq is only guaranteed to stay around until then.
  */
 static inline void set_work_data(struct work_struct *work, unsigned long data,
 				 unsigned long flags)
@@ -562,9 +595,10 @@ static void set_work_cwq(struct work_struct *work,
 		      WORK_STRUCT_PENDING | WORK_STRUCT_CWQ | extra_flags);
 }
 
-static void set_work_cpu(struct work_struct *work, unsigned int cpu)
+static void set_work_gcwq_id(struct work_struct *work, unsigned int id)
 {
-	set_work_data(work, cpu << WORK_STRUCT_FLAG_BITS, WORK_STRUCT_PENDING);
+	set_work_data(work, (unsigned long)id << WORK_STRUCT_FLAG_BITS,
+		      WORK_STRUCT_PENDING);
 }
 
 static void clear_work_data(struct work_struct *work)
@@ -585,18 +619,86 @@ static struct cpu_workqueue_struct *get_work_cwq(struct work_struct *work)
 static struct global_cwq *get_work_gcwq(struct work_struct *work)
 {
 	unsigned long data = atomic_long_read(&work->data);
-	unsigned int cpu;
+	struct global_cwq *gcwq;
+	unsigned long id;
+
+	rcu_lockdep_assert(rcu_read_lock_sched_held(),
+			   "get_work_gcwq() needs sched-RCU protection");
 
 	if (data & WORK_STRUCT_CWQ)
 		return ((struct cpu_workqueue_struct *)
 			(data & WORK_STRUCT_WQ_DATA_MASK))->pool->gcwq;
 
-	cpu = data >> WORK_STRUCT_FLAG_BITS;
-	if (cpu == WORK_CPU_NONE)
+	id = data >> WORK_STRUCT_FLAG_BITS;
+	if (id == WORK_CPU_NONE)
 		return NULL;
 
-	BUG_ON(cpu >= nr_cpu_ids && cpu != WORK_CPU_UNBOUND);
-	return get_gcwq(cpu);
+	if (id < nr_cpu_ids)
+		return get_gcwq(id);
+
+	BUG_ON(id <= WORK_CPU_LAST);
+
+	/* an unbound gcwq, which may have been released since */
+	rcu_read_lock();
+	gcwq = idr_find(&unbound_gcwq_idr, id);
+	rcu_read_unlock();
+	return gcwq;
+}
+
+/**
+ * cwq_get - get an extra reference on the specified cwq
+ * @cwq: cwq to get
+ *
+ * Obtain an extra reference on @cwq.  The caller should guarantee that
+ * @cwq has positive refcnt.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void cwq_get(struct cpu_workqueue_struct *cwq)
+{
+	lockdep_assert_held(&cwq->pool->gcwq->lock);
+	WARN_ON_ONCE(cwq->refcnt <= 0);
+	cwq->refcnt++;
+}
+
+/**
+ * cwq_put - put a cwq reference
+ * @cwq: cwq to put
+ *
+ * Drop a reference of @cwq.  If its refcnt reaches zero, schedule its
+ * release.  Only unbound cwqs can get there, the per-cpu ones are owned
+ * by their workqueue until destroy_workqueue().
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void cwq_put(struct cpu_workqueue_struct *cwq)
+{
+	lockdep_assert_held(&cwq->pool->gcwq->lock);
+	if (likely(--cwq->refcnt))
+		return;
+	if (WARN_ON_ONCE(!(cwq->wq->flags & WQ_UNBOUND)))
+		return;
+	/*
+	 * @cwq can't be released under gcwq->lock, bounce to
+	 * cwq_unbound_release_workfn().  This never recurses on the same
+	 * gcwq->lock as this path is taken only for unbound workqueues and
+	 * the release work item is scheduled on a per-cpu workqueue.  To
+	 * avoid lockdep warning, unbound gcwq->locks are given lockdep
+	 * subclass of 1 in get_unbound_gcwq().
+	 */
+	schedule_work(&cwq->unbound_release_work);
+}
+
+/* cwq_put() with the surrounding gcwq->lock locking */
+static void cwq_put_unlocked(struct cpu_workqueue_struct *cwq)
+{
+	struct global_cwq *gcwq = cwq->pool->gcwq;
+
+	spin_lock_irq(&gcwq->lock);
+	cwq_put(cwq);
+	spin_unlock_irq(&gcwq->lock);
 }
 
 /*
@@ -921,6 +1023,9 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 {
 	struct worker_pool *pool = cwq->pool;
 
+	/* @work pins @cwq until cwq_dec_nr_in_flight() */
+	cwq_get(cwq);
+
 	/* we own @work, set data and link */
 	set_work_cwq(work, cwq, extra_flags);
 
@@ -945,40 +1050,29 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 
 /*
  * Test whether @work is being queued from another work executing on the
- * same workqueue.  This is rather expensive and should only be used from
- * cold paths.
+ * same workqueue.
  */
 static bool is_chained_work(struct workqueue_struct *wq)
 {
-	unsigned long flags;
-	unsigned int cpu;
+	struct worker *worker = NULL;
 
-	for_each_gcwq_cpu(cpu) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
-		struct worker *worker;
-		struct hlist_node *pos;
-		int i;
+	if (current->flags & PF_WQ_WORKER)
+		worker = kthread_data(current);
+	else if (wq->rescuer && wq->rescuer->task == current)
+		worker = wq->rescuer;
 
-		spin_lock_irqsave(&gcwq->lock, flags);
-		for_each_busy_worker(worker, i, pos, gcwq) {
-			if (worker->task != current)
-				continue;
-			spin_unlock_irqrestore(&gcwq->lock, flags);
-			/*
-			 * I'm @worker, no locking necessary.  See if @work
-			 * is headed to the same workqueue.
-			 */
-			return worker->current_cwq->wq == wq;
-		}
-		spin_unlock_irqrestore(&gcwq->lock, flags);
-	}
-	return false;
+	/*
+	 * If I'm @worker, no locking necessary.  See if @work is headed
+	 * to the same workqueue.
+	 */
+	return worker && worker->current_cwq &&
+		worker->current_cwq->wq == wq;
 }
 
 static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 			 struct work_struct *work)
 {
-	struct global_cwq *gcwq;
+	struct global_cwq *gcwq, *last_gcwq;
 	struct cpu_workqueue_struct *cwq;
 	struct list_head *worklist;
 	unsigned int work_flags;
@@ -991,44 +1085,57 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 	    WARN_ON_ONCE(!is_chained_work(wq)))
 		return;
 
-	/* determine gcwq to use */
-	if (!(wq->flags & WQ_UNBOUND)) {
-		struct global_cwq *last_gcwq;
+	/*
+	 * Disabling irqs also keeps sched-RCU read-locked which keeps the
+	 * unbound cwqs and gcwqs looked up below from being freed.
+	 */
+	local_irq_save(flags);
+retry:
+	/* determine cwq to use */
+	if (!(wq->flags & WQ_UNBOUND) && unlikely(cpu == WORK_CPU_UNBOUND))
+		cpu = raw_smp_processor_id();
 
-		if (unlikely(cpu == WORK_CPU_UNBOUND))
-			cpu = raw_smp_processor_id();
+	cwq = get_cwq(cpu, wq);
+	gcwq = cwq->pool->gcwq;
 
-		/*
-		 * It's multi cpu.  If @wq is non-reentrant and @work
-		 * was previously on a different cpu, it might still
-		 * be running there, in which case the work needs to
-		 * be queued on that cpu to guarantee non-reentrance.
-		 */
-		gcwq = get_gcwq(cpu);
-		if (wq->flags & WQ_NON_REENTRANT &&
-		    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
-			struct worker *worker;
+	/*
+	 * If @work was previously on a different gcwq, it might still be
+	 * running there, in which case the work needs to be queued on
+	 * that gcwq to guarantee non-reentrance.  This is done for
+	 * non-reentrant workqueues and for unbound ones, whose works may
+	 * otherwise run concurrently on the gcwqs of different nodes.
+	 */
+	if (wq->flags & (WQ_NON_REENTRANT | WQ_UNBOUND) &&
+	    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
+		struct worker *worker;
 
-			spin_lock_irqsave(&last_gcwq->lock, flags);
+		spin_lock(&last_gcwq->lock);
 
-			worker = find_worker_executing_work(last_gcwq, work);
+		worker = find_worker_executing_work(last_gcwq, work);
 
-			if (worker && worker->current_cwq->wq == wq)
-				gcwq = last_gcwq;
-			else {
-				/* meh... not running there, queue here */
-				spin_unlock_irqrestore(&last_gcwq->lock, flags);
-				spin_lock_irqsave(&gcwq->lock, flags);
-			}
-		} else
-			spin_lock_irqsave(&gcwq->lock, flags);
-	} else {
-		gcwq = get_gcwq(WORK_CPU_UNBOUND);
-		spin_lock_irqsave(&gcwq->lock, flags);
+		if (worker && worker->current_cwq->wq == wq) {
+			cwq = worker->current_cwq;
+			gcwq = last_gcwq;
+		} else {
+			/* meh... not running there, queue here */
+			spin_unlock(&last_gcwq->lock);
+			spin_lock(&gcwq->lock);
+		}
+	} else
+		spin_lock(&gcwq->lock);
+
+	/*
+	 * An unbound cwq retired by apply_workqueue_attrs() may have lost
+	 * its last reference after we looked it up.  Its replacement is
+	 * already installed, look again.
+	 */
+	if (unlikely(!cwq->refcnt)) {
+		spin_unlock(&gcwq->lock);
+		cpu_relax();
+		goto retry;
 	}
 
-	/* gcwq determined, get cwq and queue */
-	cwq = get_cwq(gcwq->cpu, wq);
+	/* cwq determined, queue */
 	trace_workqueue_queue_work(cpu, cwq, work);
 
 	if (WARN_ON(!list_empty(&work->entry))) {
@@ -1101,9 +1208,8 @@ EXPORT_SYMBOL_GPL(queue_work_on);
 static void delayed_work_timer_fn(unsigned long __data)
 {
 	struct delayed_work *dwork = (struct delayed_work *)__data;
-	struct cpu_workqueue_struct *cwq = get_work_cwq(&dwork->work);
 
-	__queue_work(smp_processor_id(), cwq->wq, &dwork->work);
+	__queue_work(smp_processor_id(), dwork->wq, &dwork->work);
 }
 
 /**
@@ -1141,29 +1247,19 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 	struct work_struct *work = &dwork->work;
 
 	if (!test_and_set_bit(WORK_STRUCT_PENDING_BIT, work_data_bits(work))) {
-		unsigned int lcpu;
-
 		WARN_ON_ONCE(timer_pending(timer));
 		WARN_ON_ONCE(!list_empty(&work->entry));
 
 		timer_stats_timer_set_start_info(&dwork->timer);
 
 		/*
-		 * This stores cwq for the moment, for the timer_fn.
-		 * Note that the work's gcwq is preserved to allow
-		 * reentrance detection for delayed works.
+		 * The timer_fn finds @wq in @dwork.  work->data is left
+		 * alone so that the work's gcwq is preserved to allow
+		 * reentrance detection for delayed works.  It can't point
+		 * to a cwq here as unbound cwqs may be released before the
+		 * timer fires.
 		 */
-		if (!(wq->flags & WQ_UNBOUND)) {
-			struct global_cwq *gcwq = get_work_gcwq(work);
-
-			if (gcwq && gcwq->cpu != WORK_CPU_UNBOUND)
-				lcpu = gcwq->cpu;
-			else
-				lcpu = raw_smp_processor_id();
-		} else
-			lcpu = WORK_CPU_UNBOUND;
-
-		set_work_cwq(work, get_cwq(lcpu, wq), 0);
+		dwork->wq = wq;
 
 		timer->expires = jiffies + delay;
 		timer->data = (unsigned long)dwork;
@@ -1284,6 +1380,8 @@ __acquires(&gcwq->lock)
 		 */
 		if (!(gcwq->flags & GCWQ_DISASSOCIATED))
 			set_cpus_allowed_ptr(task, get_cpu_mask(gcwq->cpu));
+		else if (gcwq->attrs)
+			set_cpus_allowed_ptr(task, gcwq->attrs->cpumask);
 
 		spin_lock_irq(&gcwq->lock);
 		if (gcwq->flags & GCWQ_DISASSOCIATED)
@@ -1547,13 +1645,17 @@ static struct worker *create_worker(struct worker_pool *pool)
 					worker, cpu_to_node(gcwq->cpu),
 					"kworker/%u:%d%s", gcwq->cpu, id, pri);
 	else
-		worker->task = kthread_create(worker_thread, worker,
-					      "kworker/u:%d%s", id, pri);
+		worker->task = kthread_create_on_node(worker_thread,
+					worker, gcwq->node,
+					"kworker/u%d:%d%s",
+					gcwq->id - (WORK_CPU_LAST + 1), id, pri);
 	if (IS_ERR(worker->task))
 		goto fail;
 
 	if (worker_pool_pri(pool))
 		set_user_nice(worker->task, HIGHPRI_NICE_LEVEL);
+	else if (gcwq->attrs)
+		set_user_nice(worker->task, gcwq->attrs->nice);
 
 	/*
 	 * Determine CPU binding of the new worker depending on
@@ -1567,6 +1669,8 @@ static struct worker *create_worker(struct worker_pool *pool)
 	if (!(gcwq->flags & GCWQ_DISASSOCIATED)) {
 		kthread_bind(worker->task, gcwq->cpu);
 	} else {
+		if (gcwq->attrs)
+			set_cpus_allowed_ptr(worker->task, gcwq->attrs->cpumask);
 		worker->task->flags |= PF_THREAD_BOUND;
 		worker->flags |= WORKER_UNBOUND;
 	}
@@ -1666,18 +1770,19 @@ static bool send_mayday(struct work_struct *work)
 {
 	struct cpu_workqueue_struct *cwq = get_work_cwq(work);
 	struct workqueue_struct *wq = cwq->wq;
-	unsigned int cpu;
 
 	if (!(wq->flags & WQ_RESCUER))
 		return false;
 
 	/* mayday mayday mayday */
-	cpu = cwq->pool->gcwq->cpu;
-	/* WORK_CPU_UNBOUND can't be set in cpumask, use cpu 0 instead */
-	if (cpu == WORK_CPU_UNBOUND)
-		cpu = 0;
-	if (!mayday_test_and_set_cpu(cpu, wq->mayday_mask))
+	spin_lock(&wq_mayday_lock);
+	if (list_empty(&cwq->mayday_node)) {
+		/* the rescuer puts the reference once it's done with @cwq */
+		cwq_get(cwq);
+		list_add_tail(&cwq->mayday_node, &wq->maydays);
 		wake_up_process(wq->rescuer->task);
+	}
+	spin_unlock(&wq_mayday_lock);
 	return true;
 }
 
@@ -1960,9 +2065,9 @@ static void cwq_activate_first_delayed(struct cpu_workqueue_struct *cwq)
 static void cwq_dec_nr_in_flight(struct cpu_workqueue_struct *cwq, int color,
 				 bool delayed)
 {
-	/* ignore uncolored works */
+	/* uncolored works don't participate in flushing or nr_active */
 	if (color == WORK_NO_COLOR)
-		return;
+		goto out_put;
 
 	cwq->nr_in_flight[color]--;
 
@@ -1977,11 +2082,11 @@ static void cwq_dec_nr_in_flight(struct cpu_workqueue_struct *cwq, int color,
 
 	/* is flush in progress and are we at the flushing tip? */
 	if (likely(cwq->flush_color != color))
-		return;
+		goto out_put;
 
 	/* are there still in-flight works? */
 	if (cwq->nr_in_flight[color])
-		return;
+		goto out_put;
 
 	/* this cwq is done, clear flush_color */
 	cwq->flush_color = -1;
@@ -1992,6 +2097,9 @@ static void cwq_dec_nr_in_flight(struct cpu_workqueue_struct *cwq, int color,
 	 */
 	if (atomic_dec_and_test(&cwq->wq->nr_cwqs_to_flush))
 		complete(&cwq->wq->first_flusher->done);
+out_put:
+	/* drop the reference taken by insert_work() */
+	cwq_put(cwq);
 }
 
 /**
@@ -2060,8 +2168,8 @@ __acquires(&gcwq->lock)
 	worker->current_cwq = cwq;
 	work_color = get_work_color(work);
 
-	/* record the current cpu number in the work data and dequeue */
-	set_work_cpu(work, gcwq->cpu);
+	/* record the current gcwq id in the work data and dequeue */
+	set_work_gcwq_id(work, gcwq->id);
 	list_del_init(&work->entry);
 
 	/*
@@ -2259,8 +2367,6 @@ static int rescuer_thread(void *__wq)
 	struct workqueue_struct *wq = __wq;
 	struct worker *rescuer = wq->rescuer;
 	struct list_head *scheduled = &rescuer->scheduled;
-	bool is_unbound = wq->flags & WQ_UNBOUND;
-	unsigned int cpu;
 
 	set_user_nice(current, RESCUER_NICE_LEVEL);
 repeat:
@@ -2271,19 +2377,20 @@ repeat:
 		return 0;
 	}
 
-	/*
-	 * See whether any cpu is asking for help.  Unbounded
-	 * workqueues use cpu 0 in mayday_mask for CPU_UNBOUND.
-	 */
-	for_each_mayday_cpu(cpu, wq->mayday_mask) {
-		unsigned int tcpu = is_unbound ? WORK_CPU_UNBOUND : cpu;
-		struct cpu_workqueue_struct *cwq = get_cwq(tcpu, wq);
+	/* see whether any cwq is asking for help */
+	spin_lock_irq(&wq_mayday_lock);
+
+	while (!list_empty(&wq->maydays)) {
+		struct cpu_workqueue_struct *cwq = list_first_entry(&wq->maydays,
+					struct cpu_workqueue_struct, mayday_node);
 		struct worker_pool *pool = cwq->pool;
 		struct global_cwq *gcwq = pool->gcwq;
 		struct work_struct *work, *n;
 
 		__set_current_state(TASK_RUNNING);
-		mayday_clear_cpu(cpu, wq->mayday_mask);
+		list_del_init(&cwq->mayday_node);
+
+		spin_unlock_irq(&wq_mayday_lock);
 
 		/* migrate to the target cpu if possible */
 		rescuer->pool = pool;
@@ -2308,9 +2415,15 @@ repeat:
 		if (keep_working(pool))
 			wake_up_worker(pool);
 
-		spin_unlock_irq(&gcwq->lock);
+		/* put the reference grabbed by send_mayday() */
+		cwq_put(cwq);
+
+		spin_unlock(&gcwq->lock);
+		spin_lock(&wq_mayday_lock);
 	}
 
+	spin_unlock_irq(&wq_mayday_lock);
+
 	schedule();
 	goto repeat;
 }
@@ -2421,16 +2534,15 @@ static void insert_wq_barrier(struct cpu_workqueue_struct *cwq,
 static bool flush_workqueue_prep_cwqs(struct workqueue_struct *wq,
 				      int flush_color, int work_color)
 {
+	struct cpu_workqueue_struct *cwq;
 	bool wait = false;
-	unsigned int cpu;
 
 	if (flush_color >= 0) {
 		BUG_ON(atomic_read(&wq->nr_cwqs_to_flush));
 		atomic_set(&wq->nr_cwqs_to_flush, 1);
 	}
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	for_each_cwq(cwq, wq) {
 		struct global_cwq *gcwq = cwq->pool->gcwq;
 
 		spin_lock_irq(&gcwq->lock);
@@ -2628,8 +2740,8 @@ EXPORT_SYMBOL_GPL(flush_workqueue);
  */
 void drain_workqueue(struct workqueue_struct *wq)
 {
+	struct cpu_workqueue_struct *cwq;
 	unsigned int flush_cnt = 0;
-	unsigned int cpu;
 
 	/*
 	 * __queue_work() needs to test whether there are drainers, is much
@@ -2643,8 +2755,9 @@ void drain_workqueue(struct workqueue_struct *wq)
 reflush:
 	flush_workqueue(wq);
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	mutex_lock(&wq->flush_mutex);
+
+	for_each_cwq(cwq, wq) {
 		bool drained;
 
 		spin_lock_irq(&cwq->pool->gcwq->lock);
@@ -2658,9 +2771,13 @@ reflush:
 		    (flush_cnt % 100 == 0 && flush_cnt <= 1000))
 			pr_warning("workqueue %s: flush on destruction isn't complete after %u tries\n",
 				   wq->name, flush_cnt);
+
+		mutex_unlock(&wq->flush_mutex);
 		goto reflush;
 	}
 
+	mutex_unlock(&wq->flush_mutex);
+
 	spin_lock(&workqueue_lock);
 	if (!--wq->nr_drainers)
 		wq->flags &= ~WQ_DRAINING;
@@ -2674,13 +2791,18 @@ static bool start_flush_work(struct work_struct *work, struct wq_barrier *barr,
 	struct worker *worker = NULL;
 	struct global_cwq *gcwq;
 	struct cpu_workqueue_struct *cwq;
+	struct workqueue_struct *wq;
 
 	might_sleep();
+
+	local_irq_disable();
 	gcwq = get_work_gcwq(work);
-	if (!gcwq)
+	if (!gcwq) {
+		local_irq_enable();
 		return false;
+	}
 
-	spin_lock_irq(&gcwq->lock);
+	spin_lock(&gcwq->lock);
 	if (!list_empty(&work->entry)) {
 		/*
 		 * See the comment near try_to_grab_pending()->smp_rmb().
@@ -2699,6 +2821,8 @@ static bool start_flush_work(struct work_struct *work, struct wq_barrier *barr,
 	} else
 		goto already_gone;
 
+	/* @cwq may be released once unlocked, @wq is stable */
+	wq = cwq->wq;
 	insert_wq_barrier(cwq, barr, work, worker);
 	spin_unlock_irq(&gcwq->lock);
 
@@ -2708,11 +2832,11 @@ static bool start_flush_work(struct work_struct *work, struct wq_barrier *barr,
 	 * flusher is not running on the same workqueue by verifying write
 	 * access.
 	 */
-	if (cwq->wq->saved_max_active == 1 || cwq->wq->flags & WQ_RESCUER)
-		lock_map_acquire(&cwq->wq->lockdep_map);
+	if (wq->saved_max_active == 1 || wq->flags & WQ_RESCUER)
+		lock_map_acquire(&wq->lockdep_map);
 	else
-		lock_map_acquire_read(&cwq->wq->lockdep_map);
-	lock_map_release(&cwq->wq->lockdep_map);
+		lock_map_acquire_read(&wq->lockdep_map);
+	lock_map_release(&wq->lockdep_map);
 
 	return true;
 already_gone:
@@ -2777,16 +2901,35 @@ static bool wait_on_cpu_work(struct global_cwq *gcwq, struct work_struct *work)
 
 static bool wait_on_work(struct work_struct *work)
 {
+	struct global_cwq *gcwq;
 	bool ret = false;
-	int cpu;
+	int cpu, id;
 
 	might_sleep();
 
 	lock_map_acquire(&work->lockdep_map);
 	lock_map_release(&work->lockdep_map);
 
-	for_each_gcwq_cpu(cpu)
+	for_each_possible_cpu(cpu)
 		ret |= wait_on_cpu_work(get_gcwq(cpu), work);
+
+	/*
+	 * Unbound gcwqs come and go.  Pin each across the wait, the work
+	 * being waited upon may well be creating or destroying some.
+	 */
+	mutex_lock(&wq_pool_mutex);
+	for (id = WORK_CPU_LAST + 1;
+	     (gcwq = idr_get_next(&unbound_gcwq_idr, &id)); id++) {
+		gcwq->refcnt++;
+		mutex_unlock(&wq_pool_mutex);
+
+		ret |= wait_on_cpu_work(gcwq, work);
+
+		mutex_lock(&wq_pool_mutex);
+		put_unbound_gcwq(gcwq);
+	}
+	mutex_unlock(&wq_pool_mutex);
+
 	return ret;
 }
 
@@ -2841,11 +2984,14 @@ static int try_to_grab_pending(struct work_struct *work)
 	 * The queueing is in progress, or it is already queued. Try to
 	 * steal it from ->worklist without clearing WORK_STRUCT_PENDING.
 	 */
+	local_irq_disable();
 	gcwq = get_work_gcwq(work);
-	if (!gcwq)
+	if (!gcwq) {
+		local_irq_enable();
 		return ret;
+	}
 
-	spin_lock_irq(&gcwq->lock);
+	spin_lock(&gcwq->lock);
 	if (!list_empty(&work->entry)) {
 		/*
 		 * This work is queued, but perhaps we locked the wrong gcwq.
@@ -2934,8 +3080,7 @@ EXPORT_SYMBOL_GPL(cancel_work_sync);
 bool flush_delayed_work(struct delayed_work *dwork)
 {
 	if (del_timer_sync(&dwork->timer))
-		__queue_work(raw_smp_processor_id(),
-			     get_work_cwq(&dwork->work)->wq, &dwork->work);
+		__queue_work(raw_smp_processor_id(), dwork->wq, &dwork->work);
 	return flush_work(&dwork->work);
 }
 EXPORT_SYMBOL(flush_delayed_work);
@@ -2955,8 +3100,7 @@ EXPORT_SYMBOL(flush_delayed_work);
 bool flush_delayed_work_sync(struct delayed_work *dwork)
 {
 	if (del_timer_sync(&dwork->timer))
-		__queue_work(raw_smp_processor_id(),
-			     get_work_cwq(&dwork->work)->wq, &dwork->work);
+		__queue_work(raw_smp_processor_id(), dwork->wq, &dwork->work);
 	return flush_work_sync(&dwork->work);
 }
 EXPORT_SYMBOL(flush_delayed_work_sync);
@@ -3135,137 +3279,703 @@ int keventd_up(void)
 	return system_wq != NULL;
 }
 
-static int alloc_cwqs(struct workqueue_struct *wq)
+struct workqueue_attrs *alloc_workqueue_attrs(gfp_t gfp_mask);
+
+/**
+ * free_workqueue_attrs - free a workqueue_attrs
+ * @attrs: workqueue_attrs to free
+ *
+ * Undo alloc_workqueue_attrs().
+ */
+void free_workqueue_attrs(struct workqueue_attrs *attrs)
 {
-	/*
-	 * cwqs are forced aligned according to WORK_STRUCT_FLAG_BITS.
-	 * Make sure that the alignment isn't lower than that of
-	 * unsigned long long.
-	 */
-	const size_t size = sizeof(struct cpu_workqueue_struct);
-	const size_t align = max_t(size_t, 1 << WORK_STRUCT_FLAG_BITS,
-				   __alignof__(unsigned long long));
+	if (attrs) {
+		free_cpumask_var(attrs->cpumask);
+		kfree(attrs);
+	}
+}
+EXPORT_SYMBOL_GPL(free_workqueue_attrs);
 
-	if (!(wq->flags & WQ_UNBOUND))
-		wq->cpu_wq.pcpu = __alloc_percpu(size, align);
-	else {
-		void *ptr;
+/**
+ * alloc_workqueue_attrs - allocate a workqueue_attrs
+ * @gfp_mask: allocation mask to use
+ *
+ * Allocate a new workqueue_attrs, initialize with default settings and
+ * return it.  Returns NULL on failure.
+ */
+struct workqueue_attrs *alloc_workqueue_attrs(gfp_t gfp_mask)
+{
+	struct workqueue_attrs *attrs;
 
-		/*
-		 * Allocate enough room to align cwq and put an extra
-		 * pointer at the end pointing back to the originally
-		 * allocated pointer which will be used for free.
-		 */
-		ptr = kzalloc(size + align + sizeof(void *), GFP_KERNEL);
-		if (ptr) {
-			wq->cpu_wq.single = PTR_ALIGN(ptr, align);
-			*(void **)(wq->cpu_wq.single + 1) = ptr;
-		}
-	}
+	attrs = kzalloc(sizeof(*attrs), gfp_mask);
+	if (!attrs)
+		goto fail;
+	if (!alloc_cpumask_var(&attrs->cpumask, gfp_mask))
+		goto fail;
 
-	/* just in case, make sure it's actually aligned */
-	BUG_ON(!IS_ALIGNED(wq->cpu_wq.v, align));
-	return wq->cpu_wq.v ? 0 : -ENOMEM;
+	cpumask_copy(attrs->cpumask, cpu_possible_mask);
+	return attrs;
+fail:
+	free_workqueue_attrs(attrs);
+	return NULL;
 }
+EXPORT_SYMBOL_GPL(alloc_workqueue_attrs);
 
-static void free_cwqs(struct workqueue_struct *wq)
+static void copy_workqueue_attrs(struct workqueue_attrs *to,
+				 const struct workqueue_attrs *from)
 {
-	if (!(wq->flags & WQ_UNBOUND))
-		free_percpu(wq->cpu_wq.pcpu);
-	else if (wq->cpu_wq.single) {
-		/* the pointer to free is stored right after the cwq */
-		kfree(*(void **)(wq->cpu_wq.single + 1));
-	}
+	to->nice = from->nice;
+	cpumask_copy(to->cpumask, from->cpumask);
+	to->no_numa = from->no_numa;
 }
 
-static int wq_clamp_max_active(int max_active, unsigned int flags,
-			       const char *name)
+/* hash value of the content of @attrs */
+static u32 wqattrs_hash(const struct workqueue_attrs *attrs)
 {
-	int lim = flags & WQ_UNBOUND ? WQ_UNBOUND_MAX_ACTIVE : WQ_MAX_ACTIVE;
+	u32 hash = 0;
 
-	if (max_active < 1 || max_active > lim)
-		printk(KERN_WARNING "workqueue: max_active %d requested for %s "
-		       "is out of range, clamping between %d and %d\n",
-		       max_active, name, 1, lim);
+	hash = jhash_1word(attrs->nice, hash);
+	hash = jhash(cpumask_bits(attrs->cpumask),
+		     BITS_TO_LONGS(nr_cpumask_bits) * sizeof(long), hash);
+	return hash;
+}
 
-	return clamp_val(max_active, 1, lim);
+/* content equality test */
+static bool wqattrs_equal(const struct workqueue_attrs *a,
+			  const struct workqueue_attrs *b)
+{
+	return a->nice == b->nice && cpumask_equal(a->cpumask, b->cpumask);
 }
 
-struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
-					       unsigned int flags,
-					       int max_active,
-					       struct lock_class_key *key,
-					       const char *lock_name, ...)
+/* claim manager positions of all pools */
+static void gcwq_claim_management_and_lock(struct global_cwq *gcwq)
 {
-	va_list args, args1;
-	struct workqueue_struct *wq;
-	unsigned int cpu;
-	size_t namelen;
+	struct worker_pool *pool;
 
-	/* determine namelen, allocate wq and format name */
-	va_start(args, lock_name);
-	va_copy(args1, args);
-	namelen = vsnprintf(NULL, 0, fmt, args) + 1;
+	for_each_worker_pool(pool, gcwq)
+		mutex_lock_nested(&pool->manager_mutex, pool - gcwq->pools);
+	spin_lock_irq(&gcwq->lock);
+}
 
-	wq = kzalloc(sizeof(*wq) + namelen, GFP_KERNEL);
-	if (!wq)
-		goto err;
+/* release manager positions */
+static void gcwq_release_management_and_unlock(struct global_cwq *gcwq)
+{
+	struct worker_pool *pool;
 
-	vsnprintf(wq->name, namelen, fmt, args1);
-	va_end(args);
-	va_end(args1);
+	spin_unlock_irq(&gcwq->lock);
+	for_each_worker_pool(pool, gcwq)
+		mutex_unlock(&pool->manager_mutex);
+}
 
-	/*
-	 * Workqueues which may be used during memory reclaim should
-	 * have a rescuer to guarantee forward progress.
-	 */
-	if (flags & WQ_MEM_RECLAIM)
-		flags |= WQ_RESCUER;
+/* initialize the fields of @gcwq and its pools common to all gcwqs */
+static void init_gcwq(struct global_cwq *gcwq)
+{
+	struct worker_pool *pool;
+	int i;
 
-	max_active = max_active ?: WQ_DFL_ACTIVE;
-	max_active = wq_clamp_max_active(max_active, flags, wq->name);
+	spin_lock_init(&gcwq->lock);
+	gcwq->flags |= GCWQ_DISASSOCIATED;
 
-	/* init wq */
-	wq->flags = flags;
-	wq->saved_max_active = max_active;
-	mutex_init(&wq->flush_mutex);
-	atomic_set(&wq->nr_cwqs_to_flush, 0);
-	INIT_LIST_HEAD(&wq->flusher_queue);
-	INIT_LIST_HEAD(&wq->flusher_overflow);
+	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&gcwq->busy_hash[i]);
 
-	lockdep_init_map(&wq->lockdep_map, lock_name, key, 0);
-	INIT_LIST_HEAD(&wq->list);
+	for_each_worker_pool(pool, gcwq) {
+		pool->gcwq = gcwq;
+		INIT_LIST_HEAD(&pool->worklist);
+		INIT_LIST_HEAD(&pool->idle_list);
 
-	if (alloc_cwqs(wq) < 0)
-		goto err;
+		init_timer_deferrable(&pool->idle_timer);
+		pool->idle_timer.function = idle_worker_timeout;
+		pool->idle_timer.data = (unsigned long)pool;
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
-		struct global_cwq *gcwq = get_gcwq(cpu);
-		int pool_idx = (bool)(flags & WQ_HIGHPRI);
+		setup_timer(&pool->mayday_timer, gcwq_mayday_timeout,
+			    (unsigned long)pool);
 
-		BUG_ON((unsigned long)cwq & WORK_STRUCT_FLAG_MASK);
-		cwq->pool = &gcwq->pools[pool_idx];
-		cwq->wq = wq;
-		cwq->flush_color = -1;
-		cwq->max_active = max_active;
-		INIT_LIST_HEAD(&cwq->delayed_works);
+		mutex_init(&pool->manager_mutex);
+		ida_init(&pool->worker_ida);
 	}
 
-	if (flags & WQ_RESCUER) {
-		struct worker *rescuer;
+	init_waitqueue_head(&gcwq->rebind_hold);
 
-		if (!alloc_mayday_mask(&wq->mayday_mask, GFP_KERNEL))
-			goto err;
+	INIT_HLIST_NODE(&gcwq->hash_node);
+	gcwq->refcnt = 1;
+}
+
+static void rcu_free_gcwq(struct rcu_head *rcu)
+{
+	struct global_cwq *gcwq = container_of(rcu, struct global_cwq, rcu);
+	struct worker_pool *pool;
+
+	for_each_worker_pool(pool, gcwq)
+		ida_destroy(&pool->worker_ida);
+	free_workqueue_attrs(gcwq->attrs);
+	kfree(gcwq);
+}
+
+/**
+ * put_unbound_gcwq - put an unbound gcwq
+ * @gcwq: unbound gcwq to put
+ *
+ * Put @gcwq.  If its refcnt reaches zero, it gets destroyed in sched-RCU
+ * safe manner.
+ *
+ * CONTEXT:
+ * mutex_lock(wq_pool_mutex).
+ */
+static void put_unbound_gcwq(struct global_cwq *gcwq)
+{
+	struct worker_pool *pool;
+	struct worker *worker;
+	bool busy;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	if (--gcwq->refcnt)
+		return;
+
+	/* sanity checks */
+	if (WARN_ON(gcwq->cpu != WORK_CPU_UNBOUND))
+		return;
+
+	/* release id and unhash, new lookups can't find @gcwq anymore */
+	if (gcwq->id >= 0)
+		idr_remove(&unbound_gcwq_idr, gcwq->id);
+	hlist_del_init(&gcwq->hash_node);
+
+	/*
+	 * No cwq references @gcwq and thus all its workers are or are
+	 * about to become idle.  Become the manager and destroy them.  A
+	 * worker woken up by the idle timer may be on its way to become
+	 * the manager itself and be neither idle nor busy; keep trying
+	 * until it settles down.
+	 */
+	do {
+		busy = false;
+		gcwq_claim_management_and_lock(gcwq);
+		for_each_worker_pool(pool, gcwq) {
+			while ((worker = first_worker(pool)))
+				destroy_worker(worker);
+			if (pool->nr_workers)
+				busy = true;
+		}
+		gcwq_release_management_and_unlock(gcwq);
+
+		if (busy)
+			schedule_timeout_uninterruptible(1);
+	} while (busy);
+
+	for_each_worker_pool(pool, gcwq) {
+		del_timer_sync(&pool->idle_timer);
+		del_timer_sync(&pool->mayday_timer);
+	}
+
+	/* sched-RCU protected to allow dereferences from get_work_gcwq() */
+	call_rcu_sched(&gcwq->rcu, rcu_free_gcwq);
+}
+
+/**
+ * get_unbound_gcwq - get a gcwq with the specified attributes
+ * @attrs: the attributes of the gcwq to get
+ *
+ * Obtain a gcwq matching @attrs and bump its refcnt.  If there already is
+ * a matching gcwq, it will be used; otherwise, this function attempts to
+ * create a new one.  On failure, returns NULL.
+ *
+ * CONTEXT:
+ * mutex_lock(wq_pool_mutex).  Might sleep.
+ */
+static struct global_cwq *get_unbound_gcwq(const struct workqueue_attrs *attrs)
+{
+	u32 hash = hash_32(wqattrs_hash(attrs), UNBOUND_GCWQ_HASH_ORDER);
+	struct hlist_head *bucket = &unbound_gcwq_hash[hash];
+	struct global_cwq *gcwq;
+	struct hlist_node *pos;
+	struct worker *worker;
+	int node, ret;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	/* do we already have a matching gcwq? */
+	hlist_for_each_entry(gcwq, pos, bucket, hash_node) {
+		if (wqattrs_equal(gcwq->attrs, attrs)) {
+			gcwq->refcnt++;
+			return gcwq;
+		}
+	}
+
+	/* allocate on the node the cpus are on, if they're all on one */
+	node = NUMA_NO_NODE;
+	if (wq_numa_enabled) {
+		for_each_node(node)
+			if (cpumask_subset(attrs->cpumask,
+					   wq_numa_possible_cpumask[node]))
+				break;
+		if (node >= nr_node_ids)
+			node = NUMA_NO_NODE;
+	}
+
+	/* nope, create a new one */
+	gcwq = kzalloc_node(sizeof(*gcwq), GFP_KERNEL, node);
+	if (!gcwq)
+		return NULL;
+
+	init_gcwq(gcwq);
+	lockdep_set_subclass(&gcwq->lock, 1);	/* see cwq_put() */
+	gcwq->cpu = WORK_CPU_UNBOUND;
+	gcwq->id = -1;
+	gcwq->node = node;
+
+	gcwq->attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!gcwq->attrs)
+		goto fail;
+	copy_workqueue_attrs(gcwq->attrs, attrs);
+	gcwq->attrs->no_numa = false;
+
+	do {
+		if (!idr_pre_get(&unbound_gcwq_idr, GFP_KERNEL))
+			goto fail;
+		ret = idr_get_new_above(&unbound_gcwq_idr, gcwq,
+					WORK_CPU_LAST + 1, &gcwq->id);
+	} while (ret == -EAGAIN);
+	if (ret) {
+		gcwq->id = -1;
+		goto fail;
+	}
+
+	/* the id has to fit in the off-queue work->data */
+	if (WARN_ON_ONCE((unsigned long)gcwq->id >
+			 ULONG_MAX >> WORK_STRUCT_FLAG_BITS))
+		goto fail;
+
+	/* only the normal pool is used, create its initial worker */
+	worker = create_worker(&gcwq->pools[0]);
+	if (!worker)
+		goto fail;
+
+	spin_lock_irq(&gcwq->lock);
+	start_worker(worker);
+	spin_unlock_irq(&gcwq->lock);
+
+	/* install */
+	hlist_add_head(&gcwq->hash_node, bucket);
+	return gcwq;
+fail:
+	put_unbound_gcwq(gcwq);
+	return NULL;
+}
+
+/* initialize the fields of @cwq common to bound and unbound ones */
+static void init_cwq(struct cpu_workqueue_struct *cwq,
+		     struct workqueue_struct *wq, struct worker_pool *pool)
+{
+	BUG_ON((unsigned long)cwq & WORK_STRUCT_FLAG_MASK);
+
+	cwq->pool = pool;
+	cwq->wq = wq;
+	cwq->flush_color = -1;
+	cwq->refcnt = 1;
+	INIT_LIST_HEAD(&cwq->delayed_works);
+	INIT_LIST_HEAD(&cwq->cwqs_node);
+	INIT_LIST_HEAD(&cwq->mayday_node);
+}
+
+/*
+ * Link @cwq into @wq->cwqs.  New cwqs start with the current work color
+ * of @wq so that flushing works as if they had been there all along.
+ */
+static void link_cwq(struct cpu_workqueue_struct *cwq)
+{
+	struct workqueue_struct *wq = cwq->wq;
+
+	lockdep_assert_held(&wq->flush_mutex);
+	lockdep_assert_held(&workqueue_lock);
+
+	/* may be called multiple times for the same cwq, ignore repeats */
+	if (!list_empty(&cwq->cwqs_node))
+		return;
+
+	cwq->work_color = wq->work_color;
+	if (workqueue_freezing && (wq->flags & WQ_FREEZABLE))
+		cwq->max_active = 0;
+	else
+		cwq->max_active = wq->saved_max_active;
+	list_add_tail(&cwq->cwqs_node, &wq->cwqs);
+}
+
+static void rcu_free_cwq(struct rcu_head *rcu)
+{
+	kmem_cache_free(cwq_cache,
+			container_of(rcu, struct cpu_workqueue_struct, rcu));
+}
+
+static void rcu_free_wq(struct rcu_head *rcu)
+{
+	struct workqueue_struct *wq =
+		container_of(rcu, struct workqueue_struct, rcu);
+
+	free_workqueue_attrs(wq->unbound_attrs);
+	kfree(wq->numa_cwq_tbl);
+	kfree(wq);
+}
+
+/*
+ * Scheduled on system_wq by cwq_put() when an unbound cwq's refcnt
+ * reaches zero.  Unlink the cwq, put its gcwq and free it.  The last cwq
+ * of a destroyed workqueue frees the workqueue too.
+ */
+static void cwq_unbound_release_workfn(struct work_struct *work)
+{
+	struct cpu_workqueue_struct *cwq = container_of(work,
+			struct cpu_workqueue_struct, unbound_release_work);
+	struct workqueue_struct *wq = cwq->wq;
+	struct global_cwq *gcwq = cwq->pool->gcwq;
+	bool is_last;
+
+	mutex_lock(&wq->flush_mutex);
+	spin_lock(&workqueue_lock);
+	list_del(&cwq->cwqs_node);
+	is_last = list_empty(&wq->cwqs);
+	spin_unlock(&workqueue_lock);
+	mutex_unlock(&wq->flush_mutex);
+
+	mutex_lock(&wq_pool_mutex);
+	put_unbound_gcwq(gcwq);
+	mutex_unlock(&wq_pool_mutex);
+
+	call_rcu_sched(&cwq->rcu, rcu_free_cwq);
+
+	/*
+	 * If we're the last cwq going away, @wq is already dead and no one
+	 * is gonna access it anymore.  Free it.
+	 */
+	if (is_last)
+		call_rcu_sched(&wq->rcu, rcu_free_wq);
+}
+
+/* allocate a cwq of @wq serving a gcwq with @attrs */
+static struct cpu_workqueue_struct *
+alloc_unbound_cwq(struct workqueue_struct *wq,
+		  const struct workqueue_attrs *attrs)
+{
+	struct cpu_workqueue_struct *cwq;
+	struct global_cwq *gcwq;
+
+	lockdep_assert_held(&wq_pool_mutex);
+
+	gcwq = get_unbound_gcwq(attrs);
+	if (!gcwq)
+		return NULL;
+
+	cwq = kmem_cache_alloc_node(cwq_cache, GFP_KERNEL | __GFP_ZERO,
+				    gcwq->node);
+	if (!cwq) {
+		put_unbound_gcwq(gcwq);
+		return NULL;
+	}
+
+	init_cwq(cwq, wq, &gcwq->pools[0]);
+	INIT_WORK(&cwq->unbound_release_work, cwq_unbound_release_workfn);
+	return cwq;
+}
+
+/* undo alloc_unbound_cwq(), only for cwqs which were never linked */
+static void free_unbound_cwq(struct cpu_workqueue_struct *cwq)
+{
+	lockdep_assert_held(&wq_pool_mutex);
+
+	if (cwq) {
+		put_unbound_gcwq(cwq->pool->gcwq);
+		kmem_cache_free(cwq_cache, cwq);
+	}
+}
+
+/**
+ * wq_calc_node_cpumask - calculate a cpumask for the cwq of a node
+ * @attrs: the wq_attrs of the workqueue
+ * @node: the target NUMA node
+ * @cpumask: outarg, the resulting cpumask
+ *
+ * Calculate the cpumask the cwq of @node of an unbound workqueue with
+ * @attrs should use: @attrs->cpumask restricted to the possible cpus of
+ * @node.  If NUMA affinity isn't enabled, or the result would be empty or
+ * identical to @attrs->cpumask, @attrs->cpumask is returned in @cpumask
+ * along with %false to indicate that the default cwq should be used.
+ *
+ * Possible cpus are used so that the per-node cwqs don't have to be
+ * updated on cpu hotplug.
+ */
+static bool wq_calc_node_cpumask(const struct workqueue_attrs *attrs,
+				 int node, struct cpumask *cpumask)
+{
+	if (!wq_numa_enabled || attrs->no_numa)
+		goto use_dfl;
+
+	cpumask_and(cpumask, attrs->cpumask, wq_numa_possible_cpumask[node]);
+	if (cpumask_empty(cpumask))
+		goto use_dfl;
+
+	return !cpumask_equal(cpumask, attrs->cpumask);
+
+use_dfl:
+	cpumask_copy(cpumask, attrs->cpumask);
+	return false;
+}
+
+/**
+ * apply_workqueue_attrs - apply new workqueue_attrs to an unbound workqueue
+ * @wq: the target workqueue
+ * @attrs: the workqueue_attrs to apply, allocated with alloc_workqueue_attrs()
+ *
+ * Apply @attrs to an unbound workqueue @wq.  Unless disabled, on NUMA
+ * machines, this function maps a separate cwq to each NUMA node with
+ * possible cpus in @attrs->cpumask so that work items are affine to the
+ * NUMA node they were issued on.  Older cwqs are released as in-flight
+ * work items finish.  Note that a work item which repeatedly requeues
+ * itself back-to-back will stay on its current cwq.
+ *
+ * Performs GFP_KERNEL allocations.  Returns 0 on success and -errno on
+ * failure.
+ */
+int apply_workqueue_attrs(struct workqueue_struct *wq,
+			  const struct workqueue_attrs *attrs)
+{
+	struct workqueue_attrs *new_attrs = NULL, *tmp_attrs = NULL;
+	struct cpu_workqueue_struct **cwq_tbl, *dfl_cwq = NULL;
+	int node, ret;
+
+	/* only unbound workqueues can change attributes */
+	if (WARN_ON(!(wq->flags & WQ_UNBOUND)))
+		return -EINVAL;
+
+	/* an ordered workqueue can only ever have a single cwq */
+	if ((wq->flags & WQ_ORDERED) && !list_empty(&wq->cwqs))
+		return -EINVAL;
+
+	cwq_tbl = kcalloc(nr_node_ids, sizeof(cwq_tbl[0]), GFP_KERNEL);
+	new_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	tmp_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!cwq_tbl || !new_attrs || !tmp_attrs) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	/* make a copy of @attrs and sanitize it */
+	copy_workqueue_attrs(new_attrs, attrs);
+	cpumask_and(new_attrs->cpumask, new_attrs->cpumask, cpu_possible_mask);
+	if (cpumask_empty(new_attrs->cpumask)) {
+		ret = -EINVAL;
+		goto out_free;
+	}
+	if (wq->flags & WQ_ORDERED)
+		new_attrs->no_numa = true;
+
+	/*
+	 * We may create multiple cwqs with differing cpumasks.  Make a
+	 * copy of @new_attrs which will be modified and used to obtain
+	 * gcwqs.
+	 */
+	copy_workqueue_attrs(tmp_attrs, new_attrs);
+
+	mutex_lock(&wq_pool_mutex);
+
+	ret = -ENOMEM;
+	dfl_cwq = alloc_unbound_cwq(wq, new_attrs);
+	if (!dfl_cwq)
+		goto out_unlock;
+
+	for_each_node(node) {
+		if (wq_calc_node_cpumask(new_attrs, node, tmp_attrs->cpumask)) {
+			cwq_tbl[node] = alloc_unbound_cwq(wq, tmp_attrs);
+			if (!cwq_tbl[node])
+				goto out_free_cwqs;
+		} else {
+			cwq_tbl[node] = dfl_cwq;
+		}
+	}
+
+	/* all cwqs have been created successfully, let's install'em */
+	mutex_lock(&wq->flush_mutex);
+	spin_lock(&workqueue_lock);
+
+	link_cwq(dfl_cwq);
+	swap(wq->dfl_cwq, dfl_cwq);
+
+	for_each_node(node) {
+		struct cpu_workqueue_struct *old;
+
+		link_cwq(cwq_tbl[node]);
+		old = rcu_dereference_protected(wq->numa_cwq_tbl[node],
+					lockdep_is_held(&workqueue_lock));
+		rcu_assign_pointer(wq->numa_cwq_tbl[node], cwq_tbl[node]);
+		cwq_tbl[node] = old;
+	}
+
+	copy_workqueue_attrs(wq->unbound_attrs, new_attrs);
+
+	spin_unlock(&workqueue_lock);
+	mutex_unlock(&wq->flush_mutex);
+
+	/*
+	 * Drop the base references of the old cwqs.  They're released once
+	 * the works in flight on them finish.
+	 */
+	for_each_node(node)
+		if (cwq_tbl[node] && cwq_tbl[node] != dfl_cwq)
+			cwq_put_unlocked(cwq_tbl[node]);
+	if (dfl_cwq)
+		cwq_put_unlocked(dfl_cwq);
+
+	ret = 0;
+	goto out_unlock;
+
+out_free_cwqs:
+	for_each_node(node)
+		if (cwq_tbl[node] && cwq_tbl[node] != dfl_cwq)
+			free_unbound_cwq(cwq_tbl[node]);
+	free_unbound_cwq(dfl_cwq);
+out_unlock:
+	mutex_unlock(&wq_pool_mutex);
+out_free:
+	free_workqueue_attrs(tmp_attrs);
+	free_workqueue_attrs(new_attrs);
+	kfree(cwq_tbl);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(apply_workqueue_attrs);
+
+static int alloc_and_link_cwqs(struct workqueue_struct *wq)
+{
+	bool highpri = wq->flags & WQ_HIGHPRI;
+	int cpu;
+
+	if (!(wq->flags & WQ_UNBOUND)) {
+		wq->cpu_cwqs = __alloc_percpu(sizeof(struct cpu_workqueue_struct),
+					      CWQ_ALIGN);
+		if (!wq->cpu_cwqs)
+			return -ENOMEM;
+
+		mutex_lock(&wq->flush_mutex);
+		spin_lock(&workqueue_lock);
+
+		for_each_possible_cpu(cpu) {
+			struct cpu_workqueue_struct *cwq =
+				per_cpu_ptr(wq->cpu_cwqs, cpu);
+			struct global_cwq *gcwq = get_gcwq(cpu);
+
+			init_cwq(cwq, wq, &gcwq->pools[highpri]);
+			link_cwq(cwq);
+		}
+
+		spin_unlock(&workqueue_lock);
+		mutex_unlock(&wq->flush_mutex);
+		return 0;
+	}
+
+	wq->numa_cwq_tbl = kcalloc(nr_node_ids, sizeof(wq->numa_cwq_tbl[0]),
+				   GFP_KERNEL);
+	wq->unbound_attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!wq->numa_cwq_tbl || !wq->unbound_attrs)
+		return -ENOMEM;
+
+	/* unbound highpri workqueues get the highpri nice level */
+	if (highpri)
+		wq->unbound_attrs->nice = HIGHPRI_NICE_LEVEL;
+
+	return apply_workqueue_attrs(wq, wq->unbound_attrs);
+}
+
+static int wq_clamp_max_active(int max_active, unsigned int flags,
+			       const char *name)
+{
+	int lim = flags & WQ_UNBOUND ? WQ_UNBOUND_MAX_ACTIVE : WQ_MAX_ACTIVE;
+
+	if (max_active < 1 || max_active > lim)
+		printk(KERN_WARNING "workqueue: max_active %d requested for %s "
+		       "is out of range, clamping between %d and %d\n",
+		       max_active, name, 1, lim);
+
+	return clamp_val(max_active, 1, lim);
+}
+
+#ifdef CONFIG_SYSFS
+static int workqueue_sysfs_register(struct workqueue_struct *wq);
+static void workqueue_sysfs_unregister(struct workqueue_struct *wq);
+#else
+static inline int workqueue_sysfs_register(struct workqueue_struct *wq)
+{
+	return 0;
+}
+static inline void workqueue_sysfs_unregister(struct workqueue_struct *wq) { }
+#endif
+
+struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
+					       unsigned int flags,
+					       int max_active,
+					       struct lock_class_key *key,
+					       const char *lock_name, ...)
+{
+	va_list args, args1;
+	struct workqueue_struct *wq;
+	struct cpu_workqueue_struct *cwq;
+	size_t namelen;
+
+	/* determine namelen, allocate wq and format name */
+	va_start(args, lock_name);
+	va_copy(args1, args);
+	namelen = vsnprintf(NULL, 0, fmt, args) + 1;
+
+	wq = kzalloc(sizeof(*wq) + namelen, GFP_KERNEL);
+	if (!wq)
+		return NULL;
+
+	vsnprintf(wq->name, namelen, fmt, args1);
+	va_end(args);
+	va_end(args1);
+
+	/*
+	 * Workqueues which may be used during memory reclaim should
+	 * have a rescuer to guarantee forward progress.
+	 */
+	if (flags & WQ_MEM_RECLAIM)
+		flags |= WQ_RESCUER;
+
+	/* an unbound workqueue with max_active of 1 is ordered */
+	if ((flags & WQ_UNBOUND) && max_active == 1)
+		flags |= WQ_ORDERED;
+
+	max_active = max_active ?: WQ_DFL_ACTIVE;
+	max_active = wq_clamp_max_active(max_active, flags, wq->name);
+
+	/* init wq */
+	wq->flags = flags;
+	wq->saved_max_active = max_active;
+	mutex_init(&wq->flush_mutex);
+	atomic_set(&wq->nr_cwqs_to_flush, 0);
+	INIT_LIST_HEAD(&wq->cwqs);
+	INIT_LIST_HEAD(&wq->flusher_queue);
+	INIT_LIST_HEAD(&wq->flusher_overflow);
+	INIT_LIST_HEAD(&wq->maydays);
+
+	lockdep_init_map(&wq->lockdep_map, lock_name, key, 0);
+	INIT_LIST_HEAD(&wq->list);
+
+	if (alloc_and_link_cwqs(wq) < 0)
+		goto err_destroy;
+
+	if (flags & WQ_RESCUER) {
+		struct worker *rescuer;
 
 		wq->rescuer = rescuer = alloc_worker();
 		if (!rescuer)
-			goto err;
+			goto err_destroy;
 
 		rescuer->task = kthread_create(rescuer_thread, wq, "%s",
 					       wq->name);
-		if (IS_ERR(rescuer->task))
-			goto err;
+		if (IS_ERR(rescuer->task)) {
+			kfree(rescuer);
+			wq->rescuer = NULL;
+			goto err_destroy;
+		}
 
 		rescuer->task->flags |= PF_THREAD_BOUND;
 		wake_up_process(rescuer->task);
@@ -3279,21 +3989,27 @@ struct workqueue_struct *__alloc_workqueue_key(const char *fmt,
 	spin_lock(&workqueue_lock);
 
 	if (workqueue_freezing && wq->flags & WQ_FREEZABLE)
-		for_each_cwq_cpu(cpu, wq)
-			get_cwq(cpu, wq)->max_active = 0;
+		for_each_cwq(cwq, wq)
+			cwq->max_active = 0;
 
 	list_add(&wq->list, &workqueues);
 
 	spin_unlock(&workqueue_lock);
 
+	if ((wq->flags & WQ_SYSFS) && workqueue_sysfs_register(wq))
+		goto err_destroy;
+
 	return wq;
-err:
-	if (wq) {
-		free_cwqs(wq);
-		free_mayday_mask(wq->mayday_mask);
+
+err_destroy:
+	/* nothing can be queued yet, destroy_workqueue() can clean up */
+	wq->flags &= ~(WQ_RESCUER | WQ_SYSFS);
+	if (wq->rescuer) {
+		kthread_stop(wq->rescuer->task);
 		kfree(wq->rescuer);
-		kfree(wq);
+		wq->rescuer = NULL;
 	}
+	destroy_workqueue(wq);
 	return NULL;
 }
 EXPORT_SYMBOL_GPL(__alloc_workqueue_key);
@@ -3306,7 +4022,11 @@ EXPORT_SYMBOL_GPL(__alloc_workqueue_key);
  */
 void destroy_workqueue(struct workqueue_struct *wq)
 {
-	unsigned int cpu;
+	struct cpu_workqueue_struct *cwq;
+	int node;
+
+	/* userland can't poke at it once it's gone from sysfs */
+	workqueue_sysfs_unregister(wq);
 
 	/* drain it before proceeding with destruction */
 	drain_workqueue(wq);
@@ -3316,12 +4036,12 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	 * flushing is complete in case freeze races us.
 	 */
 	spin_lock(&workqueue_lock);
-	list_del(&wq->list);
+	list_del_init(&wq->list);
 	spin_unlock(&workqueue_lock);
 
 	/* sanity check */
-	for_each_cwq_cpu(cpu, wq) {
-		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	mutex_lock(&wq->flush_mutex);
+	for_each_cwq(cwq, wq) {
 		int i;
 
 		for (i = 0; i < WORK_NR_COLORS; i++)
@@ -3329,15 +4049,58 @@ void destroy_workqueue(struct workqueue_struct *wq)
 		BUG_ON(cwq->nr_active);
 		BUG_ON(!list_empty(&cwq->delayed_works));
 	}
+	mutex_unlock(&wq->flush_mutex);
 
 	if (wq->flags & WQ_RESCUER) {
 		kthread_stop(wq->rescuer->task);
-		free_mayday_mask(wq->mayday_mask);
 		kfree(wq->rescuer);
+		wq->rescuer = NULL;
+
+		/* drop the references held by mayday requests never served */
+		spin_lock_irq(&wq_mayday_lock);
+		while (!list_empty(&wq->maydays)) {
+			cwq = list_first_entry(&wq->maydays,
+					       struct cpu_workqueue_struct,
+					       mayday_node);
+			list_del_init(&cwq->mayday_node);
+			spin_unlock_irq(&wq_mayday_lock);
+			cwq_put_unlocked(cwq);
+			spin_lock_irq(&wq_mayday_lock);
+		}
+		spin_unlock_irq(&wq_mayday_lock);
 	}
 
-	free_cwqs(wq);
-	kfree(wq);
+	if (!(wq->flags & WQ_UNBOUND)) {
+		free_percpu(wq->cpu_cwqs);
+		kfree(wq);
+		return;
+	}
+
+	/*
+	 * Put the base references of all cwqs.  The release of the last
+	 * one also frees @wq, see cwq_unbound_release_workfn().  If no cwq
+	 * was ever linked, nothing else references @wq.
+	 */
+	if (list_empty(&wq->cwqs)) {
+		free_workqueue_attrs(wq->unbound_attrs);
+		kfree(wq->numa_cwq_tbl);
+		kfree(wq);
+		return;
+	}
+
+	mutex_lock(&wq_pool_mutex);
+	for_each_node(node) {
+		cwq = rcu_access_pointer(wq->numa_cwq_tbl[node]);
+		RCU_INIT_POINTER(wq->numa_cwq_tbl[node], NULL);
+		if (cwq && cwq != wq->dfl_cwq)
+			cwq_put_unlocked(cwq);
+	}
+	cwq = wq->dfl_cwq;
+	wq->dfl_cwq = NULL;
+	mutex_unlock(&wq_pool_mutex);
+
+	/* @wq may be freed once this is put */
+	cwq_put_unlocked(cwq);
 }
 EXPORT_SYMBOL_GPL(destroy_workqueue);
 
@@ -3353,7 +4116,11 @@ EXPORT_SYMBOL_GPL(destroy_workqueue);
  */
 void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 {
-	unsigned int cpu;
+	struct cpu_workqueue_struct *cwq;
+
+	/* disallow meddling with max_active for ordered workqueues */
+	if (WARN_ON(wq->flags & WQ_ORDERED))
+		return;
 
 	max_active = wq_clamp_max_active(max_active, wq->flags, wq->name);
 
@@ -3361,14 +4128,13 @@ void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 
 	wq->saved_max_active = max_active;
 
-	for_each_cwq_cpu(cpu, wq) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
+	for_each_cwq(cwq, wq) {
+		struct global_cwq *gcwq = cwq->pool->gcwq;
 
 		spin_lock_irq(&gcwq->lock);
 
-		if (!(wq->flags & WQ_FREEZABLE) ||
-		    !(gcwq->flags & GCWQ_FREEZING))
-			get_cwq(gcwq->cpu, wq)->max_active = max_active;
+		if (!(wq->flags & WQ_FREEZABLE) || !workqueue_freezing)
+			cwq->max_active = max_active;
 
 		spin_unlock_irq(&gcwq->lock);
 	}
@@ -3391,9 +4157,15 @@ EXPORT_SYMBOL_GPL(workqueue_set_max_active);
  */
 bool workqueue_congested(unsigned int cpu, struct workqueue_struct *wq)
 {
-	struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	struct cpu_workqueue_struct *cwq;
+	bool ret;
 
-	return !list_empty(&cwq->delayed_works);
+	rcu_read_lock_sched();
+	cwq = get_cwq(cpu, wq);
+	ret = !list_empty(&cwq->delayed_works);
+	rcu_read_unlock_sched();
+
+	return ret;
 }
 EXPORT_SYMBOL_GPL(workqueue_congested);
 
@@ -3406,9 +4178,15 @@ EXPORT_SYMBOL_GPL(workqueue_congested);
  */
 unsigned int work_cpu(struct work_struct *work)
 {
-	struct global_cwq *gcwq = get_work_gcwq(work);
+	struct global_cwq *gcwq;
+	unsigned int cpu;
+
+	rcu_read_lock_sched();
+	gcwq = get_work_gcwq(work);
+	cpu = gcwq ? gcwq->cpu : WORK_CPU_NONE;
+	rcu_read_unlock_sched();
 
-	return gcwq ? gcwq->cpu : WORK_CPU_NONE;
+	return cpu;
 }
 EXPORT_SYMBOL_GPL(work_cpu);
 
@@ -3427,14 +4205,19 @@ EXPORT_SYMBOL_GPL(work_cpu);
  */
 unsigned int work_busy(struct work_struct *work)
 {
-	struct global_cwq *gcwq = get_work_gcwq(work);
+	struct global_cwq *gcwq;
 	unsigned long flags;
 	unsigned int ret = 0;
 
-	if (!gcwq)
+	local_irq_save(flags);
+
+	gcwq = get_work_gcwq(work);
+	if (!gcwq) {
+		local_irq_restore(flags);
 		return false;
+	}
 
-	spin_lock_irqsave(&gcwq->lock, flags);
+	spin_lock(&gcwq->lock);
 
 	if (work_pending(work))
 		ret |= WORK_BUSY_PENDING;
@@ -3447,6 +4230,309 @@ unsigned int work_busy(struct work_struct *work)
 }
 EXPORT_SYMBOL_GPL(work_busy);
 
+#ifdef CONFIG_SYSFS
+/*
+ * Workqueues with WQ_SYSFS flag set are visible to userland via
+ * /sys/bus/workqueue/devices/WQ_NAME.  All visible workqueues have the
+ * following attributes.
+ *
+ *  per_cpu	RO bool	: whether the workqueue is per-cpu or unbound
+ *  max_active	RW int	: maximum number of in-flight work items
+ *
+ * Unbound workqueues have the following extra attributes.
+ *
+ *  nice	RW int	: nice value of the workers
+ *  cpumask	RW mask	: bitmask of allowed CPUs for the workers
+ *  numa	RW bool	: whether the work items are affine to NUMA nodes
+ */
+struct wq_device {
+	struct workqueue_struct		*wq;
+	struct device			dev;
+};
+
+static bool wq_sysfs_ready;		/* W: wq_subsys is registered */
+
+static struct workqueue_struct *dev_to_wq(struct device *dev)
+{
+	struct wq_device *wq_dev = container_of(dev, struct wq_device, dev);
+
+	return wq_dev->wq;
+}
+
+static ssize_t wq_per_cpu_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", !(wq->flags & WQ_UNBOUND));
+}
+
+static ssize_t wq_max_active_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", wq->saved_max_active);
+}
+
+static ssize_t wq_max_active_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int val;
+
+	if (sscanf(buf, "%d", &val) != 1 || val <= 0)
+		return -EINVAL;
+
+	workqueue_set_max_active(wq, val);
+	return count;
+}
+
+static struct device_attribute wq_sysfs_attrs[] = {
+	__ATTR(per_cpu, 0444, wq_per_cpu_show, NULL),
+	__ATTR(max_active, 0644, wq_max_active_show, wq_max_active_store),
+	__ATTR_NULL,
+};
+
+/* return a copy of the current unbound attrs of @wq to be modified */
+static struct workqueue_attrs *wq_sysfs_prep_attrs(struct workqueue_struct *wq)
+{
+	struct workqueue_attrs *attrs;
+
+	attrs = alloc_workqueue_attrs(GFP_KERNEL);
+	if (!attrs)
+		return NULL;
+
+	mutex_lock(&wq_pool_mutex);
+	copy_workqueue_attrs(attrs, wq->unbound_attrs);
+	mutex_unlock(&wq_pool_mutex);
+	return attrs;
+}
+
+static ssize_t wq_nice_show(struct device *dev, struct device_attribute *attr,
+			    char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq_pool_mutex);
+	written = scnprintf(buf, PAGE_SIZE, "%d\n", wq->unbound_attrs->nice);
+	mutex_unlock(&wq_pool_mutex);
+
+	return written;
+}
+
+static ssize_t wq_nice_store(struct device *dev, struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int ret;
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		return -ENOMEM;
+
+	if (sscanf(buf, "%d", &attrs->nice) == 1 &&
+	    attrs->nice >= -20 && attrs->nice <= 19)
+		ret = apply_workqueue_attrs(wq, attrs);
+	else
+		ret = -EINVAL;
+
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static ssize_t wq_cpumask_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq_pool_mutex);
+	written = cpumask_scnprintf(buf, PAGE_SIZE, wq->unbound_attrs->cpumask);
+	mutex_unlock(&wq_pool_mutex);
+
+	written += scnprintf(buf + written, PAGE_SIZE - written, "\n");
+	return written;
+}
+
+static ssize_t wq_cpumask_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int ret;
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		return -ENOMEM;
+
+	ret = bitmap_parse(buf, count, cpumask_bits(attrs->cpumask),
+			   nr_cpumask_bits);
+	if (!ret)
+		ret = apply_workqueue_attrs(wq, attrs);
+
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static ssize_t wq_numa_show(struct device *dev, struct device_attribute *attr,
+			    char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int written;
+
+	mutex_lock(&wq_pool_mutex);
+	written = scnprintf(buf, PAGE_SIZE, "%d\n",
+			    !wq->unbound_attrs->no_numa);
+	mutex_unlock(&wq_pool_mutex);
+
+	return written;
+}
+
+static ssize_t wq_numa_store(struct device *dev, struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct workqueue_attrs *attrs;
+	int v, ret;
+
+	attrs = wq_sysfs_prep_attrs(wq);
+	if (!attrs)
+		return -ENOMEM;
+
+	ret = -EINVAL;
+	if (sscanf(buf, "%d", &v) == 1) {
+		attrs->no_numa = !v;
+		ret = apply_workqueue_attrs(wq, attrs);
+	}
+
+	free_workqueue_attrs(attrs);
+	return ret ?: count;
+}
+
+static struct device_attribute wq_sysfs_unbound_attrs[] = {
+	__ATTR(nice, 0644, wq_nice_show, wq_nice_store),
+	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store),
+	__ATTR(numa, 0644, wq_numa_show, wq_numa_store),
+	__ATTR_NULL,
+};
+
+static struct bus_type wq_subsys = {
+	.name				= "workqueue",
+	.dev_attrs			= wq_sysfs_attrs,
+};
+
+static void wq_device_release(struct device *dev)
+{
+	kfree(container_of(dev, struct wq_device, dev));
+}
+
+/**
+ * workqueue_sysfs_register - make a workqueue visible in sysfs
+ * @wq: the workqueue to register
+ *
+ * Expose @wq in sysfs under /sys/bus/workqueue/devices.  Called for
+ * workqueues created with WQ_SYSFS.  Workqueues created before the
+ * workqueue bus is registered are exposed from wq_sysfs_init().
+ *
+ * Returns 0 on success, -errno on failure.
+ */
+static int workqueue_sysfs_register(struct workqueue_struct *wq)
+{
+	struct wq_device *wq_dev;
+	struct device_attribute *attr;
+	int ret;
+
+	/* ordered workqueues can't have max_active or attrs changed */
+	if (WARN_ON(wq->flags & WQ_ORDERED))
+		return -EINVAL;
+
+	if (!wq_sysfs_ready)
+		return 0;
+
+	wq_dev = kzalloc(sizeof(*wq_dev), GFP_KERNEL);
+	if (!wq_dev)
+		return -ENOMEM;
+
+	wq_dev->wq = wq;
+	wq_dev->dev.bus = &wq_subsys;
+	wq_dev->dev.init_name = wq->name;
+	wq_dev->dev.release = wq_device_release;
+
+	/* uevent is sent after the unbound attributes are in place */
+	dev_set_uevent_suppress(&wq_dev->dev, true);
+
+	ret = device_register(&wq_dev->dev);
+	if (ret) {
+		put_device(&wq_dev->dev);
+		return ret;
+	}
+
+	if (wq->flags & WQ_UNBOUND) {
+		for (attr = wq_sysfs_unbound_attrs; attr->attr.name; attr++) {
+			ret = device_create_file(&wq_dev->dev, attr);
+			if (ret) {
+				device_unregister(&wq_dev->dev);
+				return ret;
+			}
+		}
+	}
+
+	wq->wq_dev = wq_dev;
+	dev_set_uevent_suppress(&wq_dev->dev, false);
+	kobject_uevent(&wq_dev->dev.kobj, KOBJ_ADD);
+	return 0;
+}
+
+static void workqueue_sysfs_unregister(struct workqueue_struct *wq)
+{
+	struct wq_device *wq_dev = wq->wq_dev;
+
+	if (!wq_dev)
+		return;
+
+	wq->wq_dev = NULL;
+	device_unregister(&wq_dev->dev);
+}
+
+static int __init wq_sysfs_init(void)
+{
+	struct workqueue_struct *wq;
+	int ret;
+
+	ret = subsys_system_register(&wq_subsys, NULL);
+	if (ret)
+		return ret;
+
+	/* expose the WQ_SYSFS workqueues created during early boot */
+	spin_lock(&workqueue_lock);
+	wq_sysfs_ready = true;
+restart:
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!(wq->flags & WQ_SYSFS) || wq->wq_dev)
+			continue;
+
+		spin_unlock(&workqueue_lock);
+		ret = workqueue_sysfs_register(wq);
+		spin_lock(&workqueue_lock);
+		if (ret) {
+			pr_warn("workqueue: failed to expose %s in sysfs (%d)\n",
+				wq->name, ret);
+			wq->flags &= ~WQ_SYSFS;
+		}
+		goto restart;
+	}
+	spin_unlock(&workqueue_lock);
+
+	return 0;
+}
+core_initcall(wq_sysfs_init);
+#endif /* CONFIG_SYSFS */
+
 /*
  * CPU hotplug.
  *
@@ -3462,26 +4548,6 @@ EXPORT_SYMBOL_GPL(work_busy);
  * cpu comes back online.
  */
 
-/* claim manager positions of all pools */
-static void gcwq_claim_management_and_lock(struct global_cwq *gcwq)
-{
-	struct worker_pool *pool;
-
-	for_each_worker_pool(pool, gcwq)
-		mutex_lock_nested(&pool->manager_mutex, pool - gcwq->pools);
-	spin_lock_irq(&gcwq->lock);
-}
-
-/* release manager positions */
-static void gcwq_release_management_and_unlock(struct global_cwq *gcwq)
-{
-	struct worker_pool *pool;
-
-	spin_unlock_irq(&gcwq->lock);
-	for_each_worker_pool(pool, gcwq)
-		mutex_unlock(&pool->manager_mutex);
-}
-
 static void gcwq_unbind_fn(struct work_struct *work)
 {
 	struct global_cwq *gcwq = get_gcwq(smp_processor_id());
@@ -3648,30 +4714,25 @@ EXPORT_SYMBOL_GPL(work_on_cpu);
  */
 void freeze_workqueues_begin(void)
 {
-	unsigned int cpu;
+	struct workqueue_struct *wq;
+	struct cpu_workqueue_struct *cwq;
 
 	spin_lock(&workqueue_lock);
 
 	BUG_ON(workqueue_freezing);
 	workqueue_freezing = true;
 
-	for_each_gcwq_cpu(cpu) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
-		struct workqueue_struct *wq;
-
-		spin_lock_irq(&gcwq->lock);
-
-		BUG_ON(gcwq->flags & GCWQ_FREEZING);
-		gcwq->flags |= GCWQ_FREEZING;
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!(wq->flags & WQ_FREEZABLE))
+			continue;
 
-		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+		for_each_cwq(cwq, wq) {
+			struct global_cwq *gcwq = cwq->pool->gcwq;
 
-			if (cwq && wq->flags & WQ_FREEZABLE)
-				cwq->max_active = 0;
+			spin_lock_irq(&gcwq->lock);
+			cwq->max_active = 0;
+			spin_unlock_irq(&gcwq->lock);
 		}
-
-		spin_unlock_irq(&gcwq->lock);
 	}
 
 	spin_unlock(&workqueue_lock);
@@ -3692,25 +4753,22 @@ void freeze_workqueues_begin(void)
  */
 bool freeze_workqueues_busy(void)
 {
-	unsigned int cpu;
+	struct workqueue_struct *wq;
+	struct cpu_workqueue_struct *cwq;
 	bool busy = false;
 
 	spin_lock(&workqueue_lock);
 
 	BUG_ON(!workqueue_freezing);
 
-	for_each_gcwq_cpu(cpu) {
-		struct workqueue_struct *wq;
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!(wq->flags & WQ_FREEZABLE))
+			continue;
 		/*
 		 * nr_active is monotonically decreasing.  It's safe
 		 * to peek without lock.
 		 */
-		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
-
-			if (!cwq || !(wq->flags & WQ_FREEZABLE))
-				continue;
-
+		for_each_cwq(cwq, wq) {
 			BUG_ON(cwq->nr_active < 0);
 			if (cwq->nr_active) {
 				busy = true;
@@ -3734,28 +4792,22 @@ out_unlock:
  */
 void thaw_workqueues(void)
 {
-	unsigned int cpu;
+	struct workqueue_struct *wq;
+	struct cpu_workqueue_struct *cwq;
 
 	spin_lock(&workqueue_lock);
 
 	if (!workqueue_freezing)
 		goto out_unlock;
 
-	for_each_gcwq_cpu(cpu) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
-		struct worker_pool *pool;
-		struct workqueue_struct *wq;
-
-		spin_lock_irq(&gcwq->lock);
-
-		BUG_ON(!(gcwq->flags & GCWQ_FREEZING));
-		gcwq->flags &= ~GCWQ_FREEZING;
+	list_for_each_entry(wq, &workqueues, list) {
+		if (!(wq->flags & WQ_FREEZABLE))
+			continue;
 
-		list_for_each_entry(wq, &workqueues, list) {
-			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+		for_each_cwq(cwq, wq) {
+			struct global_cwq *gcwq = cwq->pool->gcwq;
 
-			if (!cwq || !(wq->flags & WQ_FREEZABLE))
-				continue;
+			spin_lock_irq(&gcwq->lock);
 
 			/* restore max_active and repopulate worklist */
 			cwq->max_active = wq->saved_max_active;
@@ -3763,12 +4815,11 @@ void thaw_workqueues(void)
 			while (!list_empty(&cwq->delayed_works) &&
 			       cwq->nr_active < cwq->max_active)
 				cwq_activate_first_delayed(cwq);
-		}
 
-		for_each_worker_pool(pool, gcwq)
-			wake_up_worker(pool);
+			wake_up_worker(cwq->pool);
 
-		spin_unlock_irq(&gcwq->lock);
+			spin_unlock_irq(&gcwq->lock);
+		}
 	}
 
 	workqueue_freezing = false;
@@ -3777,52 +4828,71 @@ out_unlock:
 }
 #endif /* CONFIG_FREEZER */
 
-static int __init init_workqueues(void)
+/* initialize the possible cpumask of each NUMA node */
+static void __init wq_numa_init(void)
 {
-	unsigned int cpu;
-	int i;
+	cpumask_var_t *tbl;
+	int node, cpu;
 
-	cpu_notifier(workqueue_cpu_up_callback, CPU_PRI_WORKQUEUE_UP);
-	cpu_notifier(workqueue_cpu_down_callback, CPU_PRI_WORKQUEUE_DOWN);
+	if (num_possible_nodes() <= 1)
+		return;
 
-	/* initialize gcwqs */
-	for_each_gcwq_cpu(cpu) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
-		struct worker_pool *pool;
+	if (wq_disable_numa) {
+		pr_info("workqueue: NUMA affinity support disabled\n");
+		return;
+	}
 
-		spin_lock_init(&gcwq->lock);
-		gcwq->cpu = cpu;
-		gcwq->flags |= GCWQ_DISASSOCIATED;
+	tbl = kzalloc(nr_node_ids * sizeof(tbl[0]), GFP_KERNEL);
+	BUG_ON(!tbl);
 
-		for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)
-			INIT_HLIST_HEAD(&gcwq->busy_hash[i]);
+	for_each_node(node)
+		BUG_ON(!zalloc_cpumask_var_node(&tbl[node], GFP_KERNEL,
+				node_online(node) ? node : NUMA_NO_NODE));
 
-		for_each_worker_pool(pool, gcwq) {
-			pool->gcwq = gcwq;
-			INIT_LIST_HEAD(&pool->worklist);
-			INIT_LIST_HEAD(&pool->idle_list);
+	for_each_possible_cpu(cpu) {
+		node = cpu_to_node(cpu);
+		if (WARN_ON(node == NUMA_NO_NODE)) {
+			pr_warn("workqueue: NUMA node mapping not available for cpu%d, disabling NUMA support\n",
+				cpu);
+			/* happens only on broken firmware, leak @tbl */
+			return;
+		}
+		cpumask_set_cpu(cpu, tbl[node]);
+	}
 
-			init_timer_deferrable(&pool->idle_timer);
-			pool->idle_timer.function = idle_worker_timeout;
-			pool->idle_timer.data = (unsigned long)pool;
+	wq_numa_possible_cpumask = tbl;
+	wq_numa_enabled = true;
+}
 
-			setup_timer(&pool->mayday_timer, gcwq_mayday_timeout,
-				    (unsigned long)pool);
+static int __init init_workqueues(void)
+{
+	unsigned int cpu;
 
-			mutex_init(&pool->manager_mutex);
-			ida_init(&pool->worker_ida);
-		}
+	cpu_notifier(workqueue_cpu_up_callback, CPU_PRI_WORKQUEUE_UP);
+	cpu_notifier(workqueue_cpu_down_callback, CPU_PRI_WORKQUEUE_DOWN);
+
+	cwq_cache = kmem_cache_create("cpu_workqueue_struct",
+				      sizeof(struct cpu_workqueue_struct),
+				      CWQ_ALIGN, SLAB_PANIC, NULL);
+
+	wq_numa_init();
+
+	/* initialize per-cpu gcwqs */
+	for_each_possible_cpu(cpu) {
+		struct global_cwq *gcwq = get_gcwq(cpu);
 
-		init_waitqueue_head(&gcwq->rebind_hold);
+		init_gcwq(gcwq);
+		gcwq->cpu = cpu;
+		gcwq->id = cpu;
+		gcwq->node = cpu_to_node(cpu);
 	}
 
 	/* create the initial worker */
-	for_each_online_gcwq_cpu(cpu) {
+	for_each_online_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
 		struct worker_pool *pool;
 
-		if (cpu != WORK_CPU_UNBOUND)
-			gcwq->flags &= ~GCWQ_DISASSOCIATED;
+		gcwq->flags &= ~GCWQ_DISASSOCIATED;
 
 		for_each_worker_pool(pool, gcwq) {
 			struct worker *worker;
@@ -3838,7 +4908,8 @@ static int __init init_workqueues(void)
 	system_wq = alloc_workqueue("events", 0, 0);
 	system_long_wq = alloc_workqueue("events_long", 0, 0);
 	system_nrt_wq = alloc_workqueue("events_nrt", WQ_NON_REENTRANT, 0);
-	system_unbound_wq = alloc_workqueue("events_unbound", WQ_UNBOUND,
+	system_unbound_wq = alloc_workqueue("events_unbound",
+					    WQ_UNBOUND | WQ_SYSFS,
 					    WQ_UNBOUND_MAX_ACTIVE);
 	system_freezable_wq = alloc_workqueue("events_freezable",
 					      WQ_FREEZABLE, 0);
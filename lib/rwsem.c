@@ -7,6 +7,8 @@
 #include <linux/sched.h>
 #include <linux/init.h>
 #include <linux/export.h>
+#include <linux/jiffies.h>
+#include <linux/mutex.h>
 
 /*
  * Initialize an rwsem:
@@ -24,6 +26,10 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->count = RWSEM_UNLOCKED_VALUE;
 	raw_spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+	sem->handoff = 0;
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
@@ -34,8 +40,45 @@ struct rwsem_waiter {
 	unsigned int flags;
 #define RWSEM_WAITING_FOR_READ	0x00000001
 #define RWSEM_WAITING_FOR_WRITE	0x00000002
+	unsigned long timeout;
 };
 
+/*
+ * A waiter at the head of the queue which has been waiting for longer
+ * than this may have the lock handed over to it: spinning writers stop
+ * stealing the lock until it has been granted.
+ */
+#define RWSEM_WAIT_TIMEOUT	DIV_ROUND_UP(HZ, 250)
+
+/*
+ * Maximum number of readers granted the lock by a single wakeup.  This
+ * bounds the time spent under wait_lock and keeps the active count from
+ * overflowing on 32-bit.
+ */
+#define RWSEM_MAX_READERS_WAKEUP	256
+
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Called with wait_lock held when the first waiter couldn't be granted
+ * the lock because somebody else got it first.
+ */
+static inline void rwsem_check_handoff(struct rw_semaphore *sem,
+				       struct rwsem_waiter *waiter)
+{
+	if (!sem->handoff && time_after(jiffies, waiter->timeout))
+		sem->handoff = 1;
+}
+
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem)
+{
+	sem->handoff = 0;
+}
+#else
+static inline void rwsem_check_handoff(struct rw_semaphore *sem,
+				       struct rwsem_waiter *waiter) { }
+static inline void rwsem_clear_handoff(struct rw_semaphore *sem) { }
+#endif
+
 /* Wake types for __rwsem_do_wake().  Note that RWSEM_WAKE_NO_ACTIVE and
  * RWSEM_WAKE_READ_OWNED imply that the spinlock must have been kept held
  * since the rwsem value was observed.
@@ -57,10 +100,10 @@ struct rwsem_waiter {
 static struct rw_semaphore *
 __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 {
-	struct rwsem_waiter *waiter;
+	struct rwsem_waiter *waiter, *tmp;
 	struct task_struct *tsk;
-	struct list_head *next;
-	signed long oldcount, woken, loop, adjustment;
+	LIST_HEAD(wake_list);
+	signed long oldcount, woken, adjustment;
 
 	waiter = list_entry(sem->wait_list.next, struct rwsem_waiter, list);
 	if (!(waiter->flags & RWSEM_WAITING_FOR_WRITE))
@@ -91,6 +134,7 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 	 * any time after that point (due to a wakeup from another source).
 	 */
 	list_del(&waiter->list);
+	rwsem_clear_handoff(sem);
 	tsk = waiter->task;
 	smp_mb();
 	waiter->task = NULL;
@@ -114,37 +158,38 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 	 * count adjustment pretty soon.
 	 */
 	if (wake_type == RWSEM_WAKE_ANY &&
-	    rwsem_atomic_update(0, sem) < RWSEM_WAITING_BIAS)
+	    rwsem_atomic_update(0, sem) < RWSEM_WAITING_BIAS) {
 		/* Someone grabbed the sem for write already */
+		rwsem_check_handoff(sem, waiter);
 		goto out;
+	}
 
-	/* Grant an infinite number of read locks to the readers at the front
-	 * of the queue.  Note we increment the 'active part' of the count by
+	/* Grant read locks to the readers in the queue, not only to those
+	 * at the front, so that they run as one batch instead of being
+	 * interleaved with the writers queued between them.  Writers keep
+	 * their place.  Note we increment the 'active part' of the count by
 	 * the number of readers before waking any processes up.
 	 */
 	woken = 0;
-	do {
-		woken++;
+	list_for_each_entry_safe(waiter, tmp, &sem->wait_list, list) {
+		if (waiter->flags & RWSEM_WAITING_FOR_WRITE)
+			continue;
 
-		if (waiter->list.next == &sem->wait_list)
+		list_move_tail(&waiter->list, &wake_list);
+		if (++woken >= RWSEM_MAX_READERS_WAKEUP)
 			break;
-
-		waiter = list_entry(waiter->list.next,
-					struct rwsem_waiter, list);
-
-	} while (waiter->flags & RWSEM_WAITING_FOR_READ);
+	}
 
 	adjustment = woken * RWSEM_ACTIVE_READ_BIAS;
-	if (waiter->flags & RWSEM_WAITING_FOR_READ)
-		/* hit end of list above */
+	if (list_empty(&sem->wait_list))
+		/* granted the whole queue */
 		adjustment -= RWSEM_WAITING_BIAS;
 
 	rwsem_atomic_add(adjustment, sem);
+	rwsem_clear_handoff(sem);
 
-	next = sem->wait_list.next;
-	for (loop = woken; loop > 0; loop--) {
-		waiter = list_entry(next, struct rwsem_waiter, list);
-		next = waiter->list.next;
+	/* wake_list is discarded, its entries vanish once ->task is cleared */
+	list_for_each_entry_safe(waiter, tmp, &wake_list, list) {
 		tsk = waiter->task;
 		smp_mb();
 		waiter->task = NULL;
@@ -152,17 +197,16 @@ __rwsem_do_wake(struct rw_semaphore *sem, int wake_type)
 		put_task_struct(tsk);
 	}
 
-	sem->wait_list.next = next;
-	next->prev = &sem->wait_list;
-
  out:
 	return sem;
 
 	/* undo the change to the active count, but check for a transition
 	 * 1->0 */
  undo_write:
-	if (rwsem_atomic_update(-adjustment, sem) & RWSEM_ACTIVE_MASK)
+	if (rwsem_atomic_update(-adjustment, sem) & RWSEM_ACTIVE_MASK) {
+		rwsem_check_handoff(sem, waiter);
 		goto out;
+	}
 	goto try_again_write;
 }
 
@@ -183,6 +227,7 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 	raw_spin_lock_irq(&sem->wait_lock);
 	waiter.task = tsk;
 	waiter.flags = flags;
+	waiter.timeout = jiffies + RWSEM_WAIT_TIMEOUT;
 	get_task_struct(tsk);
 
 	if (list_empty(&sem->wait_list))
@@ -201,7 +246,7 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 	if (count == RWSEM_WAITING_BIAS)
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_NO_ACTIVE);
 	else if (count > RWSEM_WAITING_BIAS &&
-		 adjustment == -RWSEM_ACTIVE_WRITE_BIAS)
+		 (flags & RWSEM_WAITING_FOR_WRITE))
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED);
 
 	raw_spin_unlock_irq(&sem->wait_lock);
@@ -228,13 +273,164 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 					-RWSEM_ACTIVE_READ_BIAS);
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Try to acquire the write lock outside of the wait queue.  Waiters are
+ * robbed unless the first one is due a handoff.
+ */
+static inline bool rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = ACCESS_ONCE(sem->count);
+
+	while (true) {
+		if (!(count == 0 || count == RWSEM_WAITING_BIAS))
+			return false;
+		if (count && ACCESS_ONCE(sem->handoff))
+			return false;
+
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count)
+			return true;
+
+		count = old;
+	}
+}
+
+static inline bool rwsem_can_spin_on_owner(struct rw_semaphore *sem)
+{
+	struct task_struct *owner;
+	bool on_cpu = true;
+
+	if (need_resched())
+		return false;
+
+	rcu_read_lock();
+	owner = ACCESS_ONCE(sem->owner);
+	if (owner && owner != RWSEM_READER_OWNED)
+		on_cpu = owner->on_cpu;
+	rcu_read_unlock();
+
+	/*
+	 * If sem->owner is not set, the owner may have just acquired the
+	 * rwsem and not set the owner yet, or it has been released.
+	 */
+	return on_cpu;
+}
+
+static inline bool owner_running(struct rw_semaphore *sem,
+				 struct task_struct *owner)
+{
+	if (sem->owner != owner)
+		return false;
+
+	/*
+	 * Ensure we emit the owner->on_cpu, dereference _after_ checking
+	 * sem->owner still matches owner, if that fails, owner might
+	 * point to free()d memory, if it still matches, the rcu_read_lock()
+	 * ensures the memory stays valid.
+	 */
+	barrier();
+
+	return owner->on_cpu;
+}
+
+/*
+ * Spin while @owner holds the rwsem and is running.  Returns true if the
+ * owner went away and it's worth trying to acquire the rwsem.
+ */
+static noinline bool rwsem_spin_on_owner(struct rw_semaphore *sem,
+					 struct task_struct *owner)
+{
+	rcu_read_lock();
+	while (owner_running(sem, owner)) {
+		if (need_resched() || ACCESS_ONCE(sem->handoff))
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+	rcu_read_unlock();
+
+	/*
+	 * We break out the loop above on need_resched() or handoff, and
+	 * when the owner changed or stopped running.  Keep spinning only if
+	 * the rwsem was released.
+	 */
+	return ACCESS_ONCE(sem->owner) == NULL;
+}
+
+/*
+ * Spin on the owner of the rwsem as long as it's running, the same way
+ * mutexes do, in the hope that it releases the rwsem soon.  Sleeping and
+ * waking up costs two context switches, which is a lot more than most
+ * write critical sections.  Returns true if the write lock was acquired.
+ */
+static bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	struct task_struct *owner;
+	bool taken = false;
+
+	preempt_disable();
+
+	if (!rwsem_can_spin_on_owner(sem))
+		goto done;
+
+	while (true) {
+		if (rwsem_try_write_lock_unqueued(sem)) {
+			taken = true;
+			break;
+		}
+
+		/* let the first waiter have it */
+		if (ACCESS_ONCE(sem->handoff))
+			break;
+
+		/* there's no telling how long readers are going to take */
+		owner = ACCESS_ONCE(sem->owner);
+		if (owner == RWSEM_READER_OWNED)
+			break;
+
+		if (owner && !rwsem_spin_on_owner(sem, owner))
+			break;
+
+		/*
+		 * When there's no owner, we might have preempted between the
+		 * owner acquiring the lock and setting the owner field.  If
+		 * we're an RT task that will live-lock because we won't let
+		 * the owner complete.
+		 */
+		if (!owner && (need_resched() || rt_task(current)))
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+
+done:
+	preempt_enable();
+	return taken;
+}
+#else
+static inline bool rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	return false;
+}
+#endif
+
 /*
  * wait for the write lock to be granted
  */
 struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 {
-	return rwsem_down_failed_common(sem, RWSEM_WAITING_FOR_WRITE,
-					-RWSEM_ACTIVE_WRITE_BIAS);
+	/*
+	 * Undo the write bias of the fastpath so that we don't hold off
+	 * the owner and the other writers while spinning.
+	 */
+	rwsem_atomic_add(-RWSEM_ACTIVE_WRITE_BIAS, sem);
+
+	if (rwsem_optimistic_spin(sem))
+		return sem;
+
+	return rwsem_down_failed_common(sem, RWSEM_WAITING_FOR_WRITE, 0);
 }
 
 /*
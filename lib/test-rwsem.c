@@ -0,0 +1,165 @@
+/*
+ * Run a reader and a writer thread per online CPU against one rwsem for
+ * a few seconds.  Readers and writers must exclude each other, and the
+ * longest wait of each kind shows whether spinning writers starve the
+ * queued ones.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/rwsem.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+
+#include "test-start.h"
+
+#define DURATION	(5 * HZ)
+#define HOLD_LOOPS	100
+
+static DECLARE_RWSEM(sem);
+
+/* threads inside the critical section */
+static atomic_t readers ____cacheline_aligned_in_smp;
+static atomic_t writers;
+static atomic_t errors;
+
+struct test_thread {
+	bool writer;
+	unsigned long ops;
+	s64 max_wait_ns;
+	struct completion done;
+};
+
+static struct test_start start_barrier;
+static unsigned long end;
+
+static void hold(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < HOLD_LOOPS; i++)
+		cpu_relax();
+}
+
+static void test_read(void)
+{
+	down_read(&sem);
+	atomic_inc(&readers);
+	if (atomic_read(&writers))
+		atomic_inc(&errors);
+	hold();
+	atomic_dec(&readers);
+	up_read(&sem);
+}
+
+static void test_write(void)
+{
+	down_write(&sem);
+	if (atomic_inc_return(&writers) != 1 || atomic_read(&readers))
+		atomic_inc(&errors);
+	hold();
+	atomic_dec(&writers);
+	up_write(&sem);
+}
+
+static int test_thread_fn(void *data)
+{
+	struct test_thread *t = data;
+	ktime_t start;
+	s64 wait;
+
+	test_start_wait(&start_barrier);
+
+	while (time_before(jiffies, end)) {
+		start = ktime_get();
+		if (t->writer)
+			test_write();
+		else
+			test_read();
+		wait = ktime_to_ns(ktime_sub(ktime_get(), start));
+		t->max_wait_ns = max(t->max_wait_ns, wait);
+		t->ops++;
+		cond_resched();
+	}
+
+	complete(&t->done);
+	return 0;
+}
+
+static void __init report(struct test_thread *threads, unsigned int nr,
+			  const char *what)
+{
+	unsigned long ops = 0;
+	s64 max_wait = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		ops += threads[i].ops;
+		max_wait = max(max_wait, threads[i].max_wait_ns);
+	}
+
+	printk(KERN_INFO "rwsem %s: %lu ops, longest wait %lld us\n",
+	       what, ops, div_s64(max_wait, NSEC_PER_USEC));
+}
+
+static int __init test_rwsem_init(void)
+{
+	unsigned int i, started, cpus = num_online_cpus();
+	struct test_thread *threads;
+	int ret = 0;
+
+	threads = kcalloc(2 * cpus, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	test_start_init(&start_barrier);
+
+	/* writers first, then readers */
+	for (started = 0; started < 2 * cpus; started++) {
+		struct test_thread *t = &threads[started];
+		struct task_struct *task;
+
+		t->writer = started < cpus;
+		init_completion(&t->done);
+		task = kthread_run(test_thread_fn, t, "test_rwsem/%u",
+				   started);
+		if (IS_ERR(task)) {
+			ret = PTR_ERR(task);
+			break;
+		}
+	}
+
+	test_start_wait_ready(&start_barrier, started);
+	end = jiffies + DURATION;
+	test_start_go(&start_barrier);
+
+	for (i = 0; i < started; i++)
+		wait_for_completion(&threads[i].done);
+	if (ret)
+		goto out;
+
+	if (atomic_read(&errors)) {
+		printk(KERN_ERR "rwsem: %d exclusion violations\n",
+		       atomic_read(&errors));
+		ret = -EINVAL;
+		goto out;
+	}
+
+	report(threads, cpus, "writers");
+	report(threads + cpus, cpus, "readers");
+out:
+	kfree(threads);
+	return ret;
+}
+module_init(test_rwsem_init);
+
+static void __exit test_rwsem_exit(void)
+{
+}
+module_exit(test_rwsem_exit);
+
+MODULE_LICENSE("GPL");
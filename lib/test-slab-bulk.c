@@ -0,0 +1,142 @@
+/*
+ * Check that kmem_cache_alloc_bulk() hands out distinct objects and
+ * compare its per-object cost with kmem_cache_alloc()/kmem_cache_free().
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/timex.h>
+
+#define OBJECT_SIZE	256
+#define LOOPS		100000
+#define MAX_BULK	256
+
+static const unsigned int bulk_sizes[] __initconst = {
+	1, 2, 3, 4, 8, 16, 30, 32, 64, 128, 158, 250,
+};
+
+static void *objs[MAX_BULK];
+
+static int __init cmp_ptr(const void *a, const void *b)
+{
+	unsigned long x = *(unsigned long *)a, y = *(unsigned long *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int __init check_batch(struct kmem_cache *s, unsigned int n)
+{
+	unsigned int i;
+	int ret = 0;
+
+	if (kmem_cache_alloc_bulk(s, GFP_KERNEL, n, objs) != n)
+		return -ENOMEM;
+
+	for (i = 0; i < n; i++)
+		memset(objs[i], 0x5a, OBJECT_SIZE);
+
+	sort(objs, n, sizeof(void *), cmp_ptr, NULL);
+	for (i = 1; i < n; i++) {
+		if (objs[i] == objs[i - 1]) {
+			printk(KERN_ERR "slab bulk: %p handed out twice in "
+			       "a batch of %u\n", objs[i], n);
+			ret = -EINVAL;
+		}
+	}
+
+	/* sorted, so no longer in allocation order */
+	kmem_cache_free_bulk(s, n, objs);
+	return ret;
+}
+
+static int __init bench_single(struct kmem_cache *s, unsigned int n,
+			       u64 *cycles)
+{
+	cycles_t start, stop;
+	unsigned int l, i;
+
+	start = get_cycles();
+	for (l = 0; l < LOOPS; l++) {
+		for (i = 0; i < n; i++) {
+			objs[i] = kmem_cache_alloc(s, GFP_KERNEL);
+			if (!objs[i]) {
+				while (i--)
+					kmem_cache_free(s, objs[i]);
+				return -ENOMEM;
+			}
+		}
+		for (i = 0; i < n; i++)
+			kmem_cache_free(s, objs[i]);
+	}
+	stop = get_cycles();
+
+	*cycles = div_u64(stop - start, (u64)LOOPS * n);
+	return 0;
+}
+
+static int __init bench_bulk(struct kmem_cache *s, unsigned int n,
+			     u64 *cycles)
+{
+	cycles_t start, stop;
+	unsigned int l;
+
+	start = get_cycles();
+	for (l = 0; l < LOOPS; l++) {
+		if (!kmem_cache_alloc_bulk(s, GFP_KERNEL, n, objs))
+			return -ENOMEM;
+		kmem_cache_free_bulk(s, n, objs);
+	}
+	stop = get_cycles();
+
+	*cycles = div_u64(stop - start, (u64)LOOPS * n);
+	return 0;
+}
+
+static int __init test_slab_bulk_init(void)
+{
+	struct kmem_cache *s;
+	unsigned int i;
+	int ret = 0;
+
+	s = kmem_cache_create("test_slab_bulk", OBJECT_SIZE, 0, 0, NULL);
+	if (!s)
+		return -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(bulk_sizes) && !ret; i++)
+		ret = check_batch(s, bulk_sizes[i]);
+
+	/* no cycle counter on this architecture, nothing to time with */
+	if (!ret && !get_cycles()) {
+		printk(KERN_INFO "slab bulk: get_cycles() unavailable, "
+		       "skipping timing\n");
+		goto out;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(bulk_sizes) && !ret; i++) {
+		unsigned int n = bulk_sizes[i];
+		u64 single, bulk;
+
+		ret = bench_single(s, n, &single);
+		if (!ret)
+			ret = bench_bulk(s, n, &bulk);
+		if (ret)
+			break;
+		printk(KERN_INFO "slab bulk %3u: %llu cycles/obj single, "
+		       "%llu bulk\n", n, single, bulk);
+		cond_resched();
+	}
+out:
+	kmem_cache_destroy(s);
+	return ret;
+}
+module_init(test_slab_bulk_init);
+
+static void __exit test_slab_bulk_exit(void)
+{
+}
+module_exit(test_slab_bulk_exit);
+
+MODULE_LICENSE("GPL");
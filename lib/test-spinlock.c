@@ -0,0 +1,187 @@
+/*
+ * Contend arch_spinlock_t from 1, 2, 4 ... up to all online CPUs, check
+ * that it excludes and compare the cost of a lock/unlock pair with a
+ * plain ticket lock, where all waiters spin on the lock word.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/timex.h>
+
+#include "test-start.h"
+
+#define LOOPS		100000
+#define HOLD_LOOPS	10	/* cpu_relax() in the critical section */
+#define DELAY_LOOPS	50	/* and between two of them */
+
+struct ticket_lock {
+	atomic_t	next;
+	atomic_t	owner;
+};
+
+static struct ticket_lock ticket ____cacheline_aligned_in_smp;
+static arch_spinlock_t arch_lock ____cacheline_aligned_in_smp =
+	__ARCH_SPIN_LOCK_UNLOCKED;
+
+/* protected by the lock under test */
+static unsigned long counter ____cacheline_aligned_in_smp;
+
+static void ticket_lock(void)
+{
+	int t = atomic_inc_return(&ticket.next) - 1;
+
+	while (atomic_read(&ticket.owner) != t)
+		cpu_relax();
+	smp_rmb();
+}
+
+static void ticket_unlock(void)
+{
+	smp_mb__before_atomic_inc();
+	atomic_inc(&ticket.owner);
+}
+
+static void arch_lock_lock(void)
+{
+	arch_spin_lock(&arch_lock);
+}
+
+static void arch_lock_unlock(void)
+{
+	arch_spin_unlock(&arch_lock);
+}
+
+static const struct lock_ops {
+	const char *name;
+	void (*lock)(void);
+	void (*unlock)(void);
+} lock_ops[] = {
+	{ "ticket", ticket_lock, ticket_unlock },
+	{ "arch", arch_lock_lock, arch_lock_unlock },
+};
+
+struct test_thread {
+	const struct lock_ops *ops;
+	cycles_t cycles;
+	struct completion done;
+};
+
+static struct test_start start_barrier;
+
+static int test_thread_fn(void *data)
+{
+	struct test_thread *t = data;
+	unsigned int i, j;
+	cycles_t start;
+
+	test_start_wait(&start_barrier);
+
+	start = get_cycles();
+	for (i = 0; i < LOOPS; i++) {
+		preempt_disable();
+		t->ops->lock();
+		counter++;
+		for (j = 0; j < HOLD_LOOPS; j++)
+			cpu_relax();
+		t->ops->unlock();
+		preempt_enable();
+
+		for (j = 0; j < DELAY_LOOPS; j++)
+			cpu_relax();
+		if (!(i & 1023))
+			cond_resched();
+	}
+	t->cycles = get_cycles() - start;
+
+	complete(&t->done);
+	return 0;
+}
+
+static int __init run_test(struct test_thread *threads, unsigned int nr,
+			   const struct lock_ops *ops)
+{
+	unsigned int i, started;
+	u64 cycles = 0;
+	int cpu = -1, ret = 0;
+
+	counter = 0;
+	test_start_init(&start_barrier);
+
+	for (started = 0; started < nr; started++) {
+		struct test_thread *t = &threads[started];
+		struct task_struct *task;
+
+		t->ops = ops;
+		init_completion(&t->done);
+		task = kthread_create(test_thread_fn, t, "test_spinlock/%u",
+				      started);
+		if (IS_ERR(task)) {
+			ret = PTR_ERR(task);
+			break;
+		}
+		/* a CPU may have gone offline since max was computed */
+		cpu = cpumask_next(cpu, cpu_online_mask);
+		if (cpu >= nr_cpu_ids) {
+			kthread_stop(task);
+			ret = -ENODEV;
+			break;
+		}
+		kthread_bind(task, cpu);
+		wake_up_process(task);
+	}
+
+	test_start_wait_ready(&start_barrier, started);
+	test_start_go(&start_barrier);
+
+	for (i = 0; i < started; i++) {
+		wait_for_completion(&threads[i].done);
+		cycles += threads[i].cycles;
+	}
+
+	if (ret)
+		return ret;
+
+	if (counter != (unsigned long)nr * LOOPS) {
+		printk(KERN_ERR "spinlock %s: %u threads lost %lu updates\n",
+		       ops->name, nr, (unsigned long)nr * LOOPS - counter);
+		return -EINVAL;
+	}
+
+	printk(KERN_INFO "spinlock %s: %u threads, %llu cycles/op\n",
+	       ops->name, nr, div_u64(cycles, (u64)nr * LOOPS));
+	return 0;
+}
+
+static int __init test_spinlock_init(void)
+{
+	unsigned int i, nr, max = num_online_cpus();
+	struct test_thread *threads;
+	int ret = 0;
+
+	threads = kcalloc(max, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	for (nr = 1; !ret; nr = min(nr * 2, max)) {
+		for (i = 0; i < ARRAY_SIZE(lock_ops) && !ret; i++)
+			ret = run_test(threads, nr, &lock_ops[i]);
+		if (nr == max)
+			break;
+	}
+
+	kfree(threads);
+	return ret;
+}
+module_init(test_spinlock_init);
+
+static void __exit test_spinlock_exit(void)
+{
+}
+module_exit(test_spinlock_exit);
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,46 @@
+#ifndef _LIB_TEST_START_H
+#define _LIB_TEST_START_H
+
+/*
+ * Start barrier for the lock tests: every thread checks in and then
+ * sleeps until all of them are ready, so that they actually contend.
+ */
+#include <linux/atomic.h>
+#include <linux/sched.h>
+#include <linux/wait.h>
+
+struct test_start {
+	wait_queue_head_t	wait;
+	atomic_t		ready;
+	bool			go;
+};
+
+static inline void test_start_init(struct test_start *s)
+{
+	init_waitqueue_head(&s->wait);
+	atomic_set(&s->ready, 0);
+	s->go = false;
+}
+
+/* called by each test thread */
+static inline void test_start_wait(struct test_start *s)
+{
+	atomic_inc(&s->ready);
+	wait_event(s->wait, ACCESS_ONCE(s->go));
+}
+
+/* wait until @nr threads have checked in */
+static inline void test_start_wait_ready(struct test_start *s,
+					 unsigned int nr)
+{
+	while (atomic_read(&s->ready) < nr)
+		schedule_timeout_uninterruptible(1);
+}
+
+static inline void test_start_go(struct test_start *s)
+{
+	s->go = true;
+	wake_up_all(&s->wait);
+}
+
+#endif /* _LIB_TEST_START_H */
@@ -0,0 +1,204 @@
+/*
+ * Arm a large number of pinned timers with random timeouts up to two
+ * minutes, like TCP retransmit and keepalive timers, and keep re-arming
+ * and deleting them for a few seconds.  Report the cost of mod_timer()
+ * and del_timer() and how late the expired timers ran; none may expire
+ * early.  Then check that a short timer armed right after its CPU was
+ * idle for a second still expires on time.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/timer.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/delay.h>
+#include <linux/jiffies.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/vmalloc.h>
+#include <linux/timex.h>
+
+#define NR_TIMERS	100000
+#define MAX_TIMEOUT	(120 * HZ)
+#define DURATION	(10 * HZ)
+#define DEL_PERCENT	25
+
+#define IDLE_ROUNDS	5
+#define IDLE_MSECS	1000
+#define IDLE_TIMEOUT	4	/* jiffies, well within the first level */
+#define IDLE_SLACK	2	/* jiffies a timer may be late by */
+
+static struct timer_list *timers;
+
+/*
+ * Only updated from the timer softirq of the CPU of the test thread,
+ * which can't run at the same time as the test thread.
+ */
+static unsigned long fired;
+static unsigned long early;
+static unsigned long max_late;
+
+static void test_timer_fn(unsigned long data)
+{
+	struct timer_list *timer = &timers[data];
+	unsigned long now = jiffies;
+
+	fired++;
+	if (time_before(now, timer->expires))
+		early++;
+	else
+		max_late = max(max_late, now - timer->expires);
+}
+
+static DECLARE_COMPLETION(idle_ready);
+static DECLARE_COMPLETION(idle_wake);
+static DECLARE_COMPLETION(idle_fired);
+static unsigned long idle_late;
+
+static void idle_timer_fn(unsigned long data)
+{
+	struct timer_list *timer = (struct timer_list *)data;
+
+	if (time_before(jiffies, timer->expires))
+		early++;
+	else
+		idle_late = max(idle_late, jiffies - timer->expires);
+	complete(&idle_fired);
+}
+
+static unsigned long random_timeout(void)
+{
+	return jiffies + 1 + random32() % MAX_TIMEOUT;
+}
+
+static void churn(void)
+{
+	u64 mod_cycles = 0, del_cycles = 0;
+	unsigned long nr_mod = 0, nr_del = 0, end;
+	unsigned int i;
+	cycles_t start;
+
+	for (i = 0; i < NR_TIMERS; i++)
+		setup_timer(&timers[i], test_timer_fn, i);
+
+	preempt_disable();
+	start = get_cycles();
+	for (i = 0; i < NR_TIMERS; i++)
+		mod_timer_pinned(&timers[i], random_timeout());
+	mod_cycles += get_cycles() - start;
+	nr_mod += NR_TIMERS;
+	preempt_enable();
+
+	end = jiffies + DURATION;
+	while (time_before(jiffies, end)) {
+		preempt_disable();
+		for (i = 0; i < 1000; i++) {
+			struct timer_list *t = &timers[random32() % NR_TIMERS];
+
+			start = get_cycles();
+			if (random32() % 100 < DEL_PERCENT) {
+				del_timer(t);
+				del_cycles += get_cycles() - start;
+				nr_del++;
+			} else {
+				mod_timer_pinned(t, random_timeout());
+				mod_cycles += get_cycles() - start;
+				nr_mod++;
+			}
+		}
+		preempt_enable();
+		cond_resched();
+	}
+
+	for (i = 0; i < NR_TIMERS; i++)
+		del_timer_sync(&timers[i]);
+
+	printk(KERN_INFO "timer: mod_timer %llu cycles/op, del_timer %llu "
+	       "cycles/op\n", div_u64(mod_cycles, nr_mod),
+	       div_u64(del_cycles, max(nr_del, 1UL)));
+	printk(KERN_INFO "timer: %lu expired, at most %lu jiffies late\n",
+	       fired, max_late);
+}
+
+/*
+ * The wheel clock of an idle CPU lags behind jiffies, the timer must be
+ * queued relative to jiffies anyway.
+ */
+static void arm_after_idle(void)
+{
+	struct timer_list timer;
+	unsigned int i;
+
+	setup_timer_on_stack(&timer, idle_timer_fn, (unsigned long)&timer);
+	for (i = 0; i < IDLE_ROUNDS; i++) {
+		complete(&idle_ready);
+		wait_for_completion(&idle_wake);
+		mod_timer_pinned(&timer, jiffies + IDLE_TIMEOUT);
+		wait_for_completion(&idle_fired);
+	}
+	destroy_timer_on_stack(&timer);
+
+	printk(KERN_INFO "timer: armed after idle at most %lu jiffies late\n",
+	       idle_late);
+}
+
+static DECLARE_COMPLETION(test_done);
+
+static int test_thread_fn(void *data)
+{
+	churn();
+	arm_after_idle();
+	complete(&test_done);
+	return 0;
+}
+
+static int __init test_timer_init(void)
+{
+	struct task_struct *task;
+	unsigned int i, cpu;
+
+	timers = vzalloc(NR_TIMERS * sizeof(*timers));
+	if (!timers)
+		return -ENOMEM;
+
+	task = kthread_create(test_thread_fn, NULL, "test_timer");
+	if (IS_ERR(task)) {
+		vfree(timers);
+		return PTR_ERR(task);
+	}
+	/* wake the test thread up from another CPU if there is one */
+	cpu = cpumask_any_but(cpu_online_mask, raw_smp_processor_id());
+	if (cpu >= nr_cpu_ids)
+		cpu = raw_smp_processor_id();
+	kthread_bind(task, cpu);
+	wake_up_process(task);
+
+	for (i = 0; i < IDLE_ROUNDS; i++) {
+		wait_for_completion(&idle_ready);
+		msleep(IDLE_MSECS);
+		complete(&idle_wake);
+	}
+	wait_for_completion(&test_done);
+	vfree(timers);
+
+	if (early) {
+		printk(KERN_ERR "timer: %lu timers expired early\n", early);
+		return -EINVAL;
+	}
+	if (idle_late > IDLE_SLACK) {
+		printk(KERN_ERR "timer: %lu jiffies late after idle\n",
+		       idle_late);
+		return -EINVAL;
+	}
+	return 0;
+}
+module_init(test_timer_init);
+
+static void __exit test_timer_exit(void)
+{
+}
+module_exit(test_timer_exit);
+
+MODULE_LICENSE("GPL");
@@ -0,0 +1,233 @@
+/*
+ * Exercise the vmalloc free area tree and lazy purging from all online
+ * CPUs at once: aligned allocations, reuse of holes among many busy
+ * areas and a check that live areas never overlap.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/random.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+#include <linux/timex.h>
+#include <linux/vmalloc.h>
+
+#define LOOPS		100000
+#define LONG_BUSY_LIST	15000
+#define SANITY_AREAS	512
+
+/* VM_IOREMAP areas are aligned to their size rounded up to a power of 2 */
+static int align_alloc_test(void)
+{
+	struct vm_struct *area;
+	unsigned long size, align;
+	unsigned int i;
+
+	for (i = 0; i < LOOPS; i++) {
+		size = (random32() % 128 + 1) * PAGE_SIZE;
+		align = 1UL << min_t(int, fls(size), IOREMAP_MAX_ORDER);
+
+		area = __get_vm_area(size, VM_IOREMAP, VMALLOC_START,
+				     VMALLOC_END);
+		if (!area)
+			return -ENOMEM;
+		if ((unsigned long)area->addr & (align - 1)) {
+			printk(KERN_ERR "vmalloc: %p not aligned to %#lx\n",
+			       area->addr, align);
+			free_vm_area(area);
+			return -EINVAL;
+		}
+		free_vm_area(area);
+	}
+
+	return 0;
+}
+
+/* allocations must find the holes punched into a long busy list */
+static int long_busy_list_alloc_test(void)
+{
+	unsigned int i;
+	void **ptrs;
+	void *ptr;
+	int ret = 0;
+
+	ptrs = vzalloc(sizeof(void *) * LONG_BUSY_LIST);
+	if (!ptrs)
+		return -ENOMEM;
+
+	for (i = 0; i < LONG_BUSY_LIST; i++) {
+		ptrs[i] = vmalloc(PAGE_SIZE);
+		if (!ptrs[i]) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	for (i = 0; i < LONG_BUSY_LIST; i += 2) {
+		vfree(ptrs[i]);
+		ptrs[i] = NULL;
+	}
+
+	for (i = 0; i < LOOPS; i++) {
+		ptr = vmalloc(PAGE_SIZE);
+		if (!ptr) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		vfree(ptr);
+	}
+
+out:
+	for (i = 0; i < LONG_BUSY_LIST; i++)
+		vfree(ptrs[i]);
+	vfree(ptrs);
+	return ret;
+}
+
+struct sanity_area {
+	unsigned long start;
+	unsigned long end;
+};
+
+static int cmp_area(const void *a, const void *b)
+{
+	const struct sanity_area *x = a, *y = b;
+
+	return x->start < y->start ? -1 : x->start > y->start;
+}
+
+static int sanity_test(void)
+{
+	struct sanity_area *areas;
+	unsigned int i, l, n;
+	int ret = 0;
+
+	areas = vmalloc(sizeof(*areas) * SANITY_AREAS);
+	if (!areas)
+		return -ENOMEM;
+
+	for (l = 0; l < LOOPS / SANITY_AREAS && !ret; l++) {
+		for (i = 0; i < SANITY_AREAS; i++) {
+			n = random32() % 16 + 1;
+			areas[i].start = (unsigned long)vmalloc(n * PAGE_SIZE);
+			if (!areas[i].start) {
+				ret = -ENOMEM;
+				break;
+			}
+			areas[i].end = areas[i].start + n * PAGE_SIZE;
+		}
+		n = i;
+
+		sort(areas, n, sizeof(areas[0]), cmp_area, NULL);
+		for (i = 1; i < n; i++) {
+			if (areas[i].start < areas[i - 1].end) {
+				printk(KERN_ERR "vmalloc: %#lx-%#lx overlaps "
+				       "%#lx-%#lx\n", areas[i].start,
+				       areas[i].end, areas[i - 1].start,
+				       areas[i - 1].end);
+				ret = -EINVAL;
+			}
+		}
+
+		for (i = 0; i < n; i++)
+			vfree((void *)areas[i].start);
+		cond_resched();
+	}
+
+	vfree(areas);
+	return ret;
+}
+
+static const struct {
+	const char *name;
+	int (*func)(void);
+} tests[] = {
+	{ "align", align_alloc_test },
+	{ "long_busy_list", long_busy_list_alloc_test },
+	{ "sanity", sanity_test },
+};
+
+struct test_thread {
+	int (*func)(void);
+	int ret;
+	cycles_t cycles;
+	struct completion done;
+};
+
+static int test_thread_fn(void *data)
+{
+	struct test_thread *t = data;
+	cycles_t start = get_cycles();
+
+	t->ret = t->func();
+	t->cycles = get_cycles() - start;
+	complete(&t->done);
+	return 0;
+}
+
+static int __init run_test(struct test_thread *threads, unsigned int nr,
+			   unsigned int test)
+{
+	unsigned int i, started;
+	u64 cycles = 0;
+	int ret = 0;
+
+	for (started = 0; started < nr; started++) {
+		struct test_thread *t = &threads[started];
+		struct task_struct *task;
+
+		t->func = tests[test].func;
+		t->ret = 0;
+		init_completion(&t->done);
+		task = kthread_run(test_thread_fn, t, "test_vmalloc/%u",
+				   started);
+		if (IS_ERR(task)) {
+			ret = PTR_ERR(task);
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++) {
+		wait_for_completion(&threads[i].done);
+		if (!ret)
+			ret = threads[i].ret;
+		cycles += threads[i].cycles;
+	}
+
+	if (ret)
+		printk(KERN_ERR "vmalloc %s: failed %d\n", tests[test].name,
+		       ret);
+	else
+		printk(KERN_INFO "vmalloc %s: %u threads, %llu cycles/loop\n",
+		       tests[test].name, started,
+		       div_u64(cycles, (u64)started * LOOPS));
+	return ret;
+}
+
+static int __init test_vmalloc_init(void)
+{
+	struct test_thread *threads;
+	unsigned int i, nr = num_online_cpus();
+	int ret = 0;
+
+	threads = kcalloc(nr, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(tests) && !ret; i++)
+		ret = run_test(threads, nr, i);
+
+	kfree(threads);
+	return ret;
+}
+module_init(test_vmalloc_init);
+
+static void __exit test_vmalloc_exit(void)
+{
+}
+module_exit(test_vmalloc_exit);
+
+MODULE_LICENSE("GPL");
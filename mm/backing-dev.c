@@ -10,6 +10,7 @@
 #include <linux/module.h>
 #include <linux/writeback.h>
 #include <linux/device.h>
+#include <linux/slab.h>
 #include <trace/events/writeback.h>
 
 static atomic_long_t bdi_seq = ATOMIC_LONG_INIT(0);
@@ -64,25 +65,34 @@ static void bdi_debug_init(void)
 static int bdi_debug_stats_show(struct seq_file *m, void *v)
 {
 	struct backing_dev_info *bdi = m->private;
-	struct bdi_writeback *wb = &bdi->wb;
+	struct bdi_writeback *wb;
 	unsigned long background_thresh;
 	unsigned long dirty_thresh;
 	unsigned long bdi_thresh;
-	unsigned long nr_dirty, nr_io, nr_more_io;
+	unsigned long nr_dirty, nr_io, nr_more_io, nr_wb;
+	unsigned long stat[NR_WB_STAT_ITEMS] = { };
 	struct inode *inode;
+	int i;
 
-	nr_dirty = nr_io = nr_more_io = 0;
-	spin_lock(&wb->list_lock);
-	list_for_each_entry(inode, &wb->b_dirty, i_wb_list)
-		nr_dirty++;
-	list_for_each_entry(inode, &wb->b_io, i_wb_list)
-		nr_io++;
-	list_for_each_entry(inode, &wb->b_more_io, i_wb_list)
-		nr_more_io++;
-	spin_unlock(&wb->list_lock);
+	/* the stats and lists are summed up over the wbs of all cgroups */
+	nr_dirty = nr_io = nr_more_io = nr_wb = 0;
+	bdi_for_each_wb(wb, bdi) {
+		spin_lock(&wb->list_lock);
+		list_for_each_entry(inode, &wb->b_dirty, i_wb_list)
+			nr_dirty++;
+		list_for_each_entry(inode, &wb->b_io, i_wb_list)
+			nr_io++;
+		list_for_each_entry(inode, &wb->b_more_io, i_wb_list)
+			nr_more_io++;
+		spin_unlock(&wb->list_lock);
+
+		for (i = 0; i < NR_WB_STAT_ITEMS; i++)
+			stat[i] += wb_stat(wb, i);
+		nr_wb++;
+	}
 
 	global_dirty_limits(&background_thresh, &dirty_thresh);
-	bdi_thresh = bdi_dirty_limit(bdi, dirty_thresh);
+	bdi_thresh = wb_dirty_limit(&bdi->wb, dirty_thresh);
 
 #define K(x) ((x) << (PAGE_SHIFT - 10))
 	seq_printf(m,
@@ -98,19 +108,21 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "b_io:               %10lu\n"
 		   "b_more_io:          %10lu\n"
 		   "bdi_list:           %10u\n"
-		   "state:              %10lx\n",
-		   (unsigned long) K(bdi_stat(bdi, BDI_WRITEBACK)),
-		   (unsigned long) K(bdi_stat(bdi, BDI_RECLAIMABLE)),
+		   "state:              %10lx\n"
+		   "nr_wb:              %10lu\n",
+		   K(stat[WB_WRITEBACK]),
+		   K(stat[WB_RECLAIMABLE]),
 		   K(bdi_thresh),
 		   K(dirty_thresh),
 		   K(background_thresh),
-		   (unsigned long) K(bdi_stat(bdi, BDI_DIRTIED)),
-		   (unsigned long) K(bdi_stat(bdi, BDI_WRITTEN)),
-		   (unsigned long) K(bdi->write_bandwidth),
+		   K(stat[WB_DIRTIED]),
+		   K(stat[WB_WRITTEN]),
+		   (unsigned long) K(bdi->wb.write_bandwidth),
 		   nr_dirty,
 		   nr_io,
 		   nr_more_io,
-		   !list_empty(&bdi->bdi_list), bdi->state);
+		   !list_empty(&bdi->bdi_list), bdi->state,
+		   nr_wb);
 #undef K
 
 	return 0;
@@ -255,7 +267,15 @@ subsys_initcall(default_bdi_init);
 
 int bdi_has_dirty_io(struct backing_dev_info *bdi)
 {
-	return wb_has_dirty_io(&bdi->wb);
+	struct bdi_writeback *wb;
+
+	bdi_for_each_wb(wb, bdi) {
+		if (wb_has_dirty_io(wb)) {
+			wb_put(wb);
+			return 1;
+		}
+	}
+	return 0;
 }
 
 static void wakeup_timer_fn(unsigned long data)
@@ -370,7 +390,7 @@ static int bdi_forker_thread(void *ptr)
 			     "bdi %p/%s is not registered!\n", bdi, bdi->name);
 
 			have_dirty_io = !list_empty(&bdi->work_list) ||
-					wb_has_dirty_io(&bdi->wb);
+					bdi_has_dirty_io(bdi);
 
 			/*
 			 * If the bdi has work to do, but the thread does not
@@ -599,8 +619,15 @@ void bdi_unregister(struct backing_dev_info *bdi)
 }
 EXPORT_SYMBOL(bdi_unregister);
 
-static void bdi_wb_init(struct bdi_writeback *wb, struct backing_dev_info *bdi)
+/*
+ * Initial write bandwidth: 100 MB/s
+ */
+#define INIT_BW		(100 << (20 - PAGE_SHIFT))
+
+static int wb_init(struct bdi_writeback *wb, struct backing_dev_info *bdi)
 {
+	int i, err;
+
 	memset(wb, 0, sizeof(*wb));
 
 	wb->bdi = bdi;
@@ -610,65 +637,300 @@ static void bdi_wb_init(struct bdi_writeback *wb, struct backing_dev_info *bdi)
 	INIT_LIST_HEAD(&wb->b_more_io);
 	spin_lock_init(&wb->list_lock);
 	setup_timer(&wb->wakeup_timer, wakeup_timer_fn, (unsigned long)bdi);
+
+	wb->bw_time_stamp = jiffies;
+	wb->balanced_dirty_ratelimit = INIT_BW;
+	wb->dirty_ratelimit = INIT_BW;
+	wb->write_bandwidth = INIT_BW;
+	wb->avg_write_bandwidth = INIT_BW;
+
+	for (i = 0; i < NR_WB_STAT_ITEMS; i++) {
+		err = percpu_counter_init(&wb->stat[i], 0);
+		if (err)
+			goto err;
+	}
+
+	err = fprop_local_init_percpu(&wb->completions);
+
+	if (err) {
+err:
+		while (i--)
+			percpu_counter_destroy(&wb->stat[i]);
+	}
+
+	return err;
 }
 
+static void wb_exit(struct bdi_writeback *wb)
+{
+	int i;
+
+	del_timer_sync(&wb->wakeup_timer);
+
+	for (i = 0; i < NR_WB_STAT_ITEMS; i++)
+		percpu_counter_destroy(&wb->stat[i]);
+
+	fprop_local_destroy_percpu(&wb->completions);
+}
+
+#ifdef CONFIG_CGROUP_WRITEBACK
+
 /*
- * Initial write bandwidth: 100 MB/s
+ * cgwb_lock protects bdi->cgwb_tree and bdi->wb_list.  A cgroup wb is in
+ * the tree of its bdi, which holds the base reference on it, from its
+ * creation until its memcg is removed or the bdi is destroyed.  It stays
+ * on bdi->wb_list until the last reference is gone.
  */
-#define INIT_BW		(100 << (20 - PAGE_SHIFT))
+static DEFINE_SPINLOCK(cgwb_lock);
+static DECLARE_WAIT_QUEUE_HEAD(cgwb_release_wait);
 
-int bdi_init(struct backing_dev_info *bdi)
+static void cgwb_release_workfn(struct work_struct *work)
 {
-	int i, err;
+	struct bdi_writeback *wb = container_of(work, struct bdi_writeback,
+						release_work);
 
-	bdi->dev = NULL;
+	spin_lock(&cgwb_lock);
+	list_del_rcu(&wb->bdi_node);
+	spin_unlock(&cgwb_lock);
 
-	bdi->min_ratio = 0;
-	bdi->max_ratio = 100;
-	bdi->max_prop_frac = FPROP_FRAC_BASE;
-	spin_lock_init(&bdi->wb_lock);
-	INIT_LIST_HEAD(&bdi->bdi_list);
-	INIT_LIST_HEAD(&bdi->work_list);
+	/* wb_get_lookup() and bdi_next_wb() may still be looking at it */
+	synchronize_rcu();
 
-	bdi_wb_init(&bdi->wb, bdi);
+	WARN_ON_ONCE(wb_has_dirty_io(wb));
+	wb_exit(wb);
+	kfree(wb);
 
-	for (i = 0; i < NR_BDI_STAT_ITEMS; i++) {
-		err = percpu_counter_init(&bdi->bdi_stat[i], 0);
-		if (err)
-			goto err;
+	wake_up_all(&cgwb_release_wait);
+}
+
+/* called by wb_put() on the last reference, can't sleep */
+void wb_release(struct bdi_writeback *wb)
+{
+	schedule_work(&wb->release_work);
+}
+
+/**
+ * wb_get_lookup - get the wb of a memcg on a bdi
+ * @bdi: the bdi of interest
+ * @memcg_id: css_id of the memcg, 0 for the root memcg
+ *
+ * Returns the referenced wb or NULL if it doesn't exist.  Doesn't sleep.
+ */
+struct bdi_writeback *wb_get_lookup(struct backing_dev_info *bdi,
+				    unsigned short memcg_id)
+{
+	struct bdi_writeback *wb;
+
+	if (!memcg_id)
+		return &bdi->wb;
+
+	rcu_read_lock();
+	wb = radix_tree_lookup(&bdi->cgwb_tree, memcg_id);
+	if (wb && !wb_tryget(wb))
+		wb = NULL;
+	rcu_read_unlock();
+
+	return wb;
+}
+
+/**
+ * wb_get_create - get the wb of a memcg on a bdi, creating it if necessary
+ * @bdi: the bdi of interest
+ * @memcg_id: css_id of the memcg, 0 for the root memcg
+ * @gfp: allocation mask, must allow sleeping
+ *
+ * Returns the referenced wb or NULL if it couldn't be created.  The percpu
+ * counters of a wb can only be allocated with GFP_KERNEL, hence this may
+ * sleep even if the wb exists.
+ */
+struct bdi_writeback *wb_get_create(struct backing_dev_info *bdi,
+				    unsigned short memcg_id, gfp_t gfp)
+{
+	struct bdi_writeback *wb;
+	int ret;
+
+	might_sleep_if(gfp & __GFP_WAIT);
+
+	wb = wb_get_lookup(bdi, memcg_id);
+	if (wb || !(gfp & __GFP_WAIT))
+		return wb;
+
+	wb = kmalloc(sizeof(*wb), gfp);
+	if (!wb)
+		return NULL;
+
+	if (wb_init(wb, bdi))
+		goto out_free;
+
+	wb->memcg_id = memcg_id;
+	atomic_set(&wb->refcnt, 1);	/* the tree's, dropped on offline */
+	INIT_WORK(&wb->release_work, cgwb_release_workfn);
+
+	if (radix_tree_preload(gfp))
+		goto out_exit;
+
+	/*
+	 * If the memcg went away in the meantime, the wb stays until the
+	 * bdi is destroyed.  It is found by css_id only, which isn't
+	 * reused before the memcg is freed, and a memcg reusing the id
+	 * later can just as well use it.
+	 */
+	spin_lock(&cgwb_lock);
+	ret = radix_tree_insert(&bdi->cgwb_tree, memcg_id, wb);
+	if (!ret) {
+		list_add_tail_rcu(&wb->bdi_node, &bdi->wb_list);
+		wb_get(wb);
 	}
+	spin_unlock(&cgwb_lock);
+	radix_tree_preload_end();
+
+	if (!ret)
+		return wb;
+
+	/* lost the race against another creator */
+	wb_exit(wb);
+	kfree(wb);
+	return wb_get_lookup(bdi, memcg_id);
+
+out_exit:
+	wb_exit(wb);
+out_free:
+	kfree(wb);
+	return NULL;
+}
 
-	bdi->dirty_exceeded = 0;
+/**
+ * bdi_next_wb - iterate over the wbs of a bdi
+ * @bdi: the bdi of interest
+ * @prev: the previous wb, NULL to start with the root wb
+ *
+ * Returns the referenced next wb of @bdi after @prev, or NULL at the end.
+ * The reference on @prev is dropped.  Doesn't sleep.
+ */
+struct bdi_writeback *bdi_next_wb(struct backing_dev_info *bdi,
+				  struct bdi_writeback *prev)
+{
+	struct bdi_writeback *wb;
+
+	rcu_read_lock();
+	wb = prev ?: list_entry(&bdi->wb_list, struct bdi_writeback, bdi_node);
+	list_for_each_entry_continue_rcu(wb, &bdi->wb_list, bdi_node)
+		if (wb_tryget(wb))
+			goto out;
+	wb = NULL;
+out:
+	rcu_read_unlock();
 
-	bdi->bw_time_stamp = jiffies;
-	bdi->written_stamp = 0;
+	if (prev)
+		wb_put(prev);
+	return wb;
+}
 
-	bdi->balanced_dirty_ratelimit = INIT_BW;
-	bdi->dirty_ratelimit = INIT_BW;
-	bdi->write_bandwidth = INIT_BW;
-	bdi->avg_write_bandwidth = INIT_BW;
+static void cgwb_kill(struct backing_dev_info *bdi, unsigned short memcg_id)
+{
+	struct bdi_writeback *wb;
 
-	err = fprop_local_init_percpu(&bdi->completions);
+	spin_lock(&cgwb_lock);
+	wb = radix_tree_delete(&bdi->cgwb_tree, memcg_id);
+	spin_unlock(&cgwb_lock);
 
-	if (err) {
-err:
-		while (i--)
-			percpu_counter_destroy(&bdi->bdi_stat[i]);
+	if (wb) {
+		/* makes writeback move its inodes elsewhere */
+		wb->offline = true;
+		wb_put(wb);
 	}
+}
 
-	return err;
+/**
+ * cgwb_memcg_offline - a memcg is being removed
+ * @memcg_id: css_id of the memcg
+ *
+ * Unlink the wbs of the memcg from all bdis.  They are freed once the
+ * inodes still associated with them have been switched away and all
+ * writeback on them is done.
+ */
+void cgwb_memcg_offline(unsigned short memcg_id)
+{
+	struct backing_dev_info *bdi;
+
+	if (!memcg_id)
+		return;
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(bdi, &bdi_list, bdi_list)
+		cgwb_kill(bdi, memcg_id);
+	rcu_read_unlock();
+}
+
+static void cgwb_bdi_init(struct backing_dev_info *bdi)
+{
+	INIT_RADIX_TREE(&bdi->cgwb_tree, GFP_ATOMIC);
+	INIT_LIST_HEAD(&bdi->wb_list);
+	list_add_rcu(&bdi->wb.bdi_node, &bdi->wb_list);
+}
+
+/*
+ * Kill all cgroup wbs of @bdi and wait for them to be released.  The
+ * filesystems on the bdi are gone by now, hence no inode should be left
+ * holding on to a wb.
+ */
+static void cgwb_bdi_destroy(struct backing_dev_info *bdi)
+{
+	struct radix_tree_iter iter;
+	void **slot;
+
+	rcu_read_lock();
+	radix_tree_for_each_slot(slot, &bdi->cgwb_tree, &iter, 0) {
+		struct bdi_writeback *wb = *slot;
+
+		cgwb_kill(bdi, wb->memcg_id);
+	}
+	rcu_read_unlock();
+
+	wait_event(cgwb_release_wait, list_is_singular(&bdi->wb_list));
+}
+
+#else	/* CONFIG_CGROUP_WRITEBACK */
+
+static void cgwb_bdi_init(struct backing_dev_info *bdi)
+{
+}
+
+static void cgwb_bdi_destroy(struct backing_dev_info *bdi)
+{
+}
+
+#endif	/* CONFIG_CGROUP_WRITEBACK */
+
+int bdi_init(struct backing_dev_info *bdi)
+{
+	int err;
+
+	bdi->dev = NULL;
+
+	bdi->min_ratio = 0;
+	bdi->max_ratio = 100;
+	bdi->max_prop_frac = FPROP_FRAC_BASE;
+	spin_lock_init(&bdi->wb_lock);
+	INIT_LIST_HEAD(&bdi->bdi_list);
+	INIT_LIST_HEAD(&bdi->work_list);
+
+	err = wb_init(&bdi->wb, bdi);
+	if (err)
+		return err;
+
+	cgwb_bdi_init(bdi);
+	return 0;
 }
 EXPORT_SYMBOL(bdi_init);
 
 void bdi_destroy(struct backing_dev_info *bdi)
 {
-	int i;
-
 	/*
 	 * Splice our entries to the default_backing_dev_info, if this
 	 * bdi disappears
 	 */
-	if (bdi_has_dirty_io(bdi)) {
+	if (wb_has_dirty_io(&bdi->wb)) {
 		struct bdi_writeback *dst = &default_backing_dev_info.wb;
 
 		bdi_lock_two(&bdi->wb, dst);
@@ -680,19 +942,15 @@ void bdi_destroy(struct backing_dev_info *bdi)
 	}
 
 	bdi_unregister(bdi);
+	cgwb_bdi_destroy(bdi);
 
 	/*
 	 * If bdi_unregister() had already been called earlier, the
 	 * wakeup_timer could still be armed because bdi_prune_sb()
 	 * can race with the bdi_wakeup_thread_delayed() calls from
-	 * __mark_inode_dirty().
+	 * __mark_inode_dirty().  wb_exit() takes care of it.
 	 */
-	del_timer_sync(&bdi->wb.wakeup_timer);
-
-	for (i = 0; i < NR_BDI_STAT_ITEMS; i++)
-		percpu_counter_destroy(&bdi->bdi_stat[i]);
-
-	fprop_local_destroy_percpu(&bdi->completions);
+	wb_exit(&bdi->wb);
 }
 EXPORT_SYMBOL(bdi_destroy);
 
@@ -131,6 +131,9 @@ struct compact_control {
 	int migratetype;		/* MOVABLE, RECLAIMABLE etc */
 	struct zone *zone;
 	bool *contended;		/* True if a lock was contended */
+	bool proactive;			/* Stop once the zone's fragmentation
+					   score is below the low watermark */
+	unsigned long nr_migrated;	/* Pages migrated by this run */
 };
 
 unsigned long
@@ -336,6 +339,30 @@ static inline void mminit_validate_memmodel_limits(unsigned long *start_pfn,
 }
 #endif /* CONFIG_SPARSEMEM */
 
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+/*
+ * struct pages of @nid from this pfn on are initialised and freed by
+ * deferred_init_memmap() instead of free_all_bootmem().
+ */
+static inline unsigned long deferred_init_pfn(int nid)
+{
+	if (nid < 0 || nid >= MAX_NUMNODES)
+		return ULONG_MAX;
+	return NODE_DATA(nid)->first_deferred_pfn;
+}
+
+extern void reserve_bootmem_region(phys_addr_t start, phys_addr_t end);
+#else
+static inline unsigned long deferred_init_pfn(int nid)
+{
+	return ULONG_MAX;
+}
+
+static inline void reserve_bootmem_region(phys_addr_t start, phys_addr_t end)
+{
+}
+#endif
+
 #define ZONE_RECLAIM_NOSCAN	-2
 #define ZONE_RECLAIM_FULL	-1
 #define ZONE_RECLAIM_SOME	0
@@ -50,6 +50,7 @@
 #include <linux/cpu.h>
 #include <linux/oom.h>
 #include "internal.h"
+#include "slab.h"
 #include <net/sock.h>
 #include <net/tcp_memcontrol.h>
 
@@ -329,6 +330,16 @@ struct mem_cgroup {
 #ifdef CONFIG_INET
 	struct tcp_memcontrol tcp_mem;
 #endif
+#ifdef CONFIG_MEMCG_KMEM
+	/* the counter to account for kernel memory (slab) usage */
+	struct res_counter kmem;
+	/* KMEM_ACCOUNTED_* bits */
+	unsigned long kmem_account_flags;
+	/* index into the per-memcg cache arrays of the root caches */
+	int kmemcg_id;
+	/* per-memcg copies of slab caches, under memcg_slab_mutex */
+	struct list_head memcg_slab_caches;
+#endif
 };
 
 /* Stuffs for move charges at task migration. */
@@ -388,6 +399,7 @@ enum charge_type {
 #define _MEM			(0)
 #define _MEMSWAP		(1)
 #define _OOM_TYPE		(2)
+#define _KMEM			(3)
 #define MEMFILE_PRIVATE(x, val)	((x) << 16 | (val))
 #define MEMFILE_TYPE(val)	((val) >> 16 & 0xffff)
 #define MEMFILE_ATTR(val)	((val) & 0xffff)
@@ -2632,6 +2644,638 @@ static void __mem_cgroup_commit_charge(struct mem_cgroup *memcg,
 	memcg_check_events(memcg, page);
 }
 
+#ifdef CONFIG_MEMCG_KMEM
+/*
+ * Kernel memory (slab) accounting.
+ *
+ * Nothing is accounted until a kmem limit is written for the first time;
+ * that gives the memcg a kmem id and from then on its tasks allocate from
+ * per-memcg copies of the slab caches, made on demand and charged page by
+ * page to both memory.kmem and memory. Children created under an active
+ * memcg inherit the accounting. When the memcg goes away its copies are
+ * destroyed as soon as their last page has been freed.
+ */
+struct static_key memcg_kmem_enabled_key;
+EXPORT_SYMBOL(memcg_kmem_enabled_key);
+
+/* kmem ids, used to index the per-memcg cache arrays */
+static DEFINE_IDA(kmem_limited_groups);
+#define MEMCG_CACHES_MIN_SIZE	4
+#define MEMCG_CACHES_MAX_SIZE	65535
+
+/* Number of slots in the arrays of root caches; grows with the ids */
+static int memcg_limited_groups_array_size;
+
+/*
+ * Protects the per-memcg cache arrays of the root caches, the lists of
+ * copies hanging off each memcg and memcg_limited_groups_array_size.
+ * Nests inside slab_mutex.
+ */
+static DEFINE_MUTEX(memcg_slab_mutex);
+
+/* Serializes kmem limit updates against each other */
+static DEFINE_MUTEX(activate_kmem_mutex);
+
+/* Copies are created here, outside of the allocating context */
+static struct workqueue_struct *memcg_cache_create_wq;
+
+/* How often an orphaned copy that still has objects is shrunk */
+#define MEMCG_CACHE_SHRINK_DELAY	(5 * HZ)
+
+enum {
+	KMEM_ACCOUNTED_ACTIVE = 0, /* kmem limit set, slab is accounted */
+};
+
+bool memcg_kmem_is_active(struct mem_cgroup *memcg)
+{
+	return memcg && test_bit(KMEM_ACCOUNTED_ACTIVE,
+				 &memcg->kmem_account_flags);
+}
+
+static inline int memcg_cache_id(struct mem_cgroup *memcg)
+{
+	return memcg->kmemcg_id;
+}
+
+static u64 memcg_kmem_usage(struct mem_cgroup *memcg)
+{
+	return res_counter_read_u64(&memcg->kmem, RES_USAGE);
+}
+
+/*
+ * Allocations made while handling accounting itself must not be
+ * accounted again.
+ */
+static inline void memcg_stop_kmem_account(void)
+{
+	VM_BUG_ON(!current->mm);
+	current->memcg_kmem_skip_account++;
+}
+
+static inline void memcg_resume_kmem_account(void)
+{
+	VM_BUG_ON(!current->mm);
+	current->memcg_kmem_skip_account--;
+}
+
+static unsigned long memcg_shrink_kmem(struct mem_cgroup *memcg, gfp_t gfp)
+{
+	struct shrink_control shrink = {
+		.gfp_mask = gfp,
+		.target_mem_cgroup = memcg,
+	};
+	unsigned long lru_pages, freed;
+
+	/*
+	 * Slab is reclaimed in proportion to the LRU pages scanned; pretend
+	 * we went through a quarter of them to get a good chunk back.
+	 */
+	lru_pages = mem_cgroup_nr_lru_pages(memcg, LRU_ALL) + 1;
+	memcg_stop_kmem_account();
+	freed = shrink_slab(&shrink, lru_pages / 4 + SWAP_CLUSTER_MAX,
+			    lru_pages);
+	memcg_resume_kmem_account();
+	return freed;
+}
+
+static int memcg_charge_kmem(struct mem_cgroup *memcg, gfp_t gfp, u64 size)
+{
+	struct res_counter *fail_res;
+	struct mem_cgroup *_memcg;
+	int nr_retries = MEM_CGROUP_RECLAIM_RETRIES;
+	int ret;
+
+	while ((ret = res_counter_charge(&memcg->kmem, size, &fail_res))) {
+		struct mem_cgroup *over_limit;
+
+		/*
+		 * Over the kmem limit. Dentries and inodes are what pins most
+		 * kernel memory, so try to shrink them before failing.
+		 */
+		if (!(gfp & __GFP_WAIT) || !nr_retries--)
+			return ret;
+		over_limit = mem_cgroup_from_res_counter(fail_res, kmem);
+		if (!memcg_shrink_kmem(over_limit, gfp))
+			nr_retries = 0;
+	}
+
+	_memcg = memcg;
+	ret = __mem_cgroup_try_charge(NULL, gfp, size >> PAGE_SHIFT, &_memcg,
+				      (gfp & __GFP_FS) && !(gfp & __GFP_NORETRY));
+	if (ret == -EINTR) {
+		/*
+		 * The task is dying and was let through. The allocation will
+		 * succeed anyway, so charge it without limits rather than
+		 * have the page unaccounted when it is freed.
+		 */
+		res_counter_charge_nofail(&memcg->res, size, &fail_res);
+		if (do_swap_account)
+			res_counter_charge_nofail(&memcg->memsw, size,
+						  &fail_res);
+		ret = 0;
+	} else if (ret)
+		res_counter_uncharge(&memcg->kmem, size);
+
+	return ret;
+}
+
+static void memcg_uncharge_kmem(struct mem_cgroup *memcg, u64 size)
+{
+	res_counter_uncharge(&memcg->res, size);
+	if (do_swap_account)
+		res_counter_uncharge(&memcg->memsw, size);
+	res_counter_uncharge(&memcg->kmem, size);
+}
+
+int __memcg_charge_slab(struct kmem_cache *s, gfp_t gfp, int order)
+{
+	struct memcg_cache_params *params = s->memcg_params;
+	int ret;
+
+	ret = memcg_charge_kmem(params->memcg, gfp, PAGE_SIZE << order);
+	if (!ret)
+		atomic_add(1 << order, &params->nr_pages);
+	return ret;
+}
+
+void __memcg_uncharge_slab(struct kmem_cache *s, int order)
+{
+	struct memcg_cache_params *params = s->memcg_params;
+
+	memcg_uncharge_kmem(params->memcg, PAGE_SIZE << order);
+	atomic_sub(1 << order, &params->nr_pages);
+}
+
+/*
+ * Does @obj live in a cache of @memcg or one of its children? Objects from
+ * root caches are not charged to anyone and belong to nobody.
+ */
+bool __memcg_kmem_owns(struct mem_cgroup *memcg, const void *obj)
+{
+	struct kmem_cache *s = slab_cache_of(obj);
+
+	if (!s || is_root_cache(s))
+		return false;
+	return mem_cgroup_same_or_subtree(memcg, s->memcg_params->memcg);
+}
+
+/*
+ * Shrink the slab objects charged to @memcg, called from memcg reclaim
+ * after @nr_scanned of its LRU pages have been scanned.
+ */
+void memcg_shrink_slab(struct mem_cgroup *memcg, struct shrink_control *shrink,
+		       unsigned long nr_scanned)
+{
+	shrink->target_mem_cgroup = memcg;
+	shrink_slab(shrink, nr_scanned,
+		    mem_cgroup_nr_lru_pages(memcg, LRU_ALL));
+	shrink->target_mem_cgroup = NULL;
+}
+
+/* Grow the per-memcg array of root cache @s to @num slots */
+static int memcg_update_cache_size(struct kmem_cache *s, int num)
+{
+	struct memcg_cache_params *cur = s->memcg_params, *new;
+
+	if (!is_root_cache(s))
+		return 0;
+	if (cur && cur->nr_caches >= num)
+		return 0;
+
+	new = kzalloc(sizeof(*new) + num * sizeof(struct kmem_cache *),
+		      GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+
+	new->is_root_cache = true;
+	new->nr_caches = num;
+	if (cur)
+		memcpy(new->memcg_caches, cur->memcg_caches,
+		       cur->nr_caches * sizeof(struct kmem_cache *));
+
+	/* __memcg_kmem_get_cache() looks at the array under RCU only */
+	rcu_assign_pointer(s->memcg_params, new);
+	if (cur)
+		kfree_rcu(cur, rcu_head);
+	return 0;
+}
+
+/* Make sure every root cache has a slot for kmem id @num_groups - 1 */
+static int memcg_update_all_caches(int num_groups)
+{
+	struct kmem_cache *s;
+	int size, ret = 0;
+
+	mutex_lock(&slab_mutex);
+	mutex_lock(&memcg_slab_mutex);
+
+	if (num_groups <= memcg_limited_groups_array_size)
+		goto out;
+
+	size = max(2 * num_groups, MEMCG_CACHES_MIN_SIZE);
+	size = min(size, MEMCG_CACHES_MAX_SIZE);
+
+	list_for_each_entry(s, &slab_caches, list) {
+		ret = memcg_update_cache_size(s, size);
+		if (ret)
+			goto out;
+	}
+	memcg_limited_groups_array_size = size;
+out:
+	mutex_unlock(&memcg_slab_mutex);
+	mutex_unlock(&slab_mutex);
+	return ret;
+}
+
+/*
+ * Give @memcg a kmem id and room in every root cache. The caller flips
+ * memcg_kmem_enabled_key afterwards, outside of cgroup_mutex where it can.
+ */
+static int __memcg_activate_kmem(struct mem_cgroup *memcg,
+				 unsigned long long limit)
+{
+	int id, err;
+
+	id = ida_simple_get(&kmem_limited_groups, 0, MEMCG_CACHES_MAX_SIZE,
+			    GFP_KERNEL);
+	if (id < 0)
+		return id;
+
+	err = memcg_update_all_caches(id + 1);
+	if (err) {
+		ida_simple_remove(&kmem_limited_groups, id);
+		return err;
+	}
+
+	err = res_counter_set_limit(&memcg->kmem, limit);
+	VM_BUG_ON(err);
+
+	memcg->kmemcg_id = id;
+	/* publish the id before anyone can see the group as active */
+	smp_wmb();
+	set_bit(KMEM_ACCOUNTED_ACTIVE, &memcg->kmem_account_flags);
+	return 0;
+}
+
+static int memcg_update_kmem_limit(struct mem_cgroup *memcg,
+				   unsigned long long val)
+{
+	struct cgroup *cont = memcg->css.cgroup;
+	int ret = 0;
+
+	mutex_lock(&activate_kmem_mutex);
+	if (memcg_kmem_is_active(memcg) || val == RESOURCE_MAX) {
+		ret = res_counter_set_limit(&memcg->kmem, val);
+		goto out;
+	}
+
+	if (!memcg_cache_create_wq) {
+		memcg_cache_create_wq =
+			alloc_ordered_workqueue("memcg_cache_create", 0);
+		if (!memcg_cache_create_wq) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	/*
+	 * Objects allocated before accounting started were never charged
+	 * and could not be uncharged properly, so accounting can only be
+	 * switched on while the group is still empty.
+	 */
+	cgroup_lock();
+	if (cgroup_task_count(cont) || !list_empty(&cont->children))
+		ret = -EBUSY;
+	else
+		ret = __memcg_activate_kmem(memcg, val);
+	cgroup_unlock();
+
+	/*
+	 * static_key_slow_inc() takes get_online_cpus(), which must not
+	 * nest inside cgroup_mutex. The key is dropped again when the
+	 * mem_cgroup is freed, see disarm_kmem_keys().
+	 */
+	if (!ret)
+		static_key_slow_inc(&memcg_kmem_enabled_key);
+out:
+	mutex_unlock(&activate_kmem_mutex);
+	return ret;
+}
+
+/*
+ * Called with cgroup_mutex held when @memcg is created: children of an
+ * accounted group are accounted as well. The parent holds a reference on
+ * memcg_kmem_enabled_key already, so taking another one is cheap.
+ */
+static int memcg_propagate_kmem(struct mem_cgroup *memcg)
+{
+	struct mem_cgroup *parent = parent_mem_cgroup(memcg);
+	int ret;
+
+	if (!memcg_kmem_is_active(parent))
+		return 0;
+
+	ret = __memcg_activate_kmem(memcg, RESOURCE_MAX);
+	if (!ret)
+		static_key_slow_inc(&memcg_kmem_enabled_key);
+	return ret;
+}
+
+static void disarm_kmem_keys(struct mem_cgroup *memcg)
+{
+	if (memcg_kmem_is_active(memcg)) {
+		static_key_slow_dec(&memcg_kmem_enabled_key);
+		ida_simple_remove(&kmem_limited_groups, memcg->kmemcg_id);
+	}
+}
+
+/*
+ * Destroy an orphaned per-memcg copy once all of its slab pages are gone.
+ * Until then, keep handing back whatever slabs became empty.
+ */
+static void memcg_cache_destroy_func(struct work_struct *w)
+{
+	struct memcg_cache_params *params;
+	struct kmem_cache *cachep, *root;
+	int id;
+
+	params = container_of(to_delayed_work(w), struct memcg_cache_params,
+			      destroy);
+	cachep = params->cachep;
+
+	if (atomic_read(&params->nr_pages)) {
+		kmem_cache_shrink(cachep);
+		schedule_delayed_work(&params->destroy,
+				      MEMCG_CACHE_SHRINK_DELAY);
+		return;
+	}
+
+	/*
+	 * Whoever takes the copy out of the root's array gets to destroy
+	 * it; kmem_cache_destroy_memcg_children() may race with us.
+	 */
+	root = params->root_cache;
+	id = memcg_cache_id(params->memcg);
+	mutex_lock(&memcg_slab_mutex);
+	if (root->memcg_params->memcg_caches[id] != cachep) {
+		mutex_unlock(&memcg_slab_mutex);
+		return;
+	}
+	root->memcg_params->memcg_caches[id] = NULL;
+	mutex_unlock(&memcg_slab_mutex);
+
+	kmem_cache_destroy(cachep);
+}
+
+/* The memcg is going away; its copies follow once they are empty */
+static void memcg_destroy_kmem_caches(struct mem_cgroup *memcg)
+{
+	struct memcg_cache_params *params;
+
+	if (!memcg_kmem_is_active(memcg))
+		return;
+
+	mutex_lock(&memcg_slab_mutex);
+	list_for_each_entry(params, &memcg->memcg_slab_caches, list)
+		schedule_delayed_work(&params->destroy, 0);
+	mutex_unlock(&memcg_slab_mutex);
+}
+
+/*
+ * Called by the slab allocators, with slab_mutex held, for every cache
+ * they create. @memcg is NULL for root caches.
+ */
+int memcg_register_cache(struct mem_cgroup *memcg, struct kmem_cache *s,
+			 struct kmem_cache *root_cache)
+{
+	struct memcg_cache_params *params;
+
+	if (!memcg) {
+		int ret = 0;
+
+		/* A root cache made after accounting started needs its array */
+		mutex_lock(&memcg_slab_mutex);
+		if (memcg_limited_groups_array_size)
+			ret = memcg_update_cache_size(s,
+					memcg_limited_groups_array_size);
+		mutex_unlock(&memcg_slab_mutex);
+		return ret;
+	}
+
+	params = kzalloc(sizeof(*params), GFP_KERNEL);
+	if (!params)
+		return -ENOMEM;
+
+	params->memcg = memcg;
+	params->root_cache = root_cache;
+	params->cachep = s;
+	INIT_LIST_HEAD(&params->list);
+	INIT_DELAYED_WORK(&params->destroy, memcg_cache_destroy_func);
+	s->memcg_params = params;
+	mem_cgroup_get(memcg);
+	return 0;
+}
+
+/* Counterpart of memcg_register_cache(), called when a cache is destroyed */
+void memcg_release_cache(struct kmem_cache *s)
+{
+	struct memcg_cache_params *params = s->memcg_params;
+
+	if (!params)
+		return;
+
+	s->memcg_params = NULL;
+	if (!params->is_root_cache) {
+		mutex_lock(&memcg_slab_mutex);
+		list_del(&params->list);
+		mutex_unlock(&memcg_slab_mutex);
+		mem_cgroup_put(params->memcg);
+	}
+	kfree(params);
+}
+
+/* Root cache @s is being destroyed, take its per-memcg copies along */
+void kmem_cache_destroy_memcg_children(struct kmem_cache *s)
+{
+	struct kmem_cache *c;
+	int i;
+
+	if (!s->memcg_params || !s->memcg_params->is_root_cache)
+		return;
+
+	/* no copies of @s may be in the making */
+	if (memcg_cache_create_wq)
+		flush_workqueue(memcg_cache_create_wq);
+
+	for (;;) {
+		c = NULL;
+		mutex_lock(&memcg_slab_mutex);
+		for (i = 0; i < s->memcg_params->nr_caches; i++) {
+			c = s->memcg_params->memcg_caches[i];
+			if (c) {
+				s->memcg_params->memcg_caches[i] = NULL;
+				break;
+			}
+		}
+		mutex_unlock(&memcg_slab_mutex);
+		if (!c)
+			break;
+
+		cancel_delayed_work_sync(&c->memcg_params->destroy);
+		kmem_cache_destroy(c);
+	}
+}
+
+struct create_work {
+	struct mem_cgroup *memcg;
+	struct kmem_cache *cachep;
+	struct work_struct work;
+};
+
+static void memcg_create_kmem_cache(struct mem_cgroup *memcg,
+				    struct kmem_cache *cachep)
+{
+	struct kmem_cache *new_cachep;
+	int id = memcg_cache_id(memcg);
+	char *name;
+
+	mutex_lock(&memcg_slab_mutex);
+	new_cachep = cachep->memcg_params->memcg_caches[id];
+	mutex_unlock(&memcg_slab_mutex);
+	if (new_cachep)
+		return;
+
+	rcu_read_lock();
+	name = kasprintf(GFP_ATOMIC, "%s(%d:%s)", cachep->name, id,
+			 rcu_dereference(memcg->css.cgroup->dentry)->d_name.name);
+	rcu_read_unlock();
+	if (!name)
+		return;
+
+	new_cachep = kmem_cache_create_memcg(memcg, name, cachep->object_size,
+					     cachep->align,
+					     cachep->flags & ~SLAB_PANIC,
+					     cachep->ctor, cachep);
+	kfree(name);
+	if (!new_cachep)
+		return;
+
+	mutex_lock(&memcg_slab_mutex);
+	if (!cachep->memcg_params->memcg_caches[id] &&
+	    !css_is_removed(&memcg->css)) {
+		list_add(&new_cachep->memcg_params->list,
+			 &memcg->memcg_slab_caches);
+		/* the copy must be fully set up before it can be found */
+		smp_wmb();
+		cachep->memcg_params->memcg_caches[id] = new_cachep;
+		new_cachep = NULL;
+	}
+	mutex_unlock(&memcg_slab_mutex);
+
+	/* lost a race against another creator or against memcg removal */
+	if (new_cachep)
+		kmem_cache_destroy(new_cachep);
+}
+
+static void memcg_create_cache_work_func(struct work_struct *w)
+{
+	struct create_work *cw = container_of(w, struct create_work, work);
+
+	memcg_create_kmem_cache(cw->memcg, cw->cachep);
+	css_put(&cw->memcg->css);
+	kfree(cw);
+}
+
+/*
+ * Called with rcu_read_lock() held, from allocation context: creating the
+ * copy right here could recurse or sleep, so leave it to a worker. The
+ * allocation that triggered it goes to the root cache, unaccounted.
+ */
+static void memcg_create_cache_enqueue(struct mem_cgroup *memcg,
+				       struct kmem_cache *cachep)
+{
+	struct create_work *cw;
+
+	if (!css_tryget(&memcg->css))
+		return;
+
+	memcg_stop_kmem_account();
+	cw = kmalloc(sizeof(*cw), GFP_NOWAIT);
+	memcg_resume_kmem_account();
+	if (!cw) {
+		css_put(&memcg->css);
+		return;
+	}
+
+	cw->memcg = memcg;
+	cw->cachep = cachep;
+	INIT_WORK(&cw->work, memcg_create_cache_work_func);
+	queue_work(memcg_cache_create_wq, &cw->work);
+}
+
+/*
+ * Return the copy of root cache @cachep the current task has to allocate
+ * from, or @cachep itself when the allocation is not to be accounted.
+ */
+struct kmem_cache *__memcg_kmem_get_cache(struct kmem_cache *cachep,
+					  gfp_t gfp)
+{
+	struct memcg_cache_params *params;
+	struct kmem_cache *memcg_cachep;
+	struct mem_cgroup *memcg;
+	int id;
+
+	/*
+	 * Interrupts and kernel threads don't run on behalf of a memcg,
+	 * __GFP_NOFAIL allocations can't be refused by the kmem limit.
+	 */
+	if (in_interrupt() || !current->mm || (current->flags & PF_KTHREAD))
+		return cachep;
+	if (current->memcg_kmem_skip_account || (gfp & __GFP_NOFAIL))
+		return cachep;
+	if (!is_root_cache(cachep))
+		return cachep;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_task(current);
+	if (!memcg || mem_cgroup_is_root(memcg) || !memcg_kmem_is_active(memcg))
+		goto out;
+
+	smp_rmb();
+	id = memcg_cache_id(memcg);
+	params = rcu_dereference(cachep->memcg_params);
+	if (unlikely(id >= params->nr_caches))
+		goto out;
+
+	memcg_cachep = ACCESS_ONCE(params->memcg_caches[id]);
+	if (likely(memcg_cachep)) {
+		smp_read_barrier_depends();
+		cachep = memcg_cachep;
+		goto out;
+	}
+
+	memcg_create_cache_enqueue(memcg, cachep);
+out:
+	rcu_read_unlock();
+	return cachep;
+}
+#else
+static inline u64 memcg_kmem_usage(struct mem_cgroup *memcg)
+{
+	return 0;
+}
+
+static inline int memcg_update_kmem_limit(struct mem_cgroup *memcg,
+					  unsigned long long val)
+{
+	return -EINVAL;
+}
+
+static void disarm_kmem_keys(struct mem_cgroup *memcg)
+{
+}
+#endif /* CONFIG_MEMCG_KMEM */
+
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 
 #define PCGF_NOCOPY_AT_SPLIT (1 << PCG_LOCK | 1 << PCG_MIGRATION)
@@ -3815,7 +4459,9 @@ move_account:
 		memcg_oom_recover(memcg);
 		cond_resched();
 	/* "ret" should also be checked to ensure all lists are empty. */
-	} while (res_counter_read_u64(&memcg->res, RES_USAGE) > 0 || ret);
+	/* slab pages are charged to res as well but are not on the LRU */
+	} while (res_counter_read_u64(&memcg->res, RES_USAGE) >
+		 memcg_kmem_usage(memcg) || ret);
 out:
 	css_put(&memcg->css);
 	return ret;
@@ -3830,7 +4476,8 @@ try_to_free:
 	lru_add_drain_all();
 	/* try to free all pages in this cgroup */
 	shrink = 1;
-	while (nr_retries && res_counter_read_u64(&memcg->res, RES_USAGE) > 0) {
+	while (nr_retries && res_counter_read_u64(&memcg->res, RES_USAGE) >
+			    memcg_kmem_usage(memcg)) {
 		int progress;
 
 		if (signal_pending(current)) {
@@ -3965,6 +4612,11 @@ static ssize_t mem_cgroup_read(struct cgroup *cont, struct cftype *cft,
 		else
 			val = res_counter_read_u64(&memcg->memsw, name);
 		break;
+#ifdef CONFIG_MEMCG_KMEM
+	case _KMEM:
+		val = res_counter_read_u64(&memcg->kmem, name);
+		break;
+#endif
 	default:
 		BUG();
 	}
@@ -4002,8 +4654,12 @@ static int mem_cgroup_write(struct cgroup *cont, struct cftype *cft,
 			break;
 		if (type == _MEM)
 			ret = mem_cgroup_resize_limit(memcg, val);
-		else
+		else if (type == _MEMSWAP)
 			ret = mem_cgroup_resize_memsw_limit(memcg, val);
+		else if (type == _KMEM)
+			ret = memcg_update_kmem_limit(memcg, val);
+		else
+			ret = -EINVAL;
 		break;
 	case RES_SOFT_LIMIT:
 		ret = res_counter_memparse_write_strategy(buffer, &val);
@@ -4053,6 +4709,118 @@ out:
 	*memsw_limit = min_memsw_limit;
 }
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+/*
+ * Writeback identifies memcgs by their css_id, 0 standing for the root
+ * memcg and for memcg being disabled.  See include/linux/backing-dev.h.
+ */
+static unsigned short mem_cgroup_wb_id(struct mem_cgroup *memcg)
+{
+	if (!memcg || mem_cgroup_is_root(memcg))
+		return 0;
+	return css_id(&memcg->css);
+}
+
+/* the memcg the current task dirties pages on behalf of */
+unsigned short mem_cgroup_wb_current_id(void)
+{
+	unsigned short id;
+
+	if (mem_cgroup_disabled())
+		return 0;
+
+	rcu_read_lock();
+	id = mem_cgroup_wb_id(mem_cgroup_from_task(current));
+	rcu_read_unlock();
+
+	return id;
+}
+
+/* the memcg @page is charged to */
+unsigned short mem_cgroup_wb_page_id(struct page *page)
+{
+	struct page_cgroup *pc;
+	unsigned short id = 0;
+
+	if (mem_cgroup_disabled())
+		return 0;
+
+	pc = lookup_page_cgroup(page);
+	if (unlikely(!pc))
+		return 0;
+
+	rcu_read_lock();
+	if (PageCgroupUsed(pc)) {
+		/* see __mem_cgroup_commit_charge() */
+		smp_rmb();
+		id = mem_cgroup_wb_id(pc->mem_cgroup);
+	}
+	rcu_read_unlock();
+
+	return id;
+}
+
+/**
+ * mem_cgroup_wb_domain - dirtyable memory of a memcg
+ * @id: memcg of interest
+ * @pavail: out parameter for the number of pages available to the memcg
+ *
+ * The dirty limits of a memcg are based on the memory available to it
+ * for the page cache: the file pages it has plus what it can still charge
+ * before hitting its (hierarchical) limit.  Returns %false if the memcg
+ * doesn't exist anymore or is not limited.
+ */
+bool mem_cgroup_wb_domain(unsigned short id, unsigned long *pavail)
+{
+	unsigned long long limit, memsw_limit;
+	struct mem_cgroup *memcg;
+	bool ret = false;
+	u64 usage;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_lookup(id);
+	if (memcg && !css_tryget(&memcg->css))
+		memcg = NULL;
+	rcu_read_unlock();
+	if (!memcg)
+		return false;
+
+	memcg_get_hierarchical_limit(memcg, &limit, &memsw_limit);
+	if (limit != RESOURCE_MAX) {
+		usage = mem_cgroup_usage(memcg, false);
+		*pavail = mem_cgroup_recursive_stat(memcg,
+					MEM_CGROUP_STAT_CACHE) +
+			  ((limit - min(limit, usage)) >> PAGE_SHIFT);
+		ret = true;
+	}
+
+	css_put(&memcg->css);
+	return ret;
+}
+
+/*
+ * The blkio cgroup the writeback IO of a memcg is issued on behalf of:
+ * the one of the same cgroup, if the controllers are co-mounted.
+ * Returns a referenced css or NULL.
+ */
+struct cgroup_subsys_state *mem_cgroup_wb_blkcg_css(unsigned short id)
+{
+	struct cgroup_subsys_state *css = NULL;
+	struct mem_cgroup *memcg;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_lookup(id);
+	if (memcg) {
+		css = memcg->css.cgroup->subsys[blkio_subsys_id];
+		if (css && !css_tryget(css))
+			css = NULL;
+	}
+	rcu_read_unlock();
+
+	return css;
+}
+#endif /* CONFIG_CGROUP_WRITEBACK */
+
 static int mem_cgroup_reset(struct cgroup *cont, unsigned int event)
 {
 	struct mem_cgroup *memcg = mem_cgroup_from_cont(cont);
@@ -4068,14 +4836,22 @@ static int mem_cgroup_reset(struct cgroup *cont, unsigned int event)
 	case RES_MAX_USAGE:
 		if (type == _MEM)
 			res_counter_reset_max(&memcg->res);
-		else
+		else if (type == _MEMSWAP)
 			res_counter_reset_max(&memcg->memsw);
+#ifdef CONFIG_MEMCG_KMEM
+		else if (type == _KMEM)
+			res_counter_reset_max(&memcg->kmem);
+#endif
 		break;
 	case RES_FAILCNT:
 		if (type == _MEM)
 			res_counter_reset_failcnt(&memcg->res);
-		else
+		else if (type == _MEMSWAP)
 			res_counter_reset_failcnt(&memcg->memsw);
+#ifdef CONFIG_MEMCG_KMEM
+		else if (type == _KMEM)
+			res_counter_reset_failcnt(&memcg->kmem);
+#endif
 		break;
 	}
 
@@ -4637,11 +5413,23 @@ static int mem_cgroup_oom_control_write(struct cgroup *cgrp,
 #ifdef CONFIG_MEMCG_KMEM
 static int memcg_init_kmem(struct mem_cgroup *memcg, struct cgroup_subsys *ss)
 {
+	struct mem_cgroup *parent = parent_mem_cgroup(memcg);
+	int ret;
+
+	memcg->kmemcg_id = -1;
+	INIT_LIST_HEAD(&memcg->memcg_slab_caches);
+	res_counter_init(&memcg->kmem, parent ? &parent->kmem : NULL);
+
+	ret = memcg_propagate_kmem(memcg);
+	if (ret)
+		return ret;
+
 	return mem_cgroup_sockets_init(memcg, ss);
 };
 
 static void kmem_cgroup_destroy(struct mem_cgroup *memcg)
 {
+	memcg_destroy_kmem_caches(memcg);
 	mem_cgroup_sockets_destroy(memcg);
 }
 #else
@@ -4718,6 +5506,31 @@ static struct cftype mem_cgroup_files[] = {
 		.unregister_event = mem_cgroup_oom_unregister_event,
 		.private = MEMFILE_PRIVATE(_OOM_TYPE, OOM_CONTROL),
 	},
+#ifdef CONFIG_MEMCG_KMEM
+	{
+		.name = "kmem.limit_in_bytes",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_LIMIT),
+		.write_string = mem_cgroup_write,
+		.read = mem_cgroup_read,
+	},
+	{
+		.name = "kmem.usage_in_bytes",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_USAGE),
+		.read = mem_cgroup_read,
+	},
+	{
+		.name = "kmem.failcnt",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_FAILCNT),
+		.trigger = mem_cgroup_reset,
+		.read = mem_cgroup_read,
+	},
+	{
+		.name = "kmem.max_usage_in_bytes",
+		.private = MEMFILE_PRIVATE(_KMEM, RES_MAX_USAGE),
+		.trigger = mem_cgroup_reset,
+		.read = mem_cgroup_read,
+	},
+#endif
 #ifdef CONFIG_NUMA
 	{
 		.name = "numa_stat",
@@ -4840,6 +5653,7 @@ static void free_work(struct work_struct *work)
 	 * the cgroup_lock.
 	 */
 	disarm_sock_keys(memcg);
+	disarm_kmem_keys(memcg);
 	if (size < PAGE_SIZE)
 		kfree(memcg);
 	else
@@ -5046,6 +5860,9 @@ static void mem_cgroup_destroy(struct cgroup *cont)
 
 	kmem_cgroup_destroy(memcg);
 
+#ifdef CONFIG_CGROUP_WRITEBACK
+	cgwb_memcg_offline(css_id(&memcg->css));
+#endif
 	mem_cgroup_put(memcg);
 }
 
@@ -105,8 +105,12 @@ static void __init __free_pages_memory(unsigned long start, unsigned long end)
 		__free_pages_bootmem(pfn_to_page(i), 0);
 }
 
+/*
+ * Pages from @deferred_pfn on have no struct page yet, they are counted
+ * here but freed by deferred_init_memmap().
+ */
 static unsigned long __init __free_memory_core(phys_addr_t start,
-				 phys_addr_t end)
+				 phys_addr_t end, unsigned long deferred_pfn)
 {
 	unsigned long start_pfn = PFN_UP(start);
 	unsigned long end_pfn = min_t(unsigned long,
@@ -115,7 +119,8 @@ static unsigned long __init __free_memory_core(phys_addr_t start,
 	if (start_pfn > end_pfn)
 		return 0;
 
-	__free_pages_memory(start_pfn, end_pfn);
+	__free_pages_memory(start_pfn,
+			    clamp(deferred_pfn, start_pfn, end_pfn));
 
 	return end_pfn - start_pfn;
 }
@@ -125,14 +130,21 @@ unsigned long __init free_low_memory_core_early(int nodeid)
 	unsigned long count = 0;
 	phys_addr_t start, end, size;
 	u64 i;
+	int nid;
+
+	/* reserved pages are handed out before the deferred init runs */
+	for (i = 0; i < memblock.reserved.cnt; i++)
+		reserve_bootmem_region(memblock.reserved.regions[i].base,
+				       memblock.reserved.regions[i].base +
+				       memblock.reserved.regions[i].size);
 
-	for_each_free_mem_range(i, MAX_NUMNODES, &start, &end, NULL)
-		count += __free_memory_core(start, end);
+	for_each_free_mem_range(i, MAX_NUMNODES, &start, &end, &nid)
+		count += __free_memory_core(start, end, deferred_init_pfn(nid));
 
 	/* free range that is used for reserved array if we allocate it */
 	size = get_allocated_memblock_reserved_regions_info(&start);
 	if (size)
-		count += __free_memory_core(start, start + size);
+		count += __free_memory_core(start, start + size, ULONG_MAX);
 
 	return count;
 }
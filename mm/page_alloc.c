@@ -22,6 +22,7 @@
 #include <linux/jiffies.h>
 #include <linux/bootmem.h>
 #include <linux/memblock.h>
+#include <linux/kthread.h>
 #include <linux/compiler.h>
 #include <linux/kernel.h>
 #include <linux/kmemcheck.h>
@@ -754,6 +755,278 @@ void __meminit __free_pages_bootmem(struct page *page, unsigned int order)
 	__free_pages(page, order);
 }
 
+static void __meminit __init_single_page(struct page *page, unsigned long pfn,
+				unsigned long zone, int nid)
+{
+	set_page_links(page, zone, nid, pfn);
+	mminit_verify_page_links(page, zone, nid, pfn);
+	init_page_count(page);
+	reset_page_mapcount(page);
+	SetPageReserved(page);
+	INIT_LIST_HEAD(&page->lru);
+#ifdef WANT_PAGE_VIRTUAL
+	/* The shift won't overflow because ZONE_NORMAL is below 4G. */
+	if (!is_highmem_idx(zone))
+		set_page_address(page, __va(pfn << PAGE_SHIFT));
+#endif
+}
+
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+/* Set once every node finished its deferred struct page init */
+static bool deferred_init_done __read_mostly;
+
+/* The highest populated zone of a node is the one that gets deferred */
+static struct zone *pgdat_deferred_zone(pg_data_t *pgdat)
+{
+	int zid;
+
+	for (zid = MAX_NR_ZONES - 1; zid >= 0; zid--) {
+		if (pgdat->node_zones[zid].spanned_pages)
+			return &pgdat->node_zones[zid];
+	}
+	return NULL;
+}
+
+/*
+ * Returns false once memmap_init_zone() has initialised enough of
+ * @pgdat, recording where the rest of it starts.
+ */
+static inline bool update_defer_init(pg_data_t *pgdat, unsigned long pfn,
+				unsigned long zone_end,
+				unsigned long *nr_initialised)
+{
+	/* Always populate low zones for address-constrained allocations */
+	if (zone_end < pgdat->node_start_pfn + pgdat->node_spanned_pages)
+		return true;
+
+	/* Initialise at least 2G of the highest zone */
+	(*nr_initialised)++;
+	if (*nr_initialised > (2UL << (30 - PAGE_SHIFT)) &&
+	    (pfn & (PAGES_PER_SECTION - 1)) == 0) {
+		pgdat->first_deferred_pfn = pfn;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Reserved memblock ranges inside the deferred part of a node are in use
+ * before deferred_init_memmap() runs, set up their struct pages right
+ * away.  The deferred init skips pages that are already initialised.
+ */
+void __init reserve_bootmem_region(phys_addr_t start, phys_addr_t end)
+{
+	unsigned long spfn, epfn, pfn;
+	int i, nid;
+
+	for_each_mem_pfn_range(i, MAX_NUMNODES, &spfn, &epfn, &nid) {
+		pg_data_t *pgdat = NODE_DATA(nid);
+		struct zone *zone = pgdat_deferred_zone(pgdat);
+
+		spfn = max3(spfn, (unsigned long)PFN_DOWN(start),
+			    pgdat->first_deferred_pfn);
+		epfn = min_t(unsigned long, epfn, PFN_UP(end));
+		for (pfn = spfn; pfn < epfn; pfn++) {
+			if (pfn_valid(pfn))
+				__init_single_page(pfn_to_page(pfn), pfn,
+						   zone_idx(zone), nid);
+		}
+	}
+}
+
+/* Hand a run of freshly initialised pages to the buddy allocator */
+static void __init deferred_free_range(unsigned long pfn,
+				       unsigned long nr_pages)
+{
+	struct page *page;
+
+	if (!nr_pages)
+		return;
+
+	page = pfn_to_page(pfn);
+
+	/* Free a large naturally-aligned chunk if possible */
+	if (nr_pages == MAX_ORDER_NR_PAGES &&
+	    (pfn & (MAX_ORDER_NR_PAGES - 1)) == 0) {
+		__free_pages_bootmem(page, MAX_ORDER - 1);
+		return;
+	}
+
+	for (; nr_pages--; page++)
+		__free_pages_bootmem(page, 0);
+}
+
+/*
+ * Initialise and free the struct pages of the next MAX_ORDER_NR_PAGES
+ * block of the deferred range of @pgdat, adding the number of pages
+ * freed to @nr_freed.  Returns false when there is nothing left to do.
+ *
+ * Called with the node's resize lock held, which keeps
+ * deferred_init_memmap() and deferred_grow_zone() off each other's
+ * blocks and lets the former know when all blocks have been done.
+ */
+static bool __init deferred_init_block(pg_data_t *pgdat,
+				       unsigned long *nr_freed)
+{
+	struct zone *zone = pgdat_deferred_zone(pgdat);
+	unsigned long node_end = pgdat->node_start_pfn +
+				 pgdat->node_spanned_pages;
+	unsigned long first = pgdat->first_deferred_pfn;
+	unsigned long last, spfn, epfn, pfn;
+	unsigned long free_base = 0, nr_free = 0;
+	int nid = pgdat->node_id;
+	int i;
+
+	if (first >= node_end)
+		return false;
+
+	last = min(ALIGN(first + 1, MAX_ORDER_NR_PAGES), node_end);
+	pgdat->first_deferred_pfn = last;
+
+	for_each_mem_pfn_range(i, nid, &spfn, &epfn, NULL) {
+		spfn = max(spfn, first);
+		epfn = min(epfn, last);
+
+		for (pfn = spfn; pfn < epfn; pfn++) {
+			struct page *page;
+
+			if (!pfn_valid(pfn))
+				continue;
+			page = pfn_to_page(pfn);
+
+			/* reserved pages were set up by reserve_bootmem_region() */
+			if (page->flags) {
+				deferred_free_range(free_base, nr_free);
+				nr_free = 0;
+			} else {
+				__init_single_page(page, pfn, zone_idx(zone),
+						   nid);
+				if (!nr_free)
+					free_base = pfn;
+				nr_free++;
+				(*nr_freed)++;
+			}
+
+			if (!(pfn & (pageblock_nr_pages - 1)))
+				set_pageblock_migratetype(page, MIGRATE_MOVABLE);
+		}
+
+		deferred_free_range(free_base, nr_free);
+		nr_free = 0;
+	}
+
+	return true;
+}
+
+static atomic_t pgdat_init_n_undone __initdata;
+static __initdata DECLARE_COMPLETION(pgdat_init_all_done_comp);
+
+/* Initialise the remaining struct pages of a node */
+static void __init deferred_init_memmap(pg_data_t *pgdat)
+{
+	unsigned long start = jiffies;
+	unsigned long nr_pages = 0;
+	unsigned long flags;
+	bool more;
+
+	do {
+		pgdat_resize_lock(pgdat, &flags);
+		more = deferred_init_block(pgdat, &nr_pages);
+		pgdat_resize_unlock(pgdat, &flags);
+		cond_resched();
+	} while (more);
+
+	printk(KERN_INFO "node %d initialised, %lu pages in %ums\n",
+	       pgdat->node_id, nr_pages, jiffies_to_msecs(jiffies - start));
+
+	if (atomic_dec_and_test(&pgdat_init_n_undone))
+		complete(&pgdat_init_all_done_comp);
+}
+
+static int __init deferred_init_memmap_thread(void *data)
+{
+	pg_data_t *pgdat = data;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	/* only the kthread is bound, the fallback runs on the init task */
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+
+	deferred_init_memmap(pgdat);
+	return 0;
+}
+
+/*
+ * An allocation ran short of memory before deferred_init_memmap() got
+ * through @zone.  Initialise at least a section more of it here.
+ */
+static bool __init deferred_grow_zone(struct zone *zone, unsigned int order)
+{
+	pg_data_t *pgdat = zone->zone_pgdat;
+	unsigned long nr_pages = 0;
+	unsigned long flags;
+	bool more = true;
+
+	if (zone != pgdat_deferred_zone(pgdat))
+		return false;
+
+	while (more && nr_pages < max(1UL << order, PAGES_PER_SECTION)) {
+		pgdat_resize_lock(pgdat, &flags);
+		more = deferred_init_block(pgdat, &nr_pages);
+		pgdat_resize_unlock(pgdat, &flags);
+	}
+
+	return nr_pages > 0;
+}
+
+/*
+ * deferred_grow_zone() is only called before deferred_init_done is set,
+ * long before the init sections are discarded.
+ */
+static bool __ref _deferred_grow_zone(struct zone *zone, unsigned int order)
+{
+	if (likely(deferred_init_done))
+		return false;
+	return deferred_grow_zone(zone, order);
+}
+#else
+static inline bool update_defer_init(pg_data_t *pgdat, unsigned long pfn,
+				unsigned long zone_end,
+				unsigned long *nr_initialised)
+{
+	return true;
+}
+
+static inline bool _deferred_grow_zone(struct zone *zone, unsigned int order)
+{
+	return false;
+}
+#endif /* CONFIG_DEFERRED_STRUCT_PAGE_INIT */
+
+/*
+ * Start one kthread per node to initialise the struct pages that
+ * memmap_init_zone() left out, and wait for all of them.
+ */
+void __init page_alloc_init_late(void)
+{
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+	struct task_struct *p;
+	int nid;
+
+	atomic_set(&pgdat_init_n_undone, num_node_state(N_HIGH_MEMORY));
+	for_each_node_state(nid, N_HIGH_MEMORY) {
+		p = kthread_run(deferred_init_memmap_thread, NODE_DATA(nid),
+				"pgdatinit%d", nid);
+		if (IS_ERR(p))
+			deferred_init_memmap(NODE_DATA(nid));
+	}
+
+	wait_for_completion(&pgdat_init_all_done_comp);
+	deferred_init_done = true;
+#endif
+}
+
 #ifdef CONFIG_CMA
 /* Free whole pageblock and set it's migration type to MIGRATE_CMA. */
 void __init init_cma_reserved_pageblock(struct page *page)
@@ -1875,6 +2148,10 @@ zonelist_scan:
 				    classzone_idx, alloc_flags))
 				goto try_this_zone;
 
+			/* the zone may only be short of pages not set up yet */
+			if (_deferred_grow_zone(zone, order))
+				goto try_this_zone;
+
 			if (NUMA_BUILD && !did_zlc_setup && nr_online_nodes > 1) {
 				/*
 				 * we do zlc_setup if there are multiple nodes
@@ -1918,6 +2195,8 @@ try_this_zone:
 						gfp_mask, migratetype);
 		if (page)
 			break;
+		if (_deferred_grow_zone(zone, order))
+			goto try_this_zone;
 this_zone_full:
 		if (NUMA_BUILD)
 			zlc_mark_zone_full(zonelist, z);
@@ -3748,13 +4027,15 @@ void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 {
 	struct page *page;
 	unsigned long end_pfn = start_pfn + size;
+	pg_data_t *pgdat = NODE_DATA(nid);
+	unsigned long nr_initialised = 0;
 	unsigned long pfn;
 	struct zone *z;
 
 	if (highest_memmap_pfn < end_pfn - 1)
 		highest_memmap_pfn = end_pfn - 1;
 
-	z = &NODE_DATA(nid)->node_zones[zone];
+	z = &pgdat->node_zones[zone];
 	for (pfn = start_pfn; pfn < end_pfn; pfn++) {
 		/*
 		 * There can be holes in boot-time mem_map[]s
@@ -3766,13 +4047,12 @@ void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 				continue;
 			if (!early_pfn_in_nid(pfn, nid))
 				continue;
+			if (!update_defer_init(pgdat, pfn, end_pfn,
+					       &nr_initialised))
+				break;
 		}
 		page = pfn_to_page(pfn);
-		set_page_links(page, zone, nid, pfn);
-		mminit_verify_page_links(page, zone, nid, pfn);
-		init_page_count(page);
-		reset_page_mapcount(page);
-		SetPageReserved(page);
+		__init_single_page(page, pfn, zone, nid);
 		/*
 		 * Mark the block movable so that blocks are reserved for
 		 * movable at startup. This will force kernel allocations
@@ -3791,13 +4071,6 @@ void __meminit memmap_init_zone(unsigned long size, int nid, unsigned long zone,
 		    && (pfn < z->zone_start_pfn + z->spanned_pages)
 		    && !(pfn & (pageblock_nr_pages - 1)))
 			set_pageblock_migratetype(page, MIGRATE_MOVABLE);
-
-		INIT_LIST_HEAD(&page->lru);
-#ifdef WANT_PAGE_VIRTUAL
-		/* The shift won't overflow because ZONE_NORMAL is below 4G. */
-		if (!is_highmem_idx(zone))
-			set_page_address(page, __va(pfn << PAGE_SHIFT));
-#endif
 	}
 }
 
@@ -4396,6 +4669,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 
 	pgdat_resize_init(pgdat);
 	init_waitqueue_head(&pgdat->kswapd_wait);
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	init_waitqueue_head(&pgdat->pfmemalloc_wait);
 	pgdat_page_cgroup_init(pgdat);
 
@@ -4521,6 +4797,9 @@ void __paginginit free_area_init_node(int nid, unsigned long *zones_size,
 
 	pgdat->node_id = nid;
 	pgdat->node_start_pfn = node_start_pfn;
+#ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
+	pgdat->first_deferred_pfn = ULONG_MAX;
+#endif
 	calculate_node_totalpages(pgdat, zones_size, zholes_size);
 
 	alloc_node_mem_map(pgdat);
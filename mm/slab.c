@@ -1685,7 +1685,7 @@ void __init kmem_cache_init(void)
 					sizes[INDEX_AC].cs_size,
 					ARCH_KMALLOC_MINALIGN,
 					ARCH_KMALLOC_FLAGS|SLAB_PANIC,
-					NULL);
+					NULL, NULL, NULL);
 
 	if (INDEX_AC != INDEX_L3) {
 		sizes[INDEX_L3].cs_cachep =
@@ -1693,7 +1693,7 @@ void __init kmem_cache_init(void)
 				sizes[INDEX_L3].cs_size,
 				ARCH_KMALLOC_MINALIGN,
 				ARCH_KMALLOC_FLAGS|SLAB_PANIC,
-				NULL);
+				NULL, NULL, NULL);
 	}
 
 	slab_early_init = 0;
@@ -1711,7 +1711,7 @@ void __init kmem_cache_init(void)
 					sizes->cs_size,
 					ARCH_KMALLOC_MINALIGN,
 					ARCH_KMALLOC_FLAGS|SLAB_PANIC,
-					NULL);
+					NULL, NULL, NULL);
 		}
 #ifdef CONFIG_ZONE_DMA
 		sizes->cs_dmacachep = __kmem_cache_create(
@@ -1720,7 +1720,7 @@ void __init kmem_cache_init(void)
 					ARCH_KMALLOC_MINALIGN,
 					ARCH_KMALLOC_FLAGS|SLAB_CACHE_DMA|
 						SLAB_PANIC,
-					NULL);
+					NULL, NULL, NULL);
 #endif
 		sizes++;
 		names++;
@@ -1901,8 +1901,12 @@ static void *kmem_getpages(struct kmem_cache *cachep, gfp_t flags, int nodeid)
 	if (cachep->flags & SLAB_RECLAIM_ACCOUNT)
 		flags |= __GFP_RECLAIMABLE;
 
+	if (memcg_charge_slab(cachep, flags, cachep->gfporder))
+		return NULL;
+
 	page = alloc_pages_exact_node(nodeid, flags | __GFP_NOTRACK, cachep->gfporder);
 	if (!page) {
+		memcg_uncharge_slab(cachep, cachep->gfporder);
 		if (!(flags & __GFP_NOWARN) && printk_ratelimit())
 			slab_out_of_memory(cachep, flags, nodeid);
 		return NULL;
@@ -1964,6 +1968,7 @@ static void kmem_freepages(struct kmem_cache *cachep, void *addr)
 	if (current->reclaim_state)
 		current->reclaim_state->reclaimed_slab += nr_freed;
 	free_pages((unsigned long)addr, cachep->gfporder);
+	memcg_uncharge_slab(cachep, cachep->gfporder);
 }
 
 static void kmem_rcu_free(struct rcu_head *head)
@@ -2383,12 +2388,20 @@ static int __init_refok setup_cpu_cache(struct kmem_cache *cachep, gfp_t gfp)
  */
 struct kmem_cache *
 __kmem_cache_create (const char *name, size_t size, size_t align,
-	unsigned long flags, void (*ctor)(void *))
+	unsigned long flags, void (*ctor)(void *),
+	struct mem_cgroup *memcg, struct kmem_cache *root_cache)
 {
 	size_t left_over, slab_size, ralign;
 	struct kmem_cache *cachep = NULL;
 	gfp_t gfp;
 
+	/*
+	 * A per-memcg copy is created with the flags of its root cache,
+	 * which include the ones we set internally.
+	 */
+	if (root_cache)
+		flags &= CREATE_MASK;
+
 #if DEBUG
 #if FORCED_DEBUG
 	/*
@@ -2596,6 +2609,21 @@ __kmem_cache_create (const char *name, size_t size, size_t align,
 		return NULL;
 	}
 
+	if (memcg_register_cache(memcg, cachep, root_cache)) {
+		__kmem_cache_destroy(cachep);
+		return NULL;
+	}
+
+	/* The name of a per-memcg copy is only borrowed from the caller */
+	if (memcg) {
+		cachep->name = kstrdup(name, gfp);
+		if (!cachep->name) {
+			memcg_release_cache(cachep);
+			__kmem_cache_destroy(cachep);
+			return NULL;
+		}
+	}
+
 	if (flags & SLAB_DEBUG_OBJECTS) {
 		/*
 		 * Would deadlock through slab_destroy()->call_rcu()->
@@ -2787,6 +2815,8 @@ void kmem_cache_destroy(struct kmem_cache *cachep)
 {
 	BUG_ON(!cachep || in_interrupt());
 
+	kmem_cache_destroy_memcg_children(cachep);
+
 	/* Find the cache in the chain of caches. */
 	get_online_cpus();
 	mutex_lock(&slab_mutex);
@@ -2805,6 +2835,9 @@ void kmem_cache_destroy(struct kmem_cache *cachep)
 	if (unlikely(cachep->flags & SLAB_DESTROY_BY_RCU))
 		rcu_barrier();
 
+	if (!is_root_cache(cachep))
+		kfree(cachep->name);
+	memcg_release_cache(cachep);
 	__kmem_cache_destroy(cachep);
 	mutex_unlock(&slab_mutex);
 	put_online_cpus();
@@ -3590,6 +3623,8 @@ __cache_alloc_node(struct kmem_cache *cachep, gfp_t flags, int nodeid,
 	if (slab_should_failslab(cachep, flags))
 		return NULL;
 
+	cachep = memcg_kmem_get_cache(cachep, flags);
+
 	cache_alloc_debugcheck_before(cachep, flags);
 	local_irq_save(save_flags);
 
@@ -3675,6 +3710,8 @@ __cache_alloc(struct kmem_cache *cachep, gfp_t flags, void *caller)
 	if (slab_should_failslab(cachep, flags))
 		return NULL;
 
+	cachep = memcg_kmem_get_cache(cachep, flags);
+
 	cache_alloc_debugcheck_before(cachep, flags);
 	local_irq_save(save_flags);
 	objp = __do_cache_alloc(cachep, flags);
@@ -3991,6 +4028,8 @@ void kmem_cache_free(struct kmem_cache *cachep, void *objp)
 {
 	unsigned long flags;
 
+	cachep = memcg_cache_from_obj(cachep, virt_to_cache(objp));
+
 	local_irq_save(flags);
 	debug_check_no_locks_freed(objp, cachep->object_size);
 	if (!(cachep->flags & SLAB_DEBUG_OBJECTS))
@@ -4002,6 +4041,19 @@ void kmem_cache_free(struct kmem_cache *cachep, void *objp)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+int kmem_cache_alloc_bulk(struct kmem_cache *cachep, gfp_t flags, size_t size,
+			  void **p)
+{
+	return __kmem_cache_alloc_bulk(cachep, flags, size, p);
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
+void kmem_cache_free_bulk(struct kmem_cache *cachep, size_t size, void **p)
+{
+	__kmem_cache_free_bulk(cachep, size, p);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
 /**
  * kfree - free previously allocated memory
  * @objp: pointer returned by kmalloc.
@@ -4757,3 +4809,12 @@ size_t ksize(const void *objp)
 	return virt_to_cache(objp)->object_size;
 }
 EXPORT_SYMBOL(ksize);
+
+struct kmem_cache *slab_cache_of(const void *objp)
+{
+	struct page *page = virt_to_head_page(objp);
+
+	if (unlikely(!PageSlab(page)))
+		return NULL;
+	return page->slab_cache;
+}
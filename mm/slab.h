@@ -1,5 +1,7 @@
 #ifndef MM_SLAB_H
 #define MM_SLAB_H
+
+#include <linux/memcontrol.h>
 /*
  * Internal slab definitions
  */
@@ -27,7 +29,121 @@ extern enum slab_state slab_state;
 extern struct mutex slab_mutex;
 extern struct list_head slab_caches;
 
+struct mem_cgroup;
 struct kmem_cache *__kmem_cache_create(const char *name, size_t size,
-	size_t align, unsigned long flags, void (*ctor)(void *));
+	size_t align, unsigned long flags, void (*ctor)(void *),
+	struct mem_cgroup *memcg, struct kmem_cache *root_cache);
+
+/* Generic one-at-a-time fallbacks for the bulk allocation interface */
+int __kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t nr,
+	void **p);
+void __kmem_cache_free_bulk(struct kmem_cache *s, size_t nr, void **p);
+
+/* Find the cache an object was allocated from */
+struct kmem_cache *slab_cache_of(const void *obj);
+
+#ifdef CONFIG_MEMCG_KMEM
+static inline bool is_root_cache(struct kmem_cache *s)
+{
+	return !s->memcg_params || s->memcg_params->is_root_cache;
+}
+
+/* Is @s the root cache @p or a per-memcg copy of it? */
+static inline bool slab_equal_or_root(struct kmem_cache *s,
+				      struct kmem_cache *p)
+{
+	return s == p ||
+		(!is_root_cache(s) && s->memcg_params->root_cache == p);
+}
+
+/*
+ * Pick the per-memcg copy of @cachep that the current task should
+ * allocate from. Returns @cachep itself when there is nothing to account.
+ */
+static __always_inline struct kmem_cache *
+memcg_kmem_get_cache(struct kmem_cache *cachep, gfp_t gfp)
+{
+	if (!memcg_kmem_enabled() || !cachep->memcg_params)
+		return cachep;
+	return __memcg_kmem_get_cache(cachep, gfp);
+}
+
+/* Charge/uncharge the slab pages of a per-memcg copy */
+static inline int memcg_charge_slab(struct kmem_cache *s, gfp_t gfp, int order)
+{
+	if (!memcg_kmem_enabled() || is_root_cache(s))
+		return 0;
+	return __memcg_charge_slab(s, gfp, order);
+}
+
+static inline void memcg_uncharge_slab(struct kmem_cache *s, int order)
+{
+	if (!memcg_kmem_enabled() || is_root_cache(s))
+		return;
+	__memcg_uncharge_slab(s, order);
+}
+
+/*
+ * Objects are freed through the root cache even when they came from one
+ * of its per-memcg copies. @cachep is the cache that really owns the
+ * object; use it if it belongs to @s.
+ */
+static inline struct kmem_cache *
+memcg_cache_from_obj(struct kmem_cache *s, struct kmem_cache *cachep)
+{
+	if (!memcg_kmem_enabled() || likely(cachep == s))
+		return s;
+	if (WARN_ON_ONCE(!slab_equal_or_root(cachep, s)))
+		return s;
+	return cachep;
+}
+#else
+static inline bool is_root_cache(struct kmem_cache *s)
+{
+	return true;
+}
+
+static inline bool slab_equal_or_root(struct kmem_cache *s,
+				      struct kmem_cache *p)
+{
+	return true;
+}
+
+static inline struct kmem_cache *
+memcg_kmem_get_cache(struct kmem_cache *cachep, gfp_t gfp)
+{
+	return cachep;
+}
+
+static inline int memcg_charge_slab(struct kmem_cache *s, gfp_t gfp, int order)
+{
+	return 0;
+}
+
+static inline void memcg_uncharge_slab(struct kmem_cache *s, int order)
+{
+}
+
+static inline struct kmem_cache *
+memcg_cache_from_obj(struct kmem_cache *s, struct kmem_cache *cachep)
+{
+	return s;
+}
+
+static inline int memcg_register_cache(struct mem_cgroup *memcg,
+				       struct kmem_cache *s,
+				       struct kmem_cache *root_cache)
+{
+	return 0;
+}
+
+static inline void memcg_release_cache(struct kmem_cache *s)
+{
+}
+
+static inline void kmem_cache_destroy_memcg_children(struct kmem_cache *s)
+{
+}
+#endif
 
 #endif
@@ -76,9 +76,13 @@ void cancel_dirty_page(struct page *page, unsigned int account_size)
 	if (TestClearPageDirty(page)) {
 		struct address_space *mapping = page->mapping;
 		if (mapping && mapping_cap_account_dirty(mapping)) {
+			struct wb_lock_cookie cookie = {};
+			struct bdi_writeback *wb;
+
+			wb = unlocked_mapping_to_wb_begin(mapping, &cookie);
 			dec_zone_page_state(page, NR_FILE_DIRTY);
-			dec_bdi_stat(mapping->backing_dev_info,
-					BDI_RECLAIMABLE);
+			dec_wb_stat(wb, WB_RECLAIMABLE);
+			unlocked_mapping_to_wb_end(mapping, &cookie);
 			if (account_size)
 				task_io_account_cancelled_write(account_size);
 		}
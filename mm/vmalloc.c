@@ -27,6 +27,7 @@
 #include <linux/pfn.h>
 #include <linux/kmemleak.h>
 #include <linux/atomic.h>
+#include <linux/llist.h>
 #include <asm/uaccess.h>
 #include <asm/tlbflush.h>
 #include <asm/shmparam.h>
@@ -255,20 +256,38 @@ struct vmap_area {
 	unsigned long flags;
 	struct rb_node rb_node;		/* address sorted rbtree */
 	struct list_head list;		/* address sorted list */
-	struct list_head purge_list;	/* "lazy purge" list */
+
+	/*
+	 * A busy area sits on a "lazy purge" list once it has been
+	 * freed, a free area caches the largest size in its subtree.
+	 */
+	union {
+		struct llist_node purge_list;
+		unsigned long subtree_max_size;
+	};
 	struct vm_struct *vm;
-	struct rcu_head rcu_head;
 };
 
 static DEFINE_SPINLOCK(vmap_area_lock);
 static LIST_HEAD(vmap_area_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
+/*
+ * The free KVA space, protected by vmap_area_lock as well.  Free areas
+ * are kept in an address sorted rbtree where every node also records
+ * the biggest free area below it, so a fitting block can be found in
+ * O(log n) instead of walking all busy areas.  The address sorted list
+ * is used for quick access to the neighbours when merging.
+ */
+static struct rb_root free_vmap_area_root = RB_ROOT;
+static LIST_HEAD(free_vmap_area_list);
+
+/*
+ * Splitting a free area in two needs a new vmap_area while holding
+ * vmap_area_lock, preload one per CPU so that can be done without
+ * resorting to an atomic allocation.
+ */
+static DEFINE_PER_CPU(struct vmap_area *, ne_fit_preload_node);
 
 static unsigned long vmap_area_pcpu_hole;
 
@@ -323,6 +342,302 @@ static void __insert_vmap_area(struct vmap_area *va)
 		list_add_rcu(&va->list, &vmap_area_list);
 }
 
+static inline unsigned long va_size(struct vmap_area *va)
+{
+	return va->va_end - va->va_start;
+}
+
+static inline unsigned long get_subtree_max_size(struct rb_node *node)
+{
+	struct vmap_area *va;
+
+	if (!node)
+		return 0;
+	va = rb_entry(node, struct vmap_area, rb_node);
+	return va->subtree_max_size;
+}
+
+static inline unsigned long compute_subtree_max_size(struct vmap_area *va)
+{
+	return max3(va_size(va),
+		    get_subtree_max_size(va->rb_node.rb_left),
+		    get_subtree_max_size(va->rb_node.rb_right));
+}
+
+static void free_vmap_area_augment_cb(struct rb_node *node, void *data)
+{
+	struct vmap_area *va = rb_entry(node, struct vmap_area, rb_node);
+
+	va->subtree_max_size = compute_subtree_max_size(va);
+}
+
+/*
+ * Fix up the cached sizes from @va to the root after @va itself
+ * changed size.  Stops as soon as an ancestor is left unchanged.
+ */
+static void augment_tree_propagate_from(struct vmap_area *va)
+{
+	struct rb_node *node = &va->rb_node;
+
+	while (node) {
+		unsigned long new_size;
+
+		va = rb_entry(node, struct vmap_area, rb_node);
+		new_size = compute_subtree_max_size(va);
+		if (va->subtree_max_size == new_size)
+			break;
+		va->subtree_max_size = new_size;
+		node = rb_parent(node);
+	}
+}
+
+static void __insert_free_vmap_area(struct vmap_area *va)
+{
+	struct rb_node **p = &free_vmap_area_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct rb_node *tmp;
+
+	while (*p) {
+		struct vmap_area *tmp_va;
+
+		parent = *p;
+		tmp_va = rb_entry(parent, struct vmap_area, rb_node);
+		if (va->va_end <= tmp_va->va_start)
+			p = &(*p)->rb_left;
+		else if (va->va_start >= tmp_va->va_end)
+			p = &(*p)->rb_right;
+		else
+			BUG();
+	}
+
+	va->subtree_max_size = va_size(va);
+	rb_link_node(&va->rb_node, parent, p);
+	rb_insert_color(&va->rb_node, &free_vmap_area_root);
+	rb_augment_insert(&va->rb_node, free_vmap_area_augment_cb, NULL);
+
+	tmp = rb_prev(&va->rb_node);
+	if (tmp) {
+		struct vmap_area *prev;
+		prev = rb_entry(tmp, struct vmap_area, rb_node);
+		list_add(&va->list, &prev->list);
+	} else
+		list_add(&va->list, &free_vmap_area_list);
+}
+
+static void __unlink_free_vmap_area(struct vmap_area *va)
+{
+	struct rb_node *deepest;
+
+	deepest = rb_augment_erase_begin(&va->rb_node);
+	rb_erase(&va->rb_node, &free_vmap_area_root);
+	RB_CLEAR_NODE(&va->rb_node);
+	if (deepest)
+		rb_augment_erase_end(deepest, free_vmap_area_augment_cb, NULL);
+	list_del(&va->list);
+}
+
+/*
+ * Return the KVA described by @va to the free tree, coalescing it
+ * with the free areas right before and after it.  @va is consumed:
+ * it is either inserted or freed.
+ */
+static void merge_or_add_free_vmap_area(struct vmap_area *va)
+{
+	struct rb_node *n = free_vmap_area_root.rb_node;
+	struct vmap_area *prev = NULL, *next = NULL, *tmp;
+
+	/* find the free neighbours of the hole that @va fills */
+	while (n) {
+		tmp = rb_entry(n, struct vmap_area, rb_node);
+		if (va->va_end <= tmp->va_start) {
+			next = tmp;
+			n = n->rb_left;
+		} else if (va->va_start >= tmp->va_end) {
+			prev = tmp;
+			n = n->rb_right;
+		} else
+			BUG();
+	}
+
+	if (next && next->va_start == va->va_end) {
+		next->va_start = va->va_start;
+		if (prev && prev->va_end == va->va_start) {
+			/* fills a hole exactly, fold prev into next */
+			next->va_start = prev->va_start;
+			__unlink_free_vmap_area(prev);
+			kfree(prev);
+		}
+		augment_tree_propagate_from(next);
+		kfree(va);
+		return;
+	}
+
+	if (prev && prev->va_end == va->va_start) {
+		prev->va_end = va->va_end;
+		augment_tree_propagate_from(prev);
+		kfree(va);
+		return;
+	}
+
+	__insert_free_vmap_area(va);
+}
+
+static inline bool is_within_this_va(struct vmap_area *va, unsigned long size,
+				     unsigned long align, unsigned long vstart)
+{
+	unsigned long nva_start_addr;
+
+	if (va->va_start > vstart)
+		nva_start_addr = ALIGN(va->va_start, align);
+	else
+		nva_start_addr = ALIGN(vstart, align);
+
+	/* can overflow due to big size or alignment */
+	if (nva_start_addr + size < nva_start_addr ||
+			nva_start_addr < vstart)
+		return false;
+
+	return nva_start_addr + size <= va->va_end;
+}
+
+/*
+ * Find the lowest free area at or above @vstart that can hold @size
+ * bytes aligned to @align.  Subtrees whose biggest area is too small
+ * are never entered, which keeps this O(log n).
+ */
+static struct vmap_area *find_vmap_lowest_match(unsigned long size,
+				unsigned long align, unsigned long vstart)
+{
+	struct vmap_area *va;
+	struct rb_node *node;
+	unsigned long length;
+
+	/*
+	 * Areas are page aligned, so only a bigger alignment can waste
+	 * space at the start of a candidate.
+	 */
+	length = align > PAGE_SIZE ? size + align - 1 : size;
+	node = free_vmap_area_root.rb_node;
+
+	while (node) {
+		va = rb_entry(node, struct vmap_area, rb_node);
+
+		if (get_subtree_max_size(node->rb_left) >= length &&
+				vstart < va->va_start) {
+			node = node->rb_left;
+		} else {
+			if (is_within_this_va(va, size, align, vstart))
+				return va;
+
+			/*
+			 * Nothing fits on the left, go right if that
+			 * subtree has a big enough area.
+			 */
+			if (get_subtree_max_size(node->rb_right) >= length) {
+				node = node->rb_right;
+				continue;
+			}
+
+			/*
+			 * Everything fitting was below vstart: climb up
+			 * and continue with the first right subtree that
+			 * has a big enough area.  Once there every area
+			 * is above vstart, so this happens at most once.
+			 */
+			while ((node = rb_parent(node))) {
+				va = rb_entry(node, struct vmap_area, rb_node);
+				if (is_within_this_va(va, size, align, vstart))
+					return va;
+
+				if (get_subtree_max_size(node->rb_right) >= length &&
+						vstart <= va->va_start) {
+					node = node->rb_right;
+					break;
+				}
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Take [nva_start_addr, nva_start_addr + size) out of the free area @va.
+ * Carving from the middle splits @va in two, which uses *@spare if the
+ * caller has one, else this CPU's preloaded area.
+ */
+static int clip_free_vmap_area(struct vmap_area *va,
+			unsigned long nva_start_addr, unsigned long size,
+			struct vmap_area **spare)
+{
+	unsigned long nva_end_addr = nva_start_addr + size;
+	struct vmap_area *lva;
+
+	BUG_ON(nva_start_addr < va->va_start || nva_end_addr > va->va_end);
+
+	if (va->va_start == nva_start_addr && va->va_end == nva_end_addr) {
+		/* exact fit */
+		__unlink_free_vmap_area(va);
+		kfree(va);
+	} else if (va->va_start == nva_start_addr) {
+		/* fits at the left edge */
+		va->va_start = nva_end_addr;
+		augment_tree_propagate_from(va);
+	} else if (va->va_end == nva_end_addr) {
+		/* fits at the right edge */
+		va->va_end = nva_start_addr;
+		augment_tree_propagate_from(va);
+	} else {
+		/* in the middle, the remainder below becomes a new area */
+		if (spare && *spare) {
+			lva = *spare;
+			*spare = NULL;
+		} else {
+			lva = __this_cpu_xchg(ne_fit_preload_node, NULL);
+		}
+		if (unlikely(!lva)) {
+			lva = kmalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+			if (!lva)
+				return -ENOMEM;
+		}
+
+		lva->va_start = va->va_start;
+		lva->va_end = nva_start_addr;
+		va->va_start = nva_end_addr;
+		augment_tree_propagate_from(va);
+		__insert_free_vmap_area(lva);
+	}
+
+	return 0;
+}
+
+/*
+ * Returns the start address of the allocated block, or vend on failure.
+ */
+static unsigned long __alloc_vmap_area(unsigned long size, unsigned long align,
+				unsigned long vstart, unsigned long vend)
+{
+	unsigned long nva_start_addr;
+	struct vmap_area *va;
+
+	va = find_vmap_lowest_match(size, align, vstart);
+	if (unlikely(!va))
+		return vend;
+
+	if (va->va_start > vstart)
+		nva_start_addr = ALIGN(va->va_start, align);
+	else
+		nva_start_addr = ALIGN(vstart, align);
+
+	if (nva_start_addr + size > vend)
+		return vend;
+
+	if (clip_free_vmap_area(va, nva_start_addr, size, NULL))
+		return vend;
+
+	return nva_start_addr;
+}
+
 static void purge_vmap_area_lazy(void);
 
 /*
@@ -334,11 +649,9 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 				unsigned long vstart, unsigned long vend,
 				int node, gfp_t gfp_mask)
 {
-	struct vmap_area *va;
-	struct rb_node *n;
+	struct vmap_area *va, *pva;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
 
 	BUG_ON(!size);
 	BUG_ON(size & ~PAGE_MASK);
@@ -350,85 +663,28 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 		return ERR_PTR(-ENOMEM);
 
 retry:
-	spin_lock(&vmap_area_lock);
 	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
+	 * Preload this CPU's spare for the case the block has to be cut
+	 * out of the middle of a free area.  If we get migrated after
+	 * the check the allocation may be done on another CPU, the
+	 * split then falls back to GFP_NOWAIT.
 	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
+	if (!this_cpu_read(ne_fit_preload_node)) {
+		pva = kmalloc_node(sizeof(struct vmap_area),
+				gfp_mask & GFP_RECLAIM_MASK, node);
+		if (pva && this_cpu_cmpxchg(ne_fit_preload_node, NULL, pva))
+			kfree(pva);
 	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size - 1 < addr)
-			goto overflow;
 
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
-	}
-
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-		if (list_is_last(&first->list, &vmap_area_list))
-			goto found;
-
-		first = list_entry(first->list.next,
-				struct vmap_area, list);
-	}
-
-found:
-	if (addr + size > vend)
+	spin_lock(&vmap_area_lock);
+	addr = __alloc_vmap_area(size, align, vstart, vend);
+	if (unlikely(addr == vend))
 		goto overflow;
 
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
 	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(va->va_start & (align-1));
@@ -456,21 +712,6 @@ static void __free_vmap_area(struct vmap_area *va)
 {
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
 	rb_erase(&va->rb_node, &vmap_area_root);
 	RB_CLEAR_NODE(&va->rb_node);
 	list_del_rcu(&va->list);
@@ -484,7 +725,8 @@ static void __free_vmap_area(struct vmap_area *va)
 	if (va->va_end > VMALLOC_START && va->va_end <= VMALLOC_END)
 		vmap_area_pcpu_hole = max(vmap_area_pcpu_hole, va->va_end);
 
-	kfree_rcu(va, rcu_head);
+	/* the KVA goes back to the free tree, va with it or freed */
+	merge_or_add_free_vmap_area(va);
 }
 
 /*
@@ -553,6 +795,12 @@ static unsigned long lazy_max_pages(void)
 
 static atomic_t vmap_lazy_nr = ATOMIC_INIT(0);
 
+/*
+ * Lazily freed areas are queued on the CPU that freed them, so vfree()
+ * and vunmap() never touch vmap_area_lock nor a shared list.
+ */
+static DEFINE_PER_CPU(struct llist_head, vmap_purge_list);
+
 /* for per-CPU blocks */
 static void purge_fragmented_blocks_allcpus(void);
 
@@ -579,10 +827,11 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 					int sync, int force_flush)
 {
 	static DEFINE_SPINLOCK(purge_lock);
-	LIST_HEAD(valist);
+	struct llist_node *valist = NULL;
+	struct llist_node *head, *node, *next;
 	struct vmap_area *va;
-	struct vmap_area *n_va;
 	int nr = 0;
+	int cpu;
 
 	/*
 	 * If sync is 0 but force_flush is 1, we'll go sync anyway but callers
@@ -598,20 +847,29 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 	if (sync)
 		purge_fragmented_blocks_allcpus();
 
-	rcu_read_lock();
-	list_for_each_entry_rcu(va, &vmap_area_list, list) {
-		if (va->flags & VM_LAZY_FREE) {
+	/* detach every CPU's list and chain them into one batch */
+	for_each_possible_cpu(cpu) {
+		head = llist_del_all(&per_cpu(vmap_purge_list, cpu));
+		if (!head)
+			continue;
+
+		for (node = head; ; node = next) {
+			va = llist_entry(node, struct vmap_area, purge_list);
 			if (va->va_start < *start)
 				*start = va->va_start;
 			if (va->va_end > *end)
 				*end = va->va_end;
 			nr += (va->va_end - va->va_start) >> PAGE_SHIFT;
-			list_add_tail(&va->purge_list, &valist);
 			va->flags |= VM_LAZY_FREEING;
 			va->flags &= ~VM_LAZY_FREE;
+
+			next = llist_next(node);
+			if (!next)
+				break;
 		}
+		node->next = valist;
+		valist = head;
 	}
-	rcu_read_unlock();
 
 	if (nr)
 		atomic_sub(nr, &vmap_lazy_nr);
@@ -621,8 +879,12 @@ static void __purge_vmap_area_lazy(unsigned long *start, unsigned long *end,
 
 	if (nr) {
 		spin_lock(&vmap_area_lock);
-		list_for_each_entry_safe(va, n_va, &valist, purge_list)
+		for (node = valist; node; node = next) {
+			/* __free_vmap_area() reuses purge_list, step first */
+			next = llist_next(node);
+			va = llist_entry(node, struct vmap_area, purge_list);
 			__free_vmap_area(va);
+		}
 		spin_unlock(&vmap_area_lock);
 	}
 	spin_unlock(&purge_lock);
@@ -656,9 +918,16 @@ static void purge_vmap_area_lazy(void)
  */
 static void free_vmap_area_noflush(struct vmap_area *va)
 {
+	int nr_lazy;
+
 	va->flags |= VM_LAZY_FREE;
-	atomic_add((va->va_end - va->va_start) >> PAGE_SHIFT, &vmap_lazy_nr);
-	if (unlikely(atomic_read(&vmap_lazy_nr) > lazy_max_pages()))
+	nr_lazy = atomic_add_return((va->va_end - va->va_start) >> PAGE_SHIFT,
+				    &vmap_lazy_nr);
+
+	llist_add(&va->purge_list, &get_cpu_var(vmap_purge_list));
+	put_cpu_var(vmap_purge_list);
+
+	if (unlikely(nr_lazy > lazy_max_pages()))
 		try_purge_vmap_area_lazy();
 }
 
@@ -1176,6 +1445,43 @@ void __init vm_area_register_early(struct vm_struct *vm, size_t align)
 	vm_area_add_early(vm);
 }
 
+/*
+ * Everything not covered by the early vmlist entries is free KVA.
+ */
+static struct vmap_area * __init vmap_init_alloc_free(void)
+{
+	struct vmap_area *free;
+
+	free = kzalloc(sizeof(struct vmap_area), GFP_NOWAIT);
+	if (!free)
+		panic("vmalloc: no memory for the free area tree\n");
+	return free;
+}
+
+static void __init vmap_init_free_space(void)
+{
+	unsigned long vmap_start = 1;
+	const unsigned long vmap_end = ULONG_MAX;
+	struct vmap_area *busy, *free;
+
+	list_for_each_entry(busy, &vmap_area_list, list) {
+		if (busy->va_start > vmap_start) {
+			free = vmap_init_alloc_free();
+			free->va_start = vmap_start;
+			free->va_end = busy->va_start;
+			__insert_free_vmap_area(free);
+		}
+		vmap_start = busy->va_end;
+	}
+
+	if (vmap_end > vmap_start) {
+		free = vmap_init_alloc_free();
+		free->va_start = vmap_start;
+		free->va_end = vmap_end;
+		__insert_free_vmap_area(free);
+	}
+}
+
 void __init vmalloc_init(void)
 {
 	struct vmap_area *va;
@@ -1200,6 +1506,7 @@ void __init vmalloc_init(void)
 		__insert_vmap_area(va);
 	}
 
+	vmap_init_free_space();
 	vmap_area_pcpu_hole = VMALLOC_END;
 
 	vmap_initialized = true;
@@ -2242,6 +2549,28 @@ static struct vmap_area *node_to_va(struct rb_node *n)
 	return n ? rb_entry(n, struct vmap_area, rb_node) : NULL;
 }
 
+/*
+ * Find the free area containing @addr.
+ */
+static struct vmap_area *pvm_find_free_va_enclose(unsigned long addr)
+{
+	struct rb_node *n = free_vmap_area_root.rb_node;
+
+	while (n) {
+		struct vmap_area *va;
+
+		va = rb_entry(n, struct vmap_area, rb_node);
+		if (addr < va->va_start)
+			n = n->rb_left;
+		else if (addr >= va->va_end)
+			n = n->rb_right;
+		else
+			return va;
+	}
+
+	return NULL;
+}
+
 /**
  * pvm_find_next_prev - find the next and prev vmap_area surrounding @end
  * @end: target address
@@ -2350,11 +2679,12 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 {
 	const unsigned long vmalloc_start = ALIGN(VMALLOC_START, align);
 	const unsigned long vmalloc_end = VMALLOC_END & ~(align - 1);
-	struct vmap_area **vas, *prev, *next;
+	struct vmap_area **vas, **spares, *prev, *next;
 	struct vm_struct **vms;
 	int area, area2, last_area, term_area;
 	unsigned long base, start, end, last_end;
 	bool purged = false;
+	int ret;
 
 	/* verify parameters and allocate data structures */
 	BUG_ON(align & ~PAGE_MASK || !is_power_of_2(align));
@@ -2390,13 +2720,16 @@ struct vm_struct **pcpu_get_vm_areas(const unsigned long *offsets,
 
 	vms = kcalloc(nr_vms, sizeof(vms[0]), GFP_KERNEL);
 	vas = kcalloc(nr_vms, sizeof(vas[0]), GFP_KERNEL);
-	if (!vas || !vms)
+	spares = kcalloc(nr_vms, sizeof(spares[0]), GFP_KERNEL);
+	if (!vas || !vms || !spares)
 		goto err_free2;
 
+	/* carving an area out of the free tree may split a free area */
 	for (area = 0; area < nr_vms; area++) {
 		vas[area] = kzalloc(sizeof(struct vmap_area), GFP_KERNEL);
 		vms[area] = kzalloc(sizeof(struct vm_struct), GFP_KERNEL);
-		if (!vas[area] || !vms[area])
+		spares[area] = kzalloc(sizeof(struct vmap_area), GFP_KERNEL);
+		if (!vas[area] || !vms[area] || !spares[area])
 			goto err_free;
 	}
 retry:
@@ -2469,9 +2802,17 @@ found:
 	/* we've found a fitting base, insert all va's */
 	for (area = 0; area < nr_vms; area++) {
 		struct vmap_area *va = vas[area];
+		struct vmap_area *free;
 
 		va->va_start = base + offsets[area];
 		va->va_end = va->va_start + sizes[area];
+
+		/* the hole is free in the busy tree, so it is in the free one */
+		free = pvm_find_free_va_enclose(va->va_start);
+		BUG_ON(!free);
+		ret = clip_free_vmap_area(free, va->va_start, sizes[area],
+					  &spares[area]);
+		BUG_ON(ret);
 		__insert_vmap_area(va);
 	}
 
@@ -2484,6 +2825,9 @@ found:
 		insert_vmalloc_vm(vms[area], vas[area], VM_ALLOC,
 				  pcpu_get_vm_areas);
 
+	for (area = 0; area < nr_vms; area++)
+		kfree(spares[area]);
+	kfree(spares);
 	kfree(vas);
 	return vms;
 
@@ -2491,8 +2835,10 @@ err_free:
 	for (area = 0; area < nr_vms; area++) {
 		kfree(vas[area]);
 		kfree(vms[area]);
+		kfree(spares[area]);
 	}
 err_free2:
+	kfree(spares);
 	kfree(vas);
 	kfree(vms);
 	return NULL;
@@ -230,6 +230,10 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 		long batch_size = shrinker->batch ? shrinker->batch
 						  : SHRINK_BATCH;
 
+		if (shrink->target_mem_cgroup &&
+		    !(shrinker->flags & SHRINKER_MEMCG_AWARE))
+			continue;
+
 		max_pass = do_shrinker_shrink(shrinker, shrink, 0);
 		if (max_pass <= 0)
 			continue;
@@ -237,9 +241,13 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 		/*
 		 * copy the current shrinker scan count into a local variable
 		 * and zero it so that other concurrent shrinker invocations
-		 * don't also do this scanning work.
+		 * don't also do this scanning work. Work deferred by global
+		 * reclaim is left alone when shrinking on behalf of a memcg.
 		 */
-		nr = atomic_long_xchg(&shrinker->nr_in_batch, 0);
+		if (shrink->target_mem_cgroup)
+			nr = 0;
+		else
+			nr = atomic_long_xchg(&shrinker->nr_in_batch, 0);
 
 		total_scan = nr;
 		delta = (4 * nr_pages_scanned) / shrinker->seeks;
@@ -301,7 +309,7 @@ unsigned long shrink_slab(struct shrink_control *shrink,
 		 * manner that handles concurrent updates. If we exhausted the
 		 * scan, there is no need to do an update.
 		 */
-		if (total_scan > 0)
+		if (total_scan > 0 && !shrink->target_mem_cgroup)
 			new_nr = atomic_long_add_return(total_scan,
 					&shrinker->nr_in_batch);
 		else
@@ -2090,6 +2098,17 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 				sc->nr_reclaimed += reclaim_state->reclaimed_slab;
 				reclaim_state->reclaimed_slab = 0;
 			}
+		} else if (memcg_kmem_is_active(sc->target_mem_cgroup)) {
+			/*
+			 * The slab objects charged to the memcg count against
+			 * its limit as well, shrink them along with the LRUs.
+			 */
+			memcg_shrink_slab(sc->target_mem_cgroup, shrink,
+					  sc->nr_scanned);
+			if (reclaim_state) {
+				sc->nr_reclaimed += reclaim_state->reclaimed_slab;
+				reclaim_state->reclaimed_slab = 0;
+			}
 		}
 		total_scanned += sc->nr_scanned;
 		if (sc->nr_reclaimed >= sc->nr_to_reclaim)
@@ -2817,8 +2836,9 @@ out:
 			zone_clear_flag(zone, ZONE_CONGESTED);
 		}
 
+		/* Leave the defragmentation to kcompactd */
 		if (zones_need_compaction)
-			compact_pgdat(pgdat, order);
+			wakeup_kcompactd(pgdat, order, *classzone_idx);
 	}
 
 	/*
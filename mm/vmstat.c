@@ -602,6 +602,24 @@ int fragmentation_index(struct zone *zone, unsigned int order)
 	fill_contig_page_info(zone, order, &info);
 	return __fragmentation_index(order, &info);
 }
+
+/*
+ * External fragmentation of a zone with respect to @order: the
+ * percentage of free memory that sits in blocks smaller than 1 << @order.
+ * Returns a value between 0 and 100.
+ */
+unsigned int extfrag_for_order(struct zone *zone, unsigned int order)
+{
+	struct contig_page_info info;
+
+	fill_contig_page_info(zone, order, &info);
+	if (info.free_pages == 0)
+		return 0;
+
+	return div_u64((info.free_pages -
+			(info.free_blocks_suitable << order)) * 100,
+		       info.free_pages);
+}
 #endif
 
 #if defined(CONFIG_PROC_FS) || defined(CONFIG_COMPACTION)
@@ -768,6 +786,10 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_direct_pages_moved",
+	"compact_daemon_wake",
+	"compact_daemon_proactive",
+	"compact_daemon_pages_moved",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
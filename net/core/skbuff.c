@@ -74,6 +74,20 @@
 struct kmem_cache *skbuff_head_cache __read_mostly;
 static struct kmem_cache *skbuff_fclone_cache __read_mostly;
 
+/*
+ * sk_buff heads released from softirq context are parked in a small per
+ * cpu array and handed back to the slab allocator in one
+ * kmem_cache_free_bulk() call instead of one kmem_cache_free() each.
+ */
+#define NAPI_SKB_CACHE_SIZE	64
+
+struct napi_skb_cache {
+	unsigned int	skb_count;
+	void		*skb_cache[NAPI_SKB_CACHE_SIZE];
+};
+
+static DEFINE_PER_CPU(struct napi_skb_cache, napi_skb_cache);
+
 static void sock_pipe_buf_release(struct pipe_inode_info *pipe,
 				  struct pipe_buffer *buf)
 {
@@ -655,6 +669,94 @@ void consume_skb(struct sk_buff *skb)
 }
 EXPORT_SYMBOL(consume_skb);
 
+/**
+ *	__kfree_skb_flush - release deferred sk_buff heads
+ *
+ *	Hand the sk_buff heads collected by __kfree_skb_defer() on this cpu
+ *	back to the slab allocator. Must be called from softirq context,
+ *	typically at the end of a NAPI or TX completion run.
+ */
+void __kfree_skb_flush(void)
+{
+	struct napi_skb_cache *nc = &__get_cpu_var(napi_skb_cache);
+
+	if (nc->skb_count) {
+		kmem_cache_free_bulk(skbuff_head_cache, nc->skb_count,
+				     nc->skb_cache);
+		nc->skb_count = 0;
+	}
+}
+
+/**
+ *	__kfree_skb_defer - free an sk_buff from softirq context
+ *	@skb: buffer to free, with no users left
+ *
+ *	Like __kfree_skb(), but the sk_buff head is only queued for a later
+ *	bulk free. @skb must not be a fast clone. The caller must call
+ *	__kfree_skb_flush() before leaving softirq context.
+ */
+void __kfree_skb_defer(struct sk_buff *skb)
+{
+	struct napi_skb_cache *nc = &__get_cpu_var(napi_skb_cache);
+
+	/* drop skb->head and call any destructors for packet */
+	skb_release_all(skb);
+
+	nc->skb_cache[nc->skb_count++] = skb;
+
+#ifdef CONFIG_SLUB
+	/* SLUB writes into objects when freeing */
+	prefetchw(skb);
+#endif
+
+	if (unlikely(nc->skb_count == NAPI_SKB_CACHE_SIZE)) {
+		kmem_cache_free_bulk(skbuff_head_cache, NAPI_SKB_CACHE_SIZE,
+				     nc->skb_cache);
+		nc->skb_count = 0;
+	}
+}
+
+/**
+ *	napi_consume_skb - free an skbuff from a NAPI poll routine
+ *	@skb: buffer to free
+ *	@budget: NAPI budget of the caller, 0 if not called from NAPI
+ *
+ *	Drop a ref to the buffer and free it if the usage count has hit
+ *	zero. Drivers should use this for TX completions done from their
+ *	poll routine so the heads can be freed in bulk; net_rx_action()
+ *	flushes them once all poll routines have run.
+ */
+void napi_consume_skb(struct sk_buff *skb, int budget)
+{
+	if (unlikely(!skb))
+		return;
+
+	/*
+	 * Zero budget indicates a non-NAPI caller.  netpoll calls ->poll()
+	 * with interrupts off and from any context, and nothing flushes
+	 * after it, so free the usual way there as well.
+	 */
+	if (unlikely(!budget || !in_serving_softirq() || irqs_disabled())) {
+		dev_kfree_skb_any(skb);
+		return;
+	}
+
+	if (likely(atomic_read(&skb->users) == 1))
+		smp_rmb();
+	else if (likely(!atomic_dec_and_test(&skb->users)))
+		return;
+	trace_consume_skb(skb);
+
+	/* Fast clones live in their own cache, free them the usual way */
+	if (skb->fclone != SKB_FCLONE_UNAVAILABLE) {
+		__kfree_skb(skb);
+		return;
+	}
+
+	__kfree_skb_defer(skb);
+}
+EXPORT_SYMBOL(napi_consume_skb);
+
 static void __copy_skb_header(struct sk_buff *new, const struct sk_buff *old)
 {
 	new->tstamp		= old->tstamp;
@@ -0,0 +1,141 @@
+/*
+ *
+ * sched-fork.c
+ *
+ * fork: Benchmark for fork() and exit()
+ *
+ * A number of worker processes, one per online CPU by default, each
+ * fork() children which _exit() right away and reap them with
+ * waitpid(), in a loop.  Every fork allocates a PID and every reaped
+ * child frees one, so this mostly stresses process creation and
+ * teardown and PID allocation.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <assert.h>
+
+#define LOOPS_DEFAULT 10000
+static int loops = LOOPS_DEFAULT;
+static int workers;
+
+static const struct option options[] = {
+	OPT_INTEGER('l', "loop", &loops,
+		    "Specify number of forks per worker"),
+	OPT_INTEGER('w', "workers", &workers,
+		    "Specify number of worker processes (default: number of online CPUs)"),
+	OPT_END()
+};
+
+static const char * const bench_sched_fork_usage[] = {
+	"perf bench sched fork <options>",
+	NULL
+};
+
+static void worker(void)
+{
+	int i, wait_stat;
+	pid_t pid;
+
+	for (i = 0; i < loops; i++) {
+		pid = fork();
+		if (!pid)
+			_exit(0);
+		assert(pid > 0);
+		assert(waitpid(pid, &wait_stat, 0) == pid);
+	}
+	exit(0);
+}
+
+int bench_sched_fork(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec, total;
+	int i, wait_stat, ready[2], m = 0;
+	int __used ret;
+	pid_t *pids;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_fork_usage, 0);
+
+	if (workers <= 0)
+		workers = sysconf(_SC_NPROCESSORS_ONLN);
+	if (workers <= 0)
+		workers = 1;
+
+	pids = calloc(workers, sizeof(*pids));
+	assert(pids);
+
+	/* the workers start forking once all of them have been created */
+	assert(!pipe(ready));
+
+	for (i = 0; i < workers; i++) {
+		pids[i] = fork();
+		assert(pids[i] >= 0);
+		if (!pids[i]) {
+			close(ready[1]);
+			ret = read(ready[0], &m, sizeof(int));
+			worker();
+		}
+	}
+
+	close(ready[0]);
+	gettimeofday(&start, NULL);
+	close(ready[1]);
+
+	for (i = 0; i < workers; i++) {
+		assert(waitpid(pids[i], &wait_stat, 0) == pids[i]);
+		assert(WIFEXITED(wait_stat) && !WEXITSTATUS(wait_stat));
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	free(pids);
+
+	total = (unsigned long long)workers * loops;
+	result_usec = diff.tv_sec * 1000000;
+	result_usec += diff.tv_usec;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %d workers forking %d children each\n\n",
+		       workers, loops);
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec/1000));
+
+		printf(" %14lf usecs/fork\n",
+		       (double)result_usec / (double)total);
+		printf(" %14d forks/sec\n",
+		       (int)((double)total /
+			     ((double)result_usec / (double)1000000)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / 1000));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -42,6 +42,9 @@ static struct bench_suite sched_suites[] = {
 	{ "pipe",
 	  "Flood of communication over pipe() between two processes",
 	  bench_sched_pipe      },
+	{ "fork",
+	  "Flood of fork() and exit() from several processes",
+	  bench_sched_fork      },
 	suite_all,
 	{ NULL,
 	  NULL,
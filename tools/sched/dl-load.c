@@ -0,0 +1,237 @@
+/*
+ * dl-load.c - periodic SCHED_DEADLINE load generator
+ *
+ * Spawns a number of threads, each running as a SCHED_DEADLINE task with
+ * the given runtime/deadline/period.  At every activation a thread burns
+ * a configurable amount of CPU time and then sleeps until the start of
+ * its next period.  At exit, activations, deadline misses and the worst
+ * observed lateness are reported for every thread.
+ *
+ * Licensed under the terms of the GNU GPL License version 2.
+ *
+ * Usage: dl-load [-n threads] [-r runtime_us] [-d deadline_us]
+ *                [-p period_us] [-w work_us] [-t seconds]
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#ifndef SCHED_DEADLINE
+#define SCHED_DEADLINE		6
+#endif
+
+#ifndef __NR_sched_setattr
+#if defined(__x86_64__)
+#define __NR_sched_setattr	313
+#elif defined(__i386__)
+#define __NR_sched_setattr	350
+#else
+#define __NR_sched_setattr	273
+#endif
+#endif
+
+struct sched_attr {
+	uint32_t size;
+	uint32_t sched_policy;
+	uint64_t sched_flags;
+	int32_t	 sched_nice;
+	uint32_t sched_priority;
+	uint64_t sched_runtime;
+	uint64_t sched_deadline;
+	uint64_t sched_period;
+};
+
+#define NSEC_PER_USEC	1000ULL
+#define NSEC_PER_SEC	1000000000ULL
+
+static unsigned int nr_threads = 1;
+static uint64_t runtime_us = 10000;
+static uint64_t deadline_us;
+static uint64_t period_us = 100000;
+static uint64_t work_us;
+static unsigned int duration = 10;
+static volatile int stop;
+
+struct thread_stats {
+	pthread_t thread;
+	int err;
+	unsigned long activations;
+	unsigned long misses;
+	uint64_t max_lateness;
+};
+
+static int sched_setattr(pid_t pid, const struct sched_attr *attr,
+			 unsigned int flags)
+{
+	return syscall(__NR_sched_setattr, pid, attr, flags);
+}
+
+static uint64_t ts_to_ns(const struct timespec *ts)
+{
+	return ts->tv_sec * NSEC_PER_SEC + ts->tv_nsec;
+}
+
+static void ns_to_ts(uint64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / NSEC_PER_SEC;
+	ts->tv_nsec = ns % NSEC_PER_SEC;
+}
+
+static uint64_t now_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return ts_to_ns(&ts);
+}
+
+/* Consume @ns of CPU time, as accounted to this thread */
+static void burn(uint64_t ns)
+{
+	uint64_t end = now_ns(CLOCK_THREAD_CPUTIME_ID) + ns;
+
+	while (now_ns(CLOCK_THREAD_CPUTIME_ID) < end)
+		;
+}
+
+static void *dl_thread(void *arg)
+{
+	struct thread_stats *st = arg;
+	struct sched_attr attr;
+	uint64_t next, dl, end;
+	struct timespec ts;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.sched_policy = SCHED_DEADLINE;
+	attr.sched_runtime = runtime_us * NSEC_PER_USEC;
+	attr.sched_deadline = deadline_us * NSEC_PER_USEC;
+	attr.sched_period = period_us * NSEC_PER_USEC;
+
+	if (sched_setattr(0, &attr, 0)) {
+		st->err = errno;
+		return NULL;
+	}
+
+	next = now_ns(CLOCK_MONOTONIC);
+	while (!stop) {
+		dl = next + deadline_us * NSEC_PER_USEC;
+
+		burn(work_us * NSEC_PER_USEC);
+
+		end = now_ns(CLOCK_MONOTONIC);
+		st->activations++;
+		if (end > dl) {
+			st->misses++;
+			if (end - dl > st->max_lateness)
+				st->max_lateness = end - dl;
+		}
+
+		next += period_us * NSEC_PER_USEC;
+		ns_to_ts(next, &ts);
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &ts, NULL) == EINTR)
+			;
+	}
+
+	return NULL;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr,
+		"usage: %s [-n threads] [-r runtime_us] [-d deadline_us]\n"
+		"       [-p period_us] [-w work_us] [-t seconds]\n", name);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct thread_stats *stats;
+	unsigned long misses = 0;
+	unsigned int i;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:r:d:p:w:t:")) != -1) {
+		switch (c) {
+		case 'n':
+			nr_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			runtime_us = strtoull(optarg, NULL, 0);
+			break;
+		case 'd':
+			deadline_us = strtoull(optarg, NULL, 0);
+			break;
+		case 'p':
+			period_us = strtoull(optarg, NULL, 0);
+			break;
+		case 'w':
+			work_us = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			duration = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (!deadline_us)
+		deadline_us = period_us;
+	if (!work_us)
+		work_us = runtime_us * 9 / 10;
+	if (!nr_threads || !runtime_us || runtime_us > deadline_us ||
+	    deadline_us > period_us)
+		usage(argv[0]);
+
+	stats = calloc(nr_threads, sizeof(*stats));
+	if (!stats) {
+		perror("calloc");
+		return 1;
+	}
+
+	printf("%u threads, runtime %llu us, deadline %llu us, "
+	       "period %llu us, work %llu us, %u s\n", nr_threads,
+	       (unsigned long long)runtime_us,
+	       (unsigned long long)deadline_us,
+	       (unsigned long long)period_us,
+	       (unsigned long long)work_us, duration);
+
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&stats[i].thread, NULL, dl_thread,
+				   &stats[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(duration);
+	stop = 1;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(stats[i].thread, NULL);
+		if (stats[i].err) {
+			printf("thread %2u: sched_setattr: %s\n", i,
+			       strerror(stats[i].err));
+			continue;
+		}
+		printf("thread %2u: %lu activations, %lu misses, "
+		       "max lateness %llu us\n", i,
+		       stats[i].activations, stats[i].misses,
+		       (unsigned long long)(stats[i].max_lateness /
+					    NSEC_PER_USEC));
+		misses += stats[i].misses;
+	}
+
+	free(stats);
+	return misses ? 2 : 0;
+}
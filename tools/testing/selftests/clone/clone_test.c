@@ -0,0 +1,457 @@
+/*
+ * Tests for the FICLONE, FICLONERANGE and FIDEDUPERANGE ioctls.
+ *
+ * Two files are set up with a different byte pattern per block, then a
+ * few fixed cases are run followed by a random sequence of writes, clones,
+ * dedupes, hole punches and truncates in the style of fsx.  A copy of both
+ * files is kept in memory and the contents are checked against it after
+ * every operation, both through the page cache and, every so often, after
+ * the page cache was dropped.  Writes over cloned blocks have to leave the
+ * other file alone, which is what exercises copy-on-write.
+ *
+ * The files are created in the current directory or in the directory given
+ * as the first argument; the second argument is the number of random
+ * operations and the third the random seed.  The test is skipped if the
+ * filesystem does not support cloning.
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/types.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifndef FICLONE
+struct file_clone_range {
+	__s64 src_fd;
+	__u64 src_offset;
+	__u64 src_length;
+	__u64 dest_offset;
+};
+
+#define FILE_DEDUPE_RANGE_SAME		0
+#define FILE_DEDUPE_RANGE_DIFFERS	1
+
+struct file_dedupe_range_info {
+	__s64 dest_fd;
+	__u64 dest_offset;
+	__u64 bytes_deduped;
+	__s32 status;
+	__u32 reserved;
+};
+
+struct file_dedupe_range {
+	__u64 src_offset;
+	__u64 src_length;
+	__u16 dest_count;
+	__u16 reserved1;
+	__u32 reserved2;
+	struct file_dedupe_range_info info[0];
+};
+
+#define FICLONE		_IOW(0x94, 9, int)
+#define FICLONERANGE	_IOW(0x94, 13, struct file_clone_range)
+#define FIDEDUPERANGE	_IOWR(0x94, 54, struct file_dedupe_range)
+#endif
+
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE		0x01
+#endif
+#ifndef FALLOC_FL_PUNCH_HOLE
+#define FALLOC_FL_PUNCH_HOLE		0x02
+#endif
+
+#define NR_BLOCKS	64
+#define MAX_BLOCKS	(2 * NR_BLOCKS)
+
+struct tfile {
+	int fd;
+	char *expect;
+	off_t size;
+	const char *name;
+};
+
+static struct tfile files[2];
+static size_t blksz;
+static char *buf;
+static int failed;
+static unsigned int pattern;
+
+static void fill(struct tfile *f, off_t off, size_t len)
+{
+	size_t i;
+
+	pattern++;
+	for (i = 0; i < len; i++)
+		f->expect[off + i] = ((off + i) / blksz) * 7 + pattern +
+				     (off + i) % 13 + 1;
+	if (pwrite(f->fd, f->expect + off, len, off) != (ssize_t)len) {
+		perror("pwrite");
+		exit(1);
+	}
+	if (off + (off_t)len > f->size)
+		f->size = off + len;
+}
+
+static int check_file(struct tfile *f, const char *test, int drop)
+{
+	struct stat st;
+	off_t i;
+
+	if (fstat(f->fd, &st)) {
+		perror("fstat");
+		exit(1);
+	}
+	if (st.st_size != f->size) {
+		printf("%s: %s size %lld, expected %lld\n", test, f->name,
+		       (long long)st.st_size, (long long)f->size);
+		return -1;
+	}
+	if (drop && (fsync(f->fd) ||
+		     posix_fadvise(f->fd, 0, 0, POSIX_FADV_DONTNEED))) {
+		perror("fsync/fadvise");
+		exit(1);
+	}
+	memset(buf, 0xff, f->size);
+	if (pread(f->fd, buf, f->size, 0) != f->size) {
+		perror("pread");
+		exit(1);
+	}
+	for (i = 0; i < f->size; i++) {
+		if (buf[i] != f->expect[i]) {
+			printf("%s: %s byte %lld is %d, expected %d%s\n",
+			       test, f->name, (long long)i, buf[i],
+			       f->expect[i],
+			       drop ? " after dropping caches" : "");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void check(const char *test, int drop, int verbose)
+{
+	if (check_file(&files[0], test, drop) ||
+	    check_file(&files[1], test, drop)) {
+		failed = 1;
+		return;
+	}
+	if (verbose)
+		printf("%s: ok\n", test);
+}
+
+static int do_clone(struct tfile *src, off_t soff, struct tfile *dst,
+		    off_t doff, off_t len)
+{
+	struct file_clone_range fcr;
+
+	fcr.src_fd = src->fd;
+	fcr.src_offset = soff;
+	fcr.src_length = len;
+	fcr.dest_offset = doff;
+	return ioctl(dst->fd, FICLONERANGE, &fcr);
+}
+
+static void model_clone(struct tfile *src, off_t soff, struct tfile *dst,
+			off_t doff, off_t len)
+{
+	if (!len)
+		len = src->size - soff;
+	if (doff > dst->size)
+		memset(dst->expect + dst->size, 0, doff - dst->size);
+	memmove(dst->expect + doff, src->expect + soff, len);
+	if (doff + len > dst->size)
+		dst->size = doff + len;
+}
+
+static void test_clone(struct tfile *src, off_t soff, struct tfile *dst,
+		       off_t doff, off_t len, const char *test)
+{
+	if (do_clone(src, soff, dst, doff, len)) {
+		printf("%s: %s\n", test, strerror(errno));
+		failed = 1;
+		return;
+	}
+	model_clone(src, soff, dst, doff, len);
+	check(test, 1, 1);
+}
+
+static void test_clone_fail(struct tfile *src, off_t soff, struct tfile *dst,
+			    off_t doff, off_t len, int expect_errno,
+			    const char *test)
+{
+	int ret = do_clone(src, soff, dst, doff, len);
+
+	if (!ret || errno != expect_errno) {
+		printf("%s: returned %d (%s), expected %s\n", test, ret,
+		       ret ? strerror(errno) : "success",
+		       strerror(expect_errno));
+		failed = 1;
+		return;
+	}
+	check(test, 0, 1);
+}
+
+static int do_dedupe(struct tfile *src, off_t soff, struct tfile *dst,
+		     off_t doff, off_t len, __u64 *deduped)
+{
+	struct {
+		struct file_dedupe_range fdr;
+		struct file_dedupe_range_info info;
+	} arg;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.fdr.src_offset = soff;
+	arg.fdr.src_length = len;
+	arg.fdr.dest_count = 1;
+	arg.info.dest_fd = dst->fd;
+	arg.info.dest_offset = doff;
+	if (ioctl(src->fd, FIDEDUPERANGE, &arg))
+		return -errno;
+	*deduped = arg.info.bytes_deduped;
+	return arg.info.status;
+}
+
+static void test_dedupe(struct tfile *src, off_t soff, struct tfile *dst,
+			off_t doff, off_t len, int expect_status,
+			const char *test)
+{
+	__u64 deduped = 0;
+	int status = do_dedupe(src, soff, dst, doff, len, &deduped);
+
+	if (status != expect_status ||
+	    (status == FILE_DEDUPE_RANGE_SAME && deduped != (__u64)len)) {
+		printf("%s: status %d, %llu bytes, expected %d\n", test,
+		       status, (unsigned long long)deduped, expect_status);
+		failed = 1;
+		return;
+	}
+	check(test, 1, 1);
+}
+
+static void punch(struct tfile *f, off_t off, off_t len)
+{
+	if (off >= f->size)
+		return;
+	if (fallocate(f->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+		      off, len)) {
+		perror("fallocate");
+		exit(1);
+	}
+	if (off + len > f->size)
+		len = f->size - off;
+	memset(f->expect + off, 0, len);
+}
+
+static void truncate_to(struct tfile *f, off_t size)
+{
+	if (ftruncate(f->fd, size)) {
+		perror("ftruncate");
+		exit(1);
+	}
+	if (size > f->size)
+		memset(f->expect + f->size, 0, size - f->size);
+	f->size = size;
+}
+
+/*
+ * Random operations on block sized units, with the odd unaligned write
+ * and truncate so that partial blocks at EOF are covered as well.
+ */
+static void random_ops(unsigned long nr_ops)
+{
+	unsigned long op;
+	char test[64];
+
+	for (op = 0; op < nr_ops; op++) {
+		struct tfile *a = &files[random() % 2];
+		struct tfile *b = &files[random() % 2];
+		off_t nblocks = a->size / blksz;
+		off_t soff, doff, len;
+		__u64 deduped;
+
+		snprintf(test, sizeof(test), "random op %lu", op);
+		switch (random() % 6) {
+		case 0:
+			soff = random() % (MAX_BLOCKS * blksz - 1);
+			len = 1 + random() % (8 * blksz);
+			if (soff + len > MAX_BLOCKS * (off_t)blksz)
+				len = MAX_BLOCKS * blksz - soff;
+			if (soff > a->size)
+				memset(a->expect + a->size, 0,
+				       soff - a->size);
+			fill(a, soff, len);
+			break;
+		case 1:
+		case 2:
+			if (!nblocks)
+				continue;
+			soff = (random() % nblocks) * blksz;
+			len = (1 + random() % 16) * blksz;
+			if (soff + len > nblocks * (off_t)blksz)
+				len = nblocks * blksz - soff;
+			doff = (random() % (MAX_BLOCKS - len / blksz)) * blksz;
+			if (a == b && soff < doff + len && doff < soff + len)
+				continue;
+			if (do_clone(a, soff, b, doff, len)) {
+				printf("%s: clone %s %lld+%lld to %s %lld: %s\n",
+				       test, a->name, (long long)soff,
+				       (long long)len, b->name,
+				       (long long)doff, strerror(errno));
+				failed = 1;
+				return;
+			}
+			model_clone(a, soff, b, doff, len);
+			break;
+		case 3:
+			if (!nblocks || a == b)
+				continue;
+			soff = (random() % nblocks) * blksz;
+			len = (1 + random() % 8) * blksz;
+			if (soff + len > nblocks * (off_t)blksz)
+				len = nblocks * blksz - soff;
+			doff = (random() % nblocks) * blksz;
+			if (doff + len > b->size)
+				continue;
+			/* sometimes make the ranges identical first */
+			if (random() % 2) {
+				memcpy(b->expect + doff, a->expect + soff, len);
+				if (pwrite(b->fd, b->expect + doff, len, doff)
+				    != len) {
+					perror("pwrite");
+					exit(1);
+				}
+			}
+			if (do_dedupe(a, soff, b, doff, len, &deduped) < 0) {
+				printf("%s: dedupe: %s\n", test,
+				       strerror(errno));
+				failed = 1;
+				return;
+			}
+			break;
+		case 4:
+			if (!nblocks)
+				continue;
+			soff = (random() % nblocks) * blksz;
+			punch(a, soff, (1 + random() % 4) * blksz);
+			break;
+		case 5:
+			truncate_to(a, random() % (MAX_BLOCKS * blksz));
+			break;
+		}
+
+		check(test, random() % 8 == 0, 0);
+		if (failed)
+			return;
+	}
+	check("random operations", 1, 1);
+}
+
+static void open_file(struct tfile *f, const char *dir, const char *name)
+{
+	char path[4096];
+
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+	f->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (f->fd < 0) {
+		perror("open");
+		exit(1);
+	}
+	unlink(path);
+	f->name = name;
+	f->size = 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = argc > 1 ? argv[1] : ".";
+	unsigned long nr_ops = argc > 2 ? strtoul(argv[2], NULL, 0) : 2000;
+	unsigned int seed = argc > 3 ? strtoul(argv[3], NULL, 0) : 1;
+	struct stat st;
+	int i;
+
+	open_file(&files[0], dir, "clone-test-file-a");
+	open_file(&files[1], dir, "clone-test-file-b");
+
+	if (fstat(files[0].fd, &st)) {
+		perror("fstat");
+		return 1;
+	}
+	blksz = st.st_blksize;
+	for (i = 0; i < 2; i++) {
+		files[i].expect = calloc(MAX_BLOCKS + 1, blksz);
+		if (!files[i].expect) {
+			perror("malloc");
+			return 1;
+		}
+	}
+	buf = malloc((MAX_BLOCKS + 1) * blksz);
+	if (!buf) {
+		perror("malloc");
+		return 1;
+	}
+
+	fill(&files[0], 0, NR_BLOCKS * blksz);
+	check("initial contents", 1, 1);
+
+	if (ioctl(files[1].fd, FICLONE, files[0].fd)) {
+		if (errno == EOPNOTSUPP || errno == ENOTTY ||
+		    errno == EINVAL) {
+			printf("clone: not supported, skipped\n");
+			return 0;
+		}
+		printf("clone whole file: %s\n", strerror(errno));
+		return 1;
+	}
+	model_clone(&files[0], 0, &files[1], 0, 0);
+	check("clone whole file", 1, 1);
+
+	/* both copies have to stay intact when either is written */
+	fill(&files[0], 2 * blksz, 3 * blksz);
+	check("write to source after clone", 0, 1);
+	check("write to source after clone", 1, 1);
+	fill(&files[1], blksz / 2, blksz);
+	check("unaligned write to clone", 1, 1);
+
+	test_clone(&files[0], 8 * blksz, &files[1], 20 * blksz, 4 * blksz,
+		   "clone range into other file");
+	test_clone(&files[0], 30 * blksz, &files[0], 40 * blksz, 5 * blksz,
+		   "clone range within a file");
+	test_clone(&files[1], 0, &files[1], NR_BLOCKS * blksz, 2 * blksz,
+		   "clone range beyond EOF");
+	fill(&files[0], NR_BLOCKS * blksz - 100, 50);
+	truncate_to(&files[0], NR_BLOCKS * blksz - 50);
+	test_clone(&files[0], (NR_BLOCKS - 1) * blksz, &files[1],
+		   files[1].size + blksz, 0, "clone partial EOF block");
+
+	test_clone_fail(&files[0], blksz / 2, &files[1], 0, blksz, EINVAL,
+			"clone unaligned range");
+	test_clone_fail(&files[0], 0, &files[0], blksz, 4 * blksz, EINVAL,
+			"clone overlapping range");
+	test_clone_fail(&files[0], files[0].size, &files[1], 0, blksz, EINVAL,
+			"clone beyond source EOF");
+
+	test_dedupe(&files[0], 30 * blksz, &files[0], 40 * blksz, 5 * blksz,
+		    FILE_DEDUPE_RANGE_SAME, "dedupe identical range");
+	test_dedupe(&files[0], 0, &files[1], 10 * blksz, 2 * blksz,
+		    FILE_DEDUPE_RANGE_DIFFERS, "dedupe different range");
+
+	srandom(seed);
+	random_ops(nr_ops);
+
+	close(files[0].fd);
+	close(files[1].fd);
+	if (failed) {
+		printf("[FAIL]\n");
+		return 1;
+	}
+	printf("[PASS]\n");
+	return 0;
+}
@@ -0,0 +1,287 @@
+/*
+ * Tests for the FALLOC_FL_COLLAPSE_RANGE, FALLOC_FL_INSERT_RANGE and
+ * FALLOC_FL_ZERO_RANGE fallocate() modes.
+ *
+ * A file is filled with a different byte pattern per block, the ranges
+ * are collapsed, inserted and zeroed and the contents are checked against
+ * a copy kept in memory, both through the page cache right away and after
+ * the page cache was dropped.  The file is created in the current
+ * directory or in the directory given as the first argument.  tmpfs,
+ * which doesn't support these modes, must reject them with EOPNOTSUPP.
+ *
+ * Licensed under the terms of the GNU GPL License version 2
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/vfs.h>
+
+#ifndef FALLOC_FL_KEEP_SIZE
+#define FALLOC_FL_KEEP_SIZE		0x01
+#endif
+#ifndef FALLOC_FL_PUNCH_HOLE
+#define FALLOC_FL_PUNCH_HOLE		0x02
+#endif
+#ifndef FALLOC_FL_COLLAPSE_RANGE
+#define FALLOC_FL_COLLAPSE_RANGE	0x08
+#endif
+#ifndef FALLOC_FL_ZERO_RANGE
+#define FALLOC_FL_ZERO_RANGE		0x10
+#endif
+#ifndef FALLOC_FL_INSERT_RANGE
+#define FALLOC_FL_INSERT_RANGE		0x20
+#endif
+
+#define TMPFS_MAGIC	0x01021994
+
+#define NR_BLOCKS	64
+
+static int fd;
+static size_t blksz;
+static char *expect;
+static off_t expect_size;
+static char *buf;
+static int failed;
+
+static void fill(off_t off, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		expect[off + i] = ((off + i) / blksz) * 7 + (off + i) % 13 + 1;
+	if (pwrite(fd, expect + off, len, off) != (ssize_t)len) {
+		perror("pwrite");
+		exit(1);
+	}
+}
+
+static void check(const char *test)
+{
+	struct stat st;
+	off_t i;
+	int pass;
+
+	if (fstat(fd, &st)) {
+		perror("fstat");
+		exit(1);
+	}
+	if (st.st_size != expect_size) {
+		printf("%s: size %lld, expected %lld\n", test,
+		       (long long)st.st_size, (long long)expect_size);
+		failed = 1;
+		return;
+	}
+
+	/* through the page cache, then from disk */
+	for (pass = 0; pass < 2; pass++) {
+		if (pass) {
+			if (fsync(fd) ||
+			    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED)) {
+				perror("fsync/fadvise");
+				exit(1);
+			}
+		}
+		memset(buf, 0xff, expect_size);
+		if (pread(fd, buf, expect_size, 0) != expect_size) {
+			perror("pread");
+			exit(1);
+		}
+		for (i = 0; i < expect_size; i++) {
+			if (buf[i] != expect[i]) {
+				printf("%s: byte %lld is %d, expected %d%s\n",
+				       test, (long long)i, buf[i], expect[i],
+				       pass ? " after dropping caches" : "");
+				failed = 1;
+				return;
+			}
+		}
+	}
+	printf("%s: ok\n", test);
+}
+
+static int do_fallocate(const char *test, int mode, off_t off, off_t len,
+			int expect_errno)
+{
+	int ret = fallocate(fd, mode, off, len);
+
+	if (ret && errno == EOPNOTSUPP && !expect_errno) {
+		printf("%s: not supported, skipped\n", test);
+		return -1;
+	}
+	if (expect_errno) {
+		if (!ret || errno != expect_errno) {
+			printf("%s: returned %d (%s), expected %s\n", test, ret,
+			       ret ? strerror(errno) : "success",
+			       strerror(expect_errno));
+			failed = 1;
+		} else {
+			printf("%s: ok\n", test);
+		}
+		return -1;
+	}
+	if (ret) {
+		printf("%s: %s\n", test, strerror(errno));
+		failed = 1;
+		return -1;
+	}
+	return 0;
+}
+
+static void test_collapse(off_t off, off_t len, const char *test)
+{
+	if (do_fallocate(test, FALLOC_FL_COLLAPSE_RANGE, off, len, 0))
+		return;
+	memmove(expect + off, expect + off + len, expect_size - off - len);
+	expect_size -= len;
+	check(test);
+}
+
+static void test_insert(off_t off, off_t len, const char *test)
+{
+	if (do_fallocate(test, FALLOC_FL_INSERT_RANGE, off, len, 0))
+		return;
+	memmove(expect + off + len, expect + off, expect_size - off);
+	memset(expect + off, 0, len);
+	expect_size += len;
+	check(test);
+}
+
+static void test_zero(off_t off, off_t len, int keep_size, const char *test)
+{
+	int mode = FALLOC_FL_ZERO_RANGE;
+
+	if (keep_size)
+		mode |= FALLOC_FL_KEEP_SIZE;
+	if (do_fallocate(test, mode, off, len, 0))
+		return;
+	if (off + len > expect_size) {
+		memset(expect + expect_size, 0, off + len - expect_size);
+		if (!keep_size)
+			expect_size = off + len;
+	}
+	memset(expect + off, 0, len);
+	check(test);
+}
+
+/* tmpfs only knows about preallocation and punching holes */
+static void test_tmpfs(const char *dir)
+{
+	char path[4096];
+	struct statfs sfs;
+	int file_fd;
+
+	if (statfs(dir, &sfs) || sfs.f_type != TMPFS_MAGIC) {
+		printf("tmpfs: no tmpfs mounted at %s, skipped\n", dir);
+		return;
+	}
+
+	snprintf(path, sizeof(path), "%s/fallocate-test-file", dir);
+	file_fd = fd;
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror("open");
+		exit(1);
+	}
+	unlink(path);
+	if (ftruncate(fd, NR_BLOCKS * blksz)) {
+		perror("ftruncate");
+		exit(1);
+	}
+
+	do_fallocate("tmpfs collapse range", FALLOC_FL_COLLAPSE_RANGE,
+		     0, blksz, EOPNOTSUPP);
+	do_fallocate("tmpfs insert range", FALLOC_FL_INSERT_RANGE,
+		     0, blksz, EOPNOTSUPP);
+	do_fallocate("tmpfs zero range", FALLOC_FL_ZERO_RANGE,
+		     0, blksz, EOPNOTSUPP);
+	do_fallocate("tmpfs zero range with keep size",
+		     FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+		     0, blksz, EOPNOTSUPP);
+
+	close(fd);
+	fd = file_fd;
+}
+
+int main(int argc, char **argv)
+{
+	char path[4096];
+	struct stat st;
+
+	snprintf(path, sizeof(path), "%s/fallocate-test-file",
+		 argc > 1 ? argv[1] : ".");
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror("open");
+		return 1;
+	}
+	unlink(path);
+
+	if (fstat(fd, &st)) {
+		perror("fstat");
+		return 1;
+	}
+	blksz = st.st_blksize;
+	expect = calloc(2 * NR_BLOCKS, blksz);
+	buf = malloc(2 * NR_BLOCKS * blksz);
+	if (!expect || !buf) {
+		perror("malloc");
+		return 1;
+	}
+
+	expect_size = NR_BLOCKS * blksz;
+	fill(0, expect_size);
+	check("initial contents");
+
+	/* invalid requests */
+	do_fallocate("collapse unaligned range", FALLOC_FL_COLLAPSE_RANGE,
+		     blksz / 2, blksz, EINVAL);
+	do_fallocate("collapse up to EOF", FALLOC_FL_COLLAPSE_RANGE,
+		     expect_size - blksz, blksz, EINVAL);
+	do_fallocate("collapse with keep size",
+		     FALLOC_FL_COLLAPSE_RANGE | FALLOC_FL_KEEP_SIZE,
+		     0, blksz, EINVAL);
+	do_fallocate("insert beyond EOF", FALLOC_FL_INSERT_RANGE,
+		     expect_size, blksz, EINVAL);
+	do_fallocate("insert unaligned range", FALLOC_FL_INSERT_RANGE,
+		     blksz, blksz / 2, EINVAL);
+	do_fallocate("zero range with punch hole",
+		     FALLOC_FL_ZERO_RANGE | FALLOC_FL_PUNCH_HOLE |
+		     FALLOC_FL_KEEP_SIZE, 0, blksz, EOPNOTSUPP);
+
+	/* some of the data is still dirty in the page cache */
+	test_collapse(2 * blksz, 3 * blksz, "collapse written range");
+	fill(4 * blksz, 2 * blksz + 100);
+	test_collapse(0, blksz, "collapse dirty range at start");
+	test_collapse(10 * blksz, 20 * blksz, "collapse large range");
+
+	test_insert(3 * blksz, 2 * blksz, "insert range");
+	fill(blksz, 4 * blksz);
+	test_insert(0, blksz, "insert dirty range at start");
+	test_insert(expect_size - blksz, 8 * blksz, "insert before last block");
+	test_collapse(expect_size - 9 * blksz, 8 * blksz, "collapse inserted hole");
+
+	test_zero(blksz + 100, 3 * blksz, 0, "zero unaligned range");
+	fill(6 * blksz, blksz);
+	test_zero(6 * blksz + 10, 20, 0, "zero inside a block");
+	test_zero(8 * blksz, 4 * blksz, 0, "zero aligned range");
+	test_zero(expect_size - blksz / 2, 4 * blksz, 1,
+		  "zero beyond EOF keeping the size");
+	test_zero(expect_size - blksz / 2, 4 * blksz, 0,
+		  "zero beyond EOF extending the file");
+
+	test_tmpfs("/dev/shm");
+
+	close(fd);
+	if (failed) {
+		printf("[FAIL]\n");
+		return 1;
+	}
+	printf("[PASS]\n");
+	return 0;
+}